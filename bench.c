@@ -0,0 +1,729 @@
+/*****************************************************************************
+ *  Written by Chris Dunlap <cdunlap@llnl.gov>.
+ *  Copyright (C) 2007-2016 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  UCRL-CODE-2002-009.
+ *
+ *  This file is part of ConMan: The Console Manager.
+ *  For details, see <https://dun.github.io/conman/>.
+ *
+ *  ConMan is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  ConMan is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with ConMan.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+/*  Microbenchmarks for the daemon's data-path primitives, run via
+ *    "make bench".  Each benchmark drives the daemon's own routines
+ *    directly (without the i/o threads) and prints its results in the
+ *    Prometheus text format so they can be tracked across upgrades:
+ *    - obj_ring:        write_obj_data() into an obj's circular-buffer,
+ *                       drained to /dev/null by write_to_obj()
+ *    - log_data:        write_log_data() for each logopt combination,
+ *                       drained to /dev/null by the log writer threads
+ *    - telnet_escapes:  process_telnet_escapes() on terminal server output
+ *    - client_escapes:  process_client_escapes() on escape-stuffed input
+ *    - tpoll_fds:       tpoll_wait() over BENCH_NUM_FDS fds
+ *    - tpoll_timers:    arming, cancelling, and dispatching timers
+ *    - list_*:          list.c appends, iteration, and searches
+ *  The input corpora are those of the test consoles (see server-test.c):
+ *    boot logs, binary BIOS screens, IAC-heavy streams, and random bytes.
+ */
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <sys/types.h>                  /* include before in.h for bsd */
+#include <netinet/in.h>                 /* include before telnet.h for bsd */
+#include <arpa/telnet.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "common.h"
+#include "list.h"
+#include "log.h"
+#include "server.h"
+#include "tpoll.h"
+#include "util-file.h"
+#include "util-str.h"
+#include "util.h"
+#include "wrapper.h"
+
+
+#define BENCH_CORPUS_SIZE               (1024 * 1024)
+#define BENCH_CORPUS_PASSES             32
+#define BENCH_CHUNK_SIZE                (OBJ_CHUNK_SIZE - 1)
+#define BENCH_NUM_FDS                   10000
+#define BENCH_NUM_READY_FDS             100
+#define BENCH_NUM_TIMERS                10000
+#define BENCH_NUM_POLLS                 1000
+#define BENCH_LIST_SIZE                 10000
+#define BENCH_LIST_PASSES               1000
+
+
+typedef struct bench_corpus {
+    const char      *name;              /* corpus name reported in results   */
+    test_format_t    format;            /* test console payload format       */
+    unsigned char   *data;              /* corpus data                       */
+    int              len;               /* num bytes of corpus data          */
+} bench_corpus_t;
+
+
+static void create_bench_corpus(server_conf_t *conf, bench_corpus_t *c);
+static void stuff_bench_corpus(const bench_corpus_t *c, bench_corpus_t *s);
+static void report_bench(const char *bench, const char *label,
+    unsigned long numOps, unsigned long long numBytes,
+    const struct timeval *t0);
+static void bench_obj_ring(obj_t *obj, const bench_corpus_t *c);
+static void bench_log_data(server_conf_t *conf, const bench_corpus_t *c,
+    const char *logopts);
+static void bench_telnet_escapes(obj_t *telnet, const bench_corpus_t *c);
+static void bench_client_escapes(obj_t *client, const bench_corpus_t *c);
+static void bench_tpoll_fds(void);
+static void bench_tpoll_timers(void);
+static void expire_bench_timer(int *count);
+static void bench_list(void);
+static int find_bench_item(void *x, void *key);
+static int open_bench_sink(void);
+
+
+static bench_corpus_t benchCorpora[] = {
+    { "boot",   CONMAN_TEST_BOOT,   NULL, 0 },
+    { "bios",   CONMAN_TEST_BIOS,   NULL, 0 },
+    { "iac",    CONMAN_TEST_IAC,    NULL, 0 },
+    { "binary", CONMAN_TEST_BINARY, NULL, 0 },
+    { NULL,     0,                  NULL, 0 }
+};
+
+static const char *benchLogOpts[] = {
+    "nosanitize,notimestamp",
+    "sanitize,notimestamp",
+    "nosanitize,timestamp",
+    "sanitize,timestamp",
+#if WITH_ZLIB
+    "compress,nosanitize,notimestamp",
+    "compress,sanitize,timestamp",
+#endif /* WITH_ZLIB */
+    NULL
+};
+
+
+int main(int argc, char *argv[])
+{
+    server_conf_t *conf;
+    bench_corpus_t *c;
+    bench_corpus_t stuffed;
+    test_opt_t opts;
+    obj_t *console;
+    obj_t *telnet;
+    obj_t *client;
+    req_t *req;
+    pthread_t tid;
+    char errbuf[MAX_LINE];
+    int k;
+    int rc;
+
+    (void) argc;
+    (void) argv;
+
+    log_set_file(stderr, LOG_WARNING, 0);
+    conf = create_server_conf();
+
+    for (c = benchCorpora; c->name; c++) {
+        create_bench_corpus(conf, c);
+    }
+    for (k = 0; k < LOG_WRITERS; k++) {
+        if ((rc = pthread_create(&tid, NULL, process_log_writes, NULL)) != 0) {
+            log_err(rc, "Unable to create log writer thread");
+        }
+        x_pthread_detach(tid);
+    }
+    printf("# HELP conman_bench_ns_per_op Nanoseconds per operation.\n");
+    printf("# TYPE conman_bench_ns_per_op gauge\n");
+    printf("# HELP conman_bench_bytes_per_sec Bytes processed per second.\n");
+    printf("# TYPE conman_bench_bytes_per_sec gauge\n");
+
+    /*  The console obj's circular-buffer.
+     */
+    (void) init_test_opts(&opts);
+    if (!(console = create_test_obj(conf, "ring", &opts,
+            errbuf, sizeof(errbuf)))) {
+        log_err(0, "Unable to create test obj: %s", errbuf);
+    }
+    if (open_test_obj(console) < 0) {
+        log_err(0, "Unable to open test obj [%s]", console->name);
+    }
+    console->bufSize = conf->consoleBufSize;
+    for (c = benchCorpora; c->name; c++) {
+        bench_obj_ring(console, c);
+    }
+    /*  The logfile obj for each combination of logopts.
+     */
+    for (k = 0; benchLogOpts[k]; k++) {
+        for (c = benchCorpora; c->name; c++) {
+            bench_log_data(conf, c, benchLogOpts[k]);
+        }
+    }
+    /*  The telnet obj of an established terminal server connection.
+     *    The random bytes of the binary corpus are omitted since they form
+     *    invalid telnet cmds.
+     */
+    if (!(telnet = create_telnet_obj(conf, "telnet", "localhost", 23,
+            errbuf, sizeof(errbuf)))) {
+        log_err(0, "Unable to create telnet obj: %s", errbuf);
+    }
+    telnet->fd = open_bench_sink();
+    telnet->aux.telnet.state = CONMAN_TELNET_UP;
+    for (c = benchCorpora; c->name; c++) {
+        if (c->format != CONMAN_TEST_BINARY) {
+            bench_telnet_escapes(telnet, c);
+        }
+    }
+    /*  The client obj of a connected session.
+     */
+    req = create_req();
+    req->sd = open_bench_sink();
+    req->user = create_string("bench");
+    req->host = create_string("localhost");
+    req->fqdn = create_string("localhost");
+    req->command = CONMAN_CMD_CONNECT;
+    client = create_client_obj(conf, req);
+    for (c = benchCorpora; c->name; c++) {
+        stuff_bench_corpus(c, &stuffed);
+        bench_client_escapes(client, &stuffed);
+        free(stuffed.data);
+    }
+    bench_tpoll_fds();
+    bench_tpoll_timers();
+    bench_list();
+
+    if (fflush(stdout) != 0) {
+        log_err(errno, "Unable to write results");
+    }
+    return(0);
+}
+
+
+int get_io_thread_stats(int n, io_stats_t *stats)
+{
+/*  Stands in for the daemon's routine (see server.c) referenced by the
+ *    metrics listener since the benchmarks do not run the i/o threads.
+ */
+    (void) n;
+    (void) stats;
+    return(-1);
+}
+
+
+static void create_bench_corpus(server_conf_t *conf, bench_corpus_t *c)
+{
+/*  Generates the BENCH_CORPUS_SIZE bytes of the corpus (c) via a test obj
+ *    of its payload format.
+ */
+    test_opt_t opts;
+    obj_t *test;
+    char name[MAX_LINE];
+    char errbuf[MAX_LINE];
+
+    (void) init_test_opts(&opts);
+    opts.format = c->format;
+    snprintf(name, sizeof(name), "corpus-%s", c->name);
+    if (!(test = create_test_obj(conf, name, &opts, errbuf, sizeof(errbuf)))) {
+        log_err(0, "Unable to create test obj: %s", errbuf);
+    }
+    if (!(c->data = malloc(BENCH_CORPUS_SIZE))) {
+        out_of_memory();
+    }
+    c->len = BENCH_CORPUS_SIZE;
+    fill_test_data(test, c->data, c->len);
+    return;
+}
+
+
+static void stuff_bench_corpus(const bench_corpus_t *c, bench_corpus_t *s)
+{
+/*  Copies the corpus (c) into (s) as a client would send it, with each
+ *    occurrence of the escape char stuffed (ie, doubled).
+ *  The caller is responsible for freeing the data of (s).
+ */
+    const unsigned char *p;
+    unsigned char *q;
+
+    *s = *c;
+    if (!(s->data = malloc(2 * c->len))) {
+        out_of_memory();
+    }
+    for (p = c->data, q = s->data; p < c->data + c->len; p++) {
+        if (*p == ESC_CHAR) {
+            *q++ = ESC_CHAR;
+        }
+        *q++ = *p;
+    }
+    s->len = q - s->data;
+    return;
+}
+
+
+static void report_bench(const char *bench, const char *label,
+    unsigned long numOps, unsigned long long numBytes,
+    const struct timeval *t0)
+{
+/*  Prints the results of the (bench) performing (numOps) operations over
+ *    (numBytes) bytes since time (t0).  The (label) holds any extra labels
+ *    (eg, the corpus) in the Prometheus format, or is NULL.
+ */
+    struct timeval t1;
+    double secs;
+
+    if (gettimeofday(&t1, NULL) < 0) {
+        log_err(errno, "gettimeofday() failed");
+    }
+    secs = (t1.tv_sec - t0->tv_sec) + ((t1.tv_usec - t0->tv_usec) / 1e6);
+    if (secs <= 0.0) {
+        secs = 1e-6;
+    }
+    printf("conman_bench_ns_per_op{bench=\"%s\"%s%s} %.1f\n",
+        bench, (label ? "," : ""), (label ? label : ""),
+        (numOps > 0) ? (secs * 1e9 / numOps) : 0.0);
+    if (numBytes > 0) {
+        printf("conman_bench_bytes_per_sec{bench=\"%s\"%s%s} %.0f\n",
+            bench, (label ? "," : ""), (label ? label : ""),
+            numBytes / secs);
+    }
+    return;
+}
+
+
+static void bench_obj_ring(obj_t *obj, const bench_corpus_t *c)
+{
+/*  Benchmarks writing chunks of the corpus (c) into the circular-buffer of
+ *    the (obj), draining it out to its fd after each chunk.
+ */
+    struct timeval t0;
+    unsigned long numOps = 0;
+    unsigned long long numBytes = 0;
+    char label[MAX_LINE];
+    int pass;
+    int off;
+    int n;
+
+    if (gettimeofday(&t0, NULL) < 0) {
+        log_err(errno, "gettimeofday() failed");
+    }
+    for (pass = 0; pass < BENCH_CORPUS_PASSES; pass++) {
+        for (off = 0; off < c->len; off += n) {
+            n = MIN(BENCH_CHUNK_SIZE, c->len - off);
+            (void) write_obj_data(obj, c->data + off, n, 0);
+            (void) write_to_obj(obj);
+            numOps++;
+            numBytes += n;
+        }
+    }
+    snprintf(label, sizeof(label), "corpus=\"%s\"", c->name);
+    report_bench("obj_ring", label, numOps, numBytes, &t0);
+    return;
+}
+
+
+static void bench_log_data(server_conf_t *conf, const bench_corpus_t *c,
+    const char *logopts)
+{
+/*  Benchmarks writing chunks of the corpus (c) into a logfile obj with the
+ *    (logopts), with the log writer threads writing its data out to
+ *    /dev/null.  The logfile is drained after each chunk so no data is
+ *    overwritten, and the time includes waiting for the writers to finish.
+ */
+    logopt_t opts;
+    test_opt_t testOpts;
+    obj_t *console;
+    obj_t *logfile;
+    struct timeval t0;
+    unsigned long numOps = 0;
+    unsigned long long numBytes = 0;
+    char name[MAX_LINE];
+    char label[MAX_LINE];
+    char errbuf[MAX_LINE];
+    int pass;
+    int off;
+    int n;
+
+    /*  Each logfile requires its own console.
+     */
+    snprintf(name, sizeof(name), "log-%s-%s", logopts, c->name);
+    (void) init_test_opts(&testOpts);
+    if (!(console = create_test_obj(conf, name, &testOpts,
+            errbuf, sizeof(errbuf)))) {
+        log_err(0, "Unable to create test obj: %s", errbuf);
+    }
+    opts = conf->globalLogOpts;
+    opts.enableLock = 0;
+    if (parse_logfile_opts(&opts, logopts, errbuf, sizeof(errbuf)) < 0) {
+        log_err(0, "Unable to parse logopts \"%s\": %s", logopts, errbuf);
+    }
+    snprintf(name, sizeof(name), "bench-%s-%s.log", logopts, c->name);
+    if (!(logfile = create_logfile_obj(conf, name, console, &opts,
+            errbuf, sizeof(errbuf)))) {
+        log_err(0, "Unable to create logfile obj: %s", errbuf);
+    }
+    logfile->bufSize = conf->logBufSize;
+    logfile->fd = open_bench_sink();
+
+    if (gettimeofday(&t0, NULL) < 0) {
+        log_err(errno, "gettimeofday() failed");
+    }
+    for (pass = 0; pass < BENCH_CORPUS_PASSES; pass++) {
+        for (off = 0; off < c->len; off += n) {
+            n = MIN(BENCH_CHUNK_SIZE, c->len - off);
+            (void) write_log_data(logfile, c->data + off, n);
+            while ((write_to_obj(logfile) == 0)
+                    && (logfile->bufInPtr != logfile->bufOutPtr)) {
+                (void) poll(NULL, 0, 1);
+            }
+            numOps++;
+            numBytes += n;
+        }
+    }
+    close_log_writes(logfile, NULL);
+    sync_log_writes();
+
+    snprintf(label, sizeof(label), "logopts=\"%s\",corpus=\"%s\"",
+        logopts, c->name);
+    report_bench("log_data", label, numOps, numBytes, &t0);
+    return;
+}
+
+
+static void bench_telnet_escapes(obj_t *telnet, const bench_corpus_t *c)
+{
+/*  Benchmarks processing chunks of the corpus (c) received by the (telnet)
+ *    obj for IAC sequences.  Each chunk is first copied since it is modified
+ *    in place, and the replies to option negotiation are drained to its fd.
+ */
+    unsigned char buf[BENCH_CHUNK_SIZE];
+    struct timeval t0;
+    unsigned long numOps = 0;
+    unsigned long long numBytes = 0;
+    char label[MAX_LINE];
+    int pass;
+    int off;
+    int n;
+
+    if (gettimeofday(&t0, NULL) < 0) {
+        log_err(errno, "gettimeofday() failed");
+    }
+    for (pass = 0; pass < BENCH_CORPUS_PASSES; pass++) {
+        for (off = 0; off < c->len; off += n) {
+            n = MIN(BENCH_CHUNK_SIZE, c->len - off);
+            memcpy(buf, c->data + off, n);
+            (void) process_telnet_escapes(telnet, buf, n);
+            (void) write_to_obj(telnet);
+            numOps++;
+            numBytes += n;
+        }
+    }
+    snprintf(label, sizeof(label), "corpus=\"%s\"", c->name);
+    report_bench("telnet_escapes", label, numOps, numBytes, &t0);
+    return;
+}
+
+
+static void bench_client_escapes(obj_t *client, const bench_corpus_t *c)
+{
+/*  Benchmarks processing chunks of the escape-stuffed corpus (c) received
+ *    from the (client) obj for escape sequences.  Each chunk is first copied
+ *    since it is modified in place.
+ */
+    unsigned char buf[BENCH_CHUNK_SIZE];
+    struct timeval t0;
+    unsigned long numOps = 0;
+    unsigned long long numBytes = 0;
+    char label[MAX_LINE];
+    int pass;
+    int off;
+    int n;
+
+    if (gettimeofday(&t0, NULL) < 0) {
+        log_err(errno, "gettimeofday() failed");
+    }
+    for (pass = 0; pass < BENCH_CORPUS_PASSES; pass++) {
+        for (off = 0; off < c->len; off += n) {
+            n = MIN(BENCH_CHUNK_SIZE, c->len - off);
+            memcpy(buf, c->data + off, n);
+            (void) process_client_escapes(client, buf, n);
+            numOps++;
+            numBytes += n;
+        }
+    }
+    snprintf(label, sizeof(label), "corpus=\"%s\"", c->name);
+    report_bench("client_escapes", label, numOps, numBytes, &t0);
+    return;
+}
+
+
+static void bench_tpoll_fds(void)
+{
+/*  Benchmarks registering BENCH_NUM_FDS fds with tpoll, and then waiting on
+ *    them with BENCH_NUM_READY_FDS of them ready for reading.
+ *  The fds are dups of two pipes, one of which never has data.  If the fd
+ *    limit cannot be raised high enough, fewer fds are used.
+ */
+    struct rlimit limit;
+    tpoll_t tp;
+    tpoll_event_t events[MUX_IO_MAX_EVENTS];
+    int idle[2];
+    int ready[2];
+    int *fds;
+    int numFds;
+    struct timeval t0;
+    char label[MAX_LINE];
+    int k;
+
+    numFds = BENCH_NUM_FDS;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0) {
+        if (limit.rlim_cur < (rlim_t) numFds + 64) {
+            limit.rlim_cur = MIN(limit.rlim_max, (rlim_t) numFds + 64);
+            (void) setrlimit(RLIMIT_NOFILE, &limit);
+            (void) getrlimit(RLIMIT_NOFILE, &limit);
+        }
+        numFds = MIN(numFds, (int) limit.rlim_cur - 64);
+    }
+    if (!(fds = malloc(numFds * sizeof(int)))) {
+        out_of_memory();
+    }
+    if ((pipe(idle) < 0) || (pipe(ready) < 0)) {
+        log_err(errno, "Unable to create pipe");
+    }
+    if (write(ready[1], "x", 1) != 1) {
+        log_err(errno, "Unable to write to pipe");
+    }
+    for (k = 0; k < numFds; k++) {
+        if ((fds[k] = dup((k % (numFds / BENCH_NUM_READY_FDS) == 0)
+                ? ready[0] : idle[0])) < 0) {
+            log_err(errno, "Unable to dup fd");
+        }
+    }
+    if (!(tp = tpoll_create(0))) {
+        log_err(0, "Unable to create tpoll obj");
+    }
+    snprintf(label, sizeof(label), "fds=\"%d\"", numFds);
+
+    if (gettimeofday(&t0, NULL) < 0) {
+        log_err(errno, "gettimeofday() failed");
+    }
+    for (k = 0; k < numFds; k++) {
+        (void) tpoll_set_arg(tp, fds[k], POLLIN, &fds[k]);
+    }
+    report_bench("tpoll_fds_set", label, numFds, 0, &t0);
+
+    if (gettimeofday(&t0, NULL) < 0) {
+        log_err(errno, "gettimeofday() failed");
+    }
+    for (k = 0; k < BENCH_NUM_POLLS; k++) {
+        if (tpoll_wait(tp, events, MUX_IO_MAX_EVENTS, 0) < 0) {
+            log_err(errno, "tpoll_wait() failed");
+        }
+    }
+    report_bench("tpoll_fds_wait", label, BENCH_NUM_POLLS, 0, &t0);
+
+    /*  Toggle POLLOUT as the i/o threads do whenever an obj has data.
+     */
+    if (gettimeofday(&t0, NULL) < 0) {
+        log_err(errno, "gettimeofday() failed");
+    }
+    for (k = 0; k < numFds; k++) {
+        (void) tpoll_set_arg(tp, fds[k], POLLOUT, &fds[k]);
+        (void) tpoll_clear(tp, fds[k], POLLOUT);
+    }
+    report_bench("tpoll_fds_toggle", label, numFds, 0, &t0);
+
+    tpoll_destroy(tp);
+    for (k = 0; k < numFds; k++) {
+        (void) close(fds[k]);
+    }
+    (void) close(idle[0]);
+    (void) close(idle[1]);
+    (void) close(ready[0]);
+    (void) close(ready[1]);
+    free(fds);
+    return;
+}
+
+
+static void bench_tpoll_timers(void)
+{
+/*  Benchmarks arming and cancelling BENCH_NUM_TIMERS tpoll timers spread
+ *    over 10 secs, and then arming and dispatching that many expired timers.
+ */
+    tpoll_t tp;
+    int *ids;
+    struct timeval t0;
+    char label[MAX_LINE];
+    int count = 0;
+    int k;
+
+    if (!(ids = malloc(BENCH_NUM_TIMERS * sizeof(int)))) {
+        out_of_memory();
+    }
+    if (!(tp = tpoll_create(0))) {
+        log_err(0, "Unable to create tpoll obj");
+    }
+    snprintf(label, sizeof(label), "timers=\"%d\"", BENCH_NUM_TIMERS);
+
+    if (gettimeofday(&t0, NULL) < 0) {
+        log_err(errno, "gettimeofday() failed");
+    }
+    for (k = 0; k < BENCH_NUM_TIMERS; k++) {
+        ids[k] = tpoll_timeout_relative(tp, (callback_f) expire_bench_timer,
+            &count, 1000 + ((k * 7919) % 10000));
+    }
+    report_bench("tpoll_timers_arm", label, BENCH_NUM_TIMERS, 0, &t0);
+
+    if (gettimeofday(&t0, NULL) < 0) {
+        log_err(errno, "gettimeofday() failed");
+    }
+    for (k = 0; k < BENCH_NUM_TIMERS; k++) {
+        (void) tpoll_timeout_cancel(tp, ids[k]);
+    }
+    report_bench("tpoll_timers_cancel", label, BENCH_NUM_TIMERS, 0, &t0);
+
+    if (gettimeofday(&t0, NULL) < 0) {
+        log_err(errno, "gettimeofday() failed");
+    }
+    for (k = 0; k < BENCH_NUM_TIMERS; k++) {
+        (void) tpoll_timeout_relative(tp, (callback_f) expire_bench_timer,
+            &count, 0);
+    }
+    while (count < BENCH_NUM_TIMERS) {
+        if (tpoll(tp, 0) < 0) {
+            log_err(errno, "tpoll() failed");
+        }
+    }
+    report_bench("tpoll_timers_dispatch", label, BENCH_NUM_TIMERS, 0, &t0);
+
+    tpoll_destroy(tp);
+    free(ids);
+    return;
+}
+
+
+static void expire_bench_timer(int *count)
+{
+/*  Counts the dispatch of a benchmark timer.
+ */
+    (*count)++;
+    return;
+}
+
+
+static void bench_list(void)
+{
+/*  Benchmarks building a list of BENCH_LIST_SIZE items, iterating over it,
+ *    searching it for its last item, and deleting its items via an iterator.
+ */
+    List l;
+    ListIterator i;
+    int *items;
+    struct timeval t0;
+    char label[MAX_LINE];
+    unsigned long sum = 0;
+    int pass;
+    int k;
+    int *x;
+
+    if (!(items = malloc(BENCH_LIST_SIZE * sizeof(int)))) {
+        out_of_memory();
+    }
+    for (k = 0; k < BENCH_LIST_SIZE; k++) {
+        items[k] = k;
+    }
+    snprintf(label, sizeof(label), "items=\"%d\"", BENCH_LIST_SIZE);
+
+    if (gettimeofday(&t0, NULL) < 0) {
+        log_err(errno, "gettimeofday() failed");
+    }
+    l = list_create(NULL);
+    for (k = 0; k < BENCH_LIST_SIZE; k++) {
+        list_append(l, &items[k]);
+    }
+    report_bench("list_append", label, BENCH_LIST_SIZE, 0, &t0);
+
+    if (gettimeofday(&t0, NULL) < 0) {
+        log_err(errno, "gettimeofday() failed");
+    }
+    i = list_iterator_create(l);
+    for (pass = 0; pass < BENCH_LIST_PASSES; pass++) {
+        while ((x = list_next(i))) {
+            sum += *x;
+        }
+        list_iterator_reset(i);
+    }
+    list_iterator_destroy(i);
+    report_bench("list_iterate", label,
+        (unsigned long) BENCH_LIST_PASSES * BENCH_LIST_SIZE, 0, &t0);
+
+    if (gettimeofday(&t0, NULL) < 0) {
+        log_err(errno, "gettimeofday() failed");
+    }
+    for (pass = 0; pass < BENCH_LIST_PASSES; pass++) {
+        if ((x = list_find_first(l, (ListFindF) find_bench_item,
+                &items[BENCH_LIST_SIZE - 1]))) {
+            sum += *x;
+        }
+    }
+    report_bench("list_find_first", label, BENCH_LIST_PASSES, 0, &t0);
+
+    if (gettimeofday(&t0, NULL) < 0) {
+        log_err(errno, "gettimeofday() failed");
+    }
+    i = list_iterator_create(l);
+    while (list_next(i)) {
+        (void) list_delete(i);
+    }
+    list_iterator_destroy(i);
+    report_bench("list_delete", label, BENCH_LIST_SIZE, 0, &t0);
+
+    list_destroy(l);
+    free(items);
+    DPRINTF((1, "List checksum is %lu.\n", sum));
+    return;
+}
+
+
+static int find_bench_item(void *x, void *key)
+{
+/*  List helper function for finding the item 'key'.
+ */
+    return(*(int *) x == *(int *) key);
+}
+
+
+static int open_bench_sink(void)
+{
+/*  Returns a non-blocking fd on /dev/null to which obj data is drained.
+ */
+    int fd;
+
+    if ((fd = open("/dev/null", O_WRONLY | O_NONBLOCK)) < 0) {
+        log_err(errno, "Unable to open \"/dev/null\"");
+    }
+    set_fd_closed_on_exec(fd);
+    return(fd);
+}
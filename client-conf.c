@@ -36,7 +36,11 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
+#if WITH_ZLIB
+#  include <zlib.h>
+#endif /* WITH_ZLIB */
 #include "client.h"
 #include "common.h"
 #include "list.h"
@@ -47,6 +51,9 @@
 
 
 static void read_consoles_from_file(List consoles, char *file);
+static void parse_log_range(req_t *req, char *str);
+static time_t parse_log_time(const char *str);
+static off_t parse_log_count(const char *str, int gotSuffix);
 static void display_client_help(client_conf_t *conf);
 
 
@@ -91,10 +98,15 @@ client_conf_t * create_client_conf(void)
     conf->escapeChar = DEFAULT_CLIENT_ESCAPE;
     conf->log = NULL;
     conf->logd = -1;
+    conf->logPipe[0] = conf->logPipe[1] = -1;
+    conf->outPipe[0] = conf->outPipe[1] = -1;
+    conf->zstream = NULL;
+    conf->mux = NULL;
     conf->errnum = CONMAN_ERR_NONE;
     conf->errmsg = NULL;
     conf->enableVerbose = 0;
     conf->isClosedByClient = 0;
+    conf->isOutSpliced = 0;
 
     return(conf);
 }
@@ -117,6 +129,13 @@ void destroy_client_conf(client_conf_t *conf)
     }
     if (conf->errmsg)
         free(conf->errmsg);
+#if WITH_ZLIB
+    if (conf->zstream) {
+        (void) inflateEnd(conf->zstream);
+        free(conf->zstream);
+    }
+#endif /* WITH_ZLIB */
+    destroy_client_mux(conf->mux);
 
     free(conf);
     return;
@@ -162,7 +181,7 @@ void process_client_cmd_line(int argc, char *argv[], client_conf_t *conf)
         conf->prog = create_string(argv[0]);
 
     opterr = 0;
-    while ((c = getopt(argc, argv, "bd:e:fF:hjl:LmqQrvV")) != -1) {
+    while ((c = getopt(argc, argv, "bd:e:fF:hjl:Lmn:N:qQrt:vVxz")) != -1) {
         switch(c) {
         case 'b':
             conf->req->enableBroadcast = 1;
@@ -207,6 +226,16 @@ void process_client_cmd_line(int argc, char *argv[], client_conf_t *conf)
         case 'm':
             conf->req->command = CONMAN_CMD_MONITOR;
             break;
+        case 'n':
+            conf->req->command = CONMAN_CMD_MONITOR;
+            conf->req->logLines = parse_log_count(optarg, 0);
+            conf->req->logBytes = 0;
+            break;
+        case 'N':
+            conf->req->command = CONMAN_CMD_MONITOR;
+            conf->req->logBytes = parse_log_count(optarg, 1);
+            conf->req->logLines = 0;
+            break;
         case 'q':
             conf->req->command = CONMAN_CMD_QUERY;
             break;
@@ -216,12 +245,26 @@ void process_client_cmd_line(int argc, char *argv[], client_conf_t *conf)
         case 'r':
             conf->req->enableRegex = 1;
             break;
+        case 't':
+            conf->req->command = CONMAN_CMD_MONITOR;
+            parse_log_range(conf->req, optarg);
+            break;
         case 'v':
             conf->enableVerbose = 1;
             break;
         case 'V':
             printf("%s-%s%s\n", PROJECT, VERSION, CLIENT_FEATURES);
             exit(0);
+        case 'x':
+            conf->req->enableMux = 1;
+            break;
+        case 'z':
+#if WITH_ZLIB
+            conf->req->enableCompress = 1;
+#else  /* !WITH_ZLIB */
+            log_err(0, "CMDLINE: compression not supported (requires zlib)");
+#endif /* !WITH_ZLIB */
+            break;
         case '?':                       /* invalid option */
             log_err(0, "CMDLINE: invalid option \"%c\"", optopt);
             exit(1);
@@ -238,6 +281,18 @@ void process_client_cmd_line(int argc, char *argv[], client_conf_t *conf)
         conf->req->enableForce = 0;
         conf->req->enableJoin = 0;
     }
+    /*  A multiplexed session frames the output of each console separately,
+     *    so it need not broadcast.  But it cannot replay a range of the log.
+     */
+    if (conf->req->enableMux) {
+        if (is_log_range_req(conf->req))
+            log_err(0, "CMDLINE: -x cannot be used with -n, -N, or -t");
+        conf->req->enableBroadcast = 0;
+    }
+    /*  Verbose mode also lists the status of each console queried.
+     */
+    if ((conf->req->command == CONMAN_CMD_QUERY) && conf->enableVerbose)
+        conf->req->enableStatus = 1;
 
     for (i=optind; i<argc; i++) {
 
@@ -312,6 +367,122 @@ static void read_consoles_from_file(List consoles, char *file)
 }
 
 
+static void parse_log_range(req_t *req, char *str)
+{
+/*  Parses the console log replay time range 'str' of the form
+ *    "SINCE[,UNTIL]" into the request's logSince & logUntil times.
+ *  Either time may be omitted (eg, ",UNTIL") to leave that end open.
+ */
+    char *p;
+
+    assert(req != NULL);
+    assert(str != NULL);
+
+    if ((p = strchr(str, ',')))
+        *p++ = '\0';
+    req->logSince = (*str) ? parse_log_time(str) : 0;
+    req->logUntil = (p && *p) ? parse_log_time(p) : 0;
+
+    if (!req->logSince && !req->logUntil)
+        log_err(0, "CMDLINE: invalid log time range");
+    if (req->logUntil && (req->logUntil < req->logSince))
+        log_err(0, "CMDLINE: log time range ends before it begins");
+    return;
+}
+
+
+static time_t parse_log_time(const char *str)
+{
+/*  Parses the local time 'str' given as "YYYY-MM-DD [HH:MM[:SS]]",
+ *    "HH:MM[:SS]" (for today), or "@SECONDS" (since the epoch).
+ *  Returns the corresponding time; o/w, exits on error.
+ */
+    const char *p = str;
+    struct tm tm;
+    time_t t;
+    long n;
+    int year, mon, day;
+    int hour, min, sec;
+    int len = 0;
+
+    assert(str != NULL);
+
+    if (*p == '@') {
+        if ((sscanf(++p, "%ld%n", &n, &len) != 1)
+                || (p[len] != '\0') || (n <= 0))
+            log_err(0, "CMDLINE: invalid log time \"%s\"", str);
+        return((time_t) n);
+    }
+    t = time(NULL);
+    if (!localtime_r(&t, &tm))
+        log_err(errno, "localtime_r() failed");
+
+    if (sscanf(p, "%d-%d-%d%n", &year, &mon, &day, &len) == 3) {
+        tm.tm_year = year - 1900;
+        tm.tm_mon = mon - 1;
+        tm.tm_mday = day;
+        tm.tm_hour = tm.tm_min = tm.tm_sec = 0;
+        p += len;
+        if ((*p == ' ') || (*p == 'T'))
+            p++;
+        else if (*p != '\0')
+            log_err(0, "CMDLINE: invalid log time \"%s\"", str);
+    }
+    if (*p != '\0') {
+        len = 0;
+        sec = 0;
+        if ((sscanf(p, "%d:%d%n:%d%n", &hour, &min, &len, &sec, &len) < 2)
+                || (p[len] != '\0'))
+            log_err(0, "CMDLINE: invalid log time \"%s\"", str);
+        tm.tm_hour = hour;
+        tm.tm_min = min;
+        tm.tm_sec = sec;
+    }
+    tm.tm_isdst = -1;
+    if ((t = mktime(&tm)) == (time_t) -1)
+        log_err(0, "CMDLINE: invalid log time \"%s\"", str);
+    return(t);
+}
+
+
+static off_t parse_log_count(const char *str, int gotSuffix)
+{
+/*  Parses the positive count 'str' of console log lines or bytes to replay.
+ *  If 'gotSuffix' is true, the count may be followed by a single-character
+ *    modifier: 'k' for KiB, 'm' for MiB, or 'g' for GiB.
+ *  Returns the count; o/w, exits on error.
+ */
+    char *p;
+    long long n;
+
+    assert(str != NULL);
+
+    errno = 0;
+    n = strtoll(str, &p, 10);
+    if (gotSuffix && (*p != '\0') && (p[1] == '\0')) {
+        switch (tolower((int) *p)) {
+        case 'k':
+            n *= 1024;
+            p++;
+            break;
+        case 'm':
+            n *= 1024 * 1024;
+            p++;
+            break;
+        case 'g':
+            n *= 1024 * 1024 * 1024;
+            p++;
+            break;
+        default:
+            break;
+        }
+    }
+    if ((errno != 0) || (p == str) || (*p != '\0') || (n <= 0))
+        log_err(0, "CMDLINE: invalid log replay count \"%s\"", str);
+    return((off_t) n);
+}
+
+
 static void display_client_help(client_conf_t *conf)
 {
     char esc[3];
@@ -331,11 +502,16 @@ static void display_client_help(client_conf_t *conf)
     printf("  -l FILE   Log connection output to file.\n");
     printf("  -L        Display license information.\n");
     printf("  -m        Monitor connection (read-only).\n");
+    printf("  -n NUM    Replay last NUM lines of console log (read-only).\n");
+    printf("  -N SIZE   Replay last SIZE bytes of console log (read-only).\n");
     printf("  -q        Query server about specified console(s).\n");
     printf("  -Q        Be quiet and suppress informational messages.\n");
     printf("  -r        Match console names via regex instead of globbing.\n");
+    printf("  -t TIME   Replay console log from TIME[,TIME] (read-only).\n");
     printf("  -v        Be verbose.\n");
     printf("  -V        Display version information.\n");
+    printf("  -x        Multiplex consoles with output prefixed by name.\n");
+    printf("  -z        Compress console output sent by server.\n");
     printf("\n");
     printf("  Once a connection is established, enter \"%s%c\""
            " to close the session,\n", esc, ESC_CHAR_CLOSE);
@@ -0,0 +1,415 @@
+/*****************************************************************************
+ *  Written by Chris Dunlap <cdunlap@llnl.gov>.
+ *  Copyright (C) 2007-2016 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  UCRL-CODE-2002-009.
+ *
+ *  This file is part of ConMan: The Console Manager.
+ *  For details, see <https://dun.github.io/conman/>.
+ *
+ *  ConMan is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  ConMan is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with ConMan.  If not, see <http://www.gnu.org/licenses/>.
+*****************************************************************************/
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "client.h"
+#include "common.h"
+#include "lex.h"
+#include "list.h"
+#include "log.h"
+#include "util-file.h"
+#include "util-str.h"
+#include "util.h"
+
+
+/*  A multiplexed session carries many consoles over one connection
+ *    (see the record framing described in common.h).  The output of each
+ *    console is written with every line prefixed by the console's name,
+ *    and a line left open by one console is ended before another console's
+ *    output is written.  Ctrl msgs from the server are displayed as
+ *    informational msgs.
+ */
+
+typedef struct mux_console {            /* MULTIPLEXED CONSOLE:              */
+    unsigned int    id;                 /*  console id assigned by server    */
+    char           *name;               /*  console name                     */
+    unsigned        isLFPending:1;      /*  true if open line ended with CR  */
+} mux_console_t;
+
+
+static void destroy_mux_console(mux_console_t *console);
+static int find_mux_console(mux_console_t *console, unsigned int *id);
+static void write_console_data(client_conf_t *conf, unsigned char *src,
+    int len, int fd, int logd);
+static void process_ctrl_msg(client_conf_t *conf, char *msg, int fd,
+    int logd);
+static void display_mux_msg(client_conf_t *conf, const char *msg, int fd,
+    int logd);
+static void append_output(client_conf_t *conf, const void *src, int len,
+    int fd, int logd);
+static void flush_output(client_conf_t *conf, int fd, int logd);
+
+
+client_mux_t * create_client_mux(void)
+{
+/*  Creates and returns the data for a multiplexed session.
+ */
+    client_mux_t *mux;
+
+    if (!(mux = malloc(sizeof(client_mux_t))))
+        out_of_memory();
+    mux->consoles = list_create((ListDelF) destroy_mux_console);
+    mux->console = NULL;
+    mux->hdrLen = 0;
+    mux->id = CONMAN_MUX_ID_CTRL;
+    mux->numLeft = 0;
+    mux->ctrlLen = 0;
+    mux->outLen = 0;
+    mux->lastConsole = NULL;
+    mux->lastId = CONMAN_MUX_ID_CTRL;
+    mux->gotCR = 0;
+    mux->isMidLine = 0;
+    return(mux);
+}
+
+
+void destroy_client_mux(client_mux_t *mux)
+{
+/*  Destroys the multiplexed session data (mux).
+ */
+    if (!mux)
+        return;
+    list_destroy(mux->consoles);
+    free(mux);
+    return;
+}
+
+
+int send_mux_data(client_conf_t *conf, unsigned int id,
+    unsigned char *src, int len)
+{
+/*  Sends the buffer (src) of length (len) to the console (id) as records,
+ *    or to every console the session can write if (id) is CONMAN_MUX_ID_ALL.
+ *  Returns 0 on success, or -1 on error (with errno set).
+ */
+    unsigned char hdr[CONMAN_MUX_HDR_LEN];
+    int n;
+
+    while (len > 0) {
+        n = MIN(len, CONMAN_MUX_MAX_LEN);
+        hdr[0] = (id >> 24) & 0xFF;
+        hdr[1] = (id >> 16) & 0xFF;
+        hdr[2] = (id >> 8) & 0xFF;
+        hdr[3] = id & 0xFF;
+        hdr[4] = (n >> 8) & 0xFF;
+        hdr[5] = n & 0xFF;
+        if (write_n(conf->req->sd, hdr, sizeof(hdr)) < 0)
+            return(-1);
+        if (write_n(conf->req->sd, src, n) < 0)
+            return(-1);
+        src += n;
+        len -= n;
+    }
+    return(0);
+}
+
+
+void write_mux_data(client_conf_t *conf, unsigned char *buf, int len,
+    int fd, int logd)
+{
+/*  Processes the buffer (buf) of length (len) received from the server
+ *    for a multiplexed session, reassembling records split across reads.
+ *  Console output is written to (fd), and also to (logd) if it is a valid
+ *    descriptor.
+ */
+    client_mux_t *mux;
+    unsigned char *p = buf;
+    unsigned char *last = buf + len;
+    int n;
+
+    assert(conf->mux != NULL);
+
+    mux = conf->mux;
+    while (p < last) {
+        if (mux->hdrLen < CONMAN_MUX_HDR_LEN) {
+            n = MIN(last - p, CONMAN_MUX_HDR_LEN - mux->hdrLen);
+            memcpy(&mux->hdr[mux->hdrLen], p, n);
+            mux->hdrLen += n;
+            p += n;
+            if (mux->hdrLen < CONMAN_MUX_HDR_LEN)
+                break;
+            mux->id = ((unsigned int) mux->hdr[0] << 24)
+                | ((unsigned int) mux->hdr[1] << 16)
+                | ((unsigned int) mux->hdr[2] << 8)
+                | (unsigned int) mux->hdr[3];
+            mux->numLeft = (mux->hdr[4] << 8) | mux->hdr[5];
+            mux->ctrlLen = 0;
+            mux->console = NULL;
+            if (mux->id != CONMAN_MUX_ID_CTRL)
+                mux->console = list_find_first(mux->consoles,
+                    (ListFindF) find_mux_console, &mux->id);
+        }
+        n = MIN(last - p, mux->numLeft);
+        if (mux->id == CONMAN_MUX_ID_CTRL) {
+            memcpy(&mux->ctrl[mux->ctrlLen], p, n);
+            mux->ctrlLen += n;
+        }
+        else if (n > 0) {
+            write_console_data(conf, p, n, fd, logd);
+        }
+        p += n;
+        mux->numLeft -= n;
+
+        if (mux->numLeft == 0) {
+            if (mux->id == CONMAN_MUX_ID_CTRL) {
+                mux->ctrl[mux->ctrlLen] = '\0';
+                process_ctrl_msg(conf, mux->ctrl, fd, logd);
+            }
+            mux->hdrLen = 0;
+        }
+    }
+    flush_output(conf, fd, logd);
+    return;
+}
+
+
+static void destroy_mux_console(mux_console_t *console)
+{
+    assert(console != NULL);
+
+    free(console->name);
+    free(console);
+    return;
+}
+
+
+static int find_mux_console(mux_console_t *console, unsigned int *id)
+{
+/*  List-find function to match a multiplexed console by its id.
+ */
+    return(console->id == *id);
+}
+
+
+static void write_console_data(client_conf_t *conf, unsigned char *src,
+    int len, int fd, int logd)
+{
+/*  Writes the console output (src) of length (len) from the current record,
+ *    prefixing each line with the name of its console.
+ *  A line left open by another console is ended first.  If that line ended
+ *    with a CR, the LF expected to start the other console's next record is
+ *    written now (and skipped later) so the CR/LF pair is kept together.
+ */
+    client_mux_t *mux = conf->mux;
+    unsigned char *last = src + len;
+    unsigned char *q;
+    char buf[MAX_LINE];
+    int n;
+
+    while (src < last) {
+        if (mux->isMidLine && (mux->lastId != mux->id)) {
+            if (!mux->gotCR)
+                append_output(conf, "\r\n", 2, fd, logd);
+            else {
+                append_output(conf, "\n", 1, fd, logd);
+                if (mux->lastConsole)
+                    mux->lastConsole->isLFPending = 1;
+            }
+            mux->isMidLine = 0;
+        }
+        if (mux->console && mux->console->isLFPending) {
+            mux->console->isLFPending = 0;
+            if (*src == '\n') {
+                src++;
+                continue;
+            }
+        }
+        if (!mux->isMidLine) {
+            if (mux->console)
+                n = snprintf(buf, sizeof(buf), "%s: ", mux->console->name);
+            else
+                n = snprintf(buf, sizeof(buf), "%u: ", mux->id);
+            if ((n < 0) || ((size_t) n >= sizeof(buf)))
+                n = strlen(buf);
+            append_output(conf, buf, n, fd, logd);
+            mux->lastConsole = mux->console;
+            mux->lastId = mux->id;
+            mux->isMidLine = 1;
+        }
+        if ((q = memchr(src, '\n', last - src))) {
+            n = q - src + 1;
+            mux->isMidLine = 0;
+        }
+        else {
+            n = last - src;
+        }
+        append_output(conf, src, n, fd, logd);
+        mux->gotCR = (src[n - 1] == '\r');
+        src += n;
+    }
+    return;
+}
+
+
+static void process_ctrl_msg(client_conf_t *conf, char *msg, int fd,
+    int logd)
+{
+/*  Processes the ctrl msg received from the server:
+ *    SUBSCRIBE CONSOLE='<str>' ID=<int>
+ *    UNSUBSCRIBE CONSOLE='<str>' ID=<int>
+ *    ERROR CODE=<int> MESSAGE='<str>'
+ *    DROPPED BYTES=<int>
+ */
+    client_mux_t *mux = conf->mux;
+    Lex l;
+    int cmd;
+    int tok;
+    char name[MAX_LINE] = "";
+    char text[MAX_LINE] = "";
+    unsigned int id = CONMAN_MUX_ID_CTRL;
+    unsigned long n = 0;
+    mux_console_t *console;
+    char *str = NULL;
+
+    l = lex_create(msg, proto_strs);
+    cmd = lex_next(l);
+    while ((tok = lex_next(l)) != LEX_EOF && (tok != LEX_EOL)) {
+        if ((tok == CONMAN_TOK_CONSOLE) && (lex_next(l) == '=')
+          && (lex_next(l) == LEX_STR))
+            strlcpy(name, lex_text(l), sizeof(name));
+        else if ((tok == CONMAN_TOK_MESSAGE) && (lex_next(l) == '=')
+          && (lex_next(l) == LEX_STR))
+            strlcpy(text, lex_text(l), sizeof(text));
+        else if ((tok == CONMAN_TOK_ID) && (lex_next(l) == '=')
+          && (lex_next(l) == LEX_INT))
+            id = (unsigned int) strtoul(lex_text(l), NULL, 10);
+        else if ((tok == CONMAN_TOK_BYTES) && (lex_next(l) == '=')
+          && (lex_next(l) == LEX_INT))
+            n = strtoul(lex_text(l), NULL, 10);
+    }
+    lex_destroy(l);
+    lex_decode(name);
+    lex_decode(text);
+
+    switch(cmd) {
+    case CONMAN_TOK_SUBSCRIBE:
+        if ((id == CONMAN_MUX_ID_CTRL) || !*name)
+            break;
+        if (!(console = list_find_first(mux->consoles,
+          (ListFindF) find_mux_console, &id))) {
+            if (!(console = malloc(sizeof(mux_console_t))))
+                out_of_memory();
+            console->id = id;
+            console->name = create_string(name);
+            console->isLFPending = 0;
+            list_append(mux->consoles, console);
+        }
+        if (!conf->req->enableQuiet)
+            str = create_format_string("Subscribed to console [%s]", name);
+        break;
+    case CONMAN_TOK_UNSUBSCRIBE:
+        if (mux->lastConsole && (mux->lastConsole->id == id))
+            mux->lastConsole = NULL;
+        if (list_delete_all(mux->consoles,
+          (ListFindF) find_mux_console, &id) == 0)
+            break;
+        if (!conf->req->enableQuiet)
+            str = create_format_string("Unsubscribed from console [%s]",
+                name);
+        break;
+    case CONMAN_TOK_ERROR:
+        str = create_format_string("ERROR: %s",
+            (*text ? text : "Unspecified"));
+        break;
+    case CONMAN_TOK_DROPPED:
+        str = create_format_string("Dropped %lu byte%s of console output",
+            n, (n == 1 ? "" : "s"));
+        break;
+    default:                            /* ignore unrecognized msgs */
+        break;
+    }
+    if (str) {
+        display_mux_msg(conf, str, fd, logd);
+        free(str);
+    }
+    return;
+}
+
+
+static void display_mux_msg(client_conf_t *conf, const char *msg, int fd,
+    int logd)
+{
+/*  Displays the informational (msg) regarding the multiplexed session.
+ *    The msg prefix begins with a newline, so it also ends any open line.
+ */
+    char buf[MAX_LINE];
+    int n;
+
+    n = snprintf(buf, sizeof(buf), "%s%s%s",
+        CONMAN_MSG_PREFIX, msg, CONMAN_MSG_SUFFIX);
+    if ((n < 0) || ((size_t) n >= sizeof(buf)))
+        strcpy(&buf[sizeof(buf) - 3], "\r\n");
+    append_output(conf, buf, strlen(buf), fd, logd);
+    conf->mux->isMidLine = 0;
+    return;
+}
+
+
+static void append_output(client_conf_t *conf, const void *src, int len,
+    int fd, int logd)
+{
+/*  Appends the buffer (src) of length (len) to the pending output,
+ *    flushing it first if there is not enough room.
+ */
+    client_mux_t *mux = conf->mux;
+    int n;
+
+    while (len > 0) {
+        if (mux->outLen == sizeof(mux->out))
+            flush_output(conf, fd, logd);
+        n = MIN(len, (int) sizeof(mux->out) - mux->outLen);
+        memcpy(&mux->out[mux->outLen], src, n);
+        mux->outLen += n;
+        src = (const unsigned char *) src + n;
+        len -= n;
+    }
+    return;
+}
+
+
+static void flush_output(client_conf_t *conf, int fd, int logd)
+{
+/*  Writes the pending output to (fd), and also to (logd)
+ *    if it is a valid descriptor.
+ */
+    client_mux_t *mux = conf->mux;
+
+    if (mux->outLen == 0)
+        return;
+    if (logd >= 0)
+        if (write_n(logd, mux->out, mux->outLen) < 0)
+            log_err(errno, "Unable to write to \"%s\"", conf->log);
+    if (write_n(fd, mux->out, mux->outLen) < 0)
+        log_err(errno, "Unable to write to fd=%d", fd);
+    mux->outLen = 0;
+    return;
+}
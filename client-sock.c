@@ -35,6 +35,9 @@
 #include <string.h>
 #include <sys/socket.h>
 #include <unistd.h>
+#if WITH_ZLIB
+#  include <zlib.h>
+#endif /* WITH_ZLIB */
 #include "client.h"
 #include "common.h"
 #include "lex.h"
@@ -42,10 +45,13 @@
 #include "util-file.h"
 #include "util-net.h"
 #include "util-str.h"
+#include "util.h"
 
 
 static void parse_rsp_ok(Lex l, client_conf_t *conf);
 static void parse_rsp_err(Lex l, client_conf_t *conf);
+static void write_server_output(client_conf_t *conf, unsigned char *buf,
+    int len, int fd, int logd);
 
 
 int connect_to_server(client_conf_t *conf)
@@ -115,6 +121,12 @@ int send_greeting(client_conf_t *conf)
             lex_encode(conf->req->tty));
     }
 
+    if (conf->req->enableCompress) {
+        n = append_format_string(buf, sizeof(buf), " %s=%s",
+            LEX_TOK2STR(proto_strs, CONMAN_TOK_OPTION),
+            LEX_TOK2STR(proto_strs, CONMAN_TOK_COMPRESS));
+    }
+
     n = append_format_string(buf, sizeof(buf), "\n");
 
     if (n < 0) {
@@ -132,6 +144,10 @@ int send_greeting(client_conf_t *conf)
         return(-1);
     }
 
+    /*  Compression is only enabled if the server's response accepts it.
+     */
+    conf->req->enableCompress = 0;
+
     if (recv_rsp(conf) < 0) {
         if (conf->errnum == CONMAN_ERR_AUTHENTICATE) {
             /*
@@ -184,6 +200,40 @@ int send_req(client_conf_t *conf)
             LEX_TOK2STR(proto_strs, CONMAN_TOK_OPTION),
             LEX_TOK2STR(proto_strs, CONMAN_TOK_REGEX));
     }
+    if ((conf->req->command == CONMAN_CMD_QUERY)
+      && conf->req->enableStatus) {
+        n = append_format_string(buf, sizeof(buf), " %s=%s",
+            LEX_TOK2STR(proto_strs, CONMAN_TOK_OPTION),
+            LEX_TOK2STR(proto_strs, CONMAN_TOK_STATUS));
+    }
+    if (conf->req->command == CONMAN_CMD_MONITOR) {
+        if (conf->req->logSince) {
+            n = append_format_string(buf, sizeof(buf), " %s=%ld",
+                LEX_TOK2STR(proto_strs, CONMAN_TOK_SINCE),
+                (long) conf->req->logSince);
+        }
+        if (conf->req->logUntil) {
+            n = append_format_string(buf, sizeof(buf), " %s=%ld",
+                LEX_TOK2STR(proto_strs, CONMAN_TOK_UNTIL),
+                (long) conf->req->logUntil);
+        }
+        if (conf->req->logBytes) {
+            n = append_format_string(buf, sizeof(buf), " %s=%lld",
+                LEX_TOK2STR(proto_strs, CONMAN_TOK_BYTES),
+                (long long) conf->req->logBytes);
+        }
+        if (conf->req->logLines) {
+            n = append_format_string(buf, sizeof(buf), " %s=%lld",
+                LEX_TOK2STR(proto_strs, CONMAN_TOK_LINES),
+                (long long) conf->req->logLines);
+        }
+    }
+    if ((conf->req->command != CONMAN_CMD_QUERY)
+      && conf->req->enableMux) {
+        n = append_format_string(buf, sizeof(buf), " %s=%s",
+            LEX_TOK2STR(proto_strs, CONMAN_TOK_OPTION),
+            LEX_TOK2STR(proto_strs, CONMAN_TOK_MULTIPLEX));
+    }
     if (conf->req->command == CONMAN_CMD_CONNECT) {
         if (conf->req->enableForce) {
             n = append_format_string(buf, sizeof(buf), " %s=%s",
@@ -228,10 +278,11 @@ int send_req(client_conf_t *conf)
         return(-1);
     }
 
-    /*  For QUERY commands, the write-half of the socket
-     *    connection can be closed once the request is sent.
+    /*  For QUERY commands and console log replays, the write-half
+     *    of the socket connection can be closed once the request is sent.
      */
-    if (conf->req->command == CONMAN_CMD_QUERY) {
+    if ((conf->req->command == CONMAN_CMD_QUERY)
+      || is_log_range_req(conf->req)) {
         if (shutdown(conf->req->sd, SHUT_WR) < 0) {
             conf->errnum = CONMAN_ERR_LOCAL;
             conf->errmsg = create_format_string(
@@ -246,7 +297,9 @@ int send_req(client_conf_t *conf)
 
 int recv_rsp(client_conf_t *conf)
 {
-    char buf[MAX_SOCK_LINE];
+    char *buf;
+    size_t size = MAX_SOCK_LINE;
+    size_t len = 0;
     int n;
     Lex l;
     int done = 0;
@@ -254,17 +307,32 @@ int recv_rsp(client_conf_t *conf)
 
     assert(conf->req->sd >= 0);
 
-    if ((n = read_line(conf->req->sd, buf, sizeof(buf))) < 0) {
+    /*  The response to a QUERY lists every matching console on a single
+     *    line, so the buffer is grown until the entire line has been read.
+     */
+    if (!(buf = malloc(size)))
+        out_of_memory();
+    while ((n = read_line(conf->req->sd, buf + len, size - len)) > 0) {
+        len += n;
+        if ((buf[len - 1] == '\n') || (len < size - 1))
+            break;
+        size *= 2;
+        if (!(buf = realloc(buf, size)))
+            out_of_memory();
+    }
+    if (n < 0) {
         conf->errnum = CONMAN_ERR_LOCAL;
         conf->errmsg = create_format_string("Unable to read response"
             " from <%s:%d>:\n  %s (blocked by TCP-Wrappers?)",
             conf->req->host, conf->req->port, strerror(errno));
+        free(buf);
         return(-1);
     }
-    else if (n == 0) {
+    else if (len == 0) {
         conf->errnum = CONMAN_ERR_LOCAL;
         conf->errmsg = create_format_string("Connection terminated by <%s:%d>",
             conf->req->host, conf->req->port);
+        free(buf);
         return(-1);
     }
 
@@ -289,6 +357,7 @@ int recv_rsp(client_conf_t *conf)
         }
     }
     lex_destroy(l);
+    free(buf);
 
     if (done == 1)
         return(0);
@@ -303,23 +372,54 @@ int recv_rsp(client_conf_t *conf)
 
 static void parse_rsp_ok(Lex l, client_conf_t *conf)
 {
+/*  Parses the OK response to the client's request.
+ *  The STATUS and CLIENTS of a queried console follow its CONSOLE token,
+ *    so each console name is held until its status has been appended to it
+ *    as tab-separated columns.
+ */
     int tok;
     int done = 0;
     char *str;
+    char *console = NULL;
 
     while (!done) {
         tok = lex_next(l);
         switch (tok) {
         case CONMAN_TOK_CONSOLE:
             if ((lex_next(l) == '=') && (lex_next(l) == LEX_STR)) {
-                if ((str = lex_decode(create_string(lex_text(l)))))
-                    list_append(conf->req->consoles, str);
+                if (console)
+                    list_append(conf->req->consoles, console);
+                console = lex_decode(create_string(lex_text(l)));
+            }
+            break;
+        case CONMAN_TOK_STATUS:
+            if (console && (lex_next(l) == '=') && (lex_next(l) == LEX_STR)) {
+                str = create_format_string("%s\t%s", console, lex_text(l));
+                free(console);
+                console = str;
+            }
+            break;
+        case CONMAN_TOK_CLIENTS:
+            if (console && (lex_next(l) == '=') && (lex_next(l) == LEX_INT)) {
+                str = create_format_string("%s\t%s", console, lex_text(l));
+                free(console);
+                console = str;
             }
             break;
         case CONMAN_TOK_OPTION:
             if (lex_next(l) == '=') {
-                if (lex_next(l) == CONMAN_TOK_RESET)
+                tok = lex_next(l);
+                if (tok == CONMAN_TOK_RESET)
                     conf->req->enableReset = 1;
+                else if (tok == CONMAN_TOK_COMPRESS)
+                    conf->req->enableCompress = 1;
+            }
+            break;
+        case CONMAN_TOK_MESSAGE:
+            if ((lex_next(l) == '=') && (lex_next(l) == LEX_STR)) {
+                if (conf->errmsg)
+                    free(conf->errmsg);
+                conf->errmsg = lex_decode(create_string(lex_text(l)));
             }
             break;
         case LEX_EOF:
@@ -330,6 +430,8 @@ static void parse_rsp_ok(Lex l, client_conf_t *conf)
             break;                      /* ignore unrecognized tokens */
         }
     }
+    if (console)
+        list_append(conf->req->consoles, console);
     return;
 }
 
@@ -406,9 +508,75 @@ void display_error(client_conf_t *conf)
 }
 
 
+void write_server_data(client_conf_t *conf, unsigned char *buf, int len,
+    int fd, int logd)
+{
+/*  Writes the data (buf) of length (len) read from the server to (fd),
+ *    and also to (logd) if it is a valid descriptor.
+ *  If the server's output is compressed, the zlib stream is inflated
+ *    here (since it is sync-flushed, all of it can be written out).
+ *  If the session is multiplexed, its records are then demultiplexed.
+ */
+#if WITH_ZLIB
+    unsigned char out[CLIENT_RECV_BUF_SIZE];
+    z_stream *z;
+    int rc;
+#endif /* WITH_ZLIB */
+
+    if (!conf->req->enableCompress) {
+        write_server_output(conf, buf, len, fd, logd);
+        return;
+    }
+#if WITH_ZLIB
+    if (!(z = conf->zstream)) {
+        if (!(z = malloc(sizeof(z_stream))))
+            out_of_memory();
+        memset(z, 0, sizeof(*z));
+        if (inflateInit2(z, CONMAN_ZIP_WINDOW_BITS) != Z_OK)
+            out_of_memory();
+        conf->zstream = z;
+    }
+    z->next_in = buf;
+    z->avail_in = len;
+    do {
+        z->next_out = out;
+        z->avail_out = sizeof(out);
+        rc = inflate(z, Z_NO_FLUSH);
+        if ((rc != Z_OK) && (rc != Z_STREAM_END) && (rc != Z_BUF_ERROR))
+            log_err(0, "Unable to decompress data from <%s:%d>: %s",
+                conf->req->host, conf->req->port,
+                (z->msg ? z->msg : "inflate failed"));
+        len = sizeof(out) - z->avail_out;
+        if (len > 0)
+            write_server_output(conf, out, len, fd, logd);
+    } while ((z->avail_out == 0) && (rc != Z_STREAM_END));
+#endif /* WITH_ZLIB */
+    return;
+}
+
+
+static void write_server_output(client_conf_t *conf, unsigned char *buf,
+    int len, int fd, int logd)
+{
+/*  Writes the (uncompressed) data (buf) of length (len) from the server
+ *    to (fd), and also to (logd) if it is a valid descriptor.
+ */
+    if (conf->mux) {
+        write_mux_data(conf, buf, len, fd, logd);
+        return;
+    }
+    if (logd >= 0)
+        if (write_n(logd, buf, len) < 0)
+            log_err(errno, "Unable to write to \"%s\"", conf->log);
+    if (write_n(fd, buf, len) < 0)
+        log_err(errno, "Unable to write to fd=%d", fd);
+    return;
+}
+
+
 void display_data(client_conf_t *conf, int fd)
 {
-    char buf[MAX_BUF_SIZE];
+    unsigned char buf[MAX_BUF_SIZE];
     int n;
 
     assert(fd >= 0);
@@ -423,11 +591,7 @@ void display_data(client_conf_t *conf, int fd)
                 conf->req->host, conf->req->port);
         if (n == 0)
             break;
-        if (write_n(fd, buf, n) < 0)
-            log_err(errno, "Unable to write to fd=%d", fd);
-        if (conf->logd >= 0)
-            if (write_n(conf->logd, buf, n) < 0)
-                log_err(errno, "Unable to write to \"%s\"", conf->log);
+        write_server_data(conf, buf, n, fd, conf->logd);
     }
     return;
 }
@@ -452,5 +616,17 @@ void display_consoles(client_conf_t *conf, int fd)
                 log_err(errno, "Unable to write to \"%s\"", conf->log);
     }
     list_iterator_destroy(i);
+
+    /*  An informational message from the server (eg, that consoles are still
+     *    being opened at startup) is written to stderr so as not to disturb
+     *    scripts parsing the console list.
+     */
+    if (conf->errmsg) {
+        n = snprintf(buf, sizeof(buf), "NOTE: %s.\n", conf->errmsg);
+        if ((n < 0) || ((size_t) n >= sizeof(buf)))
+            n = strlen(buf);
+        if (write_n(STDERR_FILENO, buf, n) < 0)
+            log_err(errno, "Unable to write to stderr");
+    }
     return;
 }
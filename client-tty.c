@@ -26,8 +26,14 @@
 #  include <config.h>
 #endif /* HAVE_CONFIG_H */
 
+#if HAVE_SPLICE && HAVE_TEE && !defined(_GNU_SOURCE)
+#  define _GNU_SOURCE                   /* for splice() and tee() */
+#endif /* HAVE_SPLICE && HAVE_TEE */
+
 #include <assert.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -45,7 +51,18 @@
 
 static void exit_handler(int signum);
 static int read_from_stdin(client_conf_t *conf);
+static int send_stdin_data(client_conf_t *conf, unsigned char *buf,
+    int len);
+static int perform_esc(client_conf_t *conf, char c);
+static void start_output(client_conf_t *conf);
+static void stop_output(client_conf_t *conf);
+static void * write_log_data(client_conf_t *conf);
 static int write_to_stdout(client_conf_t *conf);
+#if HAVE_SPLICE && HAVE_TEE
+static int splice_to_stdout(client_conf_t *conf);
+static void copy_pipe_to_stdout(client_conf_t *conf, ssize_t len,
+    ssize_t logged);
+#endif /* HAVE_SPLICE && HAVE_TEE */
 static int send_esc_seq(client_conf_t *conf, char c);
 static int perform_break_esc(client_conf_t *conf, char c);
 static int perform_close_esc(client_conf_t *conf, char c);
@@ -73,27 +90,33 @@ void connect_console(client_conf_t *conf)
  */
     struct termios tty;
     fd_set rset, rsetBak;
+    int isTty;
     int n;
 
     assert(conf->req->sd >= 0);
     assert((conf->req->command == CONMAN_CMD_CONNECT)
         || (conf->req->command == CONMAN_CMD_MONITOR));
-    assert(list_count(conf->req->consoles) > 0);
+    assert((list_count(conf->req->consoles) > 0) || conf->req->enableMux);
 
     /*  If only one console was selected for a broadcast, then
      *    the session is placed into R/W mode instead of W/O mode.
      *    So update the req accordingly.
+     *  A multiplexed session learns its consoles as they are subscribed.
      */
     if (list_count(conf->req->consoles) == 1)
         conf->req->enableBroadcast = 0;
+    if (conf->req->enableMux)
+        conf->mux = create_client_mux();
 
-    if (!isatty(STDIN_FILENO))
+    /*  A R/O multiplexed session can be run without a terminal (eg, from
+     *    a script), in which case stdin is not read.
+     */
+    isTty = isatty(STDIN_FILENO);
+    if (!isTty && (!conf->mux || (conf->req->command != CONMAN_CMD_MONITOR)))
         log_err(0, "Standard Input is not a terminal device");
-    if (!isatty(STDOUT_FILENO))
-        log_err(0, "Standard Output is not a terminal device");
 
     posix_signal(SIGHUP, SIG_IGN);
-    posix_signal(SIGINT, SIG_IGN);
+    posix_signal(SIGINT, (isTty ? SIG_IGN : exit_handler));
     posix_signal(SIGPIPE, SIG_IGN);
     posix_signal(SIGQUIT, SIG_IGN);
     posix_signal(SIGTERM, exit_handler);
@@ -103,10 +126,12 @@ void connect_console(client_conf_t *conf)
     get_tty_raw(&tty, STDIN_FILENO);
     set_tty_mode(&tty, STDIN_FILENO);
 
+    start_output(conf);
     locally_display_status(conf, "opened");
 
     FD_ZERO(&rsetBak);
-    FD_SET(STDIN_FILENO, &rsetBak);
+    if (isTty)
+        FD_SET(STDIN_FILENO, &rsetBak);
     FD_SET(conf->req->sd, &rsetBak);
 
     while (!done) {
@@ -135,6 +160,7 @@ void connect_console(client_conf_t *conf)
             conf->req->host, conf->req->port);
     conf->req->sd = -1;
 
+    stop_output(conf);
     if (!conf->isClosedByClient)
         locally_display_status(conf, "terminated by server");
 
@@ -154,116 +180,317 @@ static void exit_handler(int signum)
 
 static int read_from_stdin(client_conf_t *conf)
 {
-/*  Reads from stdin and writes to the socket connection.
+/*  Reads a block from stdin and writes it to the socket connection.
+ *    The block is scanned for runs of chars containing neither the
+ *    escape-sequence char nor ESC_CHAR, which are copied as is.
+ *    The stuffed output is sent in a single write per block, except that
+ *    output preceding an escape sequence is sent before it is performed.
+ *  ESC_CHAR is not stuffed in a multiplexed session since its records
+ *    are sent as is.
  *  Returns 1 if the read was successful,
  *    or 0 if the connection is to be closed.
  *  Note that this routine can conceivably block in the write() to the socket.
  */
     static enum { CHR, EOL, ESC } mode = EOL;
-    int n;
+    unsigned char ibuf[MAX_BUF_SIZE];
+    unsigned char obuf[(MAX_BUF_SIZE * 2) + 2];
+    unsigned char esc = conf->escapeChar;
+    int isStuffed = !conf->req->enableMux;
+    unsigned char *p, *q;
     unsigned char c;
-    char esc = conf->escapeChar;
-    unsigned char buf[4];
-    unsigned char *p = buf;
-    unsigned char *q, *r;
+    int n, m;
+    int len = 0;
+    int rc;
 
-    while ((n = read(STDIN_FILENO, &c, 1)) < 0) {
+    while ((n = read(STDIN_FILENO, ibuf, sizeof(ibuf))) < 0) {
         if (errno != EINTR)
             log_err(errno, "Unable to read from stdin");
     }
     if (n == 0)
         return(0);
 
-    if ((mode != ESC) && (c == esc)) {
-        mode = ESC;
+    for (p = ibuf; n > 0; p += m, n -= m) {
+
+        if (mode != ESC) {
+            /*
+             *  Copy the run of chars up to the next escape-sequence char
+             *    or ESC_CHAR (whichever is first).
+             */
+            m = n;
+            if ((q = memchr(p, esc, m)))
+                m = q - p;
+            if (isStuffed && (esc != ESC_CHAR)
+              && (q = memchr(p, ESC_CHAR, m)))
+                m = q - p;
+            if (m > 0) {
+                memcpy(&obuf[len], p, m);
+                len += m;
+                mode = ((p[m-1] == '\r') || (p[m-1] == '\n')) ? EOL : CHR;
+                continue;
+            }
+        }
+        m = 1;
+        c = *p;
+
+        if ((mode != ESC) && (c == esc)) {
+            mode = ESC;
+            continue;
+        }
+        if (mode == ESC) {
+            mode = EOL;
+            /*
+             *  Send the output preceding the escape sequence beforehand
+             *    as the escape may act upon the connection.
+             */
+            if (!send_stdin_data(conf, obuf, len))
+                return(0);
+            len = 0;
+            if ((rc = perform_esc(conf, c)) >= 0) {
+                if (rc == 0)
+                    return(0);
+                continue;
+            }
+            if (c != esc) {
+                /*
+                 *  If the input was escape-someothercharacter, write both
+                 *    the escape character and the other character to the
+                 *    socket.  Just write the escape character here, since
+                 *    the other character is written a few lines further down.
+                 */
+                if (isStuffed && (esc == ESC_CHAR))
+                    obuf[len++] = ESC_CHAR;
+                obuf[len++] = esc;
+            }
+        }
+        if ((c == '\r') || (c == '\n'))
+            mode = EOL;
+        else
+            mode = CHR;
+
+        /*  Perform character-stuffing of the escape-sequence character
+         *    by doubling all occurrences of it.
+         */
+        if (isStuffed && (c == ESC_CHAR))
+            obuf[len++] = ESC_CHAR;
+        obuf[len++] = c;
+        assert((size_t) len <= sizeof(obuf));
+    }
+    return(send_stdin_data(conf, obuf, len));
+}
+
+
+static int send_stdin_data(client_conf_t *conf, unsigned char *buf,
+    int len)
+{
+/*  Writes (len) bytes of stdin data from (buf) to the socket connection.
+ *    In a multiplexed session, the data is sent in records for every
+ *    console the session can write.
+ *  Returns 1 on success, or 0 if the socket connection is to be closed.
+ */
+    int rc;
+
+    if (len <= 0)
+        return(1);
+
+    /*  Do not send chars across the socket if we are in MONITOR mode.
+     *    The server would discard them anyways, but why waste resources.
+     *  Besides, we're now practicing conservation here in California. ;)
+     */
+    if (conf->req->command != CONMAN_CMD_CONNECT)
         return(1);
+
+    if (conf->mux)
+        rc = send_mux_data(conf, CONMAN_MUX_ID_ALL, buf, len);
+    else
+        rc = write_n(conf->req->sd, buf, len);
+    if (rc < 0) {
+        if (errno == EPIPE)
+            return(0);
+        log_err(errno, "Unable to write to <%s:%d>",
+            conf->req->host, conf->req->port);
     }
-    if (mode == ESC) {
-        mode = EOL;
+    return(1);
+}
+
+
+static int perform_esc(client_conf_t *conf, char c)
+{
+/*  Performs the escape sequence specified by (c).
+ *  Escape sequences are not sent to the server in a multiplexed session,
+ *    so only those performed by the client are supported there.
+ *  Returns 1 on success, 0 if the socket connection is to be closed,
+ *    or -1 if (c) does not specify an escape sequence.
+ */
+    if (conf->mux) {
         switch(c) {
-        case ESC_CHAR_BREAK:
-            return(perform_break_esc(conf, c));
         case ESC_CHAR_CLOSE:
             return(perform_close_esc(conf, c));
-        case ESC_CHAR_DEL:              /* XXX: gnats:100 del char kludge */
-            return(perform_del_esc(conf, c));
         case ESC_CHAR_ECHO:
             return(perform_echo_esc(conf, c));
-        case ESC_CHAR_FORCE:
-            return(perform_force_esc(conf, c));
         case ESC_CHAR_HELP:
             return(perform_help_esc(conf, c));
         case ESC_CHAR_INFO:
             return(perform_info_esc(conf, c));
-        case ESC_CHAR_JOIN:
-            return(perform_join_esc(conf, c));
-        case ESC_CHAR_REPLAY:
-            return(perform_log_replay_esc(conf, c));
-        case ESC_CHAR_MONITOR:
-            return(perform_monitor_esc(conf, c));
-        case ESC_CHAR_QUIET:
-            return(perform_quiet_esc(conf, c));
-        case ESC_CHAR_RESET:
-            return(perform_reset_esc(conf, c));
         case ESC_CHAR_SUSPEND:
             return(perform_suspend_esc(conf, c));
         }
-        if (c != esc) {
-            /*
-             *  If the input was escape-someothercharacter, write both the
-             *    escape character and the other character to the socket.
-             *  Just write the escape character here, since the default case
-             *    for writing the other character is a few lines further down.
-             */
-            *p++ = esc;
-        }
+        return(-1);
     }
-    if ((c == '\r') || (c == '\n'))
-        mode = EOL;
-    else
-        mode = CHR;
+    switch(c) {
+    case ESC_CHAR_BREAK:
+        return(perform_break_esc(conf, c));
+    case ESC_CHAR_CLOSE:
+        return(perform_close_esc(conf, c));
+    case ESC_CHAR_DEL:                  /* XXX: gnats:100 del char kludge */
+        return(perform_del_esc(conf, c));
+    case ESC_CHAR_ECHO:
+        return(perform_echo_esc(conf, c));
+    case ESC_CHAR_FORCE:
+        return(perform_force_esc(conf, c));
+    case ESC_CHAR_HELP:
+        return(perform_help_esc(conf, c));
+    case ESC_CHAR_INFO:
+        return(perform_info_esc(conf, c));
+    case ESC_CHAR_JOIN:
+        return(perform_join_esc(conf, c));
+    case ESC_CHAR_REPLAY:
+        return(perform_log_replay_esc(conf, c));
+    case ESC_CHAR_MONITOR:
+        return(perform_monitor_esc(conf, c));
+    case ESC_CHAR_QUIET:
+        return(perform_quiet_esc(conf, c));
+    case ESC_CHAR_RESET:
+        return(perform_reset_esc(conf, c));
+    case ESC_CHAR_SUSPEND:
+        return(perform_suspend_esc(conf, c));
+    }
+    return(-1);
+}
 
-    *p++ = c;
-    assert((p > buf) && ((size_t) (p - buf) <= sizeof(buf)));
 
-    /*  Do not send chars across the socket if we are in MONITOR mode.
-     *    The server would discard them anyways, but why waste resources.
-     *  Besides, we're now practicing conservation here in California. ;)
-     */
-    if (conf->req->command == CONMAN_CMD_CONNECT) {
-        /*
-         *  Perform character-stuffing of the escape-sequence character
-         *    by doubling all occurrences of it.
+static void start_output(client_conf_t *conf)
+{
+/*  Prepares the console output path.
+ *  If logging, the logfile is written by a separate thread fed through
+ *    a pipe so a slow terminal does not stall the log (or vice versa).
+ *  If stdout is not a terminal (eg, a pipe or file) and splice() is
+ *    supported, console output bypasses userspace entirely
+ *    (unless it must first be decompressed or demultiplexed).
+ */
+    sigset_t sigset, sigsetOld;
+    int flags;
+    int rc;
+
+    if (conf->logd >= 0) {
+        if (pipe(conf->logPipe) < 0)
+            log_err(errno, "Unable to create pipe for \"%s\"", conf->log);
+        set_fd_closed_on_exec(conf->logPipe[0]);
+        set_fd_closed_on_exec(conf->logPipe[1]);
+#ifdef F_SETPIPE_SZ
+        (void) fcntl(conf->logPipe[1], F_SETPIPE_SZ, CLIENT_PIPE_SIZE);
+#endif /* F_SETPIPE_SZ */
+
+        /*  Signals must be handled by the main thread to interrupt select().
          */
-        for (q=p-1; q>=buf; q--) {
-            if (*q == ESC_CHAR) {
-                for (r=p-1, p++; r>=q; r--)
-                    *(r+1) = *r;
-            }
-        }
-        if (write_n(conf->req->sd, buf, p - buf) < 0) {
-            if (errno == EPIPE)
-                return(0);
-            log_err(errno, "Unable to write to <%s:%d>",
-                conf->req->host, conf->req->port);
+        sigfillset(&sigset);
+        if ((rc = pthread_sigmask(SIG_SETMASK, &sigset, &sigsetOld)) != 0)
+            log_err(rc, "Unable to block signals");
+        if ((rc = pthread_create(&conf->logTid, NULL,
+          (PthreadFunc) write_log_data, conf)) != 0)
+            log_err(rc, "Unable to create logfile writer thread");
+        if ((rc = pthread_sigmask(SIG_SETMASK, &sigsetOld, NULL)) != 0)
+            log_err(rc, "Unable to restore signals");
+    }
+
+#if HAVE_SPLICE && HAVE_TEE
+    /*  Splicing to a file opened in append-mode fails with EINVAL.
+     */
+    if (isatty(STDOUT_FILENO) || conf->req->enableCompress || conf->mux)
+        return;
+    if ((flags = fcntl(STDOUT_FILENO, F_GETFL)) < 0)
+        log_err(errno, "Unable to get stdout file status flags");
+    if (flags & O_APPEND)
+        return;
+    if (pipe(conf->outPipe) < 0)
+        log_err(errno, "Unable to create pipe for stdout");
+    set_fd_closed_on_exec(conf->outPipe[0]);
+    set_fd_closed_on_exec(conf->outPipe[1]);
+#ifdef F_SETPIPE_SZ
+    (void) fcntl(conf->outPipe[1], F_SETPIPE_SZ, CLIENT_PIPE_SIZE);
+#endif /* F_SETPIPE_SZ */
+    conf->isOutSpliced = 1;
+#else  /* !(HAVE_SPLICE && HAVE_TEE) */
+    (void) flags;
+#endif /* !(HAVE_SPLICE && HAVE_TEE) */
+    return;
+}
+
+
+static void stop_output(client_conf_t *conf)
+{
+/*  Tears down the console output path, waiting for the logfile writer
+ *    thread to flush any pending output before returning.
+ */
+    int rc;
+
+    if (conf->logPipe[1] >= 0) {
+        if (close(conf->logPipe[1]) < 0)
+            log_err(errno, "Unable to close pipe for \"%s\"", conf->log);
+        conf->logPipe[1] = -1;
+        if ((rc = pthread_join(conf->logTid, NULL)) != 0)
+            log_err(rc, "Unable to join logfile writer thread");
+        if (close(conf->logPipe[0]) < 0)
+            log_err(errno, "Unable to close pipe for \"%s\"", conf->log);
+        conf->logPipe[0] = -1;
+    }
+    if (conf->outPipe[0] >= 0) {
+        if (close(conf->outPipe[0]) < 0)
+            log_err(errno, "Unable to close pipe for stdout");
+        if (close(conf->outPipe[1]) < 0)
+            log_err(errno, "Unable to close pipe for stdout");
+        conf->outPipe[0] = conf->outPipe[1] = -1;
+    }
+    conf->isOutSpliced = 0;
+    return;
+}
+
+
+static void * write_log_data(client_conf_t *conf)
+{
+/*  Thread routine to drain the logfile pipe into the logfile
+ *    until the write-end of the pipe is closed by stop_output().
+ */
+    unsigned char buf[CLIENT_RECV_BUF_SIZE];
+    int n;
+
+    for (;;) {
+        while ((n = read(conf->logPipe[0], buf, sizeof(buf))) < 0) {
+            if (errno != EINTR)
+                log_err(errno, "Unable to read pipe for \"%s\"", conf->log);
         }
+        if (n == 0)
+            break;
+        if (write_n(conf->logd, buf, n) < 0)
+            log_err(errno, "Unable to write to \"%s\"", conf->log);
     }
-    return(1);
+    return(NULL);
 }
 
 
 static int write_to_stdout(client_conf_t *conf)
 {
 /*  Reads from the socket connection and writes to stdout.
- *  Returns the number of bytes written to stdout,
+ *  Returns the number of bytes read from the socket,
  *    or 0 if the socket connection is to be closed.
  */
-    unsigned char buf[MAX_BUF_SIZE];
+    unsigned char buf[CLIENT_RECV_BUF_SIZE];
     int n;
 
-    /*  Stdin has to be processed character-by-character to check for
-     *    escape sequences.  For human input, this isn't too bad.
-     */
+#if HAVE_SPLICE && HAVE_TEE
+    if (conf->isOutSpliced)
+        return(splice_to_stdout(conf));
+#endif /* HAVE_SPLICE && HAVE_TEE */
+
     while ((n = read(conf->req->sd, buf, sizeof(buf))) < 0) {
         if (errno == EPIPE)
             return(0);
@@ -271,15 +498,88 @@ static int write_to_stdout(client_conf_t *conf)
             log_err(errno, "Unable to read from <%s:%d>",
                 conf->req->host, conf->req->port);
     }
-    if (n > 0) {
+    if (n > 0)
+        write_server_data(conf, buf, n, STDOUT_FILENO, conf->logPipe[1]);
+    return(n);
+}
+
+
+#if HAVE_SPLICE && HAVE_TEE
+static int splice_to_stdout(client_conf_t *conf)
+{
+/*  Splices from the socket connection to stdout via the stdout pipe.
+ *    If logging, the data is tee'd from the stdout pipe into the
+ *    logfile pipe before being spliced out, so it is never copied.
+ *  Returns the number of bytes written to stdout,
+ *    or 0 if the socket connection is to be closed.
+ */
+    ssize_t n, len, m, k, rc;
+
+    while ((n = splice(conf->req->sd, NULL, conf->outPipe[1], NULL,
+      CLIENT_RECV_BUF_SIZE, SPLICE_F_MOVE)) < 0) {
+        if (errno == EPIPE)
+            return(0);
+        if (errno != EINTR)
+            log_err(errno, "Unable to read from <%s:%d>",
+                conf->req->host, conf->req->port);
+    }
+    for (len = n; len > 0; len -= m) {
+        m = len;
+        if (conf->logPipe[1] >= 0) {
+            while ((m = tee(conf->outPipe[0], conf->logPipe[1], len, 0)) < 0)
+                if (errno != EINTR)
+                    log_err(errno, "Unable to write to \"%s\"", conf->log);
+        }
+        for (k = m; k > 0; ) {
+            rc = splice(conf->outPipe[0], NULL, STDOUT_FILENO, NULL, k,
+                SPLICE_F_MOVE);
+            if (rc > 0)
+                k -= rc;
+            else if ((rc < 0) && (errno == EINVAL)) {
+                copy_pipe_to_stdout(conf, len - (m - k), k);
+                return(n);
+            }
+            else if ((rc == 0) || (errno != EINTR))
+                log_err(errno, "Unable to write to stdout");
+        }
+    }
+    return(n);
+}
+
+
+static void copy_pipe_to_stdout(client_conf_t *conf, ssize_t len,
+    ssize_t logged)
+{
+/*  Copies the remaining (len) bytes in the stdout pipe to stdout through
+ *    userspace, and disables splicing for the remainder of the session.
+ *    The first (logged) bytes have already been tee'd into the logfile
+ *    pipe; the rest are written to it here.
+ *  This is needed when stdout is on a filesystem lacking splice() support.
+ */
+    unsigned char buf[CLIENT_RECV_BUF_SIZE];
+    ssize_t n, k;
+
+    while (len > 0) {
+        n = MIN(len, (ssize_t) sizeof(buf));
+        while ((n = read(conf->outPipe[0], buf, n)) < 0) {
+            if (errno != EINTR)
+                log_err(errno, "Unable to read pipe for stdout");
+        }
+        if (n == 0)
+            break;
+        len -= n;
+        k = MIN(logged, n);
+        logged -= k;
+        if ((conf->logPipe[1] >= 0) && (n > k))
+            if (write_n(conf->logPipe[1], buf + k, n - k) < 0)
+                log_err(errno, "Unable to write to \"%s\"", conf->log);
         if (write_n(STDOUT_FILENO, buf, n) < 0)
             log_err(errno, "Unable to write to stdout");
-        if (conf->logd >= 0)
-            if (write_n(conf->logd, buf, n) < 0)
-                log_err(errno, "Unable to write to \"%s\"", conf->log);
     }
-    return(n);
+    conf->isOutSpliced = 0;
+    return;
 }
+#endif /* HAVE_SPLICE && HAVE_TEE */
 
 
 static int send_esc_seq(client_conf_t *conf, char c)
@@ -407,13 +707,13 @@ static int perform_help_esc(client_conf_t *conf, char c)
     (void) append_format_string(buf, sizeof(buf),
         "  %2s%-2s -  Send the escape character.\r\n", esc, esc);
 
-    if (conf->req->command == CONMAN_CMD_CONNECT) {
+    if (!conf->mux && (conf->req->command == CONMAN_CMD_CONNECT)) {
         write_esc_char(ESC_CHAR_BREAK, tmp);
         (void) append_format_string(buf, sizeof(buf),
             "  %2s%-2s -  Transmit a serial-break.\r\n", esc, tmp);
     }
 
-    if (conf->req->command == CONMAN_CMD_CONNECT) {
+    if (!conf->mux && (conf->req->command == CONMAN_CMD_CONNECT)) {
         write_esc_char(ESC_CHAR_DEL, tmp);
         (void) append_format_string(buf, sizeof(buf),
             "  %2s%-2s -  Transmit a DEL character.\r\n", esc, tmp);
@@ -426,7 +726,7 @@ static int perform_help_esc(client_conf_t *conf, char c)
             conf->req->enableEcho ? "Disable" : "Enable");
     }
 
-    if (conf->req->command == CONMAN_CMD_MONITOR) {
+    if (!conf->mux && (conf->req->command == CONMAN_CMD_MONITOR)) {
         write_esc_char(ESC_CHAR_FORCE, tmp);
         (void) append_format_string(buf, sizeof(buf),
             "  %2s%-2s -  Force write-privileges (console-stealing).\r\n",
@@ -437,7 +737,7 @@ static int perform_help_esc(client_conf_t *conf, char c)
     (void) append_format_string(buf, sizeof(buf),
         "  %2s%-2s -  Display connection information.\r\n", esc, tmp);
 
-    if (conf->req->command == CONMAN_CMD_MONITOR) {
+    if (!conf->mux && (conf->req->command == CONMAN_CMD_MONITOR)) {
         write_esc_char(ESC_CHAR_JOIN, tmp);
         (void) append_format_string(buf, sizeof(buf),
             "  %2s%-2s -  Join write-privileges (console-sharing).\r\n",
@@ -446,15 +746,15 @@ static int perform_help_esc(client_conf_t *conf, char c)
 
     /*  FIXME: Only display this option if the console is being logged.
      */
-    if (!conf->req->enableBroadcast) {
+    if (!conf->mux && !conf->req->enableBroadcast) {
         write_esc_char(ESC_CHAR_REPLAY, tmp);
         (void) append_format_string(buf, sizeof(buf),
-            "  %2s%-2s -  Replay up to the last %d bytes of the log.\r\n",
-            esc, tmp, LOG_REPLAY_LEN);
+            "  %2s%-2s -  Replay the recent output of the console.\r\n",
+            esc, tmp);
     }
 
     if ((conf->req->command == CONMAN_CMD_CONNECT) &&
-        (!conf->req->enableBroadcast)
+        (!conf->req->enableBroadcast) && (!conf->mux)
        ) {
         write_esc_char(ESC_CHAR_MONITOR, tmp);
         (void) append_format_string(buf, sizeof(buf),
@@ -463,17 +763,17 @@ static int perform_help_esc(client_conf_t *conf, char c)
     }
 
     write_esc_char(ESC_CHAR_QUIET, tmp);
-    if (conf->req->enableQuiet) {
+    if (!conf->mux && conf->req->enableQuiet) {
         (void) append_format_string(buf, sizeof(buf), "  %2s%-2s -  "
             "Disable quiet-mode (display info msgs).\r\n", esc, tmp);
     }
-    else {
+    else if (!conf->mux) {
         (void) append_format_string(buf, sizeof(buf), "  %2s%-2s -  "
             "Enable quiet-mode (suppress info msgs).\r\n", esc, tmp);
     }
 
     if ((conf->req->command == CONMAN_CMD_CONNECT) &&
-        (conf->req->enableReset)
+        (conf->req->enableReset) && (!conf->mux)
        ) {
         write_esc_char(ESC_CHAR_RESET, tmp);
         (void) append_format_string(buf, sizeof(buf), "  %2s%-2s -  "
@@ -515,7 +815,15 @@ static int perform_info_esc(client_conf_t *conf, char c)
  */
     char *str;
 
-    if (list_count(conf->req->consoles) == 1) {
+    if (conf->mux) {
+        str = create_format_string(
+            "%sMultiplexing %s %d console%s on <%s:%d>%s", CONMAN_MSG_PREFIX,
+            (conf->req->command == CONMAN_CMD_MONITOR ? "R/O" : "R/W"),
+            list_count(conf->mux->consoles),
+            (list_count(conf->mux->consoles) == 1 ? "" : "s"),
+            conf->req->host, conf->req->port, CONMAN_MSG_SUFFIX);
+    }
+    else if (list_count(conf->req->consoles) == 1) {
         str = create_format_string(
             "%sConnected %s to console [%s] on <%s:%d>%s", CONMAN_MSG_PREFIX,
             (conf->req->command == CONMAN_CMD_MONITOR ? "R/O" : "R/W"),
@@ -613,13 +921,14 @@ static int perform_suspend_esc(client_conf_t *conf, char c)
  *    will be buffered by the network layer until the client is resumed.
  *    Once the network buffers are full, the server should overwrite data
  *    to this client in its circular write buffer.
+ *  The server is not told of the suspend in a multiplexed session.
  *  Returns 1 on success, or 0 if the socket connection is to be closed.
  */
     struct termios tty;
 
     locally_echo_esc(conf->escapeChar, c);
 
-    if (!send_esc_seq(conf, c))
+    if (!conf->mux && !send_esc_seq(conf, c))
         return(0);
     locally_display_status(conf, "suspended");
     set_tty_mode(&conf->tty, STDIN_FILENO);
@@ -630,7 +939,7 @@ static int perform_suspend_esc(client_conf_t *conf, char c)
     get_tty_raw(&tty, STDIN_FILENO);
     set_tty_mode(&tty, STDIN_FILENO);
     locally_display_status(conf, "resumed");
-    if (!send_esc_seq(conf, c))
+    if (!conf->mux && !send_esc_seq(conf, c))
         return(0);
     return(1);
 }
@@ -693,7 +1002,12 @@ static void locally_display_status(client_conf_t *conf, char *msg)
     assert((conf->req->command == CONMAN_CMD_CONNECT)
         || (conf->req->command == CONMAN_CMD_MONITOR));
 
-    if (list_count(conf->req->consoles) == 1) {
+    if (conf->mux) {
+        n = snprintf(buf, sizeof(buf), "%sMultiplexed session on <%s:%d> %s%s",
+            CONMAN_MSG_PREFIX, conf->req->host, conf->req->port,
+            msg, CONMAN_MSG_SUFFIX);
+    }
+    else if (list_count(conf->req->consoles) == 1) {
         n = snprintf(buf, sizeof(buf), "%sConnection to console [%s] %s%s",
             CONMAN_MSG_PREFIX, (char *) list_peek(conf->req->consoles),
             msg, CONMAN_MSG_SUFFIX);
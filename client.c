@@ -57,6 +57,8 @@ int main(int argc, char *argv[])
         display_error(conf);
     else if (conf->req->command == CONMAN_CMD_QUERY)
         display_consoles(conf, STDOUT_FILENO);
+    else if (is_log_range_req(conf->req))
+        display_data(conf, STDOUT_FILENO);
     else if ((conf->req->command == CONMAN_CMD_CONNECT)
       || (conf->req->command == CONMAN_CMD_MONITOR))
         connect_console(conf);
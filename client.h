@@ -25,9 +25,32 @@
 #ifndef _CLIENT_H
 #define _CLIENT_H
 
+#include <pthread.h>
 #include <termios.h>
 #include "common.h"
-
+#include "list.h"
+
+
+#define CLIENT_RECV_BUF_SIZE    65536   /* bytes read from sock at a time    */
+#define CLIENT_PIPE_SIZE        1048576 /* requested capacity of out pipes   */
+
+
+typedef struct client_mux {            /* MULTIPLEXED SESSION DATA:         */
+    List            consoles;           /*  list of subscribed consoles      */
+    struct mux_console *console;        /*  console of record being rcvd     */
+    unsigned char   hdr[CONMAN_MUX_HDR_LEN];    /* hdr of record being rcvd  */
+    int             hdrLen;             /*  num bytes of hdr received        */
+    unsigned int    id;                 /*  console id of record being rcvd  */
+    int             numLeft;            /*  num bytes left in record data    */
+    char            ctrl[CONMAN_MUX_MAX_LEN + 1];   /* ctrl msg being rcvd   */
+    int             ctrlLen;            /*  num bytes of ctrl msg received   */
+    unsigned char   out[CLIENT_RECV_BUF_SIZE];  /* output pending write      */
+    int             outLen;             /*  num bytes of output pending      */
+    struct mux_console *lastConsole;    /*  console of last output line      */
+    unsigned int    lastId;             /*  console id of last output line   */
+    unsigned        gotCR:1;            /*  true if last output was a CR     */
+    unsigned        isMidLine:1;        /*  true if last output line is open */
+} client_mux_t;
 
 typedef struct client_conf {
     char           *prog;               /* name of client program            */
@@ -35,11 +58,17 @@ typedef struct client_conf {
     int             escapeChar;         /* char to issue client escape seq   */
     char           *log;                /* connection logfile name           */
     int             logd;               /* connection logfile descriptor     */
+    int             logPipe[2];         /* pipe to async logfile writer      */
+    pthread_t       logTid;             /* async logfile writer thread id    */
+    int             outPipe[2];         /* pipe for splicing sock to stdout  */
+    void           *zstream;            /* zlib stream if output compressed  */
+    client_mux_t   *mux;                /* multiplexed session data, or NULL */
     int             errnum;             /* error number from issuing command */
     char           *errmsg;             /* error msg from issuing command    */
     struct termios  tty;                /* saved "cooked" terminal mode      */
     unsigned        enableVerbose:1;    /* true if verbose output requested  */
     unsigned        isClosedByClient:1; /* true if socket closed by client   */
+    unsigned        isOutSpliced:1;     /* true if splicing sock to stdout   */
 } client_conf_t;
 
 
@@ -60,6 +89,21 @@ void open_client_log(client_conf_t *conf);
 void close_client_log(client_conf_t *conf);
 
 
+/******************\
+**  client-mux.c  **
+\******************/
+
+client_mux_t * create_client_mux(void);
+
+void destroy_client_mux(client_mux_t *mux);
+
+int send_mux_data(client_conf_t *conf, unsigned int id,
+    unsigned char *src, int len);
+
+void write_mux_data(client_conf_t *conf, unsigned char *buf, int len,
+    int fd, int logd);
+
+
 /*******************\
 **  client-sock.c  **
 \*******************/
@@ -72,6 +116,9 @@ int send_req(client_conf_t *conf);
 
 int recv_rsp(client_conf_t *conf);
 
+void write_server_data(client_conf_t *conf, unsigned char *buf, int len,
+    int fd, int logd);
+
 void display_error(client_conf_t *conf);
 
 void display_data(client_conf_t *conf, int fd);
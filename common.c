@@ -58,22 +58,34 @@ char *proto_strs[] = {
  *  These must be sorted in a case-insensitive manner.
  */
     "BROADCAST",
+    "BYTES",
+    "CLIENTS",
     "CODE",
+    "COMPRESS",
     "CONNECT",
     "CONSOLE",
+    "DROPPED",
     "ERROR",
     "FORCE",
     "HELLO",
+    "ID",
     "JOIN",
+    "LINES",
     "MESSAGE",
     "MONITOR",
+    "MULTIPLEX",
     "OK",
     "OPTION",
     "QUERY",
     "QUIET",
     "REGEX",
     "RESET",
+    "SINCE",
+    "STATUS",
+    "SUBSCRIBE",
     "TTY",
+    "UNSUBSCRIBE",
+    "UNTIL",
     "USER",
     NULL
 };
@@ -95,14 +107,22 @@ req_t * create_req(void)
     req->ip = NULL;
     req->port = 0;
     req->consoles = list_create((ListDelF) destroy_string);
+    req->logSince = 0;
+    req->logUntil = 0;
+    req->logBytes = 0;
+    req->logLines = 0;
     req->command = CONMAN_CMD_NONE;
     req->enableBroadcast = 0;
+    req->enableCompress = 0;
     req->enableEcho = 0;
     req->enableForce = 0;
     req->enableJoin = 0;
+    req->enableMux = 0;
+    req->enableQueryAll = 0;
     req->enableQuiet = 0;
     req->enableRegex = 0;
     req->enableReset = 0;
+    req->enableStatus = 0;
     return(req);
 }
 
@@ -137,6 +157,17 @@ void destroy_req(req_t *req)
 }
 
 
+int is_log_range_req(req_t *req)
+{
+/*  Returns true if the request is for a range of the console log to be
+ *    replayed from disk (instead of a live monitor session).
+ */
+    assert(req != NULL);
+
+    return(req->logSince || req->logUntil || req->logBytes || req->logLines);
+}
+
+
 void get_tty_mode(struct termios *tty, int fd)
 {
 /*  Gets the tty values associated with 'fd' and stores them in 'tty'.
@@ -25,7 +25,9 @@
 #ifndef _COMMON_H
 #define _COMMON_H
 
+#include <sys/types.h>
 #include <termios.h>
+#include <time.h>
 #include "lex.h"
 #include "list.h"
 
@@ -37,6 +39,10 @@
 #  define _PATH_STDPATH "/usr/bin:/bin:/usr/sbin:/sbin"
 #endif /* !_PATH_STDPATH */
 
+#ifndef _PATH_TMP
+#  define _PATH_TMP "/tmp/"
+#endif /* !_PATH_TMP */
+
 
 /*  Default escape char for the client.
  */
@@ -86,6 +92,37 @@
 #define ESC_CHAR_RESET          'R'
 #define ESC_CHAR_SUSPEND        'Z'
 
+/*  Compression of server output (OPTION=COMPRESS in the greeting).
+ *  If the server accepts, its reply to the greeting includes the option,
+ *    and everything it sends after the response to the request is a zlib
+ *    stream (RFC 1950) that is sync-flushed after each write so keystroke
+ *    echoes are not held back.  The data within is unchanged, so info msgs,
+ *    log replays, and multiplexed records are carried as before.  Data sent
+ *    by the client (including its escape sequences) is never compressed.
+ */
+#define CONMAN_ZIP_WINDOW_BITS  15
+
+/*  Record framing for multiplexed sessions (OPTION=MULTIPLEX).
+ *  Once the request has been answered, data in both directions is sent
+ *    as records, each starting with a CONMAN_MUX_HDR_LEN-byte header of a
+ *    32-bit console id followed by a 16-bit payload length, both in network
+ *    byte order.  The server announces the id of each console as the client
+ *    is subscribed to it.  Escape sequences are not used in these sessions.
+ *  Records for CONMAN_MUX_ID_CTRL carry control msgs (one per record) using
+ *    the protocol strings:  the client sends SUBSCRIBE or UNSUBSCRIBE with
+ *    CONSOLE='<str>' patterns (or UNSUBSCRIBE with ID=<int>), and the server
+ *    replies with SUBSCRIBE or UNSUBSCRIBE and CONSOLE='<str>' ID=<int> for
+ *    each affected console (or ERROR with CODE=<int> MESSAGE='<str>').
+ *    If any of the client's output had to be dropped, the server sends
+ *    DROPPED with BYTES=<int> once the client has caught up.
+ *  In a CONNECT session, a record sent for CONMAN_MUX_ID_ALL is written to
+ *    every console to which the client is subscribed.
+ */
+#define CONMAN_MUX_HDR_LEN      6
+#define CONMAN_MUX_ID_CTRL      0
+#define CONMAN_MUX_ID_ALL       0xFFFFFFFFU
+#define CONMAN_MUX_MAX_LEN      65535
+
 /*  Version string information
  */
 #ifndef NDEBUG
@@ -112,10 +149,17 @@
 #  define FEATURE_TCP_WRAPPERS ""
 #endif /* WITH_TCP_WRAPPERS */
 
+#if WITH_SDT
+#  define FEATURE_SDT " SDT"
+#else
+#  define FEATURE_SDT ""
+#endif /* WITH_SDT */
+
 #define CLIENT_FEATURES \
     (FEATURE_DEBUG FEATURE_DMALLOC)
 #define SERVER_FEATURES \
-    (FEATURE_DEBUG FEATURE_DMALLOC FEATURE_FREEIPMI FEATURE_TCP_WRAPPERS)
+    (FEATURE_DEBUG FEATURE_DMALLOC FEATURE_FREEIPMI FEATURE_SDT \
+     FEATURE_TCP_WRAPPERS)
 
 #if ! HAVE_SOCKLEN_T
 typedef int socklen_t;                  /* socklen_t is uint32_t in Posix.1g */
@@ -138,14 +182,22 @@ typedef struct request {
     char     *ip;                       /* queried remote ip addr string     */
     int       port;                     /* remote port number                */
     List      consoles;                 /* list of consoles affected by cmd  */
+    time_t    logSince;                 /* replay console log from this time */
+    time_t    logUntil;                 /* replay console log to this time   */
+    off_t     logBytes;                 /* replay last num bytes of log      */
+    off_t     logLines;                 /* replay last num lines of log      */
     unsigned  command:2;                /* ConMan command to perform (cmd_t) */
     unsigned  enableBroadcast:1;        /* true if b-casting to >1 consoles  */
+    unsigned  enableCompress:1;         /* true if compressing server output */
     unsigned  enableEcho:1;             /* true if echoing standard input    */
     unsigned  enableForce:1;            /* true if forcing console conn      */
     unsigned  enableJoin:1;             /* true if joining console conn      */
+    unsigned  enableMux:1;              /* true if multiplexing consoles     */
+    unsigned  enableQueryAll:1;         /* true if querying every console    */
     unsigned  enableQuiet:1;            /* true if suppressing info messages */
     unsigned  enableRegex:1;            /* true if regex console matching    */
     unsigned  enableReset:1;            /* true if server supports reset cmd */
+    unsigned  enableStatus:1;           /* true if querying console status   */
 } req_t;
 
 
@@ -165,22 +217,34 @@ enum proto_toks {
  *  Keep enums in sync w/ common.c:proto_strs[].
  */
     CONMAN_TOK_BROADCAST = LEX_TOK_OFFSET,
+    CONMAN_TOK_BYTES,
+    CONMAN_TOK_CLIENTS,
     CONMAN_TOK_CODE,
+    CONMAN_TOK_COMPRESS,
     CONMAN_TOK_CONNECT,
     CONMAN_TOK_CONSOLE,
+    CONMAN_TOK_DROPPED,
     CONMAN_TOK_ERROR,
     CONMAN_TOK_FORCE,
     CONMAN_TOK_HELLO,
+    CONMAN_TOK_ID,
     CONMAN_TOK_JOIN,
+    CONMAN_TOK_LINES,
     CONMAN_TOK_MESSAGE,
     CONMAN_TOK_MONITOR,
+    CONMAN_TOK_MULTIPLEX,
     CONMAN_TOK_OK,
     CONMAN_TOK_OPTION,
     CONMAN_TOK_QUERY,
     CONMAN_TOK_QUIET,
     CONMAN_TOK_REGEX,
     CONMAN_TOK_RESET,
+    CONMAN_TOK_SINCE,
+    CONMAN_TOK_STATUS,
+    CONMAN_TOK_SUBSCRIBE,
     CONMAN_TOK_TTY,
+    CONMAN_TOK_UNSUBSCRIBE,
+    CONMAN_TOK_UNTIL,
     CONMAN_TOK_USER
 };
 
@@ -197,6 +261,8 @@ req_t * create_req(void);
 
 void destroy_req(req_t *req);
 
+int is_log_range_req(req_t *req);
+
 void get_tty_mode(struct termios *tty, int fd);
 
 void set_tty_mode(struct termios *tty, int fd);
@@ -0,0 +1,61 @@
+/*****************************************************************************
+ *  Written by Chris Dunlap <cdunlap@llnl.gov>.
+ *  Copyright (C) 2007-2016 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  UCRL-CODE-2002-009.
+ *
+ *  This file is part of ConMan: The Console Manager.
+ *  For details, see <https://dun.github.io/conman/>.
+ *
+ *  ConMan is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  ConMan is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with ConMan.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#ifndef _PROBE_H
+#define _PROBE_H
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+
+/*  PROBEn(name, arg1, ..., argn)
+ *    Static tracepoints (USDT) of the "conman" provider.
+ *  Unlike DPRINTF, these remain in production code.  Each compiles to a
+ *    single nop (plus an ELF note describing where its args can be found)
+ *    that a tracer such as bpftrace or perf can attach to at runtime.
+ *    Without <sys/sdt.h>, they compile to nothing.
+ *  The args are still evaluated while no tracer is attached, so they
+ *    should be limited to values already at hand.
+ *  Refer to lib/bpftrace/ for scripts using these probes.
+ */
+#if WITH_SDT
+#  include <sys/sdt.h>
+#  define PROBE1(name,a1)                                                    \
+     DTRACE_PROBE1(conman, name, a1)
+#  define PROBE2(name,a1,a2)                                                 \
+     DTRACE_PROBE2(conman, name, a1, a2)
+#  define PROBE3(name,a1,a2,a3)                                              \
+     DTRACE_PROBE3(conman, name, a1, a2, a3)
+#  define PROBE4(name,a1,a2,a3,a4)                                           \
+     DTRACE_PROBE4(conman, name, a1, a2, a3, a4)
+#else /* !WITH_SDT */
+#  define PROBE1(name,a1)
+#  define PROBE2(name,a1,a2)
+#  define PROBE3(name,a1,a2,a3)
+#  define PROBE4(name,a1,a2,a3,a4)
+#endif /* WITH_SDT */
+
+
+#endif /* !_PROBE_H */
@@ -54,34 +54,50 @@ enum server_conf_toks {
 /*
  *  Keep enums in sync w/ server_conf_strs[].
  */
-    SERVER_CONF_CONSOLE = LEX_TOK_OFFSET,
+    SERVER_CONF_CLIENTOVERFLOW = LEX_TOK_OFFSET,
+    SERVER_CONF_CONSOLE,
+    SERVER_CONF_CONSOLEBUFSIZE,
     SERVER_CONF_COREDUMP,
     SERVER_CONF_COREDUMPDIR,
     SERVER_CONF_DEV,
     SERVER_CONF_EXECPATH,
+    SERVER_CONF_FORWARD,
+    SERVER_CONF_FORWARDSPOOL,
     SERVER_CONF_GLOBAL,
+    SERVER_CONF_IOTHREADS,
 #if WITH_FREEIPMI
+    SERVER_CONF_IPMIMAXCONNECTS,
     SERVER_CONF_IPMIOPTS,
 #endif /* WITH_FREEIPMI */
     SERVER_CONF_KEEPALIVE,
     SERVER_CONF_LOG,
+    SERVER_CONF_LOGBUFSIZE,
     SERVER_CONF_LOGDIR,
     SERVER_CONF_LOGFILE,
     SERVER_CONF_LOGOPTS,
     SERVER_CONF_LOOPBACK,
+    SERVER_CONF_MAXCONNECTS,
+    SERVER_CONF_MAXHOSTCONNECTS,
+    SERVER_CONF_METRICSPORT,
     SERVER_CONF_NAME,
     SERVER_CONF_NOFILE,
     SERVER_CONF_OFF,
     SERVER_CONF_ON,
     SERVER_CONF_PIDFILE,
     SERVER_CONF_PORT,
+    SERVER_CONF_READBUDGET,
+    SERVER_CONF_REPLAY,
+    SERVER_CONF_REPLAYSIZE,
     SERVER_CONF_RESETCMD,
     SERVER_CONF_SEROPTS,
     SERVER_CONF_SERVER,
     SERVER_CONF_SYSLOG,
     SERVER_CONF_TCPWRAPPERS,
     SERVER_CONF_TESTOPTS,
-    SERVER_CONF_TIMESTAMP
+    SERVER_CONF_TIMESTAMP,
+    SERVER_CONF_TRIGGERCMD,
+    SERVER_CONF_TRIGGERFILE,
+    SERVER_CONF_TRIGGERSOCK
 };
 
 static char *server_conf_strs[] = {
@@ -89,27 +105,40 @@ static char *server_conf_strs[] = {
  *  Keep strings in sync w/ server_conf_toks enum.
  *  These must be sorted in a case-insensitive manner.
  */
+    "CLIENTOVERFLOW",
     "CONSOLE",
+    "CONSOLEBUFSIZE",
     "COREDUMP",
     "COREDUMPDIR",
     "DEV",
     "EXECPATH",
+    "FORWARD",
+    "FORWARDSPOOL",
     "GLOBAL",
+    "IOTHREADS",
 #if WITH_FREEIPMI
+    "IPMIMAXCONNECTS",
     "IPMIOPTS",
 #endif /* WITH_FREEIPMI */
     "KEEPALIVE",
     "LOG",
+    "LOGBUFSIZE",
     "LOGDIR",
     "LOGFILE",
     "LOGOPTS",
     "LOOPBACK",
+    "MAXCONNECTS",
+    "MAXHOSTCONNECTS",
+    "METRICSPORT",
     "NAME",
     "NOFILE",
     "OFF",
     "ON",
     "PIDFILE",
     "PORT",
+    "READBUDGET",
+    "REPLAY",
+    "REPLAYSIZE",
     "RESETCMD",
     "SEROPTS",
     "SERVER",
@@ -117,6 +146,9 @@ static char *server_conf_strs[] = {
     "TCPWRAPPERS",
     "TESTOPTS",
     "TIMESTAMP",
+    "TRIGGERCMD",
+    "TRIGGERFILE",
+    "TRIGGERSOCK",
     NULL
 };
 
@@ -170,6 +202,13 @@ static tag_t logFacilities[] = {
     { NULL,         -1 }
 };
 
+static tag_t clientOverflows[] = {
+    { "block",      CONMAN_OVERFLOW_BLOCK },
+    { "drop",       CONMAN_OVERFLOW_DROP },
+    { "spill",      CONMAN_OVERFLOW_SPILL },
+    { NULL,         -1 }
+};
+
 typedef struct console_strs {
     char *name;
     char *dev;
@@ -180,11 +219,14 @@ typedef struct console_strs {
     char *iopts;
 #endif /* WITH_FREEIPMI */
     char *topts;
+    char *replay;
+    int   replaySize;
 } console_strs_t;
 
 
 static void display_server_help(char *prog);
 static void signal_daemon(server_conf_t *conf);
+static int parse_config(server_conf_t *conf, int fd);
 static void parse_console_directive(server_conf_t *conf, Lex l);
 static int process_console(server_conf_t *conf, console_strs_t *con_p,
     char *errbuf, int errbuflen);
@@ -194,6 +236,7 @@ static int read_pidfile(const char *pidfile);
 static int write_pidfile(const char *pidfile);
 static int lookup_syslog_priority(const char *priority);
 static int lookup_syslog_facility(const char *facility);
+static int lookup_client_overflow(const char *overflow);
 
 
 server_conf_t * create_server_conf(void)
@@ -208,18 +251,32 @@ server_conf_t * create_server_conf(void)
     conf->confFileName = create_string(CONMAN_CONF);
     conf->coreDumpDir = NULL;
     conf->execPath = NULL;
+    conf->forwardHost = NULL;
+    conf->forwardPort = 0;
+    conf->forwardSpoolName = NULL;
+    conf->forwarder = NULL;
     conf->logDirName = NULL;
     conf->logFileName = NULL;
     conf->logFmtName = NULL;
     conf->logFilePtr = NULL;
     conf->logFileLevel = LOG_INFO;
+    conf->numIOThreads = 0;
     conf->numOpenFiles = 0;
+    conf->consoleBufSize = OBJ_BUF_SIZE;
+    conf->logBufSize = OBJ_BUF_SIZE;
+    conf->readBudget = OBJ_READ_BUDGET;
     conf->pidFileName = NULL;
     conf->resetCmd = NULL;
     conf->syslogFacility = -1;
     conf->throwSignal = -1;
+    conf->maxConnects = RECONNECT_DEFAULT_MAX;
+    conf->maxHostConnects = RECONNECT_DEFAULT_MAX_PER_HOST;
+    conf->clientOverflow = CONMAN_OVERFLOW_DROP;
     conf->tStampMinutes = 0;
     conf->tStampNext = 0;
+    conf->triggerCmd = NULL;
+    conf->triggerFileName = NULL;
+    conf->triggerSockName = NULL;
     /*
      *  The conf file's fd must be saved and kept open in order to hold an
      *    fcntl-style lock.  This lock is used to ensure only one instance
@@ -228,26 +285,46 @@ server_conf_t * create_server_conf(void)
      *    '-k' and '-r' cmdline options.
      */
     conf->fd = -1;
+    conf->numConfErrors = 0;
     conf->port = 0;
     conf->ld = -1;
+    conf->metricsPort = 0;
+    conf->metricsLd = -1;
     conf->objs = list_create((ListDelF) destroy_obj);
+    conf->consoleIndex = create_obj_index();
+    conf->deviceIndex = create_obj_index();
+    conf->logfileIndex = create_obj_index();
     if (!(conf->tp = tpoll_create(0))) {
         log_err(0, "Unable to create object for multiplexing I/O");
     }
+    conf->numConsoleObjs = 0;
+    conf->numOpenPending = 0;
     conf->globalLogName = NULL;
+    conf->globalLogOpts.enableCompress = DEFAULT_LOGOPT_COMPRESS;
     conf->globalLogOpts.enableSanitize = DEFAULT_LOGOPT_SANITIZE;
     conf->globalLogOpts.enableTimestamp = DEFAULT_LOGOPT_TIMESTAMP;
     conf->globalLogOpts.enableLock = DEFAULT_LOGOPT_LOCK;
+    conf->globalLogOpts.enableRotateZip = DEFAULT_LOGOPT_ROTATE_COMPRESS;
+    conf->globalLogOpts.rotateSize = DEFAULT_LOGOPT_ROTATE_SIZE;
+    conf->globalLogOpts.rotateAge = DEFAULT_LOGOPT_ROTATE_AGE;
+    conf->globalLogOpts.rotateCount = DEFAULT_LOGOPT_ROTATE_COUNT;
+    conf->globalLogOpts.coalesceMsecs = DEFAULT_LOGOPT_COALESCE_MSECS;
+    conf->globalLogOpts.coalesceSize = DEFAULT_LOGOPT_COALESCE_SIZE;
     conf->globalSerOpts.bps = DEFAULT_SEROPT_BPS;
+    conf->globalSerOpts.baud = DEFAULT_SEROPT_BAUD;
     conf->globalSerOpts.databits = DEFAULT_SEROPT_DATABITS;
     conf->globalSerOpts.parity = DEFAULT_SEROPT_PARITY;
     conf->globalSerOpts.stopbits = DEFAULT_SEROPT_STOPBITS;
+    conf->globalSerOpts.lowLatency = 0;
+    conf->globalReplayName = NULL;
+    conf->globalReplaySize = DEFAULT_REPLAY_SIZE;
 
 #if WITH_FREEIPMI
     if (init_ipmi_opts(&conf->globalIpmiOpts) < 0) {
         log_err(0, "Unable to initialize default IPMI options");
     }
     conf->numIpmiObjs = 0;
+    conf->ipmiMaxConnects = IPMI_DEFAULT_MAX_CONNECTS;
 #endif /* WITH_FREEIPMI */
 
     if (init_test_opts(&conf->globalTestOpts) < 0) {
@@ -299,9 +376,19 @@ void destroy_server_conf(server_conf_t *conf)
         }
         conf->ld = -1;
     }
+    if (conf->metricsLd >= 0) {
+        if (close(conf->metricsLd) < 0) {
+            log_msg(LOG_ERR, "Unable to close metrics listening socket: %s",
+                strerror(errno));
+        }
+        conf->metricsLd = -1;
+    }
     if (conf->objs) {
         list_destroy(conf->objs);
     }
+    destroy_obj_index(conf->consoleIndex);
+    destroy_obj_index(conf->deviceIndex);
+    destroy_obj_index(conf->logfileIndex);
     if (conf->tp) {
         tpoll_destroy(conf->tp);
     }
@@ -309,12 +396,18 @@ void destroy_server_conf(server_conf_t *conf)
     destroy_string(conf->coreDumpDir);
     destroy_string(conf->cwd);
     destroy_string(conf->execPath);
+    destroy_string(conf->forwardHost);
+    destroy_string(conf->forwardSpoolName);
     destroy_string(conf->globalLogName);
+    destroy_string(conf->globalReplayName);
     destroy_string(conf->logDirName);
     destroy_string(conf->logFileName);
     destroy_string(conf->logFmtName);
     destroy_string(conf->pidFileName);
     destroy_string(conf->resetCmd);
+    destroy_string(conf->triggerCmd);
+    destroy_string(conf->triggerFileName);
+    destroy_string(conf->triggerSockName);
     free(conf);
     return;
 }
@@ -384,12 +477,6 @@ void process_cmdline(server_conf_t *conf, int argc, char *argv[])
 void process_config(server_conf_t *conf)
 {
     pid_t pid;
-    struct stat fdStat;
-    int len;
-    char *buf;
-    int n;
-    Lex l;
-    int tok;
 
     /*  Keep conf->fd open after parsing the file in order to obtain the lock.
      */
@@ -414,57 +501,20 @@ void process_config(server_conf_t *conf)
         log_err(0, "Configuration \"%s\" in use by pid %d",
             conf->confFileName, pid);
     }
-    /*  Read config into memory for parsing.
-     */
     DPRINTF((9, "Opened config \"%s\": fd=%d.\n",
         conf->confFileName, conf->fd));
     set_fd_closed_on_exec(conf->fd);
-    if (fstat(conf->fd, &fdStat) < 0) {
-        log_err(errno, "Unable to stat \"%s\"", conf->confFileName);
-    }
-    len = fdStat.st_size;
-    if (!(buf = malloc(len + 1))) {
-        out_of_memory();
-    }
-    if ((n = read_n(conf->fd, buf, len)) < 0) {
+    if (parse_config(conf, conf->fd) < 0) {
         log_err(errno, "Unable to read \"%s\"", conf->confFileName);
     }
-    assert(n == len);
-    buf[len] = '\0';
-
-    l = lex_create(buf, server_conf_strs);
-    while ((tok = lex_next(l)) != LEX_EOF) {
-        switch(tok) {
-        case SERVER_CONF_CONSOLE:
-            parse_console_directive(conf, l);
-            break;
-        case SERVER_CONF_GLOBAL:
-            parse_global_directive(conf, l);
-            break;
-        case SERVER_CONF_SERVER:
-            parse_server_directive(conf, l);
-            break;
-        case LEX_EOL:
-            break;
-        case LEX_ERR:
-            log_msg(LOG_ERR, "CONFIG[%s:%d]: unmatched quote",
-                conf->confFileName, lex_line(l));
-            break;
-        default:
-            log_msg(LOG_ERR, "CONFIG[%s:%d]: unrecognized token '%s'",
-                conf->confFileName, lex_line(l), lex_text(l));
-            while (tok != LEX_EOL && tok != LEX_EOF) {
-                tok = lex_next(l);
-            }
-            break;
-        }
-    }
-    lex_destroy(l);
-    free(buf);
 
     if (conf->port <= 0) {              /* port not set so use default */
         conf->port = atoi(CONMAN_PORT);
     }
+    if (conf->metricsPort == conf->port) {
+        log_err(0, "Configuration \"%s\" has metricsport same as port %d",
+            conf->confFileName, conf->port);
+    }
     if (conf->logFileName) {
         if (strchr(conf->logFileName, '%')) {
             conf->logFmtName = create_string(conf->logFileName);
@@ -480,6 +530,81 @@ void process_config(server_conf_t *conf)
 }
 
 
+server_conf_t * reread_config(server_conf_t *conf)
+{
+/*  Re-reads the config file of the running daemon (conf) for a reconfig.
+ *  The file is parsed into a new conf whose objs are not yet opened or
+ *    assigned to i/o threads; the caller must then adopt the objs it wants
+ *    and destroy the new conf.  The new conf does not hold the lock, but
+ *    (conf) is re-locked on the file if it has since been replaced.
+ *  Returns the new conf, or NULL on error (in which case nothing changes).
+ */
+    server_conf_t *new;
+    struct stat pathStat;
+    struct stat fdStat;
+    int fd;
+
+    assert(conf != NULL);
+    assert(conf->fd >= 0);
+
+    /*  An editor may save the file by replacing it with a new one.  But the
+     *    existing fd cannot simply be closed after reading the file via
+     *    another fd since closing any fd of the file drops its fcntl lock.
+     */
+    if ((stat(conf->confFileName, &pathStat) < 0)
+            || (fstat(conf->fd, &fdStat) < 0)) {
+        log_msg(LOG_ERR, "Unable to stat \"%s\": %s",
+            conf->confFileName, strerror(errno));
+        return(NULL);
+    }
+    if ((pathStat.st_dev == fdStat.st_dev)
+            && (pathStat.st_ino == fdStat.st_ino)) {
+        fd = conf->fd;
+        if (lseek(fd, 0, SEEK_SET) < 0) {
+            log_msg(LOG_ERR, "Unable to rewind \"%s\": %s",
+                conf->confFileName, strerror(errno));
+            return(NULL);
+        }
+    }
+    else if ((fd = open(conf->confFileName, O_RDONLY)) < 0) {
+        log_msg(LOG_ERR, "Unable to open \"%s\": %s",
+            conf->confFileName, strerror(errno));
+        return(NULL);
+    }
+    else {
+        set_fd_closed_on_exec(fd);
+        if (get_read_lock(fd) < 0) {
+            log_msg(LOG_WARNING, "Unable to lock configuration \"%s\"",
+                conf->confFileName);
+        }
+        (void) close(conf->fd);
+        conf->fd = fd;
+        DPRINTF((9, "Reopened config \"%s\": fd=%d.\n",
+            conf->confFileName, conf->fd));
+    }
+    new = create_server_conf();
+    destroy_string(new->confFileName);
+    new->confFileName = create_string(conf->confFileName);
+    destroy_string(new->cwd);
+    new->cwd = create_string(conf->cwd);
+    destroy_string(new->logDirName);
+    new->logDirName = create_string(conf->cwd);
+
+    if (parse_config(new, fd) < 0) {
+        log_msg(LOG_ERR, "Unable to read \"%s\": %s",
+            conf->confFileName, strerror(errno));
+        destroy_server_conf(new);
+        return(NULL);
+    }
+    /*  SERVER directives are not re-applied, so prevent the pidfile of the
+     *    new conf from being unlinked when it is destroyed.
+     */
+    destroy_string(new->pidFileName);
+    new->pidFileName = NULL;
+    return(new);
+}
+
+
 static void display_server_help(char *prog)
 {
 /*  Displays a help message for the server's command-line options.
@@ -578,10 +703,72 @@ static void signal_daemon(server_conf_t *conf)
 }
 
 
+static int parse_config(server_conf_t *conf, int fd)
+{
+/*  Reads the config file open on (fd) into memory and parses it into (conf).
+ *  Errors in the config are logged and counted in conf->numConfErrors.
+ *  Returns 0 on success, or -1 if the file cannot be read (with errno set).
+ */
+    struct stat fdStat;
+    int len;
+    char *buf;
+    int n;
+    Lex l;
+    int tok;
+
+    if (fstat(fd, &fdStat) < 0) {
+        return(-1);
+    }
+    len = fdStat.st_size;
+    if (!(buf = malloc(len + 1))) {
+        out_of_memory();
+    }
+    if ((n = read_n(fd, buf, len)) < 0) {
+        free(buf);
+        return(-1);
+    }
+    buf[n] = '\0';
+
+    l = lex_create(buf, server_conf_strs);
+    while ((tok = lex_next(l)) != LEX_EOF) {
+        switch(tok) {
+        case SERVER_CONF_CONSOLE:
+            parse_console_directive(conf, l);
+            break;
+        case SERVER_CONF_GLOBAL:
+            parse_global_directive(conf, l);
+            break;
+        case SERVER_CONF_SERVER:
+            parse_server_directive(conf, l);
+            break;
+        case LEX_EOL:
+            break;
+        case LEX_ERR:
+            log_msg(LOG_ERR, "CONFIG[%s:%d]: unmatched quote",
+                conf->confFileName, lex_line(l));
+            conf->numConfErrors++;
+            break;
+        default:
+            log_msg(LOG_ERR, "CONFIG[%s:%d]: unrecognized token '%s'",
+                conf->confFileName, lex_line(l), lex_text(l));
+            conf->numConfErrors++;
+            while (tok != LEX_EOL && tok != LEX_EOF) {
+                tok = lex_next(l);
+            }
+            break;
+        }
+    }
+    lex_destroy(l);
+    free(buf);
+    return(0);
+}
+
+
 static void parse_console_directive(server_conf_t *conf, Lex l)
 {
 /*  CONSOLE NAME="<str>" DEV="<file>" [LOG="<file>"]
  *    [LOGOPTS="<str>"] [SEROPTS="<str>"] [IPMIOPTS="<str>"] [TESTOPTS="<str>"]
+ *    [REPLAY="<file>"] [REPLAYSIZE=<int>]
  *  Note: IPMIOPTS is only available if WITH_FREEIPMI is defined.
  */
     const char *directive;              /* name of directive being parsed */
@@ -590,6 +777,7 @@ static void parse_console_directive(server_conf_t *conf, Lex l)
     int done = 0;
     char err[MAX_LINE] = "";
     console_strs_t con;
+    int n;
 
     memset(&con, 0, sizeof(con));
 
@@ -721,6 +909,47 @@ static void parse_console_directive(server_conf_t *conf, Lex l)
             }
             break;
 
+        case SERVER_CONF_REPLAY:
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if (lex_next(l) != LEX_STR) {
+                snprintf(err, sizeof(err),
+                    "expected STRING for %s value", tokstr);
+            }
+            else if (is_empty_string(lex_text(l))) {
+                replace_string(&con.replay, "");
+            }
+            else if ((lex_text(l)[0] != '/') && (conf->logDirName)) {
+                destroy_string(con.replay);
+                con.replay = create_format_string("%s/%s",
+                    conf->logDirName, lex_text(l));
+            }
+            else {
+                replace_string(&con.replay, lex_text(l));
+            }
+            break;
+
+        case SERVER_CONF_REPLAYSIZE:
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if (lex_next(l) != LEX_INT) {
+                snprintf(err, sizeof(err),
+                    "expected INTEGER for %s value", tokstr);
+            }
+            else if (((n = atoi(lex_text(l))) < REPLAY_SIZE_MIN)
+                    || (n > REPLAY_SIZE_MAX)) {
+                snprintf(err, sizeof(err),
+                    "invalid %s value %d", tokstr, n);
+            }
+            else {
+                con.replaySize = n;
+            }
+            break;
+
         case LEX_EOF:
         case LEX_EOL:
             done = 1;
@@ -746,6 +975,7 @@ static void parse_console_directive(server_conf_t *conf, Lex l)
     if (*err) {
         log_msg(LOG_ERR, "CONFIG[%s:%d]: %s",
             conf->confFileName, lex_line(l), err);
+        conf->numConfErrors++;
         while (lex_prev(l) != LEX_EOL && lex_prev(l) != LEX_EOF) {
             (void) lex_next(l);
         }
@@ -759,6 +989,7 @@ static void parse_console_directive(server_conf_t *conf, Lex l)
     destroy_string(con.iopts);
 #endif /* WITH_FREEIPMI */
     destroy_string(con.topts);
+    destroy_string(con.replay);
     return;
 }
 
@@ -944,6 +1175,22 @@ static int process_console(server_conf_t *conf, console_strs_t *con_p,
         }
         link_objs(console, logfile);
     }
+    if ((con_p->replay && con_p->replay[ 0 ] != '\0')
+            || (!con_p->replay && conf->globalReplayName)) {
+        if (con_p->replay) {
+            strlcpy(buf, con_p->replay, sizeof(buf));
+        }
+        else if ((conf->globalReplayName[ 0 ] != '/') && (conf->logDirName)) {
+            snprintf(buf, sizeof(buf), "%s/%s",
+                conf->logDirName, conf->globalReplayName);
+            buf[ sizeof(buf) - 1 ] = '\0';
+        }
+        else {
+            strlcpy(buf, conf->globalReplayName, sizeof(buf));
+        }
+        console->ring = create_replay_ring(buf, (con_p->replaySize > 0)
+            ? con_p->replaySize : conf->globalReplaySize);
+    }
     list_destroy(args);
     return(0);
 
@@ -963,6 +1210,7 @@ static void parse_global_directive(server_conf_t *conf, Lex l)
     const char *tokstr;
     int done = 0;
     char err[MAX_LINE] = "";
+    int n;
 
     directive = lex_tok_to_str(l, lex_prev(l));
     if (!directive) {
@@ -1074,6 +1322,53 @@ static void parse_global_directive(server_conf_t *conf, Lex l)
             }
             break;
 
+        case SERVER_CONF_REPLAY:
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if (lex_next(l) != LEX_STR) {
+                snprintf(err, sizeof(err),
+                    "expected STRING for %s value", tokstr);
+            }
+            else if (is_empty_string(lex_text(l))) {
+                /*
+                 *  Unset global replay ring name if string is empty.
+                 */
+                destroy_string(conf->globalReplayName);
+                conf->globalReplayName = NULL;
+            }
+            else if (!strstr(lex_text(l), "%N")
+                    && !strstr(lex_text(l), "%D")) {
+                snprintf(err, sizeof(err),
+                    "ignoring %s %s value without '%%N' or '%%D'",
+                    directive, tokstr);
+            }
+            else {
+                destroy_string(conf->globalReplayName);
+                conf->globalReplayName = create_string(lex_text(l));
+            }
+            break;
+
+        case SERVER_CONF_REPLAYSIZE:
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if (lex_next(l) != LEX_INT) {
+                snprintf(err, sizeof(err),
+                    "expected INTEGER for %s value", tokstr);
+            }
+            else if (((n = atoi(lex_text(l))) < REPLAY_SIZE_MIN)
+                    || (n > REPLAY_SIZE_MAX)) {
+                snprintf(err, sizeof(err),
+                    "invalid %s value %d", tokstr, n);
+            }
+            else {
+                conf->globalReplaySize = n;
+            }
+            break;
+
         case LEX_EOF:
         case LEX_EOL:
             done = 1;
@@ -1092,6 +1387,7 @@ static void parse_global_directive(server_conf_t *conf, Lex l)
     if (*err) {
         log_msg(LOG_ERR, "CONFIG[%s:%d]: %s",
             conf->confFileName, lex_line(l), err);
+        conf->numConfErrors++;
         while (lex_prev(l) != LEX_EOL && lex_prev(l) != LEX_EOF) {
             (void) lex_next(l);
         }
@@ -1125,6 +1421,44 @@ static void parse_server_directive(server_conf_t *conf, Lex l)
         tokstr = lex_tok_to_str(l, tok);
         switch(tok) {
 
+        case SERVER_CONF_CLIENTOVERFLOW:
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if ((lex_next(l) != LEX_STR)
+                    || is_empty_string(lex_text(l))) {
+                snprintf(err, sizeof(err),
+                    "expected STRING for %s value", tokstr);
+            }
+            else if ((n = lookup_client_overflow(lex_text(l))) < 0) {
+                snprintf(err, sizeof(err),
+                    "invalid %s policy \"%s\"", tokstr, lex_text(l));
+            }
+            else {
+                conf->clientOverflow = n;
+            }
+            break;
+
+        case SERVER_CONF_CONSOLEBUFSIZE:
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if (lex_next(l) != LEX_INT) {
+                snprintf(err, sizeof(err),
+                    "expected INTEGER for %s value", tokstr);
+            }
+            else if (((n = atoi(lex_text(l))) < OBJ_BUF_SIZE_MIN)
+                    || (n > OBJ_BUF_SIZE_MAX)) {
+                snprintf(err, sizeof(err),
+                    "invalid %s value %d", tokstr, n);
+            }
+            else {
+                conf->consoleBufSize = n;
+            }
+            break;
+
         case SERVER_CONF_COREDUMP:
             if (lex_next(l) != '=') {
                 snprintf(err, sizeof(err),
@@ -1202,6 +1536,99 @@ static void parse_server_directive(server_conf_t *conf, Lex l)
             }
             break;
 
+        case SERVER_CONF_FORWARD:
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if (lex_next(l) != LEX_STR) {
+                snprintf(err, sizeof(err),
+                    "expected STRING for %s value", tokstr);
+            }
+            else if (is_empty_string(lex_text(l))) {
+                destroy_string(conf->forwardHost);
+                conf->forwardHost = NULL;
+                conf->forwardPort = 0;
+            }
+            else if (!is_telnet_dev(lex_text(l), &p, &n)) {
+                snprintf(err, sizeof(err),
+                    "expected \"host:port\" for %s value", tokstr);
+            }
+            else if ((p[0] == '\0') || (n <= 0) || (n > 65535)) {
+                snprintf(err, sizeof(err),
+                    "invalid %s value \"%s\"", tokstr, lex_text(l));
+                destroy_string(p);
+            }
+            else {
+                destroy_string(conf->forwardHost);
+                conf->forwardHost = p;
+                conf->forwardPort = n;
+            }
+            break;
+
+        case SERVER_CONF_FORWARDSPOOL:
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if (lex_next(l) != LEX_STR) {
+                snprintf(err, sizeof(err),
+                    "expected STRING for %s value", tokstr);
+            }
+            else if (is_empty_string(lex_text(l))) {
+                destroy_string(conf->forwardSpoolName);
+                conf->forwardSpoolName = NULL;
+            }
+            else {
+                destroy_string(conf->forwardSpoolName);
+                if (lex_text(l)[0] != '/') {
+                    conf->forwardSpoolName = create_format_string("%s/%s",
+                        conf->cwd, lex_text(l));
+                }
+                else {
+                    conf->forwardSpoolName = create_string(lex_text(l));
+                }
+            }
+            break;
+
+        case SERVER_CONF_IOTHREADS:
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if (lex_next(l) != LEX_INT) {
+                snprintf(err, sizeof(err),
+                    "expected INTEGER for %s value", tokstr);
+            }
+            else if ((n = atoi(lex_text(l))) < 0) {
+                snprintf(err, sizeof(err),
+                    "invalid %s value %d", tokstr, n);
+            }
+            else {
+                conf->numIOThreads = n;
+            }
+            break;
+
+#if WITH_FREEIPMI
+        case SERVER_CONF_IPMIMAXCONNECTS:
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if (lex_next(l) != LEX_INT) {
+                snprintf(err, sizeof(err),
+                    "expected INTEGER for %s value", tokstr);
+            }
+            else if ((n = atoi(lex_text(l))) < 0) {
+                snprintf(err, sizeof(err),
+                    "invalid %s value %d", tokstr, n);
+            }
+            else {
+                conf->ipmiMaxConnects = n;
+            }
+            break;
+#endif /* WITH_FREEIPMI */
+
         case SERVER_CONF_KEEPALIVE:
             if (lex_next(l) != '=') {
                 snprintf(err, sizeof(err),
@@ -1219,6 +1646,25 @@ static void parse_server_directive(server_conf_t *conf, Lex l)
             }
             break;
 
+        case SERVER_CONF_LOGBUFSIZE:
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if (lex_next(l) != LEX_INT) {
+                snprintf(err, sizeof(err),
+                    "expected INTEGER for %s value", tokstr);
+            }
+            else if (((n = atoi(lex_text(l))) < OBJ_BUF_SIZE)
+                    || (n > OBJ_BUF_SIZE_MAX)) {
+                snprintf(err, sizeof(err),
+                    "invalid %s value %d", tokstr, n);
+            }
+            else {
+                conf->logBufSize = n;
+            }
+            break;
+
         case SERVER_CONF_LOGDIR:
             if (lex_next(l) != '=') {
                 snprintf(err, sizeof(err),
@@ -1290,6 +1736,60 @@ static void parse_server_directive(server_conf_t *conf, Lex l)
             }
             break;
 
+        case SERVER_CONF_MAXCONNECTS:
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if (lex_next(l) != LEX_INT) {
+                snprintf(err, sizeof(err),
+                    "expected INTEGER for %s value", tokstr);
+            }
+            else if ((n = atoi(lex_text(l))) < 0) {
+                snprintf(err, sizeof(err),
+                    "invalid %s value %d", tokstr, n);
+            }
+            else {
+                conf->maxConnects = n;
+            }
+            break;
+
+        case SERVER_CONF_MAXHOSTCONNECTS:
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if (lex_next(l) != LEX_INT) {
+                snprintf(err, sizeof(err),
+                    "expected INTEGER for %s value", tokstr);
+            }
+            else if ((n = atoi(lex_text(l))) < 0) {
+                snprintf(err, sizeof(err),
+                    "invalid %s value %d", tokstr, n);
+            }
+            else {
+                conf->maxHostConnects = n;
+            }
+            break;
+
+        case SERVER_CONF_METRICSPORT:
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if (lex_next(l) != LEX_INT) {
+                snprintf(err, sizeof(err),
+                    "expected INTEGER for %s value", tokstr);
+            }
+            else if (((n = atoi(lex_text(l))) < 0) || (n > 65535)) {
+                snprintf(err, sizeof(err),
+                    "invalid %s value %d", tokstr, n);
+            }
+            else {
+                conf->metricsPort = n;
+            }
+            break;
+
         case SERVER_CONF_NOFILE:
             if (lex_next(l) != '=') {
                 snprintf(err, sizeof(err),
@@ -1345,6 +1845,25 @@ static void parse_server_directive(server_conf_t *conf, Lex l)
             }
             break;
 
+        case SERVER_CONF_READBUDGET:
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if (lex_next(l) != LEX_INT) {
+                snprintf(err, sizeof(err),
+                    "expected INTEGER for %s value", tokstr);
+            }
+            else if (((n = atoi(lex_text(l))) < 0)
+                    || (n > OBJ_BUF_SIZE_MAX)) {
+                snprintf(err, sizeof(err),
+                    "invalid %s value %d", tokstr, n);
+            }
+            else {
+                conf->readBudget = n;
+            }
+            break;
+
         case SERVER_CONF_RESETCMD:
             if (lex_next(l) != '=') {
                 snprintf(err, sizeof(err),
@@ -1456,6 +1975,66 @@ static void parse_server_directive(server_conf_t *conf, Lex l)
             }
             break;
 
+        case SERVER_CONF_TRIGGERCMD:
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if ((lex_next(l) != LEX_STR)
+                    || is_empty_string(lex_text(l))) {
+                snprintf(err, sizeof(err),
+                    "expected STRING for %s value", tokstr);
+            }
+            else {
+                destroy_string(conf->triggerCmd);
+                conf->triggerCmd = create_string(lex_text(l));
+            }
+            break;
+
+        case SERVER_CONF_TRIGGERFILE:
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if ((lex_next(l) != LEX_STR)
+                    || is_empty_string(lex_text(l))) {
+                snprintf(err, sizeof(err),
+                    "expected STRING for %s value", tokstr);
+            }
+            else {
+                destroy_string(conf->triggerFileName);
+                if (lex_text(l)[0] != '/') {
+                    conf->triggerFileName = create_format_string("%s/%s",
+                        conf->cwd, lex_text(l));
+                }
+                else {
+                    conf->triggerFileName = create_string(lex_text(l));
+                }
+            }
+            break;
+
+        case SERVER_CONF_TRIGGERSOCK:
+            if (lex_next(l) != '=') {
+                snprintf(err, sizeof(err),
+                    "expected '=' after %s keyword", tokstr);
+            }
+            else if ((lex_next(l) != LEX_STR)
+                    || is_empty_string(lex_text(l))) {
+                snprintf(err, sizeof(err),
+                    "expected STRING for %s value", tokstr);
+            }
+            else {
+                destroy_string(conf->triggerSockName);
+                if (lex_text(l)[0] != '/') {
+                    conf->triggerSockName = create_format_string("%s/%s",
+                        conf->cwd, lex_text(l));
+                }
+                else {
+                    conf->triggerSockName = create_string(lex_text(l));
+                }
+            }
+            break;
+
         case LEX_EOF:
         case LEX_EOL:
             done = 1;
@@ -1474,6 +2053,7 @@ static void parse_server_directive(server_conf_t *conf, Lex l)
     if (*err) {
         log_msg(LOG_ERR, "CONFIG[%s:%d]: %s",
             conf->confFileName, lex_line(l), err);
+        conf->numConfErrors++;
         while (lex_prev(l) != LEX_EOL && lex_prev(l) != LEX_EOF) {
             (void) lex_next(l);
         }
@@ -1614,3 +2194,24 @@ static int lookup_syslog_facility(const char *facility)
     }
     return(-1);
 }
+
+
+static int lookup_client_overflow(const char *overflow)
+{
+/*  Returns the numeric id associated with the specified client overflow
+ *    policy, or -1 if no match is found.
+ */
+    tag_t *t;
+
+    assert(overflow != NULL);
+
+    while (*overflow && isspace((int) *overflow)) {
+        overflow++;
+    }
+    for (t=clientOverflows; t->key; t++) {
+        if (!strcasecmp(t->key, overflow)) {
+            return(t->val);
+        }
+    }
+    return(-1);
+}
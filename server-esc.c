@@ -41,9 +41,6 @@
 #include "tpoll.h"
 #include "util-str.h"
 #include "util.h"
-#include "wrapper.h"
-
-extern tpoll_t tp_global;               /* defined in server.c */
 
 
 static void perform_serial_break(obj_t *client);
@@ -65,7 +62,8 @@ int process_client_escapes(obj_t *client, void *src, int len)
  *  Returns the new length of the modified buffer.
  */
     const unsigned char *last = (unsigned char *) src + len;
-    unsigned char *p, *q;
+    unsigned char *p, *q, *r;
+    int n;
 
     assert(is_client_obj(client));
     assert(client->fd >= 0);
@@ -74,7 +72,22 @@ int process_client_escapes(obj_t *client, void *src, int len)
         return(0);
 
     for (p=q=src; p<last; p++) {
-        if (client->aux.client.gotEscape) {
+        if (!client->aux.client.gotEscape) {
+            /*
+             *  Scan ahead for the next escape char and move the run of data
+             *    preceding it down over any bytes removed thus far.
+             */
+            r = memchr(p, ESC_CHAR, last - p);
+            n = (r ? r : last) - p;
+            if (q != p)
+                memmove(q, p, n);
+            q += n;
+            p += n;
+            if (!r)
+                break;
+            client->aux.client.gotEscape = 1;
+        }
+        else {
             client->aux.client.gotEscape = 0;
             switch (*p) {
             case ESC_CHAR:
@@ -119,12 +132,6 @@ int process_client_escapes(obj_t *client, void *src, int len)
                 break;
             }
         }
-        else if (*p == ESC_CHAR) {
-            client->aux.client.gotEscape = 1;
-        }
-        else {
-            *q++ = *p;
-        }
     }
     assert((q >= (unsigned char *) src) && (q <= p));
     len = q - (unsigned char *) src;
@@ -264,6 +271,9 @@ static void perform_log_replay(obj_t *client)
 /*  Kinda like TiVo's Instant Replay.  :)
  *  Replays the last bytes from the console logfile (if present) associated
  *    with this client (in either a R/O or R/W session, but not a B/C session).
+ *  If the console has a replay ring, the entire ring is replayed instead.
+ *    Since it is copied into the client's output queue as the queue drains
+ *    (via replay_client_data()), it is not bounded by LOG_REPLAY_LEN.
  *
  *  The maximum amount of data that can be written into an object's
  *    circular-buffer via write_obj_data() is (OBJ_BUF_SIZE - 1) bytes.
@@ -278,6 +288,7 @@ static void perform_log_replay(obj_t *client)
     int len = sizeof(buf);
     unsigned char *p;
     int n, m;
+    off_t start, end;
 
     assert(is_client_obj(client));
 
@@ -291,6 +302,37 @@ static void perform_log_replay(obj_t *client)
     assert(list_count(client->writers) == 1);
     console = list_peek(client->writers);
     assert(is_console_obj(console));
+
+    /*  A multiplexed client is replayed from the logfile instead of the ring
+     *    since its output must be framed in records for the console.
+     */
+    if (console->ring && !client->aux.client.mux
+            && (get_replay_ring_range(console, &start, &end) >= 0)) {
+        if (client->aux.client.gotReplay) {
+            return;
+        }
+        /*  The ring can be read without a lock since the console
+         *    is muxed by the same i/o thread as this client.
+         */
+        assert(console->tp == client->tp);
+
+        n = snprintf((char *) buf, sizeof(buf),
+            "%sBegin log replay of console [%s]%s",
+            CONMAN_MSG_PREFIX, console->name, CONMAN_MSG_SUFFIX);
+        if ((n < 0) || (n >= (int) sizeof(buf))) {
+            log_msg(LOG_WARNING,
+                "Insufficient buffer to replay console [%s] log for <%s>",
+                console->name, client->name);
+            return;
+        }
+        DPRINTF((5, "Performing ring replay on console [%s].\n",
+            console->name));
+        write_obj_data(client, buf, n, 0);
+        client->aux.client.replayPos = start;
+        client->aux.client.gotReplay = 1;
+        replay_client_data(client);
+        return;
+    }
     logfile = get_console_logfile_obj(console);
 
     if (!logfile) {
@@ -331,7 +373,10 @@ static void perform_log_replay(obj_t *client)
                 console->name, client->name);
             return;
         }
-        x_pthread_mutex_lock(&logfile->bufLock);
+        /*  The logfile's circular-buffer can be read without a lock since
+         *    the logfile is muxed by the same i/o thread as this client.
+         */
+        assert(logfile->tp == client->tp);
 
         /*  Compute the number of bytes to replay.
          *  If the console's circular-buffer has not yet wrapped around,
@@ -339,11 +384,14 @@ static void perform_log_replay(obj_t *client)
          *  The result is bounded by the value of LOG_REPLAY_LEN and the
          *    amount of buffer space remaining in 'buf'.
          */
-        if (!logfile->gotBufWrap) {
+        if (!logfile->buf) {
+            n = 0;
+        }
+        else if (!logfile->gotBufWrap) {
             n = logfile->bufInPtr - logfile->buf;
         }
         else {
-            n = OBJ_BUF_SIZE - 1;
+            n = logfile->bufSize - 1;
         }
         if (n < 0) {
             n = 0;
@@ -355,17 +403,19 @@ static void perform_log_replay(obj_t *client)
             n = len;
         }
 
-        p = logfile->bufInPtr - n;
-        if (p >= logfile->buf) {        /* no wrap needed */
-            assert(n > 0);
+        if (n == 0) {
+            ;                           /* nothing to replay */
+        }
+        else if (logfile->bufInPtr - logfile->buf >= n) {   /* no wrap */
+            p = logfile->bufInPtr - n;
             memcpy(ptr, p, n);
             ptr += n;
         }
         else {                          /* wrap backwards */
-            m = logfile->buf - p;
+            m = n - (logfile->bufInPtr - logfile->buf);
             assert(m > 0);
             assert(m <= n);
-            p = &logfile->buf[OBJ_BUF_SIZE] - m;
+            p = &logfile->buf[logfile->bufSize] - m;
             memcpy(ptr, p, m);
             ptr += m;
             n -= m;
@@ -373,8 +423,6 @@ static void perform_log_replay(obj_t *client)
             ptr += n;
         }
 
-        x_pthread_mutex_unlock(&logfile->bufLock);
-
         /*  Recompute 'len' since space was already reserved for it above.
          */
         len = &buf[sizeof(buf)] - ptr;
@@ -498,7 +546,7 @@ static void perform_reset(obj_t *client)
 
         /*  Set a timer to ensure the reset cmd does not exceed its time limit.
          */
-        console->resetCmdTimer = tpoll_timeout_relative(tp_global,
+        console->resetCmdTimer = tpoll_timeout_relative(console->tp,
             (callback_f) kill_reset_cmd, console, RESET_CMD_TIMEOUT * 1000);
         if (console->resetCmdTimer < 0) {
             write_notify_msg(console, LOG_WARNING,
@@ -562,10 +610,10 @@ static void perform_suspend(obj_t *client)
     client->aux.client.gotSuspend ^= 1;
 
     if (client->aux.client.gotSuspend) {
-        tpoll_clear(tp_global, client->fd, POLLOUT);
+        tpoll_clear(client->tp, client->fd, POLLOUT);
     }
     else {
-        tpoll_set(tp_global, client->fd, POLLOUT);
+        tpoll_set_arg(client->tp, client->fd, POLLOUT, client);
     }
 
     /*  FIXME: Do check_console_state() here looking for downed telnets.
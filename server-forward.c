@@ -0,0 +1,1244 @@
+/*****************************************************************************
+ *  Written by Chris Dunlap <cdunlap@llnl.gov>.
+ *  Copyright (C) 2007-2016 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  UCRL-CODE-2002-009.
+ *
+ *  This file is part of ConMan: The Console Manager.
+ *  For details, see <https://dun.github.io/conman/>.
+ *
+ *  ConMan is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  ConMan is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with ConMan.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+/*  The forward obj streams the output of every console to a remote collector
+ *    over a persistent TCP connection.  It is linked as a reader of each
+ *    console, much like a logfile.
+ *
+ *  The stream is a sequence of records, each consisting of a header of
+ *    FORWARD_HDR_LEN bytes in network byte order followed by the console
+ *    name and then the console output:
+ *
+ *      uint16  length of the console name
+ *      uint16  length of the console output
+ *      uint32  seconds since the epoch at which the output was read
+ *      uint32  microseconds of the above
+ *
+ *  The first record of each connection has an empty console name; its
+ *    output is the host name of the daemon.
+ *
+ *  Records are appended by the consoles' i/o threads to in-memory batches.
+ *    A batch is handed off to the forward obj's i/o thread once it is full,
+ *    or every FORWARD_BATCH_MSECS regardless.  While the collector is
+ *    unreachable (or falling behind), batches are appended to a spool file
+ *    instead and sent once it catches up.  Records are dropped once more
+ *    than FORWARD_MEM_MAX bytes are queued in memory, or FORWARD_SPOOL_MAX
+ *    bytes in the spool.
+ *  A batch interrupted by a disconnect is sent again in its entirety after
+ *    reconnecting, as is a named spool after a restart, so the collector
+ *    may receive some records more than once.
+ */
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <sys/types.h>                  /* include before in.h for bsd */
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+#include "log.h"
+#include "server.h"
+#include "tpoll.h"
+#include "util-file.h"
+#include "util-net.h"
+#include "util-str.h"
+#include "util.h"
+#include "wrapper.h"
+
+
+typedef struct forward_batch {          /* BATCH OF FORWARDED RECORDS:       */
+    struct forward_batch *next;         /*  next batch in queue              */
+    int              len;               /*  num bytes of records in batch    */
+    int              isHello;           /*  true if hello record for conn    */
+    unsigned char    data[FORWARD_BATCH_SIZE];
+} forward_batch_t;
+
+typedef struct forward_lookup {         /* LOOKUP OF COLLECTOR ADDRS:        */
+    obj_t           *forward;           /*  forward obj, or NULL if closed   */
+    char            *host;              /*  collector host name or ip        */
+    char            *port;              /*  collector port number            */
+    struct addrinfo *addrs;             /*  addrs resolved for collector     */
+    int              rc;                /*  getaddrinfo() return code        */
+    int              isDone;            /*  true if lookup has completed     */
+} forward_lookup_t;
+
+
+static forward_batch_t * create_forward_batch(void);
+static void seal_forward_batch(obj_t *forward);
+static int pack_forward_record(unsigned char *dst, const char *name,
+    int nameLen, const void *src, int len);
+static int get_forward_record_len(const unsigned char *src, int len);
+static int connect_forward_obj(obj_t *forward);
+static void start_forward_lookup(obj_t *forward);
+static void * resolve_forward_lookup(forward_lookup_t *lookup);
+static void complete_forward_lookup(obj_t *forward);
+static void destroy_forward_lookup(forward_lookup_t *lookup);
+static int connect_forward_addr(obj_t *forward);
+static void close_forward_fd(obj_t *forward);
+static void disconnect_forward_obj(obj_t *forward);
+static void reset_forward_delay(obj_t *forward);
+static void tick_forward_obj(obj_t *forward);
+static void wake_forward_obj(obj_t *forward);
+static void flush_forward_obj(obj_t *forward);
+static void spool_forward_batch(obj_t *forward, forward_batch_t *batch);
+static int open_forward_spool(obj_t *forward);
+static void recover_forward_spool(obj_t *forward);
+static forward_batch_t * next_forward_batch(obj_t *forward);
+static void notify_forward_drop(obj_t *forward);
+
+
+/*  The lock protects the forward obj's lookup shared with its resolver
+ *    thread.  It is never destroyed since a resolver thread may still be
+ *    running when the daemon exits.
+ */
+static pthread_mutex_t forwardLookupLock = PTHREAD_MUTEX_INITIALIZER;
+
+
+obj_t * create_forward_obj(server_conf_t *conf,
+    char *host, int port, char *spool)
+{
+/*  Creates a new forward object for streaming console output to the
+ *    collector at (host) and (port), and adds it to the master objs list.
+ *    If (spool) is non-null, it names the file in which records are spooled
+ *    while the collector is unreachable; o/w, an unlinked temporary file
+ *    is created when first needed.
+ *  Note: a non-blocking connect will later be initiated for the collector
+ *    by main:open_objs:open_forward_obj:connect_forward_obj().
+ *  Returns the new object.
+ */
+    obj_t *forward;
+    forward_obj_t *auxp;
+    char buf[MAX_LINE];
+    char *name;
+
+    assert(conf != NULL);
+    assert((host != NULL) && (host[0] != '\0'));
+    assert(port > 0);
+
+    name = create_format_string("%s:%d", host, port);
+    forward = create_obj(conf, name, -1, CONMAN_OBJ_FORWARD);
+    free(name);
+
+    auxp = &forward->aux.forward;
+    auxp->host = create_string(host);
+    auxp->port = port;
+    if (gethostname(buf, sizeof(buf)) < 0) {
+        strlcpy(buf, "localhost", sizeof(buf));
+    }
+    buf[sizeof(buf) - 1] = '\0';
+    auxp->hostName = create_string(buf);
+    auxp->lookup = NULL;
+    auxp->addrs = NULL;
+    auxp->addrNext = NULL;
+    x_pthread_mutex_init(&auxp->mutex, NULL);
+    auxp->fillBatch = NULL;
+    auxp->readyHead = auxp->readyTail = NULL;
+    auxp->numQueuedBytes = 0;
+    auxp->isWakeQueued = 0;
+    auxp->numDropped = 0;
+    auxp->tDropNotice = 0;
+    auxp->sendHead = NULL;
+    auxp->sendOff = 0;
+    auxp->spoolName = spool ? create_string(spool) : NULL;
+    auxp->spoolFd = -1;
+    auxp->spoolIn = 0;
+    auxp->spoolOut = 0;
+    auxp->timer = -1;
+    auxp->tickTimer = -1;
+    auxp->delay = FORWARD_MIN_TIMEOUT;
+    auxp->state = CONMAN_FORWARD_DOWN;
+    auxp->enableKeepAlive = conf->enableKeepAlive;
+
+    list_append(conf->objs, forward);
+    return(forward);
+}
+
+
+int open_forward_obj(obj_t *forward)
+{
+/*  Opens the specified 'forward' obj, recovering any records remaining in
+ *    its named spool file and starting the timer for sealing its batches.
+ *  Returns 0 if the connection is successfully completed; o/w, returns -1.
+ *
+ *  XXX: This routine must only be called by the forward obj's i/o thread.
+ */
+    forward_obj_t *auxp;
+
+    assert(forward != NULL);
+    assert(is_forward_obj(forward));
+
+    auxp = &forward->aux.forward;
+    if (auxp->spoolName && (auxp->spoolFd < 0)
+            && (open_forward_spool(forward) == 0)) {
+        recover_forward_spool(forward);
+    }
+    if (auxp->tickTimer < 0) {
+        auxp->tickTimer = tpoll_timeout_relative(forward->tp,
+            (callback_f) tick_forward_obj, forward, FORWARD_BATCH_MSECS);
+    }
+    if (auxp->state != CONMAN_FORWARD_DOWN) {
+        return(auxp->state == CONMAN_FORWARD_UP ? 0 : -1);
+    }
+    return(connect_forward_obj(forward));
+}
+
+
+void close_forward_obj(obj_t *forward)
+{
+/*  Releases the resources of the 'forward' obj prior to its destruction.
+ *  If the spool file is named, the records not yet sent to the collector
+ *    are appended to it so they can be sent once the daemon is restarted.
+ *
+ *  This routine must only be called once the i/o threads have stopped.
+ */
+    forward_obj_t *auxp;
+    forward_batch_t *batch;
+
+    assert(forward != NULL);
+    assert(is_forward_obj(forward));
+
+    auxp = &forward->aux.forward;
+    if (auxp->timer >= 0) {
+        (void) tpoll_timeout_cancel(forward->tp, auxp->timer);
+        auxp->timer = -1;
+    }
+    if (auxp->tickTimer >= 0) {
+        (void) tpoll_timeout_cancel(forward->tp, auxp->tickTimer);
+        auxp->tickTimer = -1;
+    }
+    seal_forward_batch(forward);
+    /*
+     *  A lookup still in progress is left for its resolver thread to destroy.
+     */
+    x_pthread_mutex_lock(&forwardLookupLock);
+    if (auxp->lookup) {
+        if (auxp->lookup->isDone) {
+            destroy_forward_lookup(auxp->lookup);
+        }
+        else {
+            auxp->lookup->forward = NULL;
+        }
+        auxp->lookup = NULL;
+    }
+    x_pthread_mutex_unlock(&forwardLookupLock);
+
+    if (auxp->addrs) {
+        freeaddrinfo(auxp->addrs);
+        auxp->addrs = auxp->addrNext = NULL;
+    }
+    while ((batch = auxp->sendHead)) {
+        auxp->sendHead = batch->next;
+        if (auxp->spoolName && !batch->isHello) {
+            spool_forward_batch(forward, batch);
+        }
+        free(batch);
+    }
+    while ((batch = auxp->readyHead)) {
+        auxp->readyHead = batch->next;
+        if (auxp->spoolName) {
+            spool_forward_batch(forward, batch);
+        }
+        free(batch);
+    }
+    auxp->readyTail = NULL;
+    auxp->numQueuedBytes = 0;
+    notify_forward_drop(forward);
+
+    if (auxp->spoolFd >= 0) {
+        if (close(auxp->spoolFd) < 0) {
+            log_msg(LOG_WARNING, "Unable to close spool file \"%s\": %s",
+                auxp->spoolName, strerror(errno));
+        }
+        auxp->spoolFd = -1;
+    }
+    destroy_string(auxp->host);
+    auxp->host = NULL;
+    destroy_string(auxp->hostName);
+    auxp->hostName = NULL;
+    destroy_string(auxp->spoolName);
+    auxp->spoolName = NULL;
+    x_pthread_mutex_destroy(&auxp->mutex);
+    return;
+}
+
+
+int write_forward_data(obj_t *forward, obj_t *console,
+    const void *src, int len)
+{
+/*  Appends a record of the buffer (src) of length (len) read from the
+ *    (console) to the batch being filled for the (forward) obj.
+ *  The record is dropped if FORWARD_MEM_MAX bytes are already queued in
+ *    memory; in the meantime, the forward obj's i/o thread sends or spools
+ *    the batches queued thus far.
+ *  Returns the number of bytes written.
+ *
+ *  This routine can be called by any i/o thread.
+ */
+    forward_obj_t *auxp;
+    forward_batch_t *batch;
+    int nameLen;
+    int recLen;
+    int isWake = 0;
+
+    assert(forward != NULL);
+    assert(is_forward_obj(forward));
+    assert(is_console_obj(console));
+
+    if (!src || len <= 0) {
+        return(0);
+    }
+    auxp = &forward->aux.forward;
+    nameLen = MIN((int) strlen(console->name), MAX_LINE);
+    len = MIN(len, FORWARD_BATCH_SIZE - FORWARD_HDR_LEN - nameLen);
+    recLen = FORWARD_HDR_LEN + nameLen + len;
+
+    x_pthread_mutex_lock(&auxp->mutex);
+    if (auxp->numQueuedBytes + recLen > FORWARD_MEM_MAX) {
+        auxp->numDropped += recLen;
+        x_pthread_mutex_unlock(&auxp->mutex);
+        x_counter_add(&forward->stats.bytesOverwritten, recLen);
+        return(0);
+    }
+    batch = auxp->fillBatch;
+    if (batch && (batch->len + recLen > FORWARD_BATCH_SIZE)) {
+        seal_forward_batch(forward);
+        batch = NULL;
+        if (!auxp->isWakeQueued) {
+            auxp->isWakeQueued = isWake = 1;
+        }
+    }
+    if (!batch) {
+        batch = auxp->fillBatch = create_forward_batch();
+    }
+    batch->len += pack_forward_record(batch->data + batch->len,
+        console->name, nameLen, src, len);
+    auxp->numQueuedBytes += recLen;
+    x_pthread_mutex_unlock(&auxp->mutex);
+
+    /*  Hand off the full batch promptly rather than on the next tick.
+     */
+    if (isWake && (tpoll_timeout_relative(forward->tp,
+            (callback_f) wake_forward_obj, forward, 0) < 0)) {
+        log_err(0, "Unable to create timer for forwarding to <%s:%d>",
+            auxp->host, auxp->port);
+    }
+    return(len);
+}
+
+
+int read_forward_obj(obj_t *forward)
+{
+/*  Reads from the collector connection of the 'forward' obj.
+ *  The collector is not expected to send anything, so any data received
+ *    is discarded.  This read detects the collector closing the connection.
+ *  Returns 0 since the forward obj is never destroyed.
+ */
+    char buf[MAX_LINE];
+    int n;
+
+    assert(is_forward_obj(forward));
+
+    /*  Completion of a PENDING connection is handled in write_forward_obj().
+     */
+    if ((forward->fd < 0)
+            || (forward->aux.forward.state != CONMAN_FORWARD_UP)) {
+        return(0);
+    }
+again:
+    if ((n = read(forward->fd, buf, sizeof(buf))) < 0) {
+        if (errno == EINTR) {
+            goto again;
+        }
+        if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+            return(0);
+        }
+        log_msg(LOG_INFO, "Unable to read from collector <%s:%d>: %s",
+            forward->aux.forward.host, forward->aux.forward.port,
+            strerror(errno));
+        disconnect_forward_obj(forward);
+    }
+    else if (n == 0) {
+        disconnect_forward_obj(forward);
+    }
+    return(0);
+}
+
+
+int write_forward_obj(obj_t *forward)
+{
+/*  Writes the batches of records awaiting the 'forward' obj out to the
+ *    collector, starting with those in the spool.  At most FORWARD_WRITE_MAX
+ *    bytes are written per i/o event so the other objs muxed by the same
+ *    i/o thread are not starved.
+ *  Returns 0 since the forward obj is never destroyed.
+ *
+ *  XXX: This routine must only be called by the forward obj's i/o thread.
+ */
+    forward_obj_t *auxp;
+    forward_batch_t *batch;
+    int total = 0;
+    int n;
+
+    assert(is_forward_obj(forward));
+
+    auxp = &forward->aux.forward;
+    if (forward->fd < 0) {
+        return(0);
+    }
+    /*  The completion of a non-blocking connect() makes the socket writable,
+     *    so complete the pending connect here.
+     */
+    if (auxp->state == CONMAN_FORWARD_PENDING) {
+        (void) connect_forward_obj(forward);
+        return(0);
+    }
+    while (total < FORWARD_WRITE_MAX) {
+        if (!auxp->sendHead) {
+            auxp->sendHead = next_forward_batch(forward);
+            auxp->sendOff = 0;
+        }
+        if (!(batch = auxp->sendHead)) {
+            tpoll_clear(forward->tp, forward->fd, POLLOUT);
+            break;
+        }
+        n = write(forward->fd, batch->data + auxp->sendOff,
+            batch->len - auxp->sendOff);
+        x_counter_add(&forward->stats.numWrites, 1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                x_counter_add(&forward->stats.numWriteBlocks, 1);
+                break;
+            }
+            log_msg(LOG_INFO, "Unable to write to collector <%s:%d>: %s",
+                auxp->host, auxp->port, strerror(errno));
+            disconnect_forward_obj(forward);
+            break;
+        }
+        DPRINTF((15, "Wrote %d bytes to collector <%s:%d>.\n",
+            n, auxp->host, auxp->port));
+        x_counter_add(&forward->stats.bytesWritten, n);
+        total += n;
+        auxp->sendOff += n;
+        if (auxp->sendOff == batch->len) {
+            auxp->sendHead = batch->next;
+            auxp->sendOff = 0;
+            free(batch);
+        }
+    }
+    return(0);
+}
+
+
+static forward_batch_t * create_forward_batch(void)
+{
+/*  Returns a new empty batch.
+ */
+    forward_batch_t *batch;
+
+    if (!(batch = malloc(sizeof(forward_batch_t)))) {
+        out_of_memory();
+    }
+    batch->next = NULL;
+    batch->len = 0;
+    batch->isHello = 0;
+    return(batch);
+}
+
+
+static void seal_forward_batch(obj_t *forward)
+{
+/*  Appends the batch being filled (if non-empty) to the queue of batches
+ *    ready to be sent or spooled by the forward obj's i/o thread.
+ *
+ *  XXX: This routine must be called with the forward obj's mutex held
+ *    (or once the i/o threads have stopped).
+ */
+    forward_obj_t *auxp = &forward->aux.forward;
+    forward_batch_t *batch;
+
+    if (!(batch = auxp->fillBatch)) {
+        return;
+    }
+    auxp->fillBatch = NULL;
+    if (batch->len == 0) {
+        free(batch);
+        return;
+    }
+    if (auxp->readyTail) {
+        auxp->readyTail->next = batch;
+    }
+    else {
+        auxp->readyHead = batch;
+    }
+    auxp->readyTail = batch;
+    return;
+}
+
+
+static int pack_forward_record(unsigned char *dst, const char *name,
+    int nameLen, const void *src, int len)
+{
+/*  Packs a record of the console (name) of length (nameLen) and the output
+ *    (src) of length (len) timestamped with the current time into (dst).
+ *  Returns the length of the record.
+ */
+    struct timeval tv;
+    uint16_t n16;
+    uint32_t n32;
+    unsigned char *p = dst;
+
+    if (gettimeofday(&tv, NULL) < 0) {
+        log_err(errno, "gettimeofday() failed");
+    }
+    n16 = htons(nameLen);
+    memcpy(p, &n16, sizeof(n16));
+    p += sizeof(n16);
+    n16 = htons(len);
+    memcpy(p, &n16, sizeof(n16));
+    p += sizeof(n16);
+    n32 = htonl((uint32_t) tv.tv_sec);
+    memcpy(p, &n32, sizeof(n32));
+    p += sizeof(n32);
+    n32 = htonl((uint32_t) tv.tv_usec);
+    memcpy(p, &n32, sizeof(n32));
+    p += sizeof(n32);
+    assert(p - dst == FORWARD_HDR_LEN);
+
+    memcpy(p, name, nameLen);
+    p += nameLen;
+    memcpy(p, src, len);
+    p += len;
+    return(p - dst);
+}
+
+
+static int get_forward_record_len(const unsigned char *src, int len)
+{
+/*  Returns the length of the record starting at the buffer (src) of
+ *    length (len), or 0 if the buffer does not contain the whole record.
+ */
+    uint16_t nameLen;
+    uint16_t dataLen;
+    int n;
+
+    if (len < FORWARD_HDR_LEN) {
+        return(0);
+    }
+    memcpy(&nameLen, src, sizeof(nameLen));
+    memcpy(&dataLen, src + sizeof(nameLen), sizeof(dataLen));
+    n = FORWARD_HDR_LEN + ntohs(nameLen) + ntohs(dataLen);
+    return((n <= len) ? n : 0);
+}
+
+
+static int connect_forward_obj(obj_t *forward)
+{
+/*  Establishes a non-blocking connect with the collector of the 'forward'
+ *    obj, or completes the connect in progress.
+ *  The collector's addrs are first resolved by a resolver thread so the
+ *    i/o thread is not blocked by a slow name service; the connect is then
+ *    initiated by complete_forward_lookup().
+ *  Returns 0 if the connection is successfully completed; o/w, returns -1.
+ */
+    forward_obj_t *auxp;
+    forward_batch_t *batch;
+
+    auxp = &forward->aux.forward;
+    assert(auxp->state != CONMAN_FORWARD_UP);
+
+    if (auxp->timer >= 0) {
+        (void) tpoll_timeout_cancel(forward->tp, auxp->timer);
+        auxp->timer = -1;
+    }
+    if (auxp->state == CONMAN_FORWARD_DOWN) {
+        start_forward_lookup(forward);
+        return(-1);
+    }
+    else if (auxp->state == CONMAN_FORWARD_LOOKUP) {
+        /*
+         *  Initiate a non-blocking connection attempt.
+         */
+        if (connect_forward_addr(forward) < 0) {
+            return(-1);
+        }
+    }
+    else if (auxp->state == CONMAN_FORWARD_PENDING) {
+        /*
+         *  Did the non-blocking connect complete successfully?
+         *    (cf. Stevens UNPv1 15.3 p409)
+         */
+        int err = 0;
+        socklen_t len = sizeof(err);
+        int rc;
+
+        rc = getsockopt(forward->fd, SOL_SOCKET, SO_ERROR,
+            (void *) &err, &len);
+        if (rc < 0) {
+            err = errno;
+        }
+        if (err) {
+            DPRINTF((10, "Unable to connect to collector <%s:%d>: %s.\n",
+                auxp->host, auxp->port, strerror(err)));
+            /*
+             *  Fall back to the collector's next addr (if any).
+             */
+            if (connect_forward_addr(forward) < 0) {
+                return(-1);
+            }
+        }
+    }
+    else {
+        log_err(0, "Forwarder is in unexpected state=%d", auxp->state);
+    }
+    if (auxp->addrs) {
+        freeaddrinfo(auxp->addrs);
+        auxp->addrs = auxp->addrNext = NULL;
+    }
+    auxp->state = CONMAN_FORWARD_UP;
+    x_counter_add(&forward->stats.numConnects, 1);
+    log_msg(LOG_INFO, "Forwarding console output to <%s:%d>",
+        auxp->host, auxp->port);
+
+    /*  Start the connection with the hello record, followed by the batch
+     *    interrupted by the previous connection (if any) in its entirety.
+     */
+    batch = create_forward_batch();
+    batch->isHello = 1;
+    batch->len = pack_forward_record(batch->data, "", 0,
+        auxp->hostName, MIN((int) strlen(auxp->hostName), MAX_LINE));
+    batch->next = auxp->sendHead;
+    auxp->sendHead = batch;
+    auxp->sendOff = 0;
+    tpoll_set_arg(forward->tp, forward->fd, POLLIN | POLLOUT, forward);
+    /*
+     *  Require the connection to be up for a minimum length of time
+     *    before resetting the reconnect delay (as for telnet objs).
+     */
+    auxp->timer = tpoll_timeout_relative(forward->tp,
+        (callback_f) reset_forward_delay, forward,
+        FORWARD_MAX_TIMEOUT * 1000);
+    return(0);
+}
+
+
+static void start_forward_lookup(obj_t *forward)
+{
+/*  Starts a resolver thread to look up the addrs of the forward obj's
+ *    collector, awaiting complete_forward_lookup() in the LOOKUP state.
+ *  Signals are blocked in the resolver thread so they are only delivered
+ *    to the threads expecting them.
+ *
+ *  XXX: This routine must only be called by the forward obj's i/o thread.
+ */
+    forward_obj_t *auxp = &forward->aux.forward;
+    forward_lookup_t *lookup;
+    pthread_t tid;
+    sigset_t sigset;
+    sigset_t sigsetOld;
+    int rc;
+
+    assert(auxp->lookup == NULL);
+
+    if (!(lookup = malloc(sizeof(*lookup)))) {
+        out_of_memory();
+    }
+    lookup->forward = forward;
+    lookup->host = create_string(auxp->host);
+    lookup->port = create_format_string("%d", auxp->port);
+    lookup->addrs = NULL;
+    lookup->rc = 0;
+    lookup->isDone = 0;
+
+    DPRINTF((10, "Resolving collector <%s:%d>.\n", auxp->host, auxp->port));
+
+    x_pthread_mutex_lock(&forwardLookupLock);
+    auxp->lookup = lookup;
+    auxp->state = CONMAN_FORWARD_LOOKUP;
+    x_pthread_mutex_unlock(&forwardLookupLock);
+
+    sigfillset(&sigset);
+    if ((rc = pthread_sigmask(SIG_SETMASK, &sigset, &sigsetOld)) != 0) {
+        log_err(rc, "Unable to block signals");
+    }
+    if ((rc = pthread_create(&tid, NULL,
+            (PthreadFunc) resolve_forward_lookup, lookup)) != 0) {
+        log_err(rc, "Unable to create resolver thread for forwarding");
+    }
+    if ((rc = pthread_sigmask(SIG_SETMASK, &sigsetOld, NULL)) != 0) {
+        log_err(rc, "Unable to restore signal mask");
+    }
+    x_pthread_detach(tid);
+    return;
+}
+
+
+static void * resolve_forward_lookup(forward_lookup_t *lookup)
+{
+/*  Resolves the collector's addrs for the (lookup), and schedules their
+ *    completion by the forward obj's i/o thread.
+ *  The lookup is destroyed here if the forward obj has since been closed.
+ */
+    struct addrinfo hints;
+    struct addrinfo *addrs = NULL;
+    int rc;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICSERV;
+
+    rc = getaddrinfo(lookup->host, lookup->port, &hints, &addrs);
+
+    x_pthread_mutex_lock(&forwardLookupLock);
+    lookup->addrs = (rc == 0) ? addrs : NULL;
+    lookup->rc = rc;
+    lookup->isDone = 1;
+    if (!lookup->forward) {
+        destroy_forward_lookup(lookup);
+    }
+    else {
+        (void) tpoll_timeout_relative(lookup->forward->tp,
+            (callback_f) complete_forward_lookup, lookup->forward, 0);
+    }
+    x_pthread_mutex_unlock(&forwardLookupLock);
+    return(NULL);
+}
+
+
+static void complete_forward_lookup(obj_t *forward)
+{
+/*  Takes the collector's addrs resolved by the resolver thread, and
+ *    initiates a connect to the first of them.
+ *
+ *  XXX: This routine must only be called by the forward obj's i/o thread.
+ */
+    forward_obj_t *auxp = &forward->aux.forward;
+    forward_lookup_t *lookup;
+
+    assert(auxp->state == CONMAN_FORWARD_LOOKUP);
+
+    x_pthread_mutex_lock(&forwardLookupLock);
+    lookup = auxp->lookup;
+    auxp->lookup = NULL;
+    x_pthread_mutex_unlock(&forwardLookupLock);
+
+    assert(lookup != NULL);
+    assert(lookup->isDone);
+
+    if (lookup->rc != 0) {
+        log_msg(LOG_WARNING,
+            "Unable to resolve hostname \"%s\" for forwarding: %s",
+            auxp->host, gai_strerror(lookup->rc));
+        destroy_forward_lookup(lookup);
+        disconnect_forward_obj(forward);
+        return;
+    }
+    assert(auxp->addrs == NULL);
+    auxp->addrs = auxp->addrNext = lookup->addrs;
+    lookup->addrs = NULL;
+    destroy_forward_lookup(lookup);
+
+    (void) connect_forward_obj(forward);
+    return;
+}
+
+
+static void destroy_forward_lookup(forward_lookup_t *lookup)
+{
+/*  Destroys the forward obj's (lookup).
+ */
+    if (lookup->addrs) {
+        freeaddrinfo(lookup->addrs);
+    }
+    destroy_string(lookup->host);
+    destroy_string(lookup->port);
+    free(lookup);
+    return;
+}
+
+
+static int connect_forward_addr(obj_t *forward)
+{
+/*  Initiates a non-blocking connect to the next of the collector's addrs,
+ *    closing the previous attempt (if any).  Addrs whose connect fails
+ *    outright are skipped; once all have been tried, the forward obj is
+ *    disconnected to retry the lookup after a backoff.
+ *  Returns 0 if the connection is immediately completed; o/w, returns -1
+ *    (having set the PENDING state if the connect is in progress).
+ */
+    forward_obj_t *auxp = &forward->aux.forward;
+    struct addrinfo *ai;
+    const int on = 1;
+
+    close_forward_fd(forward);
+    auxp->state = CONMAN_FORWARD_LOOKUP;
+
+    while ((ai = auxp->addrNext) != NULL) {
+        auxp->addrNext = ai->ai_next;
+
+        if ((forward->fd = socket(ai->ai_family, ai->ai_socktype,
+                ai->ai_protocol)) < 0) {
+            DPRINTF((10, "Unable to create socket for collector <%s:%d>: "
+                "%s.\n", auxp->host, auxp->port, strerror(errno)));
+            continue;
+        }
+        if (auxp->enableKeepAlive) {
+            if (setsockopt(forward->fd, SOL_SOCKET, SO_KEEPALIVE,
+                    (const void *) &on, sizeof(on)) < 0) {
+                log_err(errno, "Unable to set KEEPALIVE socket option");
+            }
+        }
+        set_fd_nonblocking(forward->fd);
+        set_fd_closed_on_exec(forward->fd);
+
+        DPRINTF((10, "Connecting to collector <%s:%d>.\n",
+            auxp->host, auxp->port));
+
+        if (connect(forward->fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            return(0);
+        }
+        if (errno == EINPROGRESS) {
+            auxp->state = CONMAN_FORWARD_PENDING;
+            tpoll_set_arg(forward->tp, forward->fd, POLLIN | POLLOUT,
+                forward);
+            return(-1);
+        }
+        DPRINTF((10, "Unable to connect to collector <%s:%d>: %s.\n",
+            auxp->host, auxp->port, strerror(errno)));
+        close_forward_fd(forward);
+    }
+    disconnect_forward_obj(forward);
+    return(-1);
+}
+
+
+static void close_forward_fd(obj_t *forward)
+{
+/*  Closes the forward obj's connection with the collector (if any).
+ */
+    forward_obj_t *auxp = &forward->aux.forward;
+
+    if (forward->fd < 0) {
+        return;
+    }
+    tpoll_clear(forward->tp, forward->fd, POLLIN | POLLOUT);
+    if (close(forward->fd) < 0) {
+        log_msg(LOG_WARNING,
+            "Unable to close connection to collector <%s:%d>: %s",
+            auxp->host, auxp->port, strerror(errno));
+    }
+    forward->fd = -1;
+    return;
+}
+
+
+static void disconnect_forward_obj(obj_t *forward)
+{
+/*  Closes the existing connection with the collector of the 'forward' obj
+ *    and sets a timer for establishing a new connection.
+ *  The batch being sent is retained to be sent again after reconnecting.
+ */
+    forward_obj_t *auxp = &forward->aux.forward;
+    forward_batch_t *batch;
+
+    DPRINTF((10, "Disconnecting from collector <%s:%d>.\n",
+        auxp->host, auxp->port));
+
+    if (auxp->timer >= 0) {
+        (void) tpoll_timeout_cancel(forward->tp, auxp->timer);
+        auxp->timer = -1;
+    }
+    close_forward_fd(forward);
+    if (auxp->addrs) {
+        freeaddrinfo(auxp->addrs);
+        auxp->addrs = auxp->addrNext = NULL;
+    }
+    while ((batch = auxp->sendHead) && batch->isHello) {
+        auxp->sendHead = batch->next;
+        free(batch);
+    }
+    auxp->sendOff = 0;
+
+    if (auxp->state == CONMAN_FORWARD_UP) {
+        log_msg(LOG_INFO, "Stopped forwarding console output to <%s:%d>",
+            auxp->host, auxp->port);
+    }
+    auxp->state = CONMAN_FORWARD_DOWN;
+    /*
+     *  Set timer for establishing new connection using exponential backoff.
+     */
+    auxp->timer = tpoll_timeout_relative(forward->tp,
+        (callback_f) connect_forward_obj, forward,
+        get_reconnect_msecs(&auxp->delay,
+            FORWARD_MIN_TIMEOUT, FORWARD_MAX_TIMEOUT));
+    return;
+}
+
+
+static void reset_forward_delay(obj_t *forward)
+{
+/*  Resets the forward obj's delay between reconnect attempts.
+ */
+    assert(is_forward_obj(forward));
+
+    forward->aux.forward.delay = 0;
+    /*
+     *  Also reset the timer ID since this routine is only invoked
+     *    by a timer when it expires.
+     */
+    forward->aux.forward.timer = -1;
+    return;
+}
+
+
+static void tick_forward_obj(obj_t *forward)
+{
+/*  Seals the batch being filled every FORWARD_BATCH_MSECS so records reach
+ *    the collector promptly even while console output is sparse.
+ */
+    forward_obj_t *auxp = &forward->aux.forward;
+
+    auxp->tickTimer = tpoll_timeout_relative(forward->tp,
+        (callback_f) tick_forward_obj, forward, FORWARD_BATCH_MSECS);
+
+    x_pthread_mutex_lock(&auxp->mutex);
+    seal_forward_batch(forward);
+    x_pthread_mutex_unlock(&auxp->mutex);
+
+    flush_forward_obj(forward);
+    return;
+}
+
+
+static void wake_forward_obj(obj_t *forward)
+{
+/*  Flushes the forward obj after a console has filled a batch.
+ */
+    forward_obj_t *auxp = &forward->aux.forward;
+
+    x_pthread_mutex_lock(&auxp->mutex);
+    auxp->isWakeQueued = 0;
+    x_pthread_mutex_unlock(&auxp->mutex);
+
+    flush_forward_obj(forward);
+    return;
+}
+
+
+static void flush_forward_obj(obj_t *forward)
+{
+/*  Hands off the batches ready to be sent by the 'forward' obj.
+ *  While connected, the batches remain queued in memory for
+ *    write_forward_obj().  But while disconnected, or while the spool is
+ *    still being sent, or while over half of FORWARD_MEM_MAX is queued,
+ *    they are appended to the spool.  Records are thereby spooled in the
+ *    order received, and the spool only contains records older than those
+ *    still in memory.
+ *
+ *  XXX: This routine must only be called by the forward obj's i/o thread.
+ */
+    forward_obj_t *auxp = &forward->aux.forward;
+    forward_batch_t *batch = NULL;
+    int isUp;
+    int isReady;
+
+    isUp = (auxp->state == CONMAN_FORWARD_UP);
+
+    x_pthread_mutex_lock(&auxp->mutex);
+    if (!isUp || (auxp->spoolOut < auxp->spoolIn)
+            || (auxp->numQueuedBytes > FORWARD_MEM_MAX / 2)) {
+        batch = auxp->readyHead;
+        auxp->readyHead = auxp->readyTail = NULL;
+    }
+    isReady = (auxp->readyHead != NULL);
+    x_pthread_mutex_unlock(&auxp->mutex);
+
+    while (batch) {
+        forward_batch_t *next = batch->next;
+
+        x_pthread_mutex_lock(&auxp->mutex);
+        auxp->numQueuedBytes -= batch->len;
+        x_pthread_mutex_unlock(&auxp->mutex);
+
+        spool_forward_batch(forward, batch);
+        free(batch);
+        batch = next;
+    }
+    if (isUp && (auxp->sendHead || isReady
+            || (auxp->spoolOut < auxp->spoolIn))) {
+        tpoll_set_arg(forward->tp, forward->fd, POLLOUT, forward);
+    }
+    notify_forward_drop(forward);
+    return;
+}
+
+
+static void spool_forward_batch(obj_t *forward, forward_batch_t *batch)
+{
+/*  Appends the records of the (batch) to the forward obj's spool file.
+ *  The batch is dropped if the spool would exceed FORWARD_SPOOL_MAX bytes,
+ *    or if it cannot be written.
+ *
+ *  XXX: This routine must only be called by the forward obj's i/o thread.
+ */
+    forward_obj_t *auxp = &forward->aux.forward;
+    unsigned char *p;
+    int len;
+    int n;
+
+    if ((auxp->spoolIn + batch->len > FORWARD_SPOOL_MAX)
+            || (open_forward_spool(forward) < 0)) {
+        goto drop;
+    }
+    p = batch->data;
+    len = batch->len;
+    while (len > 0) {
+        n = pwrite(auxp->spoolFd, p, len, auxp->spoolIn + (p - batch->data));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log_msg(LOG_WARNING, "Unable to write spool for <%s:%d>: %s",
+                auxp->host, auxp->port, strerror(errno));
+            goto drop;
+        }
+        if (n == 0) {
+            log_msg(LOG_WARNING, "Unable to write spool for <%s:%d>: %s",
+                auxp->host, auxp->port, strerror(ENOSPC));
+            goto drop;
+        }
+        p += n;
+        len -= n;
+    }
+    auxp->spoolIn += batch->len;
+    return;
+
+drop:
+    x_pthread_mutex_lock(&auxp->mutex);
+    auxp->numDropped += batch->len;
+    x_pthread_mutex_unlock(&auxp->mutex);
+    x_counter_add(&forward->stats.bytesOverwritten, batch->len);
+    return;
+}
+
+
+static int open_forward_spool(obj_t *forward)
+{
+/*  Opens the forward obj's spool file if it is not already open.
+ *  Without a spool file name, an unlinked temporary file is created
+ *    so it is removed once closed.
+ *  Returns 0 on success, or -1 on error.
+ */
+    forward_obj_t *auxp = &forward->aux.forward;
+    char name[MAX_LINE];
+
+    if (auxp->spoolFd >= 0) {
+        return(0);
+    }
+    if (auxp->spoolName) {
+        auxp->spoolFd = open(auxp->spoolName, O_RDWR | O_CREAT,
+            S_IRUSR | S_IWUSR);
+        if (auxp->spoolFd < 0) {
+            log_msg(LOG_WARNING, "Unable to open spool file \"%s\": %s",
+                auxp->spoolName, strerror(errno));
+            return(-1);
+        }
+    }
+    else {
+        snprintf(name, sizeof(name), "%sconmand.XXXXXX", _PATH_TMP);
+        if ((auxp->spoolFd = mkstemp(name)) < 0) {
+            log_msg(LOG_WARNING,
+                "Unable to create spool file for <%s:%d>: %s",
+                auxp->host, auxp->port, strerror(errno));
+            return(-1);
+        }
+        (void) unlink(name);
+    }
+    set_fd_closed_on_exec(auxp->spoolFd);
+    return(0);
+}
+
+
+static void recover_forward_spool(obj_t *forward)
+{
+/*  Recovers the records left in the forward obj's named spool file by a
+ *    previous instance of the daemon.  The spool is truncated after the
+ *    last whole record in case the previous instance died while writing.
+ */
+    forward_obj_t *auxp = &forward->aux.forward;
+    unsigned char *buf;
+    off_t off = 0;
+    int len = 0;
+    int n;
+
+    if (!(buf = malloc(FORWARD_BATCH_SIZE))) {
+        out_of_memory();
+    }
+    for (;;) {
+        n = pread(auxp->spoolFd, buf + len, FORWARD_BATCH_SIZE - len,
+            off + len);
+        if ((n < 0) && (errno == EINTR)) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        len += n;
+        while ((n = get_forward_record_len(buf, len)) > 0) {
+            off += n;
+            len -= n;
+            memmove(buf, buf + n, len);
+        }
+    }
+    free(buf);
+
+    if (len > 0) {
+        log_msg(LOG_WARNING,
+            "Discarded %d byte%s of partial record in spool file \"%s\"",
+            len, (len == 1 ? "" : "s"), auxp->spoolName);
+        if (ftruncate(auxp->spoolFd, off) < 0) {
+            log_msg(LOG_WARNING, "Unable to truncate spool file \"%s\": %s",
+                auxp->spoolName, strerror(errno));
+        }
+    }
+    if (off > 0) {
+        log_msg(LOG_INFO,
+            "Recovered %lld bytes of console output from spool file \"%s\"",
+            (long long) off, auxp->spoolName);
+    }
+    auxp->spoolIn = off;
+    auxp->spoolOut = 0;
+    return;
+}
+
+
+static forward_batch_t * next_forward_batch(obj_t *forward)
+{
+/*  Returns the next batch of records to be sent by the 'forward' obj,
+ *    or NULL if none remain.  Records in the spool are sent before those
+ *    queued in memory.  A batch read from the spool is trimmed to a whole
+ *    number of records so it can be sent again after a reconnect.
+ *  Once the spool has been read in its entirety, it is truncated for reuse.
+ *
+ *  XXX: This routine must only be called by the forward obj's i/o thread.
+ */
+    forward_obj_t *auxp = &forward->aux.forward;
+    forward_batch_t *batch;
+    int len = 0;
+    int n, m;
+
+    if (auxp->spoolOut < auxp->spoolIn) {
+        batch = create_forward_batch();
+        n = MIN(FORWARD_BATCH_SIZE, auxp->spoolIn - auxp->spoolOut);
+        do {
+            m = pread(auxp->spoolFd, batch->data, n, auxp->spoolOut);
+        } while ((m < 0) && (errno == EINTR));
+
+        while ((m > len) && ((n = get_forward_record_len(batch->data + len,
+                m - len)) > 0)) {
+            len += n;
+        }
+        if (len == 0) {
+            log_msg(LOG_WARNING,
+                "Discarded %lld bytes of unreadable spool for <%s:%d>",
+                (long long) (auxp->spoolIn - auxp->spoolOut),
+                auxp->host, auxp->port);
+            auxp->spoolOut = auxp->spoolIn;
+            free(batch);
+            batch = NULL;
+        }
+        else {
+            batch->len = len;
+            auxp->spoolOut += len;
+        }
+        if (auxp->spoolOut >= auxp->spoolIn) {
+            if (ftruncate(auxp->spoolFd, 0) < 0) {
+                log_msg(LOG_WARNING,
+                    "Unable to truncate spool for <%s:%d>: %s",
+                    auxp->host, auxp->port, strerror(errno));
+            }
+            auxp->spoolIn = auxp->spoolOut = 0;
+        }
+        if (batch) {
+            return(batch);
+        }
+    }
+    x_pthread_mutex_lock(&auxp->mutex);
+    if ((batch = auxp->readyHead)) {
+        auxp->readyHead = batch->next;
+        if (!auxp->readyHead) {
+            auxp->readyTail = NULL;
+        }
+        batch->next = NULL;
+        auxp->numQueuedBytes -= batch->len;
+    }
+    x_pthread_mutex_unlock(&auxp->mutex);
+    return(batch);
+}
+
+
+static void notify_forward_drop(obj_t *forward)
+{
+/*  Logs the number of bytes of records dropped by the forward obj,
+ *    at most once every OBJ_OVERWRITE_NOTICE_SECS.
+ */
+    forward_obj_t *auxp = &forward->aux.forward;
+    unsigned long n = 0;
+    time_t now;
+
+    now = time(NULL);
+    x_pthread_mutex_lock(&auxp->mutex);
+    if ((auxp->numDropped > 0)
+            && (now - auxp->tDropNotice >= OBJ_OVERWRITE_NOTICE_SECS)) {
+        n = auxp->numDropped;
+        auxp->numDropped = 0;
+        auxp->tDropNotice = now;
+    }
+    x_pthread_mutex_unlock(&auxp->mutex);
+
+    if (n > 0) {
+        log_msg(LOG_WARNING,
+            "Dropped %lu byte%s of console output for forwarding to <%s:%d>",
+            n, (n == 1 ? "" : "s"), auxp->host, auxp->port);
+    }
+    return;
+}
@@ -0,0 +1,383 @@
+/*****************************************************************************
+ *  Written by Chris Dunlap <cdunlap@llnl.gov>.
+ *  Copyright (C) 2007-2016 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  UCRL-CODE-2002-009.
+ *
+ *  This file is part of ConMan: The Console Manager.
+ *  For details, see <https://dun.github.io/conman/>.
+ *
+ *  ConMan is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  ConMan is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with ConMan.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <assert.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "list.h"
+#include "log.h"
+#include "server.h"
+#include "util-str.h"
+#include "util.h"
+#include "wrapper.h"
+
+
+/*  An obj index maps string keys (eg, console names or device names)
+ *    to the objs in the master conf->objs list.  The objs remain owned
+ *    by that list; the index only holds refs to them along with a copy
+ *    of each key.
+ *  Keys are hashed into chained buckets whose number doubles as the index
+ *    grows, so both inserts and exact lookups take constant time.
+ *    Several objs may share a key as long as they are of different types
+ *    (eg, a serial device and a unix domain socket), so lookups are
+ *    qualified by an obj type mask.
+ *  Matching a glob pattern uses an array of the entries sorted by key:
+ *    only the range of keys sharing the pattern's literal prefix need be
+ *    tested with fnmatch().  The array is rebuilt on the next match after
+ *    the index has been modified, so building the index remains linear.
+ *  Each insert or removal bumps the index generation count so that views
+ *    derived from the index (eg, the cached console listing) can tell when
+ *    they have become stale.
+ *  The index is protected by its mutex since it is searched by the client
+ *    worker threads.
+ */
+typedef struct obj_index_entry {
+    struct obj_index_entry *next;       /* next entry in hash bucket chain   */
+    char                   *key;        /* key under which obj is indexed    */
+    obj_t                  *obj;        /* obj ref                           */
+} obj_index_entry_t;
+
+struct obj_index {
+    pthread_mutex_t         lock;       /* lock protecting the index         */
+    obj_index_entry_t     **buckets;    /* array of hash bucket chains       */
+    int                     numBuckets; /* num buckets (a power of two)      */
+    int                     numEntries; /* num entries in the index          */
+    obj_index_entry_t     **sorted;     /* array of entries sorted by key    */
+    int                     isSorted;   /* true if sorted array is current   */
+    unsigned                gen;        /* generation count of modifications */
+};
+
+static unsigned int hash_obj_index_key(const char *key);
+static void grow_obj_index(obj_index_t *idx);
+static void sort_obj_index(obj_index_t *idx);
+static int compare_obj_index_entries(const void *p1, const void *p2);
+
+
+obj_index_t * create_obj_index(void)
+{
+/*  Creates and returns a new (empty) obj index.
+ */
+    obj_index_t *idx;
+
+    if (!(idx = malloc(sizeof(obj_index_t)))) {
+        out_of_memory();
+    }
+    x_pthread_mutex_init(&idx->lock, NULL);
+    idx->numBuckets = OBJ_INDEX_MIN_BUCKETS;
+    idx->numEntries = 0;
+    if (!(idx->buckets = calloc(idx->numBuckets, sizeof(*idx->buckets)))) {
+        out_of_memory();
+    }
+    idx->sorted = NULL;
+    idx->isSorted = 0;
+    idx->gen = 0;
+    return(idx);
+}
+
+
+void destroy_obj_index(obj_index_t *idx)
+{
+/*  Destroys the obj index (idx).  The indexed objs are not destroyed.
+ */
+    obj_index_entry_t *entry;
+    int k;
+
+    if (!idx) {
+        return;
+    }
+    for (k = 0; k < idx->numBuckets; k++) {
+        while ((entry = idx->buckets[k])) {
+            idx->buckets[k] = entry->next;
+            destroy_string(entry->key);
+            free(entry);
+        }
+    }
+    free(idx->buckets);
+    free(idx->sorted);
+    x_pthread_mutex_destroy(&idx->lock);
+    free(idx);
+    return;
+}
+
+
+void insert_obj_index(obj_index_t *idx, const char *key, obj_t *obj)
+{
+/*  Adds the (obj) to the index (idx) under (key).
+ */
+    obj_index_entry_t *entry;
+    unsigned int h;
+
+    assert(idx != NULL);
+    assert(key != NULL);
+    assert(obj != NULL);
+
+    if (!(entry = malloc(sizeof(obj_index_entry_t)))) {
+        out_of_memory();
+    }
+    entry->key = create_string(key);
+    entry->obj = obj;
+
+    x_pthread_mutex_lock(&idx->lock);
+
+    if (idx->numEntries >= idx->numBuckets) {
+        grow_obj_index(idx);
+    }
+    h = hash_obj_index_key(key) & (idx->numBuckets - 1);
+    entry->next = idx->buckets[h];
+    idx->buckets[h] = entry;
+    idx->numEntries++;
+    idx->isSorted = 0;
+    idx->gen++;
+
+    x_pthread_mutex_unlock(&idx->lock);
+    return;
+}
+
+
+void remove_obj_index(obj_index_t *idx, const char *key, obj_t *obj)
+{
+/*  Removes the (obj) indexed under (key) from the index (idx).
+ */
+    obj_index_entry_t **pp;
+    obj_index_entry_t *entry;
+    unsigned int h;
+
+    assert(idx != NULL);
+    assert(key != NULL);
+
+    x_pthread_mutex_lock(&idx->lock);
+
+    h = hash_obj_index_key(key) & (idx->numBuckets - 1);
+    for (pp = &idx->buckets[h]; (entry = *pp); pp = &entry->next) {
+        if ((entry->obj == obj) && !strcmp(entry->key, key)) {
+            *pp = entry->next;
+            destroy_string(entry->key);
+            free(entry);
+            idx->numEntries--;
+            idx->isSorted = 0;
+            idx->gen++;
+            break;
+        }
+    }
+    x_pthread_mutex_unlock(&idx->lock);
+    return;
+}
+
+
+obj_t * find_obj_index(obj_index_t *idx, const char *key, unsigned type)
+{
+/*  Searches the index (idx) for an obj indexed under (key) whose type
+ *    matches the obj type mask (type).
+ *  Returns the obj, or NULL if not found.
+ */
+    obj_index_entry_t *entry;
+    obj_t *obj = NULL;
+    unsigned int h;
+
+    assert(idx != NULL);
+    assert(key != NULL);
+
+    x_pthread_mutex_lock(&idx->lock);
+
+    h = hash_obj_index_key(key) & (idx->numBuckets - 1);
+    for (entry = idx->buckets[h]; entry; entry = entry->next) {
+        if ((entry->obj->type & type) && !strcmp(entry->key, key)) {
+            obj = entry->obj;
+            break;
+        }
+    }
+    x_pthread_mutex_unlock(&idx->lock);
+    return(obj);
+}
+
+
+unsigned get_obj_index_gen(obj_index_t *idx)
+{
+/*  Returns the generation count of the index (idx), which changes whenever
+ *    an obj is inserted into or removed from it.
+ */
+    unsigned gen;
+
+    assert(idx != NULL);
+
+    x_pthread_mutex_lock(&idx->lock);
+    gen = idx->gen;
+    x_pthread_mutex_unlock(&idx->lock);
+    return(gen);
+}
+
+
+int match_obj_index(obj_index_t *idx, const char *pat, List matches)
+{
+/*  Searches the index (idx) for objs whose keys match the shell-style
+ *    glob pattern (pat), appending each to the (matches) list.
+ *    No check is made for objs already in the list.
+ *  A pattern without any wildcards is looked up via its hash.  O/w, only
+ *    the keys sharing the literal prefix of the pattern are tested.
+ *  Returns the number of matches appended.
+ */
+    obj_index_entry_t *entry;
+    size_t len;
+    int lo, hi, mid;
+    int n = 0;
+
+    assert(idx != NULL);
+    assert(pat != NULL);
+    assert(matches != NULL);
+
+    len = strcspn(pat, "*?[\\");
+    if (pat[len] == '\0') {
+        x_pthread_mutex_lock(&idx->lock);
+        entry = idx->buckets[hash_obj_index_key(pat) & (idx->numBuckets - 1)];
+        for (; entry; entry = entry->next) {
+            if (!strcmp(entry->key, pat)) {
+                list_append(matches, entry->obj);
+                n++;
+            }
+        }
+        x_pthread_mutex_unlock(&idx->lock);
+        return(n);
+    }
+    x_pthread_mutex_lock(&idx->lock);
+
+    if (!idx->isSorted) {
+        sort_obj_index(idx);
+    }
+    /*  Binary search for the first key not less than the literal prefix.
+     */
+    lo = 0;
+    hi = idx->numEntries;
+    while (lo < hi) {
+        mid = lo + ((hi - lo) / 2);
+        if (strncmp(idx->sorted[mid]->key, pat, len) < 0) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    for (; lo < idx->numEntries; lo++) {
+        entry = idx->sorted[lo];
+        if (strncmp(entry->key, pat, len) != 0) {
+            break;
+        }
+        if (!fnmatch(pat, entry->key, 0)) {
+            list_append(matches, entry->obj);
+            n++;
+        }
+    }
+    x_pthread_mutex_unlock(&idx->lock);
+    return(n);
+}
+
+
+static unsigned int hash_obj_index_key(const char *key)
+{
+/*  Returns the FNV-1a hash of the string (key).
+ */
+    unsigned int h = 2166136261U;
+
+    while (*key) {
+        h ^= (unsigned char) *key++;
+        h *= 16777619U;
+    }
+    return(h);
+}
+
+
+static void grow_obj_index(obj_index_t *idx)
+{
+/*  Doubles the number of hash buckets in the index (idx),
+ *    rehashing its entries into them.
+ *
+ *  XXX: This routine assumes the index mutex is already locked.
+ */
+    obj_index_entry_t **buckets;
+    obj_index_entry_t *entry;
+    int n;
+    int k;
+    unsigned int h;
+
+    n = idx->numBuckets * 2;
+    if (!(buckets = calloc(n, sizeof(*buckets)))) {
+        out_of_memory();
+    }
+    for (k = 0; k < idx->numBuckets; k++) {
+        while ((entry = idx->buckets[k])) {
+            idx->buckets[k] = entry->next;
+            h = hash_obj_index_key(entry->key) & (n - 1);
+            entry->next = buckets[h];
+            buckets[h] = entry;
+        }
+    }
+    free(idx->buckets);
+    idx->buckets = buckets;
+    idx->numBuckets = n;
+    return;
+}
+
+
+static void sort_obj_index(obj_index_t *idx)
+{
+/*  Rebuilds the array of entries in the index (idx) sorted by key.
+ *
+ *  XXX: This routine assumes the index mutex is already locked.
+ */
+    obj_index_entry_t *entry;
+    int n = 0;
+    int k;
+
+    free(idx->sorted);
+    idx->sorted = malloc((idx->numEntries + 1) * sizeof(*idx->sorted));
+    if (!idx->sorted) {
+        out_of_memory();
+    }
+    for (k = 0; k < idx->numBuckets; k++) {
+        for (entry = idx->buckets[k]; entry; entry = entry->next) {
+            idx->sorted[n++] = entry;
+        }
+    }
+    assert(n == idx->numEntries);
+    qsort(idx->sorted, n, sizeof(*idx->sorted), compare_obj_index_entries);
+    idx->isSorted = 1;
+    return;
+}
+
+
+static int compare_obj_index_entries(const void *p1, const void *p2)
+{
+/*  Used by qsort() to compare index entries by their keys.
+ */
+    const obj_index_entry_t *e1 = *(const obj_index_entry_t * const *) p1;
+    const obj_index_entry_t *e2 = *(const obj_index_entry_t * const *) p2;
+
+    return(strcmp(e1->key, e2->key));
+}
@@ -75,16 +75,33 @@ static int create_ipmi_ctx(obj_t *ipmi);
 static int complete_ipmi_connect(obj_t *ipmi);
 static void fail_ipmi_connect(obj_t *ipmi);
 static void reset_ipmi_delay(obj_t *ipmi);
+static int acquire_ipmi_slot(obj_t *ipmi);
+static void release_ipmi_slot(obj_t *ipmi);
 
-extern tpoll_t tp_global;               /* defined in server.c */
 static int is_ipmi_engine_started = 0;
 
+/*  Connection attempts are admitted to the ipmiconsole engine via a fixed
+ *    number of slots.  When all slots are in use, consoles waiting to
+ *    connect are queued in FIFO order; as each attempt completes (either
+ *    successfully or not), its slot is passed to the next queued console.
+ *  This prevents a connect storm (eg, after a facility power event) from
+ *    overwhelming the engine such that most attempts time out and then
+ *    retry together.
+ */
+static pthread_mutex_t ipmi_admit_lock = PTHREAD_MUTEX_INITIALIZER;
+static List ipmi_admit_queue = NULL;
+static int ipmi_num_slots_used = 0;
+static int ipmi_max_slots = 0;
+
 
-void ipmi_init(int num_consoles)
+void ipmi_init(int num_consoles, int max_connects)
 {
-/*  Starts the ipmiconsole engine to handle 'num_consoles' IPMI SOL consoles.
+/*  Starts the ipmiconsole engine to handle 'num_consoles' IPMI SOL consoles,
+ *    with at most 'max_connects' connection attempts in progress at a time
+ *    (or unlimited if 0).
  */
     int num_threads;
+    int num_sessions;
 
     if (num_consoles <= 0) {
         return;
@@ -92,7 +109,24 @@ void ipmi_init(int num_consoles)
     if (is_ipmi_engine_started) {
         return;
     }
-    num_threads = ((num_consoles - 1) / IPMI_ENGINE_CONSOLES_PER_THREAD) + 1;
+    ipmi_admit_queue = list_create(NULL);
+    ipmi_max_slots = max_connects;
+    /*
+     *  The engine's thread count is fixed once it is started, so size it
+     *    for the number of sessions expected to be active at once: every
+     *    established session, plus the session setups in progress (which
+     *    are weighted more heavily since each exchanges several packets
+     *    with its BMC in a short period of time).
+     */
+    num_sessions = num_consoles;
+    if ((max_connects > 0) && (max_connects < num_consoles)) {
+        num_sessions += max_connects;
+    }
+    else {
+        num_sessions += num_consoles;
+    }
+    num_threads = ((num_sessions - 1) / (2 * IPMI_ENGINE_CONSOLES_PER_THREAD))
+        + 1;
     num_threads = MIN(num_threads, IPMICONSOLE_THREAD_COUNT_MAX);
 
     if (ipmiconsole_engine_init(num_threads, 0) < 0) {
@@ -104,6 +138,11 @@ void ipmi_init(int num_consoles)
             num_threads, (num_threads == 1) ? "" : "s",
             num_consoles, (num_consoles == 1) ? "" : "s");
     }
+    if (max_connects > 0) {
+        log_msg(LOG_INFO,
+            "IPMI SOL engine limited to %d connect%s in progress",
+            max_connects, (max_connects == 1) ? "" : "s");
+    }
     is_ipmi_engine_started = 1;
     return;
 }
@@ -124,6 +163,12 @@ void ipmi_fini(void)
     }
     ipmiconsole_engine_teardown(do_sol_session_cleanup);
     is_ipmi_engine_started = 0;
+
+    x_pthread_mutex_lock(&ipmi_admit_lock);
+    list_destroy(ipmi_admit_queue);
+    ipmi_admit_queue = NULL;
+    ipmi_num_slots_used = 0;
+    x_pthread_mutex_unlock(&ipmi_admit_lock);
     return;
 }
 
@@ -692,7 +737,6 @@ obj_t * create_ipmi_obj(server_conf_t *conf, char *name,
 /*  Creates a new IPMI device object and adds it to the master objs list.
  *  Returns the new object, or NULL on error.
  */
-    ListIterator i;
     obj_t *ipmi;
 
     assert(conf != NULL);
@@ -701,26 +745,19 @@ obj_t * create_ipmi_obj(server_conf_t *conf, char *name,
 
     /*  Check for duplicate console names.
      */
-    i = list_iterator_create(conf->objs);
-    while ((ipmi = list_next(i))) {
-        if (is_console_obj(ipmi) && !strcmp(ipmi->name, name)) {
-            if ((errbuf != NULL) && (errlen > 0)) {
-                snprintf(errbuf, errlen,
-                    "console [%s] specifies duplicate console name", name);
-            }
-            break;
-        }
-        if (is_ipmi_obj(ipmi) && !strcmp(ipmi->aux.ipmi.host, host)) {
-            if ((errbuf != NULL) && (errlen > 0)) {
-                snprintf(errbuf, errlen,
-                    "console [%s] specifies duplicate hostname \"%s\"",
-                    name, host);
-            }
-            break;
+    if (find_obj_index(conf->consoleIndex, name, CONMAN_OBJ_IS_CONSOLE)) {
+        if ((errbuf != NULL) && (errlen > 0)) {
+            snprintf(errbuf, errlen,
+                "console [%s] specifies duplicate console name", name);
         }
+        return(NULL);
     }
-    list_iterator_destroy(i);
-    if (ipmi != NULL) {
+    if (find_obj_index(conf->deviceIndex, host, CONMAN_OBJ_IPMI)) {
+        if ((errbuf != NULL) && (errlen > 0)) {
+            snprintf(errbuf, errlen,
+                "console [%s] specifies duplicate hostname \"%s\"",
+                name, host);
+        }
         return(NULL);
     }
     ipmi = create_obj(conf, name, -1, CONMAN_OBJ_IPMI);
@@ -731,12 +768,16 @@ obj_t * create_ipmi_obj(server_conf_t *conf, char *name,
     ipmi->aux.ipmi.state = CONMAN_IPMI_DOWN;
     ipmi->aux.ipmi.timer = -1;
     ipmi->aux.ipmi.delay = IPMI_MIN_TIMEOUT;
+    ipmi->aux.ipmi.gotSlot = 0;
+    ipmi->aux.ipmi.gotQueued = 0;
     x_pthread_mutex_init(&ipmi->aux.ipmi.mutex, NULL);
     conf->numIpmiObjs++;
     /*
-     *  Add obj to the master conf->objs list.
+     *  Add obj to the master conf->objs list and its indexes.
      */
     list_append(conf->objs, ipmi);
+    insert_obj_index(conf->consoleIndex, ipmi->name, ipmi);
+    insert_obj_index(conf->deviceIndex, ipmi->aux.ipmi.host, ipmi);
 
     DPRINTF((10,
         " IPMI [%s] H:%s U:%s P:%s K:%s L:%d C:%d W:0x%X\n",
@@ -788,11 +829,11 @@ static void disconnect_ipmi_obj(obj_t *ipmi)
     x_pthread_mutex_lock(&ipmi->aux.ipmi.mutex);
 
     if (ipmi->aux.ipmi.timer >= 0) {
-        (void) tpoll_timeout_cancel(tp_global, ipmi->aux.ipmi.timer);
+        (void) tpoll_timeout_cancel(ipmi->tp, ipmi->aux.ipmi.timer);
         ipmi->aux.ipmi.timer = -1;
     }
     if (ipmi->fd >= 0) {
-        tpoll_clear(tp_global, ipmi->fd, POLLIN | POLLOUT);
+        tpoll_clear(ipmi->tp, ipmi->fd, POLLIN | POLLOUT);
         if (close(ipmi->fd) < 0) {
             log_msg(LOG_WARNING,
                 "Unable to close connection to <%s> for console [%s]: %s",
@@ -808,6 +849,7 @@ static void disconnect_ipmi_obj(obj_t *ipmi)
             ipmi->name, ipmi->aux.ipmi.host);
     }
     ipmi->aux.ipmi.state = CONMAN_IPMI_DOWN;
+    mark_console_down(ipmi);
 
     x_pthread_mutex_unlock(&ipmi->aux.ipmi.mutex);
 
@@ -839,7 +881,7 @@ static int connect_ipmi_obj(obj_t *ipmi)
     if (ipmi->aux.ipmi.state != CONMAN_IPMI_UP) {
 
         if (ipmi->aux.ipmi.timer >= 0) {
-            (void) tpoll_timeout_cancel(tp_global, ipmi->aux.ipmi.timer);
+            (void) tpoll_timeout_cancel(ipmi->tp, ipmi->aux.ipmi.timer);
             ipmi->aux.ipmi.timer = -1;
         }
         if (ipmi->aux.ipmi.state == CONMAN_IPMI_DOWN) {
@@ -847,6 +889,7 @@ static int connect_ipmi_obj(obj_t *ipmi)
         }
         else if (ipmi->aux.ipmi.state == CONMAN_IPMI_PENDING) {
             rc = complete_ipmi_connect(ipmi);
+            release_ipmi_slot(ipmi);
         }
         else {
             log_err(0, "Console [%s] in unexpected IPMI state=%d",
@@ -872,7 +915,16 @@ static int initiate_ipmi_connect(obj_t *ipmi)
 
     assert(ipmi->aux.ipmi.state == CONMAN_IPMI_DOWN);
 
+    /*  Remain in the DOWN state without a timer while waiting for a slot.
+     *    The connection will be initiated once one is passed to this obj.
+     */
+    if (!acquire_ipmi_slot(ipmi)) {
+        DPRINTF((10, "Queued connect to <%s> via IPMI for [%s].\n",
+            ipmi->aux.ipmi.host, ipmi->name));
+        return(0);
+    }
     if (create_ipmi_ctx(ipmi) < 0) {
+        release_ipmi_slot(ipmi);
         return(-1);
     }
     DPRINTF((10, "Connecting to <%s> via IPMI for [%s].\n",
@@ -881,6 +933,7 @@ static int initiate_ipmi_connect(obj_t *ipmi)
     rc = ipmiconsole_engine_submit(ipmi->aux.ipmi.ctx,
         (Ipmiconsole_callback) connect_ipmi_obj, ipmi);
     if (rc < 0) {
+        release_ipmi_slot(ipmi);
         return(-1);
     }
     ipmi->aux.ipmi.state = CONMAN_IPMI_PENDING;
@@ -892,7 +945,7 @@ static int initiate_ipmi_connect(obj_t *ipmi)
      *    connect_ipmi_obj().
      */
     assert(ipmi->aux.ipmi.timer == -1);
-    ipmi->aux.ipmi.timer = tpoll_timeout_relative(tp_global,
+    ipmi->aux.ipmi.timer = tpoll_timeout_relative(ipmi->tp,
         (callback_f) connect_ipmi_obj, ipmi,
         IPMI_CONNECT_TIMEOUT * 1000);
 
@@ -970,7 +1023,8 @@ static int complete_ipmi_connect(obj_t *ipmi)
 
     ipmi->gotEOF = 0;
     ipmi->aux.ipmi.state = CONMAN_IPMI_UP;
-    tpoll_set(tp_global, ipmi->fd, POLLIN);
+    mark_console_up(ipmi);
+    tpoll_set_arg(ipmi->tp, ipmi->fd, POLLIN, ipmi);
 
     /*  Require the connection to be up for a minimum length of time
      *    before resetting the reconnect delay back to the minimum.
@@ -978,7 +1032,7 @@ static int complete_ipmi_connect(obj_t *ipmi)
      *    connect_ipmi_obj().
      */
     assert(ipmi->aux.ipmi.timer == -1);
-    ipmi->aux.ipmi.timer = tpoll_timeout_relative(tp_global,
+    ipmi->aux.ipmi.timer = tpoll_timeout_relative(ipmi->tp,
         (callback_f) reset_ipmi_delay, ipmi, IPMI_MIN_TIMEOUT * 1000);
 
     /*  Notify linked objs when transitioning into an UP state.
@@ -1019,15 +1073,10 @@ static void fail_ipmi_connect(obj_t *ipmi)
     DPRINTF((15, "Reconnect attempt to <%s> via IPMI for [%s] in %ds.\n",
         ipmi->aux.ipmi.host, ipmi->name, ipmi->aux.ipmi.delay));
     assert(ipmi->aux.ipmi.timer == -1);
-    ipmi->aux.ipmi.timer = tpoll_timeout_relative(tp_global,
+    ipmi->aux.ipmi.timer = tpoll_timeout_relative(ipmi->tp,
         (callback_f) connect_ipmi_obj, ipmi,
-        ipmi->aux.ipmi.delay * 1000);
-
-    /*  Update timer delay via exponential backoff.
-     */
-    if (ipmi->aux.ipmi.delay < IPMI_MAX_TIMEOUT) {
-        ipmi->aux.ipmi.delay = MIN(ipmi->aux.ipmi.delay * 2, IPMI_MAX_TIMEOUT);
-    }
+        get_reconnect_msecs(&ipmi->aux.ipmi.delay,
+            IPMI_MIN_TIMEOUT, IPMI_MAX_TIMEOUT));
     return;
 }
 
@@ -1051,6 +1100,75 @@ static void reset_ipmi_delay(obj_t *ipmi)
 }
 
 
+static int acquire_ipmi_slot(obj_t *ipmi)
+{
+/*  Acquires a slot for the 'ipmi' obj to initiate a connection attempt,
+ *    queueing the obj to be passed one if none are available.
+ *  Returns 1 if the obj holds a slot, or 0 if it is queued.
+ *
+ *  XXX: This routine assumes the ipmi obj mutex is already locked.
+ */
+    int rc = 1;
+
+    x_pthread_mutex_lock(&ipmi_admit_lock);
+
+    if (ipmi->aux.ipmi.gotSlot) {
+        ;                               /* slot was passed from another obj */
+    }
+    else if ((ipmi_max_slots == 0)
+            || (ipmi_num_slots_used < ipmi_max_slots)) {
+        ipmi_num_slots_used++;
+        ipmi->aux.ipmi.gotSlot = 1;
+    }
+    else {
+        if (!ipmi->aux.ipmi.gotQueued) {
+            list_append(ipmi_admit_queue, ipmi);
+            ipmi->aux.ipmi.gotQueued = 1;
+        }
+        rc = 0;
+    }
+    x_pthread_mutex_unlock(&ipmi_admit_lock);
+    return(rc);
+}
+
+
+static void release_ipmi_slot(obj_t *ipmi)
+{
+/*  Releases the slot held by the 'ipmi' obj once its connection attempt
+ *    has completed.  The slot is passed to the next queued obj (if any),
+ *    whose connection attempt is then initiated via a timer in its own
+ *    i/o thread.
+ *
+ *  XXX: This routine assumes the ipmi obj mutex is already locked.
+ */
+    obj_t *next = NULL;
+
+    x_pthread_mutex_lock(&ipmi_admit_lock);
+
+    if (ipmi->aux.ipmi.gotSlot) {
+        ipmi->aux.ipmi.gotSlot = 0;
+        if ((next = list_pop(ipmi_admit_queue))) {
+            next->aux.ipmi.gotQueued = 0;
+            next->aux.ipmi.gotSlot = 1;
+        }
+        else {
+            ipmi_num_slots_used--;
+        }
+    }
+    x_pthread_mutex_unlock(&ipmi_admit_lock);
+
+    /*  The next obj's mutex cannot be locked here without risking deadlock,
+     *    so its timer id is not saved.  But while queued, it has no other
+     *    timer pending.
+     */
+    if (next) {
+        (void) tpoll_timeout_relative(next->tp,
+            (callback_f) connect_ipmi_obj, next, 0);
+    }
+    return;
+}
+
+
 int send_ipmi_break(obj_t *ipmi)
 {
 /*  Generates a serial-break for the specified 'ipmi' obj.
@@ -27,21 +27,140 @@
 #endif /* HAVE_CONFIG_H */
 
 #include <assert.h>
+#include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <time.h>
+#if HAVE_SYS_SENDFILE_H
+#  include <sys/sendfile.h>
+#endif /* HAVE_SYS_SENDFILE_H */
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#endif /* __SSE2__ */
+#if WITH_ZLIB
+#  include <zlib.h>
+#endif /* WITH_ZLIB */
 #include "common.h"
 #include "log.h"
 #include "server.h"
 #include "tpoll.h"
 #include "util-file.h"
 #include "util-str.h"
+#include "util.h"
+#include "wrapper.h"
 
-extern tpoll_t tp_global;               /* defined in server.c */
+
+/*  Logfile writes are handed off to the log writer threads so that slow
+ *    storage cannot stall the i/o thread muxing the console.  Each logfile
+ *    has its own queue of bufs; a logfile with queued bufs is itself queued
+ *    for the writers, and only one writer at a time services a given logfile
+ *    so its writes remain in order.  All of the logfile write state is
+ *    protected by logWriteLock.
+ */
+typedef struct log_write {
+    struct log_write    *next;          /* next buf in logfile's queue       */
+    int                  fd;            /* logfile fd at the time of queuing */
+    int                  len;           /* num bytes of data                 */
+    time_t               mark;          /* time of index checkpoint, or 0    */
+    int                  isClose;       /* true if fd is closed (no data)    */
+    unsigned char       *data;          /* data (allocated after this hdr)   */
+    char                *name;          /* retired name to free, or NULL     */
+} log_write_t;
+
+/*  Logfile ranges replayed to clients are read as a stream of (decompressed)
+ *    data passed to a log_stream_f callback, which returns 0 to continue,
+ *    >0 to stop, or <0 on error.
+ */
+typedef struct log_stream {
+    int                  sd;            /* socket to which data is written   */
+    off_t                numBytes;      /* num bytes of data read            */
+    off_t                numLines;      /* num newlines in data read         */
+    off_t                skipBytes;     /* num bytes to skip before writing  */
+    off_t                skipLines;     /* num lines to skip for skipBytes   */
+    int                  lastByte;      /* last byte of data read            */
+    void                *zstream;       /* zlib stream if compressing sd data*/
+} log_stream_t;
+
+typedef int (*log_stream_f)(log_stream_t *ls, const unsigned char *p, int n);
+
+#if WITH_ZLIB
+/*  Logfiles rotated with rotatecompress are gzip'd by the log rotation thread.
+ *    A job remains at the head of the queue until it has been completed.
+ *  The queue is protected by logRotateLock.
+ */
+typedef struct log_rotation {
+    struct log_rotation *next;          /* next job in the queue             */
+    char                *name;          /* name of the active logfile        */
+    int                  count;         /* num rotated logfiles to keep      */
+} log_rotation_t;
+#endif /* WITH_ZLIB */
+
+static pthread_mutex_t logWriteLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t logWriteCond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t logSyncCond = PTHREAD_COND_INITIALIZER;
+static obj_t *logWriteHead = NULL;
+static obj_t *logWriteTail = NULL;
+static int logWriteCount = 0;
+
+/*  The time of the most recent periodic timestamp, in minutes since the epoch
+ *    (timestamps always fall on a minute boundary).  Each logfile writes the
+ *    timestamp lazily upon its next console output, so idle logs are left
+ *    untouched and the stamps of active logs are spread out over time.
+ */
+static int logStampMins = 0;
+
+#if WITH_ZLIB
+static pthread_mutex_t logRotateLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t logRotateCond = PTHREAD_COND_INITIALIZER;
+static log_rotation_t *logRotateHead = NULL;
+static log_rotation_t *logRotateTail = NULL;
+#endif /* WITH_ZLIB */
+
+
+static int scan_log_data(
+    const unsigned char *src, int len, int enableSanitize);
+static off_t parse_log_amount(const char *str, const char *units,
+    const off_t *scales);
+static int open_logfile(obj_t *logfile, char *lastdir, size_t lastlen);
+static int compare_logfile_names(obj_t *log1, obj_t *log2);
+static void write_log_open_msg(obj_t *logfile);
+static void write_log_timestamp(obj_t *logfile, int mins);
+static void enqueue_log_write(obj_t *logfile, log_write_t *w);
+static void enqueue_log_close(obj_t *logfile, char *name);
+static void expire_log_coalesce(obj_t *logfile);
+static int write_log_bufs(obj_t *logfile, log_write_t *head);
+static int close_log_fd(obj_t *logfile, int fd);
+static int end_log_frame(obj_t *logfile, int fd);
+static int write_log_iov(int fd, struct iovec *iov, int iovcnt);
+static int write_log_index(obj_t *logfile, int fd, time_t t);
+static int read_log_index(int fd, off_t i, time_t *tRef, off_t *offsetRef);
+static int rotate_logfile_obj(obj_t *logfile, time_t now);
+static int rename_log_files(const char *src, const char *dst);
+static void remove_log_files(const char *name);
+static int is_log_rotate_name_valid(const char *name);
+static int is_log_compressed(int fd, off_t offset);
+static int read_log_stream(const char *name, int fd, off_t start, off_t end,
+    log_stream_f f, log_stream_t *ls);
+static int count_log_stream(log_stream_t *ls, const unsigned char *p, int n);
+static int skip_log_stream(log_stream_t *ls, const unsigned char *p, int n);
+static int send_log_stream(log_stream_t *ls, const unsigned char *p, int n);
+#if WITH_ZLIB
+static int send_log_zstream(log_stream_t *ls, const unsigned char *p, int n,
+    int flush);
+static int compress_log_iov(obj_t *logfile, const struct iovec *iov,
+    int iovcnt, int isFinal, unsigned char **dstRef, int *dstLenRef);
+static void queue_log_rotation(const char *name, int count);
+static void compress_rotated_log(const char *name, int count);
+static int gzip_log_file(const char *src, const char *dst);
+#endif /* WITH_ZLIB */
 
 
 int parse_logfile_opts(logopt_t *opts, const char *str,
@@ -49,7 +168,9 @@ int parse_logfile_opts(logopt_t *opts, const char *str,
 {
 /*  Parses 'str' for logfile device options 'opts'.
  *    The 'opts' struct should be initialized to a default value.
- *    The 'str' string is of the form "(sanitize|nosanitize)".
+ *    The 'str' string is a list of options such as "(sanitize|nosanitize)"
+ *    or "rotatesize=SIZE".
+ *  Logfile compression can only be enabled if zlib support was compiled in.
  *  Returns 0 and updates the 'opts' struct on success; o/w, returns -1
  *    (writing an error message into 'errbuf' if defined).
  */
@@ -57,6 +178,10 @@ int parse_logfile_opts(logopt_t *opts, const char *str,
     char buf[MAX_LINE];
     const char * const separators = " \t\n.,;";
     char *tok;
+    off_t n;
+    const off_t sizeScales[] = { 1, 1024, 1024 * 1024, 1024 * 1024 * 1024 };
+    const off_t ageScales[] = { 60, 60, 60 * 60, 24 * 60 * 60 };
+    const off_t countScales[] = { 1 };
 
     assert(opts != NULL);
 
@@ -81,7 +206,19 @@ int parse_logfile_opts(logopt_t *opts, const char *str,
      */
     tok = strtok(buf, separators);
     while (tok != NULL) {
-        if (!strcasecmp(tok, "lock"))
+        if (!strcasecmp(tok, "compress")) {
+#if WITH_ZLIB
+            optsTmp.enableCompress = 1;
+#else /* !WITH_ZLIB */
+            if ((errbuf != NULL) && (errlen > 0))
+                snprintf(errbuf, errlen,
+                    "logfile compression not supported without zlib");
+            return(-1);
+#endif /* !WITH_ZLIB */
+        }
+        else if (!strcasecmp(tok, "nocompress"))
+            optsTmp.enableCompress = 0;
+        else if (!strcasecmp(tok, "lock"))
             optsTmp.enableLock = 1;
         else if (!strcasecmp(tok, "nolock"))
             optsTmp.enableLock = 0;
@@ -93,6 +230,69 @@ int parse_logfile_opts(logopt_t *opts, const char *str,
             optsTmp.enableTimestamp = 1;
         else if (!strcasecmp(tok, "notimestamp"))
             optsTmp.enableTimestamp = 0;
+        else if (!strcasecmp(tok, "rotatecompress")) {
+#if WITH_ZLIB
+            optsTmp.enableRotateZip = 1;
+#else /* !WITH_ZLIB */
+            if ((errbuf != NULL) && (errlen > 0))
+                snprintf(errbuf, errlen,
+                    "logfile compression not supported without zlib");
+            return(-1);
+#endif /* !WITH_ZLIB */
+        }
+        else if (!strcasecmp(tok, "norotatecompress"))
+            optsTmp.enableRotateZip = 0;
+        else if (!strncasecmp(tok, "rotatesize=", 11)) {
+            if ((n = parse_log_amount(tok + 11, "kmg", sizeScales)) < 0) {
+                if ((errbuf != NULL) && (errlen > 0))
+                    snprintf(errbuf, errlen, "invalid rotatesize '%s'",
+                        tok + 11);
+                return(-1);
+            }
+            optsTmp.rotateSize = n;
+        }
+        else if (!strncasecmp(tok, "rotateage=", 10)) {
+            if (((n = parse_log_amount(tok + 10, "mhd", ageScales)) < 0)
+                    || (n > INT_MAX)) {
+                if ((errbuf != NULL) && (errlen > 0))
+                    snprintf(errbuf, errlen, "invalid rotateage '%s'",
+                        tok + 10);
+                return(-1);
+            }
+            optsTmp.rotateAge = n;
+        }
+        else if (!strncasecmp(tok, "rotatecount=", 12)) {
+            if (((n = parse_log_amount(tok + 12, "", countScales)) < 1)
+                    || (n > LOG_ROTATE_COUNT_MAX)) {
+                if ((errbuf != NULL) && (errlen > 0))
+                    snprintf(errbuf, errlen,
+                        "rotatecount must be between 1-%d",
+                        LOG_ROTATE_COUNT_MAX);
+                return(-1);
+            }
+            optsTmp.rotateCount = n;
+        }
+        else if (!strncasecmp(tok, "coalesce=", 9)) {
+            if (((n = parse_log_amount(tok + 9, "", countScales)) < 0)
+                    || (n > LOG_COALESCE_MSECS_MAX)) {
+                if ((errbuf != NULL) && (errlen > 0))
+                    snprintf(errbuf, errlen,
+                        "coalesce must be between 0-%d ms",
+                        LOG_COALESCE_MSECS_MAX);
+                return(-1);
+            }
+            optsTmp.coalesceMsecs = n;
+        }
+        else if (!strncasecmp(tok, "coalescesize=", 13)) {
+            if (((n = parse_log_amount(tok + 13, "kmg", sizeScales)) < 1)
+                    || (n > INT_MAX)) {
+                if ((errbuf != NULL) && (errlen > 0))
+                    snprintf(errbuf, errlen, "invalid coalescesize '%s'",
+                        tok + 13);
+                return(-1);
+            }
+            optsTmp.coalesceSize = n;
+        }
         else {
             log_msg(LOG_WARNING, "ignoring unrecognized token '%s'", tok);
         }
@@ -103,6 +303,34 @@ int parse_logfile_opts(logopt_t *opts, const char *str,
 }
 
 
+static off_t parse_log_amount(const char *str, const char *units,
+    const off_t *scales)
+{
+/*  Parses the non-negative integer 'str' for a logfile option, which may be
+ *    followed by one of the single-character modifiers listed in 'units'.
+ *  The integer is multiplied by scales[0] if no modifier is given, or by
+ *    scales[i+1] for the modifier units[i].
+ *  Returns the amount, or -1 on error.
+ */
+    char *p;
+    const char *q;
+    long long n;
+
+    errno = 0;
+    n = strtoll(str, &p, 10);
+    if ((errno != 0) || (p == str) || (n < 0)) {
+        return(-1);
+    }
+    if (*p == '\0') {
+        return(n * scales[0]);
+    }
+    if ((p[1] != '\0') || !(q = strchr(units, tolower((int) *p)))) {
+        return(-1);
+    }
+    return(n * scales[(q - units) + 1]);
+}
+
+
 obj_t * create_logfile_obj(server_conf_t *conf, char *name,
     obj_t *console, logopt_t *opts, char *errbuf, int errlen)
 {
@@ -112,11 +340,9 @@ obj_t * create_logfile_obj(server_conf_t *conf, char *name,
  *    by main:open_objs:reopen_obj:open_logfile_obj().
  *  Returns the new object, or NULL on error.
  */
-    ListIterator i;
     obj_t *logfile;
     char buf[MAX_LINE];
     char *pname;
-    obj_t *obj;
 
     assert(conf != NULL);
     assert((name != NULL) && (name[0] != '\0'));
@@ -137,17 +363,7 @@ obj_t * create_logfile_obj(server_conf_t *conf, char *name,
         pname = name;
     }
 
-    i = list_iterator_create(conf->objs);
-    while ((logfile = list_next(i))) {
-        if (!is_logfile_obj(logfile)) {
-            continue;
-        }
-        if (!strcmp(logfile->name, pname)) {
-            break;
-        }
-    }
-    list_iterator_destroy(i);
-
+    logfile = find_obj_index(conf->logfileIndex, pname, CONMAN_OBJ_LOGFILE);
     if (logfile) {
         if ((errbuf != NULL) && (errlen > 0)) {
             snprintf(errbuf, errlen, "console [%s] already logging to \"%s\"",
@@ -160,6 +376,30 @@ obj_t * create_logfile_obj(server_conf_t *conf, char *name,
     logfile->aux.logfile.lineState = CONMAN_LOG_LINE_INIT;
     logfile->aux.logfile.opts = *opts;
     logfile->aux.logfile.gotTruncate = !!conf->enableZeroLogs;
+    logfile->aux.logfile.writeHead = NULL;
+    logfile->aux.logfile.writeTail = NULL;
+    logfile->aux.logfile.writeNext = NULL;
+    logfile->aux.logfile.numWriteBytes = 0;
+    logfile->aux.logfile.isWriteQueued = 0;
+    logfile->aux.logfile.isWriteBlocked = 0;
+    logfile->aux.logfile.isWriteRetired = 0;
+    logfile->aux.logfile.writeErrno = 0;
+    logfile->aux.logfile.numWrites = 0;
+    logfile->aux.logfile.writeMsecs = 0;
+    logfile->aux.logfile.writeMsecsMax = 0;
+    logfile->aux.logfile.zstream = NULL;
+    logfile->aux.logfile.frameBytes = 0;
+    logfile->aux.logfile.frameTime = 0;
+    logfile->aux.logfile.indexFd = -1;
+    logfile->aux.logfile.isIndexNew = 0;
+    logfile->aux.logfile.indexTime = 0;
+    logfile->aux.logfile.stampMins = x_atomic_load(&logStampMins);
+    logfile->aux.logfile.rotateBytes = 0;
+    logfile->aux.logfile.rotateTime = 0;
+    logfile->aux.logfile.rotateRetry = 0;
+    logfile->aux.logfile.coalesceTimer = -1;
+    logfile->aux.logfile.isFlushForced = 0;
+    logfile->aux.logfile.gotCoalesceDue = 0;
 
     if (logfile->aux.logfile.opts.enableSanitize
             || logfile->aux.logfile.opts.enableTimestamp) {
@@ -202,19 +442,11 @@ obj_t * create_logfile_obj(server_conf_t *conf, char *name,
     }
     /*  Add obj to the master conf->objs list
      *    before its corresponding console obj.
+     *  Prepending it (rather than inserting it just before the console)
+     *    avoids searching the list for the console.
      */
-    i = list_iterator_create(conf->objs);
-    while ((obj = list_next(i))) {
-        if (obj == console) {
-            list_insert(i, logfile);
-            break;
-        }
-    }
-    list_iterator_destroy(i);
-    if (!obj) {
-        log_err(0, "INTERNAL: Console [%s] object not found in master list",
-            console->name);
-    }
+    list_prepend(conf->objs, logfile);
+    insert_obj_index(conf->logfileIndex, logfile->name, logfile);
     return(logfile);
 }
 
@@ -225,11 +457,46 @@ int open_logfile_obj(obj_t *logfile)
  *  Since this logfile can be re-opened after the daemon has chdir()'d,
  *    it must be specified with an absolute pathname.
  *  Returns 0 if the logfile is successfully opened; o/w, returns -1.
+ */
+    return(open_logfile(logfile, NULL, 0));
+}
+
+
+void open_logfile_objs(List logfiles)
+{
+/*  (Re)opens each of the logfile objs in the 'logfiles' list.
+ *  The list is sorted by name so logfiles in the same directory are opened
+ *    together, and the intermediate directories are only checked once for
+ *    each of these runs instead of once per logfile.  This matters when
+ *    opening thousands of logfiles on network storage.
+ */
+    ListIterator i;
+    obj_t *logfile;
+    char lastdir[PATH_MAX] = "";
+
+    list_sort(logfiles, (ListCmpF) compare_logfile_names);
+
+    i = list_iterator_create(logfiles);
+    while ((logfile = list_next(i))) {
+        (void) open_logfile(logfile, lastdir, sizeof(lastdir));
+    }
+    list_iterator_destroy(i);
+    return;
+}
+
+
+static int open_logfile(obj_t *logfile, char *lastdir, size_t lastlen)
+{
+/*  (Re)opens the specified 'logfile' obj.
+ *  If 'lastdir' is not NULL, it holds the directory of the previous logfile
+ *    opened in this run; the intermediate directories are only created if
+ *    they differ, after which 'lastdir' is updated (up to 'lastlen' bytes).
+ *  Returns 0 if the logfile is successfully opened; o/w, returns -1.
  */
     char  dirname[PATH_MAX];
+    char *name;
     int   flags;
-    char *now;
-    char *msg;
+    struct stat st;
 
     assert(logfile != NULL);
     assert(is_logfile_obj(logfile));
@@ -238,15 +505,9 @@ int open_logfile_obj(obj_t *logfile)
     assert(logfile->aux.logfile.console != NULL);
     assert(logfile->aux.logfile.console->name != NULL);
 
-    if (logfile->fd >= 0) {
-        tpoll_clear(tp_global, logfile->fd, POLLOUT);
-        if (close(logfile->fd) < 0)
-            log_msg(LOG_WARNING, "Unable to close logfile \"%s\": %s",
-                logfile->name, strerror(errno));
-        logfile->fd = -1;
-    }
     /*  Perform conversion specifier expansion.
      */
+    name = NULL;
     if (logfile->aux.logfile.fmtName) {
 
         char buf[MAX_LINE];
@@ -257,16 +518,28 @@ int open_logfile_obj(obj_t *logfile)
             log_msg(LOG_WARNING,
                 "Unable to open logfile for [%s]: filename exceeded buffer",
                 logfile->aux.logfile.console->name);
-            logfile->fd = -1;
+            flush_logfile_obj(logfile);
+            close_log_writes(logfile, NULL);
             return(-1);
         }
-        free(logfile->name);
-        logfile->name = create_string(buf);
+        if (strcmp(buf, logfile->name) != 0) {
+            name = create_string(buf);
+        }
     }
+    /*  Hand off the previous fd to the log writers to be closed
+     *    without waiting for its queued data to be written out.
+     */
+    flush_logfile_obj(logfile);
+    close_log_writes(logfile, name);
     /*  Create intermediate directories.
      */
     if (get_dir_name(logfile->name, dirname, sizeof(dirname))) {
-        (void) create_dirs(dirname);
+        if (!lastdir || strcmp(dirname, lastdir)) {
+            (void) create_dirs(dirname);
+        }
+        if (lastdir) {
+            (void) strlcpy(lastdir, dirname, lastlen);
+        }
     }
     /*  Only truncate on the initial open if ZeroLogs was enabled.
      */
@@ -287,10 +560,73 @@ int open_logfile_obj(obj_t *logfile)
         logfile->fd = -1;
         return(-1);
     }
+    /*  A new (or truncated) logfile invalidates its time index.
+     */
+    if (fstat(logfile->fd, &st) < 0) {
+        st.st_size = 0;
+    }
+    if (st.st_size == 0) {
+        x_pthread_mutex_lock(&logWriteLock);
+        logfile->aux.logfile.isIndexNew = 1;
+        x_pthread_mutex_unlock(&logWriteLock);
+    }
+    /*  Rotation by size counts the data already in the logfile.
+     */
+    logfile->aux.logfile.rotateBytes = st.st_size;
+    logfile->aux.logfile.rotateTime = time(NULL);
+    logfile->aux.logfile.rotateRetry = 0;
+
     logfile->gotEOF = 0;
     set_fd_nonblocking(logfile->fd);    /* redundant, just playing it safe */
     set_fd_closed_on_exec(logfile->fd);
 
+    write_log_open_msg(logfile);
+
+    DPRINTF((9, "Opened [%s] logfile: fd=%d file=%s.\n",
+        logfile->aux.logfile.console->name, logfile->fd, logfile->name));
+    return(0);
+}
+
+
+static int compare_logfile_names(obj_t *log1, obj_t *log2)
+{
+/*  List helper function for sorting logfile objs by name.
+ */
+    return(strcmp(log1->name, log2->name));
+}
+
+
+static void write_log_timestamp(obj_t *logfile, int mins)
+{
+/*  Writes the periodic timestamp for the minute (mins) into the logfile obj,
+ *    marking it for a checkpoint in its sidecar time index.
+ */
+    time_t t;
+    char *now;
+    char buf[MAX_LINE];
+
+    t = (time_t) mins * 60;
+    now = create_long_time_string(t);
+    snprintf(buf, sizeof(buf), "%sConsole [%s] log at %s%s",
+        CONMAN_MSG_PREFIX, logfile->aux.logfile.console->name,
+        now, CONMAN_MSG_SUFFIX);
+    strcpy(&buf[sizeof(buf) - 3], "\r\n");
+    free(now);
+
+    logfile->aux.logfile.stampMins = mins;
+    mark_log_index(logfile, t);
+    write_obj_data(logfile, buf, strlen(buf), 1);
+    return;
+}
+
+
+static void write_log_open_msg(obj_t *logfile)
+{
+/*  Writes the "log opened" message at the start of a newly-opened logfile.
+ */
+    char *now;
+    char *msg;
+
     now = create_long_time_string(0);
     msg = create_format_string("%sConsole [%s] log opened at %s%s",
         CONMAN_MSG_PREFIX, logfile->aux.logfile.console->name, now,
@@ -304,10 +640,7 @@ int open_logfile_obj(obj_t *logfile)
      *    be triggered.  Thusly, we re-initialize the line state here.
      */
     logfile->aux.logfile.lineState = CONMAN_LOG_LINE_INIT;
-
-    DPRINTF((9, "Opened [%s] logfile: fd=%d file=%s.\n",
-        logfile->aux.logfile.console->name, logfile->fd, logfile->name));
-    return(0);
+    return;
 }
 
 
@@ -364,6 +697,8 @@ int write_log_data(obj_t *log, const void *src, int len)
  *    sequences.
  *  If newline timestamping is enabled, the current timestamp is appended
  *    after each newline.
+ *  If a periodic timestamp has come due since the last one written into
+ *    this logfile, it is written ahead of the data.
  *  Returns the number of bytes written into the logfile obj's buffer.
  */
     const int minbuf = 25;              /* cr/lf + timestamp + meta/char */
@@ -371,11 +706,16 @@ int write_log_data(obj_t *log, const void *src, int len)
     const unsigned char *p;
     unsigned char *q;
     const unsigned char * const qLast = buf + sizeof(buf);
+    int m;
     int n = 0;
 
     assert(is_logfile_obj(log));
     assert(sizeof(buf) >= (size_t) minbuf);
 
+    if ((m = x_atomic_load(&logStampMins)) != log->aux.logfile.stampMins) {
+        write_log_timestamp(log, m);
+    }
+
     /*  If no additional processing is needed, listen to Biff Tannen:
      *    "make like a tree and get outta here".
      */
@@ -386,6 +726,24 @@ int write_log_data(obj_t *log, const void *src, int len)
         len, log->aux.logfile.console->name, log->name));
 
     for (p=src, q=buf; len>0; p++, len--) {
+        /*
+         *  Within a line, the run of bytes needing no processing is copied
+         *    in bulk.  The internal buffer retains at least (minbuf) bytes
+         *    afterwards for processing the byte that ended the run.
+         */
+        if (log->aux.logfile.lineState == CONMAN_LOG_LINE_DATA) {
+            m = scan_log_data(p, MIN(len, (qLast - q) - minbuf),
+                log->aux.logfile.opts.enableSanitize);
+            if (m > 0) {
+                memcpy(q, p, m);
+                q += m;
+                p += m;
+                len -= m;
+                if (len == 0) {
+                    break;
+                }
+            }
+        }
         /*
          *  A newline state machine is used to properly sanitize CR/LF line
          *    terminations.  This is responsible for coalescing multiple CRs,
@@ -466,3 +824,1799 @@ int write_log_data(obj_t *log, const void *src, int len)
     n += write_obj_data(log, buf, q - buf, 0);
     return(n);
 }
+
+
+int queue_log_write(obj_t *logfile, const struct iovec *iov, int iovcnt)
+{
+/*  Queues the data described by the (iovcnt) buffers of (iov) to be written
+ *    out to the logfile obj's fd by a log writer thread.
+ *  Returns the number of bytes queued, or -1 (setting errno) if a previous
+ *    write to the logfile failed.  If the logfile already has
+ *    LOG_WRITE_QUEUE_MAX bytes queued, 0 is returned and POLLOUT is cleared
+ *    until the writer has caught up; data accumulating in the meantime
+ *    is subject to being overwritten in the logfile's circular-buffer.
+ *
+ *  XXX: This routine must only be called by the obj's i/o thread.
+ */
+    log_write_t *w;
+    int len;
+    int k;
+    int n;
+
+    assert(is_logfile_obj(logfile));
+    assert(logfile->fd >= 0);
+
+    x_pthread_mutex_lock(&logWriteLock);
+
+    if (logfile->aux.logfile.writeErrno) {
+        errno = logfile->aux.logfile.writeErrno;
+        logfile->aux.logfile.writeErrno = 0;
+        x_pthread_mutex_unlock(&logWriteLock);
+        return(-1);
+    }
+    len = LOG_WRITE_QUEUE_MAX - logfile->aux.logfile.numWriteBytes;
+    if (len <= 0) {
+        logfile->aux.logfile.isWriteBlocked = 1;
+        tpoll_clear(logfile->tp, logfile->fd, POLLOUT);
+        x_pthread_mutex_unlock(&logWriteLock);
+        return(0);
+    }
+    for (k = 0, n = 0; k < iovcnt; k++) {
+        n += iov[k].iov_len;
+    }
+    len = MIN(len, n);
+
+    if (!(w = malloc(sizeof(log_write_t) + len))) {
+        out_of_memory();
+    }
+    w->next = NULL;
+    w->fd = logfile->fd;
+    w->len = len;
+    w->mark = logfile->aux.logfile.indexTime;
+    w->isClose = 0;
+    w->name = NULL;
+    logfile->aux.logfile.indexTime = 0;
+    w->data = (unsigned char *) (w + 1);
+    for (k = 0, n = 0; (k < iovcnt) && (n < len); k++) {
+        int m = MIN((int) iov[k].iov_len, len - n);
+        memcpy(w->data + n, iov[k].iov_base, m);
+        n += m;
+    }
+    enqueue_log_write(logfile, w);
+    logfile->aux.logfile.rotateBytes += len;
+
+    x_pthread_mutex_unlock(&logWriteLock);
+    return(len);
+}
+
+
+static void enqueue_log_write(obj_t *logfile, log_write_t *w)
+{
+/*  Appends the buf (w) to the logfile obj's write queue, and queues the
+ *    logfile itself for the log writers if it is not already queued.
+ *
+ *  XXX: This routine must only be called while holding logWriteLock.
+ */
+    w->next = NULL;
+    if (logfile->aux.logfile.writeTail) {
+        logfile->aux.logfile.writeTail->next = w;
+    }
+    else {
+        logfile->aux.logfile.writeHead = w;
+    }
+    logfile->aux.logfile.writeTail = w;
+    logfile->aux.logfile.numWriteBytes += w->len;
+
+    if (!logfile->aux.logfile.isWriteQueued) {
+        logfile->aux.logfile.isWriteQueued = 1;
+        logWriteCount++;
+        logfile->aux.logfile.writeNext = NULL;
+        if (logWriteTail) {
+            logWriteTail->aux.logfile.writeNext = logfile;
+        }
+        else {
+            logWriteHead = logfile;
+        }
+        logWriteTail = logfile;
+        if ((errno = pthread_cond_signal(&logWriteCond)) != 0) {
+            log_err(errno, "pthread_cond_signal() failed");
+        }
+    }
+    return;
+}
+
+
+static void enqueue_log_close(obj_t *logfile, char *name)
+{
+/*  Appends a close buf to the logfile obj's write queue so the writer
+ *    closes the obj's current fd (if any) once all of the data queued for it
+ *    has been written, and then frees the retired (name) if not NULL.
+ *  The obj's fd is reset since the fd now belongs to the log writers.
+ *
+ *  XXX: This routine must only be called while holding logWriteLock.
+ */
+    log_write_t *w;
+
+    if (!(w = malloc(sizeof(log_write_t)))) {
+        out_of_memory();
+    }
+    w->fd = logfile->fd;
+    w->len = 0;
+    w->mark = 0;
+    w->isClose = 1;
+    w->data = NULL;
+    w->name = name;
+    enqueue_log_write(logfile, w);
+    logfile->fd = -1;
+    return;
+}
+
+
+int defer_log_write(obj_t *logfile, int len)
+{
+/*  Checks whether writing the (len) bytes buffered in the logfile obj
+ *    should be deferred in order to coalesce them with subsequent output.
+ *  A write is deferred until the data reaches the logfile's coalescesize
+ *    (or half of its buffer), or until its coalesce time has elapsed since
+ *    the data was first held back.  A write is never deferred while a
+ *    flush is being forced, or once the logfile has reached EOF.
+ *  Returns true if the write should be deferred.
+ *
+ *  XXX: This routine must only be called by the logfile obj's i/o thread.
+ */
+    logopt_t *opts;
+
+    assert(is_logfile_obj(logfile));
+
+    opts = &logfile->aux.logfile.opts;
+    if (!opts->coalesceMsecs || logfile->gotEOF) {
+        return(0);
+    }
+    if ((len < MIN(opts->coalesceSize, logfile->bufSize / 2))
+            && !logfile->aux.logfile.gotCoalesceDue
+            && !x_atomic_load(&logfile->aux.logfile.isFlushForced)) {
+        if (logfile->aux.logfile.coalesceTimer < 0) {
+            logfile->aux.logfile.coalesceTimer = tpoll_timeout_relative(
+                logfile->tp, (callback_f) expire_log_coalesce, logfile,
+                opts->coalesceMsecs);
+        }
+        return(1);
+    }
+    if (logfile->aux.logfile.coalesceTimer >= 0) {
+        (void) tpoll_timeout_cancel(logfile->tp,
+            logfile->aux.logfile.coalesceTimer);
+        logfile->aux.logfile.coalesceTimer = -1;
+    }
+    logfile->aux.logfile.gotCoalesceDue = 0;
+    return(0);
+}
+
+
+static void expire_log_coalesce(obj_t *logfile)
+{
+/*  Ends the coalescing of the data held back in the logfile obj after its
+ *    coalesce time has elapsed, notifying tpoll so the data is written.
+ *  This routine is invoked by a timer in the logfile obj's i/o thread.
+ */
+    logfile->aux.logfile.coalesceTimer = -1;
+    logfile->aux.logfile.gotCoalesceDue = 1;
+    if (logfile->fd >= 0) {
+        tpoll_set_arg(logfile->tp, logfile->fd, POLLOUT, logfile);
+    }
+    return;
+}
+
+
+void flush_log_writes(obj_t *logfile)
+{
+/*  Forces any data being coalesced in the logfile obj to be written out,
+ *    waiting up to LOG_FLUSH_WAIT_SECS for it to reach the logfile
+ *    (e.g., before the logfile is replayed from disk).
+ *
+ *  XXX: This routine must not be called by the logfile obj's i/o thread.
+ */
+    struct timespec ts;
+
+    assert(is_logfile_obj(logfile));
+
+    if (!logfile->aux.logfile.opts.coalesceMsecs) {
+        return;
+    }
+    ts.tv_sec = time(NULL) + LOG_FLUSH_WAIT_SECS;
+    ts.tv_nsec = 0;
+
+    x_pthread_mutex_lock(&logWriteLock);
+    x_atomic_store(&logfile->aux.logfile.isFlushForced, 1);
+    if (logfile->fd >= 0) {
+        tpoll_set_arg(logfile->tp, logfile->fd, POLLOUT, logfile);
+    }
+    while (x_atomic_load(&logfile->aux.logfile.isFlushForced)
+            || logfile->aux.logfile.isWriteQueued) {
+        errno = pthread_cond_timedwait(&logSyncCond, &logWriteLock, &ts);
+        if (errno == ETIMEDOUT) {
+            break;
+        }
+        else if (errno != 0) {
+            log_err(errno, "pthread_cond_timedwait() failed");
+        }
+    }
+    x_pthread_mutex_unlock(&logWriteLock);
+    return;
+}
+
+
+void end_log_flush(obj_t *logfile)
+{
+/*  Completes a flush forced on the logfile obj once all of its buffered
+ *    data has been queued for the log writers.
+ *
+ *  XXX: This routine must only be called by the logfile obj's i/o thread.
+ */
+    assert(is_logfile_obj(logfile));
+
+    if (!x_atomic_load(&logfile->aux.logfile.isFlushForced)) {
+        return;
+    }
+    x_pthread_mutex_lock(&logWriteLock);
+    x_atomic_store(&logfile->aux.logfile.isFlushForced, 0);
+    if ((errno = pthread_cond_broadcast(&logSyncCond)) != 0) {
+        log_err(errno, "pthread_cond_broadcast() failed");
+    }
+    x_pthread_mutex_unlock(&logWriteLock);
+    return;
+}
+
+
+void close_log_writes(obj_t *logfile, char *name)
+{
+/*  Closes the logfile obj's fd without waiting on the log writers.
+ *    The fd is handed off to the writers, and is closed (along with its
+ *    gz frame and sidecar index) once all of the data queued for it has been
+ *    written.  Data still buffered in the obj is not affected.
+ *  If (name) is not NULL, it replaces the obj's name.  The old name is freed
+ *    by the writers as well since they may still be using it.
+ *
+ *  XXX: This routine must only be called by the logfile obj's i/o thread.
+ */
+    char *old = NULL;
+
+    assert(is_logfile_obj(logfile));
+
+    if (logfile->fd >= 0) {
+        tpoll_clear(logfile->tp, logfile->fd, POLLIN | POLLOUT);
+    }
+    x_pthread_mutex_lock(&logWriteLock);
+    if (name) {
+        old = logfile->name;
+        logfile->name = name;
+    }
+    if ((logfile->fd >= 0) || (old && logfile->aux.logfile.isWriteQueued)) {
+        enqueue_log_close(logfile, old);
+        old = NULL;
+    }
+    logfile->aux.logfile.writeErrno = 0;
+    x_pthread_mutex_unlock(&logWriteLock);
+
+    free(old);
+    return;
+}
+
+
+int defer_logfile_destroy(obj_t *logfile)
+{
+/*  Checks whether the logfile obj being destroyed still has bufs queued
+ *    for the log writers, in which case the writer servicing it frees the obj
+ *    (and its name) once they have been written out.
+ *  Returns true if freeing the obj has been deferred to the writers.
+ */
+    int isDeferred;
+
+    assert(is_logfile_obj(logfile));
+    assert(logfile->fd < 0);
+
+    x_pthread_mutex_lock(&logWriteLock);
+    isDeferred = logfile->aux.logfile.isWriteQueued;
+    logfile->aux.logfile.isWriteRetired = isDeferred;
+    x_pthread_mutex_unlock(&logWriteLock);
+    return(isDeferred);
+}
+
+
+void sync_log_writes(void)
+{
+/*  Waits for the log writers to write out all of the data queued for
+ *    every logfile obj (e.g., before the daemon exits).
+ */
+    x_pthread_mutex_lock(&logWriteLock);
+    while (logWriteCount > 0) {
+        if ((errno = pthread_cond_wait(&logSyncCond, &logWriteLock)) != 0) {
+            log_err(errno, "pthread_cond_wait() failed");
+        }
+    }
+    x_pthread_mutex_unlock(&logWriteLock);
+    return;
+}
+
+
+void * process_log_writes(void *arg)
+{
+/*  The log writer thread loop.  Writes out the bufs queued for each logfile
+ *    in turn, requeueing the logfile if more bufs arrived in the meantime.
+ *  Once a blocked logfile's queue has drained to half of its limit
+ *    (or a write has failed), its i/o thread is notified via POLLOUT.
+ */
+    obj_t *logfile;
+    log_write_t *head;
+    int n;
+
+    x_pthread_mutex_lock(&logWriteLock);
+    for (;;) {
+        while (!logWriteHead) {
+            if ((errno = pthread_cond_wait(
+              &logWriteCond, &logWriteLock)) != 0) {
+                log_err(errno, "pthread_cond_wait() failed");
+            }
+        }
+        logfile = logWriteHead;
+        if (!(logWriteHead = logfile->aux.logfile.writeNext)) {
+            logWriteTail = NULL;
+        }
+        head = logfile->aux.logfile.writeHead;
+        logfile->aux.logfile.writeHead = NULL;
+        logfile->aux.logfile.writeTail = NULL;
+        x_pthread_mutex_unlock(&logWriteLock);
+
+        n = write_log_bufs(logfile, head);
+
+        x_pthread_mutex_lock(&logWriteLock);
+        logfile->aux.logfile.numWriteBytes -= n;
+        if (logfile->aux.logfile.writeHead) {
+            logfile->aux.logfile.writeNext = NULL;
+            if (logWriteTail) {
+                logWriteTail->aux.logfile.writeNext = logfile;
+            }
+            else {
+                logWriteHead = logfile;
+            }
+            logWriteTail = logfile;
+        }
+        else {
+            logfile->aux.logfile.isWriteQueued = 0;
+            logWriteCount--;
+            if ((errno = pthread_cond_broadcast(&logSyncCond)) != 0) {
+                log_err(errno, "pthread_cond_broadcast() failed");
+            }
+            if (logfile->aux.logfile.isWriteRetired) {
+                free(logfile->name);
+                free(logfile);
+                continue;
+            }
+        }
+        /*  The i/o thread is notified via the logfile's current fd
+         *    since the bufs written may have been for a rotated fd.
+         */
+        if (((logfile->aux.logfile.isWriteBlocked
+              && (logfile->aux.logfile.numWriteBytes
+                  <= LOG_WRITE_QUEUE_MAX / 2))
+            || logfile->aux.logfile.writeErrno)
+          && (logfile->fd >= 0)) {
+            logfile->aux.logfile.isWriteBlocked = 0;
+            tpoll_set_arg(logfile->tp, logfile->fd, POLLOUT, logfile);
+        }
+    }
+    /* Not reached. */
+    x_pthread_mutex_unlock(&logWriteLock);
+    return(arg);
+}
+
+
+void check_logfile_rotation(obj_t *logfile)
+{
+/*  Rotates the logfile obj once the data logged to its current file has
+ *    reached its rotatesize, or once the file has reached its rotateage.
+ *  Since this is only checked as data is written into the logfile,
+ *    an idle logfile is not rotated until its console next logs output.
+ *  If the rotation fails, it is retried after LOG_ROTATE_RETRY_SECS.
+ *
+ *  XXX: This routine must only be called by the logfile obj's i/o thread.
+ */
+    logopt_t *opts;
+    time_t now;
+
+    assert(is_logfile_obj(logfile));
+
+    opts = &logfile->aux.logfile.opts;
+    if ((logfile->fd < 0) || (!opts->rotateSize && !opts->rotateAge)) {
+        return;
+    }
+    now = time(NULL);
+    if (!((opts->rotateSize
+            && (logfile->aux.logfile.rotateBytes >= opts->rotateSize))
+        || (opts->rotateAge
+            && (now - logfile->aux.logfile.rotateTime >= opts->rotateAge)))) {
+        return;
+    }
+    if (now < logfile->aux.logfile.rotateRetry) {
+        return;
+    }
+    if (rotate_logfile_obj(logfile, now) < 0) {
+        logfile->aux.logfile.rotateRetry = now + LOG_ROTATE_RETRY_SECS;
+    }
+    return;
+}
+
+
+#if WITH_ZLIB
+void * process_log_rotations(void *arg)
+{
+/*  The log rotation thread loop.  Gzips each logfile rotated with
+ *    rotatecompress in turn so the i/o threads never wait on it.
+ */
+    log_rotation_t *r;
+
+    x_pthread_mutex_lock(&logRotateLock);
+    for (;;) {
+        while (!logRotateHead) {
+            if ((errno = pthread_cond_wait(
+              &logRotateCond, &logRotateLock)) != 0) {
+                log_err(errno, "pthread_cond_wait() failed");
+            }
+        }
+        r = logRotateHead;
+        x_pthread_mutex_unlock(&logRotateLock);
+
+        compress_rotated_log(r->name, r->count);
+
+        x_pthread_mutex_lock(&logRotateLock);
+        if (!(logRotateHead = r->next)) {
+            logRotateTail = NULL;
+        }
+        free(r->name);
+        free(r);
+    }
+    /* Not reached. */
+    x_pthread_mutex_unlock(&logRotateLock);
+    return(arg);
+}
+#endif /* WITH_ZLIB */
+
+
+void set_log_timestamp(time_t t)
+{
+/*  Sets the time (t) of the current periodic timestamp, which is written
+ *    into each logfile upon its next console output.
+ */
+    x_atomic_store(&logStampMins, (int) (t / 60));
+    return;
+}
+
+
+void mark_log_index(obj_t *logfile, time_t t)
+{
+/*  Marks the logfile obj for a checkpoint at time (t) in its sidecar index.
+ *  The checkpoint is attached to the next buf queued for the writer, and
+ *    records the byte offset at which that buf is written to the logfile.
+ *    It is thus at or before any data written into the obj after this call.
+ */
+    assert(is_logfile_obj(logfile));
+
+    x_pthread_mutex_lock(&logWriteLock);
+    logfile->aux.logfile.indexTime = t;
+    x_pthread_mutex_unlock(&logWriteLock);
+    return;
+}
+
+
+int find_log_range(const char *name, time_t since, time_t until,
+    off_t *startRef, off_t *endRef, char *errbuf, int errlen)
+{
+/*  Finds the range of the logfile (name) covering the times from (since)
+ *    to (until) via the checkpoints in its sidecar index; either time
+ *    can be 0 to leave that end of the range open.
+ *  The range starts at the last checkpoint at or before (since) and ends
+ *    at the first checkpoint after (until), so it is only as precise as the
+ *    TimeStamp interval.  An open end is set to -1 for the end of the file.
+ *  The index is not needed if both ends of the range are open.
+ *  Returns 0 on success with the range in (startRef) and (endRef);
+ *    o/w, returns -1 with a message written into (errbuf).
+ */
+    char idxname[PATH_MAX];
+    struct stat st;
+    int fd;
+    off_t lo, hi, mid, n;
+    time_t t;
+    off_t offset;
+    int rc = -1;
+
+    assert(name != NULL);
+    assert(startRef != NULL);
+    assert(endRef != NULL);
+
+    *startRef = 0;
+    *endRef = -1;
+
+    if (!since && !until) {
+        return(0);
+    }
+    if ((snprintf(idxname, sizeof(idxname), "%s%s", name, LOG_INDEX_SUFFIX)
+            >= (int) sizeof(idxname)) || (stat(name, &st) < 0)) {
+        snprintf(errbuf, errlen, "unable to access logfile");
+        return(-1);
+    }
+    if ((fd = open(idxname, O_RDONLY)) < 0) {
+        snprintf(errbuf, errlen, "logfile has no time index");
+        return(-1);
+    }
+    if (fstat(fd, &st) < 0) {
+        snprintf(errbuf, errlen, "unable to access time index");
+        goto end;
+    }
+    n = st.st_size / LOG_INDEX_REC_LEN;
+
+    /*  Binary search for the last checkpoint at or before (since).
+     */
+    if (since) {
+        for (lo = 0, hi = n; lo < hi; ) {
+            mid = lo + ((hi - lo) / 2);
+            if (read_log_index(fd, mid, &t, &offset) < 0) {
+                goto bad;
+            }
+            if (t <= since) {
+                lo = mid + 1;
+            }
+            else {
+                hi = mid;
+            }
+        }
+        if (lo > 0) {
+            if (read_log_index(fd, lo - 1, &t, startRef) < 0) {
+                goto bad;
+            }
+        }
+    }
+    /*  Binary search for the first checkpoint after (until).
+     */
+    if (until) {
+        for (lo = 0, hi = n; lo < hi; ) {
+            mid = lo + ((hi - lo) / 2);
+            if (read_log_index(fd, mid, &t, &offset) < 0) {
+                goto bad;
+            }
+            if (t <= until) {
+                lo = mid + 1;
+            }
+            else {
+                hi = mid;
+            }
+        }
+        if (lo < n) {
+            if (read_log_index(fd, lo, &t, endRef) < 0) {
+                goto bad;
+            }
+        }
+    }
+    if (stat(name, &st) < 0) {
+        snprintf(errbuf, errlen, "unable to access logfile");
+        goto end;
+    }
+    if ((*startRef > st.st_size) || (*endRef > st.st_size)
+            || ((*endRef >= 0) && (*endRef < *startRef))) {
+        goto bad;
+    }
+    rc = 0;
+    goto end;
+
+bad:
+    snprintf(errbuf, errlen, "time index is invalid");
+end:
+    if (close(fd) < 0) {
+        log_msg(LOG_WARNING, "Unable to close \"%s\": %s",
+            idxname, strerror(errno));
+    }
+    return(rc);
+}
+
+
+int find_log_tail(const char *name, off_t lines, off_t bytes,
+    off_t *startRef, off_t end, off_t *skipRef, char *errbuf, int errlen)
+{
+/*  Narrows the range of the logfile (name) from offset (startRef) up to
+ *    offset (end) -- or to the end of the file if (end) is -1 -- down to
+ *    its last (lines) lines or (bytes) bytes, whichever is non-zero.
+ *  An uncompressed logfile is scanned backwards from the end of the range.
+ *    A compressed logfile can only be read forwards from a gz frame
+ *    boundary, so the frames at the checkpoints in its sidecar index are
+ *    decompressed in exponentially-increasing steps back from the end of
+ *    the range until they hold enough data; the (skipRef) bytes of
+ *    decompressed data preceding the tail are then to be discarded.
+ *  Returns 0 on success with the range adjusted in (startRef) and
+ *    (skipRef); o/w, returns -1 with a message written into (errbuf).
+ */
+    int fd;
+    int idxfd = -1;
+    char idxname[PATH_MAX];
+    struct stat st;
+    unsigned char buf[MAX_BUF_SIZE];
+    log_stream_t ls;
+    off_t e, pos, cand, need;
+    off_t lo, hi, mid, n, step;
+    time_t t;
+    off_t offset;
+    int len, k;
+    int rc = -1;
+
+    assert(name != NULL);
+    assert(startRef != NULL);
+    assert(skipRef != NULL);
+    assert((lines > 0) || (bytes > 0));
+
+    *skipRef = 0;
+    if ((fd = open(name, O_RDONLY)) < 0) {
+        snprintf(errbuf, errlen, "unable to access logfile");
+        return(-1);
+    }
+    if (fstat(fd, &st) < 0) {
+        snprintf(errbuf, errlen, "unable to access logfile");
+        goto end;
+    }
+    e = ((end < 0) || (end > st.st_size)) ? st.st_size : end;
+
+    if (!is_log_compressed(fd, *startRef)) {
+        if (bytes > 0) {
+            if (e - *startRef > bytes) {
+                *startRef = e - bytes;
+            }
+            rc = 0;
+            goto end;
+        }
+        /*  Search backwards for the newline preceding the (lines)th-to-last
+         *    line, disregarding the newline terminating the last line.
+         */
+        need = lines;
+        for (pos = e; pos > *startRef; ) {
+            len = MIN((off_t) sizeof(buf), pos - *startRef);
+            pos -= len;
+            if (pread(fd, buf, len, pos) != len) {
+                snprintf(errbuf, errlen, "unable to read logfile");
+                goto end;
+            }
+            for (k = len - 1; k >= 0; k--) {
+                if ((buf[k] == '\n') && (pos + k != e - 1) && (--need == 0)) {
+                    *startRef = pos + k + 1;
+                    rc = 0;
+                    goto end;
+                }
+            }
+        }
+        rc = 0;
+        goto end;
+    }
+    /*  Find the last checkpoint before the end of the range.
+     *  Without an index, the logfile is decompressed from the start.
+     */
+    n = 0;
+    snprintf(idxname, sizeof(idxname), "%s%s", name, LOG_INDEX_SUFFIX);
+    if (((idxfd = open(idxname, O_RDONLY)) >= 0)
+            && (fstat(idxfd, &st) == 0)) {
+        for (lo = 0, hi = st.st_size / LOG_INDEX_REC_LEN; lo < hi; ) {
+            mid = lo + ((hi - lo) / 2);
+            if (read_log_index(idxfd, mid, &t, &offset) < 0) {
+                snprintf(errbuf, errlen, "time index is invalid");
+                goto end;
+            }
+            if (offset < e) {
+                lo = mid + 1;
+            }
+            else {
+                hi = mid;
+            }
+        }
+        n = lo;
+    }
+    for (step = 1; ; step *= 2) {
+        cand = *startRef;
+        if ((n > 0) && (read_log_index(idxfd, n - 1, &t, &offset) == 0)
+                && (offset > *startRef)) {
+            cand = offset;
+        }
+        memset(&ls, 0, sizeof(ls));
+        ls.lastByte = '\n';
+        if (read_log_stream(name, fd, cand, e, count_log_stream, &ls) < 0) {
+            snprintf(errbuf, errlen, "unable to read logfile");
+            goto end;
+        }
+        if (ls.lastByte != '\n') {
+            ls.numLines++;
+        }
+        if ((cand == *startRef)
+                || ((bytes > 0) && (ls.numBytes >= bytes))
+                || ((lines > 0) && (ls.numLines >= lines))) {
+            break;
+        }
+        n = MAX(n - step, 0);
+    }
+    *startRef = cand;
+    if (bytes > 0) {
+        *skipRef = MAX(ls.numBytes - bytes, 0);
+    }
+    else if (ls.numLines > lines) {
+        ls.skipLines = ls.numLines - lines;
+        ls.numBytes = 0;
+        if (read_log_stream(name, fd, cand, e, skip_log_stream, &ls) < 0) {
+            snprintf(errbuf, errlen, "unable to read logfile");
+            goto end;
+        }
+        *skipRef = ls.skipBytes;
+    }
+    rc = 0;
+
+end:
+    if ((idxfd >= 0) && (close(idxfd) < 0)) {
+        log_msg(LOG_WARNING, "Unable to close \"%s\": %s",
+            idxname, strerror(errno));
+    }
+    if (close(fd) < 0) {
+        log_msg(LOG_WARNING, "Unable to close logfile \"%s\": %s",
+            name, strerror(errno));
+    }
+    return(rc);
+}
+
+
+int write_log_range(const char *name, off_t start, off_t end, off_t skip,
+    int sd, int enableCompress)
+{
+/*  Writes the range of the logfile (name) from offset (start) up to
+ *    offset (end) -- or to the end of the file if (end) is -1 -- to (sd),
+ *    discarding the first (skip) bytes.
+ *  Since a compressed logfile is only indexed at gz frame boundaries,
+ *    a range starting with a gzip member is decompressed.  Otherwise,
+ *    the range is copied via sendfile() (if available) without passing
+ *    through user-space.
+ *  If (enableCompress) is set, the range is sent to the client as a zlib
+ *    stream instead (which precludes sendfile()).
+ *  Since (sd) is a blocking socket, the transfer is paced by the client;
+ *    its send timeout bounds how long a stalled client is waited upon.
+ *  Returns 0 on success, or -1 on error.
+ */
+    int fd;
+    log_stream_t ls;
+    int rc = -1;
+#if HAVE_SYS_SENDFILE_H
+    off_t pos;
+    size_t len;
+    ssize_t n;
+#endif /* HAVE_SYS_SENDFILE_H */
+#if WITH_ZLIB
+    z_stream z;
+#endif /* WITH_ZLIB */
+
+    assert(name != NULL);
+    assert(sd >= 0);
+
+    if ((fd = open(name, O_RDONLY)) < 0) {
+        log_msg(LOG_WARNING, "Unable to open logfile \"%s\": %s",
+            name, strerror(errno));
+        return(-1);
+    }
+    memset(&ls, 0, sizeof(ls));
+    ls.sd = sd;
+    ls.skipBytes = skip;
+
+#if WITH_ZLIB
+    memset(&z, 0, sizeof(z));
+    if (enableCompress) {
+        if (deflateInit2(&z, CLIENT_ZIP_LEVEL, Z_DEFLATED,
+          CONMAN_ZIP_WINDOW_BITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            log_msg(LOG_WARNING,
+                "Unable to initialize compression of logfile \"%s\"", name);
+            goto end;
+        }
+        ls.zstream = &z;
+    }
+#else  /* !WITH_ZLIB */
+    assert(!enableCompress);
+#endif /* !WITH_ZLIB */
+
+#if HAVE_SYS_SENDFILE_H
+    if (!ls.zstream && !is_log_compressed(fd, start)) {
+        for (pos = start + skip; (end < 0) || (pos < end); ) {
+            len = ((end < 0) || (end - pos > LOG_SENDFILE_MAX))
+                ? LOG_SENDFILE_MAX : (size_t) (end - pos);
+            if ((n = sendfile(sd, fd, &pos, len)) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if ((errno == EINVAL) || (errno == ENOSYS)) {
+                    break;              /* fall back to read_log_stream() */
+                }
+                log_msg(LOG_INFO,
+                    "Unable to write logfile \"%s\" to client: %s",
+                    name, strerror(errno));
+                goto end;
+            }
+            if (n == 0) {
+                rc = 0;
+                goto end;
+            }
+        }
+        if ((end >= 0) && (pos >= end)) {
+            rc = 0;
+            goto end;
+        }
+        start = pos;
+        ls.skipBytes = 0;
+    }
+#endif /* HAVE_SYS_SENDFILE_H */
+
+    rc = read_log_stream(name, fd, start, end, send_log_stream, &ls);
+
+#if WITH_ZLIB
+    if (ls.zstream) {
+        if ((rc == 0) && (send_log_zstream(&ls, NULL, 0, Z_FINISH) < 0)) {
+            rc = -1;
+        }
+        (void) deflateEnd(&z);
+    }
+#endif /* WITH_ZLIB */
+
+#if HAVE_SYS_SENDFILE_H || WITH_ZLIB
+end:
+#endif /* HAVE_SYS_SENDFILE_H || WITH_ZLIB */
+    if (close(fd) < 0) {
+        log_msg(LOG_WARNING, "Unable to close logfile \"%s\": %s",
+            name, strerror(errno));
+    }
+    return(rc);
+}
+
+
+static int write_log_bufs(obj_t *logfile, log_write_t *head)
+{
+/*  Writes out and frees the list of bufs (head) queued for the logfile obj,
+ *    gathering up to LOG_WRITE_IOV_MAX bufs into each writev().
+ *  If logfile compression is enabled, the gathered bufs are compressed
+ *    into the current gz frame and written as a single buf.
+ *  A buf marked for an index checkpoint starts a new writev(), and the
+ *    checkpoint is recorded in the logfile's index before it is written.
+ *  A close buf ends the writes to an fd that the logfile has since closed
+ *    (or rotated away from).
+ *  Bufs following a failed write are discarded, with the error recorded for
+ *    the logfile's i/o thread to shut it down.  The write latency counters
+ *    are updated, and a write exceeding LOG_WRITE_SLOW_MSECS is reported.
+ *  Returns the number of bytes dequeued.
+ *
+ *  XXX: This routine must only be called by a log writer thread
+ *    (without holding logWriteLock).
+ */
+    struct iovec iov[LOG_WRITE_IOV_MAX];
+    log_write_t *w;
+    struct timeval t0, t1;
+    unsigned long msecs;
+    int total = 0;
+    int len;
+    int err = 0;
+    int numBufs;
+    int iovcnt;
+    unsigned char *zbuf = NULL;
+    int n;
+
+    while (head) {
+        if (head->isClose) {
+            w = head;
+            head = w->next;
+            if ((w->fd >= 0)
+                    && (n = close_log_fd(logfile, w->fd)) && !err) {
+                err = n;
+            }
+            free(w->name);
+            free(w);
+            continue;
+        }
+        if (head->mark && !err) {
+            err = write_log_index(logfile, head->fd, head->mark);
+        }
+        for (w = head, iovcnt = 0; w && (iovcnt < LOG_WRITE_IOV_MAX)
+                && ((w == head) || (!w->mark && !w->isClose))
+                && (w->fd == head->fd); w = w->next, iovcnt++) {
+            iov[iovcnt].iov_base = w->data;
+            iov[iovcnt].iov_len = w->len;
+        }
+        numBufs = iovcnt;
+#if WITH_ZLIB
+        if (logfile->aux.logfile.opts.enableCompress
+                || logfile->aux.logfile.zstream) {
+            if (compress_log_iov(logfile, iov, iovcnt, 0, &zbuf, &n) < 0) {
+                err = EIO;
+            }
+            iov[0].iov_base = zbuf;
+            iov[0].iov_len = n;
+            iovcnt = 1;
+        }
+#endif /* WITH_ZLIB */
+        if (gettimeofday(&t0, NULL) < 0) {
+            log_err(errno, "gettimeofday() failed");
+        }
+        if (!err) {
+            err = write_log_iov(head->fd, iov, iovcnt);
+        }
+        if (gettimeofday(&t1, NULL) < 0) {
+            log_err(errno, "gettimeofday() failed");
+        }
+        msecs = ((t1.tv_sec - t0.tv_sec) * 1000)
+            + ((t1.tv_usec - t0.tv_usec) / 1000);
+        if ((long) msecs < 0) {
+            msecs = 0;
+        }
+        /*  Free the bufs that were gathered into the writev().
+         */
+        free(zbuf);
+        zbuf = NULL;
+        len = 0;
+        while (numBufs-- > 0) {
+            w = head;
+            head = w->next;
+            len += w->len;
+            free(w);
+        }
+        total += len;
+
+        if (msecs >= LOG_WRITE_SLOW_MSECS) {
+            log_msg(LOG_NOTICE, "Write of %d bytes to \"%s\" took %lu ms",
+                len, logfile->name, msecs);
+        }
+        x_pthread_mutex_lock(&logWriteLock);
+        logfile->aux.logfile.numWrites++;
+        logfile->aux.logfile.writeMsecs += msecs;
+        if (msecs > logfile->aux.logfile.writeMsecsMax) {
+            logfile->aux.logfile.writeMsecsMax = msecs;
+        }
+        if (err && !logfile->aux.logfile.writeErrno) {
+            logfile->aux.logfile.writeErrno = err;
+        }
+        x_pthread_mutex_unlock(&logWriteLock);
+    }
+    return(total);
+}
+
+
+static int write_log_iov(int fd, struct iovec *iov, int iovcnt)
+{
+/*  Writes all of the data described by the (iovcnt) bufs of (iov) to (fd),
+ *    retrying partial writes; the (iov) array is modified in the process.
+ *  Returns 0 on success, or the errno of the failed write.
+ */
+    int n;
+
+    while (iovcnt > 0) {
+        if ((n = writev(fd, iov, iovcnt)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            else if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                (void) poll(NULL, 0, 10);
+                continue;
+            }
+            return(errno);
+        }
+        /*  Advance past the bufs written by a partial write.
+         */
+        while ((iovcnt > 0) && (n >= (int) iov[0].iov_len)) {
+            n -= iov[0].iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (n > 0) {
+            iov[0].iov_base = (char *) iov[0].iov_base + n;
+            iov[0].iov_len -= n;
+        }
+    }
+    return(0);
+}
+
+
+static int write_log_index(obj_t *logfile, int fd, time_t t)
+{
+/*  Records a checkpoint at time (t) in the logfile obj's sidecar index,
+ *    noting the current size of the logfile (fd) as the byte offset of the
+ *    data following it.  If logfile compression is enabled, the current
+ *    gz frame is completed first so the offset is that of a frame boundary.
+ *  Each record is fixed-length so the index can be binary searched.
+ *  Returns 0 on success, or the errno of a failed write to the logfile.
+ *    Failing to update the index is merely reported.
+ *
+ *  XXX: This routine must only be called by a log writer thread
+ *    (without holding logWriteLock).
+ */
+    char buf[LOG_INDEX_REC_LEN + 1];
+    char idxname[PATH_MAX];
+    struct stat st;
+    struct iovec iov;
+    int flags;
+    int err;
+
+    if ((err = end_log_frame(logfile, fd)) != 0) {
+        return(err);
+    }
+    if (fstat(fd, &st) < 0) {
+        log_msg(LOG_WARNING, "Unable to stat \"%s\": %s",
+            logfile->name, strerror(errno));
+        return(0);
+    }
+    if (logfile->aux.logfile.indexFd < 0) {
+        snprintf(idxname, sizeof(idxname), "%s%s",
+            logfile->name, LOG_INDEX_SUFFIX);
+        flags = O_WRONLY | O_CREAT | O_APPEND;
+        x_pthread_mutex_lock(&logWriteLock);
+        if (logfile->aux.logfile.isIndexNew) {
+            logfile->aux.logfile.isIndexNew = 0;
+            flags |= O_TRUNC;
+        }
+        x_pthread_mutex_unlock(&logWriteLock);
+        if ((logfile->aux.logfile.indexFd =
+          open(idxname, flags, S_IRUSR | S_IWUSR)) < 0) {
+            log_msg(LOG_WARNING, "Unable to open index \"%s\": %s",
+                idxname, strerror(errno));
+            return(0);
+        }
+        set_fd_closed_on_exec(logfile->aux.logfile.indexFd);
+    }
+    snprintf(buf, sizeof(buf), "%012ld %012lld\n",
+        (long) t, (long long) st.st_size);
+    iov.iov_base = buf;
+    iov.iov_len = LOG_INDEX_REC_LEN;
+    if ((err = write_log_iov(logfile->aux.logfile.indexFd, &iov, 1)) != 0) {
+        log_msg(LOG_WARNING, "Unable to write index for \"%s\": %s",
+            logfile->name, strerror(err));
+    }
+    return(0);
+}
+
+
+static int close_log_fd(obj_t *logfile, int fd)
+{
+/*  Closes the logfile (fd) that the logfile obj has handed off once all of
+ *    the data queued for it has been written, first completing its gz frame
+ *    and closing its sidecar index.  The gz stream is released so the next
+ *    fd starts afresh (with the logfile's current options).
+ *  Returns 0 on success, or the errno of a failed write to the logfile.
+ *
+ *  XXX: This routine must only be called by a log writer thread
+ *    (without holding logWriteLock).
+ */
+    int err;
+
+    err = end_log_frame(logfile, fd);
+
+#if WITH_ZLIB
+    if (logfile->aux.logfile.zstream) {
+        (void) deflateEnd(logfile->aux.logfile.zstream);
+        free(logfile->aux.logfile.zstream);
+        logfile->aux.logfile.zstream = NULL;
+    }
+#endif /* WITH_ZLIB */
+
+    if (logfile->aux.logfile.indexFd >= 0) {
+        if (close(logfile->aux.logfile.indexFd) < 0) {
+            log_msg(LOG_WARNING, "Unable to close index for \"%s\": %s",
+                logfile->name, strerror(errno));
+        }
+        logfile->aux.logfile.indexFd = -1;
+    }
+    if (close(fd) < 0) {
+        log_msg(LOG_WARNING, "Unable to close logfile \"%s\": %s",
+            logfile->name, strerror(errno));
+    }
+    return(err);
+}
+
+
+static int end_log_frame(obj_t *logfile, int fd)
+{
+/*  Completes the logfile obj's current gz frame (if it holds any data),
+ *    writing the remainder of the frame out to the logfile (fd).
+ *  Returns 0 on success, or the errno of a failed write to the logfile.
+ *
+ *  XXX: This routine must only be called by a log writer thread
+ *    (without holding logWriteLock).
+ */
+#if WITH_ZLIB
+    unsigned char *dst;
+    int dstLen;
+    struct iovec iov;
+    int err;
+
+    if (!logfile->aux.logfile.zstream || !logfile->aux.logfile.frameBytes) {
+        return(0);
+    }
+    if (compress_log_iov(logfile, NULL, 0, 1, &dst, &dstLen) < 0) {
+        return(EIO);
+    }
+    iov.iov_base = dst;
+    iov.iov_len = dstLen;
+    err = write_log_iov(fd, &iov, 1);
+    free(dst);
+    return(err);
+#else /* !WITH_ZLIB */
+    (void) logfile;
+    (void) fd;
+    return(0);
+#endif /* !WITH_ZLIB */
+}
+
+
+static int read_log_index(int fd, off_t i, time_t *tRef, off_t *offsetRef)
+{
+/*  Reads the (i)th checkpoint record from the sidecar index (fd).
+ *  Returns 0 on success with the checkpoint's time and byte offset in
+ *    (tRef) and (offsetRef), or -1 if the record is invalid.
+ */
+    char buf[LOG_INDEX_REC_LEN + 1];
+    long t;
+    long long offset;
+
+    if (pread(fd, buf, LOG_INDEX_REC_LEN, i * LOG_INDEX_REC_LEN)
+            != LOG_INDEX_REC_LEN) {
+        return(-1);
+    }
+    buf[LOG_INDEX_REC_LEN] = '\0';
+    if ((buf[LOG_INDEX_REC_LEN - 1] != '\n')
+            || (sscanf(buf, "%ld %lld", &t, &offset) != 2) || (offset < 0)) {
+        return(-1);
+    }
+    *tRef = (time_t) t;
+    *offsetRef = (off_t) offset;
+    return(0);
+}
+
+
+static int rotate_logfile_obj(obj_t *logfile, time_t now)
+{
+/*  Rotates the logfile obj's current file out of the way and opens a new
+ *    one in its place.  Rather than waiting for the bufs queued for the old
+ *    fd to be written, a close buf is queued behind them for the writers.
+ *  Rotated logfiles are renamed with the suffixes ".1" through ".N" (from
+ *    newest to oldest) along with their sidecar indexes, and the oldest
+ *    beyond the rotatecount is removed.  With rotatecompress, the logfile
+ *    is instead renamed with the suffix ".0" for the log rotation thread to
+ *    gzip into ".1.gz"; this is deferred while a previous ".0" is pending.
+ *  Returns 0 on success, or -1 on error (in which case the logfile obj
+ *    continues writing to its current file).
+ *
+ *  XXX: This routine must only be called by the logfile obj's i/o thread.
+ */
+    logopt_t *opts;
+    char src[PATH_MAX];
+    char dst[PATH_MAX];
+    int isZip;
+    int k;
+    int fd;
+
+    opts = &logfile->aux.logfile.opts;
+    isZip = 0;
+#if WITH_ZLIB
+    isZip = opts->enableRotateZip && !opts->enableCompress;
+#endif /* WITH_ZLIB */
+
+    if (!is_log_rotate_name_valid(logfile->name)) {
+        return(-1);
+    }
+    if (isZip) {
+        snprintf(dst, sizeof(dst), "%s.0", logfile->name);
+        if (access(dst, F_OK) == 0) {
+#if WITH_ZLIB
+            /*  Requeue the job in case it was lost to a daemon restart.
+             */
+            queue_log_rotation(logfile->name, opts->rotateCount);
+#endif /* WITH_ZLIB */
+            return(-1);
+        }
+    }
+    else {
+        snprintf(src, sizeof(src), "%s.%d", logfile->name, opts->rotateCount);
+        remove_log_files(src);
+        for (k = opts->rotateCount - 1; k > 0; k--) {
+            snprintf(src, sizeof(src), "%s.%d", logfile->name, k);
+            snprintf(dst, sizeof(dst), "%s.%d", logfile->name, k + 1);
+            (void) rename_log_files(src, dst);
+        }
+        snprintf(dst, sizeof(dst), "%s.1", logfile->name);
+    }
+    if (rename_log_files(logfile->name, dst) < 0) {
+        log_msg(LOG_WARNING, "Unable to rotate logfile \"%s\": %s",
+            logfile->name, strerror(errno));
+        return(-1);
+    }
+    if ((fd = open(logfile->name, O_WRONLY | O_CREAT | O_APPEND | O_NONBLOCK,
+      S_IRUSR | S_IWUSR)) < 0) {
+        log_msg(LOG_WARNING, "Unable to open logfile \"%s\": %s",
+            logfile->name, strerror(errno));
+        (void) rename_log_files(dst, logfile->name);
+        return(-1);
+    }
+    if (opts->enableLock && (get_write_lock(fd) < 0)) {
+        log_msg(LOG_WARNING, "Unable to lock \"%s\"", logfile->name);
+        (void) close(fd);
+        (void) rename_log_files(dst, logfile->name);
+        return(-1);
+    }
+    set_fd_nonblocking(fd);
+    set_fd_closed_on_exec(fd);
+
+    tpoll_clear(logfile->tp, logfile->fd, POLLOUT);
+
+    /*  The index of the new logfile will be created afresh at its first
+     *    checkpoint.
+     */
+    x_pthread_mutex_lock(&logWriteLock);
+    enqueue_log_close(logfile, NULL);
+    logfile->fd = fd;
+    logfile->aux.logfile.isIndexNew = 1;
+    logfile->aux.logfile.rotateBytes = 0;
+    x_pthread_mutex_unlock(&logWriteLock);
+
+    logfile->aux.logfile.rotateTime = now;
+    logfile->aux.logfile.rotateRetry = 0;
+
+#if WITH_ZLIB
+    if (isZip) {
+        queue_log_rotation(logfile->name, opts->rotateCount);
+    }
+#endif /* WITH_ZLIB */
+
+    log_msg(LOG_INFO, "Rotated logfile \"%s\"", logfile->name);
+    write_log_open_msg(logfile);
+    return(0);
+}
+
+
+static int rename_log_files(const char *src, const char *dst)
+{
+/*  Renames the logfile (src) to (dst) along with its sidecar index,
+ *    removing any stale index for (dst) if (src) has none.
+ *  Returns 0 on success, or -1 if the logfile could not be renamed.
+ */
+    char srcIdx[PATH_MAX];
+    char dstIdx[PATH_MAX];
+
+    if (rename(src, dst) < 0) {
+        return(-1);
+    }
+    if ((snprintf(srcIdx, sizeof(srcIdx), "%s%s", src, LOG_INDEX_SUFFIX)
+            >= (int) sizeof(srcIdx))
+      || (snprintf(dstIdx, sizeof(dstIdx), "%s%s", dst, LOG_INDEX_SUFFIX)
+            >= (int) sizeof(dstIdx))) {
+        return(0);
+    }
+    if ((rename(srcIdx, dstIdx) < 0) && (errno == ENOENT)) {
+        (void) unlink(dstIdx);
+    }
+    return(0);
+}
+
+
+static void remove_log_files(const char *name)
+{
+/*  Removes the logfile (name) along with its sidecar index.
+ */
+    char idx[PATH_MAX];
+
+    (void) unlink(name);
+    if (snprintf(idx, sizeof(idx), "%s%s", name, LOG_INDEX_SUFFIX)
+            < (int) sizeof(idx)) {
+        (void) unlink(idx);
+    }
+    return;
+}
+
+
+static int is_log_rotate_name_valid(const char *name)
+{
+/*  Checks whether the logfile (name) leaves room for the longest name
+ *    derived from it by rotation (ie, ".NN.gz" plus the index suffix).
+ *  Returns true if so; o/w, logs a warning and returns false.
+ */
+    if (strlen(name) + sizeof(".NN.gz" LOG_INDEX_SUFFIX) > PATH_MAX) {
+        log_msg(LOG_WARNING, "Unable to rotate logfile \"%s\": %s",
+            name, strerror(ENAMETOOLONG));
+        return(0);
+    }
+    return(1);
+}
+
+
+static int is_log_compressed(int fd, off_t offset)
+{
+/*  Returns true if the logfile (fd) has a gzip member starting at (offset).
+ */
+#if WITH_ZLIB
+    unsigned char buf[2];
+
+    return((pread(fd, buf, 2, offset) == 2)
+        && (buf[0] == 0x1f) && (buf[1] == 0x8b));
+#else /* !WITH_ZLIB */
+    return(0);
+#endif /* !WITH_ZLIB */
+}
+
+
+static int read_log_stream(const char *name, int fd, off_t start, off_t end,
+    log_stream_f f, log_stream_t *ls)
+{
+/*  Reads the range of the logfile (name) open on (fd) from offset (start)
+ *    up to offset (end) -- or to the end of the file if (end) is -1 --
+ *    passing the data to the callback (f) along with the state (ls).
+ *  A range starting with a gzip member is decompressed.
+ *  Returns 0 on success, or -1 on error.
+ */
+    unsigned char buf[MAX_BUF_SIZE];
+    off_t pos;
+    int len;
+    int n;
+    int rc = -1;
+#if WITH_ZLIB
+    unsigned char out[MAX_BUF_SIZE];
+    z_stream z;
+    int isCompressed = 0;
+    int zrc;
+
+    if (is_log_compressed(fd, start)) {
+        memset(&z, 0, sizeof(z));
+        if (inflateInit2(&z, 15 + 16) != Z_OK) {
+            log_msg(LOG_WARNING, "Unable to initialize decompression");
+            return(-1);
+        }
+        isCompressed = 1;
+    }
+#endif /* WITH_ZLIB */
+
+    for (pos = start; (end < 0) || (pos < end); pos += n) {
+        len = sizeof(buf);
+        if ((end >= 0) && (end - pos < len)) {
+            len = end - pos;
+        }
+        if ((n = pread(fd, buf, len, pos)) < 0) {
+            if (errno == EINTR) {
+                n = 0;
+                continue;
+            }
+            log_msg(LOG_WARNING, "Unable to read logfile \"%s\": %s",
+                name, strerror(errno));
+            goto end;
+        }
+        if (n == 0) {
+            break;
+        }
+#if WITH_ZLIB
+        if (isCompressed) {
+            /*
+             *  Concatenated gz frames form a single gzip file, so the
+             *    stream is reset at the end of each frame.
+             */
+            z.next_in = buf;
+            z.avail_in = n;
+            do {
+                z.next_out = out;
+                z.avail_out = sizeof(out);
+                zrc = inflate(&z, Z_NO_FLUSH);
+                if (zrc == Z_STREAM_END) {
+                    zrc = inflateReset(&z);
+                }
+                if ((zrc != Z_OK) && (zrc != Z_BUF_ERROR)) {
+                    log_msg(LOG_WARNING,
+                        "Unable to decompress logfile \"%s\": %s",
+                        name, (z.msg ? z.msg : "inflate failed"));
+                    goto end;
+                }
+                len = sizeof(out) - z.avail_out;
+                if ((len > 0) && ((zrc = f(ls, out, len)) != 0)) {
+                    rc = (zrc < 0) ? -1 : 0;
+                    goto end;
+                }
+            } while ((z.avail_in > 0) || (z.avail_out == 0));
+            continue;
+        }
+#endif /* WITH_ZLIB */
+        if ((len = f(ls, buf, n)) != 0) {
+            rc = (len < 0) ? -1 : 0;
+            goto end;
+        }
+    }
+    rc = 0;
+
+end:
+#if WITH_ZLIB
+    if (isCompressed) {
+        (void) inflateEnd(&z);
+    }
+#endif /* WITH_ZLIB */
+    return(rc);
+}
+
+
+static int count_log_stream(log_stream_t *ls, const unsigned char *p, int n)
+{
+/*  Counts the bytes and newlines of the logfile data (p) of length (n).
+ */
+    const unsigned char *q;
+    const unsigned char * const last = p + n;
+
+    ls->numBytes += n;
+    ls->lastByte = p[n - 1];
+    while ((q = memchr(p, '\n', last - p))) {
+        ls->numLines++;
+        p = q + 1;
+    }
+    return(0);
+}
+
+
+static int skip_log_stream(log_stream_t *ls, const unsigned char *p, int n)
+{
+/*  Finds the offset (skipBytes) of the data following the (skipLines)th
+ *    newline of the logfile data (p) of length (n).
+ *  Returns >0 once it has been found.
+ */
+    const unsigned char * const first = p;
+    const unsigned char * const last = p + n;
+    const unsigned char *q;
+
+    while ((q = memchr(p, '\n', last - p))) {
+        p = q + 1;
+        if (--ls->skipLines == 0) {
+            ls->skipBytes = ls->numBytes + (p - first);
+            return(1);
+        }
+    }
+    ls->numBytes += n;
+    return(0);
+}
+
+
+static int send_log_stream(log_stream_t *ls, const unsigned char *p, int n)
+{
+/*  Writes the logfile data (p) of length (n) to the client socket (sd)
+ *    once the leading (skipBytes) have been discarded.
+ *  Returns <0 if the write fails.
+ */
+    if (ls->skipBytes >= n) {
+        ls->skipBytes -= n;
+        return(0);
+    }
+    p += ls->skipBytes;
+    n -= ls->skipBytes;
+    ls->skipBytes = 0;
+
+#if WITH_ZLIB
+    if (ls->zstream) {
+        return(send_log_zstream(ls, p, n, Z_NO_FLUSH));
+    }
+#endif /* WITH_ZLIB */
+    if (write_n(ls->sd, (void *) p, n) < 0) {
+        log_msg(LOG_INFO, "Unable to write console log to client: %s",
+            strerror(errno));
+        return(-1);
+    }
+    return(0);
+}
+
+
+#if WITH_ZLIB
+static int send_log_zstream(log_stream_t *ls, const unsigned char *p, int n,
+    int flush)
+{
+/*  Compresses the logfile data (p) of length (n) into the zlib stream
+ *    being sent to the client socket (sd), writing out whatever output
+ *    is produced.  A (flush) of Z_FINISH terminates the stream.
+ *  Returns <0 if the compression or write fails.
+ */
+    z_stream *z = ls->zstream;
+    unsigned char buf[MAX_BUF_SIZE];
+    int len;
+    int rc;
+
+    z->next_in = (unsigned char *) p;
+    z->avail_in = n;
+    do {
+        z->next_out = buf;
+        z->avail_out = sizeof(buf);
+        rc = deflate(z, flush);
+        if ((rc != Z_OK) && (rc != Z_STREAM_END) && (rc != Z_BUF_ERROR)) {
+            log_msg(LOG_INFO, "Unable to compress console log: %s",
+                (z->msg ? z->msg : "deflate failed"));
+            return(-1);
+        }
+        len = sizeof(buf) - z->avail_out;
+        if ((len > 0) && (write_n(ls->sd, buf, len) < 0)) {
+            log_msg(LOG_INFO, "Unable to write console log to client: %s",
+                strerror(errno));
+            return(-1);
+        }
+    } while (z->avail_out == 0);
+
+    return(0);
+}
+
+
+static int compress_log_iov(obj_t *logfile, const struct iovec *iov,
+    int iovcnt, int isFinal, unsigned char **dstRef, int *dstLenRef)
+{
+/*  Compresses the data described by the (iovcnt) bufs of (iov) into the
+ *    logfile obj's current gz frame, setting (dstRef) to a buffer holding
+ *    the compressed output of length (dstLenRef).
+ *  Each frame is a complete gzip member that can be decoded independently;
+ *    concatenated frames form a valid gzip file.  The frame is completed
+ *    once it holds LOG_COMPRESS_FRAME_SIZE bytes of uncompressed data or is
+ *    LOG_COMPRESS_FRAME_SECS old, or if (isFinal) is set.  Otherwise, the
+ *    stream is sync-flushed so everything written so far can be recovered
+ *    from the file should the daemon crash.
+ *  The caller is responsible for freeing the output buffer (dstRef).
+ *  Returns 0 on success, or -1 on error.
+ */
+    z_stream *z;
+    unsigned char *dst;
+    int dstSize;
+    int len = 0;
+    int k;
+    int flush;
+    int rc;
+
+    if (!(z = logfile->aux.logfile.zstream)) {
+        if (isFinal) {
+            *dstRef = NULL;
+            *dstLenRef = 0;
+            return(0);
+        }
+        if (!(z = malloc(sizeof(z_stream)))) {
+            out_of_memory();
+        }
+        memset(z, 0, sizeof(*z));
+        /*  A windowBits of 15+16 selects the gzip wrapper.
+         */
+        if (deflateInit2(z, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+          15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            log_msg(LOG_WARNING, "Unable to initialize compression for [%s]",
+                logfile->name);
+            free(z);
+            *dstRef = NULL;
+            *dstLenRef = 0;
+            return(-1);
+        }
+        logfile->aux.logfile.zstream = z;
+        logfile->aux.logfile.frameBytes = 0;
+        logfile->aux.logfile.frameTime = time(NULL);
+    }
+    for (k = 0; k < iovcnt; k++) {
+        len += iov[k].iov_len;
+    }
+    logfile->aux.logfile.frameBytes += len;
+    if (isFinal
+      || (logfile->aux.logfile.frameBytes >= LOG_COMPRESS_FRAME_SIZE)
+      || (time(NULL) - logfile->aux.logfile.frameTime
+          >= LOG_COMPRESS_FRAME_SECS)) {
+        flush = Z_FINISH;
+    }
+    else {
+        flush = Z_SYNC_FLUSH;
+    }
+    dstSize = deflateBound(z, len) + 64;
+    if (!(dst = malloc(dstSize))) {
+        out_of_memory();
+    }
+    z->next_out = dst;
+    z->avail_out = dstSize;
+
+    for (k = 0; k <= iovcnt; k++) {
+        if (k < iovcnt) {
+            z->next_in = iov[k].iov_base;
+            z->avail_in = iov[k].iov_len;
+            rc = deflate(z, Z_NO_FLUSH);
+        }
+        else {
+            z->next_in = NULL;
+            z->avail_in = 0;
+            rc = deflate(z, flush);
+        }
+        if (((rc != Z_OK) && (rc != Z_STREAM_END) && (rc != Z_BUF_ERROR))
+                || (z->avail_in > 0)) {
+            log_msg(LOG_WARNING, "Unable to compress data for [%s]: %s",
+                logfile->name, (z->msg ? z->msg : "deflate failed"));
+            free(dst);
+            *dstRef = NULL;
+            *dstLenRef = 0;
+            return(-1);
+        }
+    }
+    *dstRef = dst;
+    *dstLenRef = dstSize - z->avail_out;
+
+    if (flush == Z_FINISH) {
+        (void) deflateReset(z);
+        logfile->aux.logfile.frameBytes = 0;
+        logfile->aux.logfile.frameTime = time(NULL);
+    }
+    return(0);
+}
+
+
+static void queue_log_rotation(const char *name, int count)
+{
+/*  Queues a job for the log rotation thread to gzip the logfile (name)
+ *    rotated to ".0", keeping (count) rotated logfiles.
+ *  Nothing is queued if a job for this logfile is already pending.
+ */
+    log_rotation_t *r;
+
+    x_pthread_mutex_lock(&logRotateLock);
+    for (r = logRotateHead; r; r = r->next) {
+        if (!strcmp(r->name, name)) {
+            break;
+        }
+    }
+    if (!r) {
+        if (!(r = malloc(sizeof(log_rotation_t)))) {
+            out_of_memory();
+        }
+        r->next = NULL;
+        r->name = create_string(name);
+        r->count = count;
+        if (logRotateTail) {
+            logRotateTail->next = r;
+        }
+        else {
+            logRotateHead = r;
+        }
+        logRotateTail = r;
+        if ((errno = pthread_cond_signal(&logRotateCond)) != 0) {
+            log_err(errno, "pthread_cond_signal() failed");
+        }
+    }
+    x_pthread_mutex_unlock(&logRotateLock);
+    return;
+}
+
+
+static void compress_rotated_log(const char *name, int count)
+{
+/*  Shifts the gzip'd logfiles rotated from (name), and then gzips the
+ *    logfile rotated to ".0" into ".1.gz".  The sidecar index of the ".0"
+ *    logfile is removed since its offsets do not apply to the gzip'd data.
+ *  If the logfile cannot be gzip'd, it is instead renamed to ".1".
+ *
+ *  XXX: This routine must only be called by the log rotation thread.
+ */
+    char src[PATH_MAX];
+    char dst[PATH_MAX];
+    int k;
+
+    if (!is_log_rotate_name_valid(name)) {
+        return;
+    }
+    snprintf(dst, sizeof(dst), "%s.%d.gz", name, count);
+    (void) unlink(dst);
+    for (k = count - 1; k > 0; k--) {
+        snprintf(src, sizeof(src), "%s.%d.gz", name, k);
+        snprintf(dst, sizeof(dst), "%s.%d.gz", name, k + 1);
+        (void) rename(src, dst);
+    }
+    snprintf(src, sizeof(src), "%s.0", name);
+    snprintf(dst, sizeof(dst), "%s.1.gz", name);
+
+    if (gzip_log_file(src, dst) < 0) {
+        log_msg(LOG_WARNING, "Unable to compress rotated logfile \"%s\": %s",
+            src, strerror(errno));
+        (void) unlink(dst);
+        snprintf(dst, sizeof(dst), "%s.1", name);
+        (void) rename_log_files(src, dst);
+        return;
+    }
+    remove_log_files(src);
+    DPRINTF((5, "Compressed rotated logfile \"%s\".\n", dst));
+    return;
+}
+
+
+static int gzip_log_file(const char *src, const char *dst)
+{
+/*  Gzips the file (src) into the new file (dst).
+ *  Returns 0 on success, or -1 on error (with errno set).
+ */
+    unsigned char buf[MAX_BUF_SIZE];
+    int fdSrc;
+    int fdDst;
+    gzFile gz;
+    int n;
+    int err = 0;
+
+    if ((fdSrc = open(src, O_RDONLY)) < 0) {
+        return(-1);
+    }
+    if ((fdDst = open(dst, O_WRONLY | O_CREAT | O_TRUNC,
+      S_IRUSR | S_IWUSR)) < 0) {
+        err = errno;
+        (void) close(fdSrc);
+        errno = err;
+        return(-1);
+    }
+    if (!(gz = gzdopen(fdDst, "wb"))) {
+        (void) close(fdDst);
+        (void) close(fdSrc);
+        errno = ENOMEM;
+        return(-1);
+    }
+    for (;;) {
+        if ((n = read(fdSrc, buf, sizeof(buf))) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            err = errno;
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        if (gzwrite(gz, buf, n) != n) {
+            err = EIO;
+            break;
+        }
+    }
+    if ((gzclose(gz) != Z_OK) && !err) {
+        err = EIO;
+    }
+    (void) close(fdSrc);
+    if (err) {
+        errno = err;
+        return(-1);
+    }
+    return(0);
+}
+#endif /* WITH_ZLIB */
+
+
+static int scan_log_data(const unsigned char *src, int len, int enableSanitize)
+{
+/*  Scans the buffer (src) of length (len) for the first byte requiring
+ *    processing by write_log_data(): a CR, LF, or NUL; or, if sanitized logs
+ *    are enabled (enableSanitize), any byte that is not printable 7-bit ASCII.
+ *  Returns the number of leading bytes that can be copied as-is.
+ */
+    const unsigned char *p = src;
+    const unsigned char * const pLast = src + len;
+#if defined(__SSE2__)
+    __m128i v;
+    unsigned int mask;
+
+    while (pLast - p >= 16) {
+        v = _mm_loadu_si128((const __m128i *) p);
+        if (enableSanitize) {
+            /*  A signed compare catches both ctrl-chars and high-bit bytes.
+             */
+            mask = _mm_movemask_epi8(_mm_or_si128(
+                _mm_cmplt_epi8(v, _mm_set1_epi8(0x20)),
+                _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7F))));
+        }
+        else {
+            mask = _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(
+                _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')),
+                _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))),
+                _mm_cmpeq_epi8(v, _mm_setzero_si128())));
+        }
+        if (mask != 0) {
+            return((p - src) + __builtin_ctz(mask));
+        }
+        p += 16;
+    }
+#endif /* __SSE2__ */
+
+    if (enableSanitize) {
+        while ((p < pLast) && (*p >= 0x20) && (*p < 0x7F)) {
+            p++;
+        }
+    }
+    else {
+        while ((p < pLast) && (*p != '\r') && (*p != '\n') && (*p != '\0')) {
+            p++;
+        }
+    }
+    return(p - src);
+}
@@ -0,0 +1,465 @@
+/*****************************************************************************
+ *  Written by Chris Dunlap <cdunlap@llnl.gov>.
+ *  Copyright (C) 2007-2016 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  UCRL-CODE-2002-009.
+ *
+ *  This file is part of ConMan: The Console Manager.
+ *  For details, see <https://dun.github.io/conman/>.
+ *
+ *  ConMan is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  ConMan is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with ConMan.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <assert.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "common.h"
+#include "list.h"
+#include "log.h"
+#include "server.h"
+#include "util-file.h"
+#include "util-str.h"
+#include "util.h"
+#include "wrapper.h"
+
+
+/*  The performance counters of the console objs (and their logfiles) and
+ *    of the i/o threads (along with the test bench totals while benchmark
+ *    test consoles are open) are exported in the Prometheus text format over
+ *    HTTP on the SERVER METRICSPORT.  A scrape is handled by a
+ *    bulk worker thread, reading the counters without taking any locks.
+ */
+
+#define METRICS_CONTENT_TYPE    "text/plain; version=0.0.4"
+#define METRICS_PATH            "/metrics"
+
+typedef struct metrics_buf {
+    char            *data;              /* response body being formatted     */
+    int              len;               /* num bytes of data in use          */
+    int              size;              /* num bytes of data allocated       */
+} metrics_buf_t;
+
+typedef struct metric_def {
+    const char      *name;              /* metric name                       */
+    const char      *type;              /* metric type (counter or gauge)    */
+    const char      *help;              /* metric help string                */
+    size_t           offset;            /* offset of counter in obj_stats_t  */
+} metric_def_t;
+
+static const metric_def_t console_metrics[] = {
+    { "conman_console_read_bytes_total", "counter",
+      "Bytes read from the console.",
+      offsetof(obj_stats_t, bytesRead) },
+    { "conman_console_written_bytes_total", "counter",
+      "Bytes written to the console.",
+      offsetof(obj_stats_t, bytesWritten) },
+    { "conman_console_overwritten_bytes_total", "counter",
+      "Bytes of console input overwritten before being written.",
+      offsetof(obj_stats_t, bytesOverwritten) },
+    { "conman_console_writes_total", "counter",
+      "Write attempts on the console.",
+      offsetof(obj_stats_t, numWrites) },
+    { "conman_console_write_blocks_total", "counter",
+      "Writes to the console that would have blocked.",
+      offsetof(obj_stats_t, numWriteBlocks) },
+    { NULL, NULL, NULL, 0 }
+};
+
+static const metric_def_t logfile_metrics[] = {
+    { "conman_logfile_written_bytes_total", "counter",
+      "Bytes written to the console logfile.",
+      offsetof(obj_stats_t, bytesWritten) },
+    { "conman_logfile_overwritten_bytes_total", "counter",
+      "Bytes of console output overwritten before being logged.",
+      offsetof(obj_stats_t, bytesOverwritten) },
+    { "conman_logfile_writes_total", "counter",
+      "Write attempts on the console logfile.",
+      offsetof(obj_stats_t, numWrites) },
+    { "conman_logfile_write_blocks_total", "counter",
+      "Writes to the console logfile deferred by a full write queue.",
+      offsetof(obj_stats_t, numWriteBlocks) },
+    { NULL, NULL, NULL, 0 }
+};
+
+static int parse_metrics_req(const char *line, char *errbuf, int errlen);
+static void send_metrics_rsp(int sd, const char *status,
+    metrics_buf_t *mb);
+static void format_console_metrics(metrics_buf_t *mb, List consoles);
+static void format_io_metrics(metrics_buf_t *mb, server_conf_t *conf);
+static void format_bench_metrics(metrics_buf_t *mb);
+static void append_metric_def(metrics_buf_t *mb,
+    const char *name, const char *type, const char *help);
+static void append_console_label(metrics_buf_t *mb, const char *name,
+    obj_t *console);
+static void append_usecs(metrics_buf_t *mb, unsigned long usecs);
+static void append_metrics(metrics_buf_t *mb, const char *fmt, ...);
+
+
+void process_metrics(server_conf_t *conf, int sd, const char *httpReq)
+{
+/*  Processes the HTTP request line (httpReq) received on the metrics
+ *    connection (sd), the headers of which have already been discarded.
+ *  This is called by one of the bulk worker threads.  The socket is made
+ *    blocking, but its send timeout bounds how long a scraper can occupy
+ *    the worker.  The connection is closed once finished.
+ */
+    metrics_buf_t mb;
+    char buf[MAX_LINE];
+    List pats;
+    List consoles;
+
+    assert(conf != NULL);
+    assert(sd >= 0);
+    assert(httpReq != NULL);
+
+    DPRINTF((5, "Processing new metrics request.\n"));
+
+    mb.data = NULL;
+    mb.len = mb.size = 0;
+    set_fd_blocking(sd);
+
+    if (parse_metrics_req(httpReq, buf, sizeof(buf)) < 0) {
+        append_metrics(&mb, "%s\n", buf);
+        send_metrics_rsp(sd, buf, &mb);
+    }
+    else {
+        pats = list_create(NULL);
+        list_append(pats, "*");
+        consoles = list_create(NULL);
+        (void) match_console_objs(conf, pats, 0, consoles, NULL, 0);
+        format_console_metrics(&mb, consoles);
+        format_io_metrics(&mb, conf);
+        format_bench_metrics(&mb);
+        list_destroy(consoles);
+        list_destroy(pats);
+        send_metrics_rsp(sd, "200 OK", &mb);
+    }
+    free(mb.data);
+
+    if (close(sd) < 0) {
+        log_msg(LOG_WARNING, "Unable to close metrics connection: %s",
+            strerror(errno));
+    }
+    return;
+}
+
+
+static int parse_metrics_req(const char *line, char *errbuf, int errlen)
+{
+/*  Parses the HTTP request line (line).
+ *  Returns 0 if it is a GET of the metrics path; o/w, returns -1
+ *    (writing the HTTP status for the error into errbuf).
+ */
+    char method[16];
+    char path[MAX_LINE];
+
+    if (sscanf(line, "%15s %1023s", method, path) != 2) {
+        snprintf(errbuf, errlen, "400 Bad Request");
+        return(-1);
+    }
+    if (strcmp(method, "GET") != 0) {
+        snprintf(errbuf, errlen, "405 Method Not Allowed");
+        return(-1);
+    }
+    if ((strcmp(path, METRICS_PATH) != 0) && (strcmp(path, "/") != 0)) {
+        snprintf(errbuf, errlen, "404 Not Found");
+        return(-1);
+    }
+    return(0);
+}
+
+
+static void send_metrics_rsp(int sd, const char *status, metrics_buf_t *mb)
+{
+/*  Sends the HTTP response with the (status) line and the body in (mb).
+ */
+    char hdr[MAX_LINE];
+    int n;
+
+    n = snprintf(hdr, sizeof(hdr),
+        "HTTP/1.0 %s\r\nContent-Type: %s\r\nContent-Length: %d\r\n"
+        "Connection: close\r\n\r\n", status, METRICS_CONTENT_TYPE, mb->len);
+    if ((write_n(sd, hdr, n) < 0)
+            || ((mb->len > 0) && (write_n(sd, mb->data, mb->len) < 0))) {
+        log_msg(LOG_INFO, "Unable to send metrics response: %s",
+            strerror(errno));
+    }
+    return;
+}
+
+
+static void format_console_metrics(metrics_buf_t *mb, List consoles)
+{
+/*  Formats the counters of each console obj in the (consoles) list along
+ *    with those of its logfile obj (if any).
+ *  Each metric is written for every console before the next one is begun
+ *    since the samples of a metric must be grouped together.
+ */
+    ListIterator i;
+    obj_t *console;
+    obj_t *logfile;
+    const metric_def_t *m;
+    unsigned long val;
+    time_t tDown;
+    time_t now;
+
+    i = list_iterator_create(consoles);
+
+    append_metric_def(mb, "conman_console_up", "gauge",
+        "Whether the console connection is established.");
+    while ((console = list_next(i))) {
+        append_console_label(mb, "conman_console_up", console);
+        tDown = x_counter_load(&console->stats.tDown);
+        append_metrics(mb, " %d\n", (tDown == 0) ? 1 : 0);
+    }
+    append_metric_def(mb, "conman_console_reconnects_total", "counter",
+        "Times the console connection was re-established.");
+    list_iterator_reset(i);
+    while ((console = list_next(i))) {
+        append_console_label(mb, "conman_console_reconnects_total", console);
+        val = x_counter_load(&console->stats.numConnects);
+        append_metrics(mb, " %lu\n", (val > 0) ? val - 1 : 0);
+    }
+    append_metric_def(mb, "conman_console_down_seconds_total", "counter",
+        "Seconds the console connection has not been established.");
+    now = time(NULL);
+    list_iterator_reset(i);
+    while ((console = list_next(i))) {
+        append_console_label(mb, "conman_console_down_seconds_total",
+            console);
+        val = x_counter_load(&console->stats.secsDown);
+        tDown = x_counter_load(&console->stats.tDown);
+        if ((tDown > 0) && (now > tDown)) {
+            val += now - tDown;
+        }
+        append_metrics(mb, " %lu\n", val);
+    }
+    for (m = console_metrics; m->name; m++) {
+        append_metric_def(mb, m->name, m->type, m->help);
+        list_iterator_reset(i);
+        while ((console = list_next(i))) {
+            append_console_label(mb, m->name, console);
+            val = x_counter_load((unsigned long *)
+                ((char *) &console->stats + m->offset));
+            append_metrics(mb, " %lu\n", val);
+        }
+    }
+    for (m = logfile_metrics; m->name; m++) {
+        append_metric_def(mb, m->name, m->type, m->help);
+        list_iterator_reset(i);
+        while ((console = list_next(i))) {
+            if (!(logfile = get_console_logfile_obj(console))) {
+                continue;
+            }
+            append_console_label(mb, m->name, console);
+            val = x_counter_load((unsigned long *)
+                ((char *) &logfile->stats + m->offset));
+            append_metrics(mb, " %lu\n", val);
+        }
+    }
+    list_iterator_destroy(i);
+    return;
+}
+
+
+static void format_io_metrics(metrics_buf_t *mb, server_conf_t *conf)
+{
+/*  Formats the counters of each i/o thread, including the timer dispatch
+ *    stats of its tpoll obj.
+ */
+    io_stats_t *stats;
+    int n;
+    int k;
+
+    if ((n = conf->numIOThreads) <= 0) {
+        return;
+    }
+    if (!(stats = malloc(n * sizeof(io_stats_t)))) {
+        out_of_memory();
+    }
+    for (k = 0; k < n; k++) {
+        if (get_io_thread_stats(k, &stats[k]) < 0) {
+            break;
+        }
+    }
+    n = k;
+
+    append_metric_def(mb, "conman_io_wakeups_total", "counter",
+        "Wakeups of the i/o thread with fds ready for i/o.");
+    for (k = 0; k < n; k++) {
+        append_metrics(mb, "conman_io_wakeups_total{thread=\"%d\"} %lu\n",
+            k, stats[k].numWakeups);
+    }
+    append_metric_def(mb, "conman_io_ready_fds_total", "counter",
+        "Fds ready for i/o summed over all wakeups of the i/o thread.");
+    for (k = 0; k < n; k++) {
+        append_metrics(mb, "conman_io_ready_fds_total{thread=\"%d\"} %lu\n",
+            k, stats[k].numReadyFds);
+    }
+    append_metric_def(mb, "conman_io_busy_seconds_total", "counter",
+        "Seconds the i/o thread spent handling ready fds.");
+    for (k = 0; k < n; k++) {
+        append_metrics(mb, "conman_io_busy_seconds_total{thread=\"%d\"} ",
+            k);
+        append_usecs(mb, stats[k].usecsBusy);
+    }
+    append_metric_def(mb, "conman_io_busy_max_seconds", "gauge",
+        "Most seconds the i/o thread spent handling one wakeup.");
+    for (k = 0; k < n; k++) {
+        append_metrics(mb, "conman_io_busy_max_seconds{thread=\"%d\"} ", k);
+        append_usecs(mb, stats[k].usecsBusyMax);
+    }
+    append_metric_def(mb, "conman_timer_dispatches_total", "counter",
+        "Timers dispatched by the i/o thread.");
+    for (k = 0; k < n; k++) {
+        append_metrics(mb,
+            "conman_timer_dispatches_total{thread=\"%d\"} %lu\n",
+            k, stats[k].timers.num_timers);
+    }
+    append_metric_def(mb, "conman_timer_lag_seconds_total", "counter",
+        "Seconds between the expiration and dispatch of the timers.");
+    for (k = 0; k < n; k++) {
+        append_metrics(mb, "conman_timer_lag_seconds_total{thread=\"%d\"} ",
+            k);
+        append_usecs(mb, stats[k].timers.usecs_lag);
+    }
+    append_metric_def(mb, "conman_timer_lag_max_seconds", "gauge",
+        "Most seconds between the expiration and dispatch of a timer.");
+    for (k = 0; k < n; k++) {
+        append_metrics(mb, "conman_timer_lag_max_seconds{thread=\"%d\"} ",
+            k);
+        append_usecs(mb, stats[k].timers.usecs_lag_max);
+    }
+    free(stats);
+    return;
+}
+
+
+static void format_bench_metrics(metrics_buf_t *mb)
+{
+/*  Formats the test bench totals if any benchmark test consoles are open.
+ */
+    test_bench_stats_t stats;
+
+    if (get_test_bench_stats(&stats) < 0) {
+        return;
+    }
+    append_metric_def(mb, "conman_test_bench_consoles", "gauge",
+        "Benchmark test consoles open.");
+    append_metrics(mb, "conman_test_bench_consoles %d\n", stats.numConsoles);
+    append_metric_def(mb, "conman_test_bench_target_bytes_per_second",
+        "gauge", "Sum of the rates of the benchmark test consoles.");
+    append_metrics(mb, "conman_test_bench_target_bytes_per_second %llu\n",
+        stats.rate);
+    append_metric_def(mb, "conman_test_bench_generated_bytes_total",
+        "counter", "Bytes generated by the benchmark test consoles.");
+    append_metrics(mb, "conman_test_bench_generated_bytes_total %llu\n",
+        stats.numBytes);
+    append_metric_def(mb, "conman_test_bench_overwritten_bytes_total",
+        "counter", "Bytes overwritten in any obj during the benchmark.");
+    append_metrics(mb, "conman_test_bench_overwritten_bytes_total %llu\n",
+        stats.numOver);
+    append_metric_def(mb, "conman_test_bench_latency_seconds", "summary",
+        "Seconds from generating benchmark data to writing it to a client.");
+    append_metrics(mb, "conman_test_bench_latency_seconds_sum %.6f\n",
+        stats.usecsLatency / 1e6);
+    append_metrics(mb, "conman_test_bench_latency_seconds_count %llu\n",
+        stats.numSamples);
+    return;
+}
+
+
+static void append_metric_def(metrics_buf_t *mb,
+    const char *name, const char *type, const char *help)
+{
+/*  Appends the HELP and TYPE lines for the metric (name).
+ */
+    append_metrics(mb, "# HELP %s %s\n# TYPE %s %s\n",
+        name, help, name, type);
+    return;
+}
+
+
+static void append_console_label(metrics_buf_t *mb, const char *name,
+    obj_t *console)
+{
+/*  Appends the metric (name) labeled with the name of the (console),
+ *    escaping its backslashes, double-quotes, and newlines.
+ */
+    const char *p;
+
+    append_metrics(mb, "%s{console=\"", name);
+    for (p = console->name; *p; p++) {
+        if (*p == '\\') {
+            append_metrics(mb, "\\\\");
+        }
+        else if (*p == '"') {
+            append_metrics(mb, "\\\"");
+        }
+        else if (*p == '\n') {
+            append_metrics(mb, "\\n");
+        }
+        else {
+            append_metrics(mb, "%c", *p);
+        }
+    }
+    append_metrics(mb, "\"}");
+    return;
+}
+
+
+static void append_usecs(metrics_buf_t *mb, unsigned long usecs)
+{
+/*  Appends the sample value of (usecs) microseconds in seconds.
+ */
+    append_metrics(mb, "%lu.%06lu\n", usecs / 1000000, usecs % 1000000);
+    return;
+}
+
+
+static void append_metrics(metrics_buf_t *mb, const char *fmt, ...)
+{
+/*  Appends the formatted string to the response body (mb),
+ *    growing it as needed.
+ */
+    va_list vargs;
+    int n;
+
+    for (;;) {
+        if (mb->size - mb->len > 1) {
+            va_start(vargs, fmt);
+            n = vsnprintf(mb->data + mb->len, mb->size - mb->len, fmt, vargs);
+            va_end(vargs);
+            if ((n >= 0) && (n < mb->size - mb->len)) {
+                mb->len += n;
+                return;
+            }
+        }
+        mb->size = (mb->size > 0) ? mb->size * 2 : MAX_BUF_SIZE;
+        if (!(mb->data = realloc(mb->data, mb->size))) {
+            out_of_memory();
+        }
+    }
+}
@@ -0,0 +1,475 @@
+/*****************************************************************************
+ *  Written by Chris Dunlap <cdunlap@llnl.gov>.
+ *  Copyright (C) 2007-2016 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  UCRL-CODE-2002-009.
+ *
+ *  This file is part of ConMan: The Console Manager.
+ *  For details, see <https://dun.github.io/conman/>.
+ *
+ *  ConMan is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  ConMan is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with ConMan.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "lex.h"
+#include "list.h"
+#include "log.h"
+#include "server.h"
+#include "util-str.h"
+#include "util.h"
+
+
+/*  A multiplexed client session carries many consoles over one connection
+ *    (see the record framing described in common.h).  The client obj is
+ *    linked to each console to which it is subscribed just as an ordinary
+ *    R/O (or R/W) client would be, so console output reaches it via the
+ *    usual fan-out; the client obj frames that output with the console's
+ *    id as it is queued, sharing the console's chunks as any other client
+ *    would.  Input received from the client is parsed into records here:
+ *    ctrl records (un)subscribe consoles, and console records are written
+ *    to the targeted console(s).
+ *  Ctrl msgs are processed by the client obj's i/o thread.
+ */
+
+static void write_record_data(obj_t *client, unsigned int id,
+    unsigned char *src, int len);
+static obj_t * find_writable_console(obj_t *client, unsigned int id);
+static void process_ctrl_msg(obj_t *client, char *msg);
+static void perform_subscribe(obj_t *client, Lex l);
+static void perform_unsubscribe(obj_t *client, Lex l);
+static void unsubscribe_client_console(obj_t *client, obj_t *console);
+static void send_console_msg(obj_t *client, int tok, obj_t *console);
+static void send_error_msg(obj_t *client, int errnum, const char *errmsg);
+
+
+client_mux_t * create_client_mux(server_conf_t *conf)
+{
+/*  Creates and returns the multiplex session data for a client obj.
+ */
+    client_mux_t *mux;
+
+    assert(conf != NULL);
+
+    if (!(mux = malloc(sizeof(client_mux_t)))) {
+        out_of_memory();
+    }
+    mux->conf = conf;
+    mux->hdrLen = 0;
+    mux->id = CONMAN_MUX_ID_CTRL;
+    mux->numLeft = 0;
+    mux->ctrl = NULL;
+    mux->ctrlLen = 0;
+    return(mux);
+}
+
+
+void destroy_client_mux(client_mux_t *mux)
+{
+/*  Destroys the multiplex session data (mux).
+ */
+    if (!mux) {
+        return;
+    }
+    free(mux->ctrl);
+    free(mux);
+    return;
+}
+
+
+void subscribe_client_console(obj_t *client, obj_t *console)
+{
+/*  Subscribes the multiplexed (client) to the (console), announcing the
+ *    console's id before any of its output is sent.  In a CONNECT session,
+ *    the client can also write to the console unless it is busy and the
+ *    session has neither the force nor join option enabled.
+ */
+    req_t *req;
+
+    assert(is_client_obj(client));
+    assert(client->aux.client.mux != NULL);
+    assert(is_console_obj(console));
+
+    if (list_find_first(console->readers, (ListFindF) find_obj, client)) {
+        return;
+    }
+    req = client->aux.client.req;
+    if ((req->command == CONMAN_CMD_CONNECT)
+            && !req->enableForce && !req->enableJoin
+            && !list_is_empty(console->writers)) {
+        char buf[MAX_LINE];
+        snprintf(buf, sizeof(buf), "Console [%s] already in use",
+            console->name);
+        send_error_msg(client, CONMAN_ERR_BUSY_CONSOLES, buf);
+        return;
+    }
+    send_console_msg(client, CONMAN_TOK_SUBSCRIBE, console);
+
+    if (req->command == CONMAN_CMD_CONNECT) {
+        link_objs(client, console);
+    }
+    link_objs(console, client);
+    check_console_state(console, client);
+    return;
+}
+
+
+void announce_client_unsubscribe(obj_t *client, obj_t *console)
+{
+/*  Informs the multiplexed (client) that it is no longer subscribed to
+ *    the (console), whether at its request or because the console has been
+ *    removed or stolen.  No msg is sent once the client is shut down.
+ */
+    assert(is_client_obj(client));
+    assert(client->aux.client.mux != NULL);
+    assert(is_console_obj(console));
+
+    if (client->fd < 0) {
+        return;
+    }
+    send_console_msg(client, CONMAN_TOK_UNSUBSCRIBE, console);
+    return;
+}
+
+
+void announce_client_drop(obj_t *client, unsigned long n)
+{
+/*  Informs the multiplexed (client) that (n) bytes of its output have been
+ *    dropped because it was not keeping up:
+ *    DROPPED BYTES=<int>
+ */
+    char buf[MAX_LINE];
+
+    assert(is_client_obj(client));
+    assert(client->aux.client.mux != NULL);
+
+    snprintf(buf, sizeof(buf), "%s %s=%lu",
+        LEX_TOK2STR(proto_strs, CONMAN_TOK_DROPPED),
+        LEX_TOK2STR(proto_strs, CONMAN_TOK_BYTES), n);
+    write_obj_data(client, buf, strlen(buf), 0);
+    return;
+}
+
+
+int process_client_frames(obj_t *client, void *src, int len)
+{
+/*  Processes the buffer (src) of length (len) received from the
+ *    multiplexed client, reassembling records split across reads.
+ *  The data is consumed here instead of being written to the client's
+ *    readers, so this always returns 0.
+ */
+    client_mux_t *mux;
+    unsigned char *p = src;
+    unsigned char *last = p + len;
+    int n;
+
+    assert(is_client_obj(client));
+    assert(client->aux.client.mux != NULL);
+
+    mux = client->aux.client.mux;
+    while (p < last) {
+        if (mux->hdrLen < CONMAN_MUX_HDR_LEN) {
+            n = MIN(last - p, CONMAN_MUX_HDR_LEN - mux->hdrLen);
+            memcpy(&mux->hdr[mux->hdrLen], p, n);
+            mux->hdrLen += n;
+            p += n;
+            if (mux->hdrLen < CONMAN_MUX_HDR_LEN) {
+                break;
+            }
+            mux->id = ((unsigned int) mux->hdr[0] << 24)
+                | ((unsigned int) mux->hdr[1] << 16)
+                | ((unsigned int) mux->hdr[2] << 8)
+                | (unsigned int) mux->hdr[3];
+            mux->numLeft = (mux->hdr[4] << 8) | mux->hdr[5];
+
+            if (mux->id == CONMAN_MUX_ID_CTRL) {
+                if (!(mux->ctrl = malloc(mux->numLeft + 1))) {
+                    out_of_memory();
+                }
+                mux->ctrlLen = 0;
+            }
+            else if ((mux->id != CONMAN_MUX_ID_ALL)
+                    && !find_writable_console(client, mux->id)) {
+                char buf[MAX_LINE];
+                snprintf(buf, sizeof(buf),
+                    "Console id %u is not writable", mux->id);
+                send_error_msg(client, CONMAN_ERR_BAD_REQUEST, buf);
+            }
+        }
+        n = MIN(last - p, mux->numLeft);
+        if (mux->id == CONMAN_MUX_ID_CTRL) {
+            memcpy(&mux->ctrl[mux->ctrlLen], p, n);
+            mux->ctrlLen += n;
+        }
+        else if (n > 0) {
+            write_record_data(client, mux->id, p, n);
+        }
+        p += n;
+        mux->numLeft -= n;
+
+        if (mux->numLeft == 0) {
+            if (mux->id == CONMAN_MUX_ID_CTRL) {
+                mux->ctrl[mux->ctrlLen] = '\0';
+                process_ctrl_msg(client, mux->ctrl);
+                free(mux->ctrl);
+                mux->ctrl = NULL;
+            }
+            mux->hdrLen = 0;
+        }
+    }
+    return(0);
+}
+
+
+static void write_record_data(obj_t *client, unsigned int id,
+    unsigned char *src, int len)
+{
+/*  Writes the record data (src) of length (len) from the client to the
+ *    console (id), or to every console it can write if (id) is
+ *    CONMAN_MUX_ID_ALL.  Data for any other console is discarded.
+ */
+    ListIterator i;
+    obj_t *console;
+
+    if (id != CONMAN_MUX_ID_ALL) {
+        if ((console = find_writable_console(client, id))) {
+            write_obj_data(console, src, len, 0);
+        }
+        return;
+    }
+    i = list_iterator_create(client->readers);
+    while ((console = list_next(i))) {
+        write_obj_data(console, src, len, 0);
+    }
+    list_iterator_destroy(i);
+    return;
+}
+
+
+static obj_t * find_writable_console(obj_t *client, unsigned int id)
+{
+/*  Returns the console obj identified by (id) that the client can write,
+ *    or NULL if not found.
+ */
+    ListIterator i;
+    obj_t *console;
+
+    i = list_iterator_create(client->readers);
+    while ((console = list_next(i))) {
+        if (console->muxId == id) {
+            break;
+        }
+    }
+    list_iterator_destroy(i);
+    return(console);
+}
+
+
+static void process_ctrl_msg(obj_t *client, char *msg)
+{
+/*  Processes the ctrl msg received from the multiplexed client.
+ */
+    Lex l;
+    int tok;
+
+    DPRINTF((5, "Received ctrl msg from [%s]: %s\n", client->name, msg));
+
+    l = lex_create(msg, proto_strs);
+    tok = lex_next(l);
+    switch(tok) {
+    case CONMAN_TOK_SUBSCRIBE:
+        perform_subscribe(client, l);
+        break;
+    case CONMAN_TOK_UNSUBSCRIBE:
+        perform_unsubscribe(client, l);
+        break;
+    case LEX_EOF:
+    case LEX_EOL:
+        break;
+    default:
+        send_error_msg(client, CONMAN_ERR_BAD_REQUEST,
+            "Invalid control message");
+        break;
+    }
+    lex_destroy(l);
+    return;
+}
+
+
+static void perform_subscribe(obj_t *client, Lex l)
+{
+/*  Performs the SUBSCRIBE ctrl msg:
+ *    SUBSCRIBE CONSOLE='<str>' ...
+ *  Console patterns are matched in the same manner as the session request.
+ */
+    client_mux_t *mux = client->aux.client.mux;
+    req_t *req = client->aux.client.req;
+    List pats;
+    List matches;
+    obj_t *console;
+    char buf[MAX_SOCK_LINE];
+    int tok;
+
+    pats = list_create((ListDelF) destroy_string);
+    while ((tok = lex_next(l)) != LEX_EOF && (tok != LEX_EOL)) {
+        if ((tok == CONMAN_TOK_CONSOLE) && (lex_next(l) == '=')
+          && (lex_next(l) == LEX_STR) && (*lex_text(l) != '\0')) {
+            list_append(pats, lex_decode(create_string(lex_text(l))));
+        }
+    }
+    matches = list_create(NULL);
+
+    if (match_console_objs(mux->conf, pats, req->enableRegex, matches,
+      buf, sizeof(buf)) < 0) {
+        send_error_msg(client, CONMAN_ERR_BAD_REGEX, buf);
+    }
+    else if (list_is_empty(matches)) {
+        send_error_msg(client, CONMAN_ERR_NO_CONSOLES,
+            "Found no matching consoles");
+    }
+    else {
+        log_msg(LOG_INFO, "Client <%s@%s:%d> subscribed to %d console%s",
+            req->user, req->fqdn, req->port, list_count(matches),
+            (list_count(matches) == 1 ? "" : "s"));
+        while ((console = list_pop(matches))) {
+            subscribe_client_console(client, console);
+        }
+    }
+    list_destroy(matches);
+    list_destroy(pats);
+    return;
+}
+
+
+static void perform_unsubscribe(obj_t *client, Lex l)
+{
+/*  Performs the UNSUBSCRIBE ctrl msg:
+ *    UNSUBSCRIBE CONSOLE='<str>' ... ID=<int> ...
+ *  Only consoles to which the client is currently subscribed are affected.
+ */
+    client_mux_t *mux = client->aux.client.mux;
+    req_t *req = client->aux.client.req;
+    List pats;
+    List matches;
+    ListIterator i;
+    obj_t *console;
+    unsigned int id;
+    char buf[MAX_SOCK_LINE];
+    int n = 0;
+    int tok;
+
+    pats = list_create((ListDelF) destroy_string);
+    matches = list_create(NULL);
+    while ((tok = lex_next(l)) != LEX_EOF && (tok != LEX_EOL)) {
+        if ((tok == CONMAN_TOK_CONSOLE) && (lex_next(l) == '=')
+          && (lex_next(l) == LEX_STR) && (*lex_text(l) != '\0')) {
+            list_append(pats, lex_decode(create_string(lex_text(l))));
+        }
+        else if ((tok == CONMAN_TOK_ID) && (lex_next(l) == '=')
+          && (lex_next(l) == LEX_INT)) {
+            id = (unsigned int) strtoul(lex_text(l), NULL, 10);
+            i = list_iterator_create(client->writers);
+            while ((console = list_next(i))) {
+                if (console->muxId == id) {
+                    list_append(matches, console);
+                }
+            }
+            list_iterator_destroy(i);
+        }
+    }
+    if (match_console_objs(mux->conf, pats, req->enableRegex, matches,
+      buf, sizeof(buf)) < 0) {
+        send_error_msg(client, CONMAN_ERR_BAD_REGEX, buf);
+        list_destroy(matches);
+        list_destroy(pats);
+        return;
+    }
+    /*  A console may be listed more than once if it was matched by both
+     *    its id and a pattern, but it is only unsubscribed the first time.
+     */
+    while ((console = list_pop(matches))) {
+        if (list_find_first(console->readers, (ListFindF) find_obj, client)) {
+            unsubscribe_client_console(client, console);
+            n++;
+        }
+    }
+    if (n == 0) {
+        send_error_msg(client, CONMAN_ERR_NO_CONSOLES,
+            "Found no matching consoles");
+    }
+    else {
+        log_msg(LOG_INFO, "Client <%s@%s:%d> unsubscribed from %d console%s",
+            req->user, req->fqdn, req->port, n, (n == 1 ? "" : "s"));
+    }
+    list_destroy(matches);
+    list_destroy(pats);
+    return;
+}
+
+
+static void unsubscribe_client_console(obj_t *client, obj_t *console)
+{
+/*  Unsubscribes the multiplexed (client) from the (console).
+ *  Removing the console's link to the client announces the unsubscribe.
+ */
+    if (list_find_first(client->readers, (ListFindF) find_obj, console)) {
+        unlink_objs(client, console);
+    }
+    unlink_objs(console, client);
+    return;
+}
+
+
+static void send_console_msg(obj_t *client, int tok, obj_t *console)
+{
+/*  Sends a ctrl msg of the type (tok) regarding the (console):
+ *    <tok> CONSOLE='<str>' ID=<int>
+ */
+    char buf[MAX_SOCK_LINE];
+    char tmp[MAX_LINE];
+
+    strlcpy(tmp, console->name, sizeof(tmp));
+    snprintf(buf, sizeof(buf), "%s %s='%s' %s=%u",
+        LEX_TOK2STR(proto_strs, tok),
+        LEX_TOK2STR(proto_strs, CONMAN_TOK_CONSOLE), lex_encode(tmp),
+        LEX_TOK2STR(proto_strs, CONMAN_TOK_ID), console->muxId);
+    write_obj_data(client, buf, strlen(buf), 0);
+    return;
+}
+
+
+static void send_error_msg(obj_t *client, int errnum, const char *errmsg)
+{
+/*  Sends an error ctrl msg to the multiplexed client:
+ *    ERROR CODE=<int> MESSAGE='<str>'
+ */
+    char buf[MAX_SOCK_LINE];
+    char tmp[MAX_LINE];
+
+    strlcpy(tmp, errmsg, sizeof(tmp));
+    snprintf(buf, sizeof(buf), "%s %s=%d %s='%s'",
+        LEX_TOK2STR(proto_strs, CONMAN_TOK_ERROR),
+        LEX_TOK2STR(proto_strs, CONMAN_TOK_CODE), errnum,
+        LEX_TOK2STR(proto_strs, CONMAN_TOK_MESSAGE), lex_encode(tmp));
+    write_obj_data(client, buf, strlen(buf), 0);
+    return;
+}
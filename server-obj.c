@@ -33,6 +33,7 @@
 #include <assert.h>
 #include <ctype.h>
 #include <errno.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stdarg.h>
 #include <stdlib.h>
@@ -40,10 +41,14 @@
 #include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
+#if WITH_ZLIB
+#  include <zlib.h>
+#endif /* WITH_ZLIB */
 #include "common.h"
 #include "inevent.h"
 #include "list.h"
 #include "log.h"
+#include "probe.h"
 #include "server.h"
 #include "tpoll.h"
 #include "util-file.h"
@@ -51,15 +56,111 @@
 #include "util.h"
 #include "wrapper.h"
 
-extern tpoll_t tp_global;               /* defined in server.c */
-
 
 static char * sanitize_file_string(char *str);
 static char * find_trailing_int_str(char *str);
+static void update_obj_set(obj_t *obj, obj_t ***setPtr, List objs);
 #ifndef NDEBUG
 static int validate_obj_links(obj_t *obj);
+static int validate_obj_buf(obj_t *obj);
 #endif /* !NDEBUG */
+static unsigned char * get_obj_buf(int size);
+static void put_obj_buf(unsigned char *buf, int size);
+static void release_obj_buf(obj_t *obj);
+static int write_obj_buf(obj_t *obj, const void *src, int len, int isInfo,
+    obj_chunk_t *chunk, unsigned int id);
+static int queue_client_data(obj_t *client, const unsigned char *src, int len,
+    obj_chunk_t *chunk, unsigned int id);
+static int queue_client_records(obj_t *client, const unsigned char *src,
+    int len, obj_chunk_t *chunk, unsigned int id);
+static void share_client_chunk(obj_t *client, const unsigned char *src,
+    int len, obj_chunk_t *chunk, int *overwritten);
+static void copy_client_data(obj_t *client, const unsigned char *src, int len,
+    int *overwritten);
+static obj_seg_t * append_client_seg(obj_t *client, int *overwritten);
+static void sample_client_latency(obj_t *client, int len);
+static int drop_client_data(obj_t *client, int len);
+static int spill_client_data(obj_t *client, const unsigned char *hdr,
+    int hdrLen, const unsigned char *src, int len);
+static int write_client_spill(int fd, const void *src, int len, off_t off);
+static int refill_client_data(obj_t *client);
+static void notify_client_drop(obj_t *client);
+static void note_obj_overwrite(obj_t *obj, int over);
+#if WITH_ZLIB
+static void create_client_zstream(obj_t *client);
+static int write_client_zdata(obj_t *client, struct iovec *iov, int iovcnt);
+static int compress_client_iov(obj_t *client, struct iovec *iov, int iovcnt);
+#endif /* WITH_ZLIB */
 static int num_bytes_buffered(obj_t *obj);
+static int get_obj_buf_iov(obj_t *obj, struct iovec *iov);
+static void drop_obj_buf_data(obj_t *obj, int len);
+static int get_readers_space(obj_t *obj);
+static int is_console_read_blocked(obj_t *console);
+static void pause_console_read(obj_t *console);
+static void expire_console_pause(obj_t *console);
+static void resume_console_read(obj_t *console);
+static void resume_client_consoles(obj_t *client);
+static int is_obj_io_thread(obj_t *obj);
+static void create_io_thread_key(void);
+static int copy_obj_data(obj_t *obj, const void *src, int len,
+    obj_chunk_t *chunk, unsigned int id);
+static int queue_obj_pending(obj_t *obj, const void *src, int len,
+    int isInfo, unsigned int id);
+static void drain_obj_pending(obj_t *obj);
+
+/*  Circular-bufs are allocated upon the first write into an obj.
+ *    Those no longer in use are retained in a slab of free bufs of the
+ *    same size for reuse.  Since bufs are only sized per obj type,
+ *    there will only be a few slabs.
+ */
+typedef struct obj_buf_slab {
+    struct obj_buf_slab *next;          /* next slab in list                 */
+    int                  size;          /* size of each buf in this slab     */
+    int                  numFree;       /* num bufs in free list             */
+    void                *freeList;      /* list of free bufs linked via ptr  */
+} obj_buf_slab_t;
+
+static obj_buf_slab_t *bufSlabs = NULL;
+static pthread_mutex_t bufSlabLock = PTHREAD_MUTEX_INITIALIZER;
+
+/*  Chunks no longer referenced are retained in a free pool for reuse.
+ */
+static obj_chunk_t *chunkPool = NULL;
+static int numChunksPooled = 0;
+static pthread_mutex_t chunkLock = PTHREAD_MUTEX_INITIALIZER;
+
+/*  The readers & writers of each obj are also published as a NULL-terminated
+ *    array so the obj's i/o thread can iterate over them on the data path
+ *    without locking the list or allocating an iterator.  Whenever a link
+ *    changes, a new array is published in place of the old one, which is
+ *    freed by a timer on the obj's i/o thread once it cannot still be in use.
+ *  The setLock serializes rebuilding the arrays from the lists so the last
+ *    array published reflects the last change to its list.
+ */
+static pthread_mutex_t setLock = PTHREAD_MUTEX_INITIALIZER;
+
+/*  An obj's buffer is only accessed by the i/o thread that muxes it, so the
+ *    ring (or client output queue) is written without holding its bufLock.
+ *    Data written into the obj by any other thread is instead appended to
+ *    the obj's pending queue (under bufLock) for the i/o thread to drain.
+ */
+typedef struct obj_pend {
+    struct obj_pend     *next;          /* next pending write in queue       */
+    int                  len;           /* num bytes of data                 */
+    int                  isInfo;        /* true if informational message     */
+    unsigned int         id;            /* console id for multiplexing       */
+    unsigned char       *data;          /* data (allocated after this hdr)   */
+} obj_pend_t;
+
+/*  Each console obj is assigned an id that identifies its records within
+ *    multiplexed client sessions.  Ids are never reused, so a stale id cannot
+ *    refer to a different console after the daemon has been reconfigured.
+ *    Console objs are only created by the main thread.
+ */
+static unsigned int lastMuxId = CONMAN_MUX_ID_CTRL;
+
+static pthread_key_t ioThreadKey;
+static pthread_once_t ioThreadKeyOnce = PTHREAD_ONCE_INIT;
 
 
 obj_t * create_obj(
@@ -76,10 +177,23 @@ obj_t * create_obj(
         out_of_memory();
     obj->name = create_string(name);
     obj->fd = fd;
-    obj->bufInPtr = obj->bufOutPtr = obj->buf;
+    /*
+     *  Objs are muxed by the main i/o thread until assign_io_threads()
+     *    distributes the consoles (and their logfiles) across i/o threads.
+     */
+    obj->tp = conf->tp;
+    /*
+     *  The circular-buf is not allocated until data is written into it.
+     *    Its size is set in open_objs() after the config has been parsed.
+     */
+    obj->buf = obj->bufInPtr = obj->bufOutPtr = NULL;
+    obj->bufSize = OBJ_BUF_SIZE;
+    obj->pendHead = obj->pendTail = NULL;
+    obj->numPendBytes = 0;
     x_pthread_mutex_init(&obj->bufLock, NULL);
     obj->readers = list_create(NULL);
     obj->writers = list_create(NULL);
+    obj->readerSet = obj->writerSet = NULL;
     if ((type == 0) || (type >= CONMAN_OBJ_LAST_ENTRY)) {
         log_err(0, "INTERNAL: Unrecognized object [%s] type=%d", name, type);
     }
@@ -93,6 +207,27 @@ obj_t * create_obj(
     obj->resetCmdRef = NULL;
     obj->resetCmdPid = 0;
     obj->resetCmdTimer = 0;
+    /*
+     *  A budget of 0 reads at most one chunk per i/o event.
+     */
+    obj->readBudget = 0;
+    obj->readPauseTimer = -1;
+    obj->gotReadPause = 0;
+    obj->numPendOver = 0;
+    obj->numOverNotice = 0;
+    obj->tOverNotice = 0;
+    obj->isOpenPending = 0;
+    obj->isRemoved = 0;
+    obj->trigger = NULL;
+    obj->ring = NULL;
+    obj->muxId = (type & CONMAN_OBJ_IS_CONSOLE) ? ++lastMuxId : 0;
+    /*
+     *  A console is down until its connection is first established.
+     */
+    memset(&obj->stats, 0, sizeof(obj->stats));
+    if (type & CONMAN_OBJ_IS_CONSOLE) {
+        obj->stats.tDown = time(NULL);
+    }
 
     DPRINTF((10, "Created object [%s].\n", obj->name));
     return(obj);
@@ -103,10 +238,12 @@ obj_t * create_client_obj(server_conf_t *conf, req_t *req)
 {
 /*  Creates a new client object and adds it to the master objs list.
  *    Note: the socket is open and set for non-blocking I/O.
+ *  The client will not be muxed until activate_client_obj() is called.
  *  Returns the new object.
  */
     char name[MAX_LINE];
     obj_t *client;
+    obj_t *console;
 
     assert(conf != NULL);
     assert(req != NULL);
@@ -116,18 +253,69 @@ obj_t * create_client_obj(server_conf_t *conf, req_t *req)
 
     set_fd_nonblocking(req->sd);
     set_fd_closed_on_exec(req->sd);
-    tpoll_set(tp_global, req->sd, POLLIN);
 
     snprintf(name, sizeof(name), "%s@%s:%d", req->user, req->host, req->port);
     name[sizeof(name) - 1] = '\0';
     client = create_obj(conf, name, req->sd, CONMAN_OBJ_CLIENT);
+    /*
+     *  A client obj never allocates its circular-buf since its output is
+     *    queued in segs; the bufSize instead limits the queued data.
+     */
+    client->bufSize = OBJ_BUF_SIZE;
     client->aux.client.req = req;
+    if (!(client->aux.client.segs = malloc(OBJ_SEGS_MAX * sizeof(obj_seg_t))))
+        out_of_memory();
+    client->aux.client.segHead = 0;
+    client->aux.client.numSegs = 0;
+    client->aux.client.numSegBytes = 0;
     time(&client->aux.client.timeLastRead);
     if (client->aux.client.timeLastRead == (time_t) -1)
         log_err(errno, "time() failed");
     client->aux.client.gotEscape = 0;
     client->aux.client.gotSuspend = 0;
-
+    client->aux.client.isActive = 0;
+    client->aux.client.mux = NULL;
+    client->aux.client.zstream = NULL;
+    client->aux.client.zBuf = NULL;
+    client->aux.client.zBufSize = 0;
+    client->aux.client.zBufLen = 0;
+    client->aux.client.zBufOff = 0;
+    client->aux.client.spillFd = -1;
+    client->aux.client.spillIn = 0;
+    client->aux.client.spillOut = 0;
+    client->aux.client.numDropped = 0;
+    client->aux.client.replayPos = 0;
+    client->aux.client.gotBlockExpired = 0;
+    client->aux.client.gotSpillFull = 0;
+    client->aux.client.gotReplay = 0;
+    /*
+     *  Only a R/W session may hold back reading its consoles; the output
+     *    of other sessions is dropped instead.
+     */
+    client->aux.client.overflow = conf->clientOverflow;
+    if ((conf->clientOverflow == CONMAN_OVERFLOW_BLOCK)
+            && (req->command != CONMAN_CMD_CONNECT)) {
+        client->aux.client.overflow = CONMAN_OVERFLOW_DROP;
+    }
+#if WITH_ZLIB
+    if (req->enableCompress) {
+        create_client_zstream(client);
+    }
+#endif /* WITH_ZLIB */
+    /*
+     *  A multiplexed client is allowed a larger queue since its output
+     *    is shared by all of the consoles to which it is subscribed.
+     */
+    if (req->enableMux) {
+        client->bufSize = OBJ_MUX_BUF_SIZE;
+        client->aux.client.mux = create_client_mux(conf);
+    }
+    /*
+     *  Mux the client within the same i/o thread as its (first) console.
+     */
+    if ((console = list_peek(req->consoles))) {
+        client->tp = console->tp;
+    }
     /*  Add obj to the master conf->objs list.
      */
     list_append(conf->objs, client);
@@ -138,19 +326,82 @@ obj_t * create_client_obj(server_conf_t *conf, req_t *req)
 }
 
 
+void activate_client_obj(obj_t *client)
+{
+/*  Activates the client obj for muxing I/O once its session has been set up.
+ *  Until then, the client obj cannot be shut down (and destroyed) by an
+ *    i/o thread while the client's thread is still referencing it.
+ *  While inactive, all data written to the client is held in its pending
+ *    queue.  The i/o thread drains it once notified that the fd is writable,
+ *    and clears POLLOUT again if nothing remains to be written.
+ *  The client's thread must not reference the obj once this returns.
+ */
+    assert(is_client_obj(client));
+
+    x_atomic_store(&client->aux.client.isActive, 1);
+    tpoll_set_arg(client->tp, client->fd, POLLIN | POLLOUT, client);
+    return;
+}
+
+
+void set_obj_io_thread(tpoll_t tp)
+{
+/*  Registers the calling thread as the i/o thread muxing objs via (tp).
+ *  Data written into one of these objs by this thread bypasses the obj's
+ *    pending queue.
+ */
+    assert(tp != NULL);
+
+    if ((errno = pthread_once(&ioThreadKeyOnce, create_io_thread_key)) != 0) {
+        log_err(errno, "Unable to create i/o thread key");
+    }
+    if ((errno = pthread_setspecific(ioThreadKey, tp)) != 0) {
+        log_err(errno, "Unable to set i/o thread key");
+    }
+    return;
+}
+
+
+static void create_io_thread_key(void)
+{
+/*  Creates the key identifying the tpoll obj of the calling i/o thread.
+ */
+    if ((errno = pthread_key_create(&ioThreadKey, NULL)) != 0) {
+        log_err(errno, "Unable to create i/o thread key");
+    }
+    return;
+}
+
+
+static int is_obj_io_thread(obj_t *obj)
+{
+/*  Returns true if the calling thread is the i/o thread muxing the obj.
+ */
+    if ((errno = pthread_once(&ioThreadKeyOnce, create_io_thread_key)) != 0) {
+        log_err(errno, "Unable to create i/o thread key");
+    }
+    return(pthread_getspecific(ioThreadKey) == (void *) obj->tp);
+}
+
+
 void destroy_obj(obj_t *obj)
 {
 /*  Destroys the object, closing the fd and freeing resources as needed.
- *  This routine should only be called via the obj's list destructor, thereby
- *    ensuring it will be removed from the master objs list before destruction.
+ *  This routine should only be called via the obj's list destructor or
+ *    retire_obj(), thereby ensuring it will be removed from the master objs
+ *    list before destruction.
  */
     int n;
     char **pp;
+    obj_pend_t *pend;
 
     assert(obj != NULL);
     DPRINTF((10, "Destroying object [%s].\n", obj->name));
 
-    n = num_bytes_buffered(obj);
+    if (is_logfile_obj(obj)) {
+        flush_logfile_obj(obj);
+    }
+    n = num_bytes_buffered(obj) + obj->numPendBytes;
     if (n > 0) {
         log_msg(LOG_WARNING,
             "Destroying [%s] with %d byte%s of unwritten data",
@@ -167,8 +418,38 @@ void destroy_obj(obj_t *obj)
             destroy_req(req);
             obj->aux.client.req = NULL;
         }
+        if (obj->aux.client.segs) {
+            (void) drop_client_data(obj, obj->aux.client.numSegBytes);
+            free(obj->aux.client.segs);
+            obj->aux.client.segs = NULL;
+        }
+        if (obj->aux.client.mux) {
+            destroy_client_mux(obj->aux.client.mux);
+            obj->aux.client.mux = NULL;
+        }
+#if WITH_ZLIB
+        if (obj->aux.client.zstream) {
+            (void) deflateEnd(obj->aux.client.zstream);
+            free(obj->aux.client.zstream);
+            obj->aux.client.zstream = NULL;
+        }
+#endif /* WITH_ZLIB */
+        if (obj->aux.client.zBuf) {
+            free(obj->aux.client.zBuf);
+            obj->aux.client.zBuf = NULL;
+        }
+        if (obj->aux.client.spillFd >= 0) {
+            (void) close(obj->aux.client.spillFd);
+            obj->aux.client.spillFd = -1;
+        }
         break;
     case CONMAN_OBJ_LOGFILE:
+        close_log_writes(obj, NULL);
+        if (obj->aux.logfile.coalesceTimer >= 0) {
+            (void) tpoll_timeout_cancel(obj->tp,
+                obj->aux.logfile.coalesceTimer);
+            obj->aux.logfile.coalesceTimer = -1;
+        }
         if (obj->aux.logfile.fmtName) {
             free(obj->aux.logfile.fmtName);
         }
@@ -204,6 +485,7 @@ void destroy_obj(obj_t *obj)
          */
         break;
     case CONMAN_OBJ_TELNET:
+        release_connect_slot(&obj->aux.telnet.slot);
         if (obj->aux.telnet.host) {
             free(obj->aux.telnet.host);
         }
@@ -212,7 +494,9 @@ void destroy_obj(obj_t *obj)
         break;
     case CONMAN_OBJ_UNIXSOCK:
         if (obj->aux.unixsock.dev) {
-            (void) inevent_remove(obj->aux.unixsock.dev);
+            if (obj->aux.unixsock.isWatched) {
+                (void) inevent_remove(obj->aux.unixsock.dev);
+            }
             free(obj->aux.unixsock.dev);
         }
         /*  Do not destroy obj->aux.unixsock.logfile since it is only a ref.
@@ -231,12 +515,24 @@ void destroy_obj(obj_t *obj)
 #endif /* WITH_FREEIPMI */
     case CONMAN_OBJ_TEST:
         break;
+    case CONMAN_OBJ_FORWARD:
+        close_forward_obj(obj);
+        break;
     default:
         log_err(0, "INTERNAL: Unrecognized object [%s] type=%d",
             obj->name, obj->type);
         break;
     }
 
+    if (obj->trigger) {
+        free(obj->trigger);
+    }
+    destroy_replay_ring(obj->ring);
+    release_obj_buf(obj);
+    while ((pend = obj->pendHead)) {
+        obj->pendHead = pend->next;
+        free(pend);
+    }
     x_pthread_mutex_destroy(&obj->bufLock);
     if (obj->readers) {
         list_destroy(obj->readers);
@@ -244,14 +540,25 @@ void destroy_obj(obj_t *obj)
     if (obj->writers) {
         list_destroy(obj->writers);
     }
+    if (obj->readerSet) {
+        free(obj->readerSet);
+    }
+    if (obj->writerSet) {
+        free(obj->writerSet);
+    }
     if (obj->fd >= 0) {
-        tpoll_clear(tp_global, obj->fd, POLLIN | POLLOUT);
+        tpoll_clear(obj->tp, obj->fd, POLLIN | POLLOUT);
         if (close(obj->fd) < 0) {
             log_msg(LOG_WARNING, "Unable to close [%s] during destruction: %s",
                 obj->name, strerror(errno));
         }
         obj->fd = -1;
     }
+    /*  A logfile with writes still queued is freed by the log writers.
+     */
+    if (is_logfile_obj(obj) && defer_logfile_destroy(obj)) {
+        return;
+    }
     if (obj->name) {
         free(obj->name);
     }
@@ -290,6 +597,9 @@ void reopen_obj(obj_t *obj)
     else if (is_test_obj(obj)) {
         open_test_obj(obj);
     }
+    else if (is_forward_obj(obj)) {
+        open_forward_obj(obj);
+    }
     else {
         log_err(0, "INTERNAL: Cannot re-open unrecognized object [%s] type=%d",
             obj->name, obj->type);
@@ -586,14 +896,14 @@ void notify_console_objs(obj_t *console, char *msg)
     }
     i = list_iterator_create(console->readers);
     while ((obj = list_next(i))) {
-        write_obj_data(obj, msg, strlen(msg), 1);
+        write_obj_console_data(obj, console, msg, strlen(msg), 1);
     }
     list_iterator_destroy(i);
 
     i = list_iterator_create(console->writers);
     while ((obj = list_next(i))) {
         if (!list_find_first(console->readers, (ListFindF) find_obj, obj)) {
-            write_obj_data(obj, msg, strlen(msg), 1);
+            write_obj_console_data(obj, console, msg, strlen(msg), 1);
         }
     }
     list_iterator_destroy(i);
@@ -646,18 +956,25 @@ void link_objs(obj_t *src, obj_t *dst)
                 writer->aux.client.req->user, writer->aux.client.req->host,
                 (tty ? " on " : ""), (tty ? tty : ""), now, CONMAN_MSG_SUFFIX);
             strcpy(&buf[sizeof(buf) - 3], "\r\n");
-            write_obj_data(src, buf, strlen(buf), 1);
+            write_obj_console_data(src, dst, buf, strlen(buf), 1);
         }
         list_iterator_destroy(i);
 
         /*  If the client is forcing the console session,
          *    disconnect existing clients with write-privileges.
+         *    A multiplexed client is only unsubscribed from this console.
          */
         if (gotStolen) {
             i = list_iterator_create(dst->writers);
             while ((writer = list_next(i))) {
                 assert(is_client_obj(writer));
-                unlink_obj(writer);
+                if (writer->aux.client.mux) {
+                    unlink_objs(writer, dst);
+                    unlink_objs(dst, writer);
+                }
+                else {
+                    unlink_obj(writer);
+                }
             }
             list_iterator_destroy(i);
         }
@@ -671,6 +988,8 @@ void link_objs(obj_t *src, obj_t *dst)
     list_append(src->readers, dst);
     assert(!list_find_first(dst->writers, (ListFindF) find_obj, src));
     list_append(dst->writers, src);
+    update_obj_set(src, &src->readerSet, src->readers);
+    update_obj_set(dst, &dst->writerSet, dst->writers);
 
     DPRINTF((10, "Linked [%s] reads to [%s] writes.\n", src->name, dst->name));
     assert(validate_obj_links(src) >= 0);
@@ -684,19 +1003,32 @@ void unlink_objs(obj_t *src, obj_t *dst)
 /*  Destroys the link allowing data read from (src) to be written to (dst)
  *    (ie, the link from src readers to dst writers).
  */
-    int n;
+    int m, n;
     char *now;
     char *tty;
     char buf[MAX_LINE];
 
-    if (list_delete_all(src->readers, (ListFindF) find_obj, dst)) {
+    if ((m = list_delete_all(src->readers, (ListFindF) find_obj, dst))) {
         DPRINTF((10, "Removing [%s] from [%s] readers.\n",
             dst->name, src->name));
+        /*
+         *  Inform a multiplexed client when it stops receiving a console.
+         */
+        if (is_console_obj(src) && is_client_obj(dst)
+                && dst->aux.client.mux) {
+            announce_client_unsubscribe(dst, src);
+        }
     }
     if ((n = list_delete_all(dst->writers, (ListFindF) find_obj, src))) {
         DPRINTF((10, "Removing [%s] from [%s] writers.\n",
             src->name, dst->name));
     }
+    if (m > 0) {
+        update_obj_set(src, &src->readerSet, src->readers);
+    }
+    if (n > 0) {
+        update_obj_set(dst, &dst->writerSet, dst->writers);
+    }
     /*  If a "writable" client is being unlinked from a console ...
      */
     if ((n > 0) && is_client_obj(src) && is_console_obj(dst)) {
@@ -719,13 +1051,15 @@ void unlink_objs(obj_t *src, obj_t *dst)
     /*  If a client obj has become completely unlinked, set its EOF flag.
      *    This will prevent new data from being added to the obj's buffer,
      *    and the obj will be closed once its buffer is empty.
+     *  A multiplexed client remains open until it closes its connection
+     *    since it can subscribe to consoles again.
      */
-    if (is_client_obj(src)
+    if (is_client_obj(src) && !src->aux.client.mux
             && list_is_empty(src->readers) && list_is_empty(src->writers)) {
         assert(is_console_obj(dst));
         src->gotEOF = 1;
     }
-    else if (is_client_obj(dst)
+    else if (is_client_obj(dst) && !dst->aux.client.mux
             && list_is_empty(dst->readers) && list_is_empty(dst->writers)) {
         assert(is_console_obj(src));
         dst->gotEOF = 1;
@@ -755,6 +1089,48 @@ void unlink_obj(obj_t *obj)
 }
 
 
+static void update_obj_set(obj_t *obj, obj_t ***setPtr, List objs)
+{
+/*  Publishes the current contents of the (objs) list of the (obj)'s readers
+ *    or writers as a new NULL-terminated array at (setPtr), or NULL if the
+ *    list is empty.
+ *  The array previously published may still be in use by the obj's i/o
+ *    thread, so it is freed by a timer dispatched by that thread.  Since
+ *    timers are only dispatched between i/o events, the thread will have
+ *    finished iterating over it by then.
+ */
+    obj_t **set = NULL;
+    obj_t **old;
+    ListIterator i;
+    obj_t *x;
+    int n;
+    int k = 0;
+
+    x_pthread_mutex_lock(&setLock);
+    if ((n = list_count(objs)) > 0) {
+        if (!(set = malloc((n + 1) * sizeof(obj_t *)))) {
+            out_of_memory();
+        }
+        i = list_iterator_create(objs);
+        while ((k < n) && (x = list_next(i))) {
+            set[k++] = x;
+        }
+        list_iterator_destroy(i);
+        set[k] = NULL;
+    }
+    old = *setPtr;
+    x_atomic_store_ptr(setPtr, set);
+    x_pthread_mutex_unlock(&setLock);
+
+    if (old && (tpoll_timeout_relative(obj->tp,
+            (callback_f) free, old, 0) < 0)) {
+        log_err(0, "Unable to create timer for releasing [%s] links",
+            obj->name);
+    }
+    return;
+}
+
+
 #ifndef NDEBUG
 static int validate_obj_links(obj_t *obj)
 {
@@ -791,6 +1167,26 @@ static int validate_obj_links(obj_t *obj)
 
     return(gotError ? -1 : 0);
 }
+
+
+static int validate_obj_buf(obj_t *obj)
+{
+/*  Validates the input and output ptrs of the obj's circular-buffer.
+ *  Returns 0 if the ptrs are valid (or the buffer is not allocated),
+ *    or -1 on error.
+ */
+    if (!obj->buf) {
+        return(((obj->bufInPtr == NULL) && (obj->bufOutPtr == NULL)) ? 0 : -1);
+    }
+    if ((obj->bufInPtr < obj->buf)
+            || (obj->bufInPtr >= &obj->buf[obj->bufSize])
+            || (obj->bufOutPtr < obj->buf)
+            || (obj->bufOutPtr >= &obj->buf[obj->bufSize])) {
+        DPRINTF((1, "[%s] has invalid buffer ptrs.\n", obj->name));
+        return(-1);
+    }
+    return(0);
+}
 #endif /* !NDEBUG */
 
 
@@ -814,13 +1210,25 @@ int shutdown_obj(obj_t *obj)
         return(0);
     }
     /*  Close the existing connection.
+     *    A logfile's fd is instead closed by the log writers once the data
+     *    already queued for it has been written out.
      */
-    tpoll_clear(tp_global, obj->fd, POLLIN | POLLOUT);
-    if (close(obj->fd) < 0) {
-        log_msg(LOG_WARNING, "Unable to close [%s] during shutdown: %s",
-            obj->name, strerror(errno));
+    if (is_logfile_obj(obj)) {
+        flush_logfile_obj(obj);
+        close_log_writes(obj, NULL);
+    }
+    else {
+        tpoll_clear(obj->tp, obj->fd, POLLIN | POLLOUT);
+        if (close(obj->fd) < 0) {
+            log_msg(LOG_WARNING, "Unable to close [%s] during shutdown: %s",
+                obj->name, strerror(errno));
+        }
+        obj->fd = -1;
+    }
+    if (is_console_obj(obj)) {
+        mark_console_down(obj);
+        resume_console_read(obj);
     }
-    obj->fd = -1;
     /*
      *  FIXME:  The connection state should ideally be marked as DOWN here if
      *    applicable (eg, telnet & unixsock), perhaps via a close_foo_obj().
@@ -829,13 +1237,23 @@ int shutdown_obj(obj_t *obj)
      *    should be refactored since it's confusing.
      */
 
-    /*  Flush the obj's buffer.
+    /*  Flush the obj's buffer (including any data pending from other threads).
      */
-    x_pthread_mutex_lock(&obj->bufLock);
+    drain_obj_pending(obj);
     n = num_bytes_buffered(obj);
-    obj->bufInPtr = obj->bufOutPtr = obj->buf;
+    if (is_logfile_obj(obj)) {
+        obj->bufInPtr = obj->bufOutPtr = obj->buf;
+    }
+    else {
+        release_obj_buf(obj);
+    }
+    if (is_client_obj(obj)) {
+        (void) drop_client_data(obj, obj->aux.client.numSegBytes);
+        obj->aux.client.spillIn = obj->aux.client.spillOut = 0;
+        obj->aux.client.gotSpillFull = 0;
+    }
     obj->gotEOF = 0;
-    x_pthread_mutex_unlock(&obj->bufLock);
+    note_obj_overwrite(obj, 0);
     if (n > 0) {
         log_msg(LOG_WARNING,
             "Flushed %d byte%s of unwritten data from [%s]",
@@ -846,6 +1264,7 @@ int shutdown_obj(obj_t *obj)
      *    and the objs list destructor will destroy the obj.
      */
     if (is_client_obj(obj)) {
+        resume_client_consoles(obj);
         unlink_obj(obj);
         return(-1);
     }
@@ -868,6 +1287,87 @@ int shutdown_obj(obj_t *obj)
 }
 
 
+void close_console_obj(obj_t *console)
+{
+/*  Closes the (console) obj's connection for its removal from the config.
+ *    Its timers are cancelled so it will not be reopened, and any process
+ *    forked on its behalf is killed.  The obj is not unlinked or destroyed.
+ *
+ *  XXX: This routine must only be called by the console obj's i/o thread.
+ */
+    assert(console != NULL);
+    assert(is_console_obj(console));
+
+    DPRINTF((10, "Closing console [%s] for removal.\n", console->name));
+
+    if (console->resetCmdPid > 0) {
+        (void) tpoll_timeout_cancel(console->tp, console->resetCmdTimer);
+        (void) kill(-console->resetCmdPid, SIGKILL);
+        console->resetCmdPid = 0;
+        console->resetCmdTimer = 0;
+    }
+    switch(console->type) {
+    case CONMAN_OBJ_PROCESS:
+        if (console->aux.process.timer >= 0) {
+            (void) tpoll_timeout_cancel(console->tp,
+                console->aux.process.timer);
+            console->aux.process.timer = -1;
+        }
+        if (console->aux.process.pid > 0) {
+            (void) kill(console->aux.process.pid, SIGKILL);
+            console->aux.process.pid = -1;
+        }
+        console->aux.process.state = CONMAN_PROCESS_DOWN;
+        break;
+    case CONMAN_OBJ_SERIAL:
+        /*
+         *  Restore the tty and discard any pending output before closing it
+         *    (refer to destroy_obj()).
+         */
+        if (console->fd >= 0) {
+            set_tty_mode(&console->aux.serial.tty, console->fd);
+            (void) tcflush(console->fd, TCIOFLUSH);
+        }
+        break;
+    case CONMAN_OBJ_TELNET:
+        if (console->aux.telnet.timer >= 0) {
+            (void) tpoll_timeout_cancel(console->tp,
+                console->aux.telnet.timer);
+            console->aux.telnet.timer = -1;
+        }
+        release_connect_slot(&console->aux.telnet.slot);
+        console->aux.telnet.state = CONMAN_TELNET_DOWN;
+        break;
+    case CONMAN_OBJ_UNIXSOCK:
+        if (console->aux.unixsock.timer >= 0) {
+            (void) tpoll_timeout_cancel(console->tp,
+                console->aux.unixsock.timer);
+            console->aux.unixsock.timer = -1;
+        }
+        console->aux.unixsock.state = CONMAN_UNIXSOCK_DOWN;
+        break;
+    case CONMAN_OBJ_TEST:
+        close_test_obj(console);
+        break;
+    default:
+        log_err(0, "INTERNAL: Unable to close console [%s] type=%d",
+            console->name, console->type);
+        break;
+    }
+    if (console->fd >= 0) {
+        tpoll_clear(console->tp, console->fd, POLLIN | POLLOUT);
+        if (close(console->fd) < 0) {
+            log_msg(LOG_WARNING, "Unable to close [%s] for removal: %s",
+                console->name, strerror(errno));
+        }
+        console->fd = -1;
+    }
+    mark_console_down(console);
+    resume_console_read(console);
+    return;
+}
+
+
 int read_from_obj(obj_t *obj)
 {
 /*  Reads data from the obj's file descriptor and writes it out
@@ -876,22 +1376,37 @@ int read_from_obj(obj_t *obj)
  *    or -1 if the obj is ready to be destroyed.
  *
  *  An obj's circular-buffer is empty when (bufInPtr == bufOutPtr).
- *    Thus, it can hold at most (OBJ_BUF_SIZE - 1) bytes of data.
+ *    Thus, it can hold at most (bufSize - 1) bytes of data.
  *  But if the obj is a logfile, its data can grow as a result of the
  *    additional processing.  This routine's internal buffer is reduced
  *    somewhat to reduce the likelihood of log data being dropped.
+ *  Data is read into shared chunks so that client readers can reference
+ *    it directly instead of each receiving its own copy.
+ *  The fd is drained via readv() into multiple chunks at a time until
+ *    either it would block, the obj's readBudget has been consumed, or a
+ *    reader lacks buffer space for more chunks.  Any data remaining is
+ *    read upon the next i/o event, so one busy console cannot starve the
+ *    others muxed by the same i/o thread.
  */
-    unsigned char buf[(OBJ_BUF_SIZE / 2) - 1];
-    int n;
+    obj_chunk_t *chunks[OBJ_READ_IOV_MAX];
+    struct iovec iov[OBJ_READ_IOV_MAX];
+    unsigned char *buf;
+    int iovcnt;
+    int total = 0;
+    int n, m;
+    int k;
+    int e;
+    int isDrained;
     int isEmpty;
-    ListIterator i;
-    obj_t *reader;
 
     DPRINTF((20, "Entered read_from_obj: [%s]\n", obj->name));
 
     if (obj->fd < 0) {
         return(0);
     }
+    if (is_forward_obj(obj)) {
+        return(read_forward_obj(obj));
+    }
     /*  Do not read from a telnet obj that is not yet in the UP state.
      *  When the non-blocking connect completes, the fd becomes writable;
      *    when connection establishment fails, it becomes readable & writable.
@@ -900,195 +1415,1466 @@ int read_from_obj(obj_t *obj)
     if (is_telnet_obj(obj) && (obj->aux.telnet.state != CONMAN_TELNET_UP)) {
         return(0);
     }
-again:
-    if ((n = read(obj->fd, buf, sizeof(buf))) < 0) {
-        if (errno == EINTR) {
-            goto again;
-        }
-        if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
-            return(0);
-        }
-        log_msg(LOG_INFO, "Unable to read from [%s]: %s",
-            obj->name, strerror(errno));
-        return(shutdown_obj(obj));
+    /*  Hold off reading a console while a R/W client with the BLOCK overflow
+     *    policy lacks room for more output (refer to pause_console_read()).
+     */
+    if (is_console_obj(obj) && is_console_read_blocked(obj)) {
+        pause_console_read(obj);
+        return(0);
     }
-    else if (n == 0) {
-        DPRINTF((15, "Read EOF from [%s].\n", obj->name));
-        if (obj->gotEOF) {
-            log_msg(LOG_WARNING, "Read EOF from [%s] after gotEOF", obj->name);
+    for (;;) {
+        /*  Compute the number of chunks to read into.
+         *  The first read of each i/o event always gets one chunk.
+         *    Space for one chunk is reserved in each reader so this first
+         *    read will fit on the next i/o event even if the reader has not
+         *    yet been written out to its fd.
+         */
+        n = MIN(obj->readBudget - total,
+            get_readers_space(obj) - (OBJ_CHUNK_SIZE - 1));
+        if ((total > 0) && (n < OBJ_CHUNK_SIZE - 1)) {
+            break;
         }
-        obj->gotEOF = 1;
-        tpoll_clear(tp_global, obj->fd, POLLIN);
-        isEmpty = (obj->bufInPtr == obj->bufOutPtr);
-        return(isEmpty ? shutdown_obj(obj) : 0);
-    }
-    else {
-        DPRINTF((15, "Read %d bytes from [%s].\n", n, obj->name));
-        if (is_client_obj(obj)) {
-            x_pthread_mutex_lock(&obj->bufLock);
-            time(&obj->aux.client.timeLastRead);
-            if (obj->aux.client.timeLastRead == (time_t) -1) {
-                log_err(errno, "time() failed");
+        iovcnt = MAX(1, MIN(n / (OBJ_CHUNK_SIZE - 1), OBJ_READ_IOV_MAX));
+        for (k = 0; k < iovcnt; k++) {
+            chunks[k] = get_obj_chunk();
+            iov[k].iov_base = chunks[k]->data;
+            iov[k].iov_len = OBJ_CHUNK_SIZE - 1;
+        }
+again:
+        if ((n = readv(obj->fd, iov, iovcnt)) < 0) {
+            if (errno == EINTR) {
+                goto again;
             }
-            x_pthread_mutex_unlock(&obj->bufLock);
-            n = process_client_escapes(obj, buf, n);
+            /*  Releasing the chunks locks a mutex, which clobbers errno.
+             */
+            e = errno;
+            for (k = 0; k < iovcnt; k++) {
+                put_obj_chunk(chunks[k]);
+            }
+            if ((e == EAGAIN) || (e == EWOULDBLOCK)) {
+                return(total);
+            }
+            log_msg(LOG_INFO, "Unable to read from [%s]: %s",
+                obj->name, strerror(e));
+            return(shutdown_obj(obj));
         }
-        else if (is_telnet_obj(obj)) {
-            n = process_telnet_escapes(obj, buf, n);
+        else if (n == 0) {
+            for (k = 0; k < iovcnt; k++) {
+                put_obj_chunk(chunks[k]);
+            }
+            DPRINTF((15, "Read EOF from [%s].\n", obj->name));
+            if (obj->gotEOF) {
+                log_msg(LOG_WARNING, "Read EOF from [%s] after gotEOF",
+                    obj->name);
+            }
+            obj->gotEOF = 1;
+            tpoll_clear(obj->tp, obj->fd, POLLIN);
+            isEmpty = (num_bytes_buffered(obj) == 0)
+                && (x_atomic_load(&obj->numPendBytes) == 0);
+            return(isEmpty ? shutdown_obj(obj) : total);
         }
-        /*  Ensure the buffer still contains data
-         *    after the escape characters have been processed.
+        DPRINTF((15, "Read %d bytes from [%s].\n", n, obj->name));
+        PROBE3(obj_read, obj, obj->name, n);
+        total += n;
+        /*
+         *  A short read indicates the fd has been drained.
          */
-        if (n > 0) {
-            i = list_iterator_create(obj->readers);
-            while ((reader = list_next(i))) {
-
-                if (is_logfile_obj(reader)) {
-                    write_log_data(reader, buf, n);
+        isDrained = (n < iovcnt * (OBJ_CHUNK_SIZE - 1));
+
+        for (k = 0; k < iovcnt; k++) {
+            m = MIN(n, OBJ_CHUNK_SIZE - 1);
+            n -= m;
+            buf = chunks[k]->data;
+            if (m == 0) {
+                ;                       /* nothing was read into this chunk */
+            }
+            else if (is_client_obj(obj)) {
+                x_pthread_mutex_lock(&obj->bufLock);
+                time(&obj->aux.client.timeLastRead);
+                if (obj->aux.client.timeLastRead == (time_t) -1) {
+                    log_err(errno, "time() failed");
+                }
+                x_pthread_mutex_unlock(&obj->bufLock);
+                if (obj->aux.client.mux) {
+                    m = process_client_frames(obj, buf, m);
                 }
                 else {
-                    write_obj_data(reader, buf, n, 0);
+                    m = process_client_escapes(obj, buf, m);
                 }
             }
-            list_iterator_destroy(i);
+            else if (is_telnet_obj(obj)) {
+                m = process_telnet_escapes(obj, buf, m);
+            }
+            /*  Ensure the buffer still contains data
+             *    after the escape characters have been processed.
+             */
+            if (m > 0) {
+                if (is_console_obj(obj)) {
+                    scan_triggers(obj, buf, m);
+                }
+                write_obj_readers(obj, chunks[k], m);
+            }
+            put_obj_chunk(chunks[k]);
+        }
+        /*  Stop once the fd has been drained, or if processing the data
+         *    has closed the obj (or taken down its telnet connection).
+         */
+        if (isDrained || (obj->fd < 0) || (is_telnet_obj(obj)
+                && (obj->aux.telnet.state != CONMAN_TELNET_UP))) {
+            break;
         }
     }
-    return(n);
+    return(total);
 }
 
 
-int write_obj_data(obj_t *obj, const void *src, int len, int isInfo)
+static int get_readers_space(obj_t *obj)
 {
-/*  Writes the buffer (src) of length (len) into the object's (obj)
- *    circular-buffer.  If (isInfo) is true, the data is considered
- *    an informational message which a client may suppress.
- *  Returns the number of bytes written.
+/*  Returns the minimum number of bytes that can be written into the buffer
+ *    of each obj in the obj's "readers" list without overwriting data
+ *    that has not yet been written out to the reader's fd.
+ *  Logfile readers are flushed first.  Since log processing can expand the
+ *    data, and their POLLOUT may not be dispatched until after the console
+ *    is read again, waiting on tpoll would otherwise overwrite them.
+ *  Client readers with the SPILL overflow policy are not considered since
+ *    their excess output is written to disk instead of being overwritten.
+ *    Nor is a forward reader since it bounds its own queue of records.
  *
- *  Note that this routine can write at most (OBJ_BUF_SIZE - 1) bytes
- *    of data into the object's circular-buffer.
+ *  XXX: This routine must only be called by the obj's i/o thread
+ *    (which also muxes its readers).
  */
-    int avail;
-    int n, m;
-
-    DPRINTF((20, "Entered write_obj_data: [%s]\n", obj->name));
-
-    if (!src || len <= 0) {
-        return(0);
-    }
-    /*  If the obj's gotEOF flag is set,
-     *    no more data can be written into its buffer.
-     */
-    if (obj->gotEOF) {
-        log_msg(LOG_INFO, "Attempted to write %d byte%s to [%s] after EOF",
-            len, (len == 1 ? "" : "s"), obj->name);
-        return(0);
-    }
-    /*  An obj's circular-buffer is empty when (bufInPtr == bufOutPtr).
-     *    Thus, it can hold at most (OBJ_BUF_SIZE - 1) bytes of data.
-     */
-    if (len >= OBJ_BUF_SIZE) {
-        len = OBJ_BUF_SIZE - 1;
-    }
-    x_pthread_mutex_lock(&obj->bufLock);
-
-    /*  Do nothing if this is an informational message
-     *    and the client has requested not to be bothered.
-     */
-    if (isInfo && is_client_obj(obj) && obj->aux.client.req->enableQuiet) {
-        x_pthread_mutex_unlock(&obj->bufLock);
-        return(0);
-    }
-    /*  Assert the buffer's input and output ptrs are valid upon entry.
-     */
-    assert(obj->bufInPtr >= obj->buf);
-    assert(obj->bufInPtr < &obj->buf[OBJ_BUF_SIZE]);
-    assert(obj->bufOutPtr >= obj->buf);
-    assert(obj->bufOutPtr < &obj->buf[OBJ_BUF_SIZE]);
-
-    n = len;
-
-    /*  Calculate the number of bytes available before data is overwritten.
-     *  Data in the circular-buffer will be overwritten if needed since
-     *    this routine must not block.
-     *  Since an obj's circular-buffer is empty when (bufInPtr == bufOutPtr),
-     *    subtract one byte to account for this sentinel.
-     */
-    avail = OBJ_BUF_SIZE - 1 - num_bytes_buffered(obj);
+    obj_t **set;
+    obj_t *reader;
+    int n;
+    int k;
+    int space = OBJ_BUF_SIZE_MAX;
 
-    /*  Copy first chunk of data (ie, up to the end of the buffer).
-     */
-    m = MIN(len, &obj->buf[OBJ_BUF_SIZE] - obj->bufInPtr);
-    if (m > 0) {
-        memcpy(obj->bufInPtr, src, m);
-        n -= m;
-        src = (unsigned char *) src + m;
-        obj->bufInPtr += m;
-        /*
-         *  Do the hokey-pokey and perform a circular-buffer wrap-around.
-         */
-        if (obj->bufInPtr == &obj->buf[OBJ_BUF_SIZE]) {
-            obj->bufInPtr = obj->buf;
-            obj->gotBufWrap = 1;
+    set = x_atomic_load_ptr(&obj->readerSet);
+    for (k = 0; set && (reader = set[k]); k++) {
+        if (reader->tp != obj->tp) {
+            n = 0;
         }
-    }
-    /*  Copy second chunk of data (ie, from the beginning of the buffer).
-     */
-    if (n > 0) {
-        memcpy(obj->bufInPtr, src, n);
-        obj->bufInPtr += n;             /* Hokey-Pokey not needed here */
-    }
-    /*  Check to see if any data in circular-buffer was overwritten.
-     */
-    if (len > avail) {
-        if (!is_client_obj(obj) || !obj->aux.client.gotSuspend) {
-            log_msg(LOG_NOTICE, "Overwrote %d bytes for \"%s\"",
-                len - avail, obj->name);
+        else if (is_client_obj(reader)
+                && (reader->aux.client.overflow == CONMAN_OVERFLOW_SPILL)) {
+            continue;
         }
-        obj->bufOutPtr = obj->bufInPtr + 1;
-        if (obj->bufOutPtr == &obj->buf[OBJ_BUF_SIZE]) {
-            obj->bufOutPtr = obj->buf;
+        else if (is_forward_obj(reader)) {
+            continue;
         }
-    }
+        else if (is_client_obj(reader)
+                && (reader->aux.client.numSegs >= OBJ_SEGS_MAX - 1)) {
+            n = 0;
+        }
+        else {
+            if (is_logfile_obj(reader) && (reader->fd >= 0)
+                    && (num_bytes_buffered(reader) > 0)) {
+                (void) write_to_obj(reader);
+            }
+            n = reader->bufSize - 1 - num_bytes_buffered(reader)
+                - x_atomic_load(&reader->numPendBytes);
+        }
+        space = MIN(space, n);
+    }
+    return(space);
+}
+
+
+static int is_console_read_blocked(obj_t *console)
+{
+/*  Returns true if reading the (console) must wait for a client reader
+ *    with the BLOCK overflow policy to make room for another chunk of
+ *    output; o/w, returns false.
+ *  Only clients muxed by the console's i/o thread are considered, and not
+ *    those whose wait has already expired (refer to expire_console_pause()).
+ *
+ *  XXX: This routine must only be called by the console obj's i/o thread.
+ */
+    obj_t **set;
+    obj_t *reader;
+    client_obj_t *auxp;
+    int n;
+    int k;
+    int isBlocked = 0;
+
+    set = x_atomic_load_ptr(&console->readerSet);
+    for (k = 0; set && (reader = set[k]); k++) {
+        if (!is_client_obj(reader) || (reader->tp != console->tp)) {
+            continue;
+        }
+        auxp = &reader->aux.client;
+        if ((auxp->overflow != CONMAN_OVERFLOW_BLOCK)
+                || auxp->gotBlockExpired) {
+            continue;
+        }
+        /*  A chunk queued as a multiplexed record can span 3 segs.
+         */
+        n = reader->bufSize - 1 - auxp->numSegBytes
+            - x_atomic_load(&reader->numPendBytes);
+        if ((n < OBJ_CHUNK_SIZE + CONMAN_MUX_HDR_LEN)
+                || (auxp->numSegs + 3 > OBJ_SEGS_MAX)) {
+            isBlocked = 1;
+            break;
+        }
+    }
+    return(isBlocked);
+}
+
+
+static void pause_console_read(obj_t *console)
+{
+/*  Stops reading the (console) so its output is held back by the console
+ *    (or by its device's flow control) instead of being overwritten in
+ *    the queue of a slow R/W client.  Reading resumes once the client has
+ *    made room, or after CLIENT_BLOCK_MSECS so one stalled client cannot
+ *    wedge the console for its other readers and its logfile.
+ *
+ *  XXX: This routine must only be called by the console obj's i/o thread.
+ */
+    assert(is_console_obj(console));
+
+    if (console->gotReadPause) {
+        return;
+    }
+    tpoll_clear(console->tp, console->fd, POLLIN);
+    console->gotReadPause = 1;
+    console->readPauseTimer = tpoll_timeout_relative(console->tp,
+        (callback_f) expire_console_pause, console, CLIENT_BLOCK_MSECS);
+    if (console->readPauseTimer < 0) {
+        log_msg(LOG_WARNING, "Unable to create timer for [%s] read pause",
+            console->name);
+        resume_console_read(console);
+    }
+    DPRINTF((15, "Paused reading [%s].\n", console->name));
+    return;
+}
+
+
+static void expire_console_pause(obj_t *console)
+{
+/*  Resumes reading the (console) once its R/W clients have been given
+ *    CLIENT_BLOCK_MSECS to drain their output.  Clients still lacking room
+ *    stop holding back the console and have their output dropped instead
+ *    until their queues have been emptied.
+ *
+ *  XXX: This routine must only be called by the console obj's i/o thread.
+ */
+    obj_t **set;
+    obj_t *reader;
+    int k;
+
+    console->readPauseTimer = -1;
+
+    set = x_atomic_load_ptr(&console->readerSet);
+    for (k = 0; set && (reader = set[k]); k++) {
+        if (is_client_obj(reader) && (reader->tp == console->tp)
+                && (reader->aux.client.overflow == CONMAN_OVERFLOW_BLOCK)) {
+            reader->aux.client.gotBlockExpired = 1;
+        }
+    }
+    resume_console_read(console);
+    return;
+}
+
+
+static void resume_console_read(obj_t *console)
+{
+/*  Resumes reading the (console) if it has been paused.
+ *
+ *  XXX: This routine must only be called by the console obj's i/o thread.
+ */
+    if (!console->gotReadPause) {
+        return;
+    }
+    if (console->readPauseTimer >= 0) {
+        (void) tpoll_timeout_cancel(console->tp, console->readPauseTimer);
+        console->readPauseTimer = -1;
+    }
+    console->gotReadPause = 0;
+    if ((console->fd >= 0) && !console->gotEOF) {
+        tpoll_set_arg(console->tp, console->fd, POLLIN, console);
+    }
+    DPRINTF((15, "Resumed reading [%s].\n", console->name));
+    return;
+}
+
+
+static void resume_client_consoles(obj_t *client)
+{
+/*  Resumes reading each console paused on behalf of the (client) once it
+ *    has drained half of its output queue (or is being shut down), unless
+ *    the console is still held back by another client.
+ *
+ *  XXX: This routine must only be called by the client obj's i/o thread.
+ */
+    obj_t **set;
+    obj_t *console;
+    int isShutdown;
+    int k;
+
+    if (client->aux.client.overflow != CONMAN_OVERFLOW_BLOCK) {
+        return;
+    }
+    isShutdown = (client->fd < 0);
+    if (!isShutdown
+            && (client->aux.client.numSegBytes > client->bufSize / 2)) {
+        return;
+    }
+    set = x_atomic_load_ptr(&client->writerSet);
+    for (k = 0; set && (console = set[k]); k++) {
+        if (!is_console_obj(console) || (console->tp != client->tp)
+                || !console->gotReadPause) {
+            continue;
+        }
+        if (isShutdown || !is_console_read_blocked(console)) {
+            resume_console_read(console);
+        }
+    }
+    return;
+}
+
+
+static unsigned char * get_obj_buf(int size)
+{
+/*  Returns a circular-buffer of the given 'size',
+ *    reusing a free buf from the slab of that size if possible.
+ */
+    obj_buf_slab_t *slab;
+    unsigned char *buf = NULL;
+
+    assert(size >= (int) sizeof(void *));
+
+    x_pthread_mutex_lock(&bufSlabLock);
+    for (slab = bufSlabs; slab != NULL; slab = slab->next) {
+        if (slab->size == size) {
+            break;
+        }
+    }
+    if ((slab != NULL) && (slab->freeList != NULL)) {
+        buf = slab->freeList;
+        slab->freeList = *((void **) buf);
+        slab->numFree--;
+    }
+    x_pthread_mutex_unlock(&bufSlabLock);
+
+    if (!buf && !(buf = malloc(size))) {
+        out_of_memory();
+    }
+    return(buf);
+}
+
+
+static void put_obj_buf(unsigned char *buf, int size)
+{
+/*  Returns the circular-buffer 'buf' of the given 'size' to its slab
+ *    (or frees it if the slab is full).
+ */
+    obj_buf_slab_t *slab;
+
+    assert(buf != NULL);
+
+    x_pthread_mutex_lock(&bufSlabLock);
+    for (slab = bufSlabs; slab != NULL; slab = slab->next) {
+        if (slab->size == size) {
+            break;
+        }
+    }
+    if (!slab) {
+        if (!(slab = malloc(sizeof(obj_buf_slab_t)))) {
+            out_of_memory();
+        }
+        slab->size = size;
+        slab->numFree = 0;
+        slab->freeList = NULL;
+        slab->next = bufSlabs;
+        bufSlabs = slab;
+    }
+    if (slab->numFree < OBJ_BUF_POOL_MAX) {
+        *((void **) buf) = slab->freeList;
+        slab->freeList = buf;
+        slab->numFree++;
+        buf = NULL;
+    }
+    x_pthread_mutex_unlock(&bufSlabLock);
+
+    if (buf != NULL) {
+        free(buf);
+    }
+    return;
+}
+
+
+static void release_obj_buf(obj_t *obj)
+{
+/*  Releases the obj's circular-buffer (if allocated), discarding its data.
+ *
+ *  XXX: This routine must only be called by the obj's i/o thread
+ *    (or once the obj is no longer accessible by other threads).
+ */
+    if (obj->buf != NULL) {
+        put_obj_buf(obj->buf, obj->bufSize);
+    }
+    obj->buf = obj->bufInPtr = obj->bufOutPtr = NULL;
+    obj->gotBufWrap = 0;
+    return;
+}
+
+
+obj_chunk_t * get_obj_chunk(void)
+{
+/*  Returns an empty chunk (from the free pool if possible)
+ *    with a single ref held by the caller.
+ */
+    obj_chunk_t *chunk;
+
+    x_pthread_mutex_lock(&chunkLock);
+    if ((chunk = chunkPool)) {
+        chunkPool = chunk->next;
+        numChunksPooled--;
+    }
+    x_pthread_mutex_unlock(&chunkLock);
+
+    if (!chunk && !(chunk = malloc(sizeof(obj_chunk_t)))) {
+        out_of_memory();
+    }
+    chunk->next = NULL;
+    chunk->refCount = 1;
+    chunk->len = 0;
+    timerclear(&chunk->tGen);
+    return(chunk);
+}
+
+
+void put_obj_chunk(obj_chunk_t *chunk)
+{
+/*  Releases a ref to the 'chunk'.  Once the last ref has been released,
+ *    the chunk is returned to the free pool (or freed if the pool is full).
+ */
+    int n;
+
+    assert(chunk != NULL);
+
+    x_pthread_mutex_lock(&chunkLock);
+    assert(chunk->refCount > 0);
+    n = --chunk->refCount;
+    if ((n == 0) && (numChunksPooled < OBJ_CHUNK_POOL_MAX)) {
+        chunk->next = chunkPool;
+        chunkPool = chunk;
+        numChunksPooled++;
+        chunk = NULL;
+    }
+    x_pthread_mutex_unlock(&chunkLock);
+
+    if ((n == 0) && (chunk != NULL)) {
+        free(chunk);
+    }
+    return;
+}
+
+
+void write_obj_readers(obj_t *obj, obj_chunk_t *chunk, int len)
+{
+/*  Writes (len) bytes of data from the shared (chunk) into the buffer
+ *    of each obj in the obj's "readers" list.
+ *  Client readers take a ref to the chunk instead of copying the data.
+ *    Logfile readers always receive a copy since their data may be
+ *    transformed and must remain in their circular-buffer for replay.
+ *    A forward reader copies the data into a record for the console.
+ *  If the obj is a console with a replay ring, the data is first copied
+ *    into its ring.  A client replaying the ring is then caught up from
+ *    the ring instead of receiving the data directly.
+ *
+ *  XXX: This routine must only be called by the obj's i/o thread.
+ */
+    obj_t **set;
+    obj_t *reader;
+    int k;
+
+    assert(obj != NULL);
+    assert(chunk != NULL);
+    assert((len > 0) && (len < OBJ_CHUNK_SIZE));
+
+    chunk->len = len;
+    x_counter_add(&obj->stats.bytesRead, len);
+
+    if (obj->ring) {
+        write_replay_ring(obj, chunk->data, len);
+    }
+    set = x_atomic_load_ptr(&obj->readerSet);
+    for (k = 0; set && (reader = set[k]); k++) {
+
+        if (is_logfile_obj(reader)) {
+            write_log_data(reader, chunk->data, len);
+        }
+        else if (is_forward_obj(reader)) {
+            write_forward_data(reader, obj, chunk->data, len);
+        }
+        else if (is_client_obj(reader) && reader->aux.client.gotReplay) {
+            replay_client_data(reader);
+        }
+        else {
+            if (is_client_obj(reader)) {
+                PROBE4(obj_deliver, obj, obj->name, reader, len);
+            }
+            write_obj_buf(reader, chunk->data, len, 0, chunk, obj->muxId);
+        }
+    }
+    return;
+}
+
+
+int write_obj_data(obj_t *obj, const void *src, int len, int isInfo)
+{
+/*  Writes the buffer (src) of length (len) into the object's (obj)
+ *    circular-buffer.  If (isInfo) is true, the data is considered
+ *    an informational message which a client may suppress.
+ *  Returns the number of bytes written.
+ *
+ *  Note that this routine can write at most (bufSize - 1) bytes
+ *    of data into the object's circular-buffer.
+ */
+    return(write_obj_buf(obj, src, len, isInfo, NULL, CONMAN_MUX_ID_CTRL));
+}
+
+
+int write_obj_console_data(obj_t *obj, obj_t *console,
+    const void *src, int len, int isInfo)
+{
+/*  Writes the buffer (src) of length (len) regarding the (console)
+ *    into the object's (obj) circular-buffer.  If (obj) is a multiplexed
+ *    client or a forward obj, the data is sent in records for that console.
+ *    O/w, this is identical to write_obj_data().
+ *  Returns the number of bytes written.
+ */
+    assert(is_console_obj(console));
+
+    if (is_forward_obj(obj)) {
+        return(write_forward_data(obj, console, src, len));
+    }
+    return(write_obj_buf(obj, src, len, isInfo, NULL, console->muxId));
+}
+
+
+static int write_obj_buf(obj_t *obj, const void *src, int len, int isInfo,
+    obj_chunk_t *chunk, unsigned int id)
+{
+/*  Writes the buffer (src) of length (len) into the object's (obj)
+ *    circular-buffer (or output queue if it is a client obj).
+ *    If (chunk) is non-null, (src) resides within this shared chunk
+ *    and a client obj may reference it instead of copying the data.
+ *    The console (id) is only used by multiplexed client objs.
+ *  Only the obj's i/o thread writes directly into its buffer.  If called
+ *    from any other thread (or while data from other threads is still
+ *    pending, so as not to reorder it), the data is queued as pending.
+ *  Returns the number of bytes written.
+ */
+    int over;
+
+    DPRINTF((20, "Entered write_obj_data: [%s]\n", obj->name));
+
+    if (!src || len <= 0) {
+        return(0);
+    }
+    /*  If the obj's gotEOF flag is set,
+     *    no more data can be written into its buffer.
+     */
+    if (obj->gotEOF) {
+        log_msg(LOG_INFO, "Attempted to write %d byte%s to [%s] after EOF",
+            len, (len == 1 ? "" : "s"), obj->name);
+        return(0);
+    }
+    /*  An obj's circular-buffer is empty when (bufInPtr == bufOutPtr).
+     *    Thus, it can hold at most (bufSize - 1) bytes of data.
+     */
+    if (len >= obj->bufSize) {
+        len = obj->bufSize - 1;
+    }
+    /*  Do nothing if this is an informational message
+     *    and the client has requested not to be bothered.
+     */
+    if (isInfo && is_client_obj(obj) && obj->aux.client.req->enableQuiet) {
+        return(0);
+    }
+    if (!is_obj_io_thread(obj)
+            || (x_atomic_load(&obj->numPendBytes) > 0)
+            || (is_client_obj(obj)
+                && !x_atomic_load(&obj->aux.client.isActive))) {
+        return(queue_obj_pending(obj, src, len, isInfo, id));
+    }
+    over = copy_obj_data(obj, src, len, chunk, id);
+
+    /*  Check to see if any buffered data was overwritten.
+     */
+    if (over > 0) {
+        note_obj_overwrite(obj, over);
+    }
     /*  Notify tpoll that data is available for writing
      *    unless it is a client obj that is currently suspended.
      */
     if (!is_client_obj(obj) || !obj->aux.client.gotSuspend) {
-        tpoll_set(tp_global, obj->fd, POLLOUT);
+        tpoll_set_arg(obj->tp, obj->fd, POLLOUT, obj);
+    }
+    /*  If an informational message has been added to the log,
+     *    re-initialize the console log's newline state.
+     */
+    if (isInfo && is_logfile_obj(obj)) {
+        obj->aux.logfile.lineState = CONMAN_LOG_LINE_INIT;
+    }
+    return(len);
+}
+
+
+static int copy_obj_data(obj_t *obj, const void *src, int len,
+    obj_chunk_t *chunk, unsigned int id)
+{
+/*  Copies the buffer (src) of length (len) into the object's (obj)
+ *    circular-buffer (or output queue if it is a client obj),
+ *    allocating the circular-buffer if needed.
+ *  Returns the number of bytes overwritten.
+ *
+ *  XXX: This routine must only be called by the obj's i/o thread.
+ */
+    int avail;
+    int over;
+    int n, m;
+
+    assert((len > 0) && (len < obj->bufSize));
+
+    /*  Assert the buffer's input and output ptrs are valid upon entry.
+     */
+    assert(validate_obj_buf(obj) >= 0);
+
+    if (is_client_obj(obj)) {
+        over = queue_client_data(obj, src, len, chunk, id);
+    }
+    else {
+        if (!obj->buf) {
+            obj->buf = get_obj_buf(obj->bufSize);
+            obj->bufInPtr = obj->bufOutPtr = obj->buf;
+        }
+        n = len;
+
+        /*  Calculate the number of bytes available before data is
+         *    overwritten.  Data in the circular-buffer will be overwritten
+         *    if needed since this routine must not block.
+         *  Since an obj's circular-buffer is empty when
+         *    (bufInPtr == bufOutPtr), subtract one byte to account for
+         *    this sentinel.
+         */
+        avail = obj->bufSize - 1 - num_bytes_buffered(obj);
+        over = MAX(len - avail, 0);
+
+        /*  Copy first chunk of data (ie, up to the end of the buffer).
+         */
+        m = MIN(len, &obj->buf[obj->bufSize] - obj->bufInPtr);
+        if (m > 0) {
+            memcpy(obj->bufInPtr, src, m);
+            n -= m;
+            src = (unsigned char *) src + m;
+            obj->bufInPtr += m;
+            /*
+             *  Do the hokey-pokey and perform a circular-buffer wrap-around.
+             */
+            if (obj->bufInPtr == &obj->buf[obj->bufSize]) {
+                obj->bufInPtr = obj->buf;
+                obj->gotBufWrap = 1;
+            }
+        }
+        /*  Copy second chunk of data (ie, from the beginning of the buffer).
+         */
+        if (n > 0) {
+            memcpy(obj->bufInPtr, src, n);
+            obj->bufInPtr += n;         /* Hokey-Pokey not needed here */
+        }
+        if (over > 0) {
+            obj->bufOutPtr = obj->bufInPtr + 1;
+            if (obj->bufOutPtr == &obj->buf[obj->bufSize]) {
+                obj->bufOutPtr = obj->buf;
+            }
+        }
+    }
+    /*  Assert the buffer's input and output ptrs are valid upon exit.
+     */
+    assert(validate_obj_buf(obj) >= 0);
+
+    return(over);
+}
+
+
+static int queue_obj_pending(obj_t *obj, const void *src, int len,
+    int isInfo, unsigned int id)
+{
+/*  Appends a copy of the buffer (src) of length (len) to the obj's pending
+ *    queue, and notifies the obj's i/o thread to drain it.
+ *  The oldest pending writes will be discarded if needed to keep at most
+ *    (bufSize - 1) bytes pending since this routine must not block.
+ *    These are accounted for by the i/o thread when the queue is drained.
+ *  Returns the number of bytes written.
+ */
+    obj_pend_t *pend;
+    obj_pend_t *old;
+    int over = 0;
+    int isReady;
+
+    if (!(pend = malloc(sizeof(obj_pend_t) + len))) {
+        out_of_memory();
+    }
+    pend->next = NULL;
+    pend->len = len;
+    pend->isInfo = isInfo;
+    pend->id = id;
+    pend->data = (unsigned char *) (pend + 1);
+    memcpy(pend->data, src, len);
+
+    x_pthread_mutex_lock(&obj->bufLock);
+    while (obj->pendHead && (obj->numPendBytes + len > obj->bufSize - 1)) {
+        old = obj->pendHead;
+        obj->pendHead = old->next;
+        obj->numPendBytes -= old->len;
+        over += old->len;
+        free(old);
+    }
+    obj->numPendOver += over;
+    if (!obj->pendHead) {
+        obj->pendHead = pend;
+    }
+    else {
+        obj->pendTail->next = pend;
+    }
+    obj->pendTail = pend;
+    x_atomic_store(&obj->numPendBytes, obj->numPendBytes + len);
+    isReady = !is_client_obj(obj)
+        || x_atomic_load(&obj->aux.client.isActive);
+    x_pthread_mutex_unlock(&obj->bufLock);
+
+    /*  The i/o thread drains the pending queue when the fd is writable.
+     *    An inactive client obj is instead drained once activated.
+     */
+    if (isReady) {
+        tpoll_set_arg(obj->tp, obj->fd, POLLOUT, obj);
+    }
+    return(len);
+}
+
+
+static void drain_obj_pending(obj_t *obj)
+{
+/*  Moves data from the obj's pending queue into its circular-buffer
+ *    (or output queue if it is a client obj).
+ *
+ *  XXX: This routine must only be called by the obj's i/o thread.
+ */
+    obj_pend_t *pend;
+    obj_pend_t *next;
+    int over = 0;
+
+    if (x_atomic_load(&obj->numPendBytes) == 0) {
+        return;
+    }
+    x_pthread_mutex_lock(&obj->bufLock);
+    pend = obj->pendHead;
+    obj->pendHead = obj->pendTail = NULL;
+    x_atomic_store(&obj->numPendBytes, 0);
+    over = obj->numPendOver;
+    obj->numPendOver = 0;
+    x_pthread_mutex_unlock(&obj->bufLock);
+
+    while (pend != NULL) {
+        next = pend->next;
+        over += copy_obj_data(obj, pend->data, pend->len, NULL, pend->id);
+        if (pend->isInfo && is_logfile_obj(obj)) {
+            obj->aux.logfile.lineState = CONMAN_LOG_LINE_INIT;
+        }
+        free(pend);
+        pend = next;
+    }
+    if (over > 0) {
+        note_obj_overwrite(obj, over);
+    }
+    return;
+}
+
+
+static void note_obj_overwrite(obj_t *obj, int over)
+{
+/*  Accounts for (over) bytes of the obj's buffered data having been
+ *    overwritten (or discarded).  A client is later sent an in-band notice
+ *    of the bytes dropped (refer to notify_client_drop()).
+ *  The log msg is aggregated so a slow client is reported at most once
+ *    every OBJ_OVERWRITE_NOTICE_SECS instead of upon every write.
+ *    If (over) is 0, any bytes not yet reported are logged now.
+ *  The output dropped while a client is suspended is not logged.
+ *
+ *  XXX: This routine must only be called by the obj's i/o thread.
+ */
+    time_t now;
+
+    if (over > 0) {
+        PROBE3(obj_overwrite, obj, obj->name, over);
+        add_test_bench_overwrite(over);
+        x_counter_add(&obj->stats.bytesOverwritten, over);
+        if (is_client_obj(obj)) {
+            obj->aux.client.numDropped += over;
+        }
+        if (!is_client_obj(obj) || !obj->aux.client.gotSuspend) {
+            obj->numOverNotice += over;
+        }
+    }
+    if (obj->numOverNotice == 0) {
+        return;
+    }
+    now = time(NULL);
+    if ((over > 0) && (now >= obj->tOverNotice)
+            && (now - obj->tOverNotice < OBJ_OVERWRITE_NOTICE_SECS)) {
+        return;
+    }
+    log_msg(LOG_NOTICE, "Overwrote %lu bytes for \"%s\"",
+        obj->numOverNotice, obj->name);
+    obj->numOverNotice = 0;
+    obj->tOverNotice = now;
+    return;
+}
+
+
+static int queue_client_data(obj_t *client, const unsigned char *src, int len,
+    obj_chunk_t *chunk, unsigned int id)
+{
+/*  Appends the buffer (src) of length (len) to the client's output queue.
+ *    If (chunk) is non-null and (len) is large enough to be worth sharing,
+ *    a ref to the chunk is queued; o/w, the data is copied into the
+ *    client's private chunk at the tail of the queue.
+ *  Data at the head of the queue will be overwritten if needed to keep
+ *    at most (bufSize - 1) bytes queued since this routine must not block.
+ *    But if the client has the SPILL overflow policy, data that does not
+ *    fit is instead appended to its spill file; and while the spill file
+ *    holds data, new data is appended there as well to preserve its order.
+ *  If the client is multiplexed, the data is instead queued in records
+ *    for the console (id).
+ *  Returns the number of bytes overwritten (or discarded).
+ *
+ *  XXX: This routine must only be called by the client obj's i/o thread.
+ */
+    client_obj_t *auxp;
+    int over;
+
+    assert(is_client_obj(client));
+    assert((len > 0) && (len < client->bufSize));
+
+    auxp = &client->aux.client;
+    if (auxp->mux) {
+        return(queue_client_records(client, src, len, chunk, id));
+    }
+    over = MAX(auxp->numSegBytes + len - (client->bufSize - 1), 0);
+    if ((auxp->spillIn > auxp->spillOut)
+            || ((auxp->overflow == CONMAN_OVERFLOW_SPILL)
+                && ((over > 0) || (auxp->numSegs + 2 > OBJ_SEGS_MAX)))) {
+        return(spill_client_data(client, NULL, 0, src, len));
+    }
+    if (over > 0) {
+        (void) drop_client_data(client, over);
+    }
+    if ((chunk != NULL) && (len >= OBJ_CHUNK_MIN_SHARE)) {
+        share_client_chunk(client, src, len, chunk, &over);
+        return(over);
+    }
+    copy_client_data(client, src, len, &over);
+    return(over);
+}
+
+
+static int queue_client_records(obj_t *client, const unsigned char *src,
+    int len, obj_chunk_t *chunk, unsigned int id)
+{
+/*  Appends the buffer (src) of length (len) to the multiplexed client's
+ *    output queue as records for the console (id).
+ *  Each header is copied into a private chunk; the payload then shares
+ *    the (chunk) when worthwhile, as for queue_client_data().  Since
+ *    dropping part of a record would corrupt the framing of the stream,
+ *    a record that does not fit is discarded instead of overwriting the
+ *    queue (or spilled, as for queue_client_data()).
+ *  Returns the number of bytes discarded.
+ *
+ *  XXX: This routine must only be called by the client obj's i/o thread.
+ */
+    client_obj_t *auxp;
+    unsigned char hdr[CONMAN_MUX_HDR_LEN];
+    int over = 0;
+    int n, m;
+
+    auxp = &client->aux.client;
+    while (len > 0) {
+        m = MIN(len, CONMAN_MUX_MAX_LEN);
+        n = CONMAN_MUX_HDR_LEN + m;
+        hdr[0] = (id >> 24) & 0xFF;
+        hdr[1] = (id >> 16) & 0xFF;
+        hdr[2] = (id >> 8) & 0xFF;
+        hdr[3] = id & 0xFF;
+        hdr[4] = (m >> 8) & 0xFF;
+        hdr[5] = m & 0xFF;
+        if ((auxp->spillIn > auxp->spillOut)
+                || (auxp->numSegBytes + n > client->bufSize - 1)
+                || (auxp->numSegs + (n / OBJ_CHUNK_SIZE) + 2 > OBJ_SEGS_MAX)) {
+            if (auxp->overflow != CONMAN_OVERFLOW_SPILL) {
+                return(over + len);
+            }
+            over += spill_client_data(client, hdr, sizeof(hdr), src, m);
+            src += m;
+            len -= m;
+            continue;
+        }
+        copy_client_data(client, hdr, sizeof(hdr), &over);
+        if ((chunk != NULL) && (m >= OBJ_CHUNK_MIN_SHARE)) {
+            share_client_chunk(client, src, m, chunk, &over);
+        }
+        else {
+            copy_client_data(client, src, m, &over);
+        }
+        src += m;
+        len -= m;
+    }
+    return(over);
+}
+
+
+static void share_client_chunk(obj_t *client, const unsigned char *src,
+    int len, obj_chunk_t *chunk, int *overwritten)
+{
+/*  Appends a seg referencing the buffer (src) of length (len) within the
+ *    shared (chunk) to the tail of the client's output queue.
+ *  If a seg is dropped to make room in the queue, the number of bytes
+ *    it contained is added to (overwritten).
+ *
+ *  XXX: This routine must only be called by the client obj's i/o thread.
+ */
+    obj_seg_t *seg;
+
+    seg = append_client_seg(client, overwritten);
+    x_pthread_mutex_lock(&chunkLock);
+    chunk->refCount++;
+    x_pthread_mutex_unlock(&chunkLock);
+    seg->chunk = chunk;
+    seg->ptr = (unsigned char *) src;
+    seg->len = len;
+    seg->isPrivate = 0;
+    client->aux.client.numSegBytes += len;
+    return;
+}
+
+
+static void copy_client_data(obj_t *client, const unsigned char *src, int len,
+    int *overwritten)
+{
+/*  Copies the buffer (src) of length (len) into the private chunk(s)
+ *    at the tail of the client's output queue.
+ *  If a seg is dropped to make room in the queue, the number of bytes
+ *    it contained is added to (overwritten).
+ *
+ *  XXX: This routine must only be called by the client obj's i/o thread.
+ */
+    client_obj_t *auxp;
+    obj_seg_t *seg;
+    int m;
+
+    auxp = &client->aux.client;
+    while (len > 0) {
+        seg = NULL;
+        if (auxp->numSegs > 0) {
+            seg = &auxp->segs[(auxp->segHead + auxp->numSegs - 1)
+                % OBJ_SEGS_MAX];
+        }
+        if (!seg || !seg->isPrivate || (seg->chunk->len == OBJ_CHUNK_SIZE)) {
+            seg = append_client_seg(client, overwritten);
+            seg->chunk = get_obj_chunk();
+            seg->ptr = seg->chunk->data;
+            seg->len = 0;
+            seg->isPrivate = 1;
+        }
+        /*  The private chunk's data always ends at the tail of its seg.
+         */
+        assert(seg->ptr + seg->len == &seg->chunk->data[seg->chunk->len]);
+        m = MIN(len, OBJ_CHUNK_SIZE - seg->chunk->len);
+        memcpy(&seg->chunk->data[seg->chunk->len], src, m);
+        seg->chunk->len += m;
+        seg->len += m;
+        auxp->numSegBytes += m;
+        src += m;
+        len -= m;
+    }
+    return;
+}
+
+
+static obj_seg_t * append_client_seg(obj_t *client, int *overwritten)
+{
+/*  Appends an empty seg to the tail of the client's output queue.
+ *    If the queue is full, the seg at its head is dropped and the number
+ *    of bytes it contained is added to (overwritten).
+ *  Returns a ptr to the new seg.
+ *
+ *  XXX: This routine must only be called by the client obj's i/o thread.
+ */
+    client_obj_t *auxp;
+    obj_seg_t *seg;
+
+    auxp = &client->aux.client;
+    if (auxp->numSegs == OBJ_SEGS_MAX) {
+        *overwritten += drop_client_data(client,
+            auxp->segs[auxp->segHead].len);
+        /*
+         *  A head seg that is already empty still needs to be removed.
+         */
+        if (auxp->numSegs == OBJ_SEGS_MAX) {
+            seg = &auxp->segs[auxp->segHead];
+            put_obj_chunk(seg->chunk);
+            auxp->segHead = (auxp->segHead + 1) % OBJ_SEGS_MAX;
+            auxp->numSegs--;
+        }
+    }
+    seg = &auxp->segs[(auxp->segHead + auxp->numSegs) % OBJ_SEGS_MAX];
+    auxp->numSegs++;
+    return(seg);
+}
+
+
+static void sample_client_latency(obj_t *client, int len)
+{
+/*  Samples the test bench latency of each shared chunk of benchmark data
+ *    whose seg at the head of the client's output queue is completed by
+ *    writing (len) bytes.  This must be called before the bytes written
+ *    are removed via drop_client_data().
+ *
+ *  XXX: This routine must only be called by the client obj's i/o thread.
+ */
+    client_obj_t *auxp;
+    obj_seg_t *seg;
+    int k;
+
+    auxp = &client->aux.client;
+    for (k = 0; k < auxp->numSegs; k++) {
+        seg = &auxp->segs[(auxp->segHead + k) % OBJ_SEGS_MAX];
+        if (seg->len > len) {
+            break;
+        }
+        len -= seg->len;
+        if (!seg->isPrivate && timerisset(&seg->chunk->tGen)) {
+            add_test_bench_latency(&seg->chunk->tGen);
+        }
+    }
+    return;
+}
+
+
+static int drop_client_data(obj_t *client, int len)
+{
+/*  Removes up to (len) bytes of data from the head of the client's
+ *    output queue, releasing the chunk refs of segs that are emptied.
+ *  Returns the number of bytes removed.
+ *
+ *  XXX: This routine must only be called by the client obj's i/o thread
+ *    (or once the obj is no longer accessible by other threads).
+ */
+    client_obj_t *auxp;
+    obj_seg_t *seg;
+    int n = 0;
+    int m;
+
+    auxp = &client->aux.client;
+    while ((len > 0) && (auxp->numSegs > 0)) {
+        seg = &auxp->segs[auxp->segHead];
+        m = MIN(len, seg->len);
+        seg->ptr += m;
+        seg->len -= m;
+        auxp->numSegBytes -= m;
+        len -= m;
+        n += m;
+        if (seg->len == 0) {
+            put_obj_chunk(seg->chunk);
+            seg->chunk = NULL;
+            auxp->segHead = (auxp->segHead + 1) % OBJ_SEGS_MAX;
+            auxp->numSegs--;
+        }
+    }
+    return(n);
+}
+
+
+static int spill_client_data(obj_t *client, const unsigned char *hdr,
+    int hdrLen, const unsigned char *src, int len)
+{
+/*  Appends the buffer (src) of length (len) to the client's spill file,
+ *    preceded by the record header (hdr) of length (hdrLen) if non-null.
+ *    The spill file is created upon the first spill, and it is unlinked
+ *    so it is removed once closed.  Spilled data is moved back into the
+ *    client's output queue by refill_client_data() as the queue drains.
+ *  The data is discarded if the spill file would exceed CLIENT_SPILL_MAX
+ *    bytes, or if spilling has been disabled due to an error.  Once full,
+ *    all data is discarded until the spill file has been emptied so the
+ *    spilled output has at most one gap.
+ *  Returns the number of bytes discarded.
+ *
+ *  XXX: This routine must only be called by the client obj's i/o thread.
+ */
+    client_obj_t *auxp;
+    char name[MAX_LINE];
+
+    auxp = &client->aux.client;
+    if ((auxp->overflow != CONMAN_OVERFLOW_SPILL) || auxp->gotSpillFull) {
+        return(len);
+    }
+    if (auxp->spillIn + hdrLen + len > CLIENT_SPILL_MAX) {
+        auxp->gotSpillFull = 1;
+        return(len);
+    }
+    if (auxp->spillFd < 0) {
+        snprintf(name, sizeof(name), "%sconmand.XXXXXX", _PATH_TMP);
+        if ((auxp->spillFd = mkstemp(name)) < 0) {
+            log_msg(LOG_WARNING, "Unable to create spill file for [%s]: %s",
+                client->name, strerror(errno));
+            auxp->overflow = CONMAN_OVERFLOW_DROP;
+            return(len);
+        }
+        (void) unlink(name);
+        set_fd_closed_on_exec(auxp->spillFd);
+    }
+    if (((hdrLen > 0)
+            && (write_client_spill(auxp->spillFd, hdr, hdrLen,
+                auxp->spillIn) < 0))
+            || (write_client_spill(auxp->spillFd, src, len,
+                auxp->spillIn + hdrLen) < 0)) {
+        log_msg(LOG_WARNING, "Unable to spill output for [%s]: %s",
+            client->name, strerror(errno));
+        auxp->overflow = CONMAN_OVERFLOW_DROP;
+        return(len);
+    }
+    auxp->spillIn += hdrLen + len;
+    return(0);
+}
+
+
+static int write_client_spill(int fd, const void *src, int len, off_t off)
+{
+/*  Writes the buffer (src) of length (len) to the spill file (fd)
+ *    at offset (off).
+ *  Returns 0 on success, or -1 on error (with errno set).
+ */
+    int n;
+
+    while (len > 0) {
+        if ((n = pwrite(fd, src, len, off)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return(-1);
+        }
+        if (n == 0) {
+            errno = ENOSPC;
+            return(-1);
+        }
+        src = (const unsigned char *) src + n;
+        len -= n;
+        off += n;
     }
-    /*  Assert the buffer's input and output ptrs are valid upon exit.
-     */
-    assert(obj->bufInPtr >= obj->buf);
-    assert(obj->bufInPtr < &obj->buf[OBJ_BUF_SIZE]);
-    assert(obj->bufOutPtr >= obj->buf);
-    assert(obj->bufOutPtr < &obj->buf[OBJ_BUF_SIZE]);
+    return(0);
+}
 
-    x_pthread_mutex_unlock(&obj->bufLock);
 
-    /*  If an informational message has been added to the log,
-     *    re-initialize the console log's newline state.
+static int refill_client_data(obj_t *client)
+{
+/*  Moves data from the client's spill file back into its output queue
+ *    for as long as the queue has room.  Once the spill file has been
+ *    emptied, it is truncated for reuse.
+ *  Returns 0 on success, or -1 if the client is ready to be shut down.
+ *
+ *  XXX: This routine must only be called by the client obj's i/o thread.
+ */
+    client_obj_t *auxp;
+    unsigned char buf[OBJ_CHUNK_SIZE];
+    int over = 0;
+    int n;
+
+    auxp = &client->aux.client;
+    if (auxp->spillIn == 0) {
+        return(0);
+    }
+    while ((auxp->spillOut < auxp->spillIn)
+            && (auxp->numSegs + 2 <= OBJ_SEGS_MAX)) {
+        n = MIN(client->bufSize - 1 - auxp->numSegBytes, OBJ_CHUNK_SIZE);
+        n = MIN(n, auxp->spillIn - auxp->spillOut);
+        if (n <= 0) {
+            break;
+        }
+        if ((n = pread(auxp->spillFd, buf, n, auxp->spillOut)) <= 0) {
+            if ((n < 0) && (errno == EINTR)) {
+                continue;
+            }
+            log_msg(LOG_WARNING, "Unable to read spilled output for [%s]: %s",
+                client->name, (n < 0 ? strerror(errno) : "Unexpected EOF"));
+            return(-1);
+        }
+        copy_client_data(client, buf, n, &over);
+        auxp->spillOut += n;
+    }
+    assert(over == 0);
+
+    if (auxp->spillOut == auxp->spillIn) {
+        auxp->spillIn = auxp->spillOut = 0;
+        auxp->gotSpillFull = 0;
+        if (ftruncate(auxp->spillFd, 0) < 0) {
+            log_msg(LOG_WARNING, "Unable to truncate spill file for [%s]: %s",
+                client->name, strerror(errno));
+        }
+    }
+    return(0);
+}
+
+
+void replay_client_data(obj_t *client)
+{
+/*  Copies output from the replay ring of the client's console into the
+ *    client's output queue for as long as the queue has room, resuming
+ *    the replay started by perform_log_replay().  Since the ring retains
+ *    the console's output as it arrives, the client is caught up from the
+ *    ring until the replay ends (refer to write_obj_readers()).  Output
+ *    overwritten in the ring before it could be replayed is dropped.
+ *  The replay waits for spilled or pending output queued before it began.
+ *
+ *  XXX: This routine must only be called by the client obj's i/o thread
+ *    (which also muxes its console).
+ */
+    client_obj_t *auxp;
+    obj_t *console;
+    off_t start, end;
+    const unsigned char *p;
+    char buf[MAX_LINE];
+    int over = 0;
+    int n;
+
+    auxp = &client->aux.client;
+    if (!auxp->gotReplay || (auxp->spillIn > auxp->spillOut)
+            || (x_atomic_load(&client->numPendBytes) > 0)) {
+        return;
+    }
+    console = list_peek(client->writers);
+    if (!console || (get_replay_ring_range(console, &start, &end) < 0)) {
+        auxp->gotReplay = 0;
+        return;
+    }
+    if (auxp->replayPos < start) {
+        auxp->numDropped += start - auxp->replayPos;
+        auxp->replayPos = start;
+    }
+    while ((auxp->replayPos < end) && (auxp->numSegs + 2 <= OBJ_SEGS_MAX)) {
+        n = MIN(client->bufSize - 1 - auxp->numSegBytes, OBJ_CHUNK_SIZE);
+        if (n <= 0) {
+            break;
+        }
+        n = get_replay_ring_data(console, auxp->replayPos, n, &p);
+        copy_client_data(client, p, n, &over);
+        auxp->replayPos += n;
+    }
+    assert(over == 0);
+
+    if (auxp->replayPos < end) {
+        if (!auxp->gotSuspend) {
+            tpoll_set_arg(client->tp, client->fd, POLLOUT, client);
+        }
+        return;
+    }
+    /*  The replay ends once its closing message fits in the queue
+     *    without overwriting the output replayed ahead of it.
      */
-    if (isInfo && is_logfile_obj(obj)) {
-        obj->aux.logfile.lineState = CONMAN_LOG_LINE_INIT;
+    n = snprintf(buf, sizeof(buf), "%sEnd log replay of console [%s]%s",
+        CONMAN_MSG_PREFIX, console->name, CONMAN_MSG_SUFFIX);
+    if ((n < 0) || (n >= (int) sizeof(buf))) {
+        auxp->gotReplay = 0;
+        return;
+    }
+    if ((n >= client->bufSize - 1 - auxp->numSegBytes)
+            || (auxp->numSegs + 2 > OBJ_SEGS_MAX)) {
+        return;
+    }
+    auxp->gotReplay = 0;
+    write_obj_data(client, buf, n, 0);
+    return;
+}
+
+
+static void notify_client_drop(obj_t *client)
+{
+/*  Informs the client of the number of bytes of its output that have been
+ *    dropped since it was last notified.  The notice is written in-band
+ *    once the client has caught up (ie, its queue is at most half full
+ *    and it has no spilled data) so it will not be dropped as well.
+ *    A multiplexed client receives it as a ctrl msg.
+ *
+ *  XXX: This routine must only be called by the client obj's i/o thread.
+ */
+    client_obj_t *auxp;
+    unsigned long n;
+    char buf[MAX_LINE];
+
+    auxp = &client->aux.client;
+    if ((auxp->numDropped == 0) || auxp->gotSuspend
+            || (auxp->spillIn > auxp->spillOut)
+            || (auxp->numSegBytes > client->bufSize / 2)) {
+        return;
+    }
+    n = auxp->numDropped;
+    auxp->numDropped = 0;
+
+    if (auxp->mux) {
+        announce_client_drop(client, n);
+    }
+    else {
+        snprintf(buf, sizeof(buf),
+            "%sDropped %lu byte%s of console output%s",
+            CONMAN_MSG_PREFIX, n, (n == 1 ? "" : "s"), CONMAN_MSG_SUFFIX);
+        write_obj_data(client, buf, strlen(buf), 1);
+    }
+    return;
+}
+
+
+#if WITH_ZLIB
+static void create_client_zstream(obj_t *client)
+{
+/*  Creates the zlib stream for compressing the output of the client obj.
+ *  The fastest compression level is used since console output is mostly
+ *    small writes of text that compress well regardless.
+ */
+    z_stream *z;
+
+    if (!(z = malloc(sizeof(z_stream)))) {
+        out_of_memory();
     }
+    memset(z, 0, sizeof(*z));
+    if (deflateInit2(z, CLIENT_ZIP_LEVEL, Z_DEFLATED,
+      CONMAN_ZIP_WINDOW_BITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        out_of_memory();
+    }
+    client->aux.client.zstream = z;
+    return;
+}
+
+
+static int write_client_zdata(obj_t *client, struct iovec *iov, int iovcnt)
+{
+/*  Writes the data described by (iov) out to the client's fd compressed.
+ *  If compressed output from a previous call is still pending, it is
+ *    written first; no more data is compressed until it has all been
+ *    written, so a stalled client still backs up its output queue.
+ *  Returns the number of bytes of (iov) consumed, or -1 on error
+ *    (with errno set).
+ */
+    client_obj_t *auxp;
+    int nIn = 0;
+    int n;
+
+    auxp = &client->aux.client;
+    if ((auxp->zBufLen == 0) && (iovcnt > 0)) {
+        if ((nIn = compress_client_iov(client, iov, iovcnt)) < 0) {
+            errno = EIO;
+            return(-1);
+        }
+    }
+    while (auxp->zBufOff < auxp->zBufLen) {
+        n = write(client->fd, auxp->zBuf + auxp->zBufOff,
+            auxp->zBufLen - auxp->zBufOff);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((nIn > 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+                return(nIn);
+            }
+            return(-1);
+        }
+        auxp->zBufOff += n;
+    }
+    auxp->zBufLen = 0;
+    auxp->zBufOff = 0;
+    return(nIn);
+}
+
+
+static int compress_client_iov(obj_t *client, struct iovec *iov, int iovcnt)
+{
+/*  Compresses all of the data described by (iov) into the client's zBuf,
+ *    ending with a sync flush so the client can display all of it.
+ *  Returns the number of bytes compressed, or -1 on error.
+ */
+    client_obj_t *auxp;
+    z_stream *z;
+    int len = 0;
+    int size;
+    int k;
+    int rc;
+
+    auxp = &client->aux.client;
+    z = auxp->zstream;
+
+    for (k = 0; k < iovcnt; k++) {
+        len += iov[k].iov_len;
+    }
+    size = deflateBound(z, len) + 64;
+    if (size > auxp->zBufSize) {
+        free(auxp->zBuf);
+        if (!(auxp->zBuf = malloc(size))) {
+            out_of_memory();
+        }
+        auxp->zBufSize = size;
+    }
+    z->next_out = auxp->zBuf;
+    z->avail_out = auxp->zBufSize;
+
+    for (k = 0; k <= iovcnt; k++) {
+        if (k < iovcnt) {
+            z->next_in = iov[k].iov_base;
+            z->avail_in = iov[k].iov_len;
+            rc = deflate(z, Z_NO_FLUSH);
+        }
+        else {
+            z->next_in = NULL;
+            z->avail_in = 0;
+            rc = deflate(z, Z_SYNC_FLUSH);
+        }
+        if (((rc != Z_OK) && (rc != Z_BUF_ERROR)) || (z->avail_in > 0)) {
+            log_msg(LOG_WARNING, "Unable to compress data for [%s]: %s",
+                client->name, (z->msg ? z->msg : "deflate failed"));
+            return(-1);
+        }
+    }
+    auxp->zBufLen = auxp->zBufSize - z->avail_out;
+    auxp->zBufOff = 0;
     return(len);
 }
+#endif /* WITH_ZLIB */
 
 
 int write_to_obj(obj_t *obj)
 {
-/*  Writes data from the obj's circular-buffer out to its file descriptor.
+/*  Writes data from the obj's circular-buffer (or output queue if it is
+ *    a client obj) out to its file descriptor.
  *  Returns 0 on success, or -1 if the obj is ready to be destroyed.
  */
-    struct iovec iov[2];
+    struct iovec iov[OBJ_SEGS_MAX];
     int iovcnt = 0;
+    obj_seg_t *seg;
     int isDead = 0;
+    int len;
     int n;
 
     DPRINTF((20, "Entered write_to_obj: [%s]\n", obj->name));
 
+    drain_obj_pending(obj);
+
     if (obj->fd < 0) {
         return(0);
     }
+    /*  A forward obj sends its own batches of records.
+     */
+    if (is_forward_obj(obj)) {
+        return(write_forward_obj(obj));
+    }
     /*  The completion of a nonblocking connect() makes the socket writable,
      *    so complete the telnet obj non-blocking connect here if needed.
      */
@@ -1097,46 +2883,70 @@ int write_to_obj(obj_t *obj)
         open_telnet_obj(obj);
         return(0);
     }
-    x_pthread_mutex_lock(&obj->bufLock);
-
+    /*  Another thread may have notified tpoll of pending data
+     *    while the client's output is suspended.
+     */
+    if (is_client_obj(obj) && obj->aux.client.gotSuspend) {
+        tpoll_clear(obj->tp, obj->fd, POLLOUT);
+        return(0);
+    }
     /*  Assert the buffer's input and output ptrs are valid upon entry.
      */
-    assert(obj->bufInPtr >= obj->buf);
-    assert(obj->bufInPtr < &obj->buf[OBJ_BUF_SIZE]);
-    assert(obj->bufOutPtr >= obj->buf);
-    assert(obj->bufOutPtr < &obj->buf[OBJ_BUF_SIZE]);
+    assert(validate_obj_buf(obj) >= 0);
 
-    /*  IOV for object buffer cases OIO (wrap-around pt1) & IO (no-wrap).
+    /*  IOV for each seg in a client obj's output queue.
      */
-    if (obj->bufOutPtr > obj->bufInPtr) {
-        iov[0].iov_base = obj->bufOutPtr;
-        iov[0].iov_len = &obj->buf[OBJ_BUF_SIZE] - obj->bufOutPtr;
-        iovcnt = 1;
-        /*
-         *  IOV for object buffer case OIO (wrap-around pt2).
-         */
-        if (obj->bufInPtr > obj->buf) {
-            iov[1].iov_base = obj->buf;
-            iov[1].iov_len = obj->bufInPtr - obj->buf;
-            iovcnt = 2;
+    if (is_client_obj(obj)) {
+        for (iovcnt = 0; iovcnt < obj->aux.client.numSegs; iovcnt++) {
+            seg = &obj->aux.client.segs[(obj->aux.client.segHead + iovcnt)
+                % OBJ_SEGS_MAX];
+            iov[iovcnt].iov_base = seg->ptr;
+            iov[iovcnt].iov_len = seg->len;
         }
     }
-    /*  IOV for object buffer cases IOI & OI.
+    /*  IOV for the obj's circular-buffer.
      */
-    else if (obj->bufInPtr > obj->bufOutPtr) {
-        iov[0].iov_base = obj->bufOutPtr;
-        iov[0].iov_len = obj->bufInPtr - obj->bufOutPtr;
-        iovcnt = 1;
+    else {
+        iovcnt = get_obj_buf_iov(obj, iov);
     }
-
-    if (iovcnt > 0) {
+    /*  Coalesce small writes to a logfile into larger ones.  Since this
+     *    returns before the check below, a logfile is only rotated after
+     *    its coalesced output has been written out.
+     */
+    if ((iovcnt > 0) && is_logfile_obj(obj)
+            && defer_log_write(obj, num_bytes_buffered(obj))) {
+        tpoll_clear(obj->tp, obj->fd, POLLOUT);
+        if ((x_atomic_load(&obj->numPendBytes) > 0)
+                || x_atomic_load(&obj->aux.logfile.isFlushForced)) {
+            tpoll_set_arg(obj->tp, obj->fd, POLLOUT, obj);
+        }
+        return(0);
+    }
+    /*  A compressing client obj may still hold compressed output
+     *    after its output queue has been emptied.
+     */
+    if ((len = num_bytes_buffered(obj)) > 0) {
 again:
-        n = writev(obj->fd, iov, iovcnt);
+        x_counter_add(&obj->stats.numWrites, 1);
+        if (is_logfile_obj(obj)) {
+            n = queue_log_write(obj, iov, iovcnt);
+        }
+#if WITH_ZLIB
+        else if (is_client_obj(obj) && obj->aux.client.zstream) {
+            n = write_client_zdata(obj, iov, iovcnt);
+        }
+#endif /* WITH_ZLIB */
+        else {
+            n = writev(obj->fd, iov, iovcnt);
+        }
         if (n < 0) {
             if (errno == EINTR) {
                 goto again;
             }
-            if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                x_counter_add(&obj->stats.numWriteBlocks, 1);
+            }
+            else {
                 /*
                  *  If an error occurs while writing to the obj's fd,
                  *    trigger a shutdown of the obj by setting 'isDead'.
@@ -1148,15 +2958,31 @@ again:
         }
         else if (n > 0) {
             DPRINTF((15, "Wrote %d bytes to [%s].\n", n, obj->name));
-            obj->bufOutPtr += n;
-            if (obj->bufOutPtr >= &obj->buf[OBJ_BUF_SIZE]) {
-                obj->bufOutPtr -= OBJ_BUF_SIZE;
+            PROBE4(obj_write, obj, obj->name, n, len);
+            if (n < len) {
+                PROBE4(obj_write_partial, obj, obj->name, n, len);
+            }
+            x_counter_add(&obj->stats.bytesWritten, n);
+            if (is_client_obj(obj)) {
+                if (is_test_bench_active()) {
+                    sample_client_latency(obj, n);
+                }
+                (void) drop_client_data(obj, n);
+                if (refill_client_data(obj) < 0) {
+                    isDead = 1;
+                }
+                replay_client_data(obj);
+                notify_client_drop(obj);
+                resume_client_consoles(obj);
+            }
+            else {
+                drop_obj_buf_data(obj, n);
             }
         }
     }
     /*  If all buffered data has been written out to the fd...
      */
-    if (obj->bufInPtr == obj->bufOutPtr) {
+    if (num_bytes_buffered(obj) == 0) {
         /*
          *  If the gotEOF flag is set, no additional data can be written into
          *    the buffer.  As such, the object is ready for shutdown.
@@ -1164,23 +2990,163 @@ again:
         if (obj->gotEOF) {
             isDead = 1;
         }
+        /*  A client that has caught up can again hold back its consoles.
+         */
+        if (is_client_obj(obj)) {
+            obj->aux.client.gotBlockExpired = 0;
+        }
+        /*  Release the empty buffer unless it is needed for log replay.
+         */
+        if (!is_logfile_obj(obj)) {
+            release_obj_buf(obj);
+        }
+        else {
+            end_log_flush(obj);
+        }
         /*  Notify tpoll that all available data has been written.
+         *    But re-check for data queued by another thread in the meantime
+         *    since its notification may have been cleared.
          */
-        tpoll_clear(tp_global, obj->fd, POLLOUT);
+        tpoll_clear(obj->tp, obj->fd, POLLOUT);
+        if (x_atomic_load(&obj->numPendBytes) > 0) {
+            tpoll_set_arg(obj->tp, obj->fd, POLLOUT, obj);
+        }
+    }
+    /*  Rotate the logfile once it has grown too large (or old).
+     */
+    if (is_logfile_obj(obj) && !isDead) {
+        check_logfile_rotation(obj);
     }
     /*  Assert the buffer's input and output ptrs are valid upon exit.
      */
-    assert(obj->bufInPtr >= obj->buf);
-    assert(obj->bufInPtr < &obj->buf[OBJ_BUF_SIZE]);
-    assert(obj->bufOutPtr >= obj->buf);
-    assert(obj->bufOutPtr < &obj->buf[OBJ_BUF_SIZE]);
-
-    x_pthread_mutex_unlock(&obj->bufLock);
+    assert(validate_obj_buf(obj) >= 0);
 
     return(isDead ? shutdown_obj(obj) : 0);
 }
 
 
+void flush_logfile_obj(obj_t *logfile)
+{
+/*  Queues the data buffered in the logfile obj for the log writers
+ *    regardless of any coalescing of its writes.  This is done before
+ *    the logfile is closed (or re-opened) so buffered output is not lost.
+ *  The writers are never waited on: if the logfile's write queue is full,
+ *    the rest of the data is left in its buffer.
+ */
+    struct iovec iov[2];
+    int iovcnt;
+    int n;
+
+    assert(is_logfile_obj(logfile));
+
+    while ((logfile->fd >= 0)
+            && ((iovcnt = get_obj_buf_iov(logfile, iov)) > 0)) {
+        if ((n = queue_log_write(logfile, iov, iovcnt)) < 0) {
+            log_msg(LOG_INFO, "Unable to write to [%s]: %s",
+                logfile->name, strerror(errno));
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+        x_counter_add(&logfile->stats.bytesWritten, n);
+        drop_obj_buf_data(logfile, n);
+    }
+    return;
+}
+
+
+void mark_console_up(obj_t *console)
+{
+/*  Records the (console) obj's connection being established, adding the
+ *    time since it went down to its down-time counter.
+ *  This is called when a console transitions into its UP state; it is
+ *    safe to call while the console is already up.
+ */
+    time_t tDown;
+    time_t now;
+
+    assert(console != NULL);
+    assert(is_console_obj(console));
+
+    tDown = x_counter_load(&console->stats.tDown);
+    if (tDown == 0) {
+        return;
+    }
+    now = time(NULL);
+    if (now > tDown) {
+        x_counter_add(&console->stats.secsDown,
+            (unsigned long) (now - tDown));
+    }
+    x_counter_store(&console->stats.tDown, 0);
+    x_counter_add(&console->stats.numConnects, 1);
+    return;
+}
+
+
+void mark_console_down(obj_t *console)
+{
+/*  Records the (console) obj's connection being lost.
+ *  This is called when a console leaves its UP state; it is safe to call
+ *    while the console is already down.
+ */
+    assert(console != NULL);
+    assert(is_console_obj(console));
+
+    if (x_counter_load(&console->stats.tDown) == 0) {
+        x_counter_store(&console->stats.tDown, time(NULL));
+    }
+    return;
+}
+
+
+static int get_obj_buf_iov(obj_t *obj, struct iovec *iov)
+{
+/*  Sets the (up to two) bufs of (iov) to describe the data buffered in the
+ *    obj's circular-buffer waiting to be written out to its fd.
+ *  Returns the number of bufs set.
+ */
+    int iovcnt = 0;
+
+    /*  IOV for object buffer cases OIO (wrap-around pt1) & IO (no-wrap).
+     */
+    if (obj->bufOutPtr > obj->bufInPtr) {
+        iov[0].iov_base = obj->bufOutPtr;
+        iov[0].iov_len = &obj->buf[obj->bufSize] - obj->bufOutPtr;
+        iovcnt = 1;
+        /*
+         *  IOV for object buffer case OIO (wrap-around pt2).
+         */
+        if (obj->bufInPtr > obj->buf) {
+            iov[1].iov_base = obj->buf;
+            iov[1].iov_len = obj->bufInPtr - obj->buf;
+            iovcnt = 2;
+        }
+    }
+    /*  IOV for object buffer cases IOI & OI.
+     */
+    else if (obj->bufInPtr > obj->bufOutPtr) {
+        iov[0].iov_base = obj->bufOutPtr;
+        iov[0].iov_len = obj->bufInPtr - obj->bufOutPtr;
+        iovcnt = 1;
+    }
+    return(iovcnt);
+}
+
+
+static void drop_obj_buf_data(obj_t *obj, int len)
+{
+/*  Advances the obj's circular-buffer output ptr past the (len) bytes
+ *    of data that have been written out to its fd.
+ */
+    obj->bufOutPtr += len;
+    if (obj->bufOutPtr >= &obj->buf[obj->bufSize]) {
+        obj->bufOutPtr -= obj->bufSize;
+    }
+    return;
+}
+
+
 static int num_bytes_buffered(obj_t *obj)
 {
 /*  Returns the number of bytes of buffered data in 'obj' waiting to be
@@ -1190,11 +3156,15 @@ static int num_bytes_buffered(obj_t *obj)
 
     assert(obj != NULL);
 
-    if (obj->bufInPtr >= obj->bufOutPtr) {
+    if (is_client_obj(obj)) {
+        n = obj->aux.client.numSegBytes
+            + (obj->aux.client.zBufLen - obj->aux.client.zBufOff);
+    }
+    else if (obj->bufInPtr >= obj->bufOutPtr) {
         n = obj->bufInPtr - obj->bufOutPtr;
     }
     else {
-        n = (&obj->buf[OBJ_BUF_SIZE] - obj->bufOutPtr) +
+        n = (&obj->buf[obj->bufSize] - obj->bufOutPtr) +
             (obj->bufInPtr - obj->buf);
     }
     return(n);
@@ -26,10 +26,15 @@
 #  include <config.h>
 #endif /* HAVE_CONFIG_H */
 
+#if HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+#  define _GNU_SOURCE                   /* for addclosefrom_np() prototype */
+#endif /* HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP */
+
 #include <assert.h>
 #include <errno.h>
 #include <limits.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -46,15 +51,17 @@
 #include "util-str.h"
 
 
+extern char **environ;
+
+
 static int search_exec_path(const char *path, const char *src,
     char *dst, int dstlen);
 static int  disconnect_process_obj(obj_t *process);
 static int  connect_process_obj(obj_t *process);
 static int  check_process_prog(obj_t *process);
+static int  spawn_process_prog(obj_t *process, int fd, pid_t *pid_ref);
 static void reset_process_delay(obj_t *process);
 
-extern tpoll_t tp_global;               /* defined in server.c */
-
 
 int is_process_dev(const char *dev, const char *cwd,
     const char *exec_path, char **path_ref)
@@ -153,7 +160,6 @@ obj_t * create_process_obj(server_conf_t *conf, char *name, List args,
  *    by main:open_objs:reopen_obj:open_process_obj().
  *  Returns the new object, or NULL on error.
  */
-    ListIterator   i;
     obj_t         *process;
     process_obj_t *auxp;
     int            num_args;
@@ -166,18 +172,11 @@ obj_t * create_process_obj(server_conf_t *conf, char *name, List args,
 
     /*  Check for duplicate console names.
      */
-    i = list_iterator_create(conf->objs);
-    while ((process = list_next(i))) {
-        if (is_console_obj(process) && !strcmp(process->name, name)) {
-            if ((errbuf != NULL) && (errlen > 0)) {
-                snprintf(errbuf, errlen,
-                    "console [%s] specifies duplicate console name", name);
-            }
-            break;
+    if (find_obj_index(conf->consoleIndex, name, CONMAN_OBJ_IS_CONSOLE)) {
+        if ((errbuf != NULL) && (errlen > 0)) {
+            snprintf(errbuf, errlen,
+                "console [%s] specifies duplicate console name", name);
         }
-    }
-    list_iterator_destroy(i);
-    if (process != NULL) {
         return(NULL);
     }
     process = create_obj(conf, name, -1, CONMAN_OBJ_PROCESS);
@@ -204,9 +203,10 @@ obj_t * create_process_obj(server_conf_t *conf, char *name, List args,
     else {
         auxp->prog = auxp->argv[0];
     }
-    /*  Add obj to the master conf->objs list.
+    /*  Add obj to the master conf->objs list and its indexes.
      */
     list_append(conf->objs, process);
+    insert_obj_index(conf->consoleIndex, process->name, process);
 
     return(process);
 }
@@ -227,7 +227,7 @@ int open_process_obj(obj_t *process)
     auxp = &(process->aux.process);
 
     if (auxp->timer >= 0) {
-        (void) tpoll_timeout_cancel(tp_global, auxp->timer);
+        (void) tpoll_timeout_cancel(process->tp, auxp->timer);
         auxp->timer = -1;
     }
 
@@ -242,12 +242,10 @@ int open_process_obj(obj_t *process)
         DPRINTF((15, "Retrying [%s] connection to prog=\"%s\" in %ds\n",
             process->name, auxp->argv[0], auxp->delay));
 
-        auxp->timer = tpoll_timeout_relative(tp_global,
-            (callback_f) open_process_obj, process, auxp->delay * 1000);
-
-        auxp->delay = (auxp->delay == 0)
-            ? PROCESS_MIN_TIMEOUT
-            : MIN(auxp->delay * 2, PROCESS_MAX_TIMEOUT);
+        auxp->timer = tpoll_timeout_relative(process->tp,
+            (callback_f) open_process_obj, process,
+            get_reconnect_msecs(&auxp->delay,
+                PROCESS_MIN_TIMEOUT, PROCESS_MAX_TIMEOUT));
     }
     return(rc);
 }
@@ -270,7 +268,7 @@ static int disconnect_process_obj(obj_t *process)
     auxp = &(process->aux.process);
 
     if (process->fd >= 0) {
-        tpoll_clear(tp_global, process->fd, POLLIN | POLLOUT);
+        tpoll_clear(process->tp, process->fd, POLLIN | POLLOUT);
         (void) close(process->fd);
         process->fd = -1;
     }
@@ -291,6 +289,7 @@ static int disconnect_process_obj(obj_t *process)
     auxp->pid = -1;
     auxp->tStart = 0;
     auxp->state = CONMAN_PROCESS_DOWN;
+    mark_console_down(process);
     return (-1);
 }
 
@@ -325,28 +324,12 @@ static int connect_process_obj(obj_t *process)
     set_fd_closed_on_exec(fd_pair[0]);
     set_fd_closed_on_exec(fd_pair[1]);
 
-    if ((pid = fork()) < 0) {
+    if ((errno = spawn_process_prog(process, fd_pair[1], &pid)) != 0) {
         write_notify_msg(process, LOG_WARNING,
-            "Console [%s] connection failed: fork error: %s",
+            "Console [%s] connection failed: spawn error: %s",
             process->name, strerror(errno));
         goto err;
     }
-    else if (pid == 0) {
-        if (close(fd_pair[0]) < 0) {
-            log_err(errno, "close() of child fd_pair failed");
-        }
-        if (dup2(fd_pair[1], STDIN_FILENO) < 0) {
-            log_err(errno, "dup2() of child stdin failed");
-        }
-        if (dup2(fd_pair[1], STDOUT_FILENO) < 0) {
-            log_err(errno, "dup2() of child stdout failed");
-        }
-        if (dup2(fd_pair[1], STDERR_FILENO) < 0) {
-            log_err(errno, "dup2() of child stderr failed");
-        }
-        execv(auxp->argv[0], auxp->argv);
-        _exit(127);
-    }
     if (close(fd_pair[1]) < 0) {
         log_err(errno, "close() of parent fd_pair failed");
     }
@@ -357,12 +340,13 @@ static int connect_process_obj(obj_t *process)
     auxp->pid = pid;
     process->gotEOF = 0;
     auxp->state = CONMAN_PROCESS_UP;
-    tpoll_set(tp_global, process->fd, POLLIN);
+    mark_console_up(process);
+    tpoll_set_arg(process->tp, process->fd, POLLIN, process);
 
     /*  Require the connection to be up for a minimum length of time before
      *    resetting the reconnect-delay back to zero.
      */
-    auxp->timer = tpoll_timeout_relative(tp_global,
+    auxp->timer = tpoll_timeout_relative(process->tp,
         (callback_f) reset_process_delay, process, PROCESS_MIN_TIMEOUT * 1000);
 
     /*  Notify linked objs when transitioning into an UP state.
@@ -386,6 +370,76 @@ err:
 }
 
 
+static int spawn_process_prog(obj_t *process, int fd, pid_t *pid_ref)
+{
+/*  Spawns the 'process' obj's program with its stdin, stdout, and stderr
+ *    connected to 'fd', storing the pid of the child in 'pid_ref'.
+ *  The program is spawned via posix_spawn() instead of fork() since the
+ *    latter copies the page tables of the daemon's (potentially large)
+ *    address space only to discard them at exec.  Implementations
+ *    typically use vfork() or clone(CLONE_VM), so the cost of a spawn is
+ *    independent of the number of objs.
+ *  The child's fds other than stdin, stdout, and stderr are closed where
+ *    supported; regardless, the daemon's fds are all set close-on-exec.
+ *    Its signal mask and dispositions are reset since the caller may be an
+ *    i/o thread with signals blocked, and SIGPIPE is ignored by the daemon.
+ *  Returns 0 on success, or an error number on failure.
+ */
+    posix_spawn_file_actions_t fa;
+    posix_spawnattr_t          attr;
+    sigset_t                   sigset;
+    int                        rc;
+
+    assert(process != NULL);
+    assert(is_process_obj(process));
+    assert(fd > STDERR_FILENO);
+    assert(pid_ref != NULL);
+
+    if ((rc = posix_spawn_file_actions_init(&fa)) != 0) {
+        return(rc);
+    }
+    if ((rc = posix_spawnattr_init(&attr)) != 0) {
+        (void) posix_spawn_file_actions_destroy(&fa);
+        return(rc);
+    }
+    if ((rc = posix_spawn_file_actions_adddup2(&fa, fd, STDIN_FILENO)) != 0) {
+        goto end;
+    }
+    if ((rc = posix_spawn_file_actions_adddup2(&fa, fd, STDOUT_FILENO)) != 0) {
+        goto end;
+    }
+    if ((rc = posix_spawn_file_actions_adddup2(&fa, fd, STDERR_FILENO)) != 0) {
+        goto end;
+    }
+#if HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP
+    if ((rc = posix_spawn_file_actions_addclosefrom_np(&fa,
+            STDERR_FILENO + 1)) != 0) {
+        goto end;
+    }
+#endif /* HAVE_POSIX_SPAWN_FILE_ACTIONS_ADDCLOSEFROM_NP */
+
+    (void) sigemptyset(&sigset);
+    if ((rc = posix_spawnattr_setsigmask(&attr, &sigset)) != 0) {
+        goto end;
+    }
+    (void) sigfillset(&sigset);
+    if ((rc = posix_spawnattr_setsigdefault(&attr, &sigset)) != 0) {
+        goto end;
+    }
+    if ((rc = posix_spawnattr_setflags(&attr,
+            POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF)) != 0) {
+        goto end;
+    }
+    rc = posix_spawn(pid_ref, process->aux.process.argv[0], &fa, &attr,
+        process->aux.process.argv, environ);
+
+end:
+    (void) posix_spawnattr_destroy(&attr);
+    (void) posix_spawn_file_actions_destroy(&fa);
+    return(rc);
+}
+
+
 static int check_process_prog(obj_t *process)
 {
 /*  Checks whether the 'process' executable will likely exec.
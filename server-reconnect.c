@@ -0,0 +1,367 @@
+/*****************************************************************************
+ *  Written by Chris Dunlap <cdunlap@llnl.gov>.
+ *  Copyright (C) 2007-2016 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  UCRL-CODE-2002-009.
+ *
+ *  This file is part of ConMan: The Console Manager.
+ *  For details, see <https://dun.github.io/conman/>.
+ *
+ *  ConMan is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  ConMan is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with ConMan.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "common.h"
+#include "list.h"
+#include "log.h"
+#include "server.h"
+#include "tpoll.h"
+#include "util-str.h"
+#include "util.h"
+#include "wrapper.h"
+
+
+/*  The reconnect scheduler is shared by the console objs of every type.
+ *    It randomizes each obj's exponential backoff so consoles disconnected
+ *    at the same time (eg, by a terminal server reboot) do not all retry
+ *    at the same time.
+ *  It also admits network connects via slots limited both globally and
+ *    per remote host.  A connect holds its slot while it is in progress
+ *    (ie, in the PENDING state of a non-blocking connect).  When no slot
+ *    is available, the obj is queued in FIFO order; as each connect
+ *    completes (either successfully or not), its slot is passed to the
+ *    first queued obj that the limits allow, whose connect is then
+ *    initiated via a timer in its own i/o thread.
+ */
+typedef struct connect_host {
+    char            *name;              /* remote host name                  */
+    int              numConnects;       /* num connects in progress to host  */
+} connect_host_t;
+
+static connect_host_t * get_connect_host(const char *name);
+static int is_connect_allowed(connect_host_t *host);
+static int find_connect_host(connect_host_t *host, const char *name);
+static int find_connect_slot(connect_slot_t *slot, connect_slot_t *key);
+static void admit_connect_slot(connect_slot_t *slot);
+static void destroy_connect_host(connect_host_t *host);
+
+static pthread_mutex_t reconnect_lock = PTHREAD_MUTEX_INITIALIZER;
+static List reconnect_hosts = NULL;
+static List reconnect_queue = NULL;
+static int reconnect_num_connects = 0;
+static int reconnect_max_connects = 0;
+static int reconnect_max_host_connects = 0;
+static unsigned int reconnect_seed = 0;
+
+
+void reconnect_init(int max_connects, int max_host_connects)
+{
+/*  Initializes the reconnect scheduler to admit at most 'max_connects'
+ *    connects in progress overall, and at most 'max_host_connects' to any
+ *    one remote host (or unlimited if 0).
+ */
+    x_pthread_mutex_lock(&reconnect_lock);
+
+    if (!reconnect_hosts) {
+        reconnect_hosts = list_create((ListDelF) destroy_connect_host);
+        reconnect_queue = list_create(NULL);
+    }
+    reconnect_max_connects = max_connects;
+    reconnect_max_host_connects = max_host_connects;
+    reconnect_seed = (unsigned int) time(NULL) ^ (unsigned int) getpid();
+
+    x_pthread_mutex_unlock(&reconnect_lock);
+    return;
+}
+
+
+void reconnect_fini(void)
+{
+/*  Destroys the state of the reconnect scheduler.
+ */
+    x_pthread_mutex_lock(&reconnect_lock);
+
+    if (reconnect_queue) {
+        list_destroy(reconnect_queue);
+        reconnect_queue = NULL;
+    }
+    if (reconnect_hosts) {
+        list_destroy(reconnect_hosts);
+        reconnect_hosts = NULL;
+    }
+    reconnect_num_connects = 0;
+
+    x_pthread_mutex_unlock(&reconnect_lock);
+    return;
+}
+
+
+int get_reconnect_msecs(int *delay, int min_delay, int max_delay)
+{
+/*  Returns the number of milliseconds until the next reconnect attempt of
+ *    an obj whose reconnect delay is currently (*delay) seconds, and then
+ *    advances (*delay) via exponential backoff from (min_delay) up to
+ *    (max_delay) seconds.
+ *  The delay is randomized uniformly over [*delay/2, *delay] seconds.
+ *    A delay of 0 (for reconnecting right after a connection that had been
+ *    up for a while) is randomized over [0, RECONNECT_JITTER_MSECS).
+ */
+    int msecs;
+    int r;
+
+    assert(delay != NULL);
+    assert((min_delay > 0) && (min_delay <= max_delay));
+
+    x_pthread_mutex_lock(&reconnect_lock);
+    r = rand_r(&reconnect_seed);
+    x_pthread_mutex_unlock(&reconnect_lock);
+
+    if (*delay <= 0) {
+        msecs = r % RECONNECT_JITTER_MSECS;
+        *delay = min_delay;
+    }
+    else {
+        msecs = (*delay * 500) + (r % ((*delay * 500) + 1));
+        *delay = MIN(*delay * 2, max_delay);
+    }
+    return(msecs);
+}
+
+
+void init_connect_slot(connect_slot_t *slot, obj_t *obj,
+    callback_f connect, const char *host)
+{
+/*  Initializes the connect (slot) for admitting connects of the (obj)
+ *    to the remote (host).  When a queued slot is admitted, its (connect)
+ *    routine is invoked with the (obj) from the obj's own i/o thread.
+ *  The (host) string is referenced, not copied.
+ */
+    assert(slot != NULL);
+    assert(obj != NULL);
+    assert(connect != NULL);
+    assert(host != NULL);
+
+    slot->obj = obj;
+    slot->connect = connect;
+    slot->host = host;
+    slot->isHeld = 0;
+    slot->isQueued = 0;
+    slot->timer = -1;
+    return;
+}
+
+
+int acquire_connect_slot(connect_slot_t *slot)
+{
+/*  Acquires the connect (slot) for initiating a connect, queueing it to be
+ *    admitted later if the limit on connects in progress has been reached.
+ *  Returns 1 if the slot is held, or 0 if it is queued.
+ *
+ *  XXX: This routine must only be called by the slot obj's i/o thread.
+ */
+    connect_host_t *host;
+    int rc = 1;
+
+    x_pthread_mutex_lock(&reconnect_lock);
+
+    if (slot->isHeld) {
+        ;                               /* admitted from the queue */
+    }
+    else if (!reconnect_hosts) {
+        ;                               /* scheduler is not initialized */
+    }
+    else if (is_connect_allowed(host = get_connect_host(slot->host))) {
+        reconnect_num_connects++;
+        host->numConnects++;
+        slot->isHeld = 1;
+    }
+    else {
+        if (!slot->isQueued) {
+            list_append(reconnect_queue, slot);
+            slot->isQueued = 1;
+            DPRINTF((10, "Queued connect to <%s> for [%s].\n",
+                slot->host, slot->obj->name));
+        }
+        rc = 0;
+    }
+    x_pthread_mutex_unlock(&reconnect_lock);
+    return(rc);
+}
+
+
+void release_connect_slot(connect_slot_t *slot)
+{
+/*  Releases the connect (slot) once its connect has completed (or removes
+ *    it from the queue if it is waiting to be admitted).  The released
+ *    capacity is passed to the first queued slot that can be admitted.
+ *  If the slot was admitted but its connect has yet to be invoked, the
+ *    timer passing the admission to it is cancelled.
+ *
+ *  XXX: This routine must only be called by the slot obj's i/o thread.
+ */
+    connect_host_t *host;
+    connect_slot_t *next = NULL;
+    ListIterator i;
+
+    x_pthread_mutex_lock(&reconnect_lock);
+
+    if (slot->timer >= 0) {
+        (void) tpoll_timeout_cancel(slot->obj->tp, slot->timer);
+        slot->timer = -1;
+    }
+    if (!reconnect_hosts) {
+        slot->isQueued = 0;
+        slot->isHeld = 0;
+    }
+    if (slot->isQueued) {
+        (void) list_delete_all(reconnect_queue,
+            (ListFindF) find_connect_slot, slot);
+        slot->isQueued = 0;
+    }
+    if (slot->isHeld) {
+        host = get_connect_host(slot->host);
+        assert(host->numConnects > 0);
+        assert(reconnect_num_connects > 0);
+        host->numConnects--;
+        reconnect_num_connects--;
+        slot->isHeld = 0;
+
+        i = list_iterator_create(reconnect_queue);
+        while ((next = list_next(i))) {
+            host = get_connect_host(next->host);
+            if (is_connect_allowed(host)) {
+                list_remove(i);
+                reconnect_num_connects++;
+                host->numConnects++;
+                next->isQueued = 0;
+                next->isHeld = 1;
+                break;
+            }
+        }
+        list_iterator_destroy(i);
+    }
+    /*  The admission is passed via a timer on the admitted obj's i/o thread.
+     *    Its id is saved (under the lock, since this may not be that thread)
+     *    so the timer can be cancelled if the slot is released first.
+     */
+    if (next) {
+        DPRINTF((10, "Admitted connect to <%s> for [%s].\n",
+            next->host, next->obj->name));
+        next->timer = tpoll_timeout_relative(next->obj->tp,
+            (callback_f) admit_connect_slot, next, 0);
+        if (next->timer < 0) {
+            log_err(0, "Unable to create timer for admitting connect");
+        }
+    }
+    x_pthread_mutex_unlock(&reconnect_lock);
+    return;
+}
+
+
+static void admit_connect_slot(connect_slot_t *slot)
+{
+/*  Invokes the connect routine of the (slot) obj now that the slot has been
+ *    admitted.  If the obj has since been removed by a reconfig, its connect
+ *    is not invoked; the slot is released when the obj is closed.
+ *  This is called via a timer by the slot obj's i/o thread.
+ */
+    x_pthread_mutex_lock(&reconnect_lock);
+    slot->timer = -1;
+    x_pthread_mutex_unlock(&reconnect_lock);
+
+    if (x_atomic_load(&slot->obj->isRemoved)) {
+        DPRINTF((10, "Ignored admitted connect to <%s> for removed [%s].\n",
+            slot->host, slot->obj->name));
+        return;
+    }
+    slot->connect(slot->obj);
+    return;
+}
+
+
+static connect_host_t * get_connect_host(const char *name)
+{
+/*  Returns the entry tracking connects to the remote host (name),
+ *    creating it if needed.
+ *
+ *  XXX: This routine assumes the reconnect_lock mutex is already locked.
+ */
+    connect_host_t *host;
+
+    host = list_find_first(reconnect_hosts,
+        (ListFindF) find_connect_host, (void *) name);
+    if (!host) {
+        if (!(host = malloc(sizeof(connect_host_t)))) {
+            out_of_memory();
+        }
+        host->name = create_string(name);
+        host->numConnects = 0;
+        list_append(reconnect_hosts, host);
+    }
+    return(host);
+}
+
+
+static int is_connect_allowed(connect_host_t *host)
+{
+/*  Returns true if another connect to the remote (host) is within limits.
+ *
+ *  XXX: This routine assumes the reconnect_lock mutex is already locked.
+ */
+    if ((reconnect_max_connects > 0)
+            && (reconnect_num_connects >= reconnect_max_connects)) {
+        return(0);
+    }
+    if ((reconnect_max_host_connects > 0)
+            && (host->numConnects >= reconnect_max_host_connects)) {
+        return(0);
+    }
+    return(1);
+}
+
+
+static int find_connect_host(connect_host_t *host, const char *name)
+{
+/*  List helper function returning true if the (host) entry matches (name).
+ */
+    return(!strcmp(host->name, name));
+}
+
+
+static int find_connect_slot(connect_slot_t *slot, connect_slot_t *key)
+{
+/*  List helper function returning true if the (slot) is the (key).
+ */
+    return(slot == key);
+}
+
+
+static void destroy_connect_host(connect_host_t *host)
+{
+/*  List helper function destroying the (host) entry.
+ */
+    destroy_string(host->name);
+    free(host);
+    return;
+}
@@ -0,0 +1,379 @@
+/*****************************************************************************
+ *  Written by Chris Dunlap <cdunlap@llnl.gov>.
+ *  Copyright (C) 2007-2016 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  UCRL-CODE-2002-009.
+ *
+ *  This file is part of ConMan: The Console Manager.
+ *  For details, see <https://dun.github.io/conman/>.
+ *
+ *  ConMan is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  ConMan is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with ConMan.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+/*  A replay ring retains the most recent output of a console in a file
+ *    mapped into memory, so the output survives a restart (or crash) of the
+ *    daemon and can be replayed whether or not the console is being logged.
+ *
+ *  The file consists of a header of REPLAY_HDR_LEN bytes followed by the
+ *    ring itself.  The header records the total number of bytes ever
+ *    written into the ring; the next byte is written at that position
+ *    modulo the size of the ring.  The header is in host byte order since
+ *    the file is only read by the daemon that wrote it.
+ *
+ *  The ring is written by the console's i/o thread as the console's output
+ *    is passed to its readers.  The output is copied from the shared chunk
+ *    directly into the mapping without a syscall; the kernel writes the
+ *    dirty pages back to the file on its own.  The header is updated after
+ *    the output has been copied, so a crash can at worst lose the output
+ *    being copied at the time.  The file's blocks are allocated when it is
+ *    created so that storing into the mapping cannot fail for lack of space.
+ *
+ *  Clients of the console are muxed by the same i/o thread, so the ring is
+ *    replayed to them without a lock (refer to replay_client_data()).
+ */
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "log.h"
+#include "server.h"
+#include "util-file.h"
+#include "util-str.h"
+#include "util.h"
+
+
+#define REPLAY_HDR_LEN                  64
+#define REPLAY_MAGIC                    0x434d5252      /* "CMRR" */
+#define REPLAY_VERSION                  1
+
+
+typedef struct replay_hdr {             /* REPLAY RING FILE HEADER:          */
+    uint32_t         magic;             /*  REPLAY_MAGIC                     */
+    uint32_t         version;           /*  REPLAY_VERSION                   */
+    uint64_t         size;              /*  num bytes in ring                */
+    uint64_t         head;              /*  num bytes ever written into ring */
+} replay_hdr_t;
+
+typedef struct replay_ring {            /* REPLAY RING:                      */
+    char            *name;              /*  file name (w/ conversion specs)  */
+    int              size;              /*  num bytes in ring                */
+    int              fd;                /*  file descriptor, or -1 if closed */
+    replay_hdr_t    *hdr;               /*  mapped file header, or NULL      */
+    unsigned char   *data;              /*  mapped ring following the header */
+} replay_ring_t;
+
+
+static int init_replay_file(int fd, off_t len);
+
+
+replay_ring_t * create_replay_ring(const char *name, int size)
+{
+/*  Creates a replay ring of (size) bytes to be backed by the file (name),
+ *    which may contain conversion specifiers expanded by format_obj_string().
+ *  The file is not opened until open_replay_ring() is called by the
+ *    console's i/o thread.
+ */
+    replay_ring_t *ring;
+
+    assert(name != NULL);
+    assert((size >= REPLAY_SIZE_MIN) && (size <= REPLAY_SIZE_MAX));
+
+    if (!(ring = malloc(sizeof(replay_ring_t)))) {
+        out_of_memory();
+    }
+    ring->name = create_string(name);
+    ring->size = size;
+    ring->fd = -1;
+    ring->hdr = NULL;
+    ring->data = NULL;
+    return(ring);
+}
+
+
+void destroy_replay_ring(replay_ring_t *ring)
+{
+/*  Destroys the replay ring, unmapping its file if still open.
+ */
+    if (!ring) {
+        return;
+    }
+    if (ring->hdr) {
+        (void) munmap(ring->hdr, REPLAY_HDR_LEN + ring->size);
+    }
+    if (ring->fd >= 0) {
+        (void) close(ring->fd);
+    }
+    destroy_string(ring->name);
+    free(ring);
+    return;
+}
+
+
+int is_replay_ring_changed(replay_ring_t *old, replay_ring_t *new)
+{
+/*  Returns true if the definition of the 'new' replay ring differs from that
+ *    of the running 'old' replay ring, where either may be NULL if unused.
+ */
+    if (!old || !new) {
+        return(old != new);
+    }
+    return(strcmp(old->name, new->name) || (old->size != new->size));
+}
+
+
+int open_replay_ring(obj_t *console)
+{
+/*  Opens the file backing the (console)'s replay ring and maps it into
+ *    memory if not already open.  The output retained by a previous
+ *    instance of the daemon is kept if the file is of the same size;
+ *    o/w, the file is reinitialized.
+ *  Returns 0 on success, or -1 on error (in which case the console's
+ *    output is not retained).
+ *
+ *  XXX: This routine must only be called by the console obj's i/o thread.
+ */
+    replay_ring_t *ring;
+    char name[MAX_LINE];
+    struct stat st;
+    off_t len;
+    void *p;
+    int fd;
+    pid_t pid;
+
+    assert(is_console_obj(console));
+    assert(console->ring != NULL);
+
+    ring = console->ring;
+    if (ring->hdr) {
+        return(0);
+    }
+    if (format_obj_string(name, sizeof(name), console, ring->name) < 0) {
+        log_msg(LOG_WARNING,
+            "Unable to open replay ring for console [%s]: "
+            "filename exceeded buffer", console->name);
+        return(-1);
+    }
+    if ((fd = open(name, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR)) < 0) {
+        log_msg(LOG_WARNING, "Unable to open replay ring \"%s\": %s",
+            name, strerror(errno));
+        return(-1);
+    }
+    set_fd_closed_on_exec(fd);
+
+    if (get_write_lock(fd) < 0) {
+        if ((pid = is_write_lock_blocked(fd)) > 0) {
+            log_msg(LOG_WARNING,
+                "Unable to lock replay ring \"%s\": held by pid %d",
+                name, (int) pid);
+        }
+        else {
+            log_msg(LOG_WARNING, "Unable to lock replay ring \"%s\"", name);
+        }
+        goto err;
+    }
+    len = REPLAY_HDR_LEN + ring->size;
+
+    if (fstat(fd, &st) < 0) {
+        log_msg(LOG_WARNING, "Unable to stat replay ring \"%s\": %s",
+            name, strerror(errno));
+        goto err;
+    }
+    if ((st.st_size != len) && (init_replay_file(fd, len) < 0)) {
+        log_msg(LOG_WARNING, "Unable to allocate replay ring \"%s\": %s",
+            name, strerror(errno));
+        goto err;
+    }
+    p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        log_msg(LOG_WARNING, "Unable to map replay ring \"%s\": %s",
+            name, strerror(errno));
+        goto err;
+    }
+    ring->fd = fd;
+    ring->hdr = p;
+    ring->data = (unsigned char *) p + REPLAY_HDR_LEN;
+
+    if ((ring->hdr->magic == REPLAY_MAGIC)
+            && (ring->hdr->version == REPLAY_VERSION)
+            && (ring->hdr->size == (uint64_t) ring->size)) {
+        DPRINTF((5, "Recovered %llu bytes in replay ring \"%s\".\n",
+            (unsigned long long) MIN(ring->hdr->head, ring->hdr->size),
+            name));
+        return(0);
+    }
+    if (st.st_size != 0) {
+        log_msg(LOG_NOTICE, "Reinitialized replay ring \"%s\"", name);
+    }
+    memset(ring->hdr, 0, REPLAY_HDR_LEN);
+    ring->hdr->size = ring->size;
+    ring->hdr->head = 0;
+    ring->hdr->version = REPLAY_VERSION;
+    ring->hdr->magic = REPLAY_MAGIC;
+    return(0);
+
+err:
+    if (close(fd) < 0) {
+        log_msg(LOG_WARNING, "Unable to close replay ring \"%s\": %s",
+            name, strerror(errno));
+    }
+    return(-1);
+}
+
+
+static int init_replay_file(int fd, off_t len)
+{
+/*  Truncates the replay ring file (fd) and allocates (len) zeroed bytes.
+ *    Allocating its blocks up front ensures a later store into the mapping
+ *    does not fault with SIGBUS once the filesystem is full.
+ *  Returns 0 on success, or -1 on error (with errno set).
+ */
+    int e;
+
+    if (ftruncate(fd, 0) < 0) {
+        return(-1);
+    }
+    if ((e = posix_fallocate(fd, 0, len)) != 0) {
+        errno = e;
+        return(-1);
+    }
+    return(0);
+}
+
+
+void close_replay_ring(obj_t *console)
+{
+/*  Unmaps and closes the file backing the (console)'s replay ring.
+ *    Ring pages still dirty are written back by the kernel.
+ *
+ *  XXX: This routine must only be called by the console obj's i/o thread.
+ */
+    replay_ring_t *ring;
+
+    assert(is_console_obj(console));
+
+    if (!(ring = console->ring) || !ring->hdr) {
+        return;
+    }
+    if (munmap(ring->hdr, REPLAY_HDR_LEN + ring->size) < 0) {
+        log_msg(LOG_WARNING, "Unable to unmap replay ring for [%s]: %s",
+            console->name, strerror(errno));
+    }
+    ring->hdr = NULL;
+    ring->data = NULL;
+
+    if (close(ring->fd) < 0) {
+        log_msg(LOG_WARNING, "Unable to close replay ring for [%s]: %s",
+            console->name, strerror(errno));
+    }
+    ring->fd = -1;
+    return;
+}
+
+
+void write_replay_ring(obj_t *console, const void *src, int len)
+{
+/*  Writes the buffer (src) of length (len) into the (console)'s replay ring,
+ *    overwriting its oldest output.
+ *
+ *  XXX: This routine must only be called by the console obj's i/o thread.
+ */
+    replay_ring_t *ring = console->ring;
+    uint64_t head;
+    int off;
+    int n;
+
+    if (!ring || !ring->hdr || (len <= 0)) {
+        return;
+    }
+    head = ring->hdr->head;
+    if (len > ring->size) {
+        src = (const unsigned char *) src + (len - ring->size);
+        head += len - ring->size;
+        len = ring->size;
+    }
+    off = (int) (head % ring->size);
+    n = MIN(len, ring->size - off);
+    memcpy(ring->data + off, src, n);
+    if (n < len) {
+        memcpy(ring->data, (const unsigned char *) src + n, len - n);
+    }
+    ring->hdr->head = head + len;
+    return;
+}
+
+
+int get_replay_ring_range(obj_t *console, off_t *start, off_t *end)
+{
+/*  Sets (start) and (end) to the positions delimiting the output retained
+ *    in the (console)'s replay ring.
+ *  Returns 0 on success, or -1 if the console does not have an open ring.
+ *
+ *  XXX: This routine must only be called by the console obj's i/o thread.
+ */
+    replay_ring_t *ring = console->ring;
+    uint64_t head;
+
+    assert(start != NULL);
+    assert(end != NULL);
+
+    if (!ring || !ring->hdr) {
+        return(-1);
+    }
+    head = ring->hdr->head;
+    *end = (off_t) head;
+    *start = (off_t) ((head > (uint64_t) ring->size) ? head - ring->size : 0);
+    return(0);
+}
+
+
+int get_replay_ring_data(obj_t *console, off_t pos, int len,
+    const unsigned char **ptr_ref)
+{
+/*  Sets (ptr_ref) to the output at position (pos) within the (console)'s
+ *    replay ring, which must lie within the range returned by
+ *    get_replay_ring_range().
+ *  Returns the number of contiguous bytes at (ptr_ref), which is at most
+ *    (len), or -1 if the console does not have an open ring.
+ *
+ *  XXX: This routine must only be called by the console obj's i/o thread.
+ */
+    replay_ring_t *ring = console->ring;
+    off_t start, end;
+    int off;
+
+    assert(ptr_ref != NULL);
+
+    if (get_replay_ring_range(console, &start, &end) < 0) {
+        return(-1);
+    }
+    assert((pos >= start) && (pos <= end));
+
+    off = (int) (pos % ring->size);
+    len = (int) MIN(len, end - pos);
+    len = MIN(len, ring->size - off);
+    *ptr_ref = ring->data + off;
+    return(len);
+}
@@ -27,6 +27,7 @@
 #endif /* HAVE_CONFIG_H */
 
 #include <assert.h>
+#include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
@@ -43,8 +44,7 @@
 #include "tpoll.h"
 #include "util-file.h"
 #include "util-str.h"
-
-extern tpoll_t tp_global;               /* defined in server.c */
+#include "util-tty.h"
 
 
 typedef struct bps_tag {
@@ -85,9 +85,11 @@ static bps_tag_t bps_table[] = {        /* values are in increasing order */
 };
 
 
+static int parse_serial_flags(seropt_t *opts, const char *str);
 static speed_t int_to_bps(int val);
-#ifndef NDEBUG
 static int bps_to_int(speed_t bps);
+static void set_serial_dev_opts(obj_t *serial, int fd);
+#ifndef NDEBUG
 static const char * parity_to_str(int parity);
 #endif /* !NDEBUG */
 
@@ -125,7 +127,10 @@ int parse_serial_opts(
 {
 /*  Parses 'str' for serial device options 'opts'.
  *    The 'opts' struct should be initialized to a default value.
- *    The 'str' string is of the form "<bps>,<databits><parity><stopbits>".
+ *    The 'str' string is of the form
+ *    "<bps>,<databits><parity><stopbits>[,<flag>]...".
+ *  A bps value without a matching bps def is used as is if the platform
+ *    supports arbitrary rates; o/w, it is rounded down to the next bps def.
  *  Returns 0 and updates the 'opts' struct on success; o/w, returns -1
  *    (writing an error message into 'errbuf' if defined).
  */
@@ -133,6 +138,7 @@ int parse_serial_opts(
     seropt_t optsTmp;
     int bpsTmp;
     char parityTmp;
+    const char *flags;
 
     assert(opts != NULL);
 
@@ -159,6 +165,12 @@ int parse_serial_opts(
                     "expected INTEGER >0 for bps setting");
             return(-1);
         }
+        if (is_tty_custom_speed_supported()) {
+            optsTmp.baud = bpsTmp;
+        }
+        else {
+            optsTmp.baud = bps_to_int(optsTmp.bps);
+        }
     }
     if (n >= 2) {
         if ((optsTmp.databits < 5) || (optsTmp.databits > 8)) {
@@ -199,11 +211,48 @@ int parse_serial_opts(
         }
     }
 
+    /*  Flags follow the bps and the (optional) databits/parity/stopbits
+     *    fields.  A flag starts with a letter, which distinguishes
+     *    "<bps>,<flag>" from "<bps>,<databits><parity><stopbits>".
+     */
+    if ((flags = strchr(str, ',')) && isdigit((int) flags[1])) {
+        flags = strchr(flags + 1, ',');
+    }
+    if (flags && (parse_serial_flags(&optsTmp, flags + 1) < 0)) {
+        if ((errbuf != NULL) && (errlen > 0))
+            snprintf(errbuf, errlen,
+                "expected \"lowlatency\" for serial flag");
+        return(-1);
+    }
+
     *opts = optsTmp;
     return(0);
 }
 
 
+static int parse_serial_flags(seropt_t *opts, const char *str)
+{
+/*  Parses the comma-separated list of flags in 'str' into 'opts'.
+ *  Returns 0 on success, or -1 if 'str' contains an unrecognized flag.
+ */
+    const char *p;
+    size_t len;
+
+    while (str != NULL) {
+        p = strchr(str, ',');
+        len = (p != NULL) ? (size_t) (p - str) : strlen(str);
+        if ((len == 10) && !strncasecmp(str, "lowlatency", len)) {
+            opts->lowLatency = 1;
+        }
+        else {
+            return(-1);
+        }
+        str = (p != NULL) ? p + 1 : NULL;
+    }
+    return(0);
+}
+
+
 static speed_t int_to_bps(int val)
 {
 /*  Converts a numeric value 'val' into a bps speed_t,
@@ -222,7 +271,6 @@ static speed_t int_to_bps(int val)
 }
 
 
-#ifndef NDEBUG
 static int bps_to_int(speed_t bps)
 {
 /*  Converts a 'bps' speed_t into its numeric value.
@@ -236,7 +284,6 @@ static int bps_to_int(speed_t bps)
     }
     return(0);
 }
-#endif /* !NDEBUG */
 
 
 #ifndef NDEBUG
@@ -259,6 +306,8 @@ void set_serial_opts(struct termios *tty, obj_t *serial, seropt_t *opts)
 /*  Sets serial device options specified by 'opts' for the
  *   'tty' terminal settings associated with the 'serial' object.
  *  Updates the 'tty' struct as appropriate.
+ *  A bps value without a bps def is set at the next lower bps def here;
+ *    set_serial_dev_opts() sets the actual rate once the tty is updated.
  */
     assert(tty != NULL);
     assert(serial != NULL);
@@ -269,9 +318,10 @@ void set_serial_opts(struct termios *tty, obj_t *serial, seropt_t *opts)
     assert((opts->parity >= 0) && (opts->parity <= 2));
     assert((opts->stopbits >= 1) && (opts->stopbits <= 2));
 
-    DPRINTF((10, "Setting [%s] dev=%s to %d,%d%s%d.\n",
-        serial->name, serial->aux.serial.dev, bps_to_int(opts->bps),
-        opts->databits, parity_to_str(opts->parity), opts->stopbits));
+    DPRINTF((10, "Setting [%s] dev=%s to %d,%d%s%d%s.\n",
+        serial->name, serial->aux.serial.dev, opts->baud,
+        opts->databits, parity_to_str(opts->parity), opts->stopbits,
+        (opts->lowLatency ? ",lowlatency" : "")));
 
     if (cfsetispeed(tty, opts->bps) < 0)
         log_err(errno, "Unable to set [%s] input baud rate to %d",
@@ -312,6 +362,42 @@ void set_serial_opts(struct termios *tty, obj_t *serial, seropt_t *opts)
         tty->c_cflag &= ~CSTOPB;
     }
 
+    /*  Return from read() as soon as any data is available.  Since the
+     *    device is opened for non-blocking I/O, the remaining latency is
+     *    that of the driver, which is addressed by set_serial_dev_opts().
+     */
+    if (opts->lowLatency) {
+        tty->c_cc[VMIN] = 1;
+        tty->c_cc[VTIME] = 0;
+    }
+    return;
+}
+
+
+static void set_serial_dev_opts(obj_t *serial, int fd)
+{
+/*  Sets the options of the 'serial' obj that cannot be set via termios
+ *    for its device 'fd': an arbitrary bps rate and low latency.
+ *  Failures are logged, but the console remains usable (at the next lower
+ *    bps def or at the driver's default latency, respectively).
+ */
+    seropt_t *opts = &serial->aux.serial.opts;
+
+    if (opts->baud != bps_to_int(opts->bps)) {
+        if (set_tty_custom_speed(fd, opts->baud) < 0) {
+            log_msg(LOG_WARNING,
+                "Unable to set [%s] baud rate to %d (using %d): %s",
+                serial->name, opts->baud, bps_to_int(opts->bps),
+                strerror(errno));
+        }
+    }
+    if (opts->lowLatency) {
+        if (set_tty_low_latency(fd) < 0) {
+            log_msg(LOG_WARNING,
+                "Unable to set [%s] device \"%s\" for low latency: %s",
+                serial->name, serial->aux.serial.dev, strerror(errno));
+        }
+    }
     return;
 }
 
@@ -323,7 +409,6 @@ obj_t * create_serial_obj(server_conf_t *conf, char *name,
  *    Note: the console is open and set for non-blocking I/O.
  *  Returns the new object, or NULL on error.
  */
-    ListIterator i;
     obj_t *serial;
 
     assert(conf != NULL);
@@ -337,26 +422,19 @@ obj_t * create_serial_obj(server_conf_t *conf, char *name,
      *    objects within the same daemon process using the same device.
      *    So that check is performed here.
      */
-    i = list_iterator_create(conf->objs);
-    while ((serial = list_next(i))) {
-        if (is_console_obj(serial) && !strcmp(serial->name, name)) {
-            if ((errbuf != NULL) && (errlen > 0)) {
-                snprintf(errbuf, errlen,
-                    "console [%s] specifies duplicate console name", name);
-            }
-            break;
-        }
-        if (is_serial_obj(serial) && !strcmp(serial->aux.serial.dev, dev)) {
-            if ((errbuf != NULL) && (errlen > 0)) {
-                snprintf(errbuf, errlen,
-                    "console [%s] specifies duplicate device \"%s\"",
-                    name, dev);
-            }
-            break;
+    if (find_obj_index(conf->consoleIndex, name, CONMAN_OBJ_IS_CONSOLE)) {
+        if ((errbuf != NULL) && (errlen > 0)) {
+            snprintf(errbuf, errlen,
+                "console [%s] specifies duplicate console name", name);
         }
+        return(NULL);
     }
-    list_iterator_destroy(i);
-    if (serial != NULL) {
+    if (find_obj_index(conf->deviceIndex, dev, CONMAN_OBJ_SERIAL)) {
+        if ((errbuf != NULL) && (errlen > 0)) {
+            snprintf(errbuf, errlen,
+                "console [%s] specifies duplicate device \"%s\"",
+                name, dev);
+        }
         return(NULL);
     }
     serial = create_obj(conf, name, -1, CONMAN_OBJ_SERIAL);
@@ -364,9 +442,11 @@ obj_t * create_serial_obj(server_conf_t *conf, char *name,
     serial->aux.serial.opts = *opts;
     serial->aux.serial.logfile = NULL;
     /*
-     *  Add obj to the master conf->objs list.
+     *  Add obj to the master conf->objs list and its indexes.
      */
     list_append(conf->objs, serial);
+    insert_obj_index(conf->consoleIndex, serial->name, serial);
+    insert_obj_index(conf->deviceIndex, serial->aux.serial.dev, serial);
 
     return(serial);
 }
@@ -390,12 +470,13 @@ int open_serial_obj(obj_t *serial)
         write_notify_msg(serial, LOG_INFO,
             "Console [%s] disconnected from \"%s\"",
             serial->name, serial->aux.serial.dev);
-        tpoll_clear(tp_global, serial->fd, POLLIN | POLLOUT);
+        tpoll_clear(serial->tp, serial->fd, POLLIN | POLLOUT);
         set_tty_mode(&serial->aux.serial.tty, serial->fd);
         if (close(serial->fd) < 0)      /* log err and continue */
             log_msg(LOG_WARNING, "Unable to close [%s] device \"%s\": %s",
                 serial->name, serial->aux.serial.dev, strerror(errno));
         serial->fd = -1;
+        mark_console_down(serial);
     }
     flags = O_RDWR | O_NONBLOCK | O_NOCTTY;
     if ((fd = open(serial->aux.serial.dev, flags)) < 0) {
@@ -435,9 +516,11 @@ int open_serial_obj(obj_t *serial)
     get_tty_raw(&tty, fd);
     set_serial_opts(&tty, serial, &serial->aux.serial.opts);
     set_tty_mode(&tty, fd);
+    set_serial_dev_opts(serial, fd);
     serial->fd = fd;
     serial->gotEOF = 0;
-    tpoll_set(tp_global, serial->fd, POLLIN);
+    tpoll_set_arg(serial->tp, serial->fd, POLLIN, serial);
+    mark_console_up(serial);
     /*
      *  Success!
      */
@@ -445,7 +528,7 @@ int open_serial_obj(obj_t *serial)
         serial->name, serial->aux.serial.dev);
     DPRINTF((9, "Opened [%s] serial: fd=%d dev=%s bps=%d.\n",
         serial->name, serial->fd, serial->aux.serial.dev,
-        bps_to_int(serial->aux.serial.opts.bps)));
+        serial->aux.serial.opts.baud));
     return(0);
 
 err:
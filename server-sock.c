@@ -31,22 +31,26 @@
 #include <arpa/inet.h>
 #include <assert.h>
 #include <errno.h>
-#include <fnmatch.h>
+#include <netdb.h>
 #include <pthread.h>
 #include <regex.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
 #include "common.h"
 #include "lex.h"
 #include "log.h"
+#include "probe.h"
 #include "server.h"
 #include "util-file.h"
 #include "util-net.h"
 #include "util-str.h"
+#include "util.h"
 #include "wrapper.h"
 
 
@@ -66,62 +70,318 @@ int deny_severity = LOG_WARNING;        /* logging level for rejected reqs */
 #endif /* WITH_TCP_WRAPPERS */
 
 
-static int resolve_addr(server_conf_t *conf, req_t *req, int sd);
-static int recv_greeting(req_t *req);
+/*  A response is formatted into a buffer grown as needed so that it can be
+ *    sent with a single write regardless of how many consoles it lists.
+ */
+typedef struct rsp_buf {
+    char            *data;              /* response text being formatted     */
+    int              len;               /* num bytes of data in use          */
+    int              size;              /* num bytes of data allocated       */
+} rsp_buf_t;
+
+/*  The listing of all consoles sorted by name is cached since inventory
+ *    tools may query every console every few seconds.  The listing is
+ *    rebuilt once the generation count of the console index has changed.
+ *    It is ref-counted so a client can still be sent a listing that has
+ *    since been replaced.
+ */
+typedef struct console_listing {
+    int              refCount;          /* num refs held on this listing     */
+    unsigned         gen;               /* console index gen of the listing  */
+    int              numConsoles;       /* num console objs in the listing   */
+    obj_t          **consoles;          /* array of consoles sorted by name  */
+    rsp_buf_t        names;             /* lex-encoded CONSOLE tokens        */
+} console_listing_t;
+
+static pthread_mutex_t listingLock = PTHREAD_MUTEX_INITIALIZER;
+static console_listing_t *listing = NULL;
+
+
+static int read_client_line(client_setup_t *cs);
+static int resolve_addr(req_t *req, int timeout);
+static int check_client_addr(server_conf_t *conf, req_t *req);
+static int recv_greeting(req_t *req, char *buf);
 static void parse_greeting(Lex l, req_t *req);
-static int recv_req(req_t *req);
+static int recv_req(req_t *req, char *buf);
 static void parse_cmd_opts(Lex l, req_t *req);
 static int query_consoles(server_conf_t *conf, req_t *req);
+static void sort_consoles(List consoles);
+static int compare_console_ptrs(const void *p1, const void *p2);
 static int query_consoles_via_globbing(
-    server_conf_t *conf, req_t *req, List matches);
+    server_conf_t *conf, List pats, List matches);
 static int query_consoles_via_regex(
-    server_conf_t *conf, req_t *req, List matches);
+    server_conf_t *conf, List pats, List matches, char *errbuf, int errlen);
 static int validate_req(req_t *req);
 static int check_too_many_consoles(req_t *req);
 static int check_busy_consoles(req_t *req);
 static int send_rsp(req_t *req, int errnum, char *errmsg);
-static int perform_query_cmd(req_t *req);
+static int send_rsp_data(req_t *req, int errnum, char *errmsg,
+    const rsp_buf_t *names, const rsp_buf_t *data);
+static int append_console_token(rsp_buf_t *rb, obj_t *console, int status);
+static int count_console_clients(obj_t *console);
+static void append_rsp_buf(rsp_buf_t *rb, const char *fmt, ...);
+static console_listing_t * get_console_listing(server_conf_t *conf);
+static void put_console_listing(console_listing_t *cl);
+static int perform_query_cmd(req_t *req, server_conf_t *conf);
 static int perform_monitor_cmd(req_t *req, server_conf_t *conf);
+static int perform_log_range_cmd(req_t *req);
 static int perform_connect_cmd(req_t *req, server_conf_t *conf);
-static void check_console_state(obj_t *console, obj_t *client);
+static int perform_mux_cmd(req_t *req, server_conf_t *conf);
 
 
-void process_client(client_arg_t *args)
+client_setup_t * create_client_setup(
+    server_conf_t *conf, int sd, int isMetrics)
 {
-/*  The thread responsible for accepting a client connection
- *    and processing the request.
- *  The QUERY cmd is processed entirely by this thread.
+/*  Creates the state for receiving the handshake of the non-blocking
+ *    connection accepted by the daemon (conf) on (sd).  If (isMetrics)
+ *    is true, an HTTP request for the metrics is expected instead of
+ *    a client greeting.
+ *  The client addr is resolved here only from the host cache, starting
+ *    a lookup if needed; the worker waits for it via check_client_addr().
+ */
+    client_setup_t *cs;
+
+    assert(conf != NULL);
+    assert(sd >= 0);
+
+    if (!(cs = malloc(sizeof(client_setup_t)))) {
+        out_of_memory();
+    }
+    cs->conf = conf;
+    cs->sd = sd;
+    cs->timer = -1;
+    cs->req = NULL;
+    cs->httpReq = NULL;
+    cs->buf = NULL;
+    cs->len = 0;
+    cs->size = 0;
+
+    if (isMetrics) {
+        cs->state = CLIENT_SETUP_HTTP_REQUEST;
+    }
+    else {
+        cs->state = CLIENT_SETUP_GREETING;
+        cs->req = create_req();
+        cs->req->sd = sd;
+        (void) resolve_addr(cs->req, 0);
+        PROBE2(client_handshake, sd, "greeting");
+    }
+    return(cs);
+}
+
+
+void destroy_client_setup(client_setup_t *cs)
+{
+/*  Destroys the client setup state (cs), closing its connection unless
+ *    it has since been handed off by a worker.
+ */
+    if (!cs) {
+        return;
+    }
+    if (cs->req) {
+        PROBE2(client_handshake, cs->sd, "error");
+        destroy_req(cs->req);           /* also closes sd */
+    }
+    else if (cs->sd >= 0) {
+        if (close(cs->sd) < 0) {
+            log_err(errno, "close() failed on fd=%d", cs->sd);
+        }
+    }
+    free(cs->httpReq);
+    free(cs->buf);
+    free(cs);
+    return;
+}
+
+
+int read_client_setup(client_setup_t *cs)
+{
+/*  Receives whatever has arrived of the handshake on the non-blocking
+ *    connection (cs), saving a partial line until the rest of it arrives.
+ *    The greeting is answered once it has been received; this response
+ *    fits within the socket send buffer of a new connection.
+ *  This is called by the client setup thread whenever the connection
+ *    is ready for reading, so a slow client cannot hold up any other.
+ *  Returns 1 once the request has been received, 0 if more data is
+ *    needed, or -1 on error (in which case the setup should be destroyed).
+ */
+    int rc;
+
+    assert(cs != NULL);
+    assert(cs->state != CLIENT_SETUP_DONE);
+
+    while ((rc = read_client_line(cs)) > 0) {
+        switch(cs->state) {
+        case CLIENT_SETUP_GREETING:
+            DPRINTF((5, "Received greeting: %s", cs->buf));
+            if (recv_greeting(cs->req, cs->buf) < 0)
+                return(-1);
+            PROBE2(client_handshake, cs->sd, "request");
+            cs->state = CLIENT_SETUP_REQUEST;
+            break;
+        case CLIENT_SETUP_REQUEST:
+            DPRINTF((5, "Received request: %s", cs->buf));
+            if (recv_req(cs->req, cs->buf) < 0)
+                return(-1);
+            PROBE2(client_handshake, cs->sd, "queue");
+            cs->state = CLIENT_SETUP_DONE;
+            return(1);
+        case CLIENT_SETUP_HTTP_REQUEST:
+            cs->httpReq = create_string(cs->buf);
+            cs->state = CLIENT_SETUP_HTTP_HEADERS;
+            break;
+        case CLIENT_SETUP_HTTP_HEADERS:
+            if (!strcmp(cs->buf, "\r\n") || !strcmp(cs->buf, "\n")) {
+                cs->state = CLIENT_SETUP_DONE;
+                return(1);
+            }
+            break;                      /* discard request headers */
+        default:
+            assert(0);
+            return(-1);
+        }
+    }
+    if ((rc < 0) && (errno == 0) && (cs->state == CLIENT_SETUP_HTTP_HEADERS)) {
+        cs->state = CLIENT_SETUP_DONE;
+        return(1);
+    }
+    if (rc < 0) {
+        if (!cs->req) {
+            DPRINTF((5, "Unable to read metrics request: %s.\n",
+                (errno ? strerror(errno) : "EOF")));
+        }
+        else if (errno == 0) {
+            log_msg(LOG_NOTICE, "Connection terminated by <%s:%d>",
+                cs->req->fqdn, cs->req->port);
+        }
+        else {
+            log_msg(LOG_NOTICE, "Unable to read %s from <%s:%d>: %s",
+                (cs->state == CLIENT_SETUP_GREETING ? "greeting" : "request"),
+                cs->req->fqdn, cs->req->port, strerror(errno));
+        }
+    }
+    return(rc);
+}
+
+
+static int read_client_line(client_setup_t *cs)
+{
+/*  Reads the next line of the handshake from the non-blocking connection
+ *    (cs) into cs->buf, which is grown as needed up to MAX_SOCK_LINE.
+ *  Like read_line(), the line is read a byte at a time so that no data
+ *    following the newline is consumed, the newline is stored, and a line
+ *    that does not fit is returned in pieces.
+ *  Returns 1 once a complete line has been NUL-terminated in cs->buf,
+ *    0 if the rest of the line has yet to arrive, or -1 on error
+ *    (with errno set to 0 if the connection was terminated).
+ */
+    unsigned char c;
+    ssize_t rv;
+    char *p;
+    int n;
+
+    for (;;) {
+        if (cs->len + 1 >= cs->size) {
+            if (cs->size >= MAX_SOCK_LINE) {
+                break;
+            }
+            n = (cs->size > 0) ? cs->size * 2 : MAX_LINE;
+            if (n > MAX_SOCK_LINE) {
+                n = MAX_SOCK_LINE;
+            }
+            if (!(p = realloc(cs->buf, n))) {
+                out_of_memory();
+            }
+            cs->buf = p;
+            cs->size = n;
+        }
+        rv = read(cs->sd, &c, sizeof(c));
+        if (rv == 1) {
+            cs->buf[cs->len++] = c;
+            if (c == '\n')
+                break;
+        }
+        else if (rv == 0) {
+            if (cs->len == 0) {
+                errno = 0;
+                return(-1);
+            }
+            break;
+        }
+        else if (errno == EINTR) {
+            continue;
+        }
+        else if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+            return(0);
+        }
+        else {
+            return(-1);
+        }
+    }
+    cs->buf[cs->len] = '\0';
+    cs->len = 0;
+    return(1);
+}
+
+
+int is_bulk_client_setup(client_setup_t *cs)
+{
+/*  Returns true if the connection (cs) is for a request that can keep
+ *    a worker busy for a while (ie, a metrics scrape or a MONITOR cmd
+ *    replaying a time range of the console log); these are processed
+ *    by the bulk workers so as not to delay the handshakes of others.
+ */
+    assert(cs != NULL);
+    assert(cs->state == CLIENT_SETUP_DONE);
+
+    if (!cs->req) {
+        return(1);
+    }
+    return(!cs->req->enableMux && (cs->req->command == CONMAN_CMD_MONITOR)
+        && is_log_range_req(cs->req));
+}
+
+
+void process_client(server_conf_t *conf, client_setup_t *cs)
+{
+/*  Processes the request received on the client connection (cs),
+ *    taking over its req.
+ *  This is called by one of the client worker threads.  The socket is
+ *    made blocking, but its send & receive timeouts bound how long
+ *    a client can occupy the worker.
+ *  The QUERY cmd (and a MONITOR cmd replaying a time range of
+ *    the console log) is processed entirely by this thread.
  *  The MONITOR and CONNECT cmds are setup and then placed
  *    in the conf->objs list to be handled by mux_io().
+ *    Either can request a multiplexed session instead.
+ *  The client_handshake probe fires as each phase of the handshake begins.
  */
-    int sd;
-    server_conf_t *conf;
     req_t *req;
+    int sd;
 
-    /*  Free the tmp struct that was created by accept_client()
-     *    in order to pass multiple args to this thread.
-     */
-    assert(args != NULL);
-    sd = args->sd;
-    conf = args->conf;
-    free(args);
+    assert(conf != NULL);
+    assert(cs != NULL);
+    assert(cs->req != NULL);
+    assert(cs->state == CLIENT_SETUP_DONE);
 
     DPRINTF((5, "Processing new client.\n"));
 
-    x_pthread_detach(pthread_self());
+    req = cs->req;
+    sd = req->sd;
+    cs->req = NULL;
+    cs->sd = -1;
+    set_fd_blocking(sd);
 
-    req = create_req();
-
-    if (resolve_addr(conf, req, sd) < 0)
-        goto err;
-    if (recv_greeting(req) < 0)
-        goto err;
-    if (recv_req(req) < 0)
+    PROBE2(client_handshake, sd, "resolve");
+    if (check_client_addr(conf, req) < 0)
         goto err;
+    PROBE2(client_handshake, sd, "query");
     if (query_consoles(conf, req) < 0)
         goto err;
+    PROBE2(client_handshake, sd, "validate");
     if (validate_req(req) < 0)
         goto err;
+    PROBE2(client_handshake, sd, "perform");
 
     /*  send_rsp() needs to know if the reset command is supported.
      *    Since it cannot check resetCmd in the server_conf struct,
@@ -130,17 +390,27 @@ void process_client(client_arg_t *args)
     if (conf->resetCmd)
         req->enableReset = 1;
 
+    if (req->enableMux && (req->command != CONMAN_CMD_QUERY)) {
+        if (perform_mux_cmd(req, conf) < 0)
+            goto err;
+        PROBE2(client_handshake, sd, "done");
+        return;
+    }
     switch(req->command) {
     case CONMAN_CMD_CONNECT:
         if (perform_connect_cmd(req, conf) < 0)
             goto err;
         break;
     case CONMAN_CMD_MONITOR:
-        if (perform_monitor_cmd(req, conf) < 0)
+        if (is_log_range_req(req)) {
+            if (perform_log_range_cmd(req) < 0)
+                goto err;
+        }
+        else if (perform_monitor_cmd(req, conf) < 0)
             goto err;
         break;
     case CONMAN_CMD_QUERY:
-        if (perform_query_cmd(req) < 0)
+        if (perform_query_cmd(req, conf) < 0)
             goto err;
         break;
     default:
@@ -148,51 +418,94 @@ void process_client(client_arg_t *args)
             req->command, req->user, req->fqdn, req->port);
         goto err;
     }
+    PROBE2(client_handshake, sd, "done");
     return;
 
 err:
+    PROBE2(client_handshake, sd, "error");
     destroy_req(req);
     return;
 }
 
 
-static int resolve_addr(server_conf_t *conf, req_t *req, int sd)
+static int resolve_addr(req_t *req, int timeout)
 {
 /*  Resolves the network information associated with the
  *    peer at the other end of the socket connection.
- *  Returns 0 if the remote client address is valid, or -1 on error.
+ *  The host name lookup waits for up to (timeout) seconds.
+ *  Returns 1 if the host name was resolved, or 0 if the IP addr string
+ *    is used in its place.
  */
-    struct sockaddr_in addr;
+    struct sockaddr_storage addr;
     socklen_t addrlen = sizeof(addr);
+    struct sockaddr_in sin;
+    struct sockaddr_in6 *sin6;
     char buf[MAX_LINE];
+    char port[NI_MAXSERV];
     char *p;
     int gotHostName = 0;
 
-    assert(sd >= 0);
+    assert(req->sd >= 0);
 
-    req->sd = sd;
-    if (getpeername(sd, (struct sockaddr *) &addr, &addrlen) < 0)
+    if (getpeername(req->sd, (struct sockaddr *) &addr, &addrlen) < 0)
         log_err(errno, "Unable to get address of remote peer");
-    if (!inet_ntop(AF_INET, &addr.sin_addr, buf, sizeof(buf)))
-        log_err(errno, "Unable to convert network address into string");
-    req->port = ntohs(addr.sin_port);
+    /*
+     *  Report IPv4 clients of a dual-stack listen socket by their IPv4 addr.
+     */
+    sin6 = (struct sockaddr_in6 *) &addr;
+    if ((addr.ss_family == AF_INET6)
+      && IN6_IS_ADDR_V4MAPPED(&sin6->sin6_addr)) {
+        memset(&sin, 0, sizeof(sin));
+        sin.sin_family = AF_INET;
+        sin.sin_port = sin6->sin6_port;
+        memcpy(&sin.sin_addr, &sin6->sin6_addr.s6_addr[12],
+            sizeof(sin.sin_addr));
+        memcpy(&addr, &sin, sizeof(sin));
+        addrlen = sizeof(sin);
+    }
+    if (getnameinfo((struct sockaddr *) &addr, addrlen, buf, sizeof(buf),
+      port, sizeof(port), NI_NUMERICHOST | NI_NUMERICSERV) != 0)
+        log_err(0, "Unable to convert network address into string");
+    req->port = atoi(port);
+    if (req->ip)
+        free(req->ip);
     req->ip = create_string(buf);
     /*
      *  Attempt to resolve IP address.  If it succeeds, buf contains
      *    host string; if it fails, buf is unchanged with IP addr string.
      *    Either way, copy buf to prevent having to code everything as
      *    (req->host ? req->host : req->ip).
+     *  Lookups are cached, and a slow resolver only delays the handshake
+     *    by the timeout before falling back on the IP addr.
      */
-    if ((host_addr4_to_name(&addr.sin_addr, buf, sizeof(buf)))) {
+    if ((host_addr_to_name((struct sockaddr *) &addr, addrlen,
+      buf, sizeof(buf), timeout))) {
         gotHostName = 1;
-        req->fqdn = create_string(buf);
-        if ((p = strchr(buf, '.')))
-            *p = '\0';
-        req->host = create_string(buf);
     }
-    else {
-        req->fqdn = create_string(buf);
-        req->host = create_string(buf);
+    if (req->fqdn)
+        free(req->fqdn);
+    req->fqdn = create_string(buf);
+    if (gotHostName && (p = strchr(buf, '.')))
+        *p = '\0';
+    if (req->host)
+        free(req->host);
+    req->host = create_string(buf);
+    return(gotHostName);
+}
+
+
+static int check_client_addr(server_conf_t *conf, req_t *req)
+{
+/*  Completes the resolution of the client addr begun by resolve_addr()
+ *    when the connection was accepted, then checks whether the client is
+ *    permitted to connect.
+ *  Returns 0 if the remote client address is valid, or -1 on error.
+ */
+    int gotHostName;
+
+    gotHostName = strcmp(req->fqdn, req->ip) != 0;
+    if (!gotHostName) {
+        gotHostName = resolve_addr(req, CLIENT_RESOLVE_TIMEOUT);
     }
 
 #if WITH_TCP_WRAPPERS
@@ -217,33 +530,19 @@ static int resolve_addr(server_conf_t *conf, req_t *req, int sd)
 }
 
 
-static int recv_greeting(req_t *req)
+static int recv_greeting(req_t *req, char *buf)
 {
 /*  Performs the initial handshake with the client
- *    (SOMEDAY including authentication & encryption, if needed).
+ *    (SOMEDAY including authentication & encryption, if needed)
+ *    once its greeting line (buf) has been received.
  *  Returns 0 if the greeting is valid, or -1 on error.
  */
-    int n;
-    char buf[MAX_SOCK_LINE];
     Lex l;
     int done = 0;
     int tok;
 
     assert(req->sd >= 0);
 
-    if ((n = read_line(req->sd, buf, sizeof(buf))) < 0) {
-        log_msg(LOG_NOTICE, "Unable to read greeting from <%s:%d>: %s",
-            req->fqdn, req->port, strerror(errno));
-        return(-1);
-    }
-    else if (n == 0) {
-        log_msg(LOG_NOTICE, "Connection terminated by <%s:%d>",
-            req->fqdn, req->port);
-        return(-1);
-    }
-
-    DPRINTF((5, "Received greeting: %s", buf));
-
     l = lex_create(buf, proto_strs);
     while (!done) {
         tok = lex_next(l);
@@ -279,7 +578,8 @@ static int recv_greeting(req_t *req)
 static void parse_greeting(Lex l, req_t *req)
 {
 /*  Parses the "HELLO" command from the client:
- *    HELLO USER='<str>' TTY='<str>'
+ *    HELLO USER='<str>' TTY='<str>' OPTION=COMPRESS
+ *  Compression is only accepted if zlib support was compiled in.
  */
     int done = 0;
     int tok;
@@ -303,6 +603,13 @@ static void parse_greeting(Lex l, req_t *req)
                 req->tty = lex_decode(create_string(lex_text(l)));
             }
             break;
+        case CONMAN_TOK_OPTION:
+            if ((lex_next(l) == '=') && (lex_next(l) == CONMAN_TOK_COMPRESS)) {
+#if WITH_ZLIB
+                req->enableCompress = 1;
+#endif /* WITH_ZLIB */
+            }
+            break;
         case LEX_EOF:
         case LEX_EOL:
             done = 1;
@@ -315,32 +622,18 @@ static void parse_greeting(Lex l, req_t *req)
 }
 
 
-static int recv_req(req_t *req)
+static int recv_req(req_t *req, char *buf)
 {
-/*  Receives the request from the client after the greeting has completed.
+/*  Parses the request line (buf) received from the client
+ *    after the greeting has completed.
  *  Returns 0 if the request is read OK, or -1 on error.
  */
-    int n;
-    char buf[MAX_SOCK_LINE];
     Lex l;
     int done = 0;
     int tok;
 
     assert(req->sd >= 0);
 
-    if ((n = read_line(req->sd, buf, sizeof(buf))) < 0) {
-        log_msg(LOG_NOTICE, "Unable to read request from <%s:%d>: %s",
-            req->fqdn, req->port, strerror(errno));
-        return(-1);
-    }
-    else if (n == 0) {
-        log_msg(LOG_NOTICE, "Connection terminated by <%s:%d>",
-            req->fqdn, req->port);
-        return(-1);
-    }
-
-    DPRINTF((5, "Received request: %s", buf));
-
     l = lex_create(buf, proto_strs);
     while (!done) {
         tok = lex_next(l);
@@ -397,12 +690,32 @@ static void parse_cmd_opts(Lex l, req_t *req)
                     req->enableForce = 1;
                 else if (lex_prev(l) == CONMAN_TOK_JOIN)
                     req->enableJoin = 1;
+                else if (lex_prev(l) == CONMAN_TOK_MULTIPLEX)
+                    req->enableMux = 1;
                 else if (lex_prev(l) == CONMAN_TOK_QUIET)
                     req->enableQuiet = 1;
                 else if (lex_prev(l) == CONMAN_TOK_REGEX)
                     req->enableRegex = 1;
+                else if (lex_prev(l) == CONMAN_TOK_STATUS)
+                    req->enableStatus = 1;
             }
             break;
+        case CONMAN_TOK_BYTES:
+            if ((lex_next(l) == '=') && (lex_next(l) == LEX_INT))
+                req->logBytes = (off_t) strtoll(lex_text(l), NULL, 10);
+            break;
+        case CONMAN_TOK_LINES:
+            if ((lex_next(l) == '=') && (lex_next(l) == LEX_INT))
+                req->logLines = (off_t) strtoll(lex_text(l), NULL, 10);
+            break;
+        case CONMAN_TOK_SINCE:
+            if ((lex_next(l) == '=') && (lex_next(l) == LEX_INT))
+                req->logSince = (time_t) strtol(lex_text(l), NULL, 10);
+            break;
+        case CONMAN_TOK_UNTIL:
+            if ((lex_next(l) == '=') && (lex_next(l) == LEX_INT))
+                req->logUntil = (time_t) strtol(lex_text(l), NULL, 10);
+            break;
         case LEX_EOF:
         case LEX_EOL:
             done = 1;
@@ -424,27 +737,41 @@ static int query_consoles(server_conf_t *conf, req_t *req)
  *    is replaced with a list of console obj_t's.
  */
     List matches;
+    int isRegex = req->enableRegex;
     int rc;
+    char buf[MAX_SOCK_LINE];
 
     if (list_is_empty(req->consoles) && (req->command != CONMAN_CMD_QUERY))
         return(0);
 
+    /*  An empty list for the QUERY command matches all consoles.
+     *    Unless their status is requested, these are sent straight from
+     *    the cached console listing by perform_query_cmd().
+     */
+    if (list_is_empty(req->consoles)) {
+        if (!req->enableStatus) {
+            req->enableQueryAll = 1;
+            return(0);
+        }
+        list_append(req->consoles, create_string("*"));
+        isRegex = 0;
+    }
+
     /*  The NULL destructor is used for 'matches' because the matches list
      *    will only contain refs to objs contained in the conf->objs list.
      *    These objs will be destroyed when the conf->objs list is destroyed.
      */
     matches = list_create(NULL);
 
-    if (req->enableRegex)
-        rc = query_consoles_via_regex(conf, req, matches);
-    else
-        rc = query_consoles_via_globbing(conf, req, matches);
+    rc = match_console_objs(conf, req->consoles, isRegex, matches,
+        buf, sizeof(buf));
+    if (rc < 0)
+        send_rsp(req, CONMAN_ERR_BAD_REGEX, buf);
 
     /*  Replace original list of strings with list of obj_t's.
      */
     list_destroy(req->consoles);
     req->consoles = matches;
-    list_sort(req->consoles, (ListCmpF) compare_objs);
 
     /*  If only one console was selected for a broadcast, then
      *    the session is placed into R/W mode instead of W/O mode.
@@ -457,48 +784,117 @@ static int query_consoles(server_conf_t *conf, req_t *req)
 }
 
 
+int match_console_objs(server_conf_t *conf, List pats, int isRegex,
+    List matches, char *errbuf, int errlen)
+{
+/*  Appends the console objs whose names match the list of patterns (pats)
+ *    to the (matches) list, sorted by name without duplicates.
+ *    If (isRegex) is true, patterns are regular expressions;
+ *    o/w, they are shell-style globs.
+ *  A lone "*" glob is resolved via the cached console listing.
+ *  Returns 0 on success, or -1 on error (writing a message into errbuf).
+ */
+    console_listing_t *cl;
+    int rc;
+    int k;
+
+    assert(conf != NULL);
+    assert(pats != NULL);
+    assert(matches != NULL);
+
+    if (list_is_empty(pats))
+        return(0);
+    if (!isRegex && (list_count(pats) == 1) && list_is_empty(matches)
+      && !strcmp(list_peek(pats), "*")) {
+        cl = get_console_listing(conf);
+        for (k = 0; k < cl->numConsoles; k++)
+            list_append(matches, cl->consoles[k]);
+        put_console_listing(cl);
+        return(0);
+    }
+    if (isRegex)
+        rc = query_consoles_via_regex(conf, pats, matches, errbuf, errlen);
+    else
+        rc = query_consoles_via_globbing(conf, pats, matches);
+
+    sort_consoles(matches);
+    return(rc);
+}
+
+
+static void sort_consoles(List consoles)
+{
+/*  Sorts the list of console objs by name (via compare_objs()),
+ *    removing any duplicates.
+ *  The objs are sorted in an array since list_sort() is O(n^2).
+ */
+    obj_t **objs;
+    int n;
+    int k;
+
+    if ((n = list_count(consoles)) <= 1) {
+        return;
+    }
+    if (!(objs = malloc(n * sizeof(obj_t *)))) {
+        out_of_memory();
+    }
+    for (k = 0; k < n; k++) {
+        objs[k] = list_pop(consoles);
+    }
+    qsort(objs, n, sizeof(obj_t *), compare_console_ptrs);
+
+    for (k = 0; k < n; k++) {
+        if ((k == 0) || (objs[k] != objs[k - 1])) {
+            list_append(consoles, objs[k]);
+        }
+    }
+    free(objs);
+    return;
+}
+
+
+static int compare_console_ptrs(const void *p1, const void *p2)
+{
+/*  Used by qsort() to compare console obj ptrs via compare_objs().
+ *  Names that compare_objs() considers equal (eg, "foo01" and "foo1") are
+ *    ordered by strcmp() so that duplicate objs are always adjacent.
+ */
+    obj_t *obj1 = *(obj_t * const *) p1;
+    obj_t *obj2 = *(obj_t * const *) p2;
+    int rc;
+
+    if ((rc = compare_objs(obj1, obj2)) != 0) {
+        return(rc);
+    }
+    return(strcmp(obj1->name, obj2->name));
+}
+
+
 static int query_consoles_via_globbing(
-    server_conf_t *conf, req_t *req, List matches)
+    server_conf_t *conf, List pats, List matches)
 {
 /*  Match request patterns against console names using shell-style globbing.
- *  This is less efficient than matching via regular expressions
- *    since the console list must be traversed for each pattern, and the
- *    matches list must be traversed for each match to prevent duplicates.
+ *  Each pattern is resolved via the console index:  a plain name is looked
+ *    up by its hash, and a pattern with wildcards is only tested against
+ *    the names sharing its literal prefix.  Consoles matched by more than
+ *    one pattern are removed afterwards by sort_consoles().
  */
-    char *p;
-    ListIterator i, j;
+    ListIterator i;
     char *pat;
-    obj_t *obj;
-
-    /*  An empty list for the QUERY command matches all consoles.
-     */
-    if (list_is_empty(req->consoles)) {
-        p = create_string("*");
-        list_append(req->consoles, p);
-    }
 
     /*  Search objs for console names matching console patterns in the request.
      */
-    i = list_iterator_create(req->consoles);
-    j = list_iterator_create(conf->objs);
+    i = list_iterator_create(pats);
     while ((pat = list_next(i))) {
-        list_iterator_reset(j);
-        while ((obj = list_next(j))) {
-            if (!is_console_obj(obj))
-                continue;
-            if (!fnmatch(pat, obj->name, 0)
-              && !list_find_first(matches, (ListFindF) find_obj, obj))
-                list_append(matches, obj);
-        }
+        (void) match_obj_index(conf->consoleIndex, pat, matches);
     }
     list_iterator_destroy(i);
-    list_iterator_destroy(j);
     return(0);
 }
 
 
 static int query_consoles_via_regex(
-    server_conf_t *conf, req_t *req, List matches)
+    server_conf_t *conf, List pats, List matches, char *errbuf, int errlen)
 {
 /*  Match request patterns against console names using regular expressions.
  */
@@ -510,16 +906,9 @@ static int query_consoles_via_regex(
     regmatch_t match;
     obj_t *obj;
 
-    /*  An empty list for the QUERY command matches all consoles.
-     */
-    if (list_is_empty(req->consoles)) {
-        p = create_string(".*");
-        list_append(req->consoles, p);
-    }
-
     /*  Combine console patterns via alternation to create single regex.
      */
-    i = list_iterator_create(req->consoles);
+    i = list_iterator_create(pats);
     strlcpy(buf, list_next(i), sizeof(buf));
     while ((p = list_next(i))) {
         strlcat(buf, "|", sizeof(buf));
@@ -535,10 +924,9 @@ static int query_consoles_via_regex(
      */
     rc = regcomp(&rex, buf, REG_EXTENDED | REG_ICASE);
     if (rc != 0) {
-        if (regerror(rc, &rex, buf, sizeof(buf)) > sizeof(buf))
+        if (regerror(rc, &rex, errbuf, errlen) > (size_t) errlen)
             log_msg(LOG_WARNING, "Got regerror() buffer overrun");
         regfree(&rex);
-        send_rsp(req, CONMAN_ERR_BAD_REGEX, buf);
         return(-1);
     }
 
@@ -562,9 +950,12 @@ static int query_consoles_via_regex(
 static int validate_req(req_t *req)
 {
 /*  Validates the given request.
+ *  A multiplexed session may start without any consoles since the client
+ *    can subscribe to them later.
  *  Returns 0 if the request is valid, or -1 on error.
  */
-    if (list_is_empty(req->consoles)) {
+    if (list_is_empty(req->consoles) && !req->enableMux
+      && !req->enableQueryAll) {
         send_rsp(req, CONMAN_ERR_NO_CONSOLES, "Found no matching consoles");
         return(-1);
     }
@@ -587,34 +978,34 @@ static int check_too_many_consoles(req_t *req)
  */
     ListIterator i;
     obj_t *obj;
-    char buf[MAX_SOCK_LINE];
+    char buf[MAX_LINE];
+    rsp_buf_t data;
 
-    assert(!list_is_empty(req->consoles));
+    assert(!list_is_empty(req->consoles) || req->enableMux
+        || req->enableQueryAll);
 
     if (req->command == CONMAN_CMD_QUERY)
         return(0);
+    if (req->enableMux)
+        return(0);
     if (list_count(req->consoles) == 1)
         return(0);
     if ((req->command == CONMAN_CMD_CONNECT) && (req->enableBroadcast))
         return(0);
 
-    snprintf(buf, sizeof(buf), "Found %d matching consoles",
-        list_count(req->consoles));
-    send_rsp(req, CONMAN_ERR_TOO_MANY_CONSOLES, buf);
+    data.data = NULL;
+    data.len = data.size = 0;
 
-    /*  FIXME? Replace with single write_n()?
-     */
     i = list_iterator_create(req->consoles);
     while ((obj = list_next(i))) {
-        strlcpy(buf, obj->name, sizeof(buf));
-        strlcat(buf, "\n", sizeof(buf));
-        if (write_n(req->sd, buf, strlen(buf)) < 0) {
-            log_msg(LOG_NOTICE, "Unable to write to <%s:%d>: %s",
-                req->fqdn, req->port, strerror(errno));
-            break;
-        }
+        append_rsp_buf(&data, "%s\n", obj->name);
     }
     list_iterator_destroy(i);
+
+    snprintf(buf, sizeof(buf), "Found %d matching consoles",
+        list_count(req->consoles));
+    send_rsp_data(req, CONMAN_ERR_TOO_MANY_CONSOLES, buf, NULL, &data);
+    free(data.data);
     return(-1);
 }
 
@@ -634,8 +1025,10 @@ static int check_busy_consoles(req_t *req)
     time_t t;
     char *delta;
     char buf[MAX_LINE];
+    rsp_buf_t data;
 
-    assert(!list_is_empty(req->consoles));
+    assert(!list_is_empty(req->consoles) || req->enableMux
+        || req->enableQueryAll);
 
     if ((req->command == CONMAN_CMD_QUERY)
       || (req->command == CONMAN_CMD_MONITOR))
@@ -664,7 +1057,8 @@ static int check_busy_consoles(req_t *req)
         snprintf(buf, sizeof(buf), "Found %d consoles already in use",
             list_count(busy));
     }
-    send_rsp(req, CONMAN_ERR_BUSY_CONSOLES, buf);
+    data.data = NULL;
+    data.len = data.size = 0;
 
     /*  Note: the "busy" list contains object references,
      *    so they DO NOT get destroyed here when removed from the list.
@@ -682,25 +1076,21 @@ static int check_busy_consoles(req_t *req)
             x_pthread_mutex_unlock(&writer->bufLock);
             delta = create_time_delta_string(t, -1);
 
-            snprintf(buf, sizeof(buf),
+            append_rsp_buf(&data,
                 "Console [%s] open %s by <%s@%s>%s%s (idle %s).\n",
                 console->name, (gotBcast ? "B/C" : "R/W"),
                 writer->aux.client.req->user, writer->aux.client.req->host,
                 (tty ? " on " : ""), (tty ? tty : ""),
                 (delta ? delta : "???"));
-            buf[sizeof(buf) - 2] = '\n';
-            buf[sizeof(buf) - 1] = '\0';
             if (delta)
                 free(delta);
-            if (write_n(req->sd, buf, strlen(buf)) < 0) {
-                log_msg(LOG_NOTICE, "Unable to write to <%s:%d>: %s",
-                    req->fqdn, req->port, strerror(errno));
-                break;
-            }
         }
         list_iterator_destroy(i);
     }
     list_destroy(busy);
+
+    send_rsp_data(req, CONMAN_ERR_BUSY_CONSOLES, buf, NULL, &data);
+    free(data.data);
     return(-1);
 }
 
@@ -710,12 +1100,32 @@ static int send_rsp(req_t *req, int errnum, char *errmsg)
 /*  Sends a response to the given request (req).
  *  If the request is valid and there are no errors,
  *    errnum = CONMAN_ERR_NONE and an "OK" response is sent.
+ *    If (errmsg) is also given, it is included as an informational message.
  *  Otherwise, (errnum) identifies the err_type enumeration (in common.h)
  *    and (errmsg) is a string describing the error in more detail.
  *  Returns 0 if the response is sent OK, or -1 on error.
  */
-    char buf[MAX_SOCK_LINE] = "";       /* init buf for appending with NUL */
+    return(send_rsp_data(req, errnum, errmsg, NULL, NULL));
+}
+
+
+static int send_rsp_data(req_t *req, int errnum, char *errmsg,
+    const rsp_buf_t *names, const rsp_buf_t *data)
+{
+/*  Sends a response to the given request (req) as per send_rsp().
+ *  If (names) is given, its lex-encoded CONSOLE tokens are sent in place
+ *    of those formatted from the req->consoles list.
+ *  If (data) is given, its lines are sent following the response.
+ *  The response is gathered into a single writev() no matter how many
+ *    consoles are listed.
+ *  Returns 0 if the response is sent OK, or -1 on error.
+ */
+    char buf[MAX_LINE] = "";            /* init buf for appending with NUL */
+    char msg[MAX_LINE] = "";            /* init msg for appending with NUL */
     char tmp[MAX_LINE];                 /* tmp buffer for lex-encoding strs */
+    rsp_buf_t rb;
+    struct iovec iov[4];
+    int iovcnt = 0;
     int n;
     ListIterator i;
     obj_t *console;
@@ -723,6 +1133,9 @@ static int send_rsp(req_t *req, int errnum, char *errmsg)
     assert(req->sd >= 0);
     assert(errnum >= 0);
 
+    rb.data = NULL;
+    rb.len = rb.size = 0;
+
     if (errnum == CONMAN_ERR_NONE) {
 
         n = append_format_string(buf, sizeof(buf), "%s",
@@ -730,10 +1143,22 @@ static int send_rsp(req_t *req, int errnum, char *errmsg)
         if (n == -1) {
             goto overrun;
         }
+        /*  The response to the greeting accepts compression if requested.
+         */
+        if ((req->command == CONMAN_CMD_NONE) && req->enableCompress) {
+            n = append_format_string(buf, sizeof(buf), " %s=%s",
+                LEX_TOK2STR(proto_strs, CONMAN_TOK_OPTION),
+                LEX_TOK2STR(proto_strs, CONMAN_TOK_COMPRESS));
+            if (n == -1) {
+                goto overrun;
+            }
+        }
         /*  If consoles have been defined by this point, the "response"
          *    is to the request as opposed to the greeting.
+         *  A multiplexed session instead announces each console via a
+         *    ctrl record once the client has been subscribed to it.
          */
-        if (list_count(req->consoles) > 0) {
+        if ((list_count(req->consoles) > 0) || req->enableMux || names) {
 
             if (req->enableReset) {
                 n = append_format_string(buf, sizeof(buf), " %s=%s",
@@ -743,23 +1168,34 @@ static int send_rsp(req_t *req, int errnum, char *errmsg)
                     goto overrun;
                 }
             }
-            i = list_iterator_create(req->consoles);
-            while ((console = list_next(i))) {
-                n = strlcpy(tmp, console->name, sizeof(tmp));
-                if ((size_t) n >= sizeof(tmp)) {
-                    goto overrun;
+            if (!names && !req->enableMux) {
+                i = list_iterator_create(req->consoles);
+                while ((console = list_next(i))) {
+                    if (append_console_token(&rb, console,
+                            req->enableStatus) < 0) {
+                        break;
+                    }
                 }
-                n = append_format_string(buf, sizeof(buf), " %s='%s'",
-                    LEX_TOK2STR(proto_strs, CONMAN_TOK_CONSOLE),
-                    lex_encode(tmp));
-                if (n == -1) {
+                list_iterator_destroy(i);
+                if (console) {
                     goto overrun;
                 }
+                names = &rb;
+            }
+        }
+        if (errmsg) {
+            n = strlcpy(tmp, errmsg, sizeof(tmp));
+            if ((size_t) n >= sizeof(tmp)) {
+                goto overrun;
+            }
+            n = append_format_string(msg, sizeof(msg), " %s='%s'",
+                LEX_TOK2STR(proto_strs, CONMAN_TOK_MESSAGE), lex_encode(tmp));
+            if (n == -1) {
+                goto overrun;
             }
-            list_iterator_destroy(i);
         }
 
-        n = append_format_string(buf, sizeof(buf), "\n");
+        n = append_format_string(msg, sizeof(msg), "\n");
         if (n == -1) {
             goto overrun;
         }
@@ -782,39 +1218,251 @@ static int send_rsp(req_t *req, int errnum, char *errmsg)
 
     /*  Write response to client.
      */
-    if (write_n(req->sd, buf, strlen(buf)) < 0) {
+    iov[iovcnt].iov_base = buf;
+    iov[iovcnt++].iov_len = strlen(buf);
+    if (names && (names->len > 0)) {
+        iov[iovcnt].iov_base = names->data;
+        iov[iovcnt++].iov_len = names->len;
+    }
+    if (msg[0] != '\0') {
+        iov[iovcnt].iov_base = msg;
+        iov[iovcnt++].iov_len = strlen(msg);
+    }
+    if (data && (data->len > 0)) {
+        iov[iovcnt].iov_base = data->data;
+        iov[iovcnt++].iov_len = data->len;
+    }
+    if (writev_n(req->sd, iov, iovcnt) < 0) {
         log_msg(LOG_NOTICE, "Unable to write to <%s:%d>: %s",
             req->fqdn, req->port, strerror(errno));
+        free(rb.data);
         return(-1);
     }
 
-    DPRINTF((5, "Sent response: %s", buf));
+    DPRINTF((5, "Sent response: %s%s%s", buf,
+        ((names && (names->len > 0)) ? " ..." : ""), msg));
+    free(rb.data);
     return(0);
 
 overrun:
     log_msg(LOG_WARNING,
         "Client <%s@%s:%d> request terminated due to buffer overrun",
         req->user, req->fqdn, req->port);
+    free(rb.data);
     return(-1);
 }
 
 
-static int perform_query_cmd(req_t *req)
+static int append_console_token(rsp_buf_t *rb, obj_t *console, int status)
+{
+/*  Appends the lex-encoded CONSOLE token for the (console) obj to (rb).
+ *  If (status) is true, the token is followed by the console's STATUS
+ *    and the number of CLIENTS attached to it.
+ *  Returns 0 on success, or -1 if the console name is too long.
+ */
+    char tmp[MAX_LINE];                 /* tmp buffer for lex-encoding strs */
+
+    assert(is_console_obj(console));
+
+    if (strlcpy(tmp, console->name, sizeof(tmp)) >= sizeof(tmp)) {
+        return(-1);
+    }
+    append_rsp_buf(rb, " %s='%s'",
+        LEX_TOK2STR(proto_strs, CONMAN_TOK_CONSOLE), lex_encode(tmp));
+
+    if (status) {
+        append_rsp_buf(rb, " %s='%s' %s=%d",
+            LEX_TOK2STR(proto_strs, CONMAN_TOK_STATUS),
+            (x_counter_load(&console->stats.tDown) == 0) ? "up" : "down",
+            LEX_TOK2STR(proto_strs, CONMAN_TOK_CLIENTS),
+            count_console_clients(console));
+    }
+    return(0);
+}
+
+
+static int count_console_clients(obj_t *console)
+{
+/*  Returns the number of clients attached to the (console) obj.
+ *  R/O and R/W clients are among the console's readers; B/C clients are
+ *    only among its writers, and have no writers of their own.
+ */
+    ListIterator i;
+    obj_t *obj;
+    int n = 0;
+
+    i = list_iterator_create(console->readers);
+    while ((obj = list_next(i))) {
+        if (is_client_obj(obj))
+            n++;
+    }
+    list_iterator_destroy(i);
+
+    i = list_iterator_create(console->writers);
+    while ((obj = list_next(i))) {
+        if (is_client_obj(obj) && list_is_empty(obj->writers))
+            n++;
+    }
+    list_iterator_destroy(i);
+    return(n);
+}
+
+
+static void append_rsp_buf(rsp_buf_t *rb, const char *fmt, ...)
+{
+/*  Appends the formatted string to the response (rb),
+ *    growing it as needed.
+ */
+    va_list vargs;
+    int n;
+
+    for (;;) {
+        if (rb->size - rb->len > 1) {
+            va_start(vargs, fmt);
+            n = vsnprintf(rb->data + rb->len, rb->size - rb->len, fmt, vargs);
+            va_end(vargs);
+            if ((n >= 0) && (n < rb->size - rb->len)) {
+                rb->len += n;
+                return;
+            }
+        }
+        rb->size = (rb->size > 0) ? rb->size * 2 : MAX_LINE;
+        if (!(rb->data = realloc(rb->data, rb->size))) {
+            out_of_memory();
+        }
+    }
+}
+
+
+static console_listing_t * get_console_listing(server_conf_t *conf)
+{
+/*  Returns a ref to the cached listing of all consoles, first rebuilding it
+ *    if the console index has been modified since it was cached.
+ *    The ref must be released via put_console_listing().
+ *  A listing built while the index is being modified is stamped with the
+ *    generation preceding those changes, so it is rebuilt on the next call.
+ */
+    console_listing_t *cl;
+    List matches;
+    unsigned gen;
+    int k;
+
+    gen = get_obj_index_gen(conf->consoleIndex);
+
+    x_pthread_mutex_lock(&listingLock);
+
+    if (!listing || (listing->gen != gen)) {
+
+        if (listing && (--listing->refCount == 0)) {
+            free(listing->consoles);
+            free(listing->names.data);
+            free(listing);
+        }
+        if (!(cl = malloc(sizeof(console_listing_t)))) {
+            out_of_memory();
+        }
+        matches = list_create(NULL);
+        (void) match_obj_index(conf->consoleIndex, "*", matches);
+
+        cl->refCount = 1;
+        cl->gen = gen;
+        cl->numConsoles = list_count(matches);
+        cl->consoles = malloc((cl->numConsoles + 1) * sizeof(obj_t *));
+        if (!cl->consoles) {
+            out_of_memory();
+        }
+        for (k = 0; k < cl->numConsoles; k++) {
+            cl->consoles[k] = list_pop(matches);
+        }
+        list_destroy(matches);
+        qsort(cl->consoles, cl->numConsoles, sizeof(obj_t *),
+            compare_console_ptrs);
+
+        cl->names.data = NULL;
+        cl->names.len = cl->names.size = 0;
+        for (k = 0; k < cl->numConsoles; k++) {
+            if (append_console_token(&cl->names, cl->consoles[k], 0) < 0) {
+                log_msg(LOG_WARNING,
+                    "Omitted console [%s] from listing: name too long",
+                    cl->consoles[k]->name);
+            }
+        }
+        listing = cl;
+
+        DPRINTF((10, "Cached listing of %d consoles (gen=%u).\n",
+            cl->numConsoles, gen));
+    }
+    cl = listing;
+    cl->refCount++;
+
+    x_pthread_mutex_unlock(&listingLock);
+    return(cl);
+}
+
+
+static void put_console_listing(console_listing_t *cl)
+{
+/*  Releases a ref to the console listing (cl) obtained via
+ *    get_console_listing(), destroying it once it is no longer referenced.
+ */
+    assert(cl != NULL);
+
+    x_pthread_mutex_lock(&listingLock);
+    assert(cl->refCount > 0);
+    if (--cl->refCount == 0) {
+        free(cl->consoles);
+        free(cl->names.data);
+        free(cl);
+    }
+    x_pthread_mutex_unlock(&listingLock);
+    return;
+}
+
+
+static int perform_query_cmd(req_t *req, server_conf_t *conf)
 {
 /*  Performs the QUERY command, returning a list of consoles that
  *    matches the console patterns given in the client's request.
+ *  A query of every console is answered from the cached console listing.
+ *  While the consoles are still being opened at startup, the response
+ *    also reports how many remain.
  *  Returns 0 if the command succeeds, or -1 on error.
  *  Since this cmd is processed entirely by this thread,
  *    the client socket connection is closed once it is finished.
  */
+    console_listing_t *cl = NULL;
+    char buf[MAX_LINE];
+    char *msg = NULL;
+    int n;
+    int rc;
+
     assert(req->sd >= 0);
     assert(req->command == CONMAN_CMD_QUERY);
-    assert(!list_is_empty(req->consoles));
+    assert(!list_is_empty(req->consoles) || req->enableQueryAll);
 
     log_msg(LOG_INFO, "Client <%s@%s:%d> issued query",
         req->user, req->fqdn, req->port);
 
-    if (send_rsp(req, CONMAN_ERR_NONE, NULL) < 0) {
+    if (req->enableQueryAll) {
+        cl = get_console_listing(conf);
+        if (cl->numConsoles == 0) {
+            put_console_listing(cl);
+            send_rsp(req, CONMAN_ERR_NO_CONSOLES,
+                "Found no matching consoles");
+            return(-1);
+        }
+    }
+    if ((n = x_atomic_load(&conf->numOpenPending)) > 0) {
+        snprintf(buf, sizeof(buf), "%d of %d console%s still being opened",
+            n, conf->numConsoleObjs, (conf->numConsoleObjs == 1) ? "" : "s");
+        msg = buf;
+    }
+    rc = send_rsp_data(req, CONMAN_ERR_NONE, msg,
+        (cl ? &cl->names : NULL), NULL);
+    if (cl) {
+        put_console_listing(cl);
+    }
+    if (rc < 0) {
         return(-1);
     }
     destroy_req(req);
@@ -847,6 +1495,68 @@ static int perform_monitor_cmd(req_t *req, server_conf_t *conf)
     log_msg(LOG_INFO, "Client <%s@%s:%d> connected to [%s] (read-only)",
         req->user, req->fqdn, req->port, console->name);
 
+    activate_client_obj(client);
+    return(0);
+}
+
+
+static int perform_log_range_cmd(req_t *req)
+{
+/*  Performs the MONITOR command for a range of the console log,
+ *    streaming it from the logfile on disk.  The range is bracketed by
+ *    the checkpoints in its sidecar time index for the times given, and
+ *    then narrowed down to its tail for the number of lines/bytes given.
+ *  Returns 0 if the command succeeds, or -1 on error.
+ *  Since this cmd is processed entirely by this thread,
+ *    the client socket connection is closed once it is finished.
+ */
+    obj_t *console;
+    obj_t *logfile;
+    char *name;
+    off_t start, end, skip = 0;
+    char buf[MAX_SOCK_LINE];
+    char errbuf[MAX_LINE];
+
+    assert(req->sd >= 0);
+    assert(req->command == CONMAN_CMD_MONITOR);
+    assert(list_count(req->consoles) == 1);
+
+    console = list_peek(req->consoles);
+    assert(is_console_obj(console));
+
+    if (!(logfile = get_console_logfile_obj(console))) {
+        snprintf(buf, sizeof(buf), "Console [%s] is not being logged",
+            console->name);
+        send_rsp(req, CONMAN_ERR_BAD_REQUEST, buf);
+        return(-1);
+    }
+    /*  Ensure the replay includes any output still being coalesced.
+     */
+    flush_log_writes(logfile);
+    name = create_string(logfile->name);
+
+    if ((find_log_range(name, req->logSince, req->logUntil, &start, &end,
+            errbuf, sizeof(errbuf)) < 0)
+      || ((req->logLines || req->logBytes)
+        && (find_log_tail(name, req->logLines, req->logBytes, &start, end,
+            &skip, errbuf, sizeof(errbuf)) < 0))) {
+        snprintf(buf, sizeof(buf), "Unable to replay console [%s] log: %s",
+            console->name, errbuf);
+        send_rsp(req, CONMAN_ERR_BAD_REQUEST, buf);
+        free(name);
+        return(-1);
+    }
+    if (send_rsp(req, CONMAN_ERR_NONE, NULL) < 0) {
+        free(name);
+        return(-1);
+    }
+    log_msg(LOG_INFO, "Client <%s@%s:%d> replayed [%s] log (read-only)",
+        req->user, req->fqdn, req->port, console->name);
+
+    (void) write_log_range(name, start, end, skip, req->sd,
+        req->enableCompress);
+    free(name);
+    destroy_req(req);
     return(0);
 }
 
@@ -900,11 +1610,55 @@ static int perform_connect_cmd(req_t *req, server_conf_t *conf)
             "Client <%s@%s:%d> connected to %d consoles (broadcast)",
             req->user, req->fqdn, req->port, list_count(req->consoles));
     }
+    activate_client_obj(client);
+    return(0);
+}
+
+
+static int perform_mux_cmd(req_t *req, server_conf_t *conf)
+{
+/*  Performs the CONNECT or MONITOR command for a multiplexed session,
+ *    subscribing the client to each of the consoles that matched.
+ *    The session is read-write for CONNECT, and read-only for MONITOR.
+ *  Returns 0 if the command succeeds, or -1 on error.
+ */
+    obj_t *client;
+    obj_t *console;
+    ListIterator i;
+
+    assert(req->sd >= 0);
+    assert(req->enableMux);
+    assert((req->command == CONMAN_CMD_CONNECT)
+        || (req->command == CONMAN_CMD_MONITOR));
+
+    /*  Console output is framed with its console id instead.
+     */
+    req->enableBroadcast = 0;
+
+    if (send_rsp(req, CONMAN_ERR_NONE, NULL) < 0) {
+        return(-1);
+    }
+    client = create_client_obj(conf, req);
+
+    i = list_iterator_create(req->consoles);
+    while ((console = list_next(i))) {
+        assert(is_console_obj(console));
+        subscribe_client_console(client, console);
+    }
+    list_iterator_destroy(i);
+
+    log_msg(LOG_INFO,
+        "Client <%s@%s:%d> connected to %d console%s (multiplexed%s)",
+        req->user, req->fqdn, req->port, list_count(req->consoles),
+        (list_count(req->consoles) == 1 ? "" : "s"),
+        (req->command == CONMAN_CMD_MONITOR ? ", read-only" : ""));
+
+    activate_client_obj(client);
     return(0);
 }
 
 
-static void check_console_state(obj_t *console, obj_t *client)
+void check_console_state(obj_t *console, obj_t *client)
 {
 /*  Checks the state of the console and warns the client if needed.
  *  Informs the newly-connected client if strange things are afoot.
@@ -915,13 +1669,27 @@ static void check_console_state(obj_t *console, obj_t *client)
     assert(is_console_obj(console));
     assert(is_client_obj(client));
 
-    if (is_process_obj(console) && (console->fd < 0)) {
+    if (x_atomic_load(&console->isRemoved)) {
+        snprintf(buf, sizeof(buf),
+            "%sConsole [%s] has been removed from the configuration%s",
+            CONMAN_MSG_PREFIX, console->name, CONMAN_MSG_SUFFIX);
+        strcpy(&buf[sizeof(buf) - 3], "\r\n");
+        write_obj_console_data(client, console, buf, strlen(buf), 1);
+    }
+    else if (x_atomic_load(&console->isOpenPending)) {
+        snprintf(buf, sizeof(buf),
+            "%sConsole [%s] is still being opened at startup%s",
+            CONMAN_MSG_PREFIX, console->name, CONMAN_MSG_SUFFIX);
+        strcpy(&buf[sizeof(buf) - 3], "\r\n");
+        write_obj_console_data(client, console, buf, strlen(buf), 1);
+    }
+    else if (is_process_obj(console) && (console->fd < 0)) {
         snprintf(buf, sizeof(buf),
             "%sConsole [%s] is currently disconnected from \"%s\"%s",
             CONMAN_MSG_PREFIX, console->name, console->aux.process.prog,
             CONMAN_MSG_SUFFIX);
         strcpy(&buf[sizeof(buf) - 3], "\r\n");
-        write_obj_data(client, buf, strlen(buf), 1);
+        write_obj_console_data(client, console, buf, strlen(buf), 1);
         open_process_obj(console);
     }
     else if (is_serial_obj(console) && (console->fd < 0)) {
@@ -930,7 +1698,7 @@ static void check_console_state(obj_t *console, obj_t *client)
             CONMAN_MSG_PREFIX, console->name, console->aux.serial.dev,
             CONMAN_MSG_SUFFIX);
         strcpy(&buf[sizeof(buf) - 3], "\r\n");
-        write_obj_data(client, buf, strlen(buf), 1);
+        write_obj_console_data(client, console, buf, strlen(buf), 1);
         open_serial_obj(console);
     }
     else if (is_telnet_obj(console)
@@ -940,7 +1708,7 @@ static void check_console_state(obj_t *console, obj_t *client)
             CONMAN_MSG_PREFIX, console->name, console->aux.telnet.host,
             console->aux.telnet.port, CONMAN_MSG_SUFFIX);
         strcpy(&buf[sizeof(buf) - 3], "\r\n");
-        write_obj_data(client, buf, strlen(buf), 1);
+        write_obj_console_data(client, console, buf, strlen(buf), 1);
         console->aux.telnet.delay = TELNET_MIN_TIMEOUT;
         /*
          *  Do not call connect_telnet_obj() while in the PENDING state since
@@ -958,7 +1726,7 @@ static void check_console_state(obj_t *console, obj_t *client)
             CONMAN_MSG_PREFIX, console->name, console->aux.unixsock.dev,
             CONMAN_MSG_SUFFIX);
         strcpy(&buf[sizeof(buf) - 3], "\r\n");
-        write_obj_data(client, buf, strlen(buf), 1);
+        write_obj_console_data(client, console, buf, strlen(buf), 1);
         open_unixsock_obj(console);
     }
 #if WITH_FREEIPMI
@@ -969,7 +1737,7 @@ static void check_console_state(obj_t *console, obj_t *client)
             CONMAN_MSG_PREFIX, console->name, console->aux.ipmi.host,
             CONMAN_MSG_SUFFIX);
         strcpy(&buf[sizeof(buf) - 3], "\r\n");
-        write_obj_data(client, buf, strlen(buf), 1);
+        write_obj_console_data(client, console, buf, strlen(buf), 1);
         if (console->aux.ipmi.state == CONMAN_IPMI_DOWN) {
             open_ipmi_obj(console);
         }
@@ -57,8 +57,6 @@ static void reset_telnet_delay(obj_t *telnet);
 static int process_telnet_cmd(obj_t *telnet, int cmd, int opt);
 static char * opt2str(int opt, char *buf, int buflen);
 
-extern tpoll_t tp_global;               /* defined in server.c */
-
 
 int is_telnet_dev(const char *dev, char **host_ref, int *port_ref)
 {
@@ -99,7 +97,6 @@ obj_t * create_telnet_obj(server_conf_t *conf, char *name,
  *    by main:open_objs:reopen_obj:open_telnet_obj:connect_telnet_obj().
  *  Returns the new object, or NULL on error.
  */
-    ListIterator i;
     obj_t *telnet;
 
     assert(conf != NULL);
@@ -115,18 +112,11 @@ obj_t * create_telnet_obj(server_conf_t *conf, char *name,
     }
     /*  Check for duplicate console names.
      */
-    i = list_iterator_create(conf->objs);
-    while ((telnet = list_next(i))) {
-        if (is_console_obj(telnet) && !strcmp(telnet->name, name)) {
-            if ((errbuf != NULL) && (errlen > 0)) {
-                snprintf(errbuf, errlen,
-                    "console [%s] specifies duplicate console name", name);
-            }
-            break;
+    if (find_obj_index(conf->consoleIndex, name, CONMAN_OBJ_IS_CONSOLE)) {
+        if ((errbuf != NULL) && (errlen > 0)) {
+            snprintf(errbuf, errlen,
+                "console [%s] specifies duplicate console name", name);
         }
-    }
-    list_iterator_destroy(i);
-    if (telnet != NULL) {
         return(NULL);
     }
     telnet = create_obj(conf, name, -1, CONMAN_OBJ_TELNET);
@@ -135,6 +125,8 @@ obj_t * create_telnet_obj(server_conf_t *conf, char *name,
     telnet->aux.telnet.logfile = NULL;
     telnet->aux.telnet.timer = -1;
     telnet->aux.telnet.delay = TELNET_MIN_TIMEOUT;
+    init_connect_slot(&telnet->aux.telnet.slot, telnet,
+        (callback_f) connect_telnet_obj, telnet->aux.telnet.host);
     telnet->aux.telnet.iac = -1;
     telnet->aux.telnet.state = CONMAN_TELNET_DOWN;
     /*
@@ -143,9 +135,10 @@ obj_t * create_telnet_obj(server_conf_t *conf, char *name,
      */
     telnet->aux.telnet.enableKeepAlive = conf->enableKeepAlive;
 
-    /*  Add obj to the master conf->objs list.
+    /*  Add obj to the master conf->objs list and its indexes.
      */
     list_append(conf->objs, telnet);
+    insert_obj_index(conf->consoleIndex, telnet->name, telnet);
 
     return(telnet);
 }
@@ -185,7 +178,7 @@ static int connect_telnet_obj(obj_t *telnet)
     assert(telnet->aux.telnet.state != CONMAN_TELNET_UP);
 
     if (telnet->aux.telnet.timer >= 0) {
-        (void) tpoll_timeout_cancel(tp_global, telnet->aux.telnet.timer);
+        (void) tpoll_timeout_cancel(telnet->tp, telnet->aux.telnet.timer);
         telnet->aux.telnet.timer = -1;
     }
     if (telnet->aux.telnet.state == CONMAN_TELNET_DOWN) {
@@ -198,11 +191,18 @@ static int connect_telnet_obj(obj_t *telnet)
         if (host_name_to_addr4(telnet->aux.telnet.host, &saddr.sin_addr) < 0) {
             log_msg(LOG_WARNING, "Unable to resolve hostname \"%s\" for [%s]",
                 telnet->aux.telnet.host, telnet->name);
-            telnet->aux.telnet.timer = tpoll_timeout_relative(tp_global,
+            telnet->aux.telnet.timer = tpoll_timeout_relative(telnet->tp,
                 (callback_f) connect_telnet_obj, telnet,
                 RESOLVE_RETRY_TIMEOUT * 1000);
             return(-1);
         }
+        /*  Wait to be admitted by the reconnect scheduler if too many
+         *    connects are already in progress.  The scheduler will invoke
+         *    this routine again once a slot has been passed to this obj.
+         */
+        if (!acquire_connect_slot(&telnet->aux.telnet.slot)) {
+            return(-1);
+        }
         if ((telnet->fd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
             log_err(errno, "Unable to create socket for [%s]", telnet->name);
         }
@@ -226,7 +226,8 @@ static int connect_telnet_obj(obj_t *telnet)
                 (struct sockaddr *) &saddr, sizeof(saddr)) < 0) {
             if (errno == EINPROGRESS) {
                 telnet->aux.telnet.state = CONMAN_TELNET_PENDING;
-                tpoll_set(tp_global, telnet->fd, POLLIN | POLLOUT);
+                tpoll_set_arg(telnet->tp, telnet->fd, POLLIN | POLLOUT,
+                    telnet);
             }
             else {
                 disconnect_telnet_obj(telnet);
@@ -256,7 +257,7 @@ static int connect_telnet_obj(obj_t *telnet)
             disconnect_telnet_obj(telnet);
             return(-1);
         }
-        tpoll_clear(tp_global, telnet->fd, POLLOUT);
+        tpoll_clear(telnet->tp, telnet->fd, POLLOUT);
         DPRINTF((10, "Completing connection to <%s:%d> for [%s].\n",
             telnet->aux.telnet.host, telnet->aux.telnet.port, telnet->name));
     }
@@ -264,9 +265,11 @@ static int connect_telnet_obj(obj_t *telnet)
         log_err(0, "Console [%s] is in unexpected telnet state=%d",
             telnet->aux.telnet.state);
     }
+    release_connect_slot(&telnet->aux.telnet.slot);
     telnet->gotEOF = 0;
     telnet->aux.telnet.state = CONMAN_TELNET_UP;
-    tpoll_set(tp_global, telnet->fd, POLLIN);
+    mark_console_up(telnet);
+    tpoll_set_arg(telnet->tp, telnet->fd, POLLIN, telnet);
 
     /*  Notify linked objs when transitioning into an UP state.
      */
@@ -281,7 +284,7 @@ static int connect_telnet_obj(obj_t *telnet)
      *    disconnect_telnet_obj() will cancel the timer and the
      *    exponential backoff will continue.
      */
-    telnet->aux.telnet.timer = tpoll_timeout_relative(tp_global,
+    telnet->aux.telnet.timer = tpoll_timeout_relative(telnet->tp,
         (callback_f) reset_telnet_delay, telnet, TELNET_MIN_TIMEOUT * 1000);
 
     send_telnet_cmd(telnet, DO, TELOPT_BINARY);
@@ -303,11 +306,11 @@ static void disconnect_telnet_obj(obj_t *telnet)
         telnet->aux.telnet.host, telnet->aux.telnet.port, telnet->name));
 
     if (telnet->aux.telnet.timer >= 0) {
-        (void) tpoll_timeout_cancel(tp_global, telnet->aux.telnet.timer);
+        (void) tpoll_timeout_cancel(telnet->tp, telnet->aux.telnet.timer);
         telnet->aux.telnet.timer = -1;
     }
     if (telnet->fd >= 0) {
-        tpoll_clear(tp_global, telnet->fd, POLLIN | POLLOUT);
+        tpoll_clear(telnet->tp, telnet->fd, POLLIN | POLLOUT);
         if (close(telnet->fd) < 0)
             log_msg(LOG_WARNING,
                 "Unable to close connection to <%s:%d> for [%s]: %s",
@@ -315,7 +318,9 @@ static void disconnect_telnet_obj(obj_t *telnet)
                 telnet->name, strerror(errno));
         telnet->fd = -1;
     }
-    /*  Notify linked objs when transitioning from an UP state.
+    release_connect_slot(&telnet->aux.telnet.slot);
+    /*
+     *  Notify linked objs when transitioning from an UP state.
      */
     if (telnet->aux.telnet.state == CONMAN_TELNET_UP) {
         write_notify_msg(telnet, LOG_INFO,
@@ -323,19 +328,14 @@ static void disconnect_telnet_obj(obj_t *telnet)
             telnet->name, telnet->aux.telnet.host, telnet->aux.telnet.port);
     }
     telnet->aux.telnet.state = CONMAN_TELNET_DOWN;
+    mark_console_down(telnet);
     /*
      *  Set timer for establishing new connection using exponential backoff.
      */
-    telnet->aux.telnet.timer = tpoll_timeout_relative(tp_global,
+    telnet->aux.telnet.timer = tpoll_timeout_relative(telnet->tp,
         (callback_f) connect_telnet_obj, telnet,
-        telnet->aux.telnet.delay * 1000);
-    if (telnet->aux.telnet.delay == 0) {
-        telnet->aux.telnet.delay = TELNET_MIN_TIMEOUT;
-    }
-    else if (telnet->aux.telnet.delay < TELNET_MAX_TIMEOUT) {
-        telnet->aux.telnet.delay =
-            MIN(telnet->aux.telnet.delay * 2, TELNET_MAX_TIMEOUT);
-    }
+        get_reconnect_msecs(&telnet->aux.telnet.delay,
+            TELNET_MIN_TIMEOUT, TELNET_MAX_TIMEOUT));
     return;
 }
 
@@ -368,7 +368,8 @@ int process_telnet_escapes(obj_t *telnet, void *src, int len)
  *  Returns the new length of the modified buffer.
  */
     const unsigned char *last = (unsigned char *) src + len;
-    unsigned char *p, *q;
+    unsigned char *p, *q, *r;
+    int n;
 
     assert(is_telnet_obj(telnet));
     assert(telnet->fd >= 0);
@@ -378,13 +379,38 @@ int process_telnet_escapes(obj_t *telnet, void *src, int len)
         return(0);
 
     for (p=q=src; p<last; p++) {
+        /*
+         *  Outside of an IAC sequence, scan ahead for the next IAC and move
+         *    the run of data preceding it down over any bytes removed thus
+         *    far.  Since IAC is rare in console output, the whole buffer is
+         *    usually scanned once and left in place.
+         */
+        if (telnet->aux.telnet.iac == -1) {
+            r = memchr(p, IAC, last - p);
+            n = (r ? r : last) - p;
+            if (q != p)
+                memmove(q, p, n);
+            q += n;
+            p += n;
+            if (!r)
+                break;
+            telnet->aux.telnet.iac = IAC;
+            continue;
+        }
+        /*  Ignore subnegotiation opts.  Consume bytes until IAC SE.
+         *    Remain in the SB state until an IAC is found; then reset
+         *    the state to IAC assuming the next byte will be the SE cmd.
+         */
+        if (telnet->aux.telnet.iac == SB) {
+            if (!(r = memchr(p, IAC, last - p))) {
+                p = (unsigned char *) last;
+                break;
+            }
+            p = r;
+            telnet->aux.telnet.iac = IAC;
+            continue;
+        }
         switch(telnet->aux.telnet.iac) {
-        case -1:
-            if (*p == IAC)
-                telnet->aux.telnet.iac = *p;
-            else
-                *q++ = *p;
-            break;
         case IAC:
             switch (*p) {
             case IAC:
@@ -421,15 +447,6 @@ int process_telnet_escapes(obj_t *telnet, void *src, int len)
             process_telnet_cmd(telnet, telnet->aux.telnet.iac, *p);
             telnet->aux.telnet.iac = -1;
             break;
-        case SB:
-            /*
-             *  Ignore subnegotiation opts.  Consume bytes until IAC SE.
-             *    Remain in the SB state until an IAC is found; then reset
-             *    the state to IAC assuming the next byte will be the SE cmd.
-             */
-            if (*p == IAC)
-                telnet->aux.telnet.iac = *p;
-            break;
         default:
             log_err(0, "Reached invalid state %#.2x%.2x for console [%s]",
                 telnet->aux.telnet.iac, *p, telnet->name);
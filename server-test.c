@@ -31,8 +31,13 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <netinet/in.h>                 /* include before telnet.h for bsd */
+#include <arpa/telnet.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
+#include <time.h>
 #include <unistd.h>
 #include "list.h"
 #include "log.h"
@@ -41,18 +46,109 @@
 #include "util-file.h"
 #include "util-str.h"
 #include "util.h"
-
-extern tpoll_t tp_global;               /* defined in server.c */
+#include "wrapper.h"
 
 
 #define TEST_CONSOLE_DEFAULT_BYTES              1024
 #define TEST_CONSOLE_DEFAULT_DELAY_MSECS        100
 #define TEST_CONSOLE_FIRST_CHAR                 0x20
 #define TEST_CONSOLE_LAST_CHAR                  0x7E
+#define TEST_CONSOLE_LINE_LEN                   78
+#define TEST_CORPUS_LINE_MAX                    256
+#define TEST_BIOS_ROWS                          25
+#define TEST_BIOS_COLS                          80
+#define TEST_BENCH_TICK_MSECS                   10
+#define TEST_BENCH_MAX_CHUNKS                   64
+#define TEST_BENCH_REPORT_SECS                  10
+
+
+/*  A test console with a rate ("R:<bytes/sec>") is a benchmark console:
+ *    instead of random bursts, it generates its payload at a steady rate
+ *    through the normal reader fan-out.  Every TEST_BENCH_REPORT_SECS, the
+ *    test bench logs the aggregate throughput achieved by the benchmark
+ *    consoles (vs. the sum of their target rates), the number of bytes
+ *    overwritten in the buffers of any obj (ie, dropped by slow readers),
+ *    and the latency from when data is generated to when it has been
+ *    written to a client socket.
+ *  Latency is sampled from the shared chunks of benchmark data, each of
+ *    which is stamped with its generation time.  A sample is taken when
+ *    the last byte of a chunk ref in a client's output queue is written.
+ *  Totals since the test bench was started are also kept for export via
+ *    the metrics listener, so results can be collected & tracked over time.
+ *  The test bench state is protected by benchLock since benchmark consoles
+ *    (along with their clients) are spread across the i/o threads.
+ */
+static pthread_mutex_t benchLock = PTHREAD_MUTEX_INITIALIZER;
+static int benchActive = 0;
+static int benchTimer = -1;
+static int benchNumConsoles = 0;
+static unsigned long long benchRate = 0;
+static unsigned long long benchNumBytes = 0;
+static unsigned long long benchNumOver = 0;
+static unsigned long benchNumSamples = 0;
+static double benchLatencySum = 0.0;
+static long benchLatencyMax = 0;
+static struct timeval benchTime;
+static test_bench_stats_t benchTotals;
+
+/*  The corpus formats approximate the console output of real machines, so
+ *    the benchmarks exercise the data path with realistic input:
+ *    - boot:  a timestamped kernel & systemd boot log
+ *    - bios:  BIOS setup screens painted with ANSI escape sequences and
+ *             CP437 box-drawing chars, redrawn as the selection moves
+ *    - iac:   text interspersed with telnet IAC sequences (eg, option
+ *             negotiation, subnegotiation, and escaped 0xFF data bytes)
+ *  Each line is regenerated from its line number, so the corpus is the same
+ *    for every console and on every run.
+ */
+static const char *testBootMsgs[] = {
+    "Linux version 5.14.0-362.8.1.el9_3.x86_64 (gcc 11.4.1) #1 SMP",
+    "Command line: ro root=/dev/md0 console=tty0 console=ttyS0,115200n8",
+    "BIOS-e820: [mem 0x0000000000100000-0x000000007ffdbfff] usable",
+    "ACPI: RSDP 0x00000000000F5A10 000014 (v00 BOCHS )",
+    "smpboot: CPU0: Intel(R) Xeon(R) Gold 6248 CPU @ 2.50GHz",
+    "pci 0000:00:1f.2: [8086:2922] type 00 class 0x010601",
+    "ata1: SATA link up 6.0 Gbps (SStatus 133 SControl 300)",
+    "EXT4-fs (md0): mounted filesystem with ordered data mode",
+    "mlx5_core 0000:3b:00.0: firmware version: 16.35.2000",
+    "random: crng init done",
+    "systemd[1]: Started Journal Service.",
+    "systemd[1]: Reached target Local File Systems.",
+    "audit: type=1130 audit(1696502400.123:52): pid=1 uid=0 res=success",
+    NULL
+};
+
+static const char *testBiosItems[] = {
+    "System Date",                  "[Tue 10/14/2026]",
+    "System Time",                  "[12:34:56]",
+    "BIOS Version",                 "2.19.1",
+    "Processor Type",               "Intel(R) Xeon(R) Gold 6248",
+    "Total Memory",                 "196608 MB",
+    "Boot Mode",                    "[UEFI]",
+    "Secure Boot",                  "[Disabled]",
+    "Console Redirection",          "[Enabled]",
+    "Redirection Baud Rate",        "[115200]",
+    "Hyper-Threading",              "[Enabled]",
+    "Virtualization Technology",    "[Enabled]",
+    "Network Stack",                "[Enabled]",
+    "Boot Option #1",               "[PXE IPv4 Mellanox]",
+    "Boot Option #2",               "[RAID Volume 0]",
+    NULL,                           NULL
+};
 
 
 static int process_test_opt(
     test_opt_t *opts, const char *str, char *errbuf, int errlen);
+static void read_test_bench(obj_t *test);
+static void fill_test_corpus(obj_t *test, unsigned char *dst, int len);
+static int format_test_line(obj_t *test, unsigned char *dst, int len);
+static int format_test_bios_row(unsigned long n, unsigned char *dst, int len);
+static int format_test_iac_line(unsigned long n, unsigned char *dst, int len);
+static unsigned int hash_test_line(unsigned long n);
+static void start_test_bench(obj_t *test);
+static void report_test_bench(tpoll_t tp);
+static long diff_test_usecs(const struct timeval *t1,
+    const struct timeval *t0);
 
 
 int is_test_dev(const char *dev)
@@ -75,6 +171,8 @@ int init_test_opts(test_opt_t *opts)
     opts->msecMax = -1;
     opts->msecMin = -1;
     opts->probability = 100;
+    opts->rate = 0;
+    opts->format = CONMAN_TEST_TEXT;
     return(0);
 }
 
@@ -131,6 +229,8 @@ static int process_test_opt(
 /*  Parses string 'str' for a single test console device option.
  *    The string 'str' is of the form "X:VALUE", where "X" is a single-char key
  *    tag specifying the option type and "VALUE" is its corresponding value.
+ *    The "F" (format) value is one of "text", "line", "binary", "boot",
+ *    "bios", or "iac"; all others are integers.
  *  Returns 0 and updates the 'opts' struct on success; o/w, returns -1
  *    (writing an error message into buffer 'errbuf' of length 'errlen').
  */
@@ -142,7 +242,7 @@ static int process_test_opt(
     assert(opts != NULL);
     assert(str != NULL);
 
-    if ((strspn(str, "BbMmNnPp") != 1) || (str[1] != ':')) {
+    if ((strspn(str, "BbFfMmNnPpRr") != 1) || (str[1] != ':')) {
         if ((errbuf != NULL) && (errlen > 0)) {
             snprintf(errbuf, errlen, "invalid testopts value \"%s\"", str);
         }
@@ -150,6 +250,36 @@ static int process_test_opt(
     }
     c = toupper((int) str[0]);
     p = str + 2;
+
+    if (c == 'F') {
+        if (!strcasecmp(p, "text")) {
+            opts->format = CONMAN_TEST_TEXT;
+        }
+        else if (!strcasecmp(p, "line")) {
+            opts->format = CONMAN_TEST_LINE;
+        }
+        else if (!strcasecmp(p, "binary")) {
+            opts->format = CONMAN_TEST_BINARY;
+        }
+        else if (!strcasecmp(p, "boot")) {
+            opts->format = CONMAN_TEST_BOOT;
+        }
+        else if (!strcasecmp(p, "bios")) {
+            opts->format = CONMAN_TEST_BIOS;
+        }
+        else if (!strcasecmp(p, "iac")) {
+            opts->format = CONMAN_TEST_IAC;
+        }
+        else {
+            if ((errbuf != NULL) && (errlen > 0)) {
+                snprintf(errbuf, errlen,
+                    "invalid testopts value \"%s\"", str);
+            }
+            return(-1);
+        }
+        return(0);
+    }
+    errno = 0;
     l = strtol(p, &endp, 0);
     if ((*endp != '\0') || (errno == ERANGE) || (l < 0) || (l > INT_MAX)) {
         if ((errbuf != NULL) && (errlen > 0)) {
@@ -170,6 +300,9 @@ static int process_test_opt(
         case 'P':
             opts->probability = MIN(l,100);
             break;
+        case 'R':
+            opts->rate = l;
+            break;
         default:
             /*  This case should never happen since the tag has already been
              *    validated above via strspn().
@@ -187,7 +320,6 @@ obj_t * create_test_obj(server_conf_t *conf, char *name,
 /*  Creates a new test console device and adds it to the master objs list.
  *  Returns the new object, or NULL on error.
  */
-    ListIterator i;
     obj_t *test;
 
     assert(conf != NULL);
@@ -196,18 +328,11 @@ obj_t * create_test_obj(server_conf_t *conf, char *name,
 
     /*  Check for duplicate console names.
      */
-    i = list_iterator_create(conf->objs);
-    while ((test = list_next(i))) {
-        if (is_console_obj(test) && !strcmp(test->name, name)) {
-            if ((errbuf != NULL) && (errlen > 0)) {
-                snprintf(errbuf, errlen,
-                    "console [%s] specifies duplicate console name", name);
-            }
-            break;
+    if (find_obj_index(conf->consoleIndex, name, CONMAN_OBJ_IS_CONSOLE)) {
+        if ((errbuf != NULL) && (errlen > 0)) {
+            snprintf(errbuf, errlen,
+                "console [%s] specifies duplicate console name", name);
         }
-    }
-    list_iterator_destroy(i);
-    if (test != NULL) {
         return(NULL);
     }
     test = create_obj(conf, name, -1, CONMAN_OBJ_TEST);
@@ -215,11 +340,18 @@ obj_t * create_test_obj(server_conf_t *conf, char *name,
     test->aux.test.logfile = NULL;
     test->aux.test.timer = -1;
     test->aux.test.numLeft = 0;
+    test->aux.test.credit = 0.0;
+    test->aux.test.lineCol = 0;
+    test->aux.test.numLines = 0;
+    test->aux.test.seed = (unsigned int) rand() | 1;
+    timerclear(&test->aux.test.tLast);
     test->aux.test.lastChar = TEST_CONSOLE_FIRST_CHAR;
+    test->aux.test.isBench = 0;
     /*
-     *  Add obj to the master conf->objs list.
+     *  Add obj to the master conf->objs list and its indexes.
      */
     list_append(conf->objs, test);
+    insert_obj_index(conf->consoleIndex, test->name, test);
 
     return(test);
 }
@@ -241,11 +373,11 @@ int open_test_obj(obj_t *test)
     opts = &test->aux.test.opts;
 
     if (auxp->timer >= 0) {
-        (void) tpoll_timeout_cancel(tp_global, auxp->timer);
+        (void) tpoll_timeout_cancel(test->tp, auxp->timer);
         auxp->timer = -1;
     }
     if (test->fd >= 0) {
-        tpoll_clear(tp_global, test->fd, POLLOUT);
+        tpoll_clear(test->tp, test->fd, POLLOUT);
         if (close(test->fd) < 0) {
             log_msg(LOG_WARNING,
                 "Unable to close test [%s]: %s", test->name, strerror(errno));
@@ -261,15 +393,18 @@ int open_test_obj(obj_t *test)
     set_fd_nonblocking(test->fd);
     set_fd_closed_on_exec(test->fd);
 
+    if (opts->rate > 0) {
+        start_test_bench(test);
+    }
     /*  Schedule immediate timer to perform initial read once in mux_io().
      */
-    auxp->timer = tpoll_timeout_relative(tp_global,
+    auxp->timer = tpoll_timeout_relative(test->tp,
         (callback_f) read_test_obj, test, 0);
+    mark_console_up(test);
 
-    (void) opts;                /* suppress unused-but-set-variable warning */
-    DPRINTF((9, "Opened [%s] test: bytes=%d max=%d min=%d prob=%d.\n",
-        test->name, opts->numBytes, opts->msecMax, opts->msecMin,
-        opts->probability));
+    DPRINTF((9, "Opened [%s] test: bytes=%d max=%d min=%d prob=%d"
+        " rate=%d fmt=%d.\n", test->name, opts->numBytes, opts->msecMax,
+        opts->msecMin, opts->probability, opts->rate, opts->format));
     return(0);
 }
 
@@ -278,18 +413,15 @@ int read_test_obj(obj_t *test)
 {
 /*  Simulates a read from the 'test' console device, and writes it out to the
  *    circular-buffer of each 'reader' obj.  If the current read does not fit
- *    within the local buffer, a timer with a delay of 0 will be scheduled to
+ *    within the shared chunk, a timer with a delay of 0 will be scheduled to
  *    continue reading from where it left off; otherwise, a timer will be
  *    scheduled to start reading a new burst within the specified min & max.
  *  Returns the number of bytes read.
  */
     test_obj_t *auxp;
     test_opt_t *opts;
-    unsigned char buf[(OBJ_BUF_SIZE / 2) - 1];
+    obj_chunk_t *chunk;
     int n = 0;
-    int m;
-    ListIterator i;
-    obj_t *reader;
     int delay;
     int interval;
 
@@ -300,9 +432,13 @@ int read_test_obj(obj_t *test)
     opts = &test->aux.test.opts;
 
     if (auxp->timer >= 0) {
-        (void) tpoll_timeout_cancel(tp_global, auxp->timer);
+        (void) tpoll_timeout_cancel(test->tp, auxp->timer);
         auxp->timer = -1;
     }
+    if (opts->rate > 0) {
+        read_test_bench(test);
+        return(0);
+    }
     /*  Pseudorandomly perform a read at the start of a new burst.
      *  Not truly uniform, but close enough here for integers in [0,100].
      */
@@ -311,27 +447,15 @@ int read_test_obj(obj_t *test)
         if (auxp->numLeft == 0) {
             auxp->numLeft = opts->numBytes;
         }
-        n = MIN(auxp->numLeft, (int) sizeof(buf));
+        n = MIN(auxp->numLeft, OBJ_CHUNK_SIZE - 1);
 
-        for (m = 0; m < n; m++) {
-            buf[m] = ++auxp->lastChar;
-            if (auxp->lastChar == TEST_CONSOLE_LAST_CHAR) {
-                auxp->lastChar = TEST_CONSOLE_FIRST_CHAR;
-            }
-        }
+        chunk = get_obj_chunk();
+        fill_test_data(test, chunk->data, n);
         auxp->numLeft -= n;
 
-        i = list_iterator_create(test->readers);
-        while ((reader = list_next(i))) {
-
-            if (is_logfile_obj(reader)) {
-                write_log_data(reader, buf, n);
-            }
-            else {
-                write_obj_data(reader, buf, n, 0);
-            }
-        }
-        list_iterator_destroy(i);
+        scan_triggers(test, chunk->data, n);
+        write_obj_readers(test, chunk, n);
+        put_obj_chunk(chunk);
     }
     /*  Schedule the next timer.
      */
@@ -348,8 +472,541 @@ int read_test_obj(obj_t *test)
         interval = opts->msecMax - opts->msecMin + 1;
         delay = opts->msecMin + (rand() % interval);
     }
-    auxp->timer = tpoll_timeout_relative(tp_global,
+    auxp->timer = tpoll_timeout_relative(test->tp,
         (callback_f) read_test_obj, test, delay);
 
     return(n);
 }
+
+
+static void read_test_bench(obj_t *test)
+{
+/*  Simulates reads from the benchmark 'test' console device at its rate.
+ *    The bytes due since the last read are written out in chunks stamped
+ *    with the current time, and the next read is scheduled after
+ *    TEST_BENCH_TICK_MSECS.  At most TEST_BENCH_MAX_CHUNKS are written per
+ *    read; bytes due beyond that are dropped so a console that cannot keep
+ *    up shows as a shortfall in throughput instead of an ever-growing debt.
+ *
+ *  XXX: This routine must only be called by the test obj's i/o thread.
+ */
+    test_obj_t *auxp;
+    obj_chunk_t *chunk;
+    struct timeval tNow;
+    double max;
+    int total = 0;
+    int n;
+
+    auxp = &test->aux.test;
+
+    if (gettimeofday(&tNow, NULL) < 0) {
+        log_err(errno, "gettimeofday() failed");
+    }
+    if (timerisset(&auxp->tLast)) {
+        auxp->credit += (double) auxp->opts.rate
+            * MAX(diff_test_usecs(&tNow, &auxp->tLast), 0) / 1e6;
+    }
+    auxp->tLast = tNow;
+    max = (double) TEST_BENCH_MAX_CHUNKS * (OBJ_CHUNK_SIZE - 1);
+
+    while (auxp->credit >= 1.0) {
+        if (total + OBJ_CHUNK_SIZE - 1 > max) {
+            auxp->credit = 0.0;
+            break;
+        }
+        n = (int) MIN(auxp->credit, OBJ_CHUNK_SIZE - 1);
+        chunk = get_obj_chunk();
+        chunk->tGen = tNow;
+        fill_test_data(test, chunk->data, n);
+        scan_triggers(test, chunk->data, n);
+        write_obj_readers(test, chunk, n);
+        put_obj_chunk(chunk);
+        auxp->credit -= n;
+        total += n;
+    }
+    if (total > 0) {
+        x_pthread_mutex_lock(&benchLock);
+        benchNumBytes += total;
+        benchTotals.numBytes += total;
+        x_pthread_mutex_unlock(&benchLock);
+    }
+    auxp->timer = tpoll_timeout_relative(test->tp,
+        (callback_f) read_test_obj, test, TEST_BENCH_TICK_MSECS);
+    return;
+}
+
+
+void fill_test_data(obj_t *test, unsigned char *dst, int len)
+{
+/*  Fills the buffer 'dst' with 'len' bytes of the 'test' obj's payload.
+ *    The text format cycles through the printable chars.  The line format
+ *    does the same, but terminates each line with a CR/LF.  The binary
+ *    format consists of pseudorandom bytes in which all values occur
+ *    (eg, CR, LF, IAC, ESC, and high-bit chars), exercising the telnet,
+ *    escape, and sanitize paths of whatever reads it.  The corpus formats
+ *    are handled by fill_test_corpus().
+ *  This is also used by the microbenchmarks to generate their input.
+ */
+    test_obj_t *auxp;
+    unsigned int x;
+    int m;
+
+    auxp = &test->aux.test;
+
+    switch (auxp->opts.format) {
+    case CONMAN_TEST_BOOT:
+    case CONMAN_TEST_BIOS:
+    case CONMAN_TEST_IAC:
+        fill_test_corpus(test, dst, len);
+        break;
+    case CONMAN_TEST_BINARY:
+        x = auxp->seed;
+        for (m = 0; m < len; m++) {
+            x ^= x << 13;               /* xorshift32 */
+            x ^= x >> 17;
+            x ^= x << 5;
+            dst[m] = (unsigned char) (x >> 24);
+        }
+        auxp->seed = x;
+        break;
+    case CONMAN_TEST_LINE:
+        for (m = 0; m < len; m++) {
+            if (auxp->lineCol == TEST_CONSOLE_LINE_LEN) {
+                dst[m] = '\r';
+                auxp->lineCol++;
+                continue;
+            }
+            if (auxp->lineCol > TEST_CONSOLE_LINE_LEN) {
+                dst[m] = '\n';
+                auxp->lineCol = 0;
+                continue;
+            }
+            auxp->lineCol++;
+            dst[m] = ++auxp->lastChar;
+            if (auxp->lastChar == TEST_CONSOLE_LAST_CHAR) {
+                auxp->lastChar = TEST_CONSOLE_FIRST_CHAR;
+            }
+        }
+        break;
+    default:
+        for (m = 0; m < len; m++) {
+            dst[m] = ++auxp->lastChar;
+            if (auxp->lastChar == TEST_CONSOLE_LAST_CHAR) {
+                auxp->lastChar = TEST_CONSOLE_FIRST_CHAR;
+            }
+        }
+        break;
+    }
+    return;
+}
+
+
+static void fill_test_corpus(obj_t *test, unsigned char *dst, int len)
+{
+/*  Fills the buffer 'dst' with 'len' bytes of the 'test' obj's corpus.
+ *    The current line is regenerated each time, and its output resumes
+ *    from the column where the previous buffer left off.
+ */
+    test_obj_t *auxp;
+    unsigned char line[TEST_CORPUS_LINE_MAX];
+    int n, m;
+
+    auxp = &test->aux.test;
+
+    while (len > 0) {
+        n = format_test_line(test, line, sizeof(line));
+        m = MIN(len, n - auxp->lineCol);
+        memcpy(dst, &line[auxp->lineCol], m);
+        dst += m;
+        len -= m;
+        auxp->lineCol += m;
+        if (auxp->lineCol >= n) {
+            auxp->lineCol = 0;
+            auxp->numLines++;
+        }
+    }
+    return;
+}
+
+
+static int format_test_line(obj_t *test, unsigned char *dst, int len)
+{
+/*  Formats the current line of the 'test' obj's corpus into the buffer 'dst'
+ *    of length 'len'.
+ *  Returns the number of bytes in the line (which is not NUL-terminated).
+ */
+    unsigned long n;
+    unsigned long usecs;
+    int count;
+    int m;
+
+    n = test->aux.test.numLines;
+
+    switch (test->aux.test.opts.format) {
+    case CONMAN_TEST_BIOS:
+        return(format_test_bios_row(n, dst, len));
+    case CONMAN_TEST_IAC:
+        return(format_test_iac_line(n, dst, len));
+    default:
+        break;
+    }
+    for (count = 0; testBootMsgs[count]; count++) {
+        ;
+    }
+    usecs = (n * 2039) + (hash_test_line(n) % 1000);
+    m = snprintf((char *) dst, len, "[%5lu.%06lu] %s\r\n",
+        usecs / 1000000, usecs % 1000000,
+        testBootMsgs[hash_test_line(n) % count]);
+    return(MIN(m, len - 1));
+}
+
+
+static int format_test_bios_row(unsigned long n, unsigned char *dst, int len)
+{
+/*  Formats row 'n' (modulo the screen size) of a BIOS setup screen into the
+ *    buffer 'dst' of length 'len'.  Each row is positioned by a cursor
+ *    escape and drawn in CP437; the selected item (and thus the screen)
+ *    changes with each redraw.
+ *  Returns the number of bytes in the row.
+ */
+    int row;
+    int numItems;
+    int item;
+    int isSelected;
+    int m = 0;
+    int k;
+
+    assert(len >= TEST_CORPUS_LINE_MAX);
+
+    for (numItems = 0; testBiosItems[2 * numItems]; numItems++) {
+        ;
+    }
+    row = n % TEST_BIOS_ROWS;
+    if (row == 0) {
+        m += snprintf((char *) dst + m, len - m, "\033[0m\033[2J");
+    }
+    m += snprintf((char *) dst + m, len - m, "\033[%d;1H\033[0;37;44m",
+        row + 1);
+
+    if (row == 0) {
+        m += snprintf((char *) dst + m, len - m, "%-*s", TEST_BIOS_COLS,
+            "          Aptio Setup Utility - Copyright (C) 2021"
+            " American Megatrends");
+    }
+    else if ((row == 1) || (row == TEST_BIOS_ROWS - 2)) {
+        dst[m++] = (row == 1) ? 0xC9 : 0xC8;
+        for (k = 2; k < TEST_BIOS_COLS; k++) {
+            dst[m++] = 0xCD;
+        }
+        dst[m++] = (row == 1) ? 0xBB : 0xBC;
+    }
+    else if (row == TEST_BIOS_ROWS - 1) {
+        m += snprintf((char *) dst + m, len - m, "\033[1;33;44m%-*s",
+            TEST_BIOS_COLS, " \x18\x19: Select Item   Enter: Select"
+            "   F9: Defaults   F10: Save & Exit   ESC: Exit");
+    }
+    else {
+        item = row - 2;
+        isSelected = (item == (int) ((n / TEST_BIOS_ROWS) % numItems));
+        dst[m++] = 0xBA;
+        if (item < numItems) {
+            m += snprintf((char *) dst + m, len - m, "%s  %-30s%s%-46s",
+                (isSelected ? "\033[0;30;47m" : "\033[1;37;44m"),
+                testBiosItems[2 * item],
+                (isSelected ? "" : "\033[0;36;44m"),
+                testBiosItems[(2 * item) + 1]);
+            m += snprintf((char *) dst + m, len - m, "\033[0;37;44m");
+        }
+        else {
+            m += snprintf((char *) dst + m, len - m, "%-*s",
+                TEST_BIOS_COLS - 2, "");
+        }
+        dst[m++] = 0xBA;
+    }
+    m += snprintf((char *) dst + m, len - m, "\033[0m");
+    return(MIN(m, len - 1));
+}
+
+
+static int format_test_iac_line(unsigned long n, unsigned char *dst, int len)
+{
+/*  Formats line 'n' of the telnet stream into the buffer 'dst' of length
+ *    'len'.  Each line contains text along with telnet cmds, negotiations,
+ *    and escaped IAC data bytes, and is terminated by a CR/LF.
+ *  Returns the number of bytes in the line.
+ */
+    static const unsigned char nego[] = { WILL, WONT, DO, DONT };
+    static const unsigned char opts[] = {
+        TELOPT_ECHO, TELOPT_SGA, TELOPT_TTYPE, TELOPT_NAWS, TELOPT_LINEMODE
+    };
+    unsigned int x;
+    int m = 0;
+    int k;
+
+    assert(len >= TEST_CORPUS_LINE_MAX);
+
+    x = hash_test_line(n);
+    m += snprintf((char *) dst + m, len - m, "node%04lu login: ", n % 10000);
+    for (k = 0; k < 4; k++) {
+        switch ((x >> (k * 4)) & 0x7) {
+        case 0:
+            dst[m++] = IAC;
+            dst[m++] = nego[(x >> 16) & 0x3];
+            dst[m++] = opts[((x >> 18) & 0x7) % sizeof(opts)];
+            break;
+        case 1:
+            dst[m++] = IAC;
+            dst[m++] = SB;
+            dst[m++] = TELOPT_NAWS;
+            dst[m++] = 0;
+            dst[m++] = 80;
+            dst[m++] = 0;
+            dst[m++] = 24;
+            dst[m++] = IAC;
+            dst[m++] = SE;
+            break;
+        case 2:
+            dst[m++] = IAC;                 /* escaped 0xFF data byte */
+            dst[m++] = IAC;
+            break;
+        case 3:
+            dst[m++] = IAC;
+            dst[m++] = NOP;
+            break;
+        case 4:
+            dst[m++] = '\r';
+            dst[m++] = '\0';
+            break;
+        default:
+            m += snprintf((char *) dst + m, len - m, "%08x ", x);
+            break;
+        }
+    }
+    dst[m++] = '\r';
+    dst[m++] = '\n';
+    return(m);
+}
+
+
+static unsigned int hash_test_line(unsigned long n)
+{
+/*  Returns a hash of the line number 'n' for choosing corpus contents.
+ */
+    unsigned int x = (unsigned int) n;
+
+    x ^= x >> 16;                       /* murmur3 finalizer */
+    x *= 0x85EBCA6BU;
+    x ^= x >> 13;
+    x *= 0xC2B2AE35U;
+    x ^= x >> 16;
+    return(x);
+}
+
+
+void close_test_obj(obj_t *test)
+{
+/*  Closes the 'test' obj by cancelling its timer, removing it from the
+ *    test bench if it is a benchmark console.
+ *
+ *  XXX: This routine must only be called by the test obj's i/o thread.
+ */
+    test_obj_t *auxp;
+
+    assert(test != NULL);
+    assert(is_test_obj(test));
+
+    auxp = &test->aux.test;
+
+    if (auxp->timer >= 0) {
+        (void) tpoll_timeout_cancel(test->tp, auxp->timer);
+        auxp->timer = -1;
+    }
+    if (auxp->isBench) {
+        x_pthread_mutex_lock(&benchLock);
+        benchNumConsoles--;
+        benchRate -= auxp->opts.rate;
+        if (benchNumConsoles == 0) {
+            x_atomic_store(&benchActive, 0);
+        }
+        x_pthread_mutex_unlock(&benchLock);
+        auxp->isBench = 0;
+    }
+    return;
+}
+
+
+int is_test_bench_active(void)
+{
+/*  Returns true if any benchmark test consoles are open.
+ */
+    return(x_atomic_load(&benchActive));
+}
+
+
+void add_test_bench_latency(const struct timeval *tGen)
+{
+/*  Adds a latency sample for benchmark data generated at time 'tGen'
+ *    that has just been written to a client.
+ */
+    struct timeval tNow;
+    long usecs;
+
+    assert(tGen != NULL);
+
+    if (gettimeofday(&tNow, NULL) < 0) {
+        log_err(errno, "gettimeofday() failed");
+    }
+    usecs = MAX(diff_test_usecs(&tNow, tGen), 0);
+
+    x_pthread_mutex_lock(&benchLock);
+    benchNumSamples++;
+    benchLatencySum += usecs;
+    benchLatencyMax = MAX(benchLatencyMax, usecs);
+    benchTotals.numSamples++;
+    benchTotals.usecsLatency += usecs;
+    x_pthread_mutex_unlock(&benchLock);
+    return;
+}
+
+
+void add_test_bench_overwrite(int n)
+{
+/*  Adds 'n' bytes overwritten in an obj's buffer to the test bench stats
+ *    if any benchmark test consoles are open.
+ */
+    if ((n <= 0) || !x_atomic_load(&benchActive)) {
+        return;
+    }
+    x_pthread_mutex_lock(&benchLock);
+    benchNumOver += n;
+    benchTotals.numOver += n;
+    x_pthread_mutex_unlock(&benchLock);
+    return;
+}
+
+
+int get_test_bench_stats(test_bench_stats_t *stats)
+{
+/*  Copies the test bench totals into 'stats'.
+ *  Returns 0 on success, or -1 if no benchmark test consoles are open.
+ */
+    assert(stats != NULL);
+
+    x_pthread_mutex_lock(&benchLock);
+    *stats = benchTotals;
+    stats->numConsoles = benchNumConsoles;
+    stats->rate = benchRate;
+    x_pthread_mutex_unlock(&benchLock);
+
+    return((stats->numConsoles > 0) ? 0 : -1);
+}
+
+
+static void start_test_bench(obj_t *test)
+{
+/*  Adds the benchmark 'test' console to the test bench, starting the
+ *    test bench reports (from the test obj's i/o thread) if needed.
+ *
+ *  XXX: This routine must only be called by the test obj's i/o thread.
+ */
+    test_obj_t *auxp;
+
+    auxp = &test->aux.test;
+    timerclear(&auxp->tLast);
+    auxp->credit = 0.0;
+
+    if (auxp->isBench) {
+        return;
+    }
+    auxp->isBench = 1;
+
+    x_pthread_mutex_lock(&benchLock);
+    if (benchNumConsoles++ == 0) {
+        benchNumBytes = benchNumOver = 0;
+        benchNumSamples = 0;
+        benchLatencySum = 0.0;
+        benchLatencyMax = 0;
+        memset(&benchTotals, 0, sizeof(benchTotals));
+        if (gettimeofday(&benchTime, NULL) < 0) {
+            log_err(errno, "gettimeofday() failed");
+        }
+        x_atomic_store(&benchActive, 1);
+    }
+    benchRate += auxp->opts.rate;
+    if (benchTimer < 0) {
+        benchTimer = tpoll_timeout_relative(test->tp,
+            (callback_f) report_test_bench, test->tp,
+            TEST_BENCH_REPORT_SECS * 1000);
+    }
+    x_pthread_mutex_unlock(&benchLock);
+    return;
+}
+
+
+static void report_test_bench(tpoll_t tp)
+{
+/*  Logs the test bench stats for the interval since the last report,
+ *    and then resets them.  The next report is scheduled on the tpoll 'tp'
+ *    unless there are no remaining benchmark test consoles.
+ */
+    struct timeval tNow;
+    double secs;
+    int numConsoles;
+    unsigned long long rate;
+    unsigned long long numBytes;
+    unsigned long long numOver;
+    unsigned long numSamples;
+    double latencySum;
+    long latencyMax;
+
+    if (gettimeofday(&tNow, NULL) < 0) {
+        log_err(errno, "gettimeofday() failed");
+    }
+    x_pthread_mutex_lock(&benchLock);
+    secs = diff_test_usecs(&tNow, &benchTime) / 1e6;
+    numConsoles = benchNumConsoles;
+    rate = benchRate;
+    numBytes = benchNumBytes;
+    numOver = benchNumOver;
+    numSamples = benchNumSamples;
+    latencySum = benchLatencySum;
+    latencyMax = benchLatencyMax;
+
+    benchTime = tNow;
+    benchNumBytes = benchNumOver = 0;
+    benchNumSamples = 0;
+    benchLatencySum = 0.0;
+    benchLatencyMax = 0;
+
+    if (numConsoles > 0) {
+        benchTimer = tpoll_timeout_relative(tp,
+            (callback_f) report_test_bench, tp,
+            TEST_BENCH_REPORT_SECS * 1000);
+    }
+    else {
+        benchTimer = -1;
+    }
+    x_pthread_mutex_unlock(&benchLock);
+
+    if (secs <= 0.0) {
+        return;
+    }
+    log_msg(LOG_NOTICE, "Test bench: %d console%s at %.2f MB/s"
+        " (target %.2f MB/s), %llu bytes overwritten,"
+        " latency avg %.3f ms max %.3f ms (%lu samples)",
+        numConsoles, (numConsoles == 1) ? "" : "s",
+        numBytes / secs / 1e6, rate / 1e6, numOver,
+        (numSamples > 0) ? latencySum / numSamples / 1e3 : 0.0,
+        latencyMax / 1e3, numSamples);
+    return;
+}
+
+
+static long diff_test_usecs(const struct timeval *t1,
+    const struct timeval *t0)
+{
+/*  Returns the number of microseconds from time 't0' to time 't1'.
+ */
+    return(((t1->tv_sec - t0->tv_sec) * 1000000L)
+        + (t1->tv_usec - t0->tv_usec));
+}
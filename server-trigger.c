@@ -0,0 +1,830 @@
+/*****************************************************************************
+ *  Written by Chris Dunlap <cdunlap@llnl.gov>.
+ *  Copyright (C) 2007-2016 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  UCRL-CODE-2002-009.
+ *
+ *  This file is part of ConMan: The Console Manager.
+ *  For details, see <https://dun.github.io/conman/>.
+ *
+ *  ConMan is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  ConMan is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with ConMan.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "common.h"
+#include "log.h"
+#include "server.h"
+#include "util-file.h"
+#include "util-str.h"
+#include "util.h"
+
+
+#define TRIGGER_BURST_MAX               10
+#define TRIGGER_BURST_SECS              60
+#define TRIGGER_CANDS_MAX               16
+#define TRIGGER_LINE_MAX                MAX_LINE
+#define TRIGGER_PREFILTER_MIN           3
+
+
+/*  Console output is matched against the trigger patterns a line at a time.
+ *    The literal patterns (along with a literal string extracted from each
+ *    regex that every match of it must contain) are compiled into a single
+ *    Aho-Corasick automaton.  This is converted into a DFA over the classes
+ *    of bytes appearing in those strings, so each byte of console output
+ *    costs one table lookup regardless of the number of patterns.
+ *  A regex is only evaluated on a completed line in which its literal was
+ *    found by the DFA (or on every line if no literal could be extracted).
+ *  The trigger set is read-only once created, and so is shared without
+ *    locking by the i/o threads.  Each console keeps its own match state,
+ *    which is carried across reads.
+ */
+typedef struct trigger_pat {
+    char            *str;               /* pattern as given in trigger file  */
+    char            *literal;           /* string matched by DFA, or NULL    */
+    regex_t          re;                /* compiled regex (if isRegex)       */
+    int              isRegex;           /* true if pattern is a regex        */
+} trigger_pat_t;
+
+typedef struct trigger_set {
+    trigger_pat_t   *pats;              /* array of trigger patterns         */
+    int              numPats;           /* num trigger patterns              */
+    int             *regexes;           /* ids of regexes w/o a literal      */
+    int              numRegexes;        /* num regexes w/o a literal         */
+    unsigned char    classes[256];      /* byte class of each byte value     */
+    int              numClasses;        /* num byte classes                  */
+    int             *delta;             /* DFA transitions by state & class  */
+    int             *outStart;          /* index of first output of state    */
+    int             *outCount;          /* num outputs (pattern ids) of state*/
+    int             *outIds;            /* pattern ids output by the states  */
+    int              numStates;         /* num DFA states                    */
+    char            *cmd;               /* cmd to invoke for an event        */
+    int              sd;                /* unix datagram socket for events   */
+    struct sockaddr_un addr;            /* address of event socket listener  */
+} trigger_set_t;
+
+typedef struct trigger_state {
+    int              state;             /* DFA state carried across reads    */
+    int              lineLen;           /* num bytes in line buffer          */
+    int              match;             /* id of literal matched, or -1      */
+    int              numCands;          /* num regexes whose literal matched */
+    int              gotCandsOverflow;  /* true if too many cands to track   */
+    int              cands[TRIGGER_CANDS_MAX];  /* ids of candidate regexes  */
+    time_t           burstTime;         /* time at which event burst began   */
+    int              burstCount;        /* num events in current burst       */
+    int              numDropped;        /* num events suppressed in burst    */
+    char             line[TRIGGER_LINE_MAX];    /* current line of output    */
+} trigger_state_t;
+
+/*  Trie nodes are only needed while the automaton is being built.
+ */
+typedef struct trigger_build {
+    int             *delta;             /* goto transitions (-1 if none)     */
+    int             *ownHead;           /* head of state's own outputs list  */
+    int             *ownNext;           /* next output in own outputs list   */
+    int             *ownIds;            /* pattern id of output list entry   */
+    int              numOwn;            /* num output list entries           */
+    int              maxOwn;            /* num output list entries alloc'd   */
+    int              numStates;         /* num trie states                   */
+    int              maxStates;         /* num trie states alloc'd           */
+} trigger_build_t;
+
+
+static int parse_trigger_line(trigger_set_t *set, char *line,
+    const char *filename, int lineNum);
+static int get_regex_literal(const char *re, char *dst, int dstlen);
+static void add_trigger_string(trigger_build_t *b, trigger_set_t *set,
+    const char *str, int id);
+static int add_trigger_state(trigger_build_t *b, int numClasses);
+static void build_trigger_dfa(trigger_build_t *b, trigger_set_t *set);
+static void open_trigger_socket(trigger_set_t *set, const char *name);
+static void note_trigger_outputs(trigger_state_t *ts, int s);
+static void append_trigger_line(trigger_state_t *ts,
+    const unsigned char *src, int len);
+static void end_trigger_line(obj_t *console, trigger_state_t *ts);
+static void fire_trigger(obj_t *console, trigger_state_t *ts, int id);
+static void run_trigger_cmd(obj_t *console, const char *pat,
+    const char *line);
+
+static trigger_set_t *triggers = NULL;
+
+
+int create_triggers(server_conf_t *conf)
+{
+/*  Creates the set of trigger patterns read from the conf's TriggerFile.
+ *  Each line of the file is either a literal string, or a POSIX extended
+ *    regex enclosed within slashes (and optionally followed by 'i' for a
+ *    case-insensitive match).  Blank lines and lines beginning with '#'
+ *    are ignored.
+ *  Returns the number of trigger patterns, or -1 on error.
+ */
+    FILE *fp;
+    char buf[MAX_LINE];
+    int lineNum = 0;
+    trigger_set_t *set;
+    trigger_build_t b;
+    int used[256];
+    int id;
+    int n;
+    const unsigned char *p;
+
+    assert(triggers == NULL);
+
+    if (!conf->triggerFileName) {
+        return(0);
+    }
+    if (!(fp = fopen(conf->triggerFileName, "r"))) {
+        log_msg(LOG_WARNING, "Unable to open trigger file \"%s\": %s",
+            conf->triggerFileName, strerror(errno));
+        return(-1);
+    }
+    if (!(set = malloc(sizeof(trigger_set_t)))) {
+        out_of_memory();
+    }
+    memset(set, 0, sizeof(*set));
+    set->sd = -1;
+
+    while (fgets(buf, sizeof(buf), fp)) {
+        lineNum++;
+        (void) parse_trigger_line(set, buf, conf->triggerFileName, lineNum);
+    }
+    if (ferror(fp)) {
+        log_msg(LOG_WARNING, "Unable to read trigger file \"%s\"",
+            conf->triggerFileName);
+    }
+    (void) fclose(fp);
+
+    if (set->numPats == 0) {
+        log_msg(LOG_WARNING, "Trigger file \"%s\" has no patterns",
+            conf->triggerFileName);
+        free(set->pats);
+        free(set);
+        return(0);
+    }
+    /*  Assign a byte class to each byte value appearing in the literals;
+     *    all other byte values share class 0.
+     */
+    memset(used, 0, sizeof(used));
+    for (id = 0; id < set->numPats; id++) {
+        p = (const unsigned char *) set->pats[id].literal;
+        while (p && *p) {
+            used[*p++] = 1;
+        }
+    }
+    set->numClasses = 1;
+    for (n = 0; n < 256; n++) {
+        set->classes[n] = used[n] ? set->numClasses++ : 0;
+    }
+    /*  Build the trie of literals, and then convert it into the DFA.
+     */
+    memset(&b, 0, sizeof(b));
+    (void) add_trigger_state(&b, set->numClasses);
+    for (id = 0; id < set->numPats; id++) {
+        if (set->pats[id].literal) {
+            add_trigger_string(&b, set, set->pats[id].literal, id);
+        }
+        else {
+            if (!(set->regexes = realloc(set->regexes,
+              (set->numRegexes + 1) * sizeof(int)))) {
+                out_of_memory();
+            }
+            set->regexes[set->numRegexes++] = id;
+        }
+    }
+    build_trigger_dfa(&b, set);
+
+    set->cmd = conf->triggerCmd ? create_string(conf->triggerCmd) : NULL;
+    if (conf->triggerSockName) {
+        open_trigger_socket(set, conf->triggerSockName);
+    }
+    triggers = set;
+
+    log_msg(LOG_INFO, "Loaded %d trigger pattern%s from \"%s\" (%d states)",
+        set->numPats, (set->numPats == 1 ? "" : "s"),
+        conf->triggerFileName, set->numStates);
+    return(set->numPats);
+}
+
+
+void destroy_triggers(void)
+{
+/*  Destroys the set of trigger patterns.
+ */
+    trigger_set_t *set;
+    int id;
+
+    if (!(set = triggers)) {
+        return;
+    }
+    triggers = NULL;
+
+    for (id = 0; id < set->numPats; id++) {
+        if (set->pats[id].isRegex) {
+            regfree(&set->pats[id].re);
+        }
+        if (set->pats[id].literal) {
+            free(set->pats[id].literal);
+        }
+        free(set->pats[id].str);
+    }
+    free(set->pats);
+    free(set->regexes);
+    free(set->delta);
+    free(set->outStart);
+    free(set->outCount);
+    free(set->outIds);
+    if (set->cmd) {
+        free(set->cmd);
+    }
+    if (set->sd >= 0) {
+        (void) close(set->sd);
+    }
+    free(set);
+    return;
+}
+
+
+void scan_triggers(obj_t *console, const void *src, int len)
+{
+/*  Matches the (len) bytes of console output in (src) against the trigger
+ *    patterns, firing an event for each line of output that matches.
+ *
+ *  XXX: This routine must only be called by the console obj's i/o thread.
+ */
+    trigger_set_t *set;
+    trigger_state_t *ts;
+    const unsigned char *p;
+    const unsigned char *q;
+    const unsigned char *end;
+    int s;
+
+    if (!(set = triggers) || (len <= 0)) {
+        return;
+    }
+    if (!(ts = console->trigger)) {
+        if (!(ts = malloc(sizeof(trigger_state_t)))) {
+            out_of_memory();
+        }
+        memset(ts, 0, sizeof(*ts));
+        ts->match = -1;
+        console->trigger = ts;
+    }
+    s = ts->state;
+    p = src;
+    end = p + len;
+
+    for (q = p; q < end; q++) {
+        if ((*q == '\n') || (*q == '\r')) {
+            append_trigger_line(ts, p, q - p);
+            end_trigger_line(console, ts);
+            p = q + 1;
+            s = 0;
+            continue;
+        }
+        s = set->delta[(s * set->numClasses) + set->classes[*q]];
+        if (set->outCount[s] && (ts->match < 0)) {
+            note_trigger_outputs(ts, s);
+        }
+    }
+    append_trigger_line(ts, p, end - p);
+    ts->state = s;
+
+    /*  An overlong line is matched once its buffer fills.
+     */
+    if (ts->lineLen >= (int) sizeof(ts->line) - 1) {
+        end_trigger_line(console, ts);
+        ts->state = 0;
+    }
+    return;
+}
+
+
+static int parse_trigger_line(trigger_set_t *set, char *line,
+    const char *filename, int lineNum)
+{
+/*  Parses a (line) of the trigger file, adding its pattern to the (set).
+ *  Returns 0 on success (or if the line is ignored), or -1 on error.
+ */
+    trigger_pat_t *pat;
+    char *p;
+    char *q;
+    int flags = REG_EXTENDED | REG_NOSUB;
+    int rc;
+    char errbuf[MAX_LINE];
+
+    for (p = line; isspace((int) *p); p++) {;}
+    for (q = p + strlen(p); (q > p) && isspace((int) q[-1]); q--) {;}
+    *q = '\0';
+
+    if ((*p == '\0') || (*p == '#')) {
+        return(0);
+    }
+    if (!(set->pats = realloc(set->pats,
+      (set->numPats + 1) * sizeof(trigger_pat_t)))) {
+        out_of_memory();
+    }
+    pat = &set->pats[set->numPats];
+    pat->str = create_string(p);
+    pat->literal = NULL;
+    pat->isRegex = 0;
+
+    if ((*p == '/') && (q - p >= 3) && ((q[-1] == '/')
+            || ((q[-1] == 'i') && (q[-2] == '/') && (q - p >= 4)))) {
+        if (q[-1] == 'i') {
+            flags |= REG_ICASE;
+            q--;
+        }
+        *--q = '\0';
+        p++;
+        if ((rc = regcomp(&pat->re, p, flags)) != 0) {
+            (void) regerror(rc, &pat->re, errbuf, sizeof(errbuf));
+            log_msg(LOG_WARNING, "Ignoring trigger at %s:%d: %s",
+                filename, lineNum, errbuf);
+            free(pat->str);
+            return(-1);
+        }
+        pat->isRegex = 1;
+        /*
+         *  A case-insensitive regex has no literal that must appear verbatim.
+         */
+        if (!(flags & REG_ICASE) && get_regex_literal(p, errbuf,
+                sizeof(errbuf))) {
+            pat->literal = create_string(errbuf);
+        }
+    }
+    else {
+        pat->literal = create_string(p);
+    }
+    set->numPats++;
+    return(0);
+}
+
+
+static int get_regex_literal(const char *re, char *dst, int dstlen)
+{
+/*  Extracts the longest string of literal characters from the regex (re)
+ *    that must appear verbatim in anything it matches, writing it into the
+ *    buffer (dst) of length (dstlen).
+ *  Only characters outside of any subexpression are considered, and no
+ *    literal is extracted from a regex containing an alternation.
+ *  Returns the length of the literal, or 0 if none of at least
+ *    TRIGGER_PREFILTER_MIN characters could be extracted.
+ */
+    char run[MAX_LINE];
+    int runLen = 0;
+    int bestLen = 0;
+    int depth = 0;
+    int isLiteral;
+    const char *p;
+    char c;
+
+    if (strchr(re, '|')) {
+        return(0);
+    }
+    dstlen = MIN(dstlen, (int) sizeof(run));
+
+    for (p = re; *p; p++) {
+        c = *p;
+        isLiteral = 0;
+        if (c == '\\') {
+            if (!(c = *++p)) {
+                break;
+            }
+            isLiteral = ispunct((int) c);
+        }
+        else if (c == '[') {
+            p += (p[1] == '^') ? 2 : 1;
+            if (*p == ']') {
+                p++;
+            }
+            while (*p && (*p != ']')) {
+                p++;
+            }
+            if (!*p) {
+                break;
+            }
+        }
+        else if (c == '{') {
+            while (p[1] && (p[1] != '}')) {
+                p++;
+            }
+        }
+        else if (c == '(') {
+            depth++;
+        }
+        else if (c == ')') {
+            depth--;
+        }
+        else if (!strchr(".^$*+?", c)) {
+            isLiteral = 1;
+        }
+        /*  A literal char followed by '*', '?', or '{' may be absent, and one
+         *    followed by '+' may repeat; either ends the literal run.
+         */
+        if (isLiteral && (depth == 0) && (p[1] != '*') && (p[1] != '?')
+                && (p[1] != '{') && (runLen < dstlen - 1)) {
+            run[runLen++] = c;
+            if (runLen > bestLen) {
+                memcpy(dst, run, runLen);
+                dst[runLen] = '\0';
+                bestLen = runLen;
+            }
+            if (p[1] == '+') {
+                runLen = 0;
+            }
+        }
+        else {
+            runLen = 0;
+        }
+    }
+    return((bestLen >= TRIGGER_PREFILTER_MIN) ? bestLen : 0);
+}
+
+
+static void add_trigger_string(trigger_build_t *b, trigger_set_t *set,
+    const char *str, int id)
+{
+/*  Adds the string (str) to the trie being built in (b), such that
+ *    reaching its final state outputs the pattern (id).
+ */
+    const unsigned char *p;
+    int s = 0;
+    int t;
+    int c;
+
+    for (p = (const unsigned char *) str; *p; p++) {
+        c = set->classes[*p];
+        if ((t = b->delta[(s * set->numClasses) + c]) < 0) {
+            t = add_trigger_state(b, set->numClasses);
+            b->delta[(s * set->numClasses) + c] = t;
+        }
+        s = t;
+    }
+    if (b->numOwn >= b->maxOwn) {
+        b->maxOwn = b->maxOwn ? b->maxOwn * 2 : 64;
+        if (!(b->ownNext = realloc(b->ownNext, b->maxOwn * sizeof(int)))
+          || !(b->ownIds = realloc(b->ownIds, b->maxOwn * sizeof(int)))) {
+            out_of_memory();
+        }
+    }
+    b->ownIds[b->numOwn] = id;
+    b->ownNext[b->numOwn] = b->ownHead[s];
+    b->ownHead[s] = b->numOwn++;
+    return;
+}
+
+
+static int add_trigger_state(trigger_build_t *b, int numClasses)
+{
+/*  Adds a new state without transitions to the trie being built in (b).
+ *  Returns the new state.
+ */
+    int s;
+    int c;
+
+    if (b->numStates >= b->maxStates) {
+        b->maxStates = b->maxStates ? b->maxStates * 2 : 256;
+        if (!(b->delta = realloc(b->delta,
+              b->maxStates * numClasses * sizeof(int)))
+          || !(b->ownHead = realloc(b->ownHead,
+              b->maxStates * sizeof(int)))) {
+            out_of_memory();
+        }
+    }
+    s = b->numStates++;
+    for (c = 0; c < numClasses; c++) {
+        b->delta[(s * numClasses) + c] = -1;
+    }
+    b->ownHead[s] = -1;
+    return(s);
+}
+
+
+static void build_trigger_dfa(trigger_build_t *b, trigger_set_t *set)
+{
+/*  Converts the trie built in (b) into the trigger (set) DFA by computing
+ *    the Aho-Corasick failure function in breadth-first order, replacing
+ *    each missing transition with that of the state's failure state.
+ *  The outputs of each state are its own along with those of its failure
+ *    state, and are flattened into a single array.
+ */
+    const int k = set->numClasses;
+    int *fail = NULL;
+    int *queue = NULL;
+    int head = 0;
+    int tail = 0;
+    int numOut = 0;
+    int i;
+    int r, s;
+    int c;
+    int n;
+
+    if (!(fail = malloc(b->numStates * sizeof(int)))
+      || !(queue = malloc(b->numStates * sizeof(int)))
+      || !(set->outStart = malloc(b->numStates * sizeof(int)))
+      || !(set->outCount = malloc(b->numStates * sizeof(int)))) {
+        out_of_memory();
+    }
+    fail[0] = 0;
+    queue[tail++] = 0;
+    while (head < tail) {
+        r = queue[head++];
+        for (c = 0; c < k; c++) {
+            s = b->delta[(r * k) + c];
+            if (s < 0) {
+                b->delta[(r * k) + c] =
+                    (r == 0) ? 0 : b->delta[(fail[r] * k) + c];
+            }
+            else {
+                fail[s] = (r == 0) ? 0 : b->delta[(fail[r] * k) + c];
+                queue[tail++] = s;
+            }
+        }
+    }
+    /*  Flatten the outputs in breadth-first order so the outputs of each
+     *    failure state are complete before they are needed.
+     */
+    for (i = 0; i < tail; i++) {
+        s = queue[i];
+        for (n = 0, r = b->ownHead[s]; r >= 0; r = b->ownNext[r]) {
+            n++;
+        }
+        set->outCount[s] = n + ((s == 0) ? 0 : set->outCount[fail[s]]);
+        numOut += set->outCount[s];
+    }
+    if (!(set->outIds = malloc(MAX(numOut, 1) * sizeof(int)))) {
+        out_of_memory();
+    }
+    for (i = 0, n = 0; i < tail; i++) {
+        s = queue[i];
+        set->outStart[s] = n;
+        for (r = b->ownHead[s]; r >= 0; r = b->ownNext[r]) {
+            set->outIds[n++] = b->ownIds[r];
+        }
+        if ((s != 0) && set->outCount[fail[s]]) {
+            memcpy(&set->outIds[n], &set->outIds[set->outStart[fail[s]]],
+                set->outCount[fail[s]] * sizeof(int));
+            n += set->outCount[fail[s]];
+        }
+    }
+    set->delta = b->delta;
+    set->numStates = b->numStates;
+
+    free(fail);
+    free(queue);
+    free(b->ownHead);
+    free(b->ownNext);
+    free(b->ownIds);
+    return;
+}
+
+
+static void open_trigger_socket(trigger_set_t *set, const char *name)
+{
+/*  Opens the unix datagram socket for sending trigger events to the
+ *    listener bound to the pathname (name).
+ */
+    if (strlen(name) >= sizeof(set->addr.sun_path)) {
+        log_msg(LOG_WARNING, "Trigger socket \"%s\" exceeds max length",
+            name);
+        return;
+    }
+    if ((set->sd = socket(AF_UNIX, SOCK_DGRAM, 0)) < 0) {
+        log_msg(LOG_WARNING, "Unable to create trigger socket: %s",
+            strerror(errno));
+        return;
+    }
+    set_fd_nonblocking(set->sd);
+    set_fd_closed_on_exec(set->sd);
+
+    memset(&set->addr, 0, sizeof(set->addr));
+    set->addr.sun_family = AF_UNIX;
+    strcpy(set->addr.sun_path, name);
+    return;
+}
+
+
+static void note_trigger_outputs(trigger_state_t *ts, int s)
+{
+/*  Notes the patterns output by DFA state (s) for the current line.
+ *    The first literal found becomes the line's match; each regex whose
+ *    literal was found becomes a candidate to be tried once the line ends.
+ */
+    trigger_set_t *set = triggers;
+    int i;
+    int j;
+    int id;
+
+    for (i = set->outStart[s]; i < set->outStart[s] + set->outCount[s]; i++) {
+        id = set->outIds[i];
+        if (!set->pats[id].isRegex) {
+            ts->match = id;
+            return;
+        }
+        for (j = 0; (j < ts->numCands) && (ts->cands[j] != id); j++) {;}
+        if (j < ts->numCands) {
+            continue;
+        }
+        if (ts->numCands < TRIGGER_CANDS_MAX) {
+            ts->cands[ts->numCands++] = id;
+        }
+        else {
+            ts->gotCandsOverflow = 1;
+        }
+    }
+    return;
+}
+
+
+static void append_trigger_line(trigger_state_t *ts,
+    const unsigned char *src, int len)
+{
+/*  Appends the (len) bytes of (src) to the console's current line,
+ *    truncating the line if it does not fit.
+ */
+    int n;
+
+    n = MIN(len, (int) sizeof(ts->line) - 1 - ts->lineLen);
+    if (n > 0) {
+        memcpy(ts->line + ts->lineLen, src, n);
+        ts->lineLen += n;
+    }
+    return;
+}
+
+
+static void end_trigger_line(obj_t *console, trigger_state_t *ts)
+{
+/*  Completes the console's current line, firing an event for the first
+ *    literal found within it or else the first regex that matches it.
+ */
+    trigger_set_t *set = triggers;
+    int id;
+    int i;
+
+    if (ts->lineLen == 0) {
+        return;
+    }
+    ts->line[ts->lineLen] = '\0';
+    id = ts->match;
+
+    if ((id < 0) && ts->gotCandsOverflow) {
+        for (i = 0; (id < 0) && (i < set->numPats); i++) {
+            if (set->pats[i].isRegex
+                    && !regexec(&set->pats[i].re, ts->line, 0, NULL, 0)) {
+                id = i;
+            }
+        }
+    }
+    for (i = 0; (id < 0) && (i < ts->numCands); i++) {
+        if (!regexec(&set->pats[ts->cands[i]].re, ts->line, 0, NULL, 0)) {
+            id = ts->cands[i];
+        }
+    }
+    for (i = 0; (id < 0) && (i < set->numRegexes); i++) {
+        if (!regexec(&set->pats[set->regexes[i]].re, ts->line, 0, NULL, 0)) {
+            id = set->regexes[i];
+        }
+    }
+    if (id >= 0) {
+        fire_trigger(console, ts, id);
+    }
+    ts->lineLen = 0;
+    ts->match = -1;
+    ts->numCands = 0;
+    ts->gotCandsOverflow = 0;
+    return;
+}
+
+
+static void fire_trigger(obj_t *console, trigger_state_t *ts, int id)
+{
+/*  Fires an event for the console's current line matching trigger (id).
+ *    The event is logged, sent to the trigger socket, and passed to the
+ *    trigger cmd.  At most TRIGGER_BURST_MAX events are fired for a
+ *    console within TRIGGER_BURST_SECS; any others are merely counted.
+ */
+    trigger_set_t *set = triggers;
+    const char *pat;
+    char msg[MAX_LINE * 2];
+    time_t now;
+    char *p;
+    int n;
+
+    now = time(NULL);
+    if (now - ts->burstTime >= TRIGGER_BURST_SECS) {
+        if (ts->numDropped > 0) {
+            log_msg(LOG_NOTICE, "Console [%s] suppressed %d trigger event%s",
+                console->name, ts->numDropped,
+                (ts->numDropped == 1 ? "" : "s"));
+        }
+        ts->burstTime = now;
+        ts->burstCount = 0;
+        ts->numDropped = 0;
+    }
+    if (ts->burstCount >= TRIGGER_BURST_MAX) {
+        ts->numDropped++;
+        return;
+    }
+    ts->burstCount++;
+
+    /*  Replace non-printable chars so the line can be safely reported.
+     */
+    for (p = ts->line; *p; p++) {
+        if (!isprint((int) (unsigned char) *p)) {
+            *p = '.';
+        }
+    }
+    pat = set->pats[id].str;
+    log_msg(LOG_NOTICE, "Console [%s] matched trigger \"%s\": %s",
+        console->name, pat, ts->line);
+
+    if (set->sd >= 0) {
+        n = snprintf(msg, sizeof(msg), "%ld\t%s\t%s\t%s\n",
+            (long) now, console->name, pat, ts->line);
+        if ((n < 0) || (n >= (int) sizeof(msg))) {
+            n = sizeof(msg) - 1;
+            msg[n - 1] = '\n';
+        }
+        if (sendto(set->sd, msg, n, 0, (struct sockaddr *) &set->addr,
+                sizeof(set->addr)) < 0) {
+            DPRINTF((5, "Unable to send trigger event for [%s]: %s.\n",
+                console->name, strerror(errno)));
+        }
+    }
+    if (set->cmd) {
+        run_trigger_cmd(console, pat, ts->line);
+    }
+    return;
+}
+
+
+static void run_trigger_cmd(obj_t *console, const char *pat,
+    const char *line)
+{
+/*  Invokes the TriggerCmd for the (console) output (line) that matched the
+ *    trigger (pat).  The console name, pattern, and line are passed to the
+ *    cmd as the positional parameters $1, $2, and $3.
+ *  The cmd is not waited upon; it is reaped by the SIGCHLD handler.
+ */
+    char cmd[MAX_LINE];
+    pid_t pid;
+    int fd;
+
+    if (format_obj_string(cmd, sizeof(cmd), console, triggers->cmd) < 0) {
+        log_msg(LOG_WARNING,
+            "Unable to run trigger cmd for console [%s]: command too long",
+            console->name);
+        return;
+    }
+    if ((pid = fork()) < 0) {
+        log_msg(LOG_WARNING,
+            "Unable to run trigger cmd for console [%s]: fork failed: %s",
+            console->name, strerror(errno));
+        return;
+    }
+    else if (pid == 0) {
+        (void) setpgid(0, 0);
+        if ((fd = open("/dev/null", O_RDWR)) >= 0) {
+            (void) dup2(fd, STDIN_FILENO);
+            (void) dup2(fd, STDOUT_FILENO);
+            (void) dup2(fd, STDERR_FILENO);
+            if (fd > STDERR_FILENO) {
+                (void) close(fd);
+            }
+        }
+        execl("/bin/sh", "sh", "-c", cmd, "sh", console->name, pat, line,
+            (char *) NULL);
+        _exit(127);                     /* execl() error */
+    }
+    (void) setpgid(pid, 0);
+    DPRINTF((5, "Started trigger cmd for [%s] (pid %d).\n",
+        console->name, (int) pid));
+    return;
+}
@@ -50,8 +50,6 @@ static int connect_unixsock_obj(obj_t *unixsock);
 static int disconnect_unixsock_obj(obj_t *unixsock);
 static void reset_unixsock_delay(obj_t *unixsock);
 
-extern tpoll_t tp_global;               /* defined in server.c */
-
 
 int is_unixsock_dev(const char *dev, const char *cwd, char **path_ref)
 {
@@ -89,9 +87,7 @@ obj_t * create_unixsock_obj(server_conf_t *conf, char *name, char *dev,
  *  Returns the new objects, or NULL on error.
  */
     size_t        n;
-    ListIterator  i;
     obj_t        *unixsock;
-    int           rv;
 
     assert(conf != NULL);
     assert((name != NULL) && (name[0] != '\0'));
@@ -112,27 +108,19 @@ obj_t * create_unixsock_obj(server_conf_t *conf, char *name, char *dev,
     }
     /*  Check for duplicate console and device names.
      */
-    i = list_iterator_create(conf->objs);
-    while ((unixsock = list_next(i))) {
-        if (is_console_obj(unixsock) && !strcmp(unixsock->name, name)) {
-            if ((errbuf != NULL) && (errlen > 0)) {
-                snprintf(errbuf, errlen,
-                    "console [%s] specifies duplicate console name", name);
-            }
-            break;
-        }
-        if (is_unixsock_obj(unixsock)
-                && !strcmp(unixsock->aux.unixsock.dev, dev)) {
-            if ((errbuf != NULL) && (errlen > 0)) {
-                snprintf(errbuf, errlen,
-                    "console [%s] specifies duplicate device \"%s\"",
-                    name, dev);
-            }
-            break;
+    if (find_obj_index(conf->consoleIndex, name, CONMAN_OBJ_IS_CONSOLE)) {
+        if ((errbuf != NULL) && (errlen > 0)) {
+            snprintf(errbuf, errlen,
+                "console [%s] specifies duplicate console name", name);
         }
+        return(NULL);
     }
-    list_iterator_destroy(i);
-    if (unixsock != NULL) {
+    if (find_obj_index(conf->deviceIndex, dev, CONMAN_OBJ_UNIXSOCK)) {
+        if ((errbuf != NULL) && (errlen > 0)) {
+            snprintf(errbuf, errlen,
+                "console [%s] specifies duplicate device \"%s\"",
+                name, dev);
+        }
         return(NULL);
     }
     unixsock = create_obj(conf, name, -1, CONMAN_OBJ_UNIXSOCK);
@@ -141,19 +129,60 @@ obj_t * create_unixsock_obj(server_conf_t *conf, char *name, char *dev,
     unixsock->aux.unixsock.timer = -1;
     unixsock->aux.unixsock.state = CONMAN_UNIXSOCK_DOWN;
     unixsock->aux.unixsock.delay = UNIXSOCK_MIN_TIMEOUT;
+    unixsock->aux.unixsock.isWatched = 0;
     /*
-     *  Add obj to the master conf->objs list.
+     *  Add obj to the master conf->objs list and its indexes.
      */
     list_append(conf->objs, unixsock);
+    insert_obj_index(conf->consoleIndex, unixsock->name, unixsock);
+    insert_obj_index(conf->deviceIndex, unixsock->aux.unixsock.dev, unixsock);
+
+    return(unixsock);
+}
+
+
+int watch_unixsock_obj(obj_t *unixsock)
+{
+/*  Registers the (unixsock) obj's device for inotify events so the obj is
+ *    reopened whenever the socket is created.
+ *  This is not done by create_unixsock_obj() since an obj created while
+ *    re-reading the config for a reconfig may never be adopted.
+ *  Returns 0 on success, or -1 on error.
+ *
+ *  XXX: This routine must only be called by the main thread.
+ */
+    assert(unixsock != NULL);
+    assert(is_unixsock_obj(unixsock));
 
-    rv = inevent_add(unixsock->aux.unixsock.dev,
-        (inevent_cb_f) open_unixsock_obj, unixsock);
-    if (rv < 0) {
+    if (unixsock->aux.unixsock.isWatched) {
+        return(0);
+    }
+    if (inevent_add(unixsock->aux.unixsock.dev,
+            (inevent_cb_f) open_unixsock_obj, unixsock) < 0) {
         log_msg(LOG_INFO,
             "Console [%s] unable to register device \"%s\" for inotify events",
             unixsock->name, unixsock->aux.unixsock.dev);
+        return(-1);
     }
-    return(unixsock);
+    unixsock->aux.unixsock.isWatched = 1;
+    return(0);
+}
+
+
+void unwatch_unixsock_obj(obj_t *unixsock)
+{
+/*  Unregisters the (unixsock) obj's device from inotify events.
+ *
+ *  XXX: This routine must only be called by the main thread.
+ */
+    assert(unixsock != NULL);
+    assert(is_unixsock_obj(unixsock));
+
+    if (unixsock->aux.unixsock.isWatched) {
+        (void) inevent_remove(unixsock->aux.unixsock.dev);
+        unixsock->aux.unixsock.isWatched = 0;
+    }
+    return;
 }
 
 
@@ -211,7 +240,7 @@ static int connect_unixsock_obj(obj_t *unixsock)
     auxp = &(unixsock->aux.unixsock);
 
     if (auxp->timer >= 0) {
-        (void) tpoll_timeout_cancel(tp_global, auxp->timer);
+        (void) tpoll_timeout_cancel(unixsock->tp, auxp->timer);
         auxp->timer = -1;
     }
 
@@ -266,12 +295,13 @@ static int connect_unixsock_obj(obj_t *unixsock)
      */
     unixsock->gotEOF = 0;
     auxp->state = CONMAN_UNIXSOCK_UP;
-    tpoll_set(tp_global, unixsock->fd, POLLIN);
+    mark_console_up(unixsock);
+    tpoll_set_arg(unixsock->tp, unixsock->fd, POLLIN, unixsock);
 
     /*  Require the connection to be up for a minimum length of time before
      *    resetting the reconnect-delay back to the minimum.
      */
-    auxp->timer = tpoll_timeout_relative(tp_global,
+    auxp->timer = tpoll_timeout_relative(unixsock->tp,
         (callback_f) reset_unixsock_delay, unixsock, MIN_CONNECT_SECS * 1000);
 
     /*  Notify linked objs when transitioning into an UP state.
@@ -299,11 +329,11 @@ static int disconnect_unixsock_obj(obj_t *unixsock)
     auxp = &(unixsock->aux.unixsock);
 
     if (auxp->timer >= 0) {
-        (void) tpoll_timeout_cancel(tp_global, auxp->timer);
+        (void) tpoll_timeout_cancel(unixsock->tp, auxp->timer);
         auxp->timer = -1;
     }
     if (unixsock->fd >= 0) {
-        tpoll_clear(tp_global, unixsock->fd, POLLIN | POLLOUT);
+        tpoll_clear(unixsock->tp, unixsock->fd, POLLIN | POLLOUT);
         if (close(unixsock->fd) < 0) {
             log_msg(LOG_WARNING, "Console [%s] cannot close device \"%s\": %s",
                 unixsock->name, auxp->dev, strerror(errno));
@@ -314,18 +344,17 @@ static int disconnect_unixsock_obj(obj_t *unixsock)
      */
     if (auxp->state == CONMAN_UNIXSOCK_UP) {
         auxp->state = CONMAN_UNIXSOCK_DOWN;
+        mark_console_down(unixsock);
         write_notify_msg(unixsock, LOG_INFO,
             "Console [%s] disconnected from \"%s\"",
             unixsock->name, auxp->dev);
     }
     /*  Set timer for establishing new connection.
      */
-    auxp->timer = tpoll_timeout_relative(tp_global,
-        (callback_f) connect_unixsock_obj, unixsock, auxp->delay * 1000);
-
-    if (auxp->delay < UNIXSOCK_MAX_TIMEOUT) {
-        auxp->delay = MIN(auxp->delay * 2, UNIXSOCK_MAX_TIMEOUT);
-    }
+    auxp->timer = tpoll_timeout_relative(unixsock->tp,
+        (callback_f) connect_unixsock_obj, unixsock,
+        get_reconnect_msecs(&auxp->delay,
+            UNIXSOCK_MIN_TIMEOUT, UNIXSOCK_MAX_TIMEOUT));
     return(-1);
 }
 
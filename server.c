@@ -31,6 +31,7 @@
 #include <fcntl.h>
 #include <limits.h>
 #include <netinet/in.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -46,11 +47,64 @@
 #include "inevent.h"
 #include "list.h"
 #include "log.h"
+#include "probe.h"
 #include "server.h"
 #include "tpoll.h"
 #include "util-file.h"
 #include "util-str.h"
 #include "util.h"
+#include "wrapper.h"
+
+
+/*  Each i/o thread multiplexes its own shard of the consoles (along with
+ *    their logfiles and clients) via its own tpoll obj.  The main thread
+ *    is always ioThreads[0]; it also handles inotify events and signals.
+ */
+typedef struct io_thread {
+    server_conf_t   *conf;              /* server's configuration            */
+    tpoll_t          tp;                /* tpoll obj for muxing i/o & timers */
+    pthread_t        tid;               /* thread id if not the main thread  */
+    int              fdWake[2];         /* pipe for waking thread at exit    */
+    List             pendingObjs;       /* objs awaiting their initial open  */
+    io_stats_t       stats;             /* performance counters (see metrics)*/
+} io_thread_t;
+
+/*  A retired obj is destroyed once every i/o thread has run its release
+ *    timer, thereby ensuring no thread still holds a ref to it.
+ */
+typedef struct retired_obj {
+    obj_t           *obj;               /* obj awaiting destruction          */
+    int              numLeft;           /* num threads not yet released obj  */
+} retired_obj_t;
+
+/*  A console removed by a reconfig is closed and unlinked from its clients
+ *    at once, but it is retired (along with its logfile) only after a delay
+ *    of OBJ_REMOVE_DELAY secs since a client worker thread that found the
+ *    console before it was removed from the indexes may still be linking
+ *    a new client to it.
+ */
+typedef struct removed_obj {
+    obj_t           *console;           /* console obj being removed         */
+    obj_t           *logfile;           /* logfile obj of console, or NULL   */
+} removed_obj_t;
+
+/*  New client connections are accepted by the client setup thread, which
+ *    receives their handshakes via its own tpoll loop on non-blocking
+ *    sockets so that a slow or idle client cannot hold up any other.
+ *  Once its request has been received, a connection is queued for
+ *    processing by a fixed pool of worker threads.  Metrics scrapes and
+ *    log range replays are queued for a separate pool of bulk workers
+ *    so they cannot delay the processing of other clients.
+ *  While CLIENT_QUEUE_MAX connections are being set up or processed, the
+ *    listening sockets are not polled (leaving further connections in their
+ *    backlogs); consequently, neither queue can overflow.
+ */
+typedef struct client_queue {
+    client_setup_t  *setups[CLIENT_QUEUE_MAX];  /* circular queue of conns  */
+    int              head;              /* index of first conn in queue      */
+    int              count;             /* num conns in queue                */
+    pthread_cond_t   cond;              /* cond signaled when conn is queued */
+} client_queue_t;
 
 
 static void begin_daemonize(int *fd_ptr, pid_t *pgid_ptr);
@@ -66,12 +120,42 @@ static void display_configuration(server_conf_t *conf);
 static void schedule_timestamp(server_conf_t *conf);
 static void timestamp_logfiles(server_conf_t *conf);
 static void create_listen_socket(server_conf_t *conf);
+static int open_listen_socket(server_conf_t *conf, int port);
 static void setup_nofile_limit(server_conf_t *conf);
 static void open_objs(server_conf_t *conf);
-static void mux_io(server_conf_t *conf);
+static void queue_pending_objs(server_conf_t *conf, List objs, int n);
+static void open_pending_objs(io_thread_t *iot);
+static io_thread_t * get_io_thread(server_conf_t *conf, obj_t *obj);
+static void assign_io_threads(server_conf_t *conf);
+static void create_io_threads(server_conf_t *conf);
+static void stop_io_threads(server_conf_t *conf);
+static void destroy_io_threads(void);
+static void * mux_io(io_thread_t *iot);
+static void update_io_stats(io_thread_t *iot, int n, struct timeval *t0);
+static void reconfig_objs(server_conf_t *conf);
+static int is_console_changed(obj_t *old, obj_t *new);
+static int is_logfile_changed(obj_t *old, obj_t *new);
+static const char * get_logfile_key(obj_t *logfile);
+static int find_obj_type(obj_t *obj, unsigned *type);
+static void adopt_obj(server_conf_t *conf, obj_t *obj);
+static void remove_console_obj(server_conf_t *conf, obj_t *console);
+static void close_removed_obj(removed_obj_t *removed);
+static void retire_removed_obj(removed_obj_t *removed);
+static void retire_obj(server_conf_t *conf, obj_t *obj);
+static void release_retired_obj(retired_obj_t *retired);
 static void open_daemon_logfile(server_conf_t *conf);
 static void reopen_logfiles(server_conf_t *conf);
-static void accept_client(server_conf_t *conf);
+static void reopen_io_thread_logfiles(io_thread_t *iot);
+static void accept_client(server_conf_t *conf, int ld);
+static void block_signals(sigset_t *sigsetOld);
+static void restore_signals(sigset_t *sigsetOld);
+static void create_client_workers(server_conf_t *conf);
+static void create_log_writers(void);
+static void * process_client_setups(server_conf_t *conf);
+static void expire_client_setup(client_setup_t *cs);
+static void queue_client_setup(client_setup_t *cs);
+static void * process_client_queue(client_queue_t *q);
+static void release_client(server_conf_t *conf);
 
 /*  Signal handler flags and whatnot.
  */
@@ -80,10 +164,19 @@ static volatile sig_atomic_t reconfig = 0;
 static int coredump = 0;
 static char coredumpdir[PATH_MAX];
 
-/*  The 'tp_global' var is to allow timers to be set or canceled
- *    without having to pass the conf's tp var through the call stack.
- */
-tpoll_t tp_global = NULL;
+static io_thread_t *ioThreads = NULL;
+static int numIOThreads = 0;
+static pthread_mutex_t retiredLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t openLock = PTHREAD_MUTEX_INITIALIZER;
+static time_t openTime = 0;
+static int openCount = 0;
+static int ioThreadNext = 0;
+
+static tpoll_t clientTp = NULL;
+static int clientCount = 0;
+static client_queue_t clientQueue = { {NULL}, 0, 0, PTHREAD_COND_INITIALIZER };
+static client_queue_t bulkQueue = { {NULL}, 0, 0, PTHREAD_COND_INITIALIZER };
+static pthread_mutex_t clientLock = PTHREAD_MUTEX_INITIALIZER;
 
 extern char ** environ;
 
@@ -102,7 +195,6 @@ int main(int argc, char *argv[])
     log_set_file(stderr, log_priority, 0);
 
     conf = create_server_conf();
-    tp_global = conf->tp;
 
     process_cmdline(conf, argc, argv);
     if (!conf->enableForeground) {
@@ -144,18 +236,29 @@ int main(int argc, char *argv[])
         VERSION, (int) getpid());
 
 #if WITH_FREEIPMI
-    ipmi_init(conf->numIpmiObjs);
+    ipmi_init(conf->numIpmiObjs, conf->ipmiMaxConnects);
 #endif /* WITH_FREEIPMI */
 
     setup_nofile_limit(conf);
+    (void) create_triggers(conf);
+    assign_io_threads(conf);
+    reconnect_init(conf->maxConnects, conf->maxHostConnects);
     open_objs(conf);
-    mux_io(conf);
+    create_io_threads(conf);
+    create_client_workers(conf);
+    create_log_writers();
+    (void) mux_io(&ioThreads[0]);
+    stop_io_threads(conf);
+    destroy_triggers();
 
 #if WITH_FREEIPMI
     ipmi_fini();
 #endif /* WITH_FREEIPMI */
 
     destroy_server_conf(conf);
+    sync_log_writes();
+    destroy_io_threads();
+    reconnect_fini();
 
     if (pgid > 0) {
         if (kill(-pgid, SIGTERM) < 0) {
@@ -537,6 +640,10 @@ static void display_configuration(server_conf_t *conf)
         fprintf(stderr, " TimeStamp=%dm", conf->tStampMinutes);
         gotOptions++;
     }
+    if (conf->triggerFileName) {
+        fprintf(stderr, " Triggers");
+        gotOptions++;
+    }
     if (conf->enableZeroLogs) {
         fprintf(stderr, " ZeroLogs");
         gotOptions++;
@@ -546,6 +653,13 @@ static void display_configuration(server_conf_t *conf)
     }
     fprintf(stderr, "\n");
     fprintf(stderr, "Listening on port %d\n", conf->port);
+    if (conf->metricsPort > 0) {
+        fprintf(stderr, "Serving metrics on port %d\n", conf->metricsPort);
+    }
+    if (conf->forwardHost) {
+        fprintf(stderr, "Forwarding to <%s:%d>\n",
+            conf->forwardHost, conf->forwardPort);
+    }
     fprintf(stderr, "Monitoring %d console%s\n", n, ((n == 1) ? "" : "s"));
     fprintf(stderr, "\n");
     return;
@@ -589,7 +703,7 @@ static void schedule_timestamp(server_conf_t *conf)
 
     /*  The timer id is not saved because this timer will never be canceled.
      */
-    if (tpoll_timeout_absolute (tp_global,
+    if (tpoll_timeout_absolute (conf->tp,
             (callback_f) timestamp_logfiles, conf, &tv) < 0) {
         log_err(0, "Unable to create timer for timestamping logfiles");
     }
@@ -599,77 +713,96 @@ static void schedule_timestamp(server_conf_t *conf)
 
 static void timestamp_logfiles(server_conf_t *conf)
 {
-/*  Writes a timestamp message into all of the console logfiles.
+/*  Sets the timestamp due to be written into the console logfiles (each of
+ *    which writes it upon its next console output), and schedules a timer
+ *    for the next timestamp.
  */
-    char *now;
-    ListIterator i;
-    obj_t *logfile;
-    char buf[MAX_LINE];
-    int gotLogs = 0;
+    set_log_timestamp(conf->tStampNext);
+    schedule_timestamp(conf);
+    return;
+}
 
-    now = create_long_time_string(0);
-    i = list_iterator_create(conf->objs);
-    while ((logfile = list_next(i))) {
-        if (!is_logfile_obj(logfile)) {
-            continue;
-        }
-        snprintf(buf, sizeof(buf), "%sConsole [%s] log at %s%s",
-            CONMAN_MSG_PREFIX, logfile->aux.logfile.console->name,
-            now, CONMAN_MSG_SUFFIX);
-        strcpy(&buf[sizeof(buf) - 3], "\r\n");
-        write_obj_data(logfile, buf, strlen(buf), 1);
-        gotLogs = 1;
-    }
-    list_iterator_destroy(i);
-    free(now);
 
-    /*  If any logfile objs exist, schedule a timer for the next timestamp.
-     */
-    if (gotLogs) {
-        schedule_timestamp(conf);
+static void create_listen_socket(server_conf_t *conf)
+{
+/*  Creates the socket on which to listen for client connections,
+ *    along with the socket for metrics requests if a metrics port is set.
+ */
+    conf->ld = open_listen_socket(conf, conf->port);
+
+    if (conf->metricsPort > 0) {
+        conf->metricsLd = open_listen_socket(conf, conf->metricsPort);
     }
     return;
 }
 
 
-static void create_listen_socket(server_conf_t *conf)
+static int open_listen_socket(server_conf_t *conf, int port)
 {
-/*  Creates the socket on which to listen for client connections.
+/*  Opens a socket listening for connections on (port).
+ *  Unless restricted to the loopback interface, a dual-stack IPv6 socket
+ *    is used so clients can connect over either IPv4 or IPv6; if IPv6 is
+ *    not supported by the host, an IPv4 socket is used instead.
+ *  Returns the listening socket descriptor.
  */
-    int ld;
-    struct sockaddr_in addr;
+    int ld = -1;
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+    struct sockaddr_in *sin;
+    struct sockaddr_in6 *sin6;
     const int on = 1;
+    const int off = 0;
+
+    memset(&addr, 0, sizeof(addr));
 
-    if ((ld = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
-        log_err(errno, "Unable to create listening socket");
+    if (!conf->enableLoopBack) {
+        if ((ld = socket(AF_INET6, SOCK_STREAM, 0)) >= 0) {
+            sin6 = (struct sockaddr_in6 *) &addr;
+            sin6->sin6_family = AF_INET6;
+            sin6->sin6_port = htons(port);
+            sin6->sin6_addr = in6addr_any;
+            addrlen = sizeof(*sin6);
+            if (setsockopt(ld, IPPROTO_IPV6, IPV6_V6ONLY,
+              (const void *) &off, sizeof(off)) < 0) {
+                log_msg(LOG_WARNING,
+                    "Unable to accept IPv4 clients on IPv6 socket: %s",
+                    strerror(errno));
+            }
+        }
+        else if ((errno != EAFNOSUPPORT) && (errno != EPROTONOSUPPORT)) {
+            log_err(errno, "Unable to create listening socket");
+        }
+    }
+    if (ld < 0) {
+        if ((ld = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+            log_err(errno, "Unable to create listening socket");
+        }
+        sin = (struct sockaddr_in *) &addr;
+        sin->sin_family = AF_INET;
+        sin->sin_port = htons(port);
+        if (conf->enableLoopBack) {
+            sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        }
+        else {
+            sin->sin_addr.s_addr = htonl(INADDR_ANY);
+        }
+        addrlen = sizeof(*sin);
     }
     DPRINTF((9, "Opened listen socket: fd=%d.\n", ld));
     set_fd_nonblocking(ld);
     set_fd_closed_on_exec(ld);
 
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(conf->port);
-
-    if (conf->enableLoopBack) {
-        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
-    }
-    else {
-        addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    }
     if (setsockopt(ld, SOL_SOCKET, SO_REUSEADDR,
       (const void *) &on, sizeof(on)) < 0) {
         log_err(errno, "Unable to set REUSEADDR socket option");
     }
-    if (bind(ld, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
-        log_err(errno, "Unable to bind to port %d", conf->port);
+    if (bind(ld, (struct sockaddr *) &addr, addrlen) < 0) {
+        log_err(errno, "Unable to bind to port %d", port);
     }
     if (listen(ld, 10) < 0) {
-        log_err(errno, "Unable to listen on port %d", conf->port);
+        log_err(errno, "Unable to listen on port %d", port);
     }
-    conf->ld = ld;
-    tpoll_set(conf->tp, conf->ld, POLLIN);
-    return;
+    return(ld);
 }
 
 
@@ -709,6 +842,12 @@ static void setup_nofile_limit(server_conf_t *conf)
 static void open_objs(server_conf_t *conf)
 {
 /*  Initially opens everything in the 'objs' list.
+ *  The objs are not opened here, but queued for their i/o threads to open
+ *    in batches of OBJ_OPEN_BATCH via open_pending_objs().  Since each batch
+ *    is opened from a timer, clients are accepted while the consoles are
+ *    still being brought up, and the i/o threads open their shards of the
+ *    consoles in parallel.  The logfiles of each thread are queued before
+ *    its consoles so console output is not held back waiting for them.
  *  A ptr to conf->resetCmd is copied into all console objs to avoid passing
  *    the resetCmd string as a global.  When the reset escape sequence is
  *    processed by process_client_escapes(), perform_reset() has a ptr to the
@@ -717,291 +856,1508 @@ static void open_objs(server_conf_t *conf)
  *  Setting resetCmdRef must occur after the entire config file has been parsed
  *    (in process_config()); the ResetCmd string might not yet have been
  *    specified when create_obj() initializes the obj members.
+ *  Likewise, the circular-buffer size of each console and logfile obj is set
+ *    here from the SERVER ConsoleBufSize and LogBufSize keywords.  The buffer
+ *    itself is not allocated until data is first written to the obj.
+ *    The read budget of each console obj is set from ReadBudget.
+ *  The devices of unix domain socket consoles are registered for inotify
+ *    events here rather than when their objs are created.
+ *  If a collector has been specified by the SERVER Forward keyword, the
+ *    forward obj is created here and linked as a reader of every console.
+ *    It remains with the main thread, and is opened immediately.
  *  This function is called once, performs a full traversal of the obj list,
  *    and allows resetCmdRef to be set before entering mux_io().
  */
     ListIterator i;
     obj_t *obj;
+    List objs;
+    int k;
 
+    for (k = 0; k < conf->numIOThreads; k++) {
+        ioThreads[k].pendingObjs = list_create(NULL);
+    }
+    objs = list_create(NULL);
     i = list_iterator_create(conf->objs);
+    while ((obj = list_next(i))) {
+        if (is_logfile_obj(obj)) {
+            obj->bufSize = conf->logBufSize;
+            list_append(objs, obj);
+        }
+    }
+    if (conf->forwardHost) {
+        conf->forwarder = create_forward_obj(conf, conf->forwardHost,
+            conf->forwardPort, conf->forwardSpoolName);
+    }
+    list_iterator_reset(i);
     while ((obj = list_next(i))) {
         if (is_console_obj(obj)) {
+            if (conf->forwarder) {
+                link_objs(obj, conf->forwarder);
+            }
             obj->resetCmdRef = conf->resetCmd;
+            obj->bufSize = conf->consoleBufSize;
+            obj->readBudget = conf->readBudget;
+            if (is_unixsock_obj(obj)) {
+                (void) watch_unixsock_obj(obj);
+            }
+            conf->numConsoleObjs++;
+            list_append(objs, obj);
         }
-        reopen_obj(obj);
     }
     list_iterator_destroy(i);
+
+    if (conf->forwarder) {
+        (void) open_forward_obj(conf->forwarder);
+    }
+    queue_pending_objs(conf, objs, conf->numConsoleObjs);
+    list_destroy(objs);
     return;
 }
 
 
-static void mux_io(server_conf_t *conf)
+static void queue_pending_objs(server_conf_t *conf, List objs, int n)
 {
-/*  Multiplexes I/O between all of the objs in the configuration.
- *  This routine is the heart of ConMan.
+/*  Queues the logfile and console objs in the 'objs' list (of which 'n' are
+ *    consoles) for their initial open by their i/o threads, emptying the list.
+ *  The time taken to open them is logged once no consoles remain pending,
+ *    including any queued by an earlier call that are still pending.
  */
-    ListIterator i;
-    int n;
     obj_t *obj;
-    int inevent_fd;
-    int rvr, rvw;
+    int k;
 
-    assert(conf->tp != NULL);
-    assert(!list_is_empty(conf->objs));
+    x_pthread_mutex_lock(&openLock);
+    if (conf->numOpenPending == 0) {
+        openTime = time(NULL);
+        openCount = 0;
+    }
+    openCount += n;
+    x_atomic_store(&conf->numOpenPending, conf->numOpenPending + n);
+    x_pthread_mutex_unlock(&openLock);
 
-    inevent_fd = inevent_get_fd();
-    if (inevent_fd >= 0) {
-        tpoll_set(conf->tp, inevent_get_fd(), POLLIN);
+    while ((obj = list_pop(objs))) {
+        if (is_console_obj(obj)) {
+            x_atomic_store(&obj->isOpenPending, 1);
+        }
+        list_append(get_io_thread(conf, obj)->pendingObjs, obj);
     }
-    i = list_iterator_create(conf->objs);
+    for (k = 0; k < conf->numIOThreads; k++) {
+        if (tpoll_timeout_relative(ioThreads[k].tp,
+                (callback_f) open_pending_objs, &ioThreads[k], 0) < 0) {
+            log_err(0, "Unable to create timer for opening objects");
+        }
+    }
+    return;
+}
 
-    while (!done) {
 
-        if (reconfig) {
-            /*
-             *  FIXME: A reconfig should pro'ly resurrect "downed" serial objs
-             *    and reset reconnect timers of "downed" telnet objs.
-             */
-            log_msg(LOG_NOTICE, "Performing reconfig on signal=%d", reconfig);
-            reopen_logfiles(conf);
-            reconfig = 0;
+static void open_pending_objs(io_thread_t *iot)
+{
+/*  Opens the next batch of objs awaiting their initial open by the i/o
+ *    thread 'iot', rescheduling itself until none remain.
+ *  The logfiles within a batch are opened before its consoles, and together
+ *    so their directories need only be checked once for each run of
+ *    logfiles sharing the same one.
+ *  The replay ring of a console is mapped just before the console is first
+ *    opened; it remains mapped across reconnects of the console.
+ */
+    server_conf_t *conf = iot->conf;
+    List logfiles;
+    List consoles;
+    obj_t *obj;
+    int n;
+    int numOpened = 0;
+    int secs;
+
+    logfiles = list_create(NULL);
+    consoles = list_create(NULL);
+    for (n = 0; n < OBJ_OPEN_BATCH; n++) {
+        if (!(obj = list_pop(iot->pendingObjs))) {
+            break;
         }
-        while ((n = tpoll(conf->tp, -1)) < 0) {
-            if (errno != EINTR) {
-                log_err(errno, "Unable to multiplex I/O");
-            }
-            else if (done || reconfig) {
-                break;
-            }
+        list_append(is_logfile_obj(obj) ? logfiles : consoles, obj);
+    }
+    open_logfile_objs(logfiles);
+    list_destroy(logfiles);
+
+    while ((obj = list_pop(consoles))) {
+        if (obj->ring) {
+            (void) open_replay_ring(obj);
         }
-        if ((n > 0) &&
-                (tpoll_is_set(conf->tp, conf->ld, POLLIN) > 0)) {
-            n--;
-            accept_client(conf);
-        }
-        if ((inevent_fd >= 0) &&
-                (n > 0) &&
-                (tpoll_is_set(conf->tp, inevent_fd, POLLIN) > 0)) {
-            n--;
-            inevent_process();
-        }
-        /*  If read_from_obj() or write_to_obj() returns -1,
-         *    the obj's buffer has been flushed.  If it is a console obj,
-         *    retain it and attempt to re-establish the connection;
-         *    o/w, give up and remove it from the master objs list.
-         */
-        list_iterator_reset(i);
-        while ((n > 0) &&
-                ((obj = list_next(i)) != NULL)) {
-
-            rvr = tpoll_is_set(conf->tp, obj->fd, POLLIN | POLLHUP | POLLERR);
-            rvw = tpoll_is_set(conf->tp, obj->fd, POLLOUT);
-            if ((rvr > 0) || (rvw > 0)) {
-                n--;
-            }
-            if ((rvr > 0) && (read_from_obj(obj) < 0)) {
-                list_delete(i);
-                continue;
-            }
-            if ((rvw > 0) && (write_to_obj(obj) < 0)) {
-                list_delete(i);
-                continue;
-            }
+        reopen_obj(obj);
+        x_atomic_store(&obj->isOpenPending, 0);
+        numOpened++;
+    }
+    list_destroy(consoles);
+
+    if (numOpened > 0) {
+        x_pthread_mutex_lock(&openLock);
+        n = conf->numOpenPending - numOpened;
+        x_atomic_store(&conf->numOpenPending, n);
+        if (n == 0) {
+            secs = (int) (time(NULL) - openTime);
+            log_msg(LOG_INFO, "Opened %d console%s in %d sec%s",
+                openCount, (openCount == 1) ? "" : "s",
+                secs, (secs == 1) ? "" : "s");
+        }
+        x_pthread_mutex_unlock(&openLock);
+    }
+    if (!list_is_empty(iot->pendingObjs)) {
+        if (tpoll_timeout_relative(iot->tp,
+                (callback_f) open_pending_objs, iot, 0) < 0) {
+            log_err(0, "Unable to create timer for opening objects");
         }
     }
-    log_msg(LOG_NOTICE, "Exiting on signal=%d", done);
-    list_iterator_destroy(i);
     return;
 }
 
 
-static void open_daemon_logfile(server_conf_t *conf)
+static io_thread_t * get_io_thread(server_conf_t *conf, obj_t *obj)
 {
-/*  (Re)opens the daemon logfile.
- *  Since this logfile can be re-opened after the daemon has chdir()'d,
- *    it must be specified with an absolute pathname.
+/*  Returns the i/o thread muxing the 'obj'.
  */
-    static int  once = 1;
-    const char *mode = "a";
-    mode_t      mask;
-    char        dirname[PATH_MAX];
-    FILE       *fp = NULL;
-    int         fd;
-
-    assert(conf->logFileName != NULL);
-    assert(conf->logFileName[0] == '/');
-    assert(!conf->enableForeground);
+    int k;
 
-    /*  Only truncate logfile at startup if needed.
-     */
-    if (once) {
-        if (conf->enableZeroLogs) {
-            mode = "w";
+    for (k = 0; k < conf->numIOThreads; k++) {
+        if (ioThreads[k].tp == obj->tp) {
+            return(&ioThreads[k]);
         }
-        once = 0;
     }
-    /*  Perform conversion specifier expansion.
-     */
-    if (conf->logFmtName) {
+    log_err(0, "INTERNAL: Object [%s] not assigned to an I/O thread",
+        obj->name);
+    return(NULL);
+}
 
-        char buf[MAX_LINE];
 
-        if (format_obj_string(buf, sizeof(buf), NULL, conf->logFmtName) < 0) {
-            log_msg(LOG_WARNING,
-                "Unable to open daemon logfile: filename too long");
-            goto err;
+static void assign_io_threads(server_conf_t *conf)
+{
+/*  Creates the i/o threads' tpoll objs and distributes the console objs
+ *    across them in round-robin order.  Each logfile obj is assigned to the
+ *    same thread as its console so the links between them remain local.
+ *  If conf->numIOThreads is 0, one thread per online processor is used.
+ *    Regardless, the number of threads will not exceed the number of consoles.
+ *  Unix domain socket consoles remain with the main thread since they are
+ *    reopened via inotify events that are processed there.
+ *  This function must be called before the objs are opened in open_objs().
+ */
+    int numConsoles = 0;
+    int n;
+    int k;
+    ListIterator i;
+    obj_t *obj;
+
+    i = list_iterator_create(conf->objs);
+    while ((obj = list_next(i))) {
+        if (is_console_obj(obj)) {
+            numConsoles++;
         }
-        free(conf->logFileName);
-        conf->logFileName = create_string(buf);
     }
-    /*  Protect logfile against unauthorized writes by removing
-     *    group+other write-access from current mask.
-     */
-    mask = umask(0);
-    umask(mask | 022);
-    /*
-     *  Create intermediate directories.
-     */
-    if (get_dir_name(conf->logFileName, dirname, sizeof(dirname))) {
-        (void) create_dirs(dirname);
+    n = conf->numIOThreads;
+    if (n <= 0) {
+        n = (int) sysconf(_SC_NPROCESSORS_ONLN);
     }
-    /*  Open the logfile.
-     */
-    fp = fopen(conf->logFileName, mode);
-    umask(mask);
+    n = MAX(MIN(n, numConsoles), 1);
+    conf->numIOThreads = n;
 
-    if (!fp) {
-        log_msg(LOG_WARNING, "Unable to open daemon logfile \"%s\": %s",
-            conf->logFileName, strerror(errno));
-        goto err;
+    if (!(ioThreads = malloc(n * sizeof(io_thread_t)))) {
+        out_of_memory();
     }
-    if ((fd = fileno(fp)) < 0) {
-        log_msg(LOG_WARNING,
-            "Unable to obtain descriptor for daemon logfile \"%s\": %s",
-            conf->logFileName, strerror(errno));
-        goto err;
+    numIOThreads = n;
+    for (k = 0; k < n; k++) {
+        ioThreads[k].conf = conf;
+        ioThreads[k].fdWake[0] = ioThreads[k].fdWake[1] = -1;
+        ioThreads[k].pendingObjs = NULL;
+        memset(&ioThreads[k].stats, 0, sizeof(ioThreads[k].stats));
+        if (k == 0) {
+            ioThreads[k].tp = conf->tp;
+        }
+        else if (!(ioThreads[k].tp = tpoll_create(0))) {
+            log_err(0, "Unable to create object for multiplexing I/O");
+        }
     }
-    if (get_write_lock(fd) < 0) {
-        log_msg(LOG_WARNING, "Unable to lock daemon logfile \"%s\"",
-            conf->logFileName);
-        goto err;
+    k = 0;
+    list_iterator_reset(i);
+    while ((obj = list_next(i))) {
+        if (is_console_obj(obj) && !is_unixsock_obj(obj)) {
+            obj->tp = ioThreads[k++ % n].tp;
+        }
     }
-    set_fd_closed_on_exec(fd);
-    /*
-     *  Transition to new log file.
-     */
-    log_set_file(fp, conf->logFileLevel, 1);
-    if (conf->logFilePtr) {
-        if (fclose(conf->logFilePtr) == EOF) {
-            log_msg(LOG_WARNING, "Unable to close daemon logfile \"%s\"",
-                conf->logFileName);
+    list_iterator_reset(i);
+    while ((obj = list_next(i))) {
+        if (is_logfile_obj(obj)) {
+            obj->tp = obj->aux.logfile.console->tp;
         }
     }
-    conf->logFilePtr = fp;
-    DPRINTF((9, "Opened logfile \"%s\": fd=%d.\n", conf->logFileName, fd));
+    list_iterator_destroy(i);
+
+    ioThreadNext = k % n;
+
+    log_msg(LOG_INFO, "Multiplexing I/O across %d thread%s",
+        n, (n == 1) ? "" : "s");
     return;
+}
 
-err:
-    if (fp) {
-        (void) fclose(fp);
+
+static void create_io_threads(server_conf_t *conf)
+{
+/*  Spawns the i/o threads other than the main thread (ioThreads[0]).
+ *  Asynchronous signals are blocked within these threads in order for them
+ *    to be delivered to the main thread where the signal flags are checked.
+ */
+    sigset_t sigsetOld;
+    int k;
+    int rc;
+
+    assert(ioThreads != NULL);
+
+    if (conf->numIOThreads <= 1) {
+        return;
     }
-    /*  Abandon old log file and go logless.
-     */
-    log_set_file(NULL, 0, 0);
-    if (conf->logFilePtr) {
-        if (fclose(conf->logFilePtr) == EOF) {
-            log_msg(LOG_WARNING, "Unable to close daemon logfile \"%s\"",
-                conf->logFileName);
+    block_signals(&sigsetOld);
+
+    for (k = 1; k < conf->numIOThreads; k++) {
+        if (pipe(ioThreads[k].fdWake) < 0) {
+            log_err(errno, "Unable to create pipe for I/O thread");
+        }
+        set_fd_nonblocking(ioThreads[k].fdWake[0]);
+        set_fd_closed_on_exec(ioThreads[k].fdWake[0]);
+        set_fd_closed_on_exec(ioThreads[k].fdWake[1]);
+        tpoll_set(ioThreads[k].tp, ioThreads[k].fdWake[0], POLLIN);
+
+        if ((rc = pthread_create(&ioThreads[k].tid, NULL,
+          (PthreadFunc) mux_io, &ioThreads[k])) != 0) {
+            log_err(rc, "Unable to create I/O thread");
         }
     }
-    conf->logFilePtr = NULL;
+    restore_signals(&sigsetOld);
     return;
 }
 
 
-static void reopen_logfiles(server_conf_t *conf)
+static void block_signals(sigset_t *sigsetOld)
 {
-/*  Reopens the daemon logfile and all of the logfiles in the 'objs' list.
+/*  Blocks asynchronous signals within the calling thread (and the threads
+ *    it subsequently creates), saving the previous signal mask in sigsetOld.
  */
-    ListIterator i;
-    obj_t *logfile;
+    sigset_t sigset;
+    int rc;
 
-    i = list_iterator_create(conf->objs);
-    while ((logfile = list_next(i))) {
-        if (!is_logfile_obj(logfile)) {
-            continue;
-        }
-        open_logfile_obj(logfile);
+    sigfillset(&sigset);
+    sigdelset(&sigset, SIGBUS);
+    sigdelset(&sigset, SIGFPE);
+    sigdelset(&sigset, SIGILL);
+    sigdelset(&sigset, SIGSEGV);
+    if ((rc = pthread_sigmask(SIG_SETMASK, &sigset, sigsetOld)) != 0) {
+        log_err(rc, "Unable to block signals");
     }
-    list_iterator_destroy(i);
+    return;
+}
 
-    if (conf->logFileName && !conf->enableForeground) {
-        open_daemon_logfile(conf);
+
+static void restore_signals(sigset_t *sigsetOld)
+{
+/*  Restores the signal mask saved by block_signals().
+ */
+    int rc;
+
+    if ((rc = pthread_sigmask(SIG_SETMASK, sigsetOld, NULL)) != 0) {
+        log_err(rc, "Unable to restore signal mask");
     }
     return;
 }
 
 
-static void accept_client(server_conf_t *conf)
+static void create_client_workers(server_conf_t *conf)
 {
-/*  Accepts a new client connection on the listening socket.
- *  The new socket connection must be accept()'d within the poll() loop.
- *    O/w, the following scenario could occur:  Read activity would be
- *    poll()'d on the listen socket.  A new thread would be created to
- *    process this request.  Before this new thread is scheduled and the
- *    socket connection is accept()'d, the poll() loop begins its next
- *    iteration.  It notices read activity on the listen socket from the
- *    client that has not yet been accepted, so a new thread is created.
- *    Since the listen socket is set non-blocking, this new thread would
- *    receive an EAGAIN/EWOULDBLOCK on the accept() and terminate, but still...
+/*  Spawns the client setup thread that polls the listening sockets,
+ *    along with the pools of detached worker threads that process the
+ *    requests of new client connections.  These threads are not joined
+ *    at exit since a worker may be blocked (for up to CLIENT_SETUP_TIMEOUT)
+ *    on a client.
  */
-    int sd;
-    const int on = 1;
-    client_arg_t *args;
-    int rc;
+    sigset_t sigsetOld;
     pthread_t tid;
+    int k;
+    int rc;
 
-    while ((sd = accept(conf->ld, NULL, NULL)) < 0) {
-        if (errno == EINTR) {
-            continue;
-        }
-        if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
-            return;
-        }
-        if (errno == ECONNABORTED) {
-            return;
-        }
-        log_err(errno, "Unable to accept new connection");
+    if (!(clientTp = tpoll_create(0))) {
+        log_err(0, "Unable to create object for multiplexing client setups");
+    }
+    tpoll_set(clientTp, conf->ld, POLLIN);
+    if (conf->metricsLd >= 0) {
+        tpoll_set(clientTp, conf->metricsLd, POLLIN);
     }
-    DPRINTF((5, "Accepted new client on fd=%d.\n", sd));
+    block_signals(&sigsetOld);
 
-    /*  While the listen fd is non-blocking, new fds that are accept()d from
-     *    it can be either blocking or non-blocking depending on the platform.
-     *  The current model spawns a thread to handle a new client with
-     *    blocking I/O.  Once the client request has been processed,
-     *    this fd is set non-blocking and moved to the main fd set.
-     *  Consequently, we force the new fd to be blocking here for portability.
-     */
-    set_fd_blocking(sd);
+    if ((rc = pthread_create(&tid, NULL,
+      (PthreadFunc) process_client_setups, conf)) != 0) {
+        log_err(rc, "Unable to create client setup thread");
+    }
+    x_pthread_detach(tid);
 
-    if (conf->enableKeepAlive) {
-        if (setsockopt(sd, SOL_SOCKET, SO_KEEPALIVE,
-          (const void *) &on, sizeof(on)) < 0) {
-            log_err(errno, "Unable to set KEEPALIVE socket option");
+    for (k = 0; k < CLIENT_WORKERS; k++) {
+        if ((rc = pthread_create(&tid, NULL,
+          (PthreadFunc) process_client_queue, &clientQueue)) != 0) {
+            log_err(rc, "Unable to create client worker thread");
         }
+        x_pthread_detach(tid);
     }
-    /*  Create a tmp struct to hold two args to pass to the thread.
-     *  Note that the thread is responsible for freeing this memory.
-     */
-    if (!(args = malloc(sizeof(client_arg_t)))) {
-        out_of_memory();
+    for (k = 0; k < CLIENT_BULK_WORKERS; k++) {
+        if ((rc = pthread_create(&tid, NULL,
+          (PthreadFunc) process_client_queue, &bulkQueue)) != 0) {
+            log_err(rc, "Unable to create client bulk worker thread");
+        }
+        x_pthread_detach(tid);
     }
-    args->sd = sd;
-    args->conf = conf;
+    restore_signals(&sigsetOld);
+    return;
+}
 
-    if ((rc = pthread_create(&tid, NULL,
-      (PthreadFunc) process_client, args)) != 0) {
-        log_err(rc, "Unable to create new thread");
+
+static void create_log_writers(void)
+{
+/*  Spawns the pool of detached log writer threads that write logfile data
+ *    out to storage on behalf of the i/o threads, along with the thread
+ *    that gzips logfiles rotated with rotatecompress.
+ */
+    sigset_t sigsetOld;
+    pthread_t tid;
+    int k;
+    int rc;
+
+    block_signals(&sigsetOld);
+
+    for (k = 0; k < LOG_WRITERS; k++) {
+        if ((rc = pthread_create(&tid, NULL, process_log_writes, NULL)) != 0) {
+            log_err(rc, "Unable to create log writer thread");
+        }
+        x_pthread_detach(tid);
     }
+#if WITH_ZLIB
+    if ((rc = pthread_create(&tid, NULL, process_log_rotations, NULL)) != 0) {
+        log_err(rc, "Unable to create log rotation thread");
+    }
+    x_pthread_detach(tid);
+#endif /* WITH_ZLIB */
+    restore_signals(&sigsetOld);
     return;
 }
+
+
+static void * process_client_setups(server_conf_t *conf)
+{
+/*  The client setup thread loop.  Accepts new client connections and
+ *    receives each handshake as its data arrives, queueing the connection
+ *    for a worker once its request has been received.
+ *  XXX: The clientTp timers & fds must only be managed by this thread
+ *    (aside from release_client() re-enabling the listening sockets).
+ */
+    tpoll_event_t events[MUX_IO_MAX_EVENTS];
+    client_setup_t *cs;
+    int n;
+    int j;
+    int rc;
+
+    for (;;) {
+        while ((n = tpoll_wait(clientTp, events, MUX_IO_MAX_EVENTS, -1)) < 0) {
+            if (errno != EINTR) {
+                log_err(errno, "Unable to multiplex client setups");
+            }
+        }
+        for (j = 0; j < n; j++) {
+
+            if ((events[j].fd == conf->ld)
+                    || (events[j].fd == conf->metricsLd)) {
+                if (events[j].revents & POLLIN) {
+                    accept_client(conf, events[j].fd);
+                }
+                continue;
+            }
+            cs = events[j].arg;
+            if ((cs == NULL) || (cs->sd != events[j].fd)) {
+                continue;
+            }
+            if ((rc = read_client_setup(cs)) == 0) {
+                continue;
+            }
+            (void) tpoll_timeout_cancel(clientTp, cs->timer);
+            cs->timer = -1;
+            tpoll_clear(clientTp, cs->sd, POLLIN);
+
+            if (rc > 0) {
+                queue_client_setup(cs);
+            }
+            else {
+                destroy_client_setup(cs);
+                release_client(conf);
+            }
+        }
+    }
+    return(NULL);
+}
+
+
+static void expire_client_setup(client_setup_t *cs)
+{
+/*  Gives up on the client connection (cs) whose request has not been
+ *    received within CLIENT_SETUP_TIMEOUT seconds of being accepted.
+ *  This is called by the client setup thread via a clientTp timer.
+ */
+    server_conf_t *conf = cs->conf;
+
+    cs->timer = -1;
+    if (cs->req) {
+        log_msg(LOG_NOTICE, "Timed out awaiting request from <%s:%d>",
+            cs->req->fqdn, cs->req->port);
+    }
+    else {
+        DPRINTF((5, "Timed out awaiting metrics request.\n"));
+    }
+    tpoll_clear(clientTp, cs->sd, POLLIN);
+    destroy_client_setup(cs);
+    release_client(conf);
+    return;
+}
+
+
+static void queue_client_setup(client_setup_t *cs)
+{
+/*  Queues the client connection (cs) whose request has been received
+ *    for processing by a worker, or by a bulk worker if its request
+ *    can keep the worker busy for a while.
+ */
+    client_queue_t *q;
+
+    q = is_bulk_client_setup(cs) ? &bulkQueue : &clientQueue;
+
+    x_pthread_mutex_lock(&clientLock);
+    assert(q->count < CLIENT_QUEUE_MAX);
+    q->setups[(q->head + q->count) % CLIENT_QUEUE_MAX] = cs;
+    q->count++;
+    if ((errno = pthread_cond_signal(&q->cond)) != 0) {
+        log_err(errno, "pthread_cond_signal() failed");
+    }
+    x_pthread_mutex_unlock(&clientLock);
+    return;
+}
+
+
+static void * process_client_queue(client_queue_t *q)
+{
+/*  The client worker thread loop.  Processes each client connection
+ *    from the queue (q) in turn.
+ */
+    client_setup_t *cs;
+    server_conf_t *conf;
+
+    for (;;) {
+        x_pthread_mutex_lock(&clientLock);
+        while (q->count == 0) {
+            if ((errno = pthread_cond_wait(&q->cond, &clientLock)) != 0) {
+                log_err(errno, "pthread_cond_wait() failed");
+            }
+        }
+        cs = q->setups[q->head];
+        q->head = (q->head + 1) % CLIENT_QUEUE_MAX;
+        q->count--;
+        x_pthread_mutex_unlock(&clientLock);
+
+        conf = cs->conf;
+        if (cs->req) {
+            process_client(conf, cs);
+        }
+        else {
+            process_metrics(conf, cs->sd, cs->httpReq);
+            cs->sd = -1;
+        }
+        destroy_client_setup(cs);
+        release_client(conf);
+    }
+    return(NULL);
+}
+
+
+static void release_client(server_conf_t *conf)
+{
+/*  Releases the slot held by a client connection that has finished being
+ *    set up or processed.  If all CLIENT_QUEUE_MAX slots had been in use,
+ *    the listening sockets are polled again now that there is room for
+ *    another connection.
+ */
+    x_pthread_mutex_lock(&clientLock);
+    if (clientCount-- == CLIENT_QUEUE_MAX) {
+        tpoll_set(clientTp, conf->ld, POLLIN);
+        if (conf->metricsLd >= 0) {
+            tpoll_set(clientTp, conf->metricsLd, POLLIN);
+        }
+    }
+    x_pthread_mutex_unlock(&clientLock);
+    return;
+}
+
+
+static void stop_io_threads(server_conf_t *conf)
+{
+/*  Wakes the i/o threads other than the main thread and waits for them
+ *    to exit.  The 'done' flag must already be set.
+ */
+    int k;
+    int rc;
+
+    assert(done);
+
+    for (k = 1; k < conf->numIOThreads; k++) {
+        if (write(ioThreads[k].fdWake[1], "", 1) < 0) {
+            log_msg(LOG_WARNING, "Unable to wake I/O thread: %s",
+                strerror(errno));
+        }
+    }
+    for (k = 1; k < conf->numIOThreads; k++) {
+        if ((rc = pthread_join(ioThreads[k].tid, NULL)) != 0) {
+            log_err(rc, "Unable to join I/O thread");
+        }
+    }
+    return;
+}
+
+
+static void destroy_io_threads(void)
+{
+/*  Destroys the resources of the i/o threads other than the main thread.
+ *  This function must be called after all of the objs have been destroyed
+ *    since each obj's fd is cleared from its thread's tpoll obj.
+ *  The main thread's tpoll obj is destroyed along with the conf, so the
+ *    number of threads cannot be taken from the conf here.
+ */
+    int k;
+    int j;
+    int n;
+
+    if (!ioThreads) {
+        return;
+    }
+    n = numIOThreads;
+    for (k = 0; k < n; k++) {
+        if (ioThreads[k].pendingObjs) {
+            list_destroy(ioThreads[k].pendingObjs);
+        }
+    }
+    for (k = 1; k < n; k++) {
+        for (j = 0; j < 2; j++) {
+            if (ioThreads[k].fdWake[j] >= 0) {
+                (void) close(ioThreads[k].fdWake[j]);
+            }
+        }
+        tpoll_destroy(ioThreads[k].tp);
+    }
+    free(ioThreads);
+    ioThreads = NULL;
+    return;
+}
+
+
+static void * mux_io(io_thread_t *iot)
+{
+/*  Multiplexes I/O between all of the objs assigned to the i/o thread 'iot'.
+ *  This routine is the heart of ConMan.
+ *  Only the objs that are ready for I/O are visited on each wakeup;
+ *    each is returned by tpoll_wait() via the arg given to tpoll_set_arg().
+ *  The main thread additionally processes inotify events and performs
+ *    reconfigs.
+ */
+    server_conf_t *conf = iot->conf;
+    tpoll_event_t events[MUX_IO_MAX_EVENTS];
+    int is_main;
+    int n;
+    int j;
+    obj_t *obj;
+    int inevent_fd = -1;
+    int rvr, rvw;
+    struct timeval t0;
+
+    assert(iot->tp != NULL);
+    assert(!list_is_empty(conf->objs));
+
+    set_obj_io_thread(iot->tp);
+
+    is_main = (iot->tp == conf->tp);
+    if (is_main) {
+        inevent_fd = inevent_get_fd();
+        if (inevent_fd >= 0) {
+            tpoll_set(iot->tp, inevent_fd, POLLIN);
+        }
+    }
+    while (!done) {
+
+        if (is_main && reconfig) {
+            /*
+             *  FIXME: A reconfig should pro'ly resurrect "downed" serial objs
+             *    and reset reconnect timers of "downed" telnet objs.
+             */
+            log_msg(LOG_NOTICE, "Performing reconfig on signal=%d", reconfig);
+            reopen_logfiles(conf);
+            reconfig_objs(conf);
+            reconfig = 0;
+        }
+        while ((n = tpoll_wait(iot->tp, events, MUX_IO_MAX_EVENTS, -1)) < 0) {
+            if (errno != EINTR) {
+                log_err(errno, "Unable to multiplex I/O");
+            }
+            else if (done || reconfig) {
+                break;
+            }
+        }
+        if ((n > 0) && (gettimeofday(&t0, NULL) < 0)) {
+            log_err(errno, "gettimeofday() failed");
+        }
+        for (j = 0; j < n; j++) {
+
+            if ((inevent_fd >= 0) && (events[j].fd == inevent_fd)) {
+                if (events[j].revents & POLLIN) {
+                    inevent_process();
+                }
+                continue;
+            }
+            if ((iot->fdWake[0] >= 0) && (events[j].fd == iot->fdWake[0])) {
+                continue;
+            }
+            /*  Skip the event if the obj has since changed its fd.
+             */
+            obj = events[j].arg;
+            if ((obj == NULL) || (obj->fd != events[j].fd)) {
+                continue;
+            }
+            rvr = events[j].revents & (POLLIN | POLLHUP | POLLERR);
+            rvw = events[j].revents & POLLOUT;
+            /*
+             *  If read_from_obj() or write_to_obj() returns -1,
+             *    the obj's buffer has been flushed.  If it is a console obj,
+             *    retain it and attempt to re-establish the connection;
+             *    o/w, give up and remove it from the master objs list.
+             */
+            if (rvr && (read_from_obj(obj) < 0)) {
+                retire_obj(conf, obj);
+                continue;
+            }
+            if (rvw && (write_to_obj(obj) < 0)) {
+                retire_obj(conf, obj);
+                continue;
+            }
+        }
+        if (n > 0) {
+            update_io_stats(iot, n, &t0);
+        }
+    }
+    if (is_main) {
+        log_msg(LOG_NOTICE, "Exiting on signal=%d", done);
+    }
+    return(NULL);
+}
+
+
+static void update_io_stats(io_thread_t *iot, int n, struct timeval *t0)
+{
+/*  Updates the performance counters of the i/o thread 'iot' after it has
+ *    handled (n) ready fds in a wakeup that began processing at time (t0).
+ *  The counters are only written by the i/o thread itself.
+ */
+    struct timeval t1;
+    long usecs;
+
+    if (gettimeofday(&t1, NULL) < 0) {
+        log_err(errno, "gettimeofday() failed");
+    }
+    usecs = ((t1.tv_sec - t0->tv_sec) * 1000000)
+        + (t1.tv_usec - t0->tv_usec);
+    if (usecs < 0) {
+        usecs = 0;                      /* clock stepped backwards */
+    }
+    x_counter_add(&iot->stats.numWakeups, 1);
+    x_counter_add(&iot->stats.numReadyFds, n);
+    x_counter_add(&iot->stats.usecsBusy, usecs);
+    if ((unsigned long) usecs > x_counter_load(&iot->stats.usecsBusyMax)) {
+        x_counter_store(&iot->stats.usecsBusyMax, usecs);
+    }
+    return;
+}
+
+
+int get_io_thread_stats(int n, io_stats_t *stats)
+{
+/*  Copies the performance counters of i/o thread (n) into (stats),
+ *    including the timer dispatch stats of its tpoll obj.
+ *  Returns 0 on success, or -1 if there is no i/o thread (n).
+ */
+    io_thread_t *iot;
+
+    assert(stats != NULL);
+
+    if (!ioThreads || (n < 0) || (n >= numIOThreads)) {
+        return(-1);
+    }
+    iot = &ioThreads[n];
+    stats->numWakeups = x_counter_load(&iot->stats.numWakeups);
+    stats->numReadyFds = x_counter_load(&iot->stats.numReadyFds);
+    stats->usecsBusy = x_counter_load(&iot->stats.usecsBusy);
+    stats->usecsBusyMax = x_counter_load(&iot->stats.usecsBusyMax);
+    if (tpoll_get_stats(iot->tp, &stats->timers) < 0) {
+        memset(&stats->timers, 0, sizeof(stats->timers));
+    }
+    return(0);
+}
+
+
+static void reconfig_objs(server_conf_t *conf)
+{
+/*  Re-reads the config file and applies the changes to its consoles:
+ *    consoles no longer defined are removed, new consoles are added, and
+ *    consoles whose definitions have changed (including those of their
+ *    logfiles) are replaced.  All other consoles are left untouched along
+ *    with their clients and buffers.
+ *  Nothing is changed if the config contains any errors or no longer defines
+ *    any consoles, so a typo or a partially-written file cannot remove
+ *    consoles that are working.
+ *  SERVER directives are not re-applied; they only take effect on restart.
+ *    Neither are changes to IPMI consoles since the ipmiconsole engine is
+ *    sized at startup.
+ *  New consoles are queued to be opened by their i/o threads much as they
+ *    are at startup.  A changed console remains with the i/o thread of the
+ *    console it replaces so the old one is closed before the new one opens.
+ *
+ *  XXX: This routine must only be called by the main thread.
+ */
+    server_conf_t *new;
+    ListIterator i;
+    obj_t *obj;
+    obj_t *old;
+    obj_t *console;
+    List objs;
+    int numNew = 0;
+    int numAdded = 0;
+    int numChanged = 0;
+    int numRemoved = 0;
+
+    if (!(new = reread_config(conf))) {
+        return;
+    }
+    i = list_iterator_create(new->objs);
+    while ((obj = list_next(i))) {
+        if (is_console_obj(obj)) {
+            numNew++;
+        }
+    }
+    list_iterator_destroy(i);
+
+    if (new->numConfErrors > 0) {
+        log_msg(LOG_ERR, "Ignored reconfig since \"%s\" has %d error%s",
+            new->confFileName, new->numConfErrors,
+            (new->numConfErrors == 1) ? "" : "s");
+        destroy_server_conf(new);
+        return;
+    }
+    if (numNew == 0) {
+        log_msg(LOG_ERR, "Ignored reconfig since \"%s\" has no consoles",
+            new->confFileName);
+        destroy_server_conf(new);
+        return;
+    }
+    /*  Remove the running consoles that are no longer defined or have changed.
+     *    These must be removed from the indexes before the new consoles are
+     *    added since a changed console is replaced by one of the same name.
+     */
+    objs = list_create(NULL);
+    i = list_iterator_create(conf->objs);
+    while ((old = list_next(i))) {
+        if (!is_console_obj(old) || old->isRemoved) {
+            continue;
+        }
+        obj = find_obj_index(new->consoleIndex, old->name,
+            CONMAN_OBJ_IS_CONSOLE);
+        if (obj && !is_console_changed(old, obj)) {
+            continue;
+        }
+        if (is_ipmi_obj(old) || (obj && is_ipmi_obj(obj))) {
+            log_msg(LOG_WARNING,
+                "Console [%s] not reconfigured: IPMI changes require restart",
+                old->name);
+            continue;
+        }
+        if (obj) {
+            /*
+             *  Mark the new console as pending, and have it replace the old
+             *    one on the same i/o thread.
+             */
+            obj->isOpenPending = 1;
+            obj->tp = old->tp;
+            log_msg(LOG_INFO, "Console [%s] changed", old->name);
+            numChanged++;
+        }
+        else {
+            log_msg(LOG_INFO, "Console [%s] removed", old->name);
+            numRemoved++;
+        }
+        list_append(objs, old);
+    }
+    list_iterator_destroy(i);
+
+    while ((old = list_pop(objs))) {
+        remove_console_obj(conf, old);
+    }
+    /*  Mark the consoles that are not yet running as pending, and distribute
+     *    them across the i/o threads as done by assign_io_threads().
+     */
+    i = list_iterator_create(new->objs);
+    while ((obj = list_next(i))) {
+        if (!is_console_obj(obj) || obj->isOpenPending) {
+            continue;
+        }
+        if (find_obj_index(conf->consoleIndex, obj->name,
+                CONMAN_OBJ_IS_CONSOLE)) {
+            continue;
+        }
+        if (is_ipmi_obj(obj)) {
+            log_msg(LOG_WARNING,
+                "Console [%s] not added: IPMI changes require restart",
+                obj->name);
+            continue;
+        }
+        obj->isOpenPending = 1;
+        if (is_unixsock_obj(obj)) {
+            obj->tp = conf->tp;
+        }
+        else {
+            obj->tp = ioThreads[ioThreadNext].tp;
+            ioThreadNext = (ioThreadNext + 1) % conf->numIOThreads;
+        }
+        log_msg(LOG_INFO, "Console [%s] added", obj->name);
+        numAdded++;
+    }
+    /*  Move the pending consoles and their logfiles into the running conf.
+     *    The new conf retains (and destroys) the objs that are unchanged.
+     */
+    list_iterator_reset(i);
+    while ((obj = list_next(i))) {
+        console = is_logfile_obj(obj) ? obj->aux.logfile.console : obj;
+        if (!is_console_obj(console) || !console->isOpenPending) {
+            continue;
+        }
+        (void) list_remove(i);
+        adopt_obj(conf, obj);
+        list_append(objs, obj);
+    }
+    list_iterator_destroy(i);
+
+    x_pthread_mutex_lock(&openLock);
+    conf->numConsoleObjs += numAdded - numRemoved;
+    x_pthread_mutex_unlock(&openLock);
+
+    queue_pending_objs(conf, objs, numAdded + numChanged);
+    list_destroy(objs);
+    destroy_server_conf(new);
+
+    log_msg(LOG_NOTICE, "Reconfigured consoles: %d added, %d changed, "
+        "%d removed, %d unchanged", numAdded, numChanged, numRemoved,
+        numNew - numAdded - numChanged);
+    return;
+}
+
+
+static int is_console_changed(obj_t *old, obj_t *new)
+{
+/*  Returns true if the definition of the 'new' console (including that of
+ *    its logfile and replay ring) differs from that of the running 'old'
+ *    console.
+ */
+    unsigned type = CONMAN_OBJ_LOGFILE;
+    char **p;
+    char **q;
+    seropt_t *s;
+    seropt_t *t;
+
+    assert(is_console_obj(old));
+    assert(is_console_obj(new));
+
+    if (old->type != new->type) {
+        return(1);
+    }
+    switch(old->type) {
+    case CONMAN_OBJ_PROCESS:
+        p = old->aux.process.argv;
+        q = new->aux.process.argv;
+        while (*p && *q && !strcmp(*p, *q)) {
+            p++;
+            q++;
+        }
+        if (*p || *q) {
+            return(1);
+        }
+        break;
+    case CONMAN_OBJ_SERIAL:
+        s = &old->aux.serial.opts;
+        t = &new->aux.serial.opts;
+        if (strcmp(old->aux.serial.dev, new->aux.serial.dev)
+          || (s->bps != t->bps) || (s->baud != t->baud)
+          || (s->databits != t->databits) || (s->parity != t->parity)
+          || (s->stopbits != t->stopbits)
+          || (s->lowLatency != t->lowLatency)) {
+            return(1);
+        }
+        break;
+    case CONMAN_OBJ_TELNET:
+        if (strcmp(old->aux.telnet.host, new->aux.telnet.host)
+          || (old->aux.telnet.port != new->aux.telnet.port)) {
+            return(1);
+        }
+        break;
+    case CONMAN_OBJ_UNIXSOCK:
+        if (strcmp(old->aux.unixsock.dev, new->aux.unixsock.dev)) {
+            return(1);
+        }
+        break;
+#if WITH_FREEIPMI
+    case CONMAN_OBJ_IPMI:
+        if (strcmp(old->aux.ipmi.host, new->aux.ipmi.host)
+          || strcmp(old->aux.ipmi.iconf.username,
+                new->aux.ipmi.iconf.username)
+          || strcmp(old->aux.ipmi.iconf.password,
+                new->aux.ipmi.iconf.password)
+          || (old->aux.ipmi.iconf.kgLen != new->aux.ipmi.iconf.kgLen)
+          || memcmp(old->aux.ipmi.iconf.kg, new->aux.ipmi.iconf.kg,
+                old->aux.ipmi.iconf.kgLen)
+          || (old->aux.ipmi.iconf.privilegeLevel !=
+                new->aux.ipmi.iconf.privilegeLevel)
+          || (old->aux.ipmi.iconf.cipherSuite !=
+                new->aux.ipmi.iconf.cipherSuite)
+          || (old->aux.ipmi.iconf.workaroundFlags !=
+                new->aux.ipmi.iconf.workaroundFlags)) {
+            return(1);
+        }
+        break;
+#endif /* WITH_FREEIPMI */
+    case CONMAN_OBJ_TEST:
+        if ((old->aux.test.opts.numBytes != new->aux.test.opts.numBytes)
+          || (old->aux.test.opts.msecMax != new->aux.test.opts.msecMax)
+          || (old->aux.test.opts.msecMin != new->aux.test.opts.msecMin)
+          || (old->aux.test.opts.probability !=
+                new->aux.test.opts.probability)
+          || (old->aux.test.opts.rate != new->aux.test.opts.rate)
+          || (old->aux.test.opts.format != new->aux.test.opts.format)) {
+            return(1);
+        }
+        break;
+    default:
+        log_err(0, "INTERNAL: Unrecognized console [%s] type=%d",
+            old->name, old->type);
+        break;
+    }
+    if (is_replay_ring_changed(old->ring, new->ring)) {
+        return(1);
+    }
+    return(is_logfile_changed(
+        list_find_first(old->readers, (ListFindF) find_obj_type, &type),
+        list_find_first(new->readers, (ListFindF) find_obj_type, &type)));
+}
+
+
+static int is_logfile_changed(obj_t *old, obj_t *new)
+{
+/*  Returns true if the definition of the 'new' logfile differs from that of
+ *    the running 'old' logfile, where either may be NULL if not logging.
+ */
+    logopt_t *p;
+    logopt_t *q;
+
+    if (!old || !new) {
+        return(old != new);
+    }
+    if (strcmp(get_logfile_key(old), get_logfile_key(new))) {
+        return(1);
+    }
+    p = &old->aux.logfile.opts;
+    q = &new->aux.logfile.opts;
+    return((p->enableCompress != q->enableCompress)
+        || (p->enableLock != q->enableLock)
+        || (p->enableRotateZip != q->enableRotateZip)
+        || (p->enableSanitize != q->enableSanitize)
+        || (p->enableTimestamp != q->enableTimestamp)
+        || (p->rotateSize != q->rotateSize)
+        || (p->rotateAge != q->rotateAge)
+        || (p->rotateCount != q->rotateCount)
+        || (p->coalesceMsecs != q->coalesceMsecs)
+        || (p->coalesceSize != q->coalesceSize));
+}
+
+
+static const char * get_logfile_key(obj_t *logfile)
+{
+/*  Returns the name under which the 'logfile' obj was indexed when created.
+ *    The name of a logfile with conversion specifiers is expanded whenever
+ *    it is opened, but the unexpanded name is retained in its fmtName.
+ */
+    assert(is_logfile_obj(logfile));
+
+    if (logfile->aux.logfile.fmtName) {
+        return(logfile->aux.logfile.fmtName);
+    }
+    return(logfile->name);
+}
+
+
+static int find_obj_type(obj_t *obj, unsigned *type)
+{
+/*  List helper function returning true if the 'obj' matches the obj type
+ *    mask 'type'.
+ */
+    return(!!(obj->type & *type));
+}
+
+
+static void adopt_obj(server_conf_t *conf, obj_t *obj)
+{
+/*  Adds the 'obj' (a console or logfile) created by re-reading the config
+ *    to the running 'conf' as done for the objs created at startup by
+ *    process_config() and open_objs().  The i/o thread of a console obj
+ *    must have already been assigned.
+ */
+    if (is_logfile_obj(obj)) {
+        obj->tp = obj->aux.logfile.console->tp;
+        obj->bufSize = conf->logBufSize;
+        list_prepend(conf->objs, obj);
+        insert_obj_index(conf->logfileIndex, get_logfile_key(obj), obj);
+        return;
+    }
+    assert(is_console_obj(obj));
+    obj->resetCmdRef = conf->resetCmd;
+    obj->bufSize = conf->consoleBufSize;
+    obj->readBudget = conf->readBudget;
+    list_append(conf->objs, obj);
+    insert_obj_index(conf->consoleIndex, obj->name, obj);
+
+    if (conf->forwarder) {
+        link_objs(obj, conf->forwarder);
+    }
+    if (is_serial_obj(obj)) {
+        insert_obj_index(conf->deviceIndex, obj->aux.serial.dev, obj);
+    }
+    else if (is_telnet_obj(obj)) {
+        obj->aux.telnet.enableKeepAlive = conf->enableKeepAlive;
+    }
+    else if (is_unixsock_obj(obj)) {
+        insert_obj_index(conf->deviceIndex, obj->aux.unixsock.dev, obj);
+        (void) watch_unixsock_obj(obj);
+    }
+    return;
+}
+
+
+static void remove_console_obj(server_conf_t *conf, obj_t *console)
+{
+/*  Removes the running 'console' obj (and its logfile) from the 'conf'
+ *    indexes so it can no longer be found by clients.  The console is then
+ *    closed by its own i/o thread via close_removed_obj().
+ */
+    removed_obj_t *removed;
+    unsigned type = CONMAN_OBJ_LOGFILE;
+
+    assert(is_console_obj(console));
+
+    if (!(removed = malloc(sizeof(removed_obj_t)))) {
+        out_of_memory();
+    }
+    removed->console = console;
+    removed->logfile = list_find_first(console->readers,
+        (ListFindF) find_obj_type, &type);
+
+    x_atomic_store(&console->isRemoved, 1);
+    remove_obj_index(conf->consoleIndex, console->name, console);
+
+    if (is_serial_obj(console)) {
+        remove_obj_index(conf->deviceIndex, console->aux.serial.dev, console);
+    }
+    else if (is_unixsock_obj(console)) {
+        remove_obj_index(conf->deviceIndex, console->aux.unixsock.dev,
+            console);
+        unwatch_unixsock_obj(console);
+    }
+    if (removed->logfile) {
+        remove_obj_index(conf->logfileIndex,
+            get_logfile_key(removed->logfile), removed->logfile);
+    }
+    if (tpoll_timeout_relative(console->tp,
+            (callback_f) close_removed_obj, removed, 0) < 0) {
+        log_err(0, "Unable to create timer for removing [%s]",
+            console->name);
+    }
+    return;
+}
+
+
+static void close_removed_obj(removed_obj_t *removed)
+{
+/*  Closes the console of the 'removed' obj and disconnects its clients,
+ *    and then schedules the console (and its logfile) to be retired.
+ *  If the console is still awaiting its initial open, it is dequeued.
+ *
+ *  XXX: This routine must only be called by the console obj's i/o thread.
+ */
+    server_conf_t *conf = ioThreads[0].conf;
+    obj_t *console = removed->console;
+    io_thread_t *iot;
+    obj_t *client;
+    unsigned type = CONMAN_OBJ_CLIENT;
+
+    if (x_atomic_load(&console->isOpenPending)) {
+        iot = get_io_thread(conf, console);
+        (void) list_delete_all(iot->pendingObjs, (ListFindF) find_obj,
+            console);
+        if (removed->logfile) {
+            (void) list_delete_all(iot->pendingObjs, (ListFindF) find_obj,
+                removed->logfile);
+        }
+        x_atomic_store(&console->isOpenPending, 0);
+
+        x_pthread_mutex_lock(&openLock);
+        x_atomic_store(&conf->numOpenPending, conf->numOpenPending - 1);
+        openCount--;
+        x_pthread_mutex_unlock(&openLock);
+    }
+    close_console_obj(console);
+    /*
+     *  Unmap the replay ring now since a changed console replacing this one
+     *    may open the same file as soon as this routine returns.
+     */
+    close_replay_ring(console);
+
+    write_notify_msg(console, LOG_INFO,
+        "Console [%s] closed for reconfig", console->name);
+
+    while ((client = list_peek(console->writers))) {
+        unlink_objs(client, console);
+    }
+    while ((client = list_find_first(console->readers,
+            (ListFindF) find_obj_type, &type))) {
+        unlink_objs(console, client);
+    }
+    if (tpoll_timeout_relative(console->tp, (callback_f) retire_removed_obj,
+            removed, OBJ_REMOVE_DELAY * 1000) < 0) {
+        log_err(0, "Unable to create timer for removing [%s]",
+            console->name);
+    }
+    return;
+}
+
+
+static void retire_removed_obj(removed_obj_t *removed)
+{
+/*  Retires the console of the 'removed' obj along with its logfile,
+ *    first unlinking any clients linked to the console in the meantime.
+ *
+ *  XXX: This routine must only be called by the console obj's i/o thread.
+ */
+    server_conf_t *conf = ioThreads[0].conf;
+
+    unlink_obj(removed->console);
+    if (removed->logfile) {
+        retire_obj(conf, removed->logfile);
+    }
+    retire_obj(conf, removed->console);
+    free(removed);
+    return;
+}
+
+
+static void retire_obj(server_conf_t *conf, obj_t *obj)
+{
+/*  Removes the 'obj' from the master objs list and destroys it.
+ *  If multiple i/o threads are running, another thread may still hold a ref
+ *    to the obj (eg, while notifying the writers of a console it muxes).
+ *    Destruction is therefore deferred until each i/o thread has dispatched
+ *    a release timer, at which point it can no longer be referencing an obj
+ *    that has already been removed from the objs list and unlinked.
+ */
+    ListIterator i;
+    retired_obj_t *retired;
+    int k;
+
+    i = list_iterator_create(conf->objs);
+    if (list_find(i, (ListFindF) find_obj, obj)) {
+        (void) list_remove(i);
+    }
+    list_iterator_destroy(i);
+
+    if (conf->numIOThreads <= 1) {
+        destroy_obj(obj);
+        return;
+    }
+    if (!(retired = malloc(sizeof(retired_obj_t)))) {
+        out_of_memory();
+    }
+    retired->obj = obj;
+    retired->numLeft = conf->numIOThreads;
+
+    for (k = 0; k < conf->numIOThreads; k++) {
+        if (tpoll_timeout_relative(ioThreads[k].tp,
+                (callback_f) release_retired_obj, retired, 0) < 0) {
+            log_err(0, "Unable to create timer for releasing [%s]",
+                obj->name);
+        }
+    }
+    return;
+}
+
+
+static void release_retired_obj(retired_obj_t *retired)
+{
+/*  Releases the calling i/o thread's ref to the 'retired' obj,
+ *    destroying the obj once it has been released by every i/o thread.
+ */
+    int n;
+
+    x_pthread_mutex_lock(&retiredLock);
+    n = --retired->numLeft;
+    x_pthread_mutex_unlock(&retiredLock);
+
+    if (n == 0) {
+        destroy_obj(retired->obj);
+        free(retired);
+    }
+    return;
+}
+
+
+static void open_daemon_logfile(server_conf_t *conf)
+{
+/*  (Re)opens the daemon logfile.
+ *  Since this logfile can be re-opened after the daemon has chdir()'d,
+ *    it must be specified with an absolute pathname.
+ */
+    static int  once = 1;
+    const char *mode = "a";
+    mode_t      mask;
+    char        dirname[PATH_MAX];
+    FILE       *fp = NULL;
+    int         fd;
+
+    assert(conf->logFileName != NULL);
+    assert(conf->logFileName[0] == '/');
+    assert(!conf->enableForeground);
+
+    /*  Only truncate logfile at startup if needed.
+     */
+    if (once) {
+        if (conf->enableZeroLogs) {
+            mode = "w";
+        }
+        once = 0;
+    }
+    /*  Perform conversion specifier expansion.
+     */
+    if (conf->logFmtName) {
+
+        char buf[MAX_LINE];
+
+        if (format_obj_string(buf, sizeof(buf), NULL, conf->logFmtName) < 0) {
+            log_msg(LOG_WARNING,
+                "Unable to open daemon logfile: filename too long");
+            goto err;
+        }
+        free(conf->logFileName);
+        conf->logFileName = create_string(buf);
+    }
+    /*  Protect logfile against unauthorized writes by removing
+     *    group+other write-access from current mask.
+     */
+    mask = umask(0);
+    umask(mask | 022);
+    /*
+     *  Create intermediate directories.
+     */
+    if (get_dir_name(conf->logFileName, dirname, sizeof(dirname))) {
+        (void) create_dirs(dirname);
+    }
+    /*  Open the logfile.
+     */
+    fp = fopen(conf->logFileName, mode);
+    umask(mask);
+
+    if (!fp) {
+        log_msg(LOG_WARNING, "Unable to open daemon logfile \"%s\": %s",
+            conf->logFileName, strerror(errno));
+        goto err;
+    }
+    if ((fd = fileno(fp)) < 0) {
+        log_msg(LOG_WARNING,
+            "Unable to obtain descriptor for daemon logfile \"%s\": %s",
+            conf->logFileName, strerror(errno));
+        goto err;
+    }
+    if (get_write_lock(fd) < 0) {
+        log_msg(LOG_WARNING, "Unable to lock daemon logfile \"%s\"",
+            conf->logFileName);
+        goto err;
+    }
+    set_fd_closed_on_exec(fd);
+    /*
+     *  Transition to new log file.
+     */
+    log_set_file(fp, conf->logFileLevel, 1);
+    if (conf->logFilePtr) {
+        if (fclose(conf->logFilePtr) == EOF) {
+            log_msg(LOG_WARNING, "Unable to close daemon logfile \"%s\"",
+                conf->logFileName);
+        }
+    }
+    conf->logFilePtr = fp;
+    DPRINTF((9, "Opened logfile \"%s\": fd=%d.\n", conf->logFileName, fd));
+    return;
+
+err:
+    if (fp) {
+        (void) fclose(fp);
+    }
+    /*  Abandon old log file and go logless.
+     */
+    log_set_file(NULL, 0, 0);
+    if (conf->logFilePtr) {
+        if (fclose(conf->logFilePtr) == EOF) {
+            log_msg(LOG_WARNING, "Unable to close daemon logfile \"%s\"",
+                conf->logFileName);
+        }
+    }
+    conf->logFilePtr = NULL;
+    return;
+}
+
+
+static void reopen_logfiles(server_conf_t *conf)
+{
+/*  Reopens the daemon logfile and all of the logfiles in the 'objs' list.
+ *  Each console logfile is reopened by the i/o thread to which it is
+ *    assigned; those of the other threads are deferred to an immediate timer.
+ */
+    int k;
+
+    for (k = 1; k < conf->numIOThreads; k++) {
+        if (tpoll_timeout_relative(ioThreads[k].tp, (callback_f)
+                reopen_io_thread_logfiles, &ioThreads[k], 0) < 0) {
+            log_msg(LOG_WARNING, "Unable to create timer for reopening logs");
+        }
+    }
+    reopen_io_thread_logfiles(&ioThreads[0]);
+
+    if (conf->logFileName && !conf->enableForeground) {
+        open_daemon_logfile(conf);
+    }
+    return;
+}
+
+
+static void reopen_io_thread_logfiles(io_thread_t *iot)
+{
+/*  Reopens the logfiles in the 'objs' list assigned to the i/o thread 'iot'.
+ */
+    ListIterator i;
+    obj_t *logfile;
+    List logfiles;
+
+    logfiles = list_create(NULL);
+    i = list_iterator_create(iot->conf->objs);
+    while ((logfile = list_next(i))) {
+        if (!is_logfile_obj(logfile) || (logfile->tp != iot->tp)) {
+            continue;
+        }
+        /*  Skip logfiles still awaiting their initial open, as well as those
+         *    of consoles removed by a reconfig.
+         */
+        if (x_atomic_load(&logfile->aux.logfile.console->isOpenPending)
+          || x_atomic_load(&logfile->aux.logfile.console->isRemoved)) {
+            continue;
+        }
+        list_append(logfiles, logfile);
+    }
+    list_iterator_destroy(i);
+    open_logfile_objs(logfiles);
+    list_destroy(logfiles);
+    return;
+}
+
+
+static void accept_client(server_conf_t *conf, int ld)
+{
+/*  Accepts new client connections on the listening socket (ld), polling
+ *    each for its handshake in the client setup thread.
+ *  Connections are accepted until either none remain or CLIENT_QUEUE_MAX
+ *    connections are in progress.  In the latter case, the listen sockets
+ *    are no longer polled until a worker releases a connection.
+ */
+    int sd;
+    const int on = 1;
+    struct timeval tv;
+    client_setup_t *cs;
+
+    for (;;) {
+        x_pthread_mutex_lock(&clientLock);
+        if (clientCount == CLIENT_QUEUE_MAX) {
+            tpoll_clear(clientTp, conf->ld, POLLIN);
+            if (conf->metricsLd >= 0) {
+                tpoll_clear(clientTp, conf->metricsLd, POLLIN);
+            }
+            x_pthread_mutex_unlock(&clientLock);
+            return;
+        }
+        x_pthread_mutex_unlock(&clientLock);
+
+        while ((sd = accept(ld, NULL, NULL)) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+                return;
+            }
+            if (errno == ECONNABORTED) {
+                return;
+            }
+            log_err(errno, "Unable to accept new connection");
+        }
+        DPRINTF((5, "Accepted new client on fd=%d.\n", sd));
+
+        /*  While the listen fd is non-blocking, new fds that are accept()d
+         *    from it can be either blocking or non-blocking depending on the
+         *    platform.  The handshake is received with non-blocking I/O.
+         *    A worker then processes the request with blocking I/O, after
+         *    which this fd is set non-blocking again and moved to an i/o
+         *    thread's fd set.
+         *  Timeouts are set on the fd so that a slow client cannot tie up
+         *    a worker indefinitely.
+         */
+        set_fd_nonblocking(sd);
+
+        tv.tv_sec = CLIENT_SETUP_TIMEOUT;
+        tv.tv_usec = 0;
+        if ((setsockopt(sd, SOL_SOCKET, SO_RCVTIMEO,
+              (const void *) &tv, sizeof(tv)) < 0)
+          || (setsockopt(sd, SOL_SOCKET, SO_SNDTIMEO,
+              (const void *) &tv, sizeof(tv)) < 0)) {
+            log_msg(LOG_WARNING, "Unable to set timeout socket options: %s",
+                strerror(errno));
+        }
+        if (conf->enableKeepAlive) {
+            if (setsockopt(sd, SOL_SOCKET, SO_KEEPALIVE,
+              (const void *) &on, sizeof(on)) < 0) {
+                log_err(errno, "Unable to set KEEPALIVE socket option");
+            }
+        }
+        x_pthread_mutex_lock(&clientLock);
+        clientCount++;
+        PROBE2(client_accept, sd, clientCount);
+        x_pthread_mutex_unlock(&clientLock);
+
+        cs = create_client_setup(conf, sd, (ld == conf->metricsLd));
+        cs->timer = tpoll_timeout_relative(clientTp,
+            (callback_f) expire_client_setup, cs,
+            CLIENT_SETUP_TIMEOUT * 1000);
+        if (cs->timer < 0) {
+            log_err(0, "Unable to create timer for client setup");
+        }
+        tpoll_set_arg(clientTp, sd, POLLIN, cs);
+    }
+}
@@ -37,6 +37,7 @@
 #include <netinet/in.h>                 /* for struct sockaddr_in            */
 #include <pthread.h>                    /* for pthread_mutex_t               */
 #include <stdio.h>                      /* for FILE                          */
+#include <sys/uio.h>                    /* for struct iovec                  */
 #include <termios.h>                    /* for struct termios, speed_t       */
 #include <time.h>                       /* for time_t                        */
 #include <unistd.h>                     /* for pid_t                         */
@@ -45,23 +46,98 @@
 #include "tpoll.h"
 
 
+#define CLIENT_BLOCK_MSECS              2000
+#define CLIENT_BULK_WORKERS             2
+#define CLIENT_QUEUE_MAX                256
+#define CLIENT_RESOLVE_TIMEOUT          2
+#define CLIENT_SETUP_TIMEOUT            10
+#define CLIENT_SPILL_MAX                (4 * 1024 * 1024)
+#define CLIENT_WORKERS                  8
+#define CLIENT_ZIP_LEVEL                1
+
+#define DEFAULT_LOGOPT_COALESCE_MSECS   0
+#define DEFAULT_LOGOPT_COALESCE_SIZE    (OBJ_BUF_SIZE / 2)
+#define DEFAULT_LOGOPT_COMPRESS         0
 #define DEFAULT_LOGOPT_LOCK             1
+#define DEFAULT_LOGOPT_ROTATE_AGE       0
+#define DEFAULT_LOGOPT_ROTATE_COMPRESS  0
+#define DEFAULT_LOGOPT_ROTATE_COUNT     4
+#define DEFAULT_LOGOPT_ROTATE_SIZE      0
 #define DEFAULT_LOGOPT_SANITIZE         0
 #define DEFAULT_LOGOPT_TIMESTAMP        0
 
+#define DEFAULT_REPLAY_SIZE             (1024 * 1024)
+
 #define DEFAULT_SEROPT_BPS              B9600
+#define DEFAULT_SEROPT_BAUD             9600
 #define DEFAULT_SEROPT_DATABITS         8
 #define DEFAULT_SEROPT_PARITY           0
 #define DEFAULT_SEROPT_STOPBITS         1
 
+#define FORWARD_BATCH_MSECS             250
+#define FORWARD_BATCH_SIZE              65536
+#define FORWARD_HDR_LEN                 12
+#define FORWARD_MAX_TIMEOUT             60
+#define FORWARD_MEM_MAX                 (4 * 1024 * 1024)
+#define FORWARD_MIN_TIMEOUT             1
+#define FORWARD_SPOOL_MAX               (256 * 1024 * 1024)
+#define FORWARD_WRITE_MAX               (1024 * 1024)
+
+#define LOG_COMPRESS_FRAME_SECS         60
+#define LOG_COMPRESS_FRAME_SIZE         (1024 * 1024)
+
+#define LOG_COALESCE_MSECS_MAX          60000
+
+#define LOG_FLUSH_WAIT_SECS             2
+
+#define LOG_INDEX_REC_LEN               26
+#define LOG_INDEX_SUFFIX                ".idx"
+
+#define LOG_ROTATE_COUNT_MAX            99
+#define LOG_ROTATE_RETRY_SECS           10
+
+#define LOG_SENDFILE_MAX                (1024 * 1024)
+
+#define LOG_WRITE_IOV_MAX               64
+#define LOG_WRITE_QUEUE_MAX             (1024 * 1024)
+#define LOG_WRITE_SLOW_MSECS            1000
+#define LOG_WRITERS                     2
+
 #define MIN_CONNECT_SECS                60
 
+#define MUX_IO_MAX_EVENTS               256
+
+#define OBJ_BUF_POOL_MAX                64
+#define OBJ_BUF_SIZE_MAX                (1024 * 1024)
+#define OBJ_BUF_SIZE_MIN                (OBJ_CHUNK_SIZE + MAX_LINE)
+
+#define OBJ_CHUNK_SIZE                  (OBJ_BUF_SIZE / 2)
+#define OBJ_CHUNK_MIN_SHARE             256
+#define OBJ_CHUNK_POOL_MAX              256
+#define OBJ_SEGS_MAX                    32
+#define OBJ_MUX_BUF_SIZE                ((OBJ_SEGS_MAX - 2) * OBJ_CHUNK_SIZE)
+
+#define OBJ_INDEX_MIN_BUCKETS           64
+
+#define OBJ_OPEN_BATCH                  16
+
+#define OBJ_OVERWRITE_NOTICE_SECS       10
+
+#define OBJ_READ_BUDGET                 65536
+#define OBJ_READ_IOV_MAX                8
+
+#define OBJ_REMOVE_DELAY                (CLIENT_SETUP_TIMEOUT * 3)
+
+#define REPLAY_SIZE_MAX                 (256 * 1024 * 1024)
+#define REPLAY_SIZE_MIN                 LOG_REPLAY_LEN
+
 #if WITH_FREEIPMI
 #define IPMI_ENGINE_CONSOLES_PER_THREAD 128
 #define IPMI_MAX_USER_LEN               IPMI_MAX_USER_NAME_LENGTH
 #define IPMI_MAX_PSWD_LEN               IPMI_2_0_MAX_PASSWORD_LENGTH
 #define IPMI_MAX_KG_LEN                 IPMI_MAX_K_G_LENGTH
 #define IPMI_CONNECT_TIMEOUT            300
+#define IPMI_DEFAULT_MAX_CONNECTS       64
 #define IPMI_MAX_TIMEOUT                1800
 #define IPMI_MIN_TIMEOUT                60
 #endif /* WITH_FREEIPMI */
@@ -69,6 +145,10 @@
 #define PROCESS_MAX_TIMEOUT             1800
 #define PROCESS_MIN_TIMEOUT             60
 
+#define RECONNECT_DEFAULT_MAX           256
+#define RECONNECT_DEFAULT_MAX_PER_HOST  8
+#define RECONNECT_JITTER_MSECS          1000
+
 #define RESET_CMD_TIMEOUT               60
 
 #define RESOLVE_RETRY_TIMEOUT           1800
@@ -89,20 +169,133 @@ enum obj_type {                         /* type of auxiliary obj             */
     CONMAN_OBJ_UNIXSOCK = 0x20,
     CONMAN_OBJ_IPMI     = 0x40,
     CONMAN_OBJ_TEST     = 0x80,
+    CONMAN_OBJ_FORWARD  = 0x100,
     CONMAN_OBJ_LAST_ENTRY
 };
 
+typedef struct obj_stats {              /* OBJ PERFORMANCE COUNTERS:         */
+    unsigned long    bytesRead;         /*  bytes read & passed to readers   */
+    unsigned long    bytesWritten;      /*  bytes written out to fd          */
+    unsigned long    bytesOverwritten;  /*  bytes overwritten before written */
+    unsigned long    numWrites;         /*  num write attempts on fd         */
+    unsigned long    numWriteBlocks;    /*  num writes failing w/ EAGAIN     */
+    unsigned long    numConnects;       /*  num times console came up        */
+    unsigned long    secsDown;          /*  secs spent down prior to tDown   */
+    time_t           tDown;             /*  time console went down, or 0     */
+} obj_stats_t;
+
+typedef struct io_stats {               /* I/O THREAD PERFORMANCE COUNTERS:  */
+    unsigned long    numWakeups;        /*  num wakeups w/ fds ready for i/o */
+    unsigned long    numReadyFds;       /*  num fds ready over all wakeups   */
+    unsigned long    usecsBusy;         /*  usecs spent handling ready fds   */
+    unsigned long    usecsBusyMax;      /*  max usecs spent on one wakeup    */
+    tpoll_stats_t    timers;            /*  timer dispatch stats from tpoll  */
+} io_stats_t;
+
+typedef struct obj_chunk {              /* SHARED DATA CHUNK:                */
+    struct obj_chunk *next;             /*  next chunk in the free pool      */
+    int              refCount;          /*  num refs held to this chunk      */
+    int              len;               /*  num bytes of data in chunk       */
+    struct timeval   tGen;              /*  time test data generated, or 0   */
+    unsigned char    data[OBJ_CHUNK_SIZE];
+} obj_chunk_t;
+
+typedef struct obj_seg {                /* CLIENT OUTPUT SEGMENT:            */
+    obj_chunk_t     *chunk;             /*  chunk ref containing seg data    */
+    unsigned char   *ptr;               /*  ptr to next byte to write to fd  */
+    int              len;               /*  num bytes remaining in seg       */
+    unsigned         isPrivate:1;       /*  true if chunk is not shared      */
+} obj_seg_t;
+
+typedef enum client_overflow {          /* client output overflow (2 bits)   */
+    CONMAN_OVERFLOW_DROP,
+    CONMAN_OVERFLOW_SPILL,
+    CONMAN_OVERFLOW_BLOCK
+} overflow_t;
+
+typedef struct client_mux {             /* CLIENT MULTIPLEX SESSION DATA:    */
+    struct server_conf *conf;           /*  server conf for console lookups  */
+    unsigned char    hdr[CONMAN_MUX_HDR_LEN];   /* hdr of record being rcvd  */
+    int              hdrLen;            /*  num hdr bytes rcvd thus far      */
+    unsigned int     id;                /*  console id of record being rcvd  */
+    int              numLeft;           /*  num payload bytes left to rcv    */
+    char            *ctrl;              /*  buf for ctrl msg being rcvd      */
+    int              ctrlLen;           /*  num ctrl msg bytes rcvd thus far */
+} client_mux_t;
+
 typedef struct client_obj {             /* CLIENT AUX OBJ DATA:              */
     req_t           *req;               /*  client request info              */
+    obj_seg_t       *segs;              /*  circular queue of output segs    */
+    int              segHead;           /*  index of first seg in queue      */
+    int              numSegs;           /*  num segs in queue                */
+    int              numSegBytes;       /*  num bytes of data in queue       */
     time_t           timeLastRead;      /*  time last data was read from fd  */
+    int              isActive;          /*  true once ready for muxing i/o   */
+    client_mux_t    *mux;               /*  multiplex session data, or NULL  */
+    void            *zstream;           /*  zlib stream if output compressed */
+    unsigned char   *zBuf;              /*  compressed output pending write  */
+    int              zBufSize;          /*  num bytes allocated for zBuf     */
+    int              zBufLen;           /*  num bytes of data in zBuf        */
+    int              zBufOff;           /*  num bytes of zBuf written to fd  */
+    int              spillFd;           /*  unlinked file of spilled output  */
+    off_t            spillIn;           /*  offset for data spilled to file  */
+    off_t            spillOut;          /*  offset for data read from file   */
+    unsigned long    numDropped;        /*  num bytes dropped since notice   */
+    off_t            replayPos;         /*  ring pos of next byte to replay  */
+    unsigned         overflow:2;        /*  enum client_overflow policy      */
+    unsigned         gotBlockExpired:1; /*  true if console no longer waits  */
+    unsigned         gotSpillFull:1;    /*  true if dropping until unspilled */
     unsigned         gotEscape:1;       /*  true if last char rcvd was esc   */
     unsigned         gotSuspend:1;      /*  true if suspending client output */
+    unsigned         gotReplay:1;       /*  true if replaying console's ring */
 } client_obj_t;
 
+typedef enum forward_connect_state {    /* state of n/w connection (2 bits)  */
+    CONMAN_FORWARD_DOWN,
+    CONMAN_FORWARD_LOOKUP,
+    CONMAN_FORWARD_PENDING,
+    CONMAN_FORWARD_UP
+} forward_state_t;
+
+typedef struct forward_obj {            /* FORWARD AUX OBJ DATA:             */
+    char            *host;              /*  remote collector host name or ip */
+    int              port;              /*  remote collector port number     */
+    char            *hostName;          /*  local host name for hello record */
+    struct forward_lookup *lookup;      /*  collector lookup in progress     */
+    struct addrinfo *addrs;             /*  collector addrs from lookup      */
+    struct addrinfo *addrNext;          /*  next collector addr to connect   */
+    pthread_mutex_t  mutex;             /*  lock for batches from consoles   */
+    struct forward_batch *fillBatch;    /*  batch being filled with records  */
+    struct forward_batch *readyHead;    /*  head of batches awaiting i/o thd */
+    struct forward_batch *readyTail;    /*  tail of batches awaiting i/o thd */
+    int              numQueuedBytes;    /*  num bytes in fill & ready batches*/
+    int              isWakeQueued;      /*  true if wake timer is scheduled  */
+    unsigned long    numDropped;        /*  num bytes dropped since notice   */
+    time_t           tDropNotice;       /*  time of last drop log msg        */
+    struct forward_batch *sendHead;     /*  batches being sent by i/o thread */
+    int              sendOff;           /*  num bytes of sendHead written    */
+    char            *spoolName;         /*  spool file name, or NULL if anon */
+    int              spoolFd;           /*  file of records awaiting send    */
+    off_t            spoolIn;           /*  offset for records spooled       */
+    off_t            spoolOut;          /*  offset for records read to send  */
+    int              timer;             /*  timer id for reconnects          */
+    int              tickTimer;         /*  timer id for sealing batches     */
+    int              delay;             /*  secs 'til next reconnect attempt */
+    unsigned         state:2;           /*  forward_state_t of n/w connection*/
+    unsigned         enableKeepAlive:1; /*  true if using TCP keep-alive     */
+} forward_obj_t;
+
 typedef struct logfile_opt {            /* LOGFILE OBJ OPTIONS:              */
+    unsigned         enableCompress:1;  /*  true if logfile being compressed */
     unsigned         enableLock:1;      /*  true if logfile being locked     */
+    unsigned         enableRotateZip:1; /*  true if gzip'ing rotated logs    */
     unsigned         enableSanitize:1;  /*  true if logfile being sanitized  */
     unsigned         enableTimestamp:1; /*  true if timestamping each line   */
+    off_t            rotateSize;        /*  size at which to rotate, or 0    */
+    int              rotateAge;         /*  secs after which to rotate, or 0 */
+    int              rotateCount;       /*  num rotated logfiles to keep     */
+    int              coalesceMsecs;     /*  msecs to hold back writes, or 0  */
+    int              coalesceSize;      /*  num bytes at which to write      */
 } logopt_t;
 
 typedef enum logfile_line_state {       /* log CR/LF newline state (2 bits)  */
@@ -116,6 +309,30 @@ typedef struct logfile_obj {            /* LOGFILE AUX OBJ DATA:             */
     struct base_obj *console;           /*  con obj ref for name expansion   */
     char            *fmtName;           /*  name with conversion specifiers  */
     logopt_t         opts;              /*  local options                    */
+    struct log_write *writeHead;        /*  head of bufs queued for writer   */
+    struct log_write *writeTail;        /*  tail of bufs queued for writer   */
+    struct base_obj *writeNext;         /*  next logfile queued for writer   */
+    int              numWriteBytes;     /*  num bytes queued for writer      */
+    int              isWriteQueued;     /*  true if queued for/being written */
+    int              isWriteBlocked;    /*  true if POLLOUT awaiting writer  */
+    int              isWriteRetired;    /*  true if obj is freed by writer   */
+    int              writeErrno;        /*  errno of failed write, or 0      */
+    unsigned long    numWrites;         /*  num writes completed by writer   */
+    unsigned long    writeMsecs;        /*  cumulative write latency (ms)    */
+    unsigned long    writeMsecsMax;     /*  maximum write latency (ms)       */
+    void            *zstream;           /*  zlib stream of current gz frame  */
+    unsigned long    frameBytes;        /*  uncompressed bytes in gz frame   */
+    time_t           frameTime;         /*  time at which gz frame started   */
+    int              indexFd;           /*  sidecar time index file desc     */
+    int              isIndexNew;        /*  true if index must be truncated  */
+    time_t           indexTime;         /*  time of checkpoint to be indexed */
+    int              stampMins;         /*  minute of last timestamp written */
+    off_t            rotateBytes;       /*  num bytes logged since rotation  */
+    time_t           rotateTime;        /*  time of last rotation (or open)  */
+    time_t           rotateRetry;       /*  time before which not to rotate  */
+    int              coalesceTimer;     /*  timer id for coalesced writes    */
+    int              isFlushForced;     /*  true if flush req'd by replay    */
+    unsigned         gotCoalesceDue:1;  /*  true if coalesce time elapsed    */
     unsigned         gotProcessing:1;   /*  true if input processing req'd   */
     unsigned         gotTruncate:1;     /*  true if ZeroLogs is enabled      */
     unsigned         lineState:2;       /*  log_line_state_t CR/LF state     */
@@ -139,9 +356,11 @@ typedef struct process_obj {            /* PROCESS AUX OBJ DATA              */
 
 typedef struct serial_opt {             /* SERIAL OBJ OPTIONS:               */
     speed_t          bps;               /*  bps def for cfset*speed()        */
+    int              baud;              /*  bps value (may lack a bps def)   */
     int              databits;          /*  databits (5-8)                   */
     int              parity;            /*  parity (0=NONE,1=ODD,2=EVEN)     */
     int              stopbits;          /*  stopbits (1-2)                   */
+    int              lowLatency;        /*  true to minimize driver latency  */
 } seropt_t;
 
 typedef struct serial_obj {             /* SERIAL AUX OBJ DATA:              */
@@ -151,6 +370,15 @@ typedef struct serial_obj {             /* SERIAL AUX OBJ DATA:              */
     struct termios   tty;               /*  saved cooked tty mode            */
 } serial_obj_t;
 
+typedef struct connect_slot {           /* RECONNECT SCHEDULER SLOT:         */
+    struct base_obj *obj;               /*  obj to be connected              */
+    callback_f       connect;           /*  routine initiating obj's connect */
+    const char      *host;              /*  remote host name ref             */
+    int              isHeld;            /*  true if admitted to connect      */
+    int              isQueued;          /*  true if waiting for admission    */
+    int              timer;             /*  timer id for passing admission   */
+} connect_slot_t;
+
 typedef enum telnet_connect_state {     /* state of n/w connection (2 bits)  */
     CONMAN_TELNET_NONE,
     CONMAN_TELNET_DOWN,
@@ -164,6 +392,7 @@ typedef struct telnet_obj {             /* TELNET AUX OBJ DATA:              */
     struct base_obj *logfile;           /*  log obj ref for console replay   */
     int              timer;             /*  timer id for reconnects          */
     int              delay;             /*  secs 'til next reconnect attempt */
+    connect_slot_t   slot;              /*  admission for concurrent connects*/
     int              iac;               /*  -1, or last char if in IAC seq   */
     unsigned         state:2;           /*  telnet_state_t of n/w connection */
     unsigned         enableKeepAlive:1; /*  true if using TCP keep-alive     */
@@ -180,6 +409,7 @@ typedef struct unixsock_obj {           /* UNIXSOCK AUX OBJ DATA:            */
     int              timer;             /*  timer id for reconnects          */
     int              delay;             /*  secs 'til next reconnect attempt */
     unsigned         state:1;           /*  unixsock_state_t conn state      */
+    unsigned         isWatched:1;       /*  true if registered for inotify   */
 } unixsock_obj_t;
 
 /*  Refer to struct ipmiconsole_ipmi_config in <ipmiconsole.h>.
@@ -212,26 +442,55 @@ typedef struct ipmi_obj {               /* IPMI AUX OBJ DATA:                */
     int              timer;             /*  timer id                         */
     int              delay;             /*  secs 'til next reconnect attempt */
     pthread_mutex_t  mutex;             /*  lock for ctx/state/timer/delay   */
+    unsigned         gotSlot:1;         /*  true if admitted to connect      */
+    unsigned         gotQueued:1;       /*  true if waiting for admission    */
 } ipmi_obj_t;
 #endif /* WITH_FREEIPMI */
 
+typedef enum test_format {              /* test console payload format       */
+    CONMAN_TEST_TEXT,                   /*  printable chars without newlines */
+    CONMAN_TEST_LINE,                   /*  lines of printable chars w/ CRLF */
+    CONMAN_TEST_BINARY,                 /*  pseudorandom bytes (eg, IAC/ESC) */
+    CONMAN_TEST_BOOT,                   /*  timestamped kernel boot log      */
+    CONMAN_TEST_BIOS,                   /*  ANSI/CP437 BIOS setup screens    */
+    CONMAN_TEST_IAC                     /*  text w/ telnet IAC sequences     */
+} test_format_t;
+
 typedef struct test_opt {               /* TEST OBJ OPTIONS:                 */
     int              numBytes;          /*  num bytes to output per burst    */
     int              msecMax;           /*  max msecs between bursts, or -1  */
     int              msecMin;           /*  min msecs between bursts, or -1  */
     int              probability;       /*  %-probability of burst, [0-100]  */
+    int              rate;              /*  bytes/sec for bench, or 0=bursts */
+    test_format_t    format;            /*  payload format                   */
 } test_opt_t;
 
+typedef struct test_bench_stats {       /* TEST BENCH TOTALS:                */
+    int              numConsoles;       /*  num benchmark consoles open      */
+    unsigned long long rate;            /*  sum of target rates in bytes/sec */
+    unsigned long long numBytes;        /*  num bytes generated              */
+    unsigned long long numOver;         /*  num bytes overwritten in objs    */
+    unsigned long long numSamples;      /*  num latency samples taken        */
+    double           usecsLatency;      /*  sum of latency samples in usecs  */
+} test_bench_stats_t;
+
 typedef struct test_obj {               /* TEST AUX OBJ DATA:                */
     test_opt_t       opts;              /*  test obj options                 */
     struct base_obj *logfile;           /*  log obj ref for console replay   */
     int              timer;             /*  timer id for next burst          */
     int              numLeft;           /*  num bytes remaining in burst     */
+    double           credit;            /*  num bytes due at the bench rate  */
+    int              lineCol;           /*  column of next char in line fmt  */
+    unsigned long    numLines;          /*  num lines output in corpus fmts  */
+    unsigned int     seed;              /*  prng state for binary fmt        */
+    struct timeval   tLast;             /*  time of last bench credit update */
     char             lastChar;          /*  last char output by test console */
+    unsigned         isBench:1;         /*  true if counted by test bench    */
 } test_obj_t;
 
 typedef union aux_obj {
     client_obj_t     client;
+    forward_obj_t    forward;
     logfile_obj_t    logfile;
     process_obj_t    process;
     serial_obj_t     serial;
@@ -246,49 +505,115 @@ typedef union aux_obj {
 typedef struct base_obj {               /* BASE OBJ:                         */
     char            *name;              /*  obj name                         */
     int              fd;                /*  file descriptor                  */
-    unsigned char    buf[OBJ_BUF_SIZE]; /*  circular-buf to be written to fd */
+    tpoll_t          tp;                /*  tpoll obj of owning i/o thread   */
+    unsigned char   *buf;               /*  circular-buf to be written to fd */
+    int              bufSize;           /*  size of circular-buf (or queue)  */
     unsigned char   *bufInPtr;          /*  ptr for data written in to buf   */
     unsigned char   *bufOutPtr;         /*  ptr for data written out to fd   */
-    pthread_mutex_t  bufLock;           /*  lock protecting access to buf    */
+    struct obj_pend *pendHead;          /*  data written by other threads    */
+    struct obj_pend *pendTail;          /*  last pending write (for append)  */
+    int              numPendBytes;      /*  num bytes of pending data        */
+    pthread_mutex_t  bufLock;           /*  lock protecting pending data     */
     List             readers;           /*  list of objs that read from me   */
     List             writers;           /*  list of objs that write to me    */
+    struct base_obj **readerSet;        /*  NULL-term'd snapshot of readers  */
+    struct base_obj **writerSet;        /*  NULL-term'd snapshot of writers  */
     char            *resetCmdRef;       /*  console reset cmd string ref     */
     pid_t            resetCmdPid;       /*  console reset cmd active pid     */
     int              resetCmdTimer;     /*  console reset cmd timer id       */
+    int              readBudget;        /*  max bytes read per i/o event     */
+    int              readPauseTimer;    /*  timer id for resuming paused rd  */
+    int              numPendOver;       /*  num pending bytes overwritten    */
+    unsigned long    numOverNotice;     /*  num bytes overwritten since msg  */
+    time_t           tOverNotice;       /*  time of last overwrite log msg   */
+    int              isOpenPending;     /*  true until opened at startup     */
+    int              isRemoved;         /*  true once removed from config    */
+    struct trigger_state *trigger;      /*  trigger match state for console  */
+    struct replay_ring *ring;           /*  mmap'd replay ring for console   */
+    obj_stats_t      stats;             /*  performance counters             */
+    unsigned int     muxId;             /*  console id for multiplexing      */
     unsigned         type;              /*  enum obj_type of auxiliary obj   */
     unsigned         gotBufWrap:1;      /*  true if circular-buf has wrapped */
     unsigned         gotEOF:1;          /*  true if obj got EOF on last read */
+    unsigned         gotReadPause:1;    /*  true if reads await slow client  */
     aux_obj_t        aux;               /*  auxiliary obj data union         */
 } obj_t;
 
+typedef struct obj_index obj_index_t;   /* hash index of objs by string key  */
+
+typedef enum client_setup_state {       /* handshake step awaiting input     */
+    CLIENT_SETUP_GREETING,
+    CLIENT_SETUP_REQUEST,
+    CLIENT_SETUP_HTTP_REQUEST,
+    CLIENT_SETUP_HTTP_HEADERS,
+    CLIENT_SETUP_DONE
+} client_setup_state_t;
+
+typedef struct client_setup {           /* NEW CLIENT CONNECTION:            */
+    struct server_conf *conf;           /*  server conf of accepting daemon  */
+    int              sd;                /*  socket descriptor of connection  */
+    int              timer;             /*  timer id for the setup timeout   */
+    client_setup_state_t state;         /*  handshake step awaiting input    */
+    req_t           *req;               /*  client request, or NULL if http  */
+    char            *httpReq;           /*  http request line for metrics    */
+    char            *buf;               /*  line being received from sd      */
+    int              len;               /*  num bytes of buf in use          */
+    int              size;              /*  num bytes of buf allocated       */
+} client_setup_t;
+
 typedef struct server_conf {
     char            *confFileName;      /* configuration file name           */
     char            *coreDumpDir;       /* dir where core dumps are written  */
     char            *cwd;               /* cwd when daemon was started       */
     char            *execPath;          /* process exec path                 */
+    char            *forwardHost;       /* collector host name, or NULL      */
+    int              forwardPort;       /* collector port number             */
+    char            *forwardSpoolName;  /* file to which records are spooled */
+    struct base_obj *forwarder;         /* forward obj for consoles, or NULL */
     char            *logDirName;        /* dir prefix for relative logfiles  */
     char            *logFileName;       /* file to which logmsgs are written */
     char            *logFmtName;        /* name with conversion specifiers   */
     FILE            *logFilePtr;        /* msg log file ptr, !closed at exit */
     int              logFileLevel;      /* level at which to log msg to file */
+    int              numIOThreads;      /* num i/o threads, or 0 for auto    */
     int              numOpenFiles;      /* rlimit for number of open files   */
+    int              consoleBufSize;    /* size of console obj circular-bufs */
+    int              logBufSize;        /* size of logfile obj circular-bufs */
+    int              readBudget;        /* max bytes read per console event  */
     char            *pidFileName;       /* file to which pid is written      */
     char            *resetCmd;          /* cmd to invoke for reset esc-seq   */
     int              syslogFacility;    /* syslog facility or -1 if disabled */
     int              throwSignal;       /* signal num to send running daemon */
+    int              maxConnects;       /* max n/w connects in progress      */
+    int              maxHostConnects;   /* max n/w connects per remote host  */
+    int              clientOverflow;    /* enum client_overflow for clients  */
     int              tStampMinutes;     /* minutes 'tween logfile timestamps */
     time_t           tStampNext;        /* time next stamp written to logs   */
+    char            *triggerCmd;        /* cmd to invoke for trigger events  */
+    char            *triggerFileName;   /* file from which triggers are read */
+    char            *triggerSockName;   /* unix socket for trigger events    */
     int              fd;                /* configuration file descriptor     */
+    int              numConfErrors;     /* num errors found in config file   */
     int              port;              /* port number on which to listen    */
     int              ld;                /* listening socket descriptor       */
+    int              metricsPort;       /* port for metrics, or 0 if none    */
+    int              metricsLd;         /* metrics listening socket desc     */
     List             objs;              /* list of all server obj_t's        */
+    obj_index_t     *consoleIndex;      /* index of console objs by name     */
+    obj_index_t     *deviceIndex;       /* index of console objs by device   */
+    obj_index_t     *logfileIndex;      /* index of logfile objs by name     */
     tpoll_t          tp;                /* tpoll obj for muxing i/o & timers */
+    int              numConsoleObjs;    /* number of consoles in config      */
+    int              numOpenPending;    /* num consoles awaiting first open  */
     char            *globalLogName;     /* global log name (must contain &)  */
     logopt_t         globalLogOpts;     /* global opts for logfile objects   */
     seropt_t         globalSerOpts;     /* global opts for serial objects    */
+    char            *globalReplayName;  /* global replay ring name, or NULL  */
+    int              globalReplaySize;  /* global size of replay rings       */
 #if WITH_FREEIPMI
     ipmiopt_t        globalIpmiOpts;    /* global opts for ipmi objects      */
     int              numIpmiObjs;       /* number of ipmi consoles in config */
+    int              ipmiMaxConnects;   /* max ipmi connects in progress     */
 #endif /* WITH_FREEIPMI */
     test_opt_t       globalTestOpts;    /* global opts for test objs         */
     unsigned         enableCoreDump:1;  /* true if core dumps are enabled    */
@@ -300,12 +625,6 @@ typedef struct server_conf {
     unsigned         enableForeground:1;/* true if daemon should not fork    */
 } server_conf_t;
 
-typedef struct client_args {
-    int              sd;                /* socket descriptor of new client   */
-    server_conf_t   *conf;              /* server's configuration            */
-} client_arg_t;
-
-
 /*  Concering object READERS and WRITERS:
  *
  *  - an object's readers are those objects that read from it
@@ -318,7 +637,8 @@ typedef struct client_args {
  *  Data in an object's write-buffer is written out to its file descriptor.
  *
  *  CONSOLE objects: (aka PROCESS/SERIAL/TELNET objects)
- *  - readers list can contain at most one logfile object
+ *  - readers list can contain at most one logfile object,
+ *    at most one forward object,
  *    and any number of R/O or R/W client objects
  *  - writers list can contain any number of R/W or W/O client objects
  *
@@ -337,6 +657,10 @@ typedef struct client_args {
  *  W/O CLIENT objects: (aka B/C CLIENT objects)
  *  - readers list contains more than one console object
  *  - writers list is empty
+ *
+ *  FORWARD objects:
+ *  - readers list is empty
+ *  - writers list contains every console object
  */
 
 
@@ -351,6 +675,7 @@ typedef struct client_args {
     CONMAN_OBJ_TEST           \
   )
 #define is_client_obj(OBJ)   (OBJ->type == CONMAN_OBJ_CLIENT)
+#define is_forward_obj(OBJ)  (OBJ->type == CONMAN_OBJ_FORWARD)
 #define is_ipmi_obj(OBJ)     (OBJ->type == CONMAN_OBJ_IPMI)
 #define is_logfile_obj(OBJ)  (OBJ->type == CONMAN_OBJ_LOGFILE)
 #define is_process_obj(OBJ)  (OBJ->type == CONMAN_OBJ_PROCESS)
@@ -361,6 +686,11 @@ typedef struct client_args {
 #define is_console_obj(OBJ)  (OBJ->type &  CONMAN_OBJ_IS_CONSOLE)
 
 
+/*  server.c
+ */
+int get_io_thread_stats(int n, io_stats_t *stats);
+
+
 /*  server-conf.c
  */
 server_conf_t * create_server_conf(void);
@@ -371,17 +701,53 @@ void process_cmdline(server_conf_t *conf, int argc, char *argv[]);
 
 void process_config(server_conf_t *conf);
 
+server_conf_t * reread_config(server_conf_t *conf);
+
 
 /*  server-esc.c
  */
 int process_client_escapes(obj_t *client, void *src, int len);
 
 
+/*  server-forward.c
+ */
+obj_t * create_forward_obj(server_conf_t *conf,
+    char *host, int port, char *spool);
+
+int open_forward_obj(obj_t *forward);
+
+void close_forward_obj(obj_t *forward);
+
+int write_forward_data(obj_t *forward, obj_t *console,
+    const void *src, int len);
+
+int read_forward_obj(obj_t *forward);
+
+int write_forward_obj(obj_t *forward);
+
+
+/*  server-index.c
+ */
+obj_index_t * create_obj_index(void);
+
+void destroy_obj_index(obj_index_t *idx);
+
+void insert_obj_index(obj_index_t *idx, const char *key, obj_t *obj);
+
+void remove_obj_index(obj_index_t *idx, const char *key, obj_t *obj);
+
+obj_t * find_obj_index(obj_index_t *idx, const char *key, unsigned type);
+
+unsigned get_obj_index_gen(obj_index_t *idx);
+
+int match_obj_index(obj_index_t *idx, const char *pat, List matches);
+
+
 /* server-ipmi.c
  */
 #if WITH_FREEIPMI
 
-void ipmi_init(int num_consoles);
+void ipmi_init(int num_consoles, int max_connects);
 
 void ipmi_fini(void);
 
@@ -412,18 +778,59 @@ obj_t * create_logfile_obj(server_conf_t *conf, char *name,
 
 int open_logfile_obj(obj_t *logfile);
 
+void open_logfile_objs(List logfiles);
+
 obj_t * get_console_logfile_obj(obj_t *console);
 
 int write_log_data(obj_t *log, const void *src, int len);
 
+int queue_log_write(obj_t *logfile, const struct iovec *iov, int iovcnt);
+
+int defer_log_write(obj_t *logfile, int len);
+
+void flush_log_writes(obj_t *logfile);
+
+void end_log_flush(obj_t *logfile);
+
+void close_log_writes(obj_t *logfile, char *name);
+
+int defer_logfile_destroy(obj_t *logfile);
+
+void sync_log_writes(void);
+
+void * process_log_writes(void *arg);
+
+void check_logfile_rotation(obj_t *logfile);
+
+#if WITH_ZLIB
+void * process_log_rotations(void *arg);
+#endif /* WITH_ZLIB */
+
+void set_log_timestamp(time_t t);
+
+void mark_log_index(obj_t *logfile, time_t t);
+
+int find_log_range(const char *name, time_t since, time_t until,
+    off_t *startRef, off_t *endRef, char *errbuf, int errlen);
+
+int find_log_tail(const char *name, off_t lines, off_t bytes,
+    off_t *startRef, off_t end, off_t *skipRef, char *errbuf, int errlen);
+
+int write_log_range(const char *name, off_t start, off_t end, off_t skip,
+    int sd, int enableCompress);
+
 
 /*  server-obj.c
  */
+void set_obj_io_thread(tpoll_t tp);
+
 obj_t * create_obj(server_conf_t *conf, char *name,
     int fd, enum obj_type type);
 
 obj_t * create_client_obj(server_conf_t *conf, req_t *req);
 
+void activate_client_obj(obj_t *client);
+
 void destroy_obj(obj_t *obj);
 
 void reopen_obj(obj_t *obj);
@@ -446,12 +853,51 @@ void unlink_obj(obj_t *obj);
 
 int shutdown_obj(obj_t *obj);
 
+void close_console_obj(obj_t *console);
+
 int read_from_obj(obj_t *obj);
 
+obj_chunk_t * get_obj_chunk(void);
+
+void put_obj_chunk(obj_chunk_t *chunk);
+
+void write_obj_readers(obj_t *obj, obj_chunk_t *chunk, int len);
+
 int write_obj_data(obj_t *obj, const void *src, int len, int isInfo);
 
+int write_obj_console_data(obj_t *obj, obj_t *console,
+    const void *src, int len, int isInfo);
+
 int write_to_obj(obj_t *obj);
 
+void replay_client_data(obj_t *client);
+
+void flush_logfile_obj(obj_t *logfile);
+
+void mark_console_up(obj_t *console);
+
+void mark_console_down(obj_t *console);
+
+
+/*  server-metrics.c
+ */
+void process_metrics(server_conf_t *conf, int sd, const char *httpReq);
+
+
+/*  server-mux.c
+ */
+client_mux_t * create_client_mux(server_conf_t *conf);
+
+void destroy_client_mux(client_mux_t *mux);
+
+void subscribe_client_console(obj_t *client, obj_t *console);
+
+void announce_client_unsubscribe(obj_t *client, obj_t *console);
+
+void announce_client_drop(obj_t *client, unsigned long n);
+
+int process_client_frames(obj_t *client, void *src, int len);
+
 
 /*  server-process.c
  */
@@ -464,6 +910,42 @@ obj_t * create_process_obj(server_conf_t *conf, char *name, List args,
 int open_process_obj(obj_t *process);
 
 
+/*  server-reconnect.c
+ */
+void reconnect_init(int max_connects, int max_host_connects);
+
+void reconnect_fini(void);
+
+int get_reconnect_msecs(int *delay, int min_delay, int max_delay);
+
+void init_connect_slot(connect_slot_t *slot, obj_t *obj,
+    callback_f connect, const char *host);
+
+int acquire_connect_slot(connect_slot_t *slot);
+
+void release_connect_slot(connect_slot_t *slot);
+
+
+/*  server-replay.c
+ */
+struct replay_ring * create_replay_ring(const char *name, int size);
+
+void destroy_replay_ring(struct replay_ring *ring);
+
+int is_replay_ring_changed(struct replay_ring *old, struct replay_ring *new);
+
+int open_replay_ring(obj_t *console);
+
+void close_replay_ring(obj_t *console);
+
+void write_replay_ring(obj_t *console, const void *src, int len);
+
+int get_replay_ring_range(obj_t *console, off_t *start, off_t *end);
+
+int get_replay_ring_data(obj_t *console, off_t pos, int len,
+    const unsigned char **ptr_ref);
+
+
 /*  server-serial.c
  */
 int is_serial_dev(const char *dev, const char *cwd, char **path_ref);
@@ -481,7 +963,21 @@ int open_serial_obj(obj_t *serial);
 
 /*  server-sock.c
  */
-void process_client(client_arg_t *args);
+client_setup_t * create_client_setup(
+    server_conf_t *conf, int sd, int isMetrics);
+
+void destroy_client_setup(client_setup_t *cs);
+
+int read_client_setup(client_setup_t *cs);
+
+int is_bulk_client_setup(client_setup_t *cs);
+
+void process_client(server_conf_t *conf, client_setup_t *cs);
+
+int match_console_objs(server_conf_t *conf, List pats, int isRegex,
+    List matches, char *errbuf, int errlen);
+
+void check_console_state(obj_t *console, obj_t *client);
 
 
 /*  server-telnet.c
@@ -514,6 +1010,27 @@ int open_test_obj(obj_t *test);
 
 int read_test_obj(obj_t *test);
 
+void fill_test_data(obj_t *test, unsigned char *dst, int len);
+
+void close_test_obj(obj_t *test);
+
+int is_test_bench_active(void);
+
+void add_test_bench_latency(const struct timeval *tGen);
+
+void add_test_bench_overwrite(int n);
+
+int get_test_bench_stats(test_bench_stats_t *stats);
+
+
+/*  server-trigger.c
+ */
+int create_triggers(server_conf_t *conf);
+
+void destroy_triggers(void);
+
+void scan_triggers(obj_t *console, const void *src, int len);
+
 
 /*  server-unixsock.c
  */
@@ -524,5 +1041,9 @@ obj_t * create_unixsock_obj(server_conf_t *conf, char *name, char *dev,
 
 int open_unixsock_obj(obj_t *unixsock);
 
+int watch_unixsock_obj(obj_t *unixsock);
+
+void unwatch_unixsock_obj(obj_t *unixsock);
+
 
 #endif /* !_SERVER_H */
@@ -36,8 +36,15 @@
 #include <sys/resource.h>
 #include <sys/time.h>
 #include <unistd.h>
+#if HAVE_SYS_EPOLL_H
+#  include <sys/epoll.h>
+#elif HAVE_SYS_EVENT_H && HAVE_KQUEUE
+#  include <sys/types.h>
+#  include <sys/event.h>
+#endif /* HAVE_SYS_EPOLL_H */
 #include "bool.h"
 #include "log.h"
+#include "probe.h"
 #include "tpoll.h"
 
 
@@ -57,15 +64,29 @@
  *  descriptors to the first empty slot in fd_array[], and maintaining a hash
  *  to map file descriptors onto the corresponding fd_array[] index.
  *
- *  This implementation assumes the number of concurrent active timers is
- *  moderate; as such, active timers are stored in a linked-list in order of
- *  increasing timevals (ie, the head of the list (timers_active) is the next
- *  timer to expire).  It does not scale well to a large number of timers
- *  because insertion and deletion are O(n), although dispatching is O(1).
- *  Other possible implementations are heaps [Sedgewick 1998] which are
- *  O(log n) for insertion, deletion, and dispatch; or hashed timing wheels
- *  [Varghese and Lauck 1996] which can be as efficient as O(1) for insertion,
- *  deletion, and dispatch.
+ *  The fd_array[] records the events of interest and the events returned for
+ *  each file descriptor, but the kernel is only handed the entire array when
+ *  falling back to poll().  Where available, epoll (Linux) or kqueue (BSD)
+ *  is used instead:  tpoll_set() and tpoll_clear() become updates to the
+ *  kernel's interest list, and each wakeup only returns (and only costs) the
+ *  file descriptors that are actually ready.  Since the kernel does not
+ *  reference fd_array[] for these backends, changes to the set of file
+ *  descriptors do not need to signal a blocked tpoll() to restart.
+ *  If the epoll or kqueue object cannot be created at runtime, poll() is used.
+ *
+ *  Active timers are stored in a binary min-heap [Sedgewick 1998] ordered by
+ *  increasing timevals (ie, the root of the heap (timer_heap[0]) is the next
+ *  timer to expire), making insertion, deletion, and dispatch O(log n).
+ *  Timers expiring at the same time are dispatched in the order they were
+ *  set.  Timer structs are allocated from a pool (timer_pool[]) which grows
+ *  as needed but is never shrunk, so setting a timer does not malloc().
+ *  Since the pool can be realloc'd, timers are referenced by their pool
+ *  index instead of by pointer.  Timer IDs are unique (modulo wrapping) so a
+ *  stale ID can never cancel a newer timer that reused the same pool entry;
+ *  a hash table (timer_hash[]) maps each active timer ID onto its pool index
+ *  for O(1) lookup by tpoll_timeout_cancel().  Hashed timing wheels [Varghese
+ *  and Lauck 1996] could be as efficient as O(1) for insertion, deletion,
+ *  and dispatch, but at the cost of timer resolution or of larger memory.
  */
 
 
@@ -75,6 +96,14 @@
 
 #define TPOLL_ALLOC     256
 
+#define TPOLL_TIMER_ALLOC       64
+
+#if HAVE_SYS_EPOLL_H
+#  define TPOLL_HAVE_EPOLL      1
+#elif HAVE_SYS_EVENT_H && HAVE_KQUEUE
+#  define TPOLL_HAVE_KQUEUE     1
+#endif /* HAVE_SYS_EPOLL_H */
+
 
 /*****************************************************************************
  *  Internal Data Types
@@ -82,14 +111,44 @@
 
 typedef struct tpoll_timer * _tpoll_timer_t;
 
+typedef enum {
+    TPOLL_BACKEND_POLL,                 /* poll() over the entire fd_array[] */
+    TPOLL_BACKEND_EPOLL,                /* Linux epoll interest list         */
+    TPOLL_BACKEND_KQUEUE                /* BSD kqueue interest list          */
+} _tpoll_backend_t;
+
+#if defined(TPOLL_HAVE_EPOLL)
+typedef struct epoll_event _tpoll_event_t;
+#elif defined(TPOLL_HAVE_KQUEUE)
+typedef struct kevent _tpoll_event_t;
+#endif /* TPOLL_HAVE_EPOLL */
+
 struct tpoll {
     struct pollfd   *fd_array;          /* poll fd array                     */
+    void           **fd_args;           /* tpoll_wait() arg for each fd      */
+    int             *ready_fds;         /* fds ready after the last wakeup   */
+    int              num_ready;         /* num ready_fds in use              */
+#if defined(TPOLL_HAVE_EPOLL) || defined(TPOLL_HAVE_KQUEUE)
+    _tpoll_event_t  *ev_array;          /* events returned by the kernel     */
+    int              num_evs_alloc;     /* num event structs allocated       */
+    int             *nopoll_fds;        /* fds the kernel cannot monitor     */
+    int             *nopoll_idx;        /* nopoll_fds[] index for each fd    */
+    int              num_nopoll;        /* num nopoll_fds in use             */
+#endif /* TPOLL_HAVE_EPOLL || TPOLL_HAVE_KQUEUE */
+    _tpoll_backend_t backend;           /* event notification mechanism      */
+    int              ev_fd;             /* epoll/kqueue fd, or -1 for poll() */
     int              fd_pipe[ 2 ];      /* signal pipe for unblocking poll() */
     int              num_fds_alloc;     /* num pollfd structs allocated      */
     int              num_fds_used;      /* num pollfd structs in use         */
     int              max_fd;            /* max fd in array in use            */
-    _tpoll_timer_t   timers_active;     /* sorted list of active timers      */
+    _tpoll_timer_t   timer_pool;        /* pool of timer structs             */
+    int             *timer_heap;        /* min-heap of active timer indices  */
+    int             *timer_hash;        /* timer ID to timer_pool[] index    */
+    int              num_timers_alloc;  /* num timer structs allocated       */
+    int              num_timers_used;   /* num timers active in the heap     */
+    int              timers_free;       /* index of first free timer struct  */
     int              timers_next_id;    /* next id to be assigned to a timer */
+    tpoll_stats_t    stats;             /* timer dispatch statistics         */
     pthread_mutex_t  mutex;             /* locking primitive                 */
     bool             is_blocked;        /* flag set when blocking on poll()  */
     bool             is_realloced;      /* flag set after fd_array[] realloc */
@@ -98,11 +157,12 @@ struct tpoll {
 };
 
 struct tpoll_timer {
-    int              id;                /* timer ID                          */
+    int              id;                /* timer ID, or 0 if free            */
     callback_f       fnc;               /* callback function                 */
     void            *arg;               /* callback function arg             */
     struct timeval   tv;                /* expiration time                   */
-    _tpoll_timer_t   next;              /* next timer in list                */
+    int              heap_idx;          /* timer_heap[] index if active      */
+    int              next_free;         /* next free timer_pool[] index      */
 };
 
 
@@ -110,6 +170,9 @@ struct tpoll_timer {
  *  Internal Prototypes
  *****************************************************************************/
 
+static int _tpoll_set (tpoll_t tp, int fd, short int events, void *arg,
+    bool is_arg);
+
 static void _tpoll_init (tpoll_t tp, tpoll_zero_t how);
 
 static void _tpoll_signal_send (tpoll_t tp);
@@ -118,6 +181,45 @@ static void _tpoll_signal_recv (tpoll_t tp);
 
 static int _tpoll_grow (tpoll_t tp, int num_fds_req);
 
+static int _tpoll_timer_grow (tpoll_t tp);
+
+static _tpoll_timer_t _tpoll_timer_next (tpoll_t tp);
+
+static void _tpoll_timer_remove (tpoll_t tp, int i);
+
+static int _tpoll_timer_find (tpoll_t tp, int id);
+
+static void _tpoll_timer_hash_insert (tpoll_t tp, int i);
+
+static void _tpoll_timer_hash_delete (tpoll_t tp, int i);
+
+static int _tpoll_timer_is_before (tpoll_t tp, int i, int j);
+
+static void _tpoll_timer_sift_up (tpoll_t tp, int k);
+
+static void _tpoll_timer_sift_down (tpoll_t tp, int k);
+
+static int _tpoll_backend_create (tpoll_t tp);
+
+static int _tpoll_backend_grow (tpoll_t tp, int num_fds_req);
+
+static void _tpoll_backend_destroy (tpoll_t tp);
+
+static int _tpoll_backend_update (tpoll_t tp, int fd,
+    short int events_old, short int events_new);
+
+#if defined(TPOLL_HAVE_EPOLL) || defined(TPOLL_HAVE_KQUEUE)
+static void _tpoll_nopoll_add (tpoll_t tp, int fd);
+
+static void _tpoll_nopoll_del (tpoll_t tp, int fd);
+#endif /* TPOLL_HAVE_EPOLL || TPOLL_HAVE_KQUEUE */
+
+static int _tpoll_backend_prepare (tpoll_t tp, int *timeout);
+
+static int _tpoll_backend_wait (tpoll_t tp, int timeout);
+
+static int _tpoll_backend_collect (tpoll_t tp, int n);
+
 static void _tpoll_get_timeval (struct timeval *tvp, int ms);
 
 static int _tpoll_diff_timeval (struct timeval *tvp1, struct timeval *tvp0);
@@ -148,17 +250,31 @@ tpoll_create (int n)
         goto err;
     }
     tp->fd_pipe[ 0 ] = tp->fd_pipe[ 1 ] = -1;
-    tp->timers_active = NULL;
+    tp->fd_array = NULL;
+    tp->fd_args = NULL;
+    tp->ready_fds = NULL;
+    tp->num_ready = 0;
+#if defined(TPOLL_HAVE_EPOLL) || defined(TPOLL_HAVE_KQUEUE)
+    tp->ev_array = NULL;
+    tp->num_evs_alloc = 0;
+    tp->nopoll_fds = NULL;
+    tp->nopoll_idx = NULL;
+    tp->num_nopoll = 0;
+#endif /* TPOLL_HAVE_EPOLL || TPOLL_HAVE_KQUEUE */
+    tp->backend = TPOLL_BACKEND_POLL;
+    tp->ev_fd = -1;
+    tp->timer_pool = NULL;
+    tp->timer_heap = NULL;
+    tp->timer_hash = NULL;
+    tp->num_timers_alloc = 0;
+    tp->num_timers_used = 0;
+    tp->timers_free = -1;
+    memset (&tp->stats, 0, sizeof (tp->stats));
     tp->is_blocked = false;
     tp->is_realloced = false;
     tp->is_signaled = false;
     tp->is_mutex_inited = false;
 
-    if (!(tp->fd_array = malloc (n * sizeof (struct pollfd)))) {
-        goto err;
-    }
-    tp->num_fds_alloc = n;
-
     if (pipe (tp->fd_pipe) < 0) {
         goto err;
     }
@@ -173,6 +289,36 @@ tpoll_create (int n)
             goto err;
         }
     }
+    /*  The fd tables are indexed by fd, so they must at least span the
+     *    signaling pipe.  Its fd can exceed the default size when the tpoll
+     *    is created by a process already holding many fds (eg, a reconfig).
+     */
+    if (n <= tp->fd_pipe[ 0 ]) {
+        n = tp->fd_pipe[ 0 ] + 1;
+    }
+    if (!(tp->fd_array = malloc (n * sizeof (struct pollfd)))) {
+        goto err;
+    }
+    if (!(tp->fd_args = malloc (n * sizeof (void *)))) {
+        goto err;
+    }
+    if (!(tp->ready_fds = malloc (n * sizeof (int)))) {
+        goto err;
+    }
+    tp->num_fds_alloc = n;
+    memset (tp->fd_array, 0, n * sizeof (struct pollfd));
+    for (i = 0; i < n; i++) {
+        tp->fd_array[ i ].fd = -1;
+        tp->fd_args[ i ] = NULL;
+    }
+    tp->max_fd = -1;
+
+    if (_tpoll_timer_grow (tp) < 0) {
+        goto err;
+    }
+    if (_tpoll_backend_create (tp) < 0) {
+        goto err;
+    }
     if ((e = pthread_mutex_init (&tp->mutex, NULL)) != 0) {
         errno = e;
         goto err;
@@ -197,7 +343,6 @@ tpoll_destroy (tpoll_t tp)
 /*  Destroys the tpoll object [tp] and cancels all of its associated timers.
  */
     int            i;
-    _tpoll_timer_t t;
     int            e;
 
     if (!tp) {
@@ -212,17 +357,36 @@ tpoll_destroy (tpoll_t tp)
         free (tp->fd_array);
         tp->fd_array = NULL;
     }
+    if (tp->fd_args) {
+        free (tp->fd_args);
+        tp->fd_args = NULL;
+    }
+    if (tp->ready_fds) {
+        free (tp->ready_fds);
+        tp->ready_fds = NULL;
+    }
+    _tpoll_backend_destroy (tp);
+
     for (i = 0; i < 2; i++) {
         if (tp->fd_pipe[ i ] > -1) {
             (void) close (tp->fd_pipe[ i ]);
             tp->fd_pipe[ i ] = -1;
         }
     }
-    while (tp->timers_active) {
-        t = tp->timers_active;
-        tp->timers_active = t->next;
-        free (t);
+    if (tp->timer_pool) {
+        free (tp->timer_pool);
+        tp->timer_pool = NULL;
     }
+    if (tp->timer_heap) {
+        free (tp->timer_heap);
+        tp->timer_heap = NULL;
+    }
+    if (tp->timer_hash) {
+        free (tp->timer_hash);
+        tp->timer_hash = NULL;
+    }
+    tp->num_timers_alloc = 0;
+    tp->num_timers_used = 0;
     if (tp->is_mutex_inited) {
         if ((e = pthread_mutex_unlock (&tp->mutex)) != 0) {
             log_err (errno = e, "Unable to unlock tpoll mutex");
@@ -280,6 +444,7 @@ tpoll_clear (tpoll_t tp, int fd, short int events)
  */
     short int events_new = 0;
     int       i;
+    int       rc = 0;
     int       e;
 
     if (!tp) {
@@ -302,11 +467,14 @@ tpoll_clear (tpoll_t tp, int fd, short int events)
         events_new = tp->fd_array[ fd ].events & ~events;
         if (tp->fd_array[ fd ].events != events_new) {
 
+            rc = _tpoll_backend_update (tp, fd,
+                tp->fd_array[ fd ].events, events_new);
             tp->fd_array[ fd ].events = events_new;
 
             if (events_new == 0) {
                 tp->fd_array[ fd ].revents = 0;
                 tp->fd_array[ fd ].fd = -1;
+                tp->fd_args[ fd ] = NULL;
                 tp->num_fds_used--;
 
                 if (tp->max_fd == fd) {
@@ -318,7 +486,9 @@ tpoll_clear (tpoll_t tp, int fd, short int events)
                     tp->max_fd = i;
                 }
             }
-            _tpoll_signal_send (tp);
+            if (tp->backend == TPOLL_BACKEND_POLL) {
+                _tpoll_signal_send (tp);
+            }
         }
     }
     DPRINTF((21, "tpoll_clear fd=%d e=0x%02x r=0x%02x.\n",
@@ -326,7 +496,7 @@ tpoll_clear (tpoll_t tp, int fd, short int events)
     if ((e = pthread_mutex_unlock (&tp->mutex)) != 0) {
         log_err (errno = e, "Unable to unlock tpoll mutex");
     }
-    return (0);
+    return (rc);
 }
 
 
@@ -376,56 +546,105 @@ tpoll_set (tpoll_t tp, int fd, short int events)
 {
 /*  Adds the bitwise-OR'd [events] to any existing events for file descriptor
  *    [fd] within the tpoll object [tp].
+ *  Any arg previously associated with [fd] via tpoll_set_arg() is retained.
  *  The internal fd table will grow as needed.
  *  Returns 0 on success, or -1 on error.
  */
-    int       rc;
-    short int events_new = 0;
-    int       e;
+    return (_tpoll_set (tp, fd, events, NULL, false));
+}
+
+
+int
+tpoll_set_arg (tpoll_t tp, int fd, short int events, void *arg)
+{
+/*  Adds the bitwise-OR'd [events] to any existing events for file descriptor
+ *    [fd] within the tpoll object [tp], and associates [arg] with [fd].
+ *    This [arg] is returned by tpoll_wait() whenever [fd] is ready for I/O
+ *    until all of [fd]'s events are removed via tpoll_clear().
+ *  The internal fd table will grow as needed.
+ *  Returns 0 on success, or -1 on error.
+ */
+    return (_tpoll_set (tp, fd, events, arg, true));
+}
+
+
+int
+tpoll_wait (tpoll_t tp, tpoll_event_t *events, int max_events, int ms)
+{
+/*  Similar to tpoll(), but also returns the file descriptors that are ready
+ *    for I/O so the caller does not need to test each one via tpoll_is_set().
+ *  Fills in up to [max_events] entries of the [events] array with the fd,
+ *    the events that occurred, and the arg associated via tpoll_set_arg()
+ *    (or NULL) for each ready file descriptor.  Any remaining ready fds will
+ *    be returned by the next call.
+ *  Returns the number of [events] entries filled in, 0 on timeout,
+ *    or -1 on error.
+ */
+    int fd;
+    int n;
+    int i;
+    int e;
 
     if (!tp) {
         errno = EINVAL;
         return (-1);
     }
-    if (fd < 0) {
+    if (!events || (max_events <= 0)) {
         errno = EINVAL;
         return (-1);
     }
-    if (events == 0) {
-        return (0);
+    if ((n = tpoll (tp, ms)) <= 0) {
+        return (n);
     }
     if ((e = pthread_mutex_lock (&tp->mutex)) != 0) {
         log_err (errno = e, "Unable to lock tpoll mutex");
     }
-    if ((fd >= tp->num_fds_alloc) && (_tpoll_grow (tp, fd + 1) < 0)) {
-        rc = -1;
-    }
-    else {
-        if (tp->fd_array[ fd ].fd < 0) {
-            assert (tp->fd_array[ fd ].events == 0);
-            assert (tp->fd_array[ fd ].revents == 0);
-            tp->fd_array[ fd ].fd = fd;
-            tp->num_fds_used++;
-            if (fd > tp->max_fd) {
-                tp->max_fd = fd;
-            }
-            events_new = events;
-        }
-        else {
-            events_new = tp->fd_array[ fd ].events | events;
+    for (i = 0, n = 0; (i < tp->num_ready) && (n < max_events); i++) {
+        fd = tp->ready_fds[ i ];
+        if (fd == tp->fd_pipe[ 0 ]) {
+            continue;
         }
-        if (tp->fd_array[ fd ].events != events_new) {
-            tp->fd_array[ fd ].events = events_new;
-            _tpoll_signal_send (tp);
+        /*  Skip fds that were cleared after tpoll() released the mutex.
+         */
+        if ((tp->fd_array[ fd ].fd < 0) || (tp->fd_array[ fd ].revents == 0)) {
+            continue;
         }
-        rc = 0;
+        events[ n ].fd = fd;
+        events[ n ].revents = tp->fd_array[ fd ].revents;
+        events[ n ].arg = tp->fd_args[ fd ];
+        n++;
     }
-    DPRINTF((21, "tpoll_set fd=%d e=0x%02x r=0x%02x.\n",
-        fd, events, events_new));
+    DPRINTF((23, "tpoll_wait return n=%d.\n", n));
     if ((e = pthread_mutex_unlock (&tp->mutex)) != 0) {
         log_err (errno = e, "Unable to unlock tpoll mutex");
     }
-    return (rc);
+    return (n);
+}
+
+
+int
+tpoll_get_stats (tpoll_t tp, tpoll_stats_t *stats)
+{
+/*  Copies the timer dispatch statistics of the tpoll object [tp] into
+ *    [stats].  The lag of each timer is the time between its expiration
+ *    and the start of its callback.
+ *  Returns 0 on success, or -1 on error.
+ */
+    int e;
+
+    if (!tp || !stats) {
+        errno = EINVAL;
+        return (-1);
+    }
+    if ((e = pthread_mutex_lock (&tp->mutex)) != 0) {
+        log_err (errno = e, "Unable to lock tpoll mutex");
+    }
+    *stats = tp->stats;
+
+    if ((e = pthread_mutex_unlock (&tp->mutex)) != 0) {
+        log_err (errno = e, "Unable to unlock tpoll mutex");
+    }
+    return (0);
 }
 
 
@@ -439,7 +658,7 @@ tpoll_timeout_absolute (tpoll_t tp, callback_f cb, void *arg,
  *  Returns a timer ID > 0 for use with tpoll_timeout_cancel(), or -1 on error.
  */
     _tpoll_timer_t  t;
-    _tpoll_timer_t *t_ptr;
+    int             i;
     int             rc;
     int             e;
 
@@ -455,31 +674,42 @@ tpoll_timeout_absolute (tpoll_t tp, callback_f cb, void *arg,
         errno = EINVAL;
         return (-1);
     }
-    if (!(t = malloc (sizeof (struct tpoll_timer)))) {
-        return (-1);
-    }
-    t->fnc = cb;
-    t->arg = arg;
-    t->tv = *tvp;
-
     if ((e = pthread_mutex_lock (&tp->mutex)) != 0) {
         log_err (errno = e, "Unable to lock tpoll mutex");
     }
-    rc = t->id = tp->timers_next_id++;
-    if (tp->timers_next_id <= 0) {
-        tp->timers_next_id = 1;
-    }
-    t_ptr = &tp->timers_active;
-    while (*t_ptr && !timercmp (tvp, &(*t_ptr)->tv, <)) {
-        t_ptr = &((*t_ptr)->next);
-    }
-    if (*t_ptr == tp->timers_active) {
-        _tpoll_signal_send (tp);
+    if ((tp->timers_free < 0) && (_tpoll_timer_grow (tp) < 0)) {
+        rc = -1;
     }
-    t->next = *t_ptr;
-    *t_ptr = t;
+    else {
+        i = tp->timers_free;
+        t = &tp->timer_pool[ i ];
+        tp->timers_free = t->next_free;
+
+        /*  Skip IDs still held by active timers after the ID has wrapped.
+         */
+        do {
+            t->id = tp->timers_next_id++;
+            if (tp->timers_next_id <= 0) {
+                tp->timers_next_id = 1;
+            }
+        } while (_tpoll_timer_find (tp, t->id) >= 0);
 
-    DPRINTF((22, "tpoll timer set id=%d.\n", t->id));
+        rc = t->id;
+        t->fnc = cb;
+        t->arg = arg;
+        t->tv = *tvp;
+        t->next_free = -1;
+        _tpoll_timer_hash_insert (tp, i);
+
+        t->heap_idx = tp->num_timers_used;
+        tp->timer_heap[ tp->num_timers_used++ ] = i;
+        _tpoll_timer_sift_up (tp, t->heap_idx);
+
+        if (t->heap_idx == 0) {
+            _tpoll_signal_send (tp);
+        }
+        DPRINTF((22, "tpoll timer set id=%d.\n", t->id));
+    }
     if ((e = pthread_mutex_unlock (&tp->mutex)) != 0) {
         log_err (errno = e, "Unable to unlock tpoll mutex");
     }
@@ -509,8 +739,7 @@ tpoll_timeout_cancel (tpoll_t tp, int id)
  *  Returns 1 if the timer was canceled, 0 if the timer was not found,
  *    or -1 on error.
  */
-    _tpoll_timer_t  t;
-    _tpoll_timer_t *t_ptr;
+    int             i;
     int             rc;
     int             e;
 
@@ -525,21 +754,15 @@ tpoll_timeout_cancel (tpoll_t tp, int id)
     if ((e = pthread_mutex_lock (&tp->mutex)) != 0) {
         log_err (errno = e, "Unable to lock tpoll mutex");
     }
-    t_ptr = &tp->timers_active;
-    while (*t_ptr && (id != (*t_ptr)->id)) {
-        t_ptr = &((*t_ptr)->next);
-    }
-    if (!*t_ptr) {
+    if ((i = _tpoll_timer_find (tp, id)) < 0) {
         rc = 0;
     }
     else {
-        DPRINTF((22, "tpoll timer cancel id=%d.\n", (*t_ptr)->id));
-        if (*t_ptr == tp->timers_active) {
+        DPRINTF((22, "tpoll timer cancel id=%d.\n", id));
+        if (tp->timer_pool[ i ].heap_idx == 0) {
             _tpoll_signal_send (tp);
         }
-        t = *t_ptr;
-        *t_ptr = t->next;
-        free (t);
+        _tpoll_timer_remove (tp, i);
         rc = 1;
     }
     if ((e = pthread_mutex_unlock (&tp->mutex)) != 0) {
@@ -567,7 +790,11 @@ tpoll (tpoll_t tp, int ms)
  */
     struct timeval  tv_timeout;
     struct timeval  tv_now;
+    struct timeval  tv_lag;
     _tpoll_timer_t  t;
+    callback_f      fnc;
+    void           *arg;
+    long            lag;
     int             timeout;
     int             ms_diff;
     int             n;
@@ -585,18 +812,36 @@ tpoll (tpoll_t tp, int ms)
     }
     DPRINTF((23, "tpoll enter ms=%d nfd=%d mfd=%d.\n",
         ms, tp->num_fds_used, tp->max_fd));
+    PROBE3(tpoll_enter, tp, ms, tp->num_fds_used);
     _tpoll_get_timeval (&tv_now, 0);
 
     for (;;) {
         /*
          *  Dispatch timer events that have expired.
          */
-        while (tp->timers_active
-                && !timercmp (&tp->timers_active->tv, &tv_now, >)) {
+        while ((t = _tpoll_timer_next (tp))
+                && !timercmp (&t->tv, &tv_now, >)) {
 
-            t = tp->timers_active;
-            tp->timers_active = t->next;
             DPRINTF((22, "tpoll timer dispatch id=%d.\n", t->id));
+            /*
+             *  The lag is measured against the current time since tv_now
+             *    is not updated after each callback.
+             */
+            _tpoll_get_timeval (&tv_lag, 0);
+            lag = ((tv_lag.tv_sec - t->tv.tv_sec) * 1000000)
+                + (tv_lag.tv_usec - t->tv.tv_usec);
+            if (lag < 0) {
+                lag = 0;                /* clock stepped backwards */
+            }
+            tp->stats.num_timers++;
+            tp->stats.usecs_lag += lag;
+            if ((unsigned long) lag > tp->stats.usecs_lag_max) {
+                tp->stats.usecs_lag_max = lag;
+            }
+            PROBE3(timer_dispatch, tp, t->id, lag);
+            fnc = t->fnc;
+            arg = t->arg;
+            _tpoll_timer_remove (tp, t - tp->timer_pool);
             /*
              *  Release the mutex while performing the callback function
              *    in case the callback wants to set/cancel another timer.
@@ -604,8 +849,7 @@ tpoll (tpoll_t tp, int ms)
             if ((e = pthread_mutex_unlock (&tp->mutex)) != 0) {
                 log_err (errno = e, "Unable to unlock tpoll mutex");
             }
-            t->fnc (t->arg);
-            free (t);
+            fnc (arg);
 
             if ((e = pthread_mutex_lock (&tp->mutex)) != 0) {
                 log_err (errno = e, "Unable to lock tpoll mutex");
@@ -616,7 +860,7 @@ tpoll (tpoll_t tp, int ms)
         if (ms == 0) {
             timeout = 0;
         }
-        else if ((ms < 0) && !tp->timers_active) {
+        else if ((ms < 0) && !tp->num_timers_used) {
             if (tp->num_fds_used > 0) {
                 timeout = -1;           /* fd events but no more timers */
             }
@@ -626,21 +870,22 @@ tpoll (tpoll_t tp, int ms)
         }
         else {
             _tpoll_get_timeval (&tv_now, 0);
+            t = _tpoll_timer_next (tp);
 
             if (ms < 0) {
-                assert (tp->timers_active != NULL);
+                assert (t != NULL);
                 ms_diff =
-                    _tpoll_diff_timeval (&tp->timers_active->tv, &tv_now);
+                    _tpoll_diff_timeval (&t->tv, &tv_now);
             }
-            else if (!tp->timers_active) {
+            else if (!t) {
                 assert (ms > 0);
                 ms_diff =
                     _tpoll_diff_timeval (&tv_timeout, &tv_now);
             }
-            else if (!timercmp (&tp->timers_active->tv, &tv_timeout, >)) {
+            else if (!timercmp (&t->tv, &tv_timeout, >)) {
                 assert (ms > 0);
                 ms_diff =
-                    _tpoll_diff_timeval (&tp->timers_active->tv, &tv_now);
+                    _tpoll_diff_timeval (&t->tv, &tv_now);
             }
             else {
                 assert (ms > 0);
@@ -651,13 +896,17 @@ tpoll (tpoll_t tp, int ms)
         }
         /*  Poll for events, discarding any on the "signaling pipe".
          */
+        if (_tpoll_backend_prepare (tp, &timeout) < 0) {
+            n = -1;
+            break;
+        }
         tp->is_blocked = true;
 
         if ((e = pthread_mutex_unlock (&tp->mutex)) != 0) {
             log_err (errno = e, "Unable to unlock tpoll mutex");
         }
         DPRINTF((25, "tpoll poll enter ms=%d mfd=%d.\n", timeout, tp->max_fd));
-        n = poll (tp->fd_array, tp->max_fd + 1, timeout);
+        n = _tpoll_backend_wait (tp, timeout);
         DPRINTF((25, "tpoll poll return n=%d.\n", n));
 
         if ((e = pthread_mutex_lock (&tp->mutex)) != 0) {
@@ -668,6 +917,8 @@ tpoll (tpoll_t tp, int ms)
         if (n < 0) {
             break;
         }
+        n = _tpoll_backend_collect (tp, n);
+
         if (tp->is_realloced) {
             DPRINTF((25, "tpoll is_realloced.\n"));
             tp->is_realloced = false;
@@ -683,7 +934,7 @@ tpoll (tpoll_t tp, int ms)
             break;
         }
         if ((ms == 0)
-                || ((ms < 0) && !tp->num_fds_used && !tp->timers_active)) {
+                || ((ms < 0) && !tp->num_fds_used && !tp->num_timers_used)) {
             break;
         }
         _tpoll_get_timeval (&tv_now, 0);
@@ -692,6 +943,7 @@ tpoll (tpoll_t tp, int ms)
         }
     }
     DPRINTF((23, "tpoll return n=%d.\n", n));
+    PROBE2(tpoll_return, tp, n);
     if ((e = pthread_mutex_unlock (&tp->mutex)) != 0) {
         log_err (errno = e, "Unable to unlock tpoll mutex");
     }
@@ -703,6 +955,72 @@ tpoll (tpoll_t tp, int ms)
  *  Internal Functions
  *****************************************************************************/
 
+static int
+_tpoll_set (tpoll_t tp, int fd, short int events, void *arg, bool is_arg)
+{
+/*  Adds the bitwise-OR'd [events] to any existing events for file descriptor
+ *    [fd] within the tpoll object [tp].  If [is_arg] is true, [arg] is
+ *    associated with [fd] for tpoll_wait().
+ *  Returns 0 on success, or -1 on error.
+ */
+    int       rc;
+
+    short int events_new = 0;
+    int       e;
+
+    if (!tp) {
+        errno = EINVAL;
+        return (-1);
+    }
+    if (fd < 0) {
+        errno = EINVAL;
+        return (-1);
+    }
+    if (events == 0) {
+        return (0);
+    }
+    if ((e = pthread_mutex_lock (&tp->mutex)) != 0) {
+        log_err (errno = e, "Unable to lock tpoll mutex");
+    }
+    if ((fd >= tp->num_fds_alloc) && (_tpoll_grow (tp, fd + 1) < 0)) {
+        rc = -1;
+    }
+    else {
+        if (tp->fd_array[ fd ].fd < 0) {
+            assert (tp->fd_array[ fd ].events == 0);
+            assert (tp->fd_array[ fd ].revents == 0);
+            tp->fd_array[ fd ].fd = fd;
+            tp->num_fds_used++;
+            if (fd > tp->max_fd) {
+                tp->max_fd = fd;
+            }
+            events_new = events;
+        }
+        else {
+            events_new = tp->fd_array[ fd ].events | events;
+        }
+        if (is_arg) {
+            tp->fd_args[ fd ] = arg;
+        }
+        rc = 0;
+        if (tp->fd_array[ fd ].events != events_new) {
+            rc = _tpoll_backend_update (tp, fd,
+                tp->fd_array[ fd ].events, events_new);
+            tp->fd_array[ fd ].events = events_new;
+            if (tp->backend == TPOLL_BACKEND_POLL) {
+                _tpoll_signal_send (tp);
+            }
+        }
+    }
+    DPRINTF((21, "tpoll_set fd=%d e=0x%02x r=0x%02x.\n",
+        fd, events, events_new));
+    if ((e = pthread_mutex_unlock (&tp->mutex)) != 0) {
+        log_err (errno = e, "Unable to unlock tpoll mutex");
+    }
+    return (rc);
+}
+
+
 static void
 _tpoll_init (tpoll_t tp, tpoll_zero_t how)
 {
@@ -710,29 +1028,46 @@ _tpoll_init (tpoll_t tp, tpoll_zero_t how)
  *  This routine assumes the [tp] mutex is already locked.
  */
     int            i;
-    _tpoll_timer_t t;
 
     assert (tp != NULL);
     assert (tp->fd_pipe[ 0 ] > -1);
     assert (tp->num_fds_alloc > 0);
+    assert (tp->num_timers_alloc > 0);
     assert ((how & ~TPOLL_ZERO_ALL) == 0);
 
     if (how & TPOLL_ZERO_FDS) {
+        for (i = 0; i <= tp->max_fd; i++) {
+            if ((tp->fd_array[ i ].fd > -1) && (i != tp->fd_pipe[ 0 ])) {
+                (void) _tpoll_backend_update (tp, i,
+                    tp->fd_array[ i ].events, 0);
+            }
+        }
         memset (tp->fd_array, 0, tp->num_fds_alloc * sizeof (struct pollfd));
         for (i = 0; i < tp->num_fds_alloc; i++) {
             tp->fd_array[ i ].fd = -1;
+            tp->fd_args[ i ] = NULL;
         }
         tp->fd_array[ tp->fd_pipe[ 0 ] ].fd = tp->fd_pipe[ 0 ];
         tp->fd_array[ tp->fd_pipe[ 0 ] ].events = POLLIN;
         tp->max_fd = tp->fd_pipe[ 0 ];
         tp->num_fds_used = 0;
+        tp->num_ready = 0;
+#if defined(TPOLL_HAVE_EPOLL) || defined(TPOLL_HAVE_KQUEUE)
+        assert (tp->num_nopoll == 0);
+#endif /* TPOLL_HAVE_EPOLL || TPOLL_HAVE_KQUEUE */
     }
     if (how & TPOLL_ZERO_TIMERS) {
-        while (tp->timers_active) {
-            t = tp->timers_active;
-            tp->timers_active = t->next;
-            free (t);
+        for (i = 0; i < tp->num_timers_alloc; i++) {
+            tp->timer_pool[ i ].id = 0;
+            tp->timer_pool[ i ].heap_idx = -1;
+            tp->timer_pool[ i ].next_free = i + 1;
+        }
+        tp->timer_pool[ tp->num_timers_alloc - 1 ].next_free = -1;
+        for (i = 0; i < tp->num_timers_alloc * 2; i++) {
+            tp->timer_hash[ i ] = -1;
         }
+        tp->num_timers_used = 0;
+        tp->timers_free = 0;
         tp->timers_next_id = 1;
     }
     return;
@@ -822,12 +1157,15 @@ _tpoll_signal_recv (tpoll_t tp)
 static int
 _tpoll_grow (tpoll_t tp, int num_fds_req)
 {
-/*  Attempts to grow [tp]'s pollfd array to at least [num_fds_req] structs.
+/*  Attempts to grow [tp]'s pollfd array (along with the arrays indexed by
+ *    or holding fds) to at least [num_fds_req] structs.
  *  Returns 0 if the request is successful, -1 if not.
  *  This routine assumes the [tp] mutex is already locked.
  */
     struct pollfd *fd_array_tmp;
     struct pollfd *fd_array_new;
+    void         **fd_args_tmp;
+    int           *ready_fds_tmp;
     int            num_fds_tmp;
     int            num_fds_new;
     int            i;
@@ -848,8 +1186,11 @@ _tpoll_grow (tpoll_t tp, int num_fds_req)
     /*  Force tpoll()'s poll() to unblock before we realloc the fd_array.
      *  Then tpoll() will have to re-acquire the mutex before continuing.
      *  Since we currently have the mutex, we can now safely realloc fd_array.
+     *  The epoll & kqueue backends do not pass fd_array[] to the kernel.
      */
-    _tpoll_signal_send (tp);
+    if (tp->backend == TPOLL_BACKEND_POLL) {
+        _tpoll_signal_send (tp);
+    }
     if (!(fd_array_tmp =
             realloc (tp->fd_array, num_fds_tmp * sizeof (struct pollfd)))) {
         return (-1);
@@ -860,13 +1201,821 @@ _tpoll_grow (tpoll_t tp, int num_fds_req)
     for (i = tp->num_fds_alloc; i < num_fds_tmp; i++) {
         fd_array_tmp[ i ].fd = -1;
     }
-    tp->is_realloced = true;
+    if (tp->backend == TPOLL_BACKEND_POLL) {
+        tp->is_realloced = true;
+    }
     tp->fd_array = fd_array_tmp;
+
+    if (!(fd_args_tmp =
+            realloc (tp->fd_args, num_fds_tmp * sizeof (void *)))) {
+        return (-1);
+    }
+    for (i = tp->num_fds_alloc; i < num_fds_tmp; i++) {
+        fd_args_tmp[ i ] = NULL;
+    }
+    tp->fd_args = fd_args_tmp;
+
+    if (!(ready_fds_tmp =
+            realloc (tp->ready_fds, num_fds_tmp * sizeof (int)))) {
+        return (-1);
+    }
+    tp->ready_fds = ready_fds_tmp;
+
+    if (_tpoll_backend_grow (tp, num_fds_tmp) < 0) {
+        return (-1);
+    }
     tp->num_fds_alloc = num_fds_tmp;
     return (0);
 }
 
 
+static int
+_tpoll_timer_grow (tpoll_t tp)
+{
+/*  Attempts to grow [tp]'s timer pool by doubling its size (or allocating
+ *    TPOLL_TIMER_ALLOC timer structs if the pool is empty), adding the new
+ *    timer structs to the free list and rebuilding the timer ID hash.
+ *  Returns 0 if the request is successful, -1 if not.
+ *  This routine assumes the [tp] mutex is already locked (or that the object
+ *    handle has not yet been returned by tpoll_create()).
+ */
+    _tpoll_timer_t  timer_pool_tmp;
+    int            *timer_heap_tmp;
+    int            *timer_hash_tmp;
+    int             num_timers_old;
+    int             num_timers_new;
+    int             i;
+
+    assert (tp != NULL);
+    assert (TPOLL_TIMER_ALLOC > 0);
+
+    num_timers_old = tp->num_timers_alloc;
+    num_timers_new = (num_timers_old > 0)
+        ? num_timers_old * 2 : TPOLL_TIMER_ALLOC;
+    if (num_timers_new <= num_timers_old) {
+        errno = ENOMEM;
+        return (-1);
+    }
+    if (!(timer_pool_tmp = realloc (tp->timer_pool,
+            num_timers_new * sizeof (struct tpoll_timer)))) {
+        return (-1);
+    }
+    tp->timer_pool = timer_pool_tmp;
+
+    if (!(timer_heap_tmp = realloc (tp->timer_heap,
+            num_timers_new * sizeof (int)))) {
+        return (-1);
+    }
+    tp->timer_heap = timer_heap_tmp;
+
+    if (!(timer_hash_tmp = malloc (num_timers_new * 2 * sizeof (int)))) {
+        return (-1);
+    }
+    if (tp->timer_hash) {
+        free (tp->timer_hash);
+    }
+    tp->timer_hash = timer_hash_tmp;
+
+    for (i = num_timers_old; i < num_timers_new; i++) {
+        tp->timer_pool[ i ].id = 0;
+        tp->timer_pool[ i ].heap_idx = -1;
+        tp->timer_pool[ i ].next_free = i + 1;
+    }
+    tp->timer_pool[ num_timers_new - 1 ].next_free = tp->timers_free;
+    tp->timers_free = num_timers_old;
+    tp->num_timers_alloc = num_timers_new;
+
+    for (i = 0; i < num_timers_new * 2; i++) {
+        tp->timer_hash[ i ] = -1;
+    }
+    for (i = 0; i < tp->num_timers_used; i++) {
+        _tpoll_timer_hash_insert (tp, tp->timer_heap[ i ]);
+    }
+    DPRINTF((22, "tpoll timer pool grown to %d.\n", num_timers_new));
+    return (0);
+}
+
+
+static _tpoll_timer_t
+_tpoll_timer_next (tpoll_t tp)
+{
+/*  Returns the next timer to expire in [tp], or NULL if no timers are active.
+ *  The returned pointer is only valid until the timer pool is modified.
+ *  This routine assumes the [tp] mutex is already locked.
+ */
+    assert (tp != NULL);
+
+    if (tp->num_timers_used == 0) {
+        return (NULL);
+    }
+    return (&tp->timer_pool[ tp->timer_heap[ 0 ] ]);
+}
+
+
+static void
+_tpoll_timer_remove (tpoll_t tp, int i)
+{
+/*  Removes the active timer at index [i] of [tp]'s timer pool from the heap
+ *    and hash, and returns its timer struct to the free list.
+ *  This routine assumes the [tp] mutex is already locked.
+ */
+    int k;
+    int last;
+
+    assert (tp != NULL);
+    assert ((i >= 0) && (i < tp->num_timers_alloc));
+    assert (tp->timer_pool[ i ].heap_idx >= 0);
+    assert (tp->num_timers_used > 0);
+
+    k = tp->timer_pool[ i ].heap_idx;
+    last = tp->timer_heap[ --tp->num_timers_used ];
+    if (k < tp->num_timers_used) {
+        tp->timer_heap[ k ] = last;
+        tp->timer_pool[ last ].heap_idx = k;
+        _tpoll_timer_sift_up (tp, k);
+        _tpoll_timer_sift_down (tp, tp->timer_pool[ last ].heap_idx);
+    }
+    _tpoll_timer_hash_delete (tp, i);
+
+    tp->timer_pool[ i ].id = 0;
+    tp->timer_pool[ i ].heap_idx = -1;
+    tp->timer_pool[ i ].next_free = tp->timers_free;
+    tp->timers_free = i;
+    return;
+}
+
+
+static int
+_tpoll_timer_find (tpoll_t tp, int id)
+{
+/*  Searches [tp]'s timer hash for the active timer [id].
+ *  Returns the timer's index into the timer pool, or -1 if not found.
+ *  This routine assumes the [tp] mutex is already locked.
+ */
+    int mask;
+    int h;
+    int i;
+
+    assert (tp != NULL);
+    assert (id > 0);
+
+    mask = (tp->num_timers_alloc * 2) - 1;
+    for (h = id & mask; (i = tp->timer_hash[ h ]) >= 0; h = (h + 1) & mask) {
+        if (tp->timer_pool[ i ].id == id) {
+            return (i);
+        }
+    }
+    return (-1);
+}
+
+
+static void
+_tpoll_timer_hash_insert (tpoll_t tp, int i)
+{
+/*  Inserts the timer at index [i] of [tp]'s timer pool into the timer hash.
+ *    The hash is an open-addressed table with linear probing that is twice
+ *    the size of the pool, so it is at most half full.
+ *  This routine assumes the [tp] mutex is already locked.
+ */
+    int mask;
+    int h;
+
+    assert (tp != NULL);
+    assert (tp->timer_pool[ i ].id > 0);
+
+    mask = (tp->num_timers_alloc * 2) - 1;
+    h = tp->timer_pool[ i ].id & mask;
+    while (tp->timer_hash[ h ] >= 0) {
+        h = (h + 1) & mask;
+    }
+    tp->timer_hash[ h ] = i;
+    return;
+}
+
+
+static void
+_tpoll_timer_hash_delete (tpoll_t tp, int i)
+{
+/*  Deletes the timer at index [i] of [tp]'s timer pool from the timer hash.
+ *    Subsequent entries in the probe sequence are shifted back into the
+ *    vacated slot as needed so lookups never stop short [Knuth 6.4R].
+ *  This routine assumes the [tp] mutex is already locked.
+ */
+    int mask;
+    int h;
+    int j;
+    int k;
+    int home;
+
+    assert (tp != NULL);
+    assert (tp->timer_pool[ i ].id > 0);
+
+    mask = (tp->num_timers_alloc * 2) - 1;
+    h = tp->timer_pool[ i ].id & mask;
+    while (tp->timer_hash[ h ] != i) {
+        assert (tp->timer_hash[ h ] >= 0);
+        h = (h + 1) & mask;
+    }
+    tp->timer_hash[ h ] = -1;
+
+    for (j = (h + 1) & mask; (k = tp->timer_hash[ j ]) >= 0;
+            j = (j + 1) & mask) {
+        home = tp->timer_pool[ k ].id & mask;
+        /*
+         *  Leave the entry in place if its home slot lies cyclically
+         *    within (h, j]; o/w, move it back into the vacated slot.
+         */
+        if ((h <= j) ? ((h < home) && (home <= j))
+                     : ((h < home) || (home <= j))) {
+            continue;
+        }
+        tp->timer_hash[ h ] = k;
+        tp->timer_hash[ j ] = -1;
+        h = j;
+    }
+    return;
+}
+
+
+static int
+_tpoll_timer_is_before (tpoll_t tp, int i, int j)
+{
+/*  Returns non-zero if the timer at index [i] of [tp]'s timer pool expires
+ *    before the timer at index [j].  Timers with equal expiration times are
+ *    ordered by ID so they are dispatched in the order they were set.
+ */
+    struct timeval *tvp_i = &tp->timer_pool[ i ].tv;
+    struct timeval *tvp_j = &tp->timer_pool[ j ].tv;
+
+    if (timercmp (tvp_i, tvp_j, !=)) {
+        return (timercmp (tvp_i, tvp_j, <));
+    }
+    return (tp->timer_pool[ i ].id < tp->timer_pool[ j ].id);
+}
+
+
+static void
+_tpoll_timer_sift_up (tpoll_t tp, int k)
+{
+/*  Restores the heap property by moving the timer at [tp]'s heap index [k]
+ *    up towards the root.
+ *  This routine assumes the [tp] mutex is already locked.
+ */
+    int parent;
+    int i;
+
+    assert (tp != NULL);
+    assert ((k >= 0) && (k < tp->num_timers_used));
+
+    i = tp->timer_heap[ k ];
+    while (k > 0) {
+        parent = (k - 1) / 2;
+        if (!_tpoll_timer_is_before (tp, i, tp->timer_heap[ parent ])) {
+            break;
+        }
+        tp->timer_heap[ k ] = tp->timer_heap[ parent ];
+        tp->timer_pool[ tp->timer_heap[ k ] ].heap_idx = k;
+        k = parent;
+    }
+    tp->timer_heap[ k ] = i;
+    tp->timer_pool[ i ].heap_idx = k;
+    return;
+}
+
+
+static void
+_tpoll_timer_sift_down (tpoll_t tp, int k)
+{
+/*  Restores the heap property by moving the timer at [tp]'s heap index [k]
+ *    down towards the leaves.
+ *  This routine assumes the [tp] mutex is already locked.
+ */
+    int child;
+    int i;
+
+    assert (tp != NULL);
+    assert ((k >= 0) && (k < tp->num_timers_used));
+
+    i = tp->timer_heap[ k ];
+    while ((child = (2 * k) + 1) < tp->num_timers_used) {
+        if ((child + 1 < tp->num_timers_used)
+                && _tpoll_timer_is_before (tp,
+                    tp->timer_heap[ child + 1 ], tp->timer_heap[ child ])) {
+            child++;
+        }
+        if (!_tpoll_timer_is_before (tp, tp->timer_heap[ child ], i)) {
+            break;
+        }
+        tp->timer_heap[ k ] = tp->timer_heap[ child ];
+        tp->timer_pool[ tp->timer_heap[ k ] ].heap_idx = k;
+        k = child;
+    }
+    tp->timer_heap[ k ] = i;
+    tp->timer_pool[ i ].heap_idx = k;
+    return;
+}
+
+
+static int
+_tpoll_backend_create (tpoll_t tp)
+{
+/*  Creates the kernel event notification object for [tp] if epoll or kqueue
+ *    is supported, and registers the read-end of the signaling pipe with it.
+ *  Falls back to poll() if the kernel object cannot be created.
+ *  Returns 0 on success, or -1 on error.
+ */
+#if defined(TPOLL_HAVE_EPOLL) || defined(TPOLL_HAVE_KQUEUE)
+    int fval;
+
+    assert (tp != NULL);
+    assert (tp->fd_pipe[ 0 ] > -1);
+    assert (tp->ev_fd == -1);
+
+#if defined(TPOLL_HAVE_EPOLL)
+    tp->ev_fd = epoll_create (tp->num_fds_alloc);
+#else  /* !TPOLL_HAVE_EPOLL */
+    tp->ev_fd = kqueue ();
+#endif /* !TPOLL_HAVE_EPOLL */
+
+    if (tp->ev_fd < 0) {
+        DPRINTF((20, "tpoll backend unavailable: %s.\n", strerror (errno)));
+        tp->backend = TPOLL_BACKEND_POLL;
+        return (0);
+    }
+    if ((fval = fcntl (tp->ev_fd, F_GETFD, 0)) < 0) {
+        return (-1);
+    }
+    if (fcntl (tp->ev_fd, F_SETFD, fval | FD_CLOEXEC) < 0) {
+        return (-1);
+    }
+    if (!(tp->ev_array =
+            malloc (tp->num_fds_alloc * sizeof (*tp->ev_array)))) {
+        return (-1);
+    }
+    tp->num_evs_alloc = tp->num_fds_alloc;
+
+    if (_tpoll_backend_grow (tp, tp->num_fds_alloc) < 0) {
+        return (-1);
+    }
+#if defined(TPOLL_HAVE_EPOLL)
+    tp->backend = TPOLL_BACKEND_EPOLL;
+#else  /* !TPOLL_HAVE_EPOLL */
+    tp->backend = TPOLL_BACKEND_KQUEUE;
+#endif /* !TPOLL_HAVE_EPOLL */
+
+    if (_tpoll_backend_update (tp, tp->fd_pipe[ 0 ], 0, POLLIN) < 0) {
+        return (-1);
+    }
+    DPRINTF((20, "tpoll backend is %s.\n",
+        (tp->backend == TPOLL_BACKEND_EPOLL) ? "epoll" : "kqueue"));
+#endif /* TPOLL_HAVE_EPOLL || TPOLL_HAVE_KQUEUE */
+
+    return (0);
+}
+
+
+static int
+_tpoll_backend_grow (tpoll_t tp, int num_fds_req)
+{
+/*  Grows [tp]'s table of fds that cannot be monitored by the kernel to hold
+ *    [num_fds_req] fds in order to match the size of the fd table.
+ *  Returns 0 if the request is successful, -1 if not.
+ *  This routine assumes the [tp] mutex is already locked (or that the object
+ *    handle has not yet been returned by tpoll_create()).
+ */
+#if defined(TPOLL_HAVE_EPOLL) || defined(TPOLL_HAVE_KQUEUE)
+    int *nopoll_tmp;
+    int  i;
+
+    assert (tp != NULL);
+    assert (num_fds_req > 0);
+
+    if (tp->ev_fd < 0) {
+        return (0);
+    }
+
+    if (!(nopoll_tmp = realloc (tp->nopoll_fds, num_fds_req * sizeof (int)))) {
+        return (-1);
+    }
+    tp->nopoll_fds = nopoll_tmp;
+
+    if (!(nopoll_tmp = realloc (tp->nopoll_idx, num_fds_req * sizeof (int)))) {
+        return (-1);
+    }
+    i = (tp->nopoll_idx != NULL) ? tp->num_fds_alloc : 0;
+    tp->nopoll_idx = nopoll_tmp;
+    while (i < num_fds_req) {
+        tp->nopoll_idx[ i++ ] = -1;
+    }
+#endif /* TPOLL_HAVE_EPOLL || TPOLL_HAVE_KQUEUE */
+
+    return (0);
+}
+
+
+static void
+_tpoll_backend_destroy (tpoll_t tp)
+{
+/*  Releases the kernel event notification object for [tp], if any.
+ */
+    assert (tp != NULL);
+
+#if defined(TPOLL_HAVE_EPOLL) || defined(TPOLL_HAVE_KQUEUE)
+    if (tp->ev_array) {
+        free (tp->ev_array);
+        tp->ev_array = NULL;
+    }
+    tp->num_evs_alloc = 0;
+    if (tp->nopoll_fds) {
+        free (tp->nopoll_fds);
+        tp->nopoll_fds = NULL;
+    }
+    if (tp->nopoll_idx) {
+        free (tp->nopoll_idx);
+        tp->nopoll_idx = NULL;
+    }
+    tp->num_nopoll = 0;
+#endif /* TPOLL_HAVE_EPOLL || TPOLL_HAVE_KQUEUE */
+
+    if (tp->ev_fd > -1) {
+        (void) close (tp->ev_fd);
+        tp->ev_fd = -1;
+    }
+    tp->backend = TPOLL_BACKEND_POLL;
+    return;
+}
+
+
+static int
+_tpoll_backend_update (tpoll_t tp, int fd,
+    short int events_old, short int events_new)
+{
+/*  Updates the kernel's interest list for file descriptor [fd] within the
+ *    tpoll object [tp] from [events_old] to [events_new].  This is a no-op
+ *    for the poll() backend since poll() is handed the entire fd_array[].
+ *  Returns 0 on success, or -1 on error.
+ *  This routine assumes the [tp] mutex is already locked.
+ */
+#if defined(TPOLL_HAVE_EPOLL)
+    struct epoll_event ev;
+    int                op;
+#elif defined(TPOLL_HAVE_KQUEUE)
+    struct kevent      kev[ 2 ];
+    int                n = 0;
+    int                i;
+    int                j;
+#endif /* TPOLL_HAVE_EPOLL */
+
+    assert (tp != NULL);
+    assert (fd >= 0);
+
+    if ((tp->backend == TPOLL_BACKEND_POLL) || (events_old == events_new)) {
+        return (0);
+    }
+#if defined(TPOLL_HAVE_EPOLL) || defined(TPOLL_HAVE_KQUEUE)
+    /*  Fds the kernel refused to monitor are tracked via fd_array[] events.
+     */
+    if (tp->nopoll_idx[ fd ] > -1) {
+        if (events_new == 0) {
+            _tpoll_nopoll_del (tp, fd);
+        }
+        return (0);
+    }
+#endif /* TPOLL_HAVE_EPOLL || TPOLL_HAVE_KQUEUE */
+
+#if defined(TPOLL_HAVE_EPOLL)
+    memset (&ev, 0, sizeof (ev));
+    ev.data.fd = fd;
+    if (events_new & POLLIN) {
+        ev.events |= EPOLLIN;
+    }
+    if (events_new & POLLPRI) {
+        ev.events |= EPOLLPRI;
+    }
+    if (events_new & POLLOUT) {
+        ev.events |= EPOLLOUT;
+    }
+    if (events_new == 0) {
+        op = EPOLL_CTL_DEL;
+    }
+    else if (events_old == 0) {
+        op = EPOLL_CTL_ADD;
+    }
+    else {
+        op = EPOLL_CTL_MOD;
+    }
+    if (epoll_ctl (tp->ev_fd, op, fd, &ev) == 0) {
+        return (0);
+    }
+    /*  The kernel silently drops an fd from its interest list once the fd is
+     *    closed, so the interest list can lag behind fd_array[] if an fd is
+     *    closed & reused without first being cleared.
+     */
+    if ((op == EPOLL_CTL_DEL) && ((errno == ENOENT) || (errno == EBADF))) {
+        return (0);
+    }
+    if ((op == EPOLL_CTL_MOD) && (errno == ENOENT)) {
+        op = EPOLL_CTL_ADD;
+    }
+    else if ((op == EPOLL_CTL_ADD) && (errno == EEXIST)) {
+        op = EPOLL_CTL_MOD;
+    }
+    else if ((op == EPOLL_CTL_ADD) && (errno == EPERM)) {
+        _tpoll_nopoll_add (tp, fd);
+        return (0);
+    }
+    else {
+        DPRINTF((20, "tpoll epoll_ctl fd=%d op=%d failed: %s.\n",
+            fd, op, strerror (errno)));
+        return (-1);
+    }
+    if (epoll_ctl (tp->ev_fd, op, fd, &ev) < 0) {
+        DPRINTF((20, "tpoll epoll_ctl fd=%d op=%d failed: %s.\n",
+            fd, op, strerror (errno)));
+        return (-1);
+    }
+
+#elif defined(TPOLL_HAVE_KQUEUE)
+    if ((events_old ^ events_new) & POLLIN) {
+        EV_SET (&kev[ n ], fd, EVFILT_READ,
+            (events_new & POLLIN) ? EV_ADD : EV_DELETE, 0, 0, NULL);
+        n++;
+    }
+    if ((events_old ^ events_new) & POLLOUT) {
+        EV_SET (&kev[ n ], fd, EVFILT_WRITE,
+            (events_new & POLLOUT) ? EV_ADD : EV_DELETE, 0, 0, NULL);
+        n++;
+    }
+    /*  Submit each change separately so a stale EV_DELETE (for an fd that was
+     *    closed & reused without first being cleared) cannot abort an EV_ADD.
+     */
+    for (i = 0; i < n; i++) {
+        if (kevent (tp->ev_fd, &kev[ i ], 1, NULL, 0, NULL) == 0) {
+            continue;
+        }
+        if ((kev[ i ].flags & EV_DELETE)
+                && ((errno == ENOENT) || (errno == EBADF))) {
+            continue;
+        }
+        if ((kev[ i ].flags & EV_ADD) && (events_old == 0)
+                && ((errno == EINVAL) || (errno == EPERM))) {
+            for (j = 0; j < i; j++) {
+                kev[ j ].flags = EV_DELETE;
+                (void) kevent (tp->ev_fd, &kev[ j ], 1, NULL, 0, NULL);
+            }
+            _tpoll_nopoll_add (tp, fd);
+            return (0);
+        }
+        DPRINTF((20, "tpoll kevent fd=%d filter=%d failed: %s.\n",
+            fd, (int) kev[ i ].filter, strerror (errno)));
+        return (-1);
+    }
+#endif /* TPOLL_HAVE_EPOLL */
+
+    return (0);
+}
+
+
+#if defined(TPOLL_HAVE_EPOLL) || defined(TPOLL_HAVE_KQUEUE)
+static void
+_tpoll_nopoll_add (tpoll_t tp, int fd)
+{
+/*  Adds file descriptor [fd] to [tp]'s set of fds that the kernel refused to
+ *    add to its interest list (eg, regular files & /dev/null).  poll() always
+ *    reports these as ready, so tpoll() will do the same without blocking.
+ *  This routine assumes the [tp] mutex is already locked.
+ */
+    assert (tp != NULL);
+    assert ((fd >= 0) && (fd < tp->num_fds_alloc));
+    assert (tp->nopoll_idx[ fd ] == -1);
+    assert (tp->num_nopoll < tp->num_fds_alloc);
+
+    tp->nopoll_idx[ fd ] = tp->num_nopoll;
+    tp->nopoll_fds[ tp->num_nopoll++ ] = fd;
+    DPRINTF((21, "tpoll nopoll add fd=%d n=%d.\n", fd, tp->num_nopoll));
+    return;
+}
+
+
+static void
+_tpoll_nopoll_del (tpoll_t tp, int fd)
+{
+/*  Removes file descriptor [fd] from [tp]'s set of fds that cannot be
+ *    monitored by the kernel.
+ *  This routine assumes the [tp] mutex is already locked.
+ */
+    int i;
+
+    assert (tp != NULL);
+    assert ((fd >= 0) && (fd < tp->num_fds_alloc));
+    assert (tp->nopoll_idx[ fd ] > -1);
+    assert (tp->num_nopoll > 0);
+
+    i = tp->nopoll_idx[ fd ];
+    tp->nopoll_fds[ i ] = tp->nopoll_fds[ --tp->num_nopoll ];
+    tp->nopoll_idx[ tp->nopoll_fds[ i ] ] = i;
+    tp->nopoll_idx[ fd ] = -1;
+    DPRINTF((21, "tpoll nopoll del fd=%d n=%d.\n", fd, tp->num_nopoll));
+    return;
+}
+#endif /* TPOLL_HAVE_EPOLL || TPOLL_HAVE_KQUEUE */
+
+
+static int
+_tpoll_backend_prepare (tpoll_t tp, int *timeout)
+{
+/*  Prepares the tpoll object [tp] for waiting on the kernel.
+ *    This resets the revents of the fds that were ready on the previous
+ *    wakeup (which poll() would have done itself) along with the ready list.
+ *    For the epoll & kqueue backends, this also grows the event array to
+ *    match the fd table; and if any fds cannot be monitored by the kernel,
+ *    the [timeout] is set to 0 since they are always ready.
+ *  Returns 0 on success, or -1 on error.
+ *  This routine assumes the [tp] mutex is already locked.
+ */
+#if defined(TPOLL_HAVE_EPOLL) || defined(TPOLL_HAVE_KQUEUE)
+    _tpoll_event_t *ev_array_tmp;
+#endif /* TPOLL_HAVE_EPOLL || TPOLL_HAVE_KQUEUE */
+    int             fd;
+    int             i;
+
+    assert (tp != NULL);
+    assert (timeout != NULL);
+
+    for (i = 0; i < tp->num_ready; i++) {
+        fd = tp->ready_fds[ i ];
+        if (fd < tp->num_fds_alloc) {
+            tp->fd_array[ fd ].revents = 0;
+        }
+    }
+    tp->num_ready = 0;
+
+#if defined(TPOLL_HAVE_EPOLL) || defined(TPOLL_HAVE_KQUEUE)
+    if (tp->backend == TPOLL_BACKEND_POLL) {
+        return (0);
+    }
+    if (tp->num_nopoll > 0) {
+        *timeout = 0;
+    }
+    /*  The event array is only referenced by the thread blocked in tpoll(),
+     *    so it can be safely realloc'd here without signaling anyone.
+     */
+    if (tp->num_evs_alloc < tp->num_fds_alloc) {
+        if (!(ev_array_tmp = realloc (tp->ev_array,
+                tp->num_fds_alloc * sizeof (*tp->ev_array)))) {
+            return (-1);
+        }
+        tp->ev_array = ev_array_tmp;
+        tp->num_evs_alloc = tp->num_fds_alloc;
+    }
+#endif /* TPOLL_HAVE_EPOLL || TPOLL_HAVE_KQUEUE */
+
+    return (0);
+}
+
+
+static int
+_tpoll_backend_wait (tpoll_t tp, int timeout)
+{
+/*  Blocks on the kernel for up to [timeout] milliseconds (or indefinitely
+ *    if [timeout] is -1) waiting for I/O on the tpoll object [tp].
+ *  Returns the number of events returned by the kernel, 0 on timeout,
+ *    or -1 on error.
+ *  This routine assumes the [tp] mutex is NOT locked.
+ */
+#if defined(TPOLL_HAVE_KQUEUE)
+    struct timespec ts;
+#endif /* TPOLL_HAVE_KQUEUE */
+
+    assert (tp != NULL);
+
+#if defined(TPOLL_HAVE_EPOLL)
+    if (tp->backend == TPOLL_BACKEND_EPOLL) {
+        return (epoll_wait (tp->ev_fd, tp->ev_array, tp->num_evs_alloc,
+            timeout));
+    }
+#elif defined(TPOLL_HAVE_KQUEUE)
+    if (tp->backend == TPOLL_BACKEND_KQUEUE) {
+        if (timeout >= 0) {
+            ts.tv_sec = timeout / 1000;
+            ts.tv_nsec = (timeout % 1000) * 1000000;
+        }
+        return (kevent (tp->ev_fd, NULL, 0, tp->ev_array, tp->num_evs_alloc,
+            (timeout >= 0) ? &ts : NULL));
+    }
+#endif /* TPOLL_HAVE_EPOLL */
+
+    return (poll (tp->fd_array, tp->max_fd + 1, timeout));
+}
+
+
+static int
+_tpoll_backend_collect (tpoll_t tp, int n)
+{
+/*  Records the [n] events returned by the kernel into [tp]'s fd_array[]
+ *    revents so they can be tested via tpoll_is_set(), and appends each
+ *    ready fd to the ready list so tpoll_wait() does not have to search
+ *    for them.  Events for fds that were cleared while tpoll() was blocked
+ *    are discarded.
+ *  Returns the number of file descriptors with I/O ready (including the
+ *    signaling pipe), just as poll() would.
+ *  This routine assumes the [tp] mutex is already locked.
+ */
+#if defined(TPOLL_HAVE_EPOLL) || defined(TPOLL_HAVE_KQUEUE)
+    _tpoll_event_t *ev;
+    short int       revents;
+    int             i;
+#endif /* TPOLL_HAVE_EPOLL || TPOLL_HAVE_KQUEUE */
+    int             fd;
+
+    assert (tp != NULL);
+    assert (n >= 0);
+    assert (tp->num_ready == 0);
+
+    /*  poll() has already recorded the revents in fd_array[].
+     */
+    if (tp->backend == TPOLL_BACKEND_POLL) {
+        for (fd = 0; (fd <= tp->max_fd) && (tp->num_ready < n); fd++) {
+            if ((tp->fd_array[ fd ].fd > -1) && tp->fd_array[ fd ].revents) {
+                tp->ready_fds[ tp->num_ready++ ] = fd;
+            }
+        }
+        return (n);
+    }
+#if defined(TPOLL_HAVE_EPOLL) || defined(TPOLL_HAVE_KQUEUE)
+    assert (n <= tp->num_evs_alloc);
+
+    for (i = 0; i < n; i++) {
+        ev = &tp->ev_array[ i ];
+        revents = 0;
+#if defined(TPOLL_HAVE_EPOLL)
+        fd = ev->data.fd;
+        if (ev->events & EPOLLIN) {
+            revents |= POLLIN;
+        }
+        if (ev->events & EPOLLPRI) {
+            revents |= POLLPRI;
+        }
+        if (ev->events & EPOLLOUT) {
+            revents |= POLLOUT;
+        }
+        if (ev->events & EPOLLERR) {
+            revents |= POLLERR;
+        }
+        if (ev->events & EPOLLHUP) {
+            revents |= POLLHUP;
+        }
+#else  /* !TPOLL_HAVE_EPOLL */
+        fd = (int) ev->ident;
+        if (ev->flags & EV_ERROR) {
+            revents |= POLLERR;
+        }
+        else if (ev->filter == EVFILT_READ) {
+            revents |= POLLIN;
+            if (ev->flags & EV_EOF) {
+                revents |= POLLHUP;
+            }
+        }
+        else if (ev->filter == EVFILT_WRITE) {
+            revents |= POLLOUT;
+            if (ev->flags & EV_EOF) {
+                revents |= POLLHUP;
+            }
+        }
+#endif /* !TPOLL_HAVE_EPOLL */
+
+        if ((fd < 0) || (fd > tp->max_fd) || (tp->fd_array[ fd ].fd < 0)) {
+            continue;
+        }
+        revents &= tp->fd_array[ fd ].events | POLLERR | POLLHUP;
+        if (revents == 0) {
+            continue;
+        }
+        if (tp->fd_array[ fd ].revents == 0) {
+            tp->ready_fds[ tp->num_ready++ ] = fd;
+        }
+        tp->fd_array[ fd ].revents |= revents;
+    }
+    for (i = 0; i < tp->num_nopoll; i++) {
+        fd = tp->nopoll_fds[ i ];
+        if (tp->fd_array[ fd ].fd < 0) {
+            continue;
+        }
+        revents = tp->fd_array[ fd ].events & (POLLIN | POLLOUT);
+        if (revents == 0) {
+            continue;
+        }
+        if (tp->fd_array[ fd ].revents == 0) {
+            tp->ready_fds[ tp->num_ready++ ] = fd;
+        }
+        tp->fd_array[ fd ].revents |= revents;
+    }
+#endif /* TPOLL_HAVE_EPOLL || TPOLL_HAVE_KQUEUE */
+
+    return (tp->num_ready);
+}
+
+
 static void
 _tpoll_get_timeval (struct timeval *tvp, int ms)
 {
@@ -52,6 +52,24 @@ typedef enum {
     TPOLL_ZERO_ALL    = 0x03            /* zero both fds and timers */
 } tpoll_zero_t;
 
+typedef struct {
+/*
+ *  Data type for a ready file descriptor returned by tpoll_wait().
+ */
+    int       fd;                       /* file descriptor ready for I/O */
+    short int revents;                  /* events that occurred */
+    void     *arg;                      /* arg from tpoll_set_arg() */
+} tpoll_event_t;
+
+typedef struct {
+/*
+ *  Data type for timer dispatch statistics returned by tpoll_get_stats().
+ */
+    unsigned long num_timers;           /* num timers dispatched */
+    unsigned long usecs_lag;            /* total usecs dispatched past due */
+    unsigned long usecs_lag_max;        /* max usecs dispatched past due */
+} tpoll_stats_t;
+
 
 /*****************************************************************************
  *  Functions
@@ -69,6 +87,8 @@ int tpoll_is_set (tpoll_t tp, int fd, short int events);
 
 int tpoll_set (tpoll_t tp, int fd, short int events);
 
+int tpoll_set_arg (tpoll_t tp, int fd, short int events, void *arg);
+
 int tpoll_timeout_absolute (tpoll_t tp, callback_f cb, void *arg,
     const struct timeval *tvp);
 
@@ -78,5 +98,9 @@ int tpoll_timeout_cancel (tpoll_t tp, int id);
 
 int tpoll (tpoll_t tp, int ms);
 
+int tpoll_wait (tpoll_t tp, tpoll_event_t *events, int max_events, int ms);
+
+int tpoll_get_stats (tpoll_t tp, tpoll_stats_t *stats);
+
 
 #endif /* !_TPOLL_H */
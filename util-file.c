@@ -205,6 +205,33 @@ ssize_t write_n(int fd, void *buf, size_t n)
 }
 
 
+ssize_t writev_n(int fd, struct iovec *iov, int iovcnt)
+{
+    ssize_t nwritten;
+    ssize_t n = 0;
+
+    while (iovcnt > 0) {
+        if ((nwritten = writev(fd, iov, iovcnt)) < 0) {
+            if (errno == EINTR)
+                continue;
+            else
+                return(-1);
+        }
+        n += nwritten;
+        while ((iovcnt > 0) && (nwritten >= (ssize_t) iov[0].iov_len)) {
+            nwritten -= iov[0].iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (nwritten > 0) {
+            iov[0].iov_base = (char *) iov[0].iov_base + nwritten;
+            iov[0].iov_len -= nwritten;
+        }
+    }
+    return(n);
+}
+
+
 ssize_t read_line(int fd, void *buf, size_t maxlen)
 {
     size_t n;
@@ -30,6 +30,7 @@
 #endif /* HAVE_CONFIG_H */
 
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 
@@ -106,6 +107,13 @@ ssize_t write_n(int fd, void *buf, size_t n);
  *  Returns the number of bytes written, or -1 on error.
  */
 
+ssize_t writev_n(int fd, struct iovec *iov, int iovcnt);
+/*
+ *  Writes all of the data described by the (iovcnt) bufs of (iov) to (fd),
+ *    retrying partial writes; the (iov) array is modified in the process.
+ *  Returns the number of bytes written, or -1 on error.
+ */
+
 ssize_t read_line(int fd, void *buf, size_t maxlen);
 /*
  *  Reads at most (maxlen-1) bytes up to a newline from (fd) into (buf).
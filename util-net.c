@@ -36,10 +36,13 @@
 #include <netdb.h>
 #include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <time.h>
 #include "util-net.h"
 #include "util-str.h"
+#include "util.h"
 #include "wrapper.h"
 
 
@@ -47,11 +50,51 @@
 #  define INET_ADDRSTRLEN 16
 #endif /* !INET_ADDRSTRLEN */
 
+#define HOST_CACHE_SIZE         256     /* num hash buckets in addr cache    */
+#define HOST_CACHE_MAX          4096    /* num entries before purging cache  */
+#define HOST_CACHE_LOW          3072    /* num entries left after eviction   */
+#define HOST_CACHE_TTL          300     /* secs to cache a resolved name     */
+#define HOST_CACHE_NEG_TTL      60      /* secs to cache a failed lookup     */
+#define HOST_RESOLVERS          2       /* num reverse lookup threads        */
+
+
+typedef struct host_cache {
+    struct host_cache      *next;       /* next entry in hash bucket         */
+    struct host_cache      *qnext;      /* next entry in resolver queue      */
+    struct sockaddr_storage addr;       /* address being resolved            */
+    socklen_t               addrlen;    /* length of addr                    */
+    char                   *name;       /* resolved name, or NULL if none    */
+    time_t                  expires;    /* time at which the entry is stale  */
+    int                     numWaiters; /* num threads awaiting the lookup   */
+    int                     isPending;  /* true if lookup is in progress     */
+} host_cache_t;
+
 
 static pthread_mutex_t hostentLock = PTHREAD_MUTEX_INITIALIZER;
 
+/*  The reverse lookup cache is protected by hostCacheLock.  Pending entries
+ *    are queued to the resolver threads via hostQueueCond; hostCacheCond is
+ *    broadcast whenever a lookup completes.
+ */
+static pthread_mutex_t hostCacheLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t hostCacheCond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t hostQueueCond = PTHREAD_COND_INITIALIZER;
+static host_cache_t *hostCache[HOST_CACHE_SIZE];
+static host_cache_t *hostQueueHead = NULL;
+static host_cache_t *hostQueueTail = NULL;
+static int hostCacheCount = 0;
+static int hostResolverCount = 0;
+
 
 static int copy_hostent(const struct hostent *src, char *dst, int len);
+static const void * get_host_addr_key(
+    const struct sockaddr *addr, int *keylen);
+static host_cache_t * find_host_cache(
+    const struct sockaddr *addr, socklen_t addrlen);
+static void purge_host_cache(time_t now);
+static int compare_host_expires(const void *p1, const void *p2);
+static void queue_host_lookup(host_cache_t *host);
+static void * resolve_host_lookups(void *arg);
 #ifndef NDEBUG
 static int validate_hostent_copy(
     const struct hostent *src, const struct hostent *dst);
@@ -166,6 +209,64 @@ char * host_addr4_to_name(const struct in_addr *addr, char *dst, int dstlen)
 }
 
 
+char * host_addr_to_name(const struct sockaddr *addr, socklen_t addrlen,
+    char *dst, int dstlen, int timeout)
+{
+    host_cache_t *host;
+    time_t now;
+    struct timespec ts;
+    char *p = NULL;
+
+    assert(addr != NULL);
+    assert(dst != NULL);
+
+    if (!get_host_addr_key(addr, NULL)) {
+        errno = EAFNOSUPPORT;
+        return(NULL);
+    }
+    now = time(NULL);
+    ts.tv_sec = now + timeout;
+    ts.tv_nsec = 0;
+
+    x_pthread_mutex_lock(&hostCacheLock);
+    host = find_host_cache(addr, addrlen);
+    if (!host->isPending && (host->expires <= now)) {
+        queue_host_lookup(host);
+    }
+    /*  The caller only waits for a lookup if there is no previous name;
+     *    a stale entry is refreshed in the background while the previous
+     *    name continues to be used.
+     */
+    host->numWaiters++;
+    while (host->isPending && !host->name) {
+        errno = pthread_cond_timedwait(&hostCacheCond, &hostCacheLock, &ts);
+        if (errno == ETIMEDOUT) {
+            break;
+        }
+        else if (errno != 0) {
+            log_err(errno, "pthread_cond_timedwait() failed");
+        }
+    }
+    host->numWaiters--;
+
+    if (host->name) {
+        if ((dstlen <= 0) || (strlen(host->name) >= (size_t) dstlen)) {
+            errno = ERANGE;
+        }
+        else {
+            strncpy(dst, host->name, dstlen);
+            dst[dstlen - 1] = '\0';
+            p = dst;
+        }
+    }
+    else {
+        errno = (host->isPending) ? ETIMEDOUT : ENOENT;
+    }
+    x_pthread_mutex_unlock(&hostCacheLock);
+    return(p);
+}
+
+
 char * host_name_to_cname(const char *src, char *dst, int dstlen)
 {
     struct hostent *hptr;
@@ -197,6 +298,235 @@ char * host_name_to_cname(const char *src, char *dst, int dstlen)
 }
 
 
+static const void * get_host_addr_key(
+    const struct sockaddr *addr, int *keylen)
+{
+/*  Returns a ptr to the network address within the socket address (addr),
+ *    setting (keylen) (if not NULL) to its length.
+ *  Returns NULL if the address family is not supported.
+ */
+    const void *key;
+    int len;
+
+    if (addr->sa_family == AF_INET) {
+        key = &((const struct sockaddr_in *) addr)->sin_addr;
+        len = sizeof(struct in_addr);
+    }
+    else if (addr->sa_family == AF_INET6) {
+        key = &((const struct sockaddr_in6 *) addr)->sin6_addr;
+        len = sizeof(struct in6_addr);
+    }
+    else {
+        return(NULL);
+    }
+    if (keylen) {
+        *keylen = len;
+    }
+    return(key);
+}
+
+
+static host_cache_t * find_host_cache(
+    const struct sockaddr *addr, socklen_t addrlen)
+{
+/*  Returns the cache entry for the socket address (addr) of length (addrlen),
+ *    creating a new (already stale) entry if one does not exist.
+ *  The ports of the socket addresses are ignored.
+ *  The hostCacheLock must be held when calling this routine.
+ */
+    const unsigned char *key;
+    int keylen = 0;
+    unsigned int hash = 2166136261U;
+    int i;
+    host_cache_t *host;
+
+    key = get_host_addr_key(addr, &keylen);
+    assert(key != NULL);
+    for (i = 0; i < keylen; i++) {
+        hash = (hash ^ key[i]) * 16777619U;
+    }
+    hash %= HOST_CACHE_SIZE;
+
+    for (host = hostCache[hash]; host; host = host->next) {
+        if ((host->addr.ss_family == addr->sa_family) && !memcmp(key,
+          get_host_addr_key((struct sockaddr *) &host->addr, NULL), keylen))
+            return(host);
+    }
+    if (hostCacheCount >= HOST_CACHE_MAX) {
+        purge_host_cache(time(NULL));
+    }
+    if (!(host = malloc(sizeof(*host)))) {
+        out_of_memory();
+    }
+    memset(host, 0, sizeof(*host));
+    assert(addrlen <= sizeof(host->addr));
+    memcpy(&host->addr, addr, addrlen);
+    host->addrlen = addrlen;
+    host->next = hostCache[hash];
+    hostCache[hash] = host;
+    hostCacheCount++;
+    return(host);
+}
+
+
+static void purge_host_cache(time_t now)
+{
+/*  Removes all stale entries from the cache that are neither awaiting
+ *    a lookup nor being waited upon.
+ *  If the cache is still full (ie, more than HOST_CACHE_MAX addresses have
+ *    been seen within a TTL), the entries expiring soonest are evicted
+ *    as well until no more than HOST_CACHE_LOW remain.
+ *  The hostCacheLock must be held when calling this routine.
+ */
+    int i;
+    int n = 0;
+    time_t *expires;
+    time_t cutoff;
+    host_cache_t **pHost;
+    host_cache_t *host;
+
+    cutoff = now;
+    for (;;) {
+        for (i = 0; i < HOST_CACHE_SIZE; i++) {
+            pHost = &hostCache[i];
+            while ((host = *pHost)) {
+                if (!host->isPending && !host->numWaiters
+                  && (host->expires <= cutoff)) {
+                    *pHost = host->next;
+                    free(host->name);
+                    free(host);
+                    hostCacheCount--;
+                }
+                else {
+                    pHost = &host->next;
+                }
+            }
+        }
+        if ((hostCacheCount < HOST_CACHE_MAX) || (cutoff > now)) {
+            break;
+        }
+        /*  Find the expiration time at or before which enough of the
+         *    evictable entries lie to bring the count down to HOST_CACHE_LOW.
+         */
+        if (!(expires = malloc(hostCacheCount * sizeof(time_t)))) {
+            out_of_memory();
+        }
+        for (i = 0, n = 0; i < HOST_CACHE_SIZE; i++) {
+            for (host = hostCache[i]; host; host = host->next) {
+                if (!host->isPending && !host->numWaiters) {
+                    expires[n++] = host->expires;
+                }
+            }
+        }
+        if (n == 0) {
+            free(expires);
+            break;
+        }
+        qsort(expires, n, sizeof(time_t), compare_host_expires);
+        i = hostCacheCount - HOST_CACHE_LOW;
+        cutoff = expires[(i < n) ? i - 1 : n - 1];
+        free(expires);
+        if (cutoff <= now) {
+            cutoff = now + 1;           /* ensure the loop terminates */
+        }
+    }
+    return;
+}
+
+
+static int compare_host_expires(const void *p1, const void *p2)
+{
+/*  Used by qsort() to compare cache entry expiration times.
+ */
+    time_t t1 = *(const time_t *) p1;
+    time_t t2 = *(const time_t *) p2;
+
+    return((t1 < t2) ? -1 : (t1 > t2) ? 1 : 0);
+}
+
+
+static void queue_host_lookup(host_cache_t *host)
+{
+/*  Queues the cache entry (host) to be resolved by a resolver thread,
+ *    starting another resolver if fewer than HOST_RESOLVERS are running.
+ *  The hostCacheLock must be held when calling this routine.
+ */
+    pthread_t tid;
+
+    assert(!host->isPending);
+
+    host->isPending = 1;
+    host->qnext = NULL;
+    if (hostQueueTail) {
+        hostQueueTail->qnext = host;
+    }
+    else {
+        hostQueueHead = host;
+    }
+    hostQueueTail = host;
+
+    if (hostResolverCount < HOST_RESOLVERS) {
+        if ((errno = pthread_create(&tid, NULL,
+          resolve_host_lookups, NULL)) != 0) {
+            log_err(errno, "Unable to create resolver thread");
+        }
+        x_pthread_detach(tid);
+        hostResolverCount++;
+    }
+    if ((errno = pthread_cond_signal(&hostQueueCond)) != 0) {
+        log_err(errno, "pthread_cond_signal() failed");
+    }
+    return;
+}
+
+
+static void * resolve_host_lookups(void *arg)
+{
+/*  Resolves queued cache entries until the end of time.
+ *  The lookup itself is performed without holding the hostCacheLock
+ *    so a slow resolver only delays callers waiting on that address.
+ */
+    host_cache_t *host;
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+    char buf[NI_MAXHOST];
+    int rc;
+
+    x_pthread_mutex_lock(&hostCacheLock);
+    for (;;) {
+        while (!hostQueueHead) {
+            if ((errno = pthread_cond_wait(
+              &hostQueueCond, &hostCacheLock)) != 0) {
+                log_err(errno, "pthread_cond_wait() failed");
+            }
+        }
+        host = hostQueueHead;
+        if (!(hostQueueHead = host->qnext)) {
+            hostQueueTail = NULL;
+        }
+        memcpy(&addr, &host->addr, host->addrlen);
+        addrlen = host->addrlen;
+        x_pthread_mutex_unlock(&hostCacheLock);
+
+        rc = getnameinfo((struct sockaddr *) &addr, addrlen,
+            buf, sizeof(buf), NULL, 0, NI_NAMEREQD);
+
+        x_pthread_mutex_lock(&hostCacheLock);
+        free(host->name);
+        host->name = (rc == 0) ? create_string(buf) : NULL;
+        host->expires = time(NULL)
+            + ((rc == 0) ? HOST_CACHE_TTL : HOST_CACHE_NEG_TTL);
+        host->isPending = 0;
+        if ((errno = pthread_cond_broadcast(&hostCacheCond)) != 0) {
+            log_err(errno, "pthread_cond_broadcast() failed");
+        }
+    }
+    /* Not reached. */
+    x_pthread_mutex_unlock(&hostCacheLock);
+    return(arg);
+}
+
+
 static int copy_hostent(const struct hostent *src, char *buf, int len)
 {
 /*  Copies the (src) hostent struct (and all of its associated data)
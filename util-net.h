@@ -31,6 +31,7 @@
 
 #include <netdb.h>
 #include <netinet/in.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
 
@@ -79,6 +80,20 @@ char * host_addr4_to_name(const struct in_addr *addr, char *dst, int dstlen);
  *  Note that this routine is thread-safe.
  */
 
+char * host_addr_to_name(const struct sockaddr *addr, socklen_t addrlen,
+    char *dst, int dstlen, int timeout);
+/*
+ *  Converts the IPv4 or IPv6 socket address (addr) of length (addrlen)
+ *    to a host name string residing in buffer (dst) of length (dstlen).
+ *  Lookups are performed by a pool of resolver threads and the results
+ *    (both positive and negative) are cached for a bounded time.  The caller
+ *    waits at most (timeout) seconds for an uncached lookup to complete;
+ *    a lookup that times out continues in the background to seed the cache.
+ *  Returns a ptr to the NULL-terminated string (dst) on success,
+ *    or NULL on error.
+ *  Note that this routine is thread-safe.
+ */
+
 char * host_name_to_cname(const char *src, char *dst, int dstlen);
 /*
  *  Converts the hostname or IP address string (src) to the
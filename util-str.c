@@ -46,6 +46,20 @@
 #define MAX_STR_SIZE 1024
 
 
+/*  The last time string written by write_time_string() is cached by each
+ *    thread so concurrent writers of log timestamps need not share a lock.
+ */
+typedef struct time_string_cache {
+    time_t           t;                 /* time of cached string, or 0       */
+    char             str[21];           /* "YYYY-MM-DD HH:MM:SS " + NUL      */
+} time_string_cache_t;
+
+static void create_time_string_key(void);
+
+static pthread_key_t timeStringKey;
+static pthread_once_t timeStringKeyOnce = PTHREAD_ONCE_INIT;
+
+
 char * create_string(const char *str)
 {
     char *p;
@@ -346,22 +360,75 @@ char * create_time_delta_string(time_t t0, time_t t1)
 
 int write_time_string(time_t t, char *dst, size_t dstlen)
 {
+/*  Since log timestamps are written for every new line, the last time string
+ *    is cached so localtime() & strftime() are only needed once per second.
+ *    The cache is thread-specific, so no lock is taken.
+ *  The coarse realtime clock is used for the current time where available.
+ */
+    time_string_cache_t *cache;
+#ifdef CLOCK_REALTIME_COARSE
+    struct timespec ts;
+#endif /* CLOCK_REALTIME_COARSE */
     struct tm tm;
-    int n;
+    int n = 20;
 
     if (dstlen <= 20) {                 /* "YYYY-MM-DD HH:MM:SS " + NUL */
         return(0);
     }
-    get_localtime(&t, &tm);
-
-    if (!(n = strftime(dst, dstlen, "%Y-%m-%d %H:%M:%S ", &tm))) {
-        return(0);
+    if (t == 0) {
+#ifdef CLOCK_REALTIME_COARSE
+        if (clock_gettime(CLOCK_REALTIME_COARSE, &ts) == 0) {
+            t = ts.tv_sec;
+        }
+        else
+#endif /* CLOCK_REALTIME_COARSE */
+        if (time(&t) == (time_t) -1) {
+            log_err(errno, "time() failed");
+        }
+    }
+    if ((errno = pthread_once(&timeStringKeyOnce,
+      create_time_string_key)) != 0) {
+        log_err(errno, "Unable to create time string key");
+    }
+    if (!(cache = pthread_getspecific(timeStringKey))) {
+        if (!(cache = malloc(sizeof(time_string_cache_t)))) {
+            out_of_memory();
+        }
+        cache->t = 0;
+        if ((errno = pthread_setspecific(timeStringKey, cache)) != 0) {
+            log_err(errno, "Unable to set time string key");
+        }
+    }
+    if ((t != cache->t) || (cache->t == 0)) {
+        get_localtime(&t, &tm);
+        if (!(n = strftime(cache->str, sizeof(cache->str),
+          "%Y-%m-%d %H:%M:%S ", &tm))) {
+            cache->t = 0;
+        }
+        else {
+            assert(n == 20);
+            cache->t = t;
+        }
+    }
+    if (n > 0) {
+        memcpy(dst, cache->str, sizeof(cache->str));
     }
-    assert(n == 20);
     return(n);
 }
 
 
+static void create_time_string_key(void)
+{
+/*  Creates the key for the time string cache of each thread, which is
+ *    freed when the thread exits.
+ */
+    if ((errno = pthread_key_create(&timeStringKey, free)) != 0) {
+        log_err(errno, "Unable to create time string key");
+    }
+    return;
+}
+
+
 struct tm * get_localtime(time_t *tPtr, struct tm *tmPtr)
 {
 #if ! HAVE_LOCALTIME_R
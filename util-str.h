@@ -133,6 +133,8 @@ int write_time_string(time_t t, char *dst, size_t dstlen);
  *  Writes the time string "YYYY-MM-DD HH:MM:SS " specified by (t)
  *    into the buffer (dst) of size (dstlen).
  *  If no time is given (t=0), the current date & time is used.
+ *  The most recent time string is cached per thread and reused for the
+ *    same second.
  *  Returns the number of characters written (not including the NUL).
  */
 
@@ -0,0 +1,146 @@
+/*****************************************************************************
+ *  Written by Chris Dunlap <cdunlap@llnl.gov>.
+ *  Copyright (C) 2007-2016 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  UCRL-CODE-2002-009.
+ *
+ *  This file is part of ConMan: The Console Manager.
+ *  For details, see <https://dun.github.io/conman/>.
+ *
+ *  ConMan is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  ConMan is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with ConMan.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************
+ *  Refer to "util-tty.h" for documentation on public functions.
+ *****************************************************************************/
+
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+/*  This file does not include <termios.h> since the Linux termios2 struct
+ *    conflicts with its definition of struct termios.
+ */
+#include <errno.h>
+#include <sys/ioctl.h>
+#if HAVE_ASM_TERMBITS_H
+#  include <asm/termbits.h>
+#endif /* HAVE_ASM_TERMBITS_H */
+#if HAVE_LINUX_SERIAL_H
+#  include <linux/serial.h>
+#endif /* HAVE_LINUX_SERIAL_H */
+#if HAVE_IOKIT_SERIAL_IOSS_H
+#  include <IOKit/serial/ioss.h>
+#endif /* HAVE_IOKIT_SERIAL_IOSS_H */
+#include "util-tty.h"
+
+
+#if defined(TCGETS2) && defined(TCSETS2) && defined(BOTHER)
+#  define TTY_CUSTOM_SPEED_TERMIOS2 1
+#elif defined(IOSSIOSPEED)
+#  define TTY_CUSTOM_SPEED_IOSSIOSPEED 1
+#endif /* TCSETS2 && BOTHER */
+
+
+int is_tty_custom_speed_supported(void)
+{
+#if TTY_CUSTOM_SPEED_TERMIOS2 || TTY_CUSTOM_SPEED_IOSSIOSPEED
+    return(1);
+#else
+    return(0);
+#endif /* TTY_CUSTOM_SPEED_TERMIOS2 || TTY_CUSTOM_SPEED_IOSSIOSPEED */
+}
+
+
+int set_tty_custom_speed(int fd, int baud)
+{
+#if TTY_CUSTOM_SPEED_TERMIOS2
+    struct termios2 tio;
+
+    if ((fd < 0) || (baud <= 0)) {
+        errno = EINVAL;
+        return(-1);
+    }
+    if (ioctl(fd, TCGETS2, &tio) < 0) {
+        return(-1);
+    }
+    tio.c_cflag &= ~CBAUD;
+    tio.c_cflag |= BOTHER;
+    tio.c_ispeed = baud;
+    tio.c_ospeed = baud;
+#ifdef IBSHIFT
+    tio.c_cflag &= ~(CBAUD << IBSHIFT);
+    tio.c_cflag |= (BOTHER << IBSHIFT);
+#endif /* IBSHIFT */
+    if (ioctl(fd, TCSETS2, &tio) < 0) {
+        return(-1);
+    }
+    return(0);
+
+#elif TTY_CUSTOM_SPEED_IOSSIOSPEED
+    speed_t speed = (speed_t) baud;
+
+    if ((fd < 0) || (baud <= 0)) {
+        errno = EINVAL;
+        return(-1);
+    }
+    if (ioctl(fd, IOSSIOSPEED, &speed) < 0) {
+        return(-1);
+    }
+    return(0);
+
+#else
+    errno = ENOTSUP;
+    return(-1);
+#endif /* TTY_CUSTOM_SPEED_TERMIOS2 */
+}
+
+
+int set_tty_low_latency(int fd)
+{
+#if defined(TIOCGSERIAL) && defined(TIOCSSERIAL) && defined(ASYNC_LOW_LATENCY)
+    struct serial_struct ss;
+
+    if (fd < 0) {
+        errno = EINVAL;
+        return(-1);
+    }
+    if (ioctl(fd, TIOCGSERIAL, &ss) < 0) {
+        return(-1);
+    }
+    if (ss.flags & ASYNC_LOW_LATENCY) {
+        return(0);
+    }
+    ss.flags |= ASYNC_LOW_LATENCY;
+    if (ioctl(fd, TIOCSSERIAL, &ss) < 0) {
+        return(-1);
+    }
+    return(0);
+
+#elif defined(IOSSDATALAT)
+    unsigned long usecs = 1;
+
+    if (fd < 0) {
+        errno = EINVAL;
+        return(-1);
+    }
+    if (ioctl(fd, IOSSDATALAT, &usecs) < 0) {
+        return(-1);
+    }
+    return(0);
+
+#else
+    errno = ENOTSUP;
+    return(-1);
+#endif /* TIOCSSERIAL && ASYNC_LOW_LATENCY */
+}
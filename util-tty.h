@@ -0,0 +1,56 @@
+/*****************************************************************************
+ *  Written by Chris Dunlap <cdunlap@llnl.gov>.
+ *  Copyright (C) 2007-2016 Lawrence Livermore National Security, LLC.
+ *  Copyright (C) 2001-2007 The Regents of the University of California.
+ *  UCRL-CODE-2002-009.
+ *
+ *  This file is part of ConMan: The Console Manager.
+ *  For details, see <https://dun.github.io/conman/>.
+ *
+ *  ConMan is free software: you can redistribute it and/or modify it under
+ *  the terms of the GNU General Public License as published by the Free
+ *  Software Foundation, either version 3 of the License, or (at your option)
+ *  any later version.
+ *
+ *  ConMan is distributed in the hope that it will be useful, but WITHOUT
+ *  ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ *  FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ *  for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with ConMan.  If not, see <http://www.gnu.org/licenses/>.
+ *****************************************************************************/
+
+
+#ifndef _UTIL_TTY_H
+#define _UTIL_TTY_H
+
+#if HAVE_CONFIG_H
+#  include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+
+int is_tty_custom_speed_supported(void);
+/*
+ *  Returns true if set_tty_custom_speed() is supported on this platform.
+ */
+
+int set_tty_custom_speed(int fd, int baud);
+/*
+ *  Sets both the input and output speed of the terminal (fd) to (baud),
+ *    which need not be one of the speeds defined for cfsetospeed().
+ *    This must be called after the terminal's attributes have been set
+ *    since tcsetattr() may revert the speed.
+ *  Returns 0 on success, or -1 on error (with errno set).
+ */
+
+int set_tty_low_latency(int fd);
+/*
+ *  Requests the driver of the terminal (fd) to pass received data along
+ *    as soon as possible instead of buffering it (eg, for the 16ms latency
+ *    timer of some USB-serial converters).
+ *  Returns 0 on success, or -1 on error (with errno set).
+ */
+
+
+#endif /* !_UTIL_TTY_H */
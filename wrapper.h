@@ -75,5 +75,55 @@
 
 #endif /* WITH_PTHREADS */
 
+/*  Loads and stores of an int (or ptr) shared between threads w/o a lock.
+ *  A store releases all prior writes to the thread whose load observes it.
+ */
+#if HAVE_ATOMIC_BUILTINS
+
+#  define x_atomic_load(PTR)                                                  \
+     __atomic_load_n((PTR), __ATOMIC_ACQUIRE)
+
+#  define x_atomic_store(PTR,VAL)                                             \
+     __atomic_store_n((PTR), (VAL), __ATOMIC_RELEASE)
+
+#  define x_atomic_load_ptr(PTR)                                              \
+     __atomic_load_n((PTR), __ATOMIC_ACQUIRE)
+
+#  define x_atomic_store_ptr(PTR,VAL)                                         \
+     __atomic_store_n((PTR), (VAL), __ATOMIC_RELEASE)
+
+#else /* !HAVE_ATOMIC_BUILTINS */
+
+#  define x_atomic_load(PTR)          (*(volatile int *) (PTR))
+#  define x_atomic_store(PTR,VAL)     (*(volatile int *) (PTR) = (VAL))
+
+#  define x_atomic_load_ptr(PTR)      (*(void * volatile *) (PTR))
+#  define x_atomic_store_ptr(PTR,VAL) (*(void * volatile *) (PTR) = (VAL))
+
+#endif /* HAVE_ATOMIC_BUILTINS */
+
+/*  Updates and loads of a statistics counter (of any integer type) that is
+ *    read by other threads without a lock.  No ordering is implied, and
+ *    w/o atomic builtins, a concurrent load may observe a stale value.
+ */
+#if HAVE_ATOMIC_BUILTINS
+
+#  define x_counter_add(PTR,VAL)                                              \
+     ((void) __atomic_fetch_add((PTR), (VAL), __ATOMIC_RELAXED))
+
+#  define x_counter_load(PTR)                                                 \
+     __atomic_load_n((PTR), __ATOMIC_RELAXED)
+
+#  define x_counter_store(PTR,VAL)                                            \
+     __atomic_store_n((PTR), (VAL), __ATOMIC_RELAXED)
+
+#else /* !HAVE_ATOMIC_BUILTINS */
+
+#  define x_counter_add(PTR,VAL)      ((void) (*(PTR) += (VAL)))
+#  define x_counter_load(PTR)         (*(PTR))
+#  define x_counter_store(PTR,VAL)    (*(PTR) = (VAL))
+
+#endif /* HAVE_ATOMIC_BUILTINS */
+
 
 #endif /* !_WRAPPER_H */